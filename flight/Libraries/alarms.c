@@ -34,16 +34,31 @@
 #include "alarms.h"
 #include "pios_mutex.h"
 #include "pios_reset.h"
+#include "pios_thread.h"
 
 // Private constants
 
+//! Changes are published to SystemAlarms at most this often
+#define ALARMS_PUBLISH_PERIOD_MS 100
+
 // Private types
 
 // Private variables
 static struct pios_mutex *lock;
 
+//! Current severity of each alarm; what SystemAlarms.Alarm is brought up to
+static uint8_t shadow[SYSTEMALARMS_ALARM_NUMELEM];
+
+//! Set when shadow holds changes SystemAlarms doesn't yet have
+static volatile bool publish_pending;
+static uint32_t last_publish;
+
+//! Sets that didn't change anything
+static uint32_t suppressed_updates;
+
 // Private functions
 static int32_t hasSeverity(SystemAlarmsAlarmOptions severity);
+static void publishAlarms();
 
 /**
  * Initialize the alarms library
@@ -54,6 +69,8 @@ int32_t AlarmsInitialize(void)
 	lock = PIOS_Mutex_Create();
 	PIOS_Assert(lock != NULL);
 
+	SystemAlarmsAlarmGet(shadow);
+
 	uint8_t reboot_reason = SYSTEMALARMS_REBOOTCAUSE_UNDEFINED;
 
 	switch (PIOS_RESET_GetResetReason()) {
@@ -89,36 +106,35 @@ int32_t AlarmsInitialize(void)
 }
 
 /**
- * Set an alarm
+ * Set an alarm.  Most callers set their alarm every cycle, so this is
+ * cheap when the severity is unchanged: SystemAlarms is only updated, and
+ * its listeners only woken, when an alarm actually changes, and then no
+ * more often than ALARMS_PUBLISH_PERIOD_MS.  AlarmsFlush() publishes
+ * whatever was held back.
  * @param alarm The system alarm to be modified
  * @param severity The alarm severity
  * @return 0 if success, -1 if an error
  */
 int32_t AlarmsSet(SystemAlarmsAlarmElem alarm, SystemAlarmsAlarmOptions severity)
 {
-	SystemAlarmsData alarms;
-
 	// Check that this is a valid alarm
 	if (alarm >= SYSTEMALARMS_ALARM_NUMELEM)
 	{
 		return -1;
 	}
 
-	// Lock
-	PIOS_Mutex_Lock(lock, PIOS_MUTEX_TIMEOUT_MAX);
+	if (__atomic_exchange_n(&shadow[alarm], severity, __ATOMIC_RELAXED) == severity) {
+		__atomic_fetch_add(&suppressed_updates, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
 
-    // Read alarm and update its severity only if it was changed
-    SystemAlarmsGet(&alarms);
-    if ( alarms.Alarm[alarm] != severity )
-    {
-    	alarms.Alarm[alarm] = severity;
-    	SystemAlarmsSet(&alarms);
-    }
+	// Only after the shadow is updated, so a publish that sees this
+	// takes the new severity with it
+	publish_pending = true;
 
-    // Release lock
-    PIOS_Mutex_Unlock(lock);
-    return 0;
+	publishAlarms();
 
+	return 0;
 }
 
 /**
@@ -128,17 +144,13 @@ int32_t AlarmsSet(SystemAlarmsAlarmElem alarm, SystemAlarmsAlarmOptions severity
  */
 SystemAlarmsAlarmOptions AlarmsGet(SystemAlarmsAlarmElem alarm)
 {
-	SystemAlarmsData alarms;
-
 	// Check that this is a valid alarm
 	if (alarm >= SYSTEMALARMS_ALARM_NUMELEM)
 	{
 		return 0;
 	}
 
-    // Read alarm
-    SystemAlarmsGet(&alarms);
-    return alarms.Alarm[alarm];
+	return __atomic_load_n(&shadow[alarm], __ATOMIC_RELAXED);
 }
 
 /**
@@ -185,6 +197,26 @@ void AlarmsClearAll()
     }
 }
 
+/**
+ * Publish alarm changes that were held back to bound the update rate.
+ * Called periodically by the system module.
+ */
+void AlarmsFlush()
+{
+	if (publish_pending) {
+		publishAlarms();
+	}
+}
+
+/**
+ * Get how many alarm sets left the severity as it was, and so were not
+ * published
+ */
+uint32_t AlarmsGetSuppressed()
+{
+	return __atomic_load_n(&suppressed_updates, __ATOMIC_RELAXED);
+}
+
 /**
  * Check if there are any alarms with the given or higher severity
  * @return 0 if no alarms are found, 1 if at least one alarm is found
@@ -218,30 +250,51 @@ int32_t AlarmsHasCritical()
  */
 static int32_t hasSeverity(SystemAlarmsAlarmOptions severity)
 {
-	SystemAlarmsData alarms;
 	uint32_t n;
 
-	// Lock
-	PIOS_Mutex_Lock(lock, PIOS_MUTEX_TIMEOUT_MAX);
-
-    // Read alarms
-    SystemAlarmsGet(&alarms);
-
     // Go through alarms and check if any are of the given severity or higher
     for (n = 0; n < SYSTEMALARMS_ALARM_NUMELEM; ++n)
     {
-    	if ( alarms.Alarm[n] >= severity)
+    	if (__atomic_load_n(&shadow[n], __ATOMIC_RELAXED) >= severity)
     	{
-    		PIOS_Mutex_Unlock(lock);
     		return 1;
     	}
     }
 
     // If this point is reached then no alarms found
-	PIOS_Mutex_Unlock(lock);
     return 0;
 }
 
+/**
+ * Copy the shadow alarms into SystemAlarms, if there are changes and the
+ * last publish was long enough ago
+ */
+static void publishAlarms()
+{
+	uint8_t alarms[SYSTEMALARMS_ALARM_NUMELEM];
+
+	// Lock
+	PIOS_Mutex_Lock(lock, PIOS_MUTEX_TIMEOUT_MAX);
+
+	uint32_t now = PIOS_Thread_Systime();
+
+	if (publish_pending && (now - last_publish) >= ALARMS_PUBLISH_PERIOD_MS) {
+		// Clear before taking the copy, so a change racing with this
+		// leaves it set and goes out next time
+		publish_pending = false;
+
+		for (uint32_t n = 0; n < SYSTEMALARMS_ALARM_NUMELEM; n++) {
+			alarms[n] = __atomic_load_n(&shadow[n], __ATOMIC_RELAXED);
+		}
+
+		SystemAlarmsAlarmSet(alarms);
+		last_publish = now;
+	}
+
+	// Release lock
+	PIOS_Mutex_Unlock(lock);
+}
+
 static const char alarm_names[][10] = {
 	[SYSTEMALARMS_ALARM_OUTOFMEMORY] = "MEMORY",
 	[SYSTEMALARMS_ALARM_CPUOVERLOAD] = "CPU",
@@ -0,0 +1,579 @@
+/**
+ ******************************************************************************
+ * @addtogroup TauLabsLibraries Tau Labs Libraries
+ * @{
+ *
+ * @file       geofence_index.c
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Polygon fence containment and clearance with a grid index
+ *
+ * The horizontal extent of the fence is covered by a uniform grid with
+ * about one cell per edge.  Each cell lists the edges that touch it, and
+ * remembers which polygons contain its center.  Containment of a point is
+ * then the center's answer, corrected by the edges that cross the short
+ * segment from the center to the point.  Near the boundary the nearest
+ * edge is found by searching rings of cells outwards until no closer edge
+ * can remain; further away, the distance from the cell center, less how far
+ * the point is from the center, is close enough and costs nothing.
+ *
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "pios.h"
+
+#include <math.h>
+#include <float.h>
+
+#include "geofence_index.h"
+
+//! Largest number of cells along either axis
+#define GRID_MAX_DIM 128
+
+//! Border left around the vertices, m; keeps the grid from being degenerate
+#define GRID_BORDER 1.0f
+
+struct fence_edge {
+	uint16_t v[2];
+	uint8_t polygon;
+};
+
+struct geofence_index {
+	uint8_t num_polygons;
+	uint16_t polygon_mask;		// Polygons that were usable
+	uint16_t inclusion_mask;	// Those of them that are inclusions
+	float floor[GEOFENCE_MAX_POLYGONS];
+	float ceiling[GEOFENCE_MAX_POLYGONS];
+
+	uint16_t num_edges;
+	float (*vertices)[2];
+	struct fence_edge *edges;
+
+	float origin[2];		// South west corner of the grid
+	float cell_size;
+	uint16_t dim[2];		// Cells along North, East
+	uint32_t *cell_start;		// Into cell_edges, one more than cells
+	uint16_t *cell_edges;
+	uint16_t *cell_inside;		// Polygons containing each cell center
+	float *cell_clearance;		// Distance from each center to an edge
+};
+
+static inline float orient(const float o[2], const float a[2], const float b[2])
+{
+	return (a[0] - o[0]) * (b[1] - o[1]) - (a[1] - o[1]) * (b[0] - o[0]);
+}
+
+/**
+ * Does segment c-p cross edge a-b?  Points exactly on a line are counted as
+ * being on its negative side, consistently, so that the crossings along any
+ * path from outside give the right parity.
+ */
+static bool crosses(const float c[2], const float p[2],
+		const float a[2], const float b[2])
+{
+	if ((orient(c, p, a) > 0) == (orient(c, p, b) > 0))
+		return false;
+
+	return (orient(a, b, c) > 0) != (orient(a, b, p) > 0);
+}
+
+//! Does segment a-b touch the box lo-hi?  Liang-Barsky clipping.
+static bool segment_hits_box(const float a[2], const float b[2],
+		const float lo[2], const float hi[2])
+{
+	float t0 = 0, t1 = 1;
+
+	for (int k = 0; k < 2; k++) {
+		float d = b[k] - a[k];
+
+		if (d == 0) {
+			if (a[k] < lo[k] || a[k] > hi[k])
+				return false;
+
+			continue;
+		}
+
+		float ta = (lo[k] - a[k]) / d;
+		float tb = (hi[k] - a[k]) / d;
+
+		if (ta > tb) {
+			float tmp = ta;
+			ta = tb;
+			tb = tmp;
+		}
+
+		if (ta > t0)
+			t0 = ta;
+		if (tb < t1)
+			t1 = tb;
+
+		if (t0 > t1)
+			return false;
+	}
+
+	return true;
+}
+
+static float segment_distance2(const float p[2],
+		const float a[2], const float b[2])
+{
+	float d[2] = { b[0] - a[0], b[1] - a[1] };
+	float len2 = d[0] * d[0] + d[1] * d[1];
+	float t = 0;
+
+	if (len2 > 0) {
+		t = ((p[0] - a[0]) * d[0] + (p[1] - a[1]) * d[1]) / len2;
+
+		if (t < 0)
+			t = 0;
+		else if (t > 1)
+			t = 1;
+	}
+
+	float e0 = a[0] + t * d[0] - p[0];
+	float e1 = a[1] + t * d[1] - p[1];
+
+	return e0 * e0 + e1 * e1;
+}
+
+static inline uint32_t cell_id(const struct geofence_index *idx, int i, int j)
+{
+	return (uint32_t) j * idx->dim[0] + i;
+}
+
+static void cell_center(const struct geofence_index *idx, int i, int j,
+		float c[2])
+{
+	c[0] = idx->origin[0] + (i + 0.5f) * idx->cell_size;
+	c[1] = idx->origin[1] + (j + 0.5f) * idx->cell_size;
+}
+
+//! Cell coordinate along axis k, clamped to the grid
+static int cell_coord(const struct geofence_index *idx, int k, float x)
+{
+	float f = (x - idx->origin[k]) / idx->cell_size;
+
+	/* Written so that NaN ends up in cell 0 */
+	if (!(f >= 0))
+		return 0;
+
+	if (f >= idx->dim[k])
+		return idx->dim[k] - 1;
+
+	return (int) f;
+}
+
+/**
+ * Call fn for each cell that edge e touches.  Cells are grown by a small
+ * fraction so that rounding can't leave an edge out of a cell it crosses.
+ */
+static void foreach_edge_cell(struct geofence_index *idx, uint16_t e,
+		void (*fn)(struct geofence_index *idx, uint32_t cell, uint16_t e))
+{
+	const float *a = idx->vertices[idx->edges[e].v[0]];
+	const float *b = idx->vertices[idx->edges[e].v[1]];
+	const float grow = idx->cell_size * 1e-3f;
+
+	int i0 = cell_coord(idx, 0, fminf(a[0], b[0]) - grow);
+	int i1 = cell_coord(idx, 0, fmaxf(a[0], b[0]) + grow);
+	int j0 = cell_coord(idx, 1, fminf(a[1], b[1]) - grow);
+	int j1 = cell_coord(idx, 1, fmaxf(a[1], b[1]) + grow);
+
+	for (int j = j0; j <= j1; j++) {
+		for (int i = i0; i <= i1; i++) {
+			float lo[2], hi[2];
+
+			lo[0] = idx->origin[0] + i * idx->cell_size - grow;
+			lo[1] = idx->origin[1] + j * idx->cell_size - grow;
+			hi[0] = lo[0] + idx->cell_size + 2 * grow;
+			hi[1] = lo[1] + idx->cell_size + 2 * grow;
+
+			if (segment_hits_box(a, b, lo, hi))
+				fn(idx, cell_id(idx, i, j), e);
+		}
+	}
+}
+
+static void count_edge(struct geofence_index *idx, uint32_t cell, uint16_t e)
+{
+	(void) e;
+
+	idx->cell_start[cell + 1]++;
+}
+
+/* cell_inside is still free at this point and serves as the fill cursor */
+static void store_edge(struct geofence_index *idx, uint32_t cell, uint16_t e)
+{
+	idx->cell_edges[idx->cell_start[cell] + idx->cell_inside[cell]++] = e;
+}
+
+//! Flip the polygons whose edges in cell cross segment c-p
+static uint16_t cell_crossings(const struct geofence_index *idx, uint32_t cell,
+		const float c[2], const float p[2], uint16_t *stamps, uint16_t stamp)
+{
+	uint16_t flips = 0;
+
+	for (uint32_t k = idx->cell_start[cell]; k < idx->cell_start[cell + 1]; k++) {
+		uint16_t e = idx->cell_edges[k];
+
+		if (stamps) {
+			if (stamps[e] == stamp)
+				continue;
+
+			stamps[e] = stamp;
+		}
+
+		const struct fence_edge *edge = &idx->edges[e];
+
+		if (crosses(c, p, idx->vertices[edge->v[0]],
+					idx->vertices[edge->v[1]]))
+			flips ^= 1 << edge->polygon;
+	}
+
+	return flips;
+}
+
+/**
+ * Work out which polygons contain each cell center.  The first center of
+ * each row is tested against every edge, from a point outside the grid;
+ * each following center only needs the edges of the two cells between it
+ * and the previous one.
+ */
+static bool compute_cell_inside(struct geofence_index *idx)
+{
+	uint16_t *stamps = PIOS_malloc(idx->num_edges * sizeof(*stamps));
+
+	if (!stamps)
+		return false;
+
+	memset(stamps, 0, idx->num_edges * sizeof(*stamps));
+
+	uint16_t stamp = 0;
+
+	for (int j = 0; j < idx->dim[1]; j++) {
+		float prev[2], cur[2];
+		uint16_t inside = 0;
+
+		cell_center(idx, 0, j, cur);
+		prev[0] = idx->origin[0] - idx->cell_size;
+		prev[1] = cur[1];
+
+		for (uint16_t e = 0; e < idx->num_edges; e++) {
+			const struct fence_edge *edge = &idx->edges[e];
+
+			if (crosses(prev, cur, idx->vertices[edge->v[0]],
+						idx->vertices[edge->v[1]]))
+				inside ^= 1 << edge->polygon;
+		}
+
+		idx->cell_inside[cell_id(idx, 0, j)] = inside;
+
+		for (int i = 1; i < idx->dim[0]; i++) {
+			prev[0] = cur[0];
+			cell_center(idx, i, j, cur);
+
+			/* Stamps keep an edge in both cells from counting twice */
+			if (++stamp == 0) {
+				memset(stamps, 0, idx->num_edges * sizeof(*stamps));
+				stamp = 1;
+			}
+
+			inside ^= cell_crossings(idx, cell_id(idx, i - 1, j),
+					prev, cur, stamps, stamp);
+			inside ^= cell_crossings(idx, cell_id(idx, i, j),
+					prev, cur, stamps, stamp);
+
+			idx->cell_inside[cell_id(idx, i, j)] = inside;
+		}
+	}
+
+	PIOS_free(stamps);
+
+	return true;
+}
+
+//! Distance to the closest edge, searching rings of cells around (ci, cj)
+static float nearest_edge(const struct geofence_index *idx, const float p[2],
+		int ci, int cj)
+{
+	float best2 = FLT_MAX;
+
+	for (int r = 0; ; r++) {
+		int i0 = ci - r, i1 = ci + r;
+		int j0 = cj - r, j1 = cj + r;
+
+		int j_end = (j1 < idx->dim[1]) ? j1 : idx->dim[1] - 1;
+		int i_end = (i1 < idx->dim[0]) ? i1 : idx->dim[0] - 1;
+
+		for (int j = (j0 > 0) ? j0 : 0; j <= j_end; j++) {
+			bool full_row = (j == j0) || (j == j1);
+
+			for (int i = (i0 > 0) ? i0 : 0; i <= i_end; i++) {
+				if (!full_row && i != i0 && i != i1)
+					continue;
+
+				uint32_t cell = cell_id(idx, i, j);
+
+				for (uint32_t k = idx->cell_start[cell];
+						k < idx->cell_start[cell + 1]; k++) {
+					const struct fence_edge *edge =
+						&idx->edges[idx->cell_edges[k]];
+
+					float d2 = segment_distance2(p,
+							idx->vertices[edge->v[0]],
+							idx->vertices[edge->v[1]]);
+
+					if (d2 < best2)
+						best2 = d2;
+				}
+			}
+		}
+
+		/* Anything not searched yet is beyond one of the sides of the
+		 * searched square that aren't at the edge of the grid */
+		float bound = FLT_MAX;
+
+		if (i0 > 0)
+			bound = fminf(bound, p[0] - (idx->origin[0] + i0 * idx->cell_size));
+		if (i1 < idx->dim[0] - 1)
+			bound = fminf(bound, idx->origin[0] + (i1 + 1) * idx->cell_size - p[0]);
+		if (j0 > 0)
+			bound = fminf(bound, p[1] - (idx->origin[1] + j0 * idx->cell_size));
+		if (j1 < idx->dim[1] - 1)
+			bound = fminf(bound, idx->origin[1] + (j1 + 1) * idx->cell_size - p[1]);
+
+		if (bound == FLT_MAX || best2 <= bound * bound)
+			break;
+	}
+
+	return sqrtf(best2);
+}
+
+struct geofence_index *geofence_index_build(
+		const struct geofence_polygon *polygons, uint8_t num_polygons,
+		const float (*vertices)[2], uint16_t num_vertices)
+{
+	uint32_t num_edges = 0;
+	uint16_t polygon_mask = 0;
+
+	if (num_polygons > GEOFENCE_MAX_POLYGONS)
+		num_polygons = GEOFENCE_MAX_POLYGONS;
+
+	/* Skip polygons that don't make sense rather than failing outright */
+	for (int k = 0; k < num_polygons; k++) {
+		const struct geofence_polygon *poly = &polygons[k];
+
+		if (poly->num_vertices < 3)
+			continue;
+
+		if ((uint32_t) poly->first_vertex + poly->num_vertices > num_vertices)
+			continue;
+
+		polygon_mask |= 1 << k;
+		num_edges += poly->num_vertices;
+	}
+
+	if (!polygon_mask || num_edges > UINT16_MAX)
+		return NULL;
+
+	/* Size the grid to the vertices, about one cell per edge */
+	float lo[2] = { FLT_MAX, FLT_MAX };
+	float hi[2] = { -FLT_MAX, -FLT_MAX };
+
+	for (int k = 0; k < num_polygons; k++) {
+		if (!(polygon_mask & (1 << k)))
+			continue;
+
+		for (int v = 0; v < polygons[k].num_vertices; v++) {
+			const float *vert = vertices[polygons[k].first_vertex + v];
+
+			for (int a = 0; a < 2; a++) {
+				lo[a] = fminf(lo[a], vert[a]);
+				hi[a] = fmaxf(hi[a], vert[a]);
+			}
+		}
+	}
+
+	float width = hi[0] - lo[0] + 2 * GRID_BORDER;
+	float height = hi[1] - lo[1] + 2 * GRID_BORDER;
+	float cell_size = sqrtf(width * height / num_edges);
+	uint16_t dim[2];
+
+	dim[0] = fminf(fmaxf(ceilf(width / cell_size), 1), GRID_MAX_DIM);
+	dim[1] = fminf(fmaxf(ceilf(height / cell_size), 1), GRID_MAX_DIM);
+	cell_size = fmaxf(width / dim[0], height / dim[1]);
+
+	uint32_t num_cells = (uint32_t) dim[0] * dim[1];
+
+	/* Everything but the cell edge lists goes in one allocation */
+	size_t size = sizeof(struct geofence_index) +
+		(num_cells + 1) * sizeof(uint32_t) +
+		num_edges * sizeof(float[2]) +
+		num_edges * sizeof(struct fence_edge) +
+		num_cells * sizeof(float) +
+		num_cells * sizeof(uint16_t);
+
+	struct geofence_index *idx = PIOS_malloc(size);
+
+	if (!idx)
+		return NULL;
+
+	memset(idx, 0, size);
+
+	idx->cell_start = (uint32_t *) (idx + 1);
+	idx->vertices = (float (*)[2]) (idx->cell_start + num_cells + 1);
+	idx->edges = (struct fence_edge *) (idx->vertices + num_edges);
+	idx->cell_clearance = (float *) (idx->edges + num_edges);
+	idx->cell_inside = (uint16_t *) (idx->cell_clearance + num_cells);
+
+	idx->num_polygons = num_polygons;
+	idx->polygon_mask = polygon_mask;
+	idx->num_edges = num_edges;
+	idx->origin[0] = lo[0] - GRID_BORDER;
+	idx->origin[1] = lo[1] - GRID_BORDER;
+	idx->cell_size = cell_size;
+	idx->dim[0] = dim[0];
+	idx->dim[1] = dim[1];
+
+	/* Copy the vertices of the usable polygons, and link them up */
+	uint16_t n = 0;
+
+	for (int k = 0; k < num_polygons; k++) {
+		const struct geofence_polygon *poly = &polygons[k];
+
+		if (!(polygon_mask & (1 << k)))
+			continue;
+
+		if (poly->type == GEOFENCE_POLYGON_INCLUSION)
+			idx->inclusion_mask |= 1 << k;
+
+		idx->floor[k] = poly->floor;
+		idx->ceiling[k] = poly->ceiling;
+
+		for (int v = 0; v < poly->num_vertices; v++) {
+			idx->vertices[n + v][0] = vertices[poly->first_vertex + v][0];
+			idx->vertices[n + v][1] = vertices[poly->first_vertex + v][1];
+
+			idx->edges[n + v].v[0] = n + v;
+			idx->edges[n + v].v[1] = n + (v + 1) % poly->num_vertices;
+			idx->edges[n + v].polygon = k;
+		}
+
+		n += poly->num_vertices;
+	}
+
+	/* Bucket the edges by cell: count, then fill */
+	for (uint16_t e = 0; e < idx->num_edges; e++)
+		foreach_edge_cell(idx, e, count_edge);
+
+	for (uint32_t c = 0; c < num_cells; c++)
+		idx->cell_start[c + 1] += idx->cell_start[c];
+
+	idx->cell_edges = PIOS_malloc(idx->cell_start[num_cells] * sizeof(uint16_t));
+
+	if (!idx->cell_edges) {
+		PIOS_free(idx);
+		return NULL;
+	}
+
+	for (uint16_t e = 0; e < idx->num_edges; e++)
+		foreach_edge_cell(idx, e, store_edge);
+
+	if (!compute_cell_inside(idx)) {
+		geofence_index_free(idx);
+		return NULL;
+	}
+
+	for (int j = 0; j < idx->dim[1]; j++) {
+		for (int i = 0; i < idx->dim[0]; i++) {
+			float c[2];
+
+			cell_center(idx, i, j, c);
+			idx->cell_clearance[cell_id(idx, i, j)] =
+				nearest_edge(idx, c, i, j);
+		}
+	}
+
+	return idx;
+}
+
+void geofence_index_free(struct geofence_index *idx)
+{
+	if (!idx)
+		return;
+
+	PIOS_free(idx->cell_edges);
+	PIOS_free(idx);
+}
+
+void geofence_index_check(const struct geofence_index *idx,
+		const float pos[3], struct geofence_check *result)
+{
+	const float p[2] = { pos[0], pos[1] };
+	const float altitude = -pos[2];
+
+	int ci = cell_coord(idx, 0, p[0]);
+	int cj = cell_coord(idx, 1, p[1]);
+	uint32_t cell = cell_id(idx, ci, cj);
+	float c[2];
+
+	cell_center(idx, ci, cj, c);
+
+	/* Outside the grid means outside every polygon */
+	uint16_t footprint = 0;
+
+	if (p[0] >= idx->origin[0] &&
+			p[0] <= idx->origin[0] + idx->dim[0] * idx->cell_size &&
+			p[1] >= idx->origin[1] &&
+			p[1] <= idx->origin[1] + idx->dim[1] * idx->cell_size) {
+		footprint = idx->cell_inside[cell] ^
+			cell_crossings(idx, cell, c, p, NULL, 0);
+	}
+
+	/* Far from the boundary, a lower bound from the cell center is within
+	 * a cell diagonal of the truth, which is plenty */
+	float margin = idx->cell_clearance[cell] -
+		sqrtf((p[0] - c[0]) * (p[0] - c[0]) + (p[1] - c[1]) * (p[1] - c[1]));
+
+	if (margin < 2 * idx->cell_size)
+		margin = nearest_edge(idx, p, ci, cj);
+
+	uint16_t inside = 0;
+
+	for (int k = 0; k < idx->num_polygons; k++) {
+		if (!(footprint & (1 << k)))
+			continue;
+
+		float to_floor = altitude - idx->floor[k];
+		float to_ceiling = idx->ceiling[k] - altitude;
+
+		if (to_floor >= 0 && to_ceiling >= 0)
+			inside |= 1 << k;
+
+		margin = fminf(margin, fminf(fabsf(to_floor), fabsf(to_ceiling)));
+	}
+
+	bool included = !idx->inclusion_mask || (inside & idx->inclusion_mask);
+	bool excluded = inside & ~idx->inclusion_mask;
+
+	result->allowed = included && !excluded;
+	result->margin = result->allowed ? margin : -margin;
+}
+
+/**
+ * @}
+ */
@@ -37,6 +37,8 @@ int32_t AlarmsDefault(SystemAlarmsAlarmElem alarm);
 void AlarmsDefaultAll();
 int32_t AlarmsClear(SystemAlarmsAlarmElem alarm);
 void AlarmsClearAll();
+void AlarmsFlush();
+uint32_t AlarmsGetSuppressed();
 int32_t AlarmsHasWarnings();
 int32_t AlarmsHasErrors();
 int32_t AlarmsHasCritical();
@@ -0,0 +1,87 @@
+/**
+ ******************************************************************************
+ * @addtogroup TauLabsLibraries Tau Labs Libraries
+ * @{
+ *
+ * @file       geofence_index.h
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Polygon fence containment and clearance with a grid index
+ *
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef GEOFENCE_INDEX_H
+#define GEOFENCE_INDEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//! Polygons are tracked in a bitmask, so there can't be more than this
+#define GEOFENCE_MAX_POLYGONS 16
+
+enum geofence_polygon_type {
+	GEOFENCE_POLYGON_INCLUSION,	//!< Flying is only allowed inside
+	GEOFENCE_POLYGON_EXCLUSION,	//!< Flying is not allowed inside
+};
+
+//! One fenced volume: a polygon extruded from floor to ceiling
+struct geofence_polygon {
+	enum geofence_polygon_type type;
+	float floor;			// m above home
+	float ceiling;			// m above home
+	uint16_t first_vertex;		// Index of the first vertex
+	uint16_t num_vertices;		// At least 3; closes back to the first
+};
+
+//! Outcome of checking a position against the fence
+struct geofence_check {
+	bool allowed;			// Outside exclusions, inside an inclusion
+	float margin;			// m to the nearest boundary; < 0 if !allowed
+};
+
+struct geofence_index;
+
+/**
+ * Build the index for a set of polygons.  Vertices are {North, East} in m
+ * and are copied, so the caller's arrays may be freed afterwards.
+ * @returns the index, or NULL if there is no usable polygon or no memory
+ */
+struct geofence_index *geofence_index_build(
+		const struct geofence_polygon *polygons, uint8_t num_polygons,
+		const float (*vertices)[2], uint16_t num_vertices);
+
+void geofence_index_free(struct geofence_index *idx);
+
+/**
+ * Check a position against the fence.
+ * @param[in] idx the fence
+ * @param[in] pos {North, East, Down} relative to home, m
+ * @param[out] result whether pos is allowed, and how close the nearest
+ * boundary is.  The margin counts every polygon edge, and the floors and
+ * ceilings of the polygons pos is over, so it never overstates clearance.
+ * It is exact near the boundary; further than a couple of grid cells away
+ * it may be low by up to a cell diagonal.
+ */
+void geofence_index_check(const struct geofence_index *idx,
+		const float pos[3], struct geofence_check *result);
+
+#endif /* GEOFENCE_INDEX_H */
+
+/**
+ * @}
+ */
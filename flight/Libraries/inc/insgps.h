@@ -77,6 +77,9 @@ void INSSetArmed(bool armed);
 /****************************************************/
 
 void INSResetP(const float *PDiag);
+
+//! Let the simulator save and restore the filter
+void INSRegisterSnapshot();
 void INSSetState(const float pos[3], const float vel[3], const float q[4], const float gyro_bias[3], const float accel_bias[3]);
 void INSSetPosVelVar(float PosVar, float VelVar, float VertPosVar);
 void INSSetGyroBias(const float gyro_bias[3]);
@@ -0,0 +1,88 @@
+/**
+ ******************************************************************************
+ * @addtogroup TauLabsLibraries Tau Labs Libraries
+ * @{
+ *
+ * @file       loop_timing.h
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Histograms of control loop jitter, run time and latency
+ *
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef LOOP_TIMING_H
+#define LOOP_TIMING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Bucket 0 counts 0us; bucket n counts [2^(n-1), 2^n) us, and the last
+ * bucket everything above.  Must match the LoopTiming UAVO. */
+#define LOOP_TIMING_NUM_BUCKETS 16
+
+struct loop_timing_hist {
+	uint16_t counts[LOOP_TIMING_NUM_BUCKETS];
+	uint16_t max;			// us, saturating
+};
+
+struct loop_timing {
+	uint32_t nominal_us;		// Expected period
+	uint32_t start;			// PIOS_DELAY raw time this iteration started
+	bool started;
+
+	struct loop_timing_hist jitter;	// |period - nominal|
+	struct loop_timing_hist execution;
+};
+
+/**
+ * Adds a sample to a histogram.  When a bucket fills, every bucket is
+ * halved, so the shape keeps following the recent past.
+ */
+void loop_timing_add(struct loop_timing_hist *hist, uint32_t us);
+
+/**
+ * Sets up timing for a loop expected to run every nominal_us.
+ */
+void loop_timing_init(struct loop_timing *timing, uint32_t nominal_us);
+
+/**
+ * Call when the loop wakes, to time its period.
+ */
+void loop_timing_begin(struct loop_timing *timing);
+
+/**
+ * Call when the loop has produced its output, to time its run.
+ */
+void loop_timing_end(struct loop_timing *timing);
+
+/**
+ * Call when a new gyro sample has been published.
+ */
+void loop_timing_sample(void);
+
+/**
+ * Call when outputs are written, to add the time since the oldest gyro
+ * sample not yet acted on to latency.
+ */
+void loop_timing_output(struct loop_timing_hist *latency);
+
+#endif /* LOOP_TIMING_H */
+
+/**
+ * @}
+ */
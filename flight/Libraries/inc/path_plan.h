@@ -0,0 +1,76 @@
+/**
+ ******************************************************************************
+ * @addtogroup TauLabsLibraries Tau Labs Libraries
+ * @{
+ *
+ * @file       path_plan.h
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Precomputes corners and speeds along a route of waypoints
+ *
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef PATH_PLAN_H
+#define PATH_PLAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * One leg of the route, ending at a waypoint.  The caller fills in end,
+ * velocity and straight; path_plan_build() fills in the rest and lowers
+ * velocity where the limits require it.
+ */
+struct path_plan_leg {
+	float end[3];			// NED, m
+	float velocity;			// Speed at the end, m/s
+	bool straight;			// A vector leg, which can be filleted
+
+	float length;			// Horizontal, from the previous end; 0 for the first leg
+	float corner_distance;		// Distance before end the fillet starts, m; 0 for none
+	float corner_curvature;		// Of the fillet, 1/m, positive turning right
+};
+
+struct path_plan_limits {
+	float corner_radius;		// m; 0 for sharp corners
+	float corner_accel;		// Sideways, m/s^2; 0 for no limit
+	float max_accel;		// Along the route, m/s^2; 0 for no limit
+};
+
+/**
+ * Work out the route once, so followers only need to look it up.
+ *
+ * Corners are filleted where a straight leg meets another, with the
+ * radius shrunk so that no fillet takes more than half of either leg.
+ * The first leg's start isn't known until it is flown, so the corner at
+ * its end is left sharp.  Speeds are then lowered to what the fillet
+ * allows sideways and what can be reached along each leg from its
+ * neighbours.
+ *
+ * @param[in,out] legs the route
+ * @param[in] num_legs its length
+ * @param[in] limits what the airframe can do
+ */
+void path_plan_build(struct path_plan_leg *legs, int num_legs,
+		const struct path_plan_limits *limits);
+
+#endif /* PATH_PLAN_H */
+
+/**
+ * @}
+ */
@@ -32,6 +32,7 @@
 #include "pios.h"
 #include "openpilot.h"
 #include "pathdesired.h"
+#include "pathlookahead.h"
 
 struct path_status {
 	float fractional_progress;
@@ -41,6 +42,9 @@ struct path_status {
 };
 
 void path_progress(const PathDesiredData *pathDesired, const float * cur_point, struct path_status * status);
+bool path_progress_lookahead(const PathDesiredData *pathDesired,
+		const PathLookaheadData *lookahead, const float *cur_point,
+		struct path_status *status);
 
 #endif /* PATHS_H_ */
 
@@ -0,0 +1,109 @@
+/**
+ ******************************************************************************
+ * @addtogroup TauLabsLibraries Tau Labs Libraries
+ * @{
+ *
+ * @file       rls_ident.h
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Recursive least squares identification of an axis' response
+ *
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef RLS_IDENT_H
+#define RLS_IDENT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Delays tried, in samples, from 0 up */
+#define RLS_IDENT_NUM_DELAYS 6
+
+/*
+ * Each axis is modelled as the actuator driving angular acceleration
+ * through a first order lag and a dead time:
+ *
+ *   a[k] = alpha a[k-1] + b u[k-1-delay] + c
+ *
+ * One least squares fit runs for each delay, and the one predicting best
+ * gives the estimate.  Each fit regresses on the acceleration it predicted
+ * itself rather than the differentiated gyro, whose noise would otherwise
+ * drag alpha and the gain down.  Old samples are forgotten, so the fits
+ * follow the aircraft as it changes, in constant memory.
+ */
+
+struct rls_ident_fit {
+	float theta[3];			// alpha, b, c
+	float P[3][3];			// Covariance of theta
+	float err_sq;			// Smoothed squared prediction error
+	float model_accel;		// What the fit itself predicted last
+};
+
+struct rls_ident {
+	struct rls_ident_fit fits[RLS_IDENT_NUM_DELAYS];
+
+	float u_hist[RLS_IDENT_NUM_DELAYS];	// u[k-1], u[k-2], ...
+	float last_rate;
+	uint8_t refill;			// Samples until u_hist is real again
+
+	float dT;
+	float lambda;			// Forgetting factor
+	uint32_t samples;
+};
+
+struct rls_ident_estimate {
+	float gain;			// (deg/s^2) / actuator
+	float tau;			// Lag time constant, s
+	float delay;			// Dead time, s
+	float bias;			// deg/s^2 with no actuation
+	float noise;			// RMS prediction error, deg/s^2
+};
+
+/**
+ * Starts identifying afresh.
+ * @param[out] ident state to set up
+ * @param[in] dT sample period, s
+ * @param[in] memory roughly how long samples are remembered, s
+ */
+void rls_ident_init(struct rls_ident *ident, float dT, float memory);
+
+/**
+ * Adds a sample.
+ * @param[in] rate gyro, deg/s
+ * @param[in] u actuator desired
+ */
+void rls_ident_update(struct rls_ident *ident, float rate, float u);
+
+/**
+ * Forgets the sample history after a gap in the samples, so the
+ * acceleration across it isn't fit.  What the fits have learned is kept.
+ */
+void rls_ident_skip_gap(struct rls_ident *ident);
+
+/**
+ * Reads the current estimate from the fit predicting best.
+ * @returns false if there is none yet, or the fit isn't physical
+ */
+bool rls_ident_get_estimate(const struct rls_ident *ident,
+		struct rls_ident_estimate *est);
+
+#endif /* RLS_IDENT_H */
+
+/**
+ * @}
+ */
@@ -0,0 +1,133 @@
+/**
+ ******************************************************************************
+ * @addtogroup TauLabsLibraries Tau Labs Libraries
+ * @{
+ *
+ * @file       stream_sched.h
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Deadline ordered scheduler for periodic telemetry messages
+ *
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef STREAM_SCHED_H
+#define STREAM_SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define STREAM_SCHED_MAX_MESSAGES 16
+
+//! Stream id that addresses every stream, as MAV_DATA_STREAM_ALL does
+#define STREAM_SCHED_ALL_STREAMS 0
+
+/**
+ * One row of the caller's message table.  The scheduler hands back row
+ * indices, so the caller can keep whatever it needs to build the message
+ * (a pack function, say) in a table of its own with the same layout.
+ */
+struct stream_sched_message {
+	uint8_t msgid;
+	uint8_t stream;			// Stream it is switched with; 0 for none
+	uint16_t default_interval_ms;	// 0 if off until requested
+	uint16_t max_len;		// Longest it can be on the wire, bytes
+};
+
+struct stream_sched {
+	const struct stream_sched_message *table;
+	uint8_t num_messages;
+
+	uint32_t bytes_per_s;		// 0 for an unlimited link
+	uint32_t max_credit;		// millibytes
+	uint32_t credit;		// millibytes
+	uint32_t last_tick;
+
+	struct {
+		uint32_t due;		// ms
+		uint16_t interval_ms;	// 0 when off
+	} state[STREAM_SCHED_MAX_MESSAGES];
+};
+
+/**
+ * Set up the scheduler.  Messages on by default are all due at once.
+ * @param[in] table the messages, which must outlive the scheduler
+ * @param[in] bytes_per_s what the link can carry; 0 if there's no limit
+ * @param[in] max_burst the most bytes sent back to back after the link
+ * has been idle
+ * @returns 0 on success, -1 if the table is too long
+ */
+int32_t stream_sched_init(struct stream_sched *s,
+		const struct stream_sched_message *table, uint8_t num_messages,
+		uint32_t bytes_per_s, uint16_t max_burst, uint32_t now);
+
+/**
+ * Credit the link budget with the time since the last tick.  Call once
+ * before asking for messages.
+ */
+void stream_sched_tick(struct stream_sched *s, uint32_t now);
+
+/**
+ * The message to send next: of those due, the one that has been due the
+ * longest.  It is only handed out when it fits both the link budget and
+ * the room left; a message that doesn't fit blocks the rest rather than
+ * being overtaken, so long messages can't be starved by short ones.
+ * @param[in] room bytes left in the caller's send buffer
+ * @returns the table index, or -1 if nothing is due or it doesn't fit
+ */
+int stream_sched_next(const struct stream_sched *s, uint32_t now,
+		uint16_t room);
+
+/**
+ * Account for a message handed out by stream_sched_next() and schedule
+ * its next run.  Deadlines missed for want of link are skipped, not made
+ * up in a burst later.
+ * @param[in] len bytes it actually took
+ */
+void stream_sched_sent(struct stream_sched *s, int idx, uint16_t len,
+		uint32_t now);
+
+/**
+ * Change one message's interval, as MAV_CMD_SET_MESSAGE_INTERVAL does.
+ * @param[in] interval_us -1 to stop it, 0 for its default, else the period
+ * @returns 0 on success, -1 if the message isn't in the table
+ */
+int32_t stream_sched_set_interval(struct stream_sched *s, uint8_t msgid,
+		int32_t interval_us, uint32_t now);
+
+/**
+ * Start or stop a stream of messages, as REQUEST_DATA_STREAM does.
+ * @param[in] stream the stream, or STREAM_SCHED_ALL_STREAMS
+ * @param[in] rate_hz the rate to send each of its messages at; 0 for
+ * their defaults
+ * @returns the number of messages changed
+ */
+int32_t stream_sched_set_stream_rate(struct stream_sched *s, uint8_t stream,
+		uint16_t rate_hz, bool start, uint32_t now);
+
+/**
+ * @returns the interval a message is currently sent at in ms, 0 if it is
+ * off, or -1 if it isn't in the table
+ */
+int32_t stream_sched_get_interval(const struct stream_sched *s,
+		uint8_t msgid);
+
+#endif /* STREAM_SCHED_H */
+
+/**
+ * @}
+ */
@@ -0,0 +1,126 @@
+/**
+ ******************************************************************************
+ * @addtogroup TauLabsLibraries Tau Labs Libraries
+ * @{
+ *
+ * @file       telemetry_snapshot.h
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Shared sample of the state third party telemetry bridges export
+ *
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef TELEMETRY_SNAPSHOT_H
+#define TELEMETRY_SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//! A snapshot younger than this is handed out again rather than resampled
+#define TELEMETRY_SNAPSHOT_MAX_AGE_MS 20
+
+#define TELEMETRY_SNAPSHOT_CHANNELS 8
+
+/**
+ * The fields the bridges have in common.  Objects that don't exist on a
+ * target leave their have_ flag false and their fields zero.  Enums keep
+ * their UAVObject values (GPSPOSITION_STATUS_*, FLIGHTSTATUS_*).
+ */
+struct telemetry_snapshot {
+	uint32_t sample_time;		// ms, PIOS_Thread_Systime() when sampled
+	uint32_t sequence;		// Incremented on every resample
+
+	bool have_attitude;
+	bool have_gps;
+	bool have_home;
+	bool have_position;
+	bool have_velocity;
+	bool have_baro;
+	bool have_airspeed;
+	bool have_battery;
+
+	// AttitudeActual, degrees
+	float roll;
+	float pitch;
+	float yaw;
+
+	// GPSPosition
+	uint8_t gps_status;
+	uint8_t gps_satellites;
+	int32_t latitude;		// deg * 10^7
+	int32_t longitude;		// deg * 10^7
+	float gps_altitude;		// m above geoid
+	float groundspeed;		// m/s
+	float course;			// deg
+	float hdop;
+	float vdop;
+
+	// HomeLocation
+	bool home_set;
+	int32_t home_latitude;		// deg * 10^7
+	int32_t home_longitude;		// deg * 10^7
+	float home_altitude;		// m
+
+	// PositionActual and VelocityActual, NED relative to home
+	float position[3];		// m
+	float velocity[3];		// m/s
+
+	float baro_altitude;		// m
+	float true_airspeed;		// m/s
+
+	// FlightBatteryState, and the FlightBatterySettings that qualify it
+	float battery_voltage;		// V, 0 without a voltage sensor
+	float battery_current;		// A, 0 without a current sensor
+	float consumed_energy;		// mAh
+	uint32_t battery_capacity;	// mAh, 0 if unknown
+	uint8_t battery_cells;		// Detected, else configured; may be 0
+
+	// FlightStatus
+	uint8_t armed;
+	uint8_t flight_mode;
+	uint8_t control_source;
+
+	// ManualControlCommand
+	int16_t rssi;			// %
+	uint16_t channels[TELEMETRY_SNAPSHOT_CHANNELS];	// us
+
+	// SystemStats
+	uint32_t flight_time;		// ms
+	uint8_t cpu_load;		// %
+};
+
+/**
+ * Set up the snapshot.  Bridges call this from their initialize
+ * function; calls after the first do nothing.
+ * @returns 0 on success
+ */
+int32_t telemetry_snapshot_init(void);
+
+/**
+ * Copy out the current snapshot, first resampling the objects if it is
+ * older than TELEMETRY_SNAPSHOT_MAX_AGE_MS.  However many bridges run, each
+ * object is read at most once per period.
+ * @param[out] snap the snapshot
+ */
+void telemetry_snapshot_get(struct telemetry_snapshot *snap);
+
+#endif /* TELEMETRY_SNAPSHOT_H */
+
+/**
+ * @}
+ */
@@ -66,6 +66,10 @@ int32_t UAVTalkReceiveObject(UAVTalkConnection connectionHandle);
 void UAVTalkGetStats(UAVTalkConnection connection, UAVTalkStats *stats);
 uint32_t UAVTalkGetPacketObjId(UAVTalkConnection connection);
 uint32_t UAVTalkGetPacketInstId(UAVTalkConnection connection);
+int32_t UAVTalkFrameInputStream(UAVTalkConnection connection, const uint8_t *rxbytes, int32_t numbytes, bool *complete);
+int32_t UAVTalkRelayFrame(UAVTalkConnection inConnection, UAVTalkConnection outConnection);
+int32_t UAVTalkReceiveFrame(UAVTalkConnection connection);
+uint32_t UAVTalkGetFrameInstId(UAVTalkConnection connection);
 
 #endif // UAVTALK_H
 /**
@@ -0,0 +1,78 @@
+/**
+ ******************************************************************************
+ * @addtogroup TauLabsLibraries Tau Labs Libraries
+ * @{
+ *
+ * @file       vert_est.h
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Vertical position and velocity from accels and baro
+ *
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef VERT_EST_H
+#define VERT_EST_H
+
+/*
+ * Third order complementary filter of the down acceleration against the
+ * baro altitude.  It is predicted with every accel sample and corrected
+ * with every baro sample, so that the velocity it gives responds at the
+ * IMU rate rather than the baro's, without drifting.
+ */
+
+struct vert_est {
+	float position_z;		// Down, m, from where it was reset
+	float velocity_z;		// Down, m/s
+
+	float k1_z;			// Gains from the time constant
+	float k2_z;
+	float k3_z;
+
+	float accel_correction_z;
+	float position_base_z;
+	float position_error_z;
+	float position_correction_z;
+	float baro_zero;
+};
+
+/**
+ * Starts estimating afresh, with the altitude zeroed.
+ * @param[out] est state to set up
+ * @param[in] baro current baro altitude, m
+ * @param[in] time_constant how quickly the baro corrects the accels, s
+ */
+void vert_est_reset(struct vert_est *est, float baro, float time_constant);
+
+/**
+ * Integrates an accel sample.
+ * @param[in] z_accel down acceleration with gravity removed, m/s^2
+ * @param[in] dt time since the last sample, s
+ */
+void vert_est_predict(struct vert_est *est, float z_accel, float dt);
+
+/**
+ * Corrects with a baro sample.
+ * @param[in] baro baro altitude, m
+ */
+void vert_est_update_baro(struct vert_est *est, float baro);
+
+#endif /* VERT_EST_H */
+
+/**
+ * @}
+ */
@@ -29,6 +29,7 @@
  * with this program; if not, see <http://www.gnu.org/licenses/>
  */
 
+#include "pios.h"
 #include "insgps.h"
 #include "physical_constants.h"
 #include <math.h>
@@ -193,6 +194,18 @@ void INSGetVariance(float *var_out)
            var_out[i] = P[i][i];
  }
  
+/**
+ * Register the filter state, for the simulator to save and restore
+ */
+void INSRegisterSnapshot()
+{
+	PIOS_SNAPSHOT_VAR("insgps", X);
+	PIOS_SNAPSHOT_VAR("insgps", P);
+	PIOS_SNAPSHOT_VAR("insgps", Q);
+	PIOS_SNAPSHOT_VAR("insgps", R);
+	PIOS_SNAPSHOT_VAR("insgps", Be);
+}
+
 void INSResetP(const float *PDiag)
 {
 	uint8_t i,j;
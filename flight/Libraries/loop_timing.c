@@ -0,0 +1,118 @@
+/**
+ ******************************************************************************
+ * @addtogroup TauLabsLibraries Tau Labs Libraries
+ * @{
+ *
+ * @file       loop_timing.c
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Histograms of control loop jitter, run time and latency
+ *
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "openpilot.h"
+#include "loop_timing.h"
+
+/* When the oldest gyro sample not yet acted on was published */
+static volatile uint32_t sample_time;
+static volatile bool sample_pending;
+
+void loop_timing_add(struct loop_timing_hist *hist, uint32_t us)
+{
+	int bucket = 0;
+
+	if (us) {
+		bucket = 32 - __builtin_clz(us);
+
+		if (bucket >= LOOP_TIMING_NUM_BUCKETS) {
+			bucket = LOOP_TIMING_NUM_BUCKETS - 1;
+		}
+	}
+
+	if (hist->counts[bucket] == UINT16_MAX) {
+		for (int i = 0; i < LOOP_TIMING_NUM_BUCKETS; i++) {
+			hist->counts[i] /= 2;
+		}
+	}
+
+	hist->counts[bucket]++;
+
+	if (us > hist->max) {
+		hist->max = (us > UINT16_MAX) ? UINT16_MAX : us;
+	}
+}
+
+void loop_timing_init(struct loop_timing *timing, uint32_t nominal_us)
+{
+	memset(timing, 0, sizeof(*timing));
+
+	timing->nominal_us = nominal_us;
+}
+
+void loop_timing_begin(struct loop_timing *timing)
+{
+	uint32_t now = PIOS_DELAY_GetRaw();
+
+	if (timing->started) {
+		uint32_t period = PIOS_DELAY_DiffuS2(timing->start, now);
+
+		if (period > timing->nominal_us) {
+			loop_timing_add(&timing->jitter, period - timing->nominal_us);
+		} else {
+			loop_timing_add(&timing->jitter, timing->nominal_us - period);
+		}
+	}
+
+	timing->start = now;
+	timing->started = true;
+}
+
+void loop_timing_end(struct loop_timing *timing)
+{
+	if (!timing->started) {
+		return;
+	}
+
+	loop_timing_add(&timing->execution,
+			PIOS_DELAY_DiffuS(timing->start));
+}
+
+void loop_timing_sample(void)
+{
+	/* A sample that arrives before the last was acted on doesn't
+	 * restart the clock; the overrun shows up as latency */
+	if (!sample_pending) {
+		sample_time = PIOS_DELAY_GetRaw();
+		sample_pending = true;
+	}
+}
+
+void loop_timing_output(struct loop_timing_hist *latency)
+{
+	if (!sample_pending) {
+		return;
+	}
+
+	loop_timing_add(latency, PIOS_DELAY_DiffuS(sample_time));
+
+	sample_pending = false;
+}
+
+/**
+ * @}
+ */
@@ -92,9 +92,12 @@ void lpfilter_construct_single_biquad(struct lpfilter_biquad *b, float cutoff, f
 	b->a1 = 2.0f * (f*f - 1.0f) * b->b0;
 	b->a2 = -(1.0f - q*f + f*f) * b->b0;
 
-	b->s = PIOS_malloc_no_dma(sizeof(struct lpfilter_biquad_state)*width);
-	if(!b->s)
-		PIOS_Assert(0);
+	if(!b->s) {
+		b->s = PIOS_malloc_no_dma_tagged(sizeof(struct lpfilter_biquad_state)*width,
+				PIOS_HEAP_TAG_FILTER);
+		if(!b->s)
+			PIOS_Assert(0);
+	}
 
 	memset((void*)b->s, 0, sizeof(struct lpfilter_biquad_state)*width);
 }
@@ -117,14 +120,35 @@ void lpfilter_construct_biquads(lpfilter_state_t filt, float cutoff, float dT, i
 	for(int i = 0; i < len; i++)
 	{
 		if(!filt->biquad[i]) {
-			filt->biquad[i] = PIOS_malloc_no_dma(sizeof(struct lpfilter_biquad));
+			filt->biquad[i] = PIOS_malloc_no_dma_tagged(sizeof(struct lpfilter_biquad),
+					PIOS_HEAP_TAG_FILTER);
 			if(!filt->biquad[i])
 				PIOS_Assert(0);
+			memset(filt->biquad[i], 0, sizeof(struct lpfilter_biquad));
 		}
 		lpfilter_construct_single_biquad(filt->biquad[i], cutoff, dT, lpfilter_butterworth_factors[addr+i], width);
 	}
 }
 
+static void lpfilter_free_state(lpfilter_state_t filter)
+{
+	if(filter->first_order) {
+		PIOS_free(filter->first_order->prev);
+		PIOS_free(filter->first_order);
+		filter->first_order = NULL;
+	}
+
+	for(int i = 0; i < 4; i++) {
+		if(filter->biquad[i]) {
+			PIOS_free(filter->biquad[i]->s);
+			PIOS_free(filter->biquad[i]);
+			filter->biquad[i] = NULL;
+		}
+	}
+
+	filter->width = 0;
+}
+
 void lpfilter_create(lpfilter_state_t *filter_ptr, float cutoff, float dT, uint8_t order, uint8_t width)
 {
 	if(!filter_ptr) {
@@ -133,7 +157,8 @@ void lpfilter_create(lpfilter_state_t *filter_ptr, float cutoff, float dT, uint8
 	}
 
 	if(!*filter_ptr) {
-		*filter_ptr = PIOS_malloc_no_dma(sizeof(struct lpfilter_state));
+		*filter_ptr = PIOS_malloc_no_dma_tagged(sizeof(struct lpfilter_state),
+				PIOS_HEAP_TAG_FILTER);
 		if(!*filter_ptr)
 			PIOS_Assert(0);
 		memset(*filter_ptr, 0, sizeof(struct lpfilter_state));
@@ -141,12 +166,16 @@ void lpfilter_create(lpfilter_state_t *filter_ptr, float cutoff, float dT, uint8
 
 	lpfilter_state_t filter = *filter_ptr;
 
-	if((filter->width != 0 && filter->width != width) || (width > MAX_FILTER_WIDTH)) {
-		// We can't free memory, so if some caller keeps tossing varying
-		// filter widths while updating an already allocated filter, go fail.
+	if(width > MAX_FILTER_WIDTH) {
 		PIOS_Assert(0);
 	}
 
+	if(filter->width != 0 && filter->width != width) {
+		// The per-axis state is sized by width, so drop it and let it
+		// be allocated again below.
+		lpfilter_free_state(filter);
+	}
+
 	// Clamp order count. If zero, this bypasses the filter.
 	if(order == 0) {
 		filter->order = 0;
@@ -156,11 +185,13 @@ void lpfilter_create(lpfilter_state_t *filter_ptr, float cutoff, float dT, uint8
 	if(order & 0x1) {
 		// Filter is odd, allocate the first order filter.
 		if(!filter->first_order) {
-			filter->first_order = PIOS_malloc_no_dma(sizeof(struct lpfilter_first_order));
+			filter->first_order = PIOS_malloc_no_dma_tagged(sizeof(struct lpfilter_first_order),
+					PIOS_HEAP_TAG_FILTER);
 			if(!filter->first_order)
 				PIOS_Assert(0);
 
-			filter->first_order->prev = PIOS_malloc_no_dma(sizeof(float)*width);
+			filter->first_order->prev = PIOS_malloc_no_dma_tagged(sizeof(float)*width,
+					PIOS_HEAP_TAG_FILTER);
 			if(!filter->first_order->prev)
 				PIOS_Assert(0);
 		}
@@ -0,0 +1,493 @@
+/**
+ ******************************************************************************
+ * @addtogroup TauLabsLibraries Tau Labs Libraries
+ * @{
+ * @addtogroup TauLabsMath Tau Labs math support libraries
+ * @{
+ *
+ * @file       physsim.c
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Rigid body physics plant for closed-loop simulation
+ *
+ * A small six degree of freedom model of a multirotor or a fixed wing
+ * airframe.  It is driven by normalized actuator outputs and synthesizes
+ * the raw values an IMU, magnetometer and barometer would report, so that
+ * the firmware can be flown closed-loop without an external simulator.
+ *
+ * Conventions follow the rest of the flight code: NED earth frame, body
+ * frame x forward / y right / z down, and q rotating earth into body as
+ * understood by Quaternion2R().
+ *
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "physical_constants.h"
+#include "coordinate_conversions.h"
+#include "physsim.h"
+
+//! Air density used for the aerodynamic terms, kg/m^3
+#define PHYSSIM_RHO STANDARD_AIR_DENSITY
+
+//! Largest angle of attack / sideslip the linear aero model is trusted at
+#define PHYSSIM_MAX_ALPHA 0.26f
+
+/**
+ * Fill out a reasonable set of parameters for the given frame type.
+ * The multirotor is a ~500g quad X, motor order as in the GCS mixer
+ * (front left, front right, back right, back left); the fixed wing is a
+ * ~1kg foam trainer with an AETR channel layout.
+ * @param[out] params the parameter block to fill
+ * @param[in] frame the kind of airframe to describe
+ */
+void physsim_default_params(struct physsim_params *params,
+		enum physsim_frame frame)
+{
+	memset(params, 0, sizeof(*params));
+
+	params->frame = frame;
+
+	params->gyro_noise = 0.5f;
+	params->accel_noise = 0.15f;
+	params->mag_noise = 5.0f;
+	params->baro_noise = 0.1f;
+
+	params->mag_field[0] = 400;
+	params->mag_field[1] = 0;
+	params->mag_field[2] = 800;
+
+	params->motor_tau = 0.03f;
+	params->thrust_expo = 0.6f;
+
+	switch (frame) {
+	default:
+	case PHYSSIM_FRAME_MULTIROTOR:
+		params->mass = 0.5f;
+		params->inertia[0] = 2.5e-3f;
+		params->inertia[1] = 2.5e-3f;
+		params->inertia[2] = 4.5e-3f;
+
+		params->num_motors = 4;
+		params->motors[0] = (struct physsim_motor) { { 0.08f, -0.08f }, -1 };
+		params->motors[1] = (struct physsim_motor) { { 0.08f, 0.08f }, 1 };
+		params->motors[2] = (struct physsim_motor) { { -0.08f, 0.08f }, -1 };
+		params->motors[3] = (struct physsim_motor) { { -0.08f, -0.08f }, 1 };
+
+		params->max_thrust = 5.0f;
+		params->torque_coeff = 0.016f;
+		params->drag_lin = 0.2f;
+		params->rot_damping = 2e-3f;
+		break;
+	case PHYSSIM_FRAME_FIXEDWING:
+		params->mass = 1.0f;
+		params->inertia[0] = 0.02f;
+		params->inertia[1] = 0.03f;
+		params->inertia[2] = 0.045f;
+
+		params->num_motors = 1;
+		params->max_thrust = 8.0f;
+		params->drag_lin = 0.02f;
+		params->rot_damping = 0.01f;
+
+		params->ch_aileron = 0;
+		params->ch_elevator = 1;
+		params->ch_throttle = 2;
+		params->ch_rudder = 3;
+
+		params->wing_area = 0.25f;
+		params->cl0 = 0.3f;
+		params->cl_alpha = 4.5f;
+		params->cd0 = 0.05f;
+		params->surface_authority[0] = 5e-3f;
+		params->surface_authority[1] = 6e-3f;
+		params->surface_authority[2] = 3e-3f;
+		break;
+	}
+}
+
+/**
+ * Put the airframe level on the ground at the origin.
+ * @param[out] state the state to reset
+ * @param[in] seed seed for the sensor noise generator; must be nonzero
+ */
+void physsim_reset(struct physsim_state *state, uint32_t seed)
+{
+	memset(state, 0, sizeof(*state));
+
+	state->q[0] = 1;
+	state->accel[2] = -GRAVITY;
+	state->on_ground = true;
+	state->seed = seed ? seed : 1;
+}
+
+//! xorshift32; fast, and good enough for sensor noise
+static float physsim_uniform(struct physsim_state *state)
+{
+	uint32_t x = state->seed;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	state->seed = x;
+
+	/* (0, 1] so the log below is always finite */
+	return ((x >> 8) + 1) * (1.0f / 16777216.0f);
+}
+
+//! Box-Muller, one standard deviation
+static float physsim_gauss(struct physsim_state *state)
+{
+	float u1 = physsim_uniform(state);
+	float u2 = physsim_uniform(state);
+
+	return sqrtf(-2.0f * logf(u1)) * cosf(2 * PI * u2);
+}
+
+static float physsim_clamp(float val, float min, float max)
+{
+	if (val < min) {
+		return min;
+	}
+
+	if (val > max) {
+		return max;
+	}
+
+	return val;
+}
+
+//! First order spool and the thrust curve of a single motor
+static float physsim_motor_thrust(const struct physsim_params *params,
+		struct physsim_state *state, int idx, float cmd, float dT)
+{
+	cmd = physsim_clamp(cmd, 0, 1);
+
+	state->motor[idx] += (cmd - state->motor[idx]) *
+		dT / (params->motor_tau + dT);
+
+	float m = state->motor[idx];
+
+	return params->max_thrust *
+		(params->thrust_expo * m * m + (1 - params->thrust_expo) * m);
+}
+
+static void physsim_multirotor_forces(const struct physsim_params *params,
+		struct physsim_state *state, const float *outputs,
+		uint8_t num_outputs, const float v_body[3], float force[3],
+		float moment[3], float dT)
+{
+	for (int i = 0; i < params->num_motors; i++) {
+		float cmd = (i < num_outputs) ? outputs[i] : 0;
+		float thrust = physsim_motor_thrust(params, state, i, cmd, dT);
+
+		const struct physsim_motor *motor = &params->motors[i];
+
+		force[2] -= thrust;
+
+		/* r x F with F = (0, 0, -thrust) */
+		moment[0] -= motor->pos[1] * thrust;
+		moment[1] += motor->pos[0] * thrust;
+		moment[2] += motor->dir * params->torque_coeff * thrust;
+	}
+
+	for (int i = 0; i < 3; i++) {
+		force[i] -= params->drag_lin * v_body[i];
+		moment[i] -= params->rot_damping * state->rate[i];
+	}
+}
+
+static void physsim_fixedwing_forces(const struct physsim_params *params,
+		struct physsim_state *state, const float *outputs,
+		uint8_t num_outputs, const float v_body[3], float force[3],
+		float moment[3], float dT)
+{
+	float throttle = 0, surf[3] = { 0, 0, 0 };
+
+	if (params->ch_throttle < num_outputs) {
+		throttle = outputs[params->ch_throttle];
+	}
+
+	if (params->ch_aileron < num_outputs) {
+		surf[0] = physsim_clamp(outputs[params->ch_aileron], -1, 1);
+	}
+
+	if (params->ch_elevator < num_outputs) {
+		surf[1] = physsim_clamp(outputs[params->ch_elevator], -1, 1);
+	}
+
+	if (params->ch_rudder < num_outputs) {
+		surf[2] = physsim_clamp(outputs[params->ch_rudder], -1, 1);
+	}
+
+	force[0] += physsim_motor_thrust(params, state, 0, throttle, dT);
+
+	float airspeed = VectorMagnitude(v_body);
+	float q_dyn = 0.5f * PHYSSIM_RHO * airspeed * airspeed;
+
+	float alpha = 0, beta = 0;
+
+	if (airspeed > 0.5f) {
+		float vhat[3] = {
+			v_body[0] / airspeed,
+			v_body[1] / airspeed,
+			v_body[2] / airspeed
+		};
+
+		alpha = physsim_clamp(atan2f(vhat[2], vhat[0]),
+				-PHYSSIM_MAX_ALPHA, PHYSSIM_MAX_ALPHA);
+		beta = physsim_clamp(asinf(vhat[1]),
+				-PHYSSIM_MAX_ALPHA, PHYSSIM_MAX_ALPHA);
+
+		float cl = params->cl0 + params->cl_alpha * alpha;
+		float cd = params->cd0 + 0.05f * cl * cl;
+
+		float lift = q_dyn * params->wing_area * cl;
+		float drag = q_dyn * params->wing_area * cd;
+
+		/* Lift is normal to the relative wind in the x-z plane,
+		 * drag opposes it. */
+		force[0] += lift * vhat[2] - drag * vhat[0];
+		force[1] += -drag * vhat[1] -
+			q_dyn * params->wing_area * 0.5f * beta;
+		force[2] += -lift * vhat[0] - drag * vhat[2];
+	}
+
+	/* Control surfaces, weathercock / pitch stability and damping
+	 * that grows with airspeed. */
+	float damping = params->rot_damping * (airspeed + 1);
+
+	moment[0] += q_dyn * params->surface_authority[0] * surf[0];
+	moment[1] += q_dyn * params->surface_authority[1] *
+		(surf[1] - 2 * alpha);
+	moment[2] += q_dyn * params->surface_authority[2] *
+		(surf[2] + 2 * beta);
+
+	for (int i = 0; i < 3; i++) {
+		force[i] -= params->drag_lin * v_body[i];
+		moment[i] -= damping * state->rate[i];
+	}
+}
+
+/**
+ * Advance the plant by one time step.
+ * @param[in] params the airframe description
+ * @param[in,out] state the state to integrate
+ * @param[in] outputs normalized actuator outputs.  Motors are 0..1,
+ * fixed wing control surfaces -1..1.
+ * @param[in] num_outputs number of entries in outputs
+ * @param[in] dT the time step, s
+ */
+void physsim_step(const struct physsim_params *params,
+		struct physsim_state *state, const float *outputs,
+		uint8_t num_outputs, float dT)
+{
+	float Rbe[3][3];
+	Quaternion2R(state->q, Rbe);
+
+	float v_body[3];
+	rot_mult(Rbe, state->vel, v_body, false);
+
+	float force[3] = { 0, 0, 0 };
+	float moment[3] = { 0, 0, 0 };
+
+	if (params->frame == PHYSSIM_FRAME_FIXEDWING) {
+		physsim_fixedwing_forces(params, state, outputs, num_outputs,
+				v_body, force, moment, dT);
+	} else {
+		physsim_multirotor_forces(params, state, outputs, num_outputs,
+				v_body, force, moment, dT);
+	}
+
+	/* Rotational dynamics: I w' = M - w x (I w) */
+	const float *I = params->inertia;
+	const float *w = state->rate;
+
+	float Iw[3] = { I[0] * w[0], I[1] * w[1], I[2] * w[2] };
+	float gyroscopic[3];
+	CrossProduct(w, Iw, gyroscopic);
+
+	for (int i = 0; i < 3; i++) {
+		state->rate[i] += (moment[i] - gyroscopic[i]) / I[i] * dT;
+	}
+
+	/* q' = 1/2 q * (0, w) */
+	float *q = state->q;
+	float qdot[4] = {
+		(-q[1] * w[0] - q[2] * w[1] - q[3] * w[2]) * 0.5f,
+		( q[0] * w[0] - q[3] * w[1] + q[2] * w[2]) * 0.5f,
+		( q[3] * w[0] + q[0] * w[1] - q[1] * w[2]) * 0.5f,
+		(-q[2] * w[0] + q[1] * w[1] + q[0] * w[2]) * 0.5f,
+	};
+
+	float qmag = 0;
+
+	for (int i = 0; i < 4; i++) {
+		q[i] += qdot[i] * dT;
+		qmag += q[i] * q[i];
+	}
+
+	qmag = sqrtf(qmag);
+
+	for (int i = 0; i < 4; i++) {
+		q[i] /= qmag;
+	}
+
+	/* Translational dynamics in the earth frame */
+	float f_ned[3];
+	rot_mult(Rbe, force, f_ned, true);
+
+	float accel_ned[3] = {
+		f_ned[0] / params->mass,
+		f_ned[1] / params->mass,
+		f_ned[2] / params->mass + GRAVITY
+	};
+
+	state->on_ground = (state->pos[2] >= 0) && (accel_ned[2] >= 0);
+
+	if (state->on_ground) {
+		/* The ground pushes back; multirotors sit still and level,
+		 * fixed wings can still roll along their heading. */
+		accel_ned[2] = 0;
+		state->pos[2] = 0;
+
+		if (state->vel[2] > 0) {
+			state->vel[2] = 0;
+		}
+
+		float rpy[3];
+		Quaternion2RPY(state->q, rpy);
+		rpy[0] = 0;
+		rpy[1] = 0;
+		RPY2Quaternion(rpy, state->q);
+
+		state->rate[0] = 0;
+		state->rate[1] = 0;
+		state->rate[2] = 0;
+
+		if (params->frame == PHYSSIM_FRAME_FIXEDWING) {
+			float heading[2] = { cosf(rpy[2] * DEG2RAD),
+				sinf(rpy[2] * DEG2RAD) };
+			float along = accel_ned[0] * heading[0] +
+				accel_ned[1] * heading[1];
+			float speed = state->vel[0] * heading[0] +
+				state->vel[1] * heading[1];
+
+			if (speed <= 0 && along < 0) {
+				along = 0;
+				speed = 0;
+			}
+
+			accel_ned[0] = along * heading[0];
+			accel_ned[1] = along * heading[1];
+			state->vel[0] = speed * heading[0];
+			state->vel[1] = speed * heading[1];
+		} else {
+			accel_ned[0] = 0;
+			accel_ned[1] = 0;
+			state->vel[0] = 0;
+			state->vel[1] = 0;
+		}
+	}
+
+	for (int i = 0; i < 3; i++) {
+		state->vel[i] += accel_ned[i] * dT;
+		state->pos[i] += state->vel[i] * dT;
+	}
+
+	/* What an accelerometer measures is everything but gravity */
+	float specific_ned[3] = {
+		accel_ned[0],
+		accel_ned[1],
+		accel_ned[2] - GRAVITY
+	};
+
+	Quaternion2R(state->q, Rbe);
+	rot_mult(Rbe, specific_ned, state->accel, false);
+
+	state->time += dT;
+}
+
+/**
+ * Synthesize a gyro sample.
+ * @param[out] gyro body rates in deg/s
+ */
+void physsim_sense_gyro(const struct physsim_params *params,
+		struct physsim_state *state, float gyro[3])
+{
+	for (int i = 0; i < 3; i++) {
+		gyro[i] = state->rate[i] * RAD2DEG +
+			physsim_gauss(state) * params->gyro_noise;
+	}
+}
+
+/**
+ * Synthesize an accelerometer sample.
+ * @param[out] accel body specific force in m/s^2
+ */
+void physsim_sense_accel(const struct physsim_params *params,
+		struct physsim_state *state, float accel[3])
+{
+	for (int i = 0; i < 3; i++) {
+		accel[i] = state->accel[i] +
+			physsim_gauss(state) * params->accel_noise;
+	}
+}
+
+/**
+ * Synthesize a magnetometer sample.
+ * @param[out] mag body frame field in mGa
+ */
+void physsim_sense_mag(const struct physsim_params *params,
+		struct physsim_state *state, float mag[3])
+{
+	float Rbe[3][3];
+	Quaternion2R(state->q, Rbe);
+
+	rot_mult(Rbe, params->mag_field, mag, false);
+
+	for (int i = 0; i < 3; i++) {
+		mag[i] += physsim_gauss(state) * params->mag_noise;
+	}
+}
+
+/**
+ * Synthesize a barometer sample.
+ * @param[out] pressure static pressure in kPa, if not NULL
+ * @returns altitude above the origin in m
+ */
+float physsim_sense_baro(const struct physsim_params *params,
+		struct physsim_state *state, float *pressure)
+{
+	float altitude = -state->pos[2] +
+		physsim_gauss(state) * params->baro_noise;
+
+	if (pressure) {
+		*pressure = STANDARD_AIR_SEA_LEVEL_PRESSURE / 1000.0f *
+			powf(1.0f - altitude / 44330.0f, 5.255f);
+	}
+
+	return altitude;
+}
+
+/**
+ * @}
+ * @}
+ */
@@ -0,0 +1,122 @@
+/**
+ ******************************************************************************
+ * @addtogroup TauLabsLibraries Tau Labs Libraries
+ * @{
+ * @addtogroup TauLabsMath Tau Labs math support libraries
+ * @{
+ *
+ * @file       physsim.h
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Rigid body physics plant for closed-loop simulation
+ *
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef PHYSSIM_H
+#define PHYSSIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PHYSSIM_MAX_MOTORS 8
+
+enum physsim_frame {
+	PHYSSIM_FRAME_MULTIROTOR,
+	PHYSSIM_FRAME_FIXEDWING,
+};
+
+//! A single motor/prop on a multirotor frame
+struct physsim_motor {
+	float pos[2];			// Body x (fwd) / y (right) position, m
+	float dir;			// Yaw reaction sign; -1 for CW props
+};
+
+//! Physical description of the simulated airframe
+struct physsim_params {
+	enum physsim_frame frame;
+
+	float mass;			// kg
+	float inertia[3];		// Diagonal inertia, kg m^2
+
+	uint8_t num_motors;
+	struct physsim_motor motors[PHYSSIM_MAX_MOTORS];
+
+	float motor_tau;		// Spool time constant, s
+	float max_thrust;		// Per motor thrust at full command, N
+	float thrust_expo;		// 0 = linear, 1 = quadratic in command
+	float torque_coeff;		// Yaw reaction torque per N thrust, m
+
+	float drag_lin;			// Translational drag, N / (m/s)
+	float rot_damping;		// Angular damping, Nm / (rad/s)
+
+	/* Fixed wing: output channel roles and aerodynamics */
+	uint8_t ch_aileron;
+	uint8_t ch_elevator;
+	uint8_t ch_throttle;
+	uint8_t ch_rudder;
+	float wing_area;		// m^2
+	float cl0;			// Lift coefficient at zero alpha
+	float cl_alpha;			// Lift slope, 1/rad
+	float cd0;			// Parasitic drag coefficient
+	float surface_authority[3];	// Moment per dynamic pressure, m^3
+
+	/* Sensor noise, one standard deviation */
+	float gyro_noise;		// deg/s
+	float accel_noise;		// m/s^2
+	float mag_noise;		// mGa
+	float baro_noise;		// m
+
+	float mag_field[3];		// Earth field in NED, mGa
+};
+
+//! Integrated state of the simulated airframe
+struct physsim_state {
+	float pos[3];			// NED position, m
+	float vel[3];			// NED velocity, m/s
+	float q[4];			// Attitude quaternion (body from earth)
+	float rate[3];			// Body angular rate, rad/s
+	float accel[3];			// Body specific force, m/s^2
+	float motor[PHYSSIM_MAX_MOTORS];	// Spooled motor command, 0..1
+	float time;			// Simulated seconds since reset
+	bool on_ground;
+
+	uint32_t seed;			// Noise generator state
+};
+
+void physsim_default_params(struct physsim_params *params,
+		enum physsim_frame frame);
+void physsim_reset(struct physsim_state *state, uint32_t seed);
+void physsim_step(const struct physsim_params *params,
+		struct physsim_state *state, const float *outputs,
+		uint8_t num_outputs, float dT);
+
+void physsim_sense_gyro(const struct physsim_params *params,
+		struct physsim_state *state, float gyro[3]);
+void physsim_sense_accel(const struct physsim_params *params,
+		struct physsim_state *state, float accel[3]);
+void physsim_sense_mag(const struct physsim_params *params,
+		struct physsim_state *state, float mag[3]);
+float physsim_sense_baro(const struct physsim_params *params,
+		struct physsim_state *state, float *pressure);
+
+#endif /* PHYSSIM_H */
+
+/**
+ * @}
+ * @}
+ */
@@ -34,11 +34,37 @@
 #include "pid.h"
 
 //! Store the shared time constant for the derivative cutoff.
+//! 1/(2*pi*f_cutoff); 7.9577e-3 means 20 Hz f_cutoff
 static float deriv_tau = 7.9577e-3f;
 
 //! Store the setpoint weight to apply for the derivative term
 static float deriv_gamma = 1.0;
 
+/**
+ * Run the DT1 filter on the error difference
+ * @param[in] pid The PID struture which stores temporary information
+ * @param[in] diff The change in error since the last call
+ * @param[in] dT  The time step, nonzero
+ * @returns The filtered derivative term
+ *
+ * The coefficients only depend on dT, Kd and the cutoff, which rarely
+ * change between calls, so they are kept in the pid rather than paying
+ * for two divisions each time.
+ */
+static inline float pid_dterm(struct pid *pid, float diff, float dT)
+{
+	if (dT != pid->dT || deriv_tau != pid->derivTau) {
+		pid->dT = dT;
+		pid->derivTau = deriv_tau;
+		pid->derivAlpha = dT / (dT + deriv_tau);
+		pid->derivGain = pid->d / dT;
+	}
+
+	pid->lastDer += pid->derivAlpha * (diff * pid->derivGain - pid->lastDer);
+
+	return pid->lastDer;
+}
+
 /**
  * Update the PID computation
  * @param[in] pid The PID struture which stores temporary information
@@ -62,9 +88,8 @@ float pid_apply(struct pid *pid, const float err, float dT)
 	pid->lastErr = err;
 	if(pid->d && dT)
 	{
-		dterm = pid->lastDer +  dT / ( dT + deriv_tau) * ((diff * pid->d / dT) - pid->lastDer);
-		pid->lastDer = dterm;            //   ^ set constant to 1/(2*pi*f_cutoff)
-	}	                                 //   7.9577e-3  means 20 Hz f_cutoff
+		dterm = pid_dterm(pid, diff, dT);
+	}
  
 	return ((err * pid->p) + pid->iAccumulator + dterm);
 }
@@ -97,9 +122,8 @@ float pid_apply_antiwindup(struct pid *pid, const float err,
 	pid->lastErr = err;
 	if(pid->d && dT)
 	{
-		dterm = pid->lastDer +  dT / ( dT + deriv_tau) * ((diff * pid->d / dT) - pid->lastDer);
-		pid->lastDer = dterm;            //   ^ set constant to 1/(2*pi*f_cutoff)
-	}	                                 //   7.9577e-3  means 20 Hz f_cutoff
+		dterm = pid_dterm(pid, diff, dT);
+	}
  
  	// Compute how much (if at all) the output is saturating
 	float ideal_output = ((err * pid->p) + pid->iAccumulator + dterm);
@@ -157,9 +181,8 @@ float pid_apply_setpoint(struct pid *pid, struct pid_deadband *deadband, const f
 	pid->lastErr = err_d;
 	if(pid->d && dT)
 	{
-		dterm = pid->lastDer +  dT / ( dT + deriv_tau) * ((diff * pid->d / dT) - pid->lastDer);
-		pid->lastDer = dterm;            //   ^ set constant to 1/(2*pi*f_cutoff)
-	}	                                 //   7.9577e-3  means 20 Hz f_cutoff
+		dterm = pid_dterm(pid, diff, dT);
+	}
  
 	return ((err * pid->p) + pid->iAccumulator + dterm);
 }
@@ -205,6 +228,9 @@ void pid_configure(struct pid *pid, float p, float i, float d, float iLim)
 	pid->i = i;
 	pid->d = d;
 	pid->iLim = iLim;
+
+	// Have pid_dterm work out its coefficients again
+	pid->dT = 0;
 }
 
 /**
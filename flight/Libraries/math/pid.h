@@ -47,6 +47,12 @@ struct pid {
 	float iAccumulator;
 	float lastErr;
 	float lastDer;
+
+	// Derivative filter coefficients for the last dT and cutoff used
+	float dT;
+	float derivTau;
+	float derivAlpha;			// dT / (dT + tau)
+	float derivGain;			// d / dT
 };
 
 //! Methods to use the pid structures
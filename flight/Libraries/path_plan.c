@@ -0,0 +1,149 @@
+/**
+ ******************************************************************************
+ * @addtogroup TauLabsLibraries Tau Labs Libraries
+ * @{
+ *
+ * @file       path_plan.c
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Precomputes corners and speeds along a route of waypoints
+ *
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "path_plan.h"
+
+#include <math.h>
+
+/* Turns shallower than this (about 1 degree) are flown straight through,
+ * and those sharper than about 170 degrees are flown sharp: the fillet
+ * would be all but a reversal */
+#define MIN_TURN_SIN 0.0175f
+#define MAX_TURN_COS -0.985f
+
+/* Lengths shorter than this give no usable direction */
+#define MIN_LENGTH 0.01f
+
+static void fillet_corner(struct path_plan_leg *legs, int i, float radius)
+{
+	struct path_plan_leg *in = &legs[i];
+	const struct path_plan_leg *out = &legs[i + 1];
+
+	in->corner_distance = 0;
+	in->corner_curvature = 0;
+
+	if (radius <= 0 || !in->straight || !out->straight ||
+			in->length < MIN_LENGTH || out->length < MIN_LENGTH) {
+		return;
+	}
+
+	const struct path_plan_leg *prev = &legs[i - 1];
+
+	float u0[2] = {
+		(in->end[0] - prev->end[0]) / in->length,
+		(in->end[1] - prev->end[1]) / in->length,
+	};
+	float u1[2] = {
+		(out->end[0] - in->end[0]) / out->length,
+		(out->end[1] - in->end[1]) / out->length,
+	};
+
+	float turn_cos = u0[0] * u1[0] + u0[1] * u1[1];
+	float turn_sin = u0[0] * u1[1] - u0[1] * u1[0];
+
+	if (fabsf(turn_sin) < MIN_TURN_SIN && turn_cos > 0) {
+		return;
+	}
+
+	if (turn_cos < MAX_TURN_COS) {
+		return;
+	}
+
+	// tan of half the turn
+	float half_tan = fabsf(turn_sin) / (1 + turn_cos);
+
+	float distance = radius * half_tan;
+	float max_distance = fminf(in->length, out->length) / 2;
+
+	if (distance > max_distance) {
+		distance = max_distance;
+		radius = distance / half_tan;
+	}
+
+	in->corner_distance = distance;
+	in->corner_curvature = (turn_sin > 0 ? 1 : -1) / radius;
+}
+
+void path_plan_build(struct path_plan_leg *legs, int num_legs,
+		const struct path_plan_limits *limits)
+{
+	if (num_legs <= 0) {
+		return;
+	}
+
+	legs[0].length = 0;
+
+	for (int i = 1; i < num_legs; i++) {
+		float n = legs[i].end[0] - legs[i - 1].end[0];
+		float e = legs[i].end[1] - legs[i - 1].end[1];
+
+		legs[i].length = sqrtf(n * n + e * e);
+	}
+
+	legs[0].corner_distance = 0;
+	legs[0].corner_curvature = 0;
+	legs[num_legs - 1].corner_distance = 0;
+	legs[num_legs - 1].corner_curvature = 0;
+
+	for (int i = 1; i < num_legs - 1; i++) {
+		fillet_corner(legs, i, limits->corner_radius);
+
+		// v^2 = a r
+		if (legs[i].corner_curvature != 0 && limits->corner_accel > 0) {
+			float corner_speed = sqrtf(limits->corner_accel /
+					fabsf(legs[i].corner_curvature));
+
+			legs[i].velocity = fminf(legs[i].velocity, corner_speed);
+		}
+	}
+
+	if (limits->max_accel <= 0) {
+		return;
+	}
+
+	float two_a = 2 * limits->max_accel;
+
+	// Slow down in time for what's ahead ...
+	for (int i = num_legs - 2; i >= 0; i--) {
+		float reachable = sqrtf(legs[i + 1].velocity * legs[i + 1].velocity +
+				two_a * legs[i + 1].length);
+
+		legs[i].velocity = fminf(legs[i].velocity, reachable);
+	}
+
+	// ... and don't plan to be faster than can be reached from behind
+	for (int i = 1; i < num_legs; i++) {
+		float reachable = sqrtf(legs[i - 1].velocity * legs[i - 1].velocity +
+				two_a * legs[i].length);
+
+		legs[i].velocity = fminf(legs[i].velocity, reachable);
+	}
+}
+
+/**
+ * @}
+ */
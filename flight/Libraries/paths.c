@@ -38,6 +38,7 @@
 
 #include "uavobjectmanager.h"
 #include "pathdesired.h"
+#include "pathlookahead.h"
 
 // private functions
 static void path_endpoint(const float * start_point, const float * end_point,
@@ -92,6 +93,98 @@ void path_progress(const PathDesiredData *pathDesired,
 	}
 }
 
+/**
+ * @brief Compute progress along path, turning onto the next leg early
+ * @param[in] pathDesired Path being flown
+ * @param[in] lookahead Route ahead of it from @ref PathPlanner, or NULL
+ * @param[in] cur_point Current location
+ * @param[out] status Structure containing progress along path and deviation
+ * @returns true while flying the turn onto the next leg
+ *
+ * As @ref path_progress, except that near the end of a vector leg the
+ * fillet precomputed by the planner is flown instead of the corner.  The
+ * last stretch of the leg's progress is spread over the turn, so the leg
+ * completes where the turn meets the next one.
+ */
+bool path_progress_lookahead(const PathDesiredData *pathDesired,
+                             const PathLookaheadData *lookahead,
+                             const float *cur_point,
+                             struct path_status *status)
+{
+	path_progress(pathDesired, cur_point, status);
+
+	if (lookahead == NULL ||
+			pathDesired->Mode != PATHDESIRED_MODE_VECTOR ||
+			lookahead->Waypoint[0] != pathDesired->Waypoint ||
+			lookahead->Waypoint[1] < 0 ||
+			lookahead->CornerDistance[0] <= 0 ||
+			lookahead->CornerCurvature[0] == 0 ||
+			lookahead->Length[0] <= 0 ||
+			lookahead->Length[1] <= 0) {
+		return false;
+	}
+
+	const float length = lookahead->Length[0];
+	const float distance = lookahead->CornerDistance[0];
+
+	if ((1 - status->fractional_progress) * length > distance) {
+		return false;
+	}
+
+	const float curvature = lookahead->CornerCurvature[0];
+	const float radius = 1 / fabsf(curvature);
+	const float side = (curvature > 0) ? 1 : -1;
+
+	// Directions of this leg and the next
+	const float in_dir[2] = {
+		status->path_direction[0],
+		status->path_direction[1]
+	};
+	const float out_dir[2] = {
+		(lookahead->EndNorth[1] - lookahead->EndNorth[0]) / lookahead->Length[1],
+		(lookahead->EndEast[1] - lookahead->EndEast[0]) / lookahead->Length[1]
+	};
+
+	// Where the fillet leaves this leg and joins the next
+	const float turn_start[2] = {
+		pathDesired->End[0] - in_dir[0] * distance,
+		pathDesired->End[1] - in_dir[1] * distance
+	};
+	const float turn_end[2] = {
+		pathDesired->End[0] + out_dir[0] * distance,
+		pathDesired->End[1] + out_dir[1] * distance
+	};
+
+	const float center[2] = {
+		turn_start[0] - in_dir[1] * radius * side,
+		turn_start[1] + in_dir[0] * radius * side
+	};
+
+	path_circle(center, radius, cur_point, status, curvature > 0);
+
+	// Progress through the turn, measured along its chord
+	const float chord[2] = {
+		turn_end[0] - turn_start[0],
+		turn_end[1] - turn_start[1]
+	};
+	const float chord_sq = chord[0] * chord[0] + chord[1] * chord[1];
+
+	float turn_progress = 1;
+
+	if (chord_sq > 1e-6f) {
+		turn_progress = ((cur_point[0] - turn_start[0]) * chord[0] +
+			(cur_point[1] - turn_start[1]) * chord[1]) / chord_sq;
+
+		if (turn_progress < 0) {
+			turn_progress = 0;
+		}
+	}
+
+	status->fractional_progress = 1 - distance * (1 - turn_progress) / length;
+
+	return true;
+}
+
 /**
  * @brief Compute progress towards endpoint. Deviation equals distance
  * @param[in] start_point Starting point
@@ -0,0 +1,205 @@
+/**
+ ******************************************************************************
+ * @addtogroup TauLabsLibraries Tau Labs Libraries
+ * @{
+ *
+ * @file       rls_ident.c
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Recursive least squares identification of an axis' response
+ *
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "rls_ident.h"
+
+#include <math.h>
+#include <string.h>
+
+/* Accelerations are fit in thousands of deg/s^2, so that all of theta is
+ * of order one and the covariance keeps its precision in floats */
+#define ACCEL_SCALE 0.001f
+
+/* Starting covariance: nothing is known */
+#define P_INITIAL 100.0f
+
+/* Without excitation the covariance grows by 1/lambda every sample; stop
+ * it there rather than let the next disturbance throw theta around */
+#define P_MAX_TRACE 1000.0f
+
+static void fit_init(struct rls_ident_fit *fit)
+{
+	memset(fit, 0, sizeof(*fit));
+
+	for (int i = 0; i < 3; i++) {
+		fit->P[i][i] = P_INITIAL;
+	}
+}
+
+static void fit_update(struct rls_ident_fit *fit, const float phi[3],
+		float y, float lambda)
+{
+	float Pphi[3];
+	float denom = lambda;
+
+	for (int i = 0; i < 3; i++) {
+		Pphi[i] = fit->P[i][0] * phi[0] + fit->P[i][1] * phi[1] +
+			fit->P[i][2] * phi[2];
+		denom += phi[i] * Pphi[i];
+	}
+
+	float err = y - (fit->theta[0] * phi[0] + fit->theta[1] * phi[1] +
+			fit->theta[2] * phi[2]);
+
+	fit->err_sq = lambda * fit->err_sq + (1 - lambda) * err * err;
+
+	float trace = 0;
+
+	for (int i = 0; i < 3; i++) {
+		float k = Pphi[i] / denom;
+
+		fit->theta[i] += k * err;
+
+		for (int j = 0; j < 3; j++) {
+			fit->P[i][j] -= k * Pphi[j];
+		}
+
+		trace += fit->P[i][i];
+	}
+
+	float scale = (trace < P_MAX_TRACE) ? 1 / lambda : 1;
+
+	// Keep P symmetric against rounding
+	for (int i = 0; i < 3; i++) {
+		fit->P[i][i] *= scale;
+
+		for (int j = i + 1; j < 3; j++) {
+			float avg = (fit->P[i][j] + fit->P[j][i]) * 0.5f * scale;
+
+			fit->P[i][j] = avg;
+			fit->P[j][i] = avg;
+		}
+	}
+}
+
+void rls_ident_init(struct rls_ident *ident, float dT, float memory)
+{
+	memset(ident, 0, sizeof(*ident));
+
+	for (int i = 0; i < RLS_IDENT_NUM_DELAYS; i++) {
+		fit_init(&ident->fits[i]);
+	}
+
+	ident->dT = dT;
+	ident->lambda = 1 - dT / memory;
+	ident->refill = RLS_IDENT_NUM_DELAYS + 2;
+}
+
+void rls_ident_skip_gap(struct rls_ident *ident)
+{
+	memset(ident->u_hist, 0, sizeof(ident->u_hist));
+	ident->last_rate = 0;
+	ident->refill = RLS_IDENT_NUM_DELAYS + 2;
+}
+
+void rls_ident_update(struct rls_ident *ident, float rate, float u)
+{
+	float accel = (rate - ident->last_rate) / ident->dT * ACCEL_SCALE;
+
+	/* Once the acceleration and every delayed input are real samples */
+	if (ident->refill) {
+		/* Restart each fit's own prediction from the measurement,
+		 * which is real from the second sample on */
+		if (ident->refill <= RLS_IDENT_NUM_DELAYS + 1) {
+			for (int i = 0; i < RLS_IDENT_NUM_DELAYS; i++) {
+				ident->fits[i].model_accel = accel;
+			}
+		}
+
+		ident->refill--;
+	} else {
+		for (int i = 0; i < RLS_IDENT_NUM_DELAYS; i++) {
+			struct rls_ident_fit *fit = &ident->fits[i];
+
+			const float phi[3] = {
+				fit->model_accel, ident->u_hist[i], 1
+			};
+
+			fit_update(fit, phi, accel, ident->lambda);
+
+			fit->model_accel = fit->theta[0] * phi[0] +
+				fit->theta[1] * phi[1] + fit->theta[2] * phi[2];
+		}
+	}
+
+	for (int i = RLS_IDENT_NUM_DELAYS - 1; i > 0; i--) {
+		ident->u_hist[i] = ident->u_hist[i - 1];
+	}
+
+	ident->u_hist[0] = u;
+	ident->last_rate = rate;
+	ident->samples++;
+}
+
+bool rls_ident_get_estimate(const struct rls_ident *ident,
+		struct rls_ident_estimate *est)
+{
+	if (ident->samples <= RLS_IDENT_NUM_DELAYS + 1) {
+		return false;
+	}
+
+	/* Wait for one memory's worth of fitting */
+	uint32_t fitted = ident->samples - RLS_IDENT_NUM_DELAYS - 1;
+
+	if (fitted * (1 - ident->lambda) < 1) {
+		return false;
+	}
+
+	int best = 0;
+
+	for (int i = 1; i < RLS_IDENT_NUM_DELAYS; i++) {
+		if (ident->fits[i].err_sq < ident->fits[best].err_sq) {
+			best = i;
+		}
+	}
+
+	const struct rls_ident_fit *fit = &ident->fits[best];
+
+	float alpha = fit->theta[0];
+
+	if (alpha <= 0 || alpha >= 1) {
+		return false;
+	}
+
+	float gain = fit->theta[1] / (1 - alpha) / ACCEL_SCALE;
+
+	if (gain <= 0) {
+		return false;
+	}
+
+	est->gain = gain;
+	est->tau = -ident->dT / logf(alpha);
+	est->delay = best * ident->dT;
+	est->bias = fit->theta[2] / (1 - alpha) / ACCEL_SCALE;
+	est->noise = sqrtf(fit->err_sq) / ACCEL_SCALE;
+
+	return true;
+}
+
+/**
+ * @}
+ */
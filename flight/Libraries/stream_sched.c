@@ -0,0 +1,256 @@
+/**
+ ******************************************************************************
+ * @addtogroup TauLabsLibraries Tau Labs Libraries
+ * @{
+ *
+ * @file       stream_sched.c
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Deadline ordered scheduler for periodic telemetry messages
+ *
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "stream_sched.h"
+
+#include <stddef.h>
+
+/* Longest gap between ticks that is credited in full; it only needs to
+ * be enough to fill the burst allowance, and keeps the product in range */
+#define MAX_CREDITED_MS 1000
+
+/* Times wrap, so compare them by difference */
+static inline int32_t time_diff(uint32_t a, uint32_t b)
+{
+	return (int32_t) (a - b);
+}
+
+static int find_message(const struct stream_sched *s, uint8_t msgid)
+{
+	for (int i = 0; i < s->num_messages; i++) {
+		if (s->table[i].msgid == msgid) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/* A message that was off goes out right away; one that was on keeps its
+ * deadline unless the new interval brings it closer */
+static void apply_interval(struct stream_sched *s, int idx,
+		uint16_t interval_ms, uint32_t now)
+{
+	if (interval_ms == 0) {
+		s->state[idx].interval_ms = 0;
+		return;
+	}
+
+	if (s->state[idx].interval_ms == 0) {
+		s->state[idx].due = now;
+	} else if (time_diff(s->state[idx].due, now + interval_ms) > 0) {
+		s->state[idx].due = now + interval_ms;
+	}
+
+	s->state[idx].interval_ms = interval_ms;
+}
+
+int32_t stream_sched_init(struct stream_sched *s,
+		const struct stream_sched_message *table, uint8_t num_messages,
+		uint32_t bytes_per_s, uint16_t max_burst, uint32_t now)
+{
+	if (num_messages > STREAM_SCHED_MAX_MESSAGES) {
+		return -1;
+	}
+
+	s->table = table;
+	s->num_messages = num_messages;
+	s->bytes_per_s = bytes_per_s;
+	s->last_tick = now;
+
+	/* A burst smaller than the longest message would never let it out */
+	uint16_t longest = max_burst;
+
+	for (int i = 0; i < num_messages; i++) {
+		if (table[i].max_len > longest) {
+			longest = table[i].max_len;
+		}
+
+		s->state[i].interval_ms = table[i].default_interval_ms;
+		s->state[i].due = now;
+	}
+
+	s->max_credit = longest * 1000;
+	s->credit = s->max_credit;
+
+	return 0;
+}
+
+void stream_sched_tick(struct stream_sched *s, uint32_t now)
+{
+	uint32_t elapsed = now - s->last_tick;
+
+	s->last_tick = now;
+
+	if (s->bytes_per_s == 0) {
+		return;
+	}
+
+	if (elapsed > MAX_CREDITED_MS) {
+		elapsed = MAX_CREDITED_MS;
+	}
+
+	s->credit += elapsed * s->bytes_per_s;
+
+	if (s->credit > s->max_credit) {
+		s->credit = s->max_credit;
+	}
+}
+
+int stream_sched_next(const struct stream_sched *s, uint32_t now,
+		uint16_t room)
+{
+	int best = -1;
+
+	for (int i = 0; i < s->num_messages; i++) {
+		if (s->state[i].interval_ms == 0 ||
+				time_diff(now, s->state[i].due) < 0) {
+			continue;
+		}
+
+		if (best < 0 ||
+				time_diff(s->state[i].due, s->state[best].due) < 0) {
+			best = i;
+		}
+	}
+
+	if (best < 0) {
+		return -1;
+	}
+
+	uint16_t len = s->table[best].max_len;
+
+	if (len > room) {
+		return -1;
+	}
+
+	if (s->bytes_per_s && s->credit < len * 1000) {
+		return -1;
+	}
+
+	return best;
+}
+
+void stream_sched_sent(struct stream_sched *s, int idx, uint16_t len,
+		uint32_t now)
+{
+	if (s->bytes_per_s) {
+		uint32_t cost = len * 1000;
+
+		s->credit = s->credit > cost ? s->credit - cost : 0;
+	}
+
+	uint16_t interval = s->state[idx].interval_ms;
+
+	if (interval == 0) {
+		return;
+	}
+
+	s->state[idx].due += interval;
+
+	if (time_diff(s->state[idx].due, now) <= 0) {
+		s->state[idx].due = now + interval;
+	}
+}
+
+int32_t stream_sched_set_interval(struct stream_sched *s, uint8_t msgid,
+		int32_t interval_us, uint32_t now)
+{
+	int idx = find_message(s, msgid);
+
+	if (idx < 0) {
+		return -1;
+	}
+
+	uint16_t interval_ms;
+
+	if (interval_us < 0) {
+		interval_ms = 0;
+	} else if (interval_us == 0) {
+		interval_ms = s->table[idx].default_interval_ms;
+	} else if (interval_us >= 65535 * 1000) {
+		interval_ms = 65535;
+	} else if (interval_us < 1000) {
+		interval_ms = 1;
+	} else {
+		interval_ms = (interval_us + 500) / 1000;
+	}
+
+	apply_interval(s, idx, interval_ms, now);
+
+	return 0;
+}
+
+int32_t stream_sched_set_stream_rate(struct stream_sched *s, uint8_t stream,
+		uint16_t rate_hz, bool start, uint32_t now)
+{
+	int32_t changed = 0;
+
+	for (int i = 0; i < s->num_messages; i++) {
+		if (s->table[i].stream == 0) {
+			continue;
+		}
+
+		if (stream != STREAM_SCHED_ALL_STREAMS &&
+				s->table[i].stream != stream) {
+			continue;
+		}
+
+		uint16_t interval_ms = 0;
+
+		if (start) {
+			if (rate_hz == 0) {
+				interval_ms = s->table[i].default_interval_ms;
+			} else if (rate_hz >= 1000) {
+				interval_ms = 1;
+			} else {
+				interval_ms = 1000 / rate_hz;
+			}
+		}
+
+		apply_interval(s, i, interval_ms, now);
+		changed++;
+	}
+
+	return changed;
+}
+
+int32_t stream_sched_get_interval(const struct stream_sched *s,
+		uint8_t msgid)
+{
+	int idx = find_message(s, msgid);
+
+	if (idx < 0) {
+		return -1;
+	}
+
+	return s->state[idx].interval_ms;
+}
+
+/**
+ * @}
+ */
@@ -0,0 +1,209 @@
+/**
+ ******************************************************************************
+ * @addtogroup TauLabsLibraries Tau Labs Libraries
+ * @{
+ *
+ * @file       telemetry_snapshot.c
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Shared sample of the state third party telemetry bridges export
+ *
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "openpilot.h"
+#include "pios_mutex.h"
+#include "pios_thread.h"
+#include "telemetry_snapshot.h"
+
+#include "airspeedactual.h"
+#include "attitudeactual.h"
+#include "baroaltitude.h"
+#include "flightbatterysettings.h"
+#include "flightbatterystate.h"
+#include "flightstatus.h"
+#include "gpsposition.h"
+#include "homelocation.h"
+#include "manualcontrolcommand.h"
+#include "positionactual.h"
+#include "systemstats.h"
+#include "velocityactual.h"
+
+// Private variables
+static struct pios_mutex *snapshot_lock;
+static struct telemetry_snapshot snapshot;
+static bool sampled;
+
+// Private functions
+static void sample(struct telemetry_snapshot *s);
+
+int32_t telemetry_snapshot_init(void)
+{
+	if (snapshot_lock) {
+		return 0;
+	}
+
+	snapshot_lock = PIOS_Mutex_Create();
+
+	return snapshot_lock ? 0 : -1;
+}
+
+void telemetry_snapshot_get(struct telemetry_snapshot *snap)
+{
+	PIOS_Assert(snapshot_lock);
+
+	PIOS_Mutex_Lock(snapshot_lock, PIOS_MUTEX_TIMEOUT_MAX);
+
+	uint32_t now = PIOS_Thread_Systime();
+
+	if (!sampled || now - snapshot.sample_time >= TELEMETRY_SNAPSHOT_MAX_AGE_MS) {
+		sample(&snapshot);
+
+		snapshot.sample_time = now;
+		snapshot.sequence++;
+		sampled = true;
+	}
+
+	*snap = snapshot;
+
+	PIOS_Mutex_Unlock(snapshot_lock);
+}
+
+/**
+ * Read everything in one pass.  Only GPSPosition and FlightStatus are
+ * copied whole; of the rest just the fields the bridges use are fetched.
+ */
+static void sample(struct telemetry_snapshot *s)
+{
+	s->have_attitude = AttitudeActualHandle() != NULL;
+	if (s->have_attitude) {
+		AttitudeActualRollGet(&s->roll);
+		AttitudeActualPitchGet(&s->pitch);
+		AttitudeActualYawGet(&s->yaw);
+	}
+
+	s->have_gps = GPSPositionHandle() != NULL;
+	if (s->have_gps) {
+		GPSPositionData gps;
+		GPSPositionGet(&gps);
+
+		s->gps_status = gps.Status;
+		s->gps_satellites = gps.Satellites;
+		s->latitude = gps.Latitude;
+		s->longitude = gps.Longitude;
+		s->gps_altitude = gps.Altitude;
+		s->groundspeed = gps.Groundspeed;
+		s->course = gps.Heading;
+		s->hdop = gps.HDOP;
+		s->vdop = gps.VDOP;
+	} else {
+		s->gps_status = GPSPOSITION_STATUS_NOGPS;
+	}
+
+	s->have_home = HomeLocationHandle() != NULL;
+	if (s->have_home) {
+		uint8_t set;
+		HomeLocationSetGet(&set);
+		s->home_set = set == HOMELOCATION_SET_TRUE;
+
+		HomeLocationLatitudeGet(&s->home_latitude);
+		HomeLocationLongitudeGet(&s->home_longitude);
+		HomeLocationAltitudeGet(&s->home_altitude);
+	}
+
+	s->have_position = PositionActualHandle() != NULL;
+	if (s->have_position) {
+		PositionActualNorthGet(&s->position[0]);
+		PositionActualEastGet(&s->position[1]);
+		PositionActualDownGet(&s->position[2]);
+	}
+
+	s->have_velocity = VelocityActualHandle() != NULL;
+	if (s->have_velocity) {
+		VelocityActualNorthGet(&s->velocity[0]);
+		VelocityActualEastGet(&s->velocity[1]);
+		VelocityActualDownGet(&s->velocity[2]);
+	}
+
+	s->have_baro = BaroAltitudeHandle() != NULL;
+	if (s->have_baro) {
+		BaroAltitudeAltitudeGet(&s->baro_altitude);
+	}
+
+	s->have_airspeed = AirspeedActualHandle() != NULL;
+	if (s->have_airspeed) {
+		AirspeedActualTrueAirspeedGet(&s->true_airspeed);
+	}
+
+	s->have_battery = FlightBatteryStateHandle() != NULL &&
+		FlightBatterySettingsHandle() != NULL;
+	if (s->have_battery) {
+		uint8_t voltage_pin, current_pin, detected_cells;
+
+		FlightBatterySettingsVoltagePinGet(&voltage_pin);
+		FlightBatterySettingsCurrentPinGet(&current_pin);
+		FlightBatterySettingsCapacityGet(&s->battery_capacity);
+		FlightBatterySettingsNbCellsGet(&s->battery_cells);
+
+		s->battery_voltage = 0;
+		if (voltage_pin != FLIGHTBATTERYSETTINGS_VOLTAGEPIN_NONE) {
+			FlightBatteryStateVoltageGet(&s->battery_voltage);
+		}
+
+		s->battery_current = 0;
+		if (current_pin != FLIGHTBATTERYSETTINGS_CURRENTPIN_NONE) {
+			FlightBatteryStateCurrentGet(&s->battery_current);
+		}
+
+		FlightBatteryStateConsumedEnergyGet(&s->consumed_energy);
+
+		FlightBatteryStateDetectedCellCountGet(&detected_cells);
+		if (detected_cells) {
+			s->battery_cells = detected_cells;
+		}
+	}
+
+	if (FlightStatusHandle() != NULL) {
+		FlightStatusData status;
+		FlightStatusGet(&status);
+
+		s->armed = status.Armed;
+		s->flight_mode = status.FlightMode;
+		s->control_source = status.ControlSource;
+	}
+
+	if (ManualControlCommandHandle() != NULL) {
+		uint16_t channels[MANUALCONTROLCOMMAND_CHANNEL_NUMELEM];
+
+		ManualControlCommandRssiGet(&s->rssi);
+		ManualControlCommandChannelGet(channels);
+
+		for (int i = 0; i < TELEMETRY_SNAPSHOT_CHANNELS; i++) {
+			s->channels[i] = i < MANUALCONTROLCOMMAND_CHANNEL_NUMELEM ?
+				channels[i] : 0;
+		}
+	}
+
+	if (SystemStatsHandle() != NULL) {
+		SystemStatsFlightTimeGet(&s->flight_time);
+		SystemStatsCPULoadGet(&s->cpu_load);
+	}
+}
+
+/**
+ * @}
+ */
@@ -45,7 +45,7 @@ static int32_t objectTransaction(UAVTalkConnectionData *connection, UAVObjHandle
 static int32_t sendObject(UAVTalkConnectionData *connection, UAVObjHandle obj, uint16_t instId, uint8_t type);
 static int32_t sendSingleObject(UAVTalkConnectionData *connection, UAVObjHandle obj, uint16_t instId, uint8_t type);
 static int32_t sendNack(UAVTalkConnectionData *connection, uint32_t objId);
-static int32_t receiveObject(UAVTalkConnectionData *connection);
+static int32_t receiveObject(UAVTalkConnectionData *connection, const uint8_t *data);
 static int32_t sendBuf(UAVTalkConnection connectionHandle, uint8_t *buf, uint16_t len);
 
 /**
@@ -61,7 +61,8 @@ UAVTalkConnection UAVTalkInitialize(void *ctx, UAVTalkOutputCb outputStream,
 		UAVTalkAckCb ackCallback, UAVTalkFileCb fileCallback)
 {
 	// allocate object
-	UAVTalkConnectionData * connection = PIOS_malloc_no_dma(sizeof(UAVTalkConnectionData));
+	UAVTalkConnectionData * connection = PIOS_malloc_no_dma_tagged(sizeof(UAVTalkConnectionData),
+			PIOS_HEAP_TAG_COMMS);
 	if (!connection) return 0;
 
 	*connection = (UAVTalkConnectionData) {
@@ -76,9 +77,9 @@ UAVTalkConnection UAVTalkInitialize(void *ctx, UAVTalkOutputCb outputStream,
 	connection->lock = PIOS_Recursive_Mutex_Create();
 	PIOS_Assert(connection->lock != NULL);
 	// allocate buffers
-	connection->rxBuffer = PIOS_malloc(UAVTALK_MAX_PACKET_LENGTH);
+	connection->rxBuffer = PIOS_malloc_tagged(UAVTALK_MAX_PACKET_LENGTH, PIOS_HEAP_TAG_COMMS);
 	if (!connection->rxBuffer) return 0;
-	connection->txBuffer = PIOS_malloc(UAVTALK_MAX_PACKET_LENGTH);
+	connection->txBuffer = PIOS_malloc_tagged(UAVTALK_MAX_PACKET_LENGTH, PIOS_HEAP_TAG_COMMS);
 	if (!connection->txBuffer) return 0;
 
 	return (UAVTalkConnection) connection;
@@ -423,7 +424,7 @@ void UAVTalkProcessInputStream(UAVTalkConnection connectionHandle, uint8_t *rxby
 					rxbytes[i]);
 
 		if (state == UAVTALK_STATE_COMPLETE) {
-			receiveObject(connection);
+			receiveObject(connection, connection->rxBuffer);
 		}
 	}
 }
@@ -533,7 +534,7 @@ int32_t UAVTalkReceiveObject(UAVTalkConnection connectionHandle)
 		return -1;
 	}
 
-	return receiveObject(connection);
+	return receiveObject(connection, connection->rxBuffer);
 }
 
 /**
@@ -620,6 +621,260 @@ UAVTalkRxState UAVTalkRelayInputStream(UAVTalkConnection connectionHandle, uint8
 	return state;
 }
 
+/**
+ * Find UAVTalk frames in a stream that is mostly relayed rather than
+ * received.  Only the framing and CRC are checked: the object isn't looked
+ * up and the frame is kept byte for byte in the receive buffer, so it can
+ * be forwarded untouched with UAVTalkRelayFrame() or, for the few objects
+ * that are consumed here, decoded with UAVTalkReceiveFrame().
+ *
+ * A connection should either frame its input or parse it with
+ * UAVTalkProcessInputStreamQuiet(), not both.
+ *
+ * Returns after a complete frame, so the caller can dispatch it before
+ * passing the rest of the bytes.
+ * \param[in] connectionHandle UAVTalkConnection to be used
+ * \param[in] rxbytes Received bytes
+ * \param[in] numbytes Number of received bytes
+ * \param[out] complete Set if a frame was completed
+ * \return number of bytes consumed
+ * \return -1 Failure
+ */
+int32_t UAVTalkFrameInputStream(UAVTalkConnection connectionHandle,
+		const uint8_t *rxbytes, int32_t numbytes, bool *complete)
+{
+	UAVTalkConnectionData *connection;
+	CHECKCONHANDLE(connectionHandle, connection, return -1);
+
+	UAVTalkInputProcessor *iproc = &connection->iproc;
+	uint8_t *frame = connection->rxBuffer;
+	int32_t i = 0;
+
+	*complete = false;
+
+	while (i < numbytes) {
+		if (iproc->state == UAVTALK_STATE_ERROR) {
+			connection->stats.rxErrors++;
+			iproc->state = UAVTALK_STATE_SYNC;
+		} else if (iproc->state == UAVTALK_STATE_COMPLETE) {
+			iproc->state = UAVTALK_STATE_SYNC;
+		}
+
+		// Body of the frame: take as much as is here in one go
+		if (iproc->state == UAVTALK_STATE_DATA) {
+			int32_t len = iproc->packet_size - iproc->rxPacketLength;
+
+			if (len > numbytes - i) {
+				len = numbytes - i;
+			}
+
+			memcpy(&frame[iproc->rxPacketLength], &rxbytes[i], len);
+			iproc->cs = PIOS_CRC_updateCRC(iproc->cs, &rxbytes[i], len);
+			iproc->rxPacketLength += len;
+			i += len;
+
+			if (iproc->rxPacketLength == iproc->packet_size) {
+				iproc->state = UAVTALK_STATE_CS;
+			}
+
+			continue;
+		}
+
+		uint8_t rxbyte = rxbytes[i++];
+
+		switch (iproc->state) {
+		case UAVTALK_STATE_SYNC:
+			if (rxbyte != UAVTALK_SYNC_VAL)
+				break;
+
+			frame[0] = rxbyte;
+			iproc->cs = PIOS_CRC_updateByte(0, rxbyte);
+			iproc->rxPacketLength = 1;
+			iproc->state = UAVTALK_STATE_TYPE;
+			break;
+
+		case UAVTALK_STATE_TYPE:
+			if ((rxbyte & UAVTALK_TYPE_MASK) != UAVTALK_TYPE_VER) {
+				iproc->state = UAVTALK_STATE_ERROR;
+				break;
+			}
+
+			frame[iproc->rxPacketLength++] = rxbyte;
+			iproc->cs = PIOS_CRC_updateByte(iproc->cs, rxbyte);
+			iproc->type = rxbyte;
+			iproc->state = UAVTALK_STATE_SIZE;
+			break;
+
+		case UAVTALK_STATE_SIZE:
+			frame[iproc->rxPacketLength++] = rxbyte;
+			iproc->cs = PIOS_CRC_updateByte(iproc->cs, rxbyte);
+
+			if (iproc->rxPacketLength < 4)
+				break;
+
+			iproc->packet_size = frame[2] | (frame[3] << 8);
+
+			if (iproc->packet_size < UAVTALK_MIN_HEADER_LENGTH ||
+					iproc->packet_size > UAVTALK_MAX_HEADER_LENGTH + UAVTALK_MAX_PAYLOAD_LENGTH) { // incorrect packet size
+				iproc->state = UAVTALK_STATE_ERROR;
+				break;
+			}
+
+			iproc->state = UAVTALK_STATE_DATA;
+			break;
+
+		case UAVTALK_STATE_CS:
+			if (rxbyte != iproc->cs) { // packet error - faulty CRC
+				iproc->state = UAVTALK_STATE_ERROR;
+				break;
+			}
+
+			frame[iproc->rxPacketLength++] = rxbyte;
+
+			iproc->objId = frame[4] | (frame[5] << 8) |
+				(frame[6] << 16) | ((uint32_t) frame[7] << 24);
+			iproc->obj = NULL;
+			iproc->length = iproc->packet_size - UAVTALK_MIN_HEADER_LENGTH;
+
+			connection->stats.rxObjectBytes += iproc->length;
+			connection->stats.rxObjects++;
+
+			iproc->state = UAVTALK_STATE_COMPLETE;
+			break;
+
+		default:
+			iproc->state = UAVTALK_STATE_ERROR;
+		}
+
+		if (iproc->state == UAVTALK_STATE_COMPLETE) {
+			*complete = true;
+			break;
+		}
+	}
+
+	connection->stats.rxBytes += i;
+
+	return i;
+}
+
+/**
+ * Forward the frame just completed by UAVTalkFrameInputStream() exactly as
+ * it was received.
+ * \param[in] inConnectionHandle UAVTalkConnection the frame arrived on
+ * \param[in] outConnectionHandle UAVTalkConnection to send it out on
+ * \return 0 Success
+ * \return -1 Failure
+ */
+int32_t UAVTalkRelayFrame(UAVTalkConnection inConnectionHandle, UAVTalkConnection outConnectionHandle)
+{
+	UAVTalkConnectionData *inConnection;
+	CHECKCONHANDLE(inConnectionHandle, inConnection, return -1);
+
+	UAVTalkInputProcessor *inIproc = &inConnection->iproc;
+
+	if (inIproc->state != UAVTALK_STATE_COMPLETE) {
+		return -1;
+	}
+
+	UAVTalkConnectionData *outConnection;
+	CHECKCONHANDLE(outConnectionHandle, outConnection, return -1);
+
+	if (!outConnection->outCb) {
+		outConnection->stats.txErrors++;
+
+		return -1;
+	}
+
+	if (sendBuf(outConnectionHandle, inConnection->rxBuffer,
+				inIproc->rxPacketLength) < 0) {
+		outConnection->stats.txErrors++;
+
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Decode and act on the frame just completed by UAVTalkFrameInputStream(),
+ * as UAVTalkReceiveObject() does for a parsed packet.  The frame is left
+ * intact, so it can still be relayed afterwards.  File requests are not
+ * handled.
+ * \param[in] connectionHandle UAVTalkConnection the frame arrived on
+ * \return 0 Success
+ * \return -1 Failure
+ */
+int32_t UAVTalkReceiveFrame(UAVTalkConnection connectionHandle)
+{
+	UAVTalkConnectionData *connection;
+	CHECKCONHANDLE(connectionHandle, connection, return -1);
+
+	UAVTalkInputProcessor *iproc = &connection->iproc;
+
+	if (iproc->state != UAVTALK_STATE_COMPLETE ||
+			iproc->type == UAVTALK_TYPE_FILEREQ) {
+		return -1;
+	}
+
+	const uint8_t *frame = connection->rxBuffer;
+	uint16_t body = iproc->packet_size - UAVTALK_MIN_HEADER_LENGTH;
+
+	// The same length rules as the full parser
+	iproc->obj = UAVObjGetByID(iproc->objId);
+	iproc->instanceLength = 0;
+
+	if (iproc->type == UAVTALK_TYPE_OBJ_REQ || iproc->type == UAVTALK_TYPE_ACK || iproc->type == UAVTALK_TYPE_NACK) {
+		iproc->length = 0;
+
+		if (body == 2) {
+			iproc->instanceLength = 2;
+		}
+	} else if (iproc->obj) {
+		iproc->length = UAVObjGetNumBytes(iproc->obj);
+		iproc->instanceLength = (UAVObjIsSingleInstance(iproc->obj) ? 0 : 2);
+	} else {
+		iproc->length = body;
+	}
+
+	if (iproc->instanceLength + iproc->length != body) { // packet error - mismatched packet size
+		connection->stats.rxErrors++;
+
+		return -1;
+	}
+
+	iproc->instId = 0;
+
+	if (iproc->instanceLength) {
+		iproc->instId = frame[8] | (frame[9] << 8);
+	}
+
+	return receiveObject(connection, &frame[UAVTALK_MIN_HEADER_LENGTH + iproc->instanceLength]);
+}
+
+/**
+ * Get the instance ID of the frame just completed by
+ * UAVTalkFrameInputStream(), if it has one.
+ * \param[in] connectionHandle UAVTalkConnection to be used
+ * \return The instance ID; 0 if the frame has no instance field.
+ */
+uint32_t UAVTalkGetFrameInstId(UAVTalkConnection connectionHandle)
+{
+	UAVTalkConnectionData *connection;
+
+	CHECKCONHANDLE(connectionHandle, connection, return 0);
+
+	UAVTalkInputProcessor *iproc = &connection->iproc;
+
+	UAVObjHandle obj = UAVObjGetByID(iproc->objId);
+
+	if (!obj || UAVObjIsSingleInstance(obj) ||
+			(iproc->packet_size < UAVTALK_MIN_HEADER_LENGTH + 2)) {
+		return 0;
+	}
+
+	return connection->rxBuffer[8] | (connection->rxBuffer[9] << 8);
+}
+
 /**
  * Send a buffer containing a UAVTalk message through the telemetry link.
  * This function locks the connection prior to sending.
@@ -752,7 +1007,7 @@ static void handleFileReq(UAVTalkConnectionData *connection)
  * \return 0 Success
  * \return -1 Failure
  */
-static int32_t receiveObject(UAVTalkConnectionData *connection)
+static int32_t receiveObject(UAVTalkConnectionData *connection, const uint8_t *data)
 {
 	int32_t ret = 0;
 
@@ -796,7 +1051,7 @@ static int32_t receiveObject(UAVTalkConnectionData *connection)
 		// All instances, not allowed for OBJ messages
 		if (obj && (instId != UAVOBJ_ALL_INSTANCES)) {
 			// Unpack object, if the instance does not exist it will be created!
-			UAVObjUnpack(obj, instId, connection->rxBuffer);
+			UAVObjUnpack(obj, instId, data);
 		} else {
 			ret = -1;
 		}
@@ -805,7 +1060,7 @@ static int32_t receiveObject(UAVTalkConnectionData *connection)
 		// All instances, not allowed for OBJ_ACK messages
 		if (obj && (instId != UAVOBJ_ALL_INSTANCES)) {
 			// Unpack object, if the instance does not exist it will be created!
-			if (UAVObjUnpack(obj, instId, connection->rxBuffer) == 0) {
+			if (UAVObjUnpack(obj, instId, data) == 0) {
 				// Transmit ACK
 				sendObject(connection, obj, instId, UAVTALK_TYPE_ACK);
 			} else {
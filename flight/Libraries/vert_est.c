@@ -0,0 +1,72 @@
+/**
+ ******************************************************************************
+ * @addtogroup TauLabsLibraries Tau Labs Libraries
+ * @{
+ *
+ * @file       vert_est.c
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Vertical position and velocity from accels and baro
+ *
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "vert_est.h"
+
+void vert_est_reset(struct vert_est *est, float baro, float time_constant)
+{
+	est->velocity_z = 0;
+	est->position_z = 0;
+
+	// Worked out once here rather than with every sample
+	est->k1_z = 3 / time_constant;
+	est->k2_z = 3 / (time_constant * time_constant);
+	est->k3_z = 1 / (time_constant * time_constant * time_constant);
+
+	est->accel_correction_z = 0;
+	est->position_base_z = 0;
+	est->position_error_z = 0;
+	est->position_correction_z = 0;
+	est->baro_zero = baro;
+}
+
+void vert_est_predict(struct vert_est *est, float z_accel, float dt)
+{
+	est->accel_correction_z += est->position_error_z * est->k3_z * dt;
+	est->velocity_z += est->position_error_z * est->k2_z * dt;
+	est->position_correction_z += est->position_error_z * est->k1_z * dt;
+
+	float velocity_increase = (z_accel + est->accel_correction_z) * dt;
+
+	est->position_base_z += (est->velocity_z + velocity_increase * 0.5f) * dt;
+	est->position_z = est->position_base_z + est->position_correction_z;
+	est->velocity_z += velocity_increase;
+}
+
+void vert_est_update_baro(struct vert_est *est, float baro)
+{
+	float down = -(baro - est->baro_zero);
+
+	// TODO: get from a queue of previous position updates (150 ms latency)
+	float hist_position_base_d = est->position_base_z;
+
+	est->position_error_z = down - (hist_position_base_d + est->position_correction_z);
+}
+
+/**
+ * @}
+ */
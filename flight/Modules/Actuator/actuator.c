@@ -46,12 +46,14 @@
 #include "actuatordesired.h"
 #include "actuatorcommand.h"
 #include "flightstatus.h"
+#include "looptiming.h"
 #include "mixersettings.h"
 #include "cameradesired.h"
 #include "manualcontrolcommand.h"
 #include "pios_thread.h"
 #include "pios_queue.h"
 #include "misc_math.h"
+#include "loop_timing.h"
 
 // Private constants
 #define MAX_QUEUE_SIZE 2
@@ -105,6 +107,11 @@ static float curve2[MIXERSETTINGS_THROTTLECURVE2_NUMELEM];
 
 static MixerSettingsCurve2SourceOptions curve2_src;
 
+#if defined(LOOPTIMING_DIAGNOSTICS)
+static struct loop_timing timing;
+static struct loop_timing_hist latency;
+#endif
+
 // Private functions
 static void actuator_task(void* parameters);
 
@@ -172,6 +179,12 @@ int32_t ActuatorInitialize()
 	}
 #endif
 
+#if defined(LOOPTIMING_DIAGNOSTICS)
+	if (LoopTimingInitialize() == -1) {
+		return -1;
+	}
+#endif
+
 	return 0;
 }
 MODULE_HIPRI_INITCALL(ActuatorInitialize, ActuatorStart);
@@ -461,6 +474,12 @@ static void post_process_scale_and_commit(float *motor_vect, float dT,
 	}
 
 	PIOS_Servo_Update();
+
+	PIOS_TRACE_MARK(PIOS_TRACE_MARKER_ACTUATOR);
+
+#if defined(LOOPTIMING_DIAGNOSTICS)
+	loop_timing_output(&latency);
+#endif
 }
 
 static void normalize_input_data(uint32_t this_systime,
@@ -572,6 +591,14 @@ static void actuator_task(void* parameters)
 	float desired_vect[MIXERSETTINGS_MIXER1VECTOR_NUMELEM] = { 0 };
 	float dT = 0.0f;
 
+#if defined(LOOPTIMING_DIAGNOSTICS)
+	/* We run once per ActuatorDesired, so at the gyro rate */
+	uint32_t samp_rate = PIOS_SENSORS_GetSampleRate(PIOS_SENSOR_GYRO);
+	uint32_t iteration = 0;
+
+	loop_timing_init(&timing, samp_rate ? 1000000 / samp_rate : 1000);
+#endif
+
 	// Main task loop
 	while (1) {
 		/* If settings objects have changed, update our internal
@@ -611,6 +638,10 @@ static void actuator_task(void* parameters)
 			continue;
 		}
 
+#if defined(LOOPTIMING_DIAGNOSTICS)
+		loop_timing_begin(&timing);
+#endif
+
 		uint32_t this_systime = PIOS_Thread_Systime();
 
 		/* Check how long since last update; this is stored into the
@@ -686,6 +717,25 @@ static void actuator_task(void* parameters)
 		post_process_scale_and_commit(motor_vect, dT, armed,
 				spin_while_armed, stabilize_now);
 
+#if defined(LOOPTIMING_DIAGNOSTICS)
+		loop_timing_end(&timing);
+
+		/* About twice a second */
+		if ((++iteration & 511) == 0) {
+			LoopTimingActuatorJitterSet(timing.jitter.counts);
+			LoopTimingActuatorExecutionSet(timing.execution.counts);
+			LoopTimingLatencySet(latency.counts);
+
+			uint16_t max[LOOPTIMING_ACTUATORMAX_NUMELEM] = {
+				[LOOPTIMING_ACTUATORMAX_JITTER] = timing.jitter.max,
+				[LOOPTIMING_ACTUATORMAX_EXECUTION] = timing.execution.max,
+				[LOOPTIMING_ACTUATORMAX_LATENCY] = latency.max,
+			};
+
+			LoopTimingActuatorMaxSet(max);
+		}
+#endif
+
 		/* If we got this far, everything is OK. */
 		AlarmsClear(SYSTEMALARMS_ALARM_ACTUATOR);
 	}
@@ -42,6 +42,10 @@
  *
  * Hold the VTOL aircraft at a fixed altitude by running nested
  * control loops to stay at the AltitudeHoldDesired height.
+ *
+ * While engaged the loops run as the attitude module publishes each
+ * vertical estimate, rather than on a timer of their own, so that they
+ * act on the newest one.
  */
 
 #include "openpilot.h"
@@ -166,13 +170,27 @@ static void altitudeHoldTask(void *parameters)
 	AlarmsSet(SYSTEMALARMS_ALARM_ALTITUDEHOLD, SYSTEMALARMS_ALARM_OK);
 
 	// Main task loop
-	const uint32_t dt_ms = 20;
-	uint32_t timeout = dt_ms;
+	const uint16_t dt_ms = 20;
+	const uint16_t idle_ms = 100;
+	// Longest to wait for a new estimate while engaged
+	const uint16_t estimate_timeout_ms = 5 * dt_ms;
+	uint32_t timeout = idle_ms;
+	bool estimate_lost = false;
 	uint32_t timeval = PIOS_DELAY_GetRaw();
 
 	while (1) {
 		if (PIOS_Queue_Receive(queue, &ev, timeout) != true) {
+			if (!engaged) {
+				continue;
+			}
 
+			// The estimate stopped.  Rather than hold the last thrust,
+			// raise the alarm and run on the timer until it is back.
+			if (!estimate_lost) {
+				estimate_lost = true;
+				timeout = dt_ms;
+				AlarmsSet(SYSTEMALARMS_ALARM_ALTITUDEHOLD, SYSTEMALARMS_ALARM_ERROR);
+			}
 		} else if (ev.obj == FlightStatusHandle()) {
 
 			uint8_t flight_mode;
@@ -184,11 +202,23 @@ static void altitudeHoldTask(void *parameters)
 				engaged = true;
 				timeval = PIOS_DELAY_GetRaw();
 
-			} else if (flight_mode != FLIGHTSTATUS_FLIGHTMODE_ALTITUDEHOLD)
+				// Run the loop at up to 50 Hz, as new estimates arrive
+				UAVObjConnectQueueThrottled(VelocityActualHandle(), queue,
+					EV_MASK_ALL_UPDATES, dt_ms);
+				timeout = estimate_timeout_ms;
+
+			} else if (flight_mode != FLIGHTSTATUS_FLIGHTMODE_ALTITUDEHOLD && engaged) {
 				engaged = false;
 
-			// Run loop at 20 Hz when engaged otherwise just slowly wait for it to be engaged
-			timeout = engaged ? dt_ms : 100;
+				// Sleep until engaged again
+				UAVObjDisconnectQueue(VelocityActualHandle(), queue);
+				timeout = idle_ms;
+
+				if (estimate_lost) {
+					estimate_lost = false;
+					AlarmsSet(SYSTEMALARMS_ALARM_ALTITUDEHOLD, SYSTEMALARMS_ALARM_OK);
+				}
+			}
 
 			continue;
 
@@ -198,12 +228,20 @@ static void altitudeHoldTask(void *parameters)
 			pid_configure(&velocity_pid, altitudeHoldSettings.VelocityKp,
 				          altitudeHoldSettings.VelocityKi, 0.0f, 1.0f);
 			continue;
+		} else if (ev.obj != VelocityActualHandle()) {
+			continue;
+		} else if (estimate_lost) {
+			estimate_lost = false;
+			timeout = estimate_timeout_ms;
+			AlarmsSet(SYSTEMALARMS_ALARM_ALTITUDEHOLD, SYSTEMALARMS_ALARM_OK);
 		}
 
 		// When engaged compute altitude controller output
 		if (engaged) {
 			float position_z, velocity_z, altitude_error;
 
+			// The attitude module sets the position before the velocity,
+			// so both are from the same estimate
 			PositionActualDownGet(&position_z);
 			VelocityActualDownGet(&velocity_z);
 			position_z = -position_z; // Use positive up convention
@@ -55,6 +55,7 @@
 #include "coordinate_conversions.h"
 #include "WorldMagModel.h"
 #include "insgps.h"
+#include "vert_est.h"
 
 // UAVOs
 #include "accels.h"
@@ -121,18 +122,6 @@ struct complementary_filter_state {
 	enum complementary_filter_status     initialization;
 };
 
-//! Struture that tracks the data for the vertical complementary filter
-struct cfvert {
-	float velocity_z;
-	float position_z;
-	float time_constant_z;
-	float accel_correction_z;
-	float position_base_z;
-	float position_error_z;
-	float position_correction_z;
-	float baro_zero;
-};
-
 // Private variables
 static struct pios_thread *attitudeTaskHandle;
 
@@ -156,10 +145,13 @@ static bool home_location_updated;
 static const float zeros[3] = {0.0f, 0.0f, 0.0f};
 
 static struct complementary_filter_state complementary_filter_state;
-static struct cfvert cfvert; //!< State information for vertical filter
+static struct vert_est vert_est; //!< State information for vertical filter
 
 static float dT_expected = 0.001f;	// assume 1KHz if we don't know.
 
+//! The complementary filter attitude estimate
+static float cf_q[4];
+
 // Private functions
 static void AttitudeTask(void *parameters);
 
@@ -175,9 +167,6 @@ static int32_t updateAttitudeComplementary(float dT, bool first_run, bool second
 static int32_t setAttitudeComplementary();
 
 static float calc_ned_accel(float *q, float *accels);
-static void cfvert_reset(struct cfvert *cf, float baro, float time_constant);
-static void cfvert_predict_pos(struct cfvert *cf, float z_accel, float dt);
-static void cfvert_update_baro(struct cfvert *cf, float baro, float dt);
 
 //! Update the INSGPS attitude estimate
 static int32_t updateAttitudeINSGPS(bool first_run, bool outdoor_mode);
@@ -312,17 +301,25 @@ MODULE_HIPRI_INITCALL(AttitudeInitialize, AttitudeStart)
  */
 static void AttitudeTask(void *parameters)
 {
-	bool first_run = true;
-	uint32_t last_algorithm;
-	bool     last_complementary;
+	static bool first_run = true;
+	// Invalidate previous algorithm to trigger a first run
+	static uint32_t last_algorithm = 0xfffffff;
+	static bool     last_complementary = false;
 	set_state_estimation_error(SYSTEMALARMS_STATEESTIMATION_UNDEFINED);
 
 	// Wait for all the sensors be to read
 	PIOS_Thread_Sleep(100);
 
-	// Invalidate previous algorithm to trigger a first run
-	last_algorithm = 0xfffffff;
-	last_complementary = false;
+	// Lets the simulator resume a flight with the filters where they were
+	PIOS_SNAPSHOT_VAR("attitude", first_run);
+	PIOS_SNAPSHOT_VAR("attitude", last_algorithm);
+	PIOS_SNAPSHOT_VAR("attitude", last_complementary);
+	PIOS_SNAPSHOT_VAR("attitude", complementary_filter_state);
+	PIOS_SNAPSHOT_VAR("attitude", vert_est);
+	PIOS_SNAPSHOT_VAR("attitude", cf_q);
+	PIOS_SNAPSHOT_VAR("attitude", homeLocation);
+	PIOS_SNAPSHOT_VAR("attitude", T);
+	INSRegisterSnapshot();
 
 	uint16_t samp_rate = PIOS_SENSORS_GetSampleRate(PIOS_SENSOR_GYRO);
 
@@ -470,6 +467,8 @@ static void AttitudeTask(void *parameters)
 
 		updateNedAccel();
 
+		PIOS_TRACE_MARK(PIOS_TRACE_MARKER_ATTITUDE);
+
 		if(ret_val == 0)
 			first_run = false;
 
@@ -477,9 +476,6 @@ static void AttitudeTask(void *parameters)
 	}
 }
 
-//! The complementary filter attitude estimate
-static float cf_q[4];
-
 /**
  * Update the complementary filter estimate of attitude
  * @param[in] first_run indicates the filter was just selected
@@ -568,7 +564,7 @@ static int32_t updateAttitudeComplementary(float dT, bool first_run, bool second
 
 		float baro;
 		BaroAltitudeAltitudeGet(&baro);
-		cfvert_reset(&cfvert, baro, attitudeSettings.VertPositionTau);
+		vert_est_reset(&vert_est, baro, attitudeSettings.VertPositionTau);
 
 		return 0;
 	}
@@ -627,7 +623,7 @@ static int32_t updateAttitudeComplementary(float dT, bool first_run, bool second
 		// Reset the filter for barometric data
 		float baro;
 		BaroAltitudeAltitudeGet(&baro);
-		cfvert_reset(&cfvert, baro, attitudeSettings.VertPositionTau);
+		vert_est_reset(&vert_est, baro, attitudeSettings.VertPositionTau);
 
 	} else if (complementary_filter_state.initialization == CF_ARMING ||
 	           complementary_filter_state.initialization == CF_INITIALIZING) {
@@ -649,7 +645,7 @@ static int32_t updateAttitudeComplementary(float dT, bool first_run, bool second
 		// Reset the filter for barometric data
 		float baro;
 		BaroAltitudeAltitudeGet(&baro);
-		cfvert_reset(&cfvert, baro, attitudeSettings.VertPositionTau);
+		vert_est_reset(&vert_est, baro, attitudeSettings.VertPositionTau);
 	}
 
 	GyrosGet(&gyrosData);
@@ -803,16 +799,16 @@ static int32_t updateAttitudeComplementary(float dT, bool first_run, bool second
 			float baro;
 			BaroAltitudeAltitudeGet(&baro);
 
-			cfvert_predict_pos(&cfvert, z_accel, dT);
-			cfvert_update_baro(&cfvert, baro, dT);
+			vert_est_predict(&vert_est, z_accel, dT);
+			vert_est_update_baro(&vert_est, baro);
 
 			got_baro_pt = true;
 		} else if (!got_baro_pt) {
 			/* If we've never heard from the baro hold alt at 0 */
-			cfvert.position_z = 0;
-			cfvert.velocity_z = 0;
+			vert_est.position_z = 0;
+			vert_est.velocity_z = 0;
 		} else {
-			cfvert_predict_pos(&cfvert, z_accel, dT);
+			vert_est_predict(&vert_est, z_accel, dT);
 		}
 	}
 
@@ -850,48 +846,6 @@ static float calc_ned_accel(float *q, float *accels)
 	return accel_ned[2];
 }
 
-//! Resets the vertical baro complementary filter and zeros the altitude
-static void cfvert_reset(struct cfvert *cf, float baro, float time_constant)
-{
-	cf->velocity_z = 0;
-	cf->position_z = 0;
-	cf->time_constant_z = time_constant;
-	cf->accel_correction_z = 0;
-	cf->position_base_z = 0;
-	cf->position_error_z = 0;
-	cf->position_correction_z = 0;
-	cf->baro_zero = baro;
-}
-
-//! Predict the position in the future
-static void cfvert_predict_pos(struct cfvert *cf, float z_accel, float dt)
-{
-	float k1_z = 3 / cf->time_constant_z;
-	float k2_z = 3 / powf(cf->time_constant_z, 2);
-	float k3_z = 1 / powf(cf->time_constant_z, 3);
-
-	cf->accel_correction_z += cf->position_error_z * k3_z * dt;
-	cf->velocity_z += cf->position_error_z * k2_z * dt;
-	cf->position_correction_z += cf->position_error_z * k1_z * dt;
-
-	float velocity_increase;
-	velocity_increase = (z_accel + cf->accel_correction_z) * dt;
-	cf->position_base_z += (cf->velocity_z + velocity_increase * 0.5f) * dt;
-	cf->position_z = cf->position_base_z + cf->position_correction_z;
-	cf->velocity_z += velocity_increase;
-}
-
-//! Update the baro feedback
-static void cfvert_update_baro(struct cfvert *cf, float baro, float dt)
-{
-	float down = -(baro - cf->baro_zero);
-
-	// TODO: get from a queue of previous position updates (150 ms latency)
-	float hist_position_base_d = cf->position_base_z;
-
-	cf->position_error_z = down - (hist_position_base_d + cf->position_correction_z);
-}
-
 //! Set the navigation information to the raw estimates
 static int32_t setNavigationRaw()
 {
@@ -924,10 +878,10 @@ static int32_t setNavigationRaw()
 		PositionActualData positionActual;
 		positionActual.North = NED[0];
 		positionActual.East = NED[1];
-		positionActual.Down = cfvert.position_z;
+		positionActual.Down = vert_est.position_z;
 		PositionActualSet(&positionActual);
 	} else {
-		PositionActualDownSet(&cfvert.position_z);
+		PositionActualDownSet(&vert_est.position_z);
 	}
 
 	if (PIOS_Queue_Receive(gpsVelQueue, &ev, 0) == true) {
@@ -938,10 +892,10 @@ static int32_t setNavigationRaw()
 		VelocityActualData velocityActual;
 		velocityActual.North = gpsVelocity.North;
 		velocityActual.East = gpsVelocity.East;
-		velocityActual.Down = cfvert.velocity_z;
+		velocityActual.Down = vert_est.velocity_z;
 		VelocityActualSet(&velocityActual);
 	} else {
-		VelocityActualDownSet(&cfvert.velocity_z);
+		VelocityActualDownSet(&vert_est.velocity_z);
 	}
 
 	return 0;
@@ -950,8 +904,8 @@ static int32_t setNavigationRaw()
 //! Set the navigation information to the raw estimates
 static int32_t setNavigationNone()
 {
-	PositionActualDownSet(&cfvert.position_z);
-	VelocityActualDownSet(&cfvert.velocity_z);
+	PositionActualDownSet(&vert_est.position_z);
+	VelocityActualDownSet(&vert_est.velocity_z);
 
 	return 0;
 }
@@ -1062,6 +1016,22 @@ static int32_t updateAttitudeINSGPS(bool first_run, bool outdoor_mode)
 
 	static enum {INS_INIT, INS_WARMUP, INS_RUNNING} ins_state;
 
+	static bool snapshot_registered;
+
+	if (!snapshot_registered) {
+		PIOS_SNAPSHOT_VAR("ins", baroData);
+		PIOS_SNAPSHOT_VAR("ins", gpsData);
+		PIOS_SNAPSHOT_VAR("ins", mag_updated);
+		PIOS_SNAPSHOT_VAR("ins", baro_updated);
+		PIOS_SNAPSHOT_VAR("ins", gps_updated);
+		PIOS_SNAPSHOT_VAR("ins", gps_vel_updated);
+		PIOS_SNAPSHOT_VAR("ins", baro_offset);
+		PIOS_SNAPSHOT_VAR("ins", ins_last_time);
+		PIOS_SNAPSHOT_VAR("ins", ins_init_time);
+		PIOS_SNAPSHOT_VAR("ins", ins_state);
+		snapshot_registered = true;
+	}
+
 	float NED[3] = {0.0f, 0.0f, 0.0f};
 	float vel[3] = {0.0f, 0.0f, 0.0f};
 
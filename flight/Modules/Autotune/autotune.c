@@ -46,11 +46,13 @@
 #include "stabilizationdesired.h"
 #include "stabilizationsettings.h"
 #include "systemident.h"
+#include "systemidentstate.h"
 #include <pios_board_info.h>
 #include "pios_thread.h"
 #include "systemsettings.h"
 
 #include "misc_math.h"
+#include "rls_ident.h"
 
 // Private constants
 #define STACK_SIZE_BYTES 640
@@ -60,6 +62,18 @@
 #define AUTOTUNE_AVERAGING_DECIMATION 1
 #endif
 
+/* Faster control loops are averaged down to this before identification,
+ * so the queue and the task's work don't grow with the loop rate */
+#define IDENT_MAX_RATE_HZ 1000
+
+/* Samples wait here for the task to identify from; at most 10 arrive per
+ * IDENT_PERIOD_MS, so 64 rides out the task being held off a while */
+#define IDENT_QUEUE_LEN 64
+#define IDENT_PERIOD_MS 10
+
+/* How long the identifiers remember */
+#define IDENT_MEMORY_S 3.0f
+
 // Private types
 enum autotune_state { AT_INIT, AT_RUN };
 
@@ -81,6 +95,16 @@ struct at_measurement {
 
 static struct at_measurement *at_averages;
 
+static struct at_measurement *ident_queue;
+static volatile uint16_t ident_head;
+static volatile uint16_t ident_tail;
+static volatile bool ident_overrun;
+static struct rls_ident *ident;
+
+static uint8_t ident_decimation = 1;
+static uint8_t ident_decim_count;
+static struct at_measurement ident_accum;
+
 // Private variables
 static struct pios_thread *taskHandle;
 static bool module_enabled;
@@ -119,7 +143,8 @@ int32_t AutotuneInitialize(void)
 #endif
 
 	if (module_enabled) {
-		if (SystemIdentInitialize() == -1) {
+		if (SystemIdentInitialize() == -1 ||
+				SystemIdentStateInitialize() == -1) {
 			module_enabled = false;
 			return -1;
 		}
@@ -197,6 +222,108 @@ static void at_new_actuators(UAVObjEvent * ev, void *ctx, void *obj, int len) {
 
 	update_counter++;
 	throttle_accumulator += 10000 * actuators.Thrust;
+
+	ident_accum.y[0] += g.x;
+	ident_accum.y[1] += g.y;
+	ident_accum.y[2] += g.z;
+
+	ident_accum.u[0] += actuators.Roll;
+	ident_accum.u[1] += actuators.Pitch;
+	ident_accum.u[2] += actuators.Yaw;
+
+	if (++ident_decim_count < ident_decimation) {
+		return;
+	}
+
+	float scale = 1.0f / ident_decim_count;
+
+	struct at_measurement m = {
+		.y = { ident_accum.y[0] * scale, ident_accum.y[1] * scale,
+			ident_accum.y[2] * scale },
+		.u = { ident_accum.u[0] * scale, ident_accum.u[1] * scale,
+			ident_accum.u[2] * scale },
+	};
+
+	ident_accum = (struct at_measurement) { { 0 } };
+	ident_decim_count = 0;
+
+	uint16_t next = (ident_head + 1) % IDENT_QUEUE_LEN;
+
+	if (next == ident_tail) {
+		ident_overrun = true;
+		return;
+	}
+
+	ident_queue[ident_head] = m;
+
+	ident_head = next;
+}
+
+static void ident_restart(float dT)
+{
+	ident_tail = ident_head;
+	ident_overrun = false;
+
+	for (int axis = 0; axis < 3; axis++) {
+		rls_ident_init(&ident[axis], dT, IDENT_MEMORY_S);
+	}
+}
+
+/**
+ * Feeds the samples that have arrived to the identifiers.
+ */
+static void ident_run(void)
+{
+	if (ident_overrun) {
+		/* The gap would look like a huge acceleration.  Drop what is
+		 * queued and start the history over after it, but keep what
+		 * the fits have learned. */
+		ident_tail = ident_head;
+		ident_overrun = false;
+
+		for (int axis = 0; axis < 3; axis++) {
+			rls_ident_skip_gap(&ident[axis]);
+		}
+
+		return;
+	}
+
+	while (ident_tail != ident_head) {
+		const struct at_measurement *m = &ident_queue[ident_tail];
+
+		for (int axis = 0; axis < 3; axis++) {
+			rls_ident_update(&ident[axis], m->y[axis], m->u[axis]);
+		}
+
+		ident_tail = (ident_tail + 1) % IDENT_QUEUE_LEN;
+	}
+}
+
+static void ident_publish(void)
+{
+	SystemIdentStateData state;
+
+	SystemIdentStateGet(&state);
+
+	for (int axis = 0; axis < 3; axis++) {
+		struct rls_ident_estimate est;
+
+		if (!rls_ident_get_estimate(&ident[axis], &est)) {
+			state.Valid[axis] = SYSTEMIDENTSTATE_VALID_FALSE;
+			continue;
+		}
+
+		state.Beta[axis] = logf(est.gain);
+		state.Tau[axis] = est.tau;
+		state.Delay[axis] = est.delay;
+		state.Bias[axis] = est.bias;
+		state.Noise[axis] = est.noise;
+		state.Valid[axis] = SYSTEMIDENTSTATE_VALID_TRUE;
+	}
+
+	state.Samples = ident[0].samples;
+
+	SystemIdentStateSet(&state);
 }
 
 static void UpdateSystemIdent(uint32_t predicts, float hover_throttle,
@@ -275,13 +402,28 @@ static void AutotuneTask(void *parameters)
 
 	uint16_t buf_size = sizeof(*at_averages) * decim_wiggle_points;
 	at_averages = PIOS_malloc(buf_size);
+	ident_queue = PIOS_malloc(sizeof(*ident_queue) * IDENT_QUEUE_LEN);
+	ident = PIOS_malloc(sizeof(*ident) * 3);
 
-	while (!at_averages) {
+	while (!at_averages || !ident_queue || !ident) {
 		/* Infinite loop because we couldn't get our buffer */
 		/* Assert alarm XXX? */
 		PIOS_Thread_Sleep(2500);
 	}
 
+	uint32_t samp_rate = PIOS_SENSORS_GetSampleRate(PIOS_SENSOR_GYRO);
+
+	if (!samp_rate) {
+		samp_rate = 1000;
+	}
+
+	/* Each identified sample averages this many control loop updates */
+	ident_decimation = (samp_rate + IDENT_MAX_RATE_HZ - 1) / IDENT_MAX_RATE_HZ;
+
+	float ident_dT = (float) ident_decimation / samp_rate;
+
+	ident_restart(ident_dT);
+
 	ActuatorDesiredConnectCallback(at_new_actuators);
 
 	bool save_needed = false;
@@ -322,6 +464,8 @@ static void AutotuneTask(void *parameters)
 					// tune completes.
 					save_needed = false;
 					state = AT_RUN;
+
+					ident_restart(ident_dT);
 				}
 
 				break;
@@ -334,6 +478,8 @@ static void AutotuneTask(void *parameters)
 				UpdateSystemIdent(update_counter, hover_throttle,
 						false);
 
+				ident_publish();
+
 				if (!tune_running) {
 					/* Threshold: 24 seconds of data @ 500Hz */
 					if (update_counter > 12000) {
@@ -346,7 +492,11 @@ static void AutotuneTask(void *parameters)
 				break;
 		}
 
-		PIOS_Thread_Sleep(YIELD_MS);
+		for (uint32_t i = 0; i < YIELD_MS / IDENT_PERIOD_MS; i++) {
+			ident_run();
+
+			PIOS_Thread_Sleep(IDENT_PERIOD_MS);
+		}
 	}
 }
 
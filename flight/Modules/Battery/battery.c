@@ -40,6 +40,11 @@
 #include "modulesettings.h"
 #include "pios_thread.h"
 
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+#include "eventexecutor.h"
+#include "eventexecutorstatus.h"
+#endif
+
 // ****************
 // Private constants
 #define STACK_SIZE_BYTES            624
@@ -49,25 +54,55 @@
 
 // Private variables
 static bool module_enabled = false;
+#if !defined(PIOS_INCLUDE_EVENTEXECUTOR)
 static struct pios_thread *batteryTaskHandle;
+#endif
 static int8_t voltageADCPin = -1; //ADC pin for voltage
 static int8_t currentADCPin = -1; //ADC pin for current
 static bool battery_settings_updated;
 
 static float avg_current_lpf_for_time;
 
+static bool cells_calculated;
+static unsigned cells = 1;
+
+static FlightBatteryStateData flightBatteryData;
+static FlightBatterySettingsData batterySettings;
+
+// What used to be task locals, for the executor's RAM accounting
+#define BATTERY_STATE_BYTES (sizeof(cells_calculated) + sizeof(cells) + \
+		sizeof(flightBatteryData) + sizeof(batterySettings))
+
 // ****************
 // Private functions
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+static void batteryJob(const UAVObjEvent *ev, void *ctx);
+#else
 static void batteryTask(void * parameters);
+#endif
+static void batteryStep(void);
 
 static int32_t BatteryStart(void)
 {
 	if (module_enabled) {
 		FlightBatterySettingsConnectCallbackCtx(UAVObjCbSetFlag, &battery_settings_updated);
 
+		battery_settings_updated = true;
+		FlightBatteryStateGet(&flightBatteryData);
+
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+		// Run from the event dispatcher rather than a task of our own
+		if (EventExecutorRegister(EVENTEXECUTORSTATUS_RUNS_BATTERY,
+				batteryJob, NULL, STACK_SIZE_BYTES, BATTERY_STATE_BYTES) ||
+				EventExecutorSetPeriod(EVENTEXECUTORSTATUS_RUNS_BATTERY,
+					SAMPLE_PERIOD_MS)) {
+			return -1;
+		}
+#else
 		// Start tasks
 		batteryTaskHandle = PIOS_Thread_Create(batteryTask, "batteryBridge", STACK_SIZE_BYTES, NULL, TASK_PRIORITY);
 		TaskMonitorAdd(TASKINFO_RUNNING_BATTERY, batteryTaskHandle);
+#endif
 		return 0;
 	}
 	return -1;
@@ -103,169 +138,180 @@ int32_t BatteryInitialize(void)
 }
 MODULE_INITCALL(BatteryInitialize, BatteryStart)
 
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+/**
+ * Executor job, run every SAMPLE_PERIOD_MS.
+ */
+static void batteryJob(const UAVObjEvent *ev, void *ctx)
+{
+	(void) ev; (void) ctx;
+
+	batteryStep();
+}
+#else
 /**
  * Main task. It does not return.
  */
 static void batteryTask(void * parameters)
 {
-	const float dT = SAMPLE_PERIOD_MS / 1000.0f;
-
-	battery_settings_updated = true;
-	bool cells_calculated = false;
-	unsigned cells = 1;
-
-	FlightBatteryStateData flightBatteryData;
-	FlightBatterySettingsData batterySettings;
-
-	FlightBatteryStateGet(&flightBatteryData);
-
 	// Main task loop
 	uint32_t lastSysTime;
 	lastSysTime = PIOS_Thread_Systime();
 	while (true) {
 		PIOS_Thread_Sleep_Until(&lastSysTime, SAMPLE_PERIOD_MS);
-		float energyRemaining;
+		batteryStep();
+	}
+}
+#endif
 
-		if (battery_settings_updated) {
-			battery_settings_updated = false;
-			FlightBatterySettingsGet(&batterySettings);
+/**
+ * Takes one sample and updates the battery state and alarms.
+ */
+static void batteryStep(void)
+{
+	const float dT = SAMPLE_PERIOD_MS / 1000.0f;
 
-			voltageADCPin = batterySettings.VoltagePin;
-			if (voltageADCPin == FLIGHTBATTERYSETTINGS_VOLTAGEPIN_NONE)
-				voltageADCPin = -1;
+	float energyRemaining;
 
-			currentADCPin = batterySettings.CurrentPin;
-			if (currentADCPin == FLIGHTBATTERYSETTINGS_CURRENTPIN_NONE)
-				currentADCPin = -1;
+	if (battery_settings_updated) {
+		battery_settings_updated = false;
+		FlightBatterySettingsGet(&batterySettings);
 
-			cells_calculated = false;
-		}
+		voltageADCPin = batterySettings.VoltagePin;
+		if (voltageADCPin == FLIGHTBATTERYSETTINGS_VOLTAGEPIN_NONE)
+			voltageADCPin = -1;
 
-		bool adc_pin_invalid = false;
-		bool adc_offset_invalid = false;
-
-		// handle voltage
-		if (voltageADCPin >= 0) {
-			float adc_voltage = (float)PIOS_ADC_GetChannelVolt(voltageADCPin);
-			float scaled_voltage = 0.0f;
-
-			// A negative result indicates an error (PIOS_ADC_GetChannelVolt returns negative on error)
-			if(adc_voltage < 0.0f)
-				adc_pin_invalid = true;
-			else {
-				// scale to actual voltage
-				scaled_voltage = (adc_voltage * 1000.0f
-						/ batterySettings.SensorCalibrationFactor[FLIGHTBATTERYSETTINGS_SENSORCALIBRATIONFACTOR_VOLTAGE])
-						+ batterySettings.SensorCalibrationOffset[FLIGHTBATTERYSETTINGS_SENSORCALIBRATIONOFFSET_VOLTAGE]; //in Volts
-
-				// disallow negative values as these are cast to unsigned integral types
-				// in some telemetry layers
-				if (scaled_voltage < 0.0f) {
-					scaled_voltage = 0.0f;
-					adc_offset_invalid = true;
-				} else if (batterySettings.MaxCellVoltage > 0.0f && scaled_voltage > 2.5f) {
-					if (!cells_calculated) {
-						cells = ((scaled_voltage / batterySettings.MaxCellVoltage) + 0.9f);
-						if (cells > 0) {
-							cells_calculated = true;
-							flightBatteryData.DetectedCellCount = cells;
-						}
-					}
-				} else {
-					cells_calculated = false;
-				}
+		currentADCPin = batterySettings.CurrentPin;
+		if (currentADCPin == FLIGHTBATTERYSETTINGS_CURRENTPIN_NONE)
+			currentADCPin = -1;
+
+		cells_calculated = false;
+	}
 
+	bool adc_pin_invalid = false;
+	bool adc_offset_invalid = false;
+
+	// handle voltage
+	if (voltageADCPin >= 0) {
+		float adc_voltage = (float)PIOS_ADC_GetChannelVolt(voltageADCPin);
+		float scaled_voltage = 0.0f;
+
+		// A negative result indicates an error (PIOS_ADC_GetChannelVolt returns negative on error)
+		if(adc_voltage < 0.0f)
+			adc_pin_invalid = true;
+		else {
+			// scale to actual voltage
+			scaled_voltage = (adc_voltage * 1000.0f
+					/ batterySettings.SensorCalibrationFactor[FLIGHTBATTERYSETTINGS_SENSORCALIBRATIONFACTOR_VOLTAGE])
+					+ batterySettings.SensorCalibrationOffset[FLIGHTBATTERYSETTINGS_SENSORCALIBRATIONOFFSET_VOLTAGE]; //in Volts
+
+			// disallow negative values as these are cast to unsigned integral types
+			// in some telemetry layers
+			if (scaled_voltage < 0.0f) {
+				scaled_voltage = 0.0f;
+				adc_offset_invalid = true;
+			} else if (batterySettings.MaxCellVoltage > 0.0f && scaled_voltage > 2.5f) {
 				if (!cells_calculated) {
-					cells = batterySettings.NbCells;
-					flightBatteryData.DetectedCellCount = 0;
+					cells = ((scaled_voltage / batterySettings.MaxCellVoltage) + 0.9f);
+					if (cells > 0) {
+						cells_calculated = true;
+						flightBatteryData.DetectedCellCount = cells;
+					}
 				}
+			} else {
+				cells_calculated = false;
 			}
 
-			flightBatteryData.Voltage = scaled_voltage;
-
-			// generate alarms and warnings
-			if (flightBatteryData.Voltage < (batterySettings.CellVoltageThresholds[FLIGHTBATTERYSETTINGS_CELLVOLTAGETHRESHOLDS_ALARM] * cells))
-				AlarmsSet(SYSTEMALARMS_ALARM_BATTERY, SYSTEMALARMS_ALARM_CRITICAL);
-			else if (flightBatteryData.Voltage < (batterySettings.CellVoltageThresholds[FLIGHTBATTERYSETTINGS_CELLVOLTAGETHRESHOLDS_WARNING] * cells))
-				AlarmsSet(SYSTEMALARMS_ALARM_BATTERY, SYSTEMALARMS_ALARM_WARNING);
-			else
-				AlarmsClear(SYSTEMALARMS_ALARM_BATTERY);
-		} else {
-			flightBatteryData.Voltage = 0;
+			if (!cells_calculated) {
+				cells = batterySettings.NbCells;
+				flightBatteryData.DetectedCellCount = 0;
+			}
 		}
 
-		// handle current
-		if (currentADCPin >= 0) {
-			float adc_voltage = (float)PIOS_ADC_GetChannelVolt(currentADCPin);
-			float scaled_current = 0.0f;
-
-			// A negative result indicates an error (PIOS_ADC_GetChannelVolt returns -1 on error)
-			if(adc_voltage < 0.0f)
-				adc_pin_invalid = true;
-			else {
-				// scale to actual current
-				scaled_current = (adc_voltage * 1000.0f
-						/ batterySettings.SensorCalibrationFactor[FLIGHTBATTERYSETTINGS_SENSORCALIBRATIONFACTOR_CURRENT])
-						+ batterySettings.SensorCalibrationOffset[FLIGHTBATTERYSETTINGS_SENSORCALIBRATIONOFFSET_CURRENT]; //in Amps
-
-				// disallow negative values as these are cast to unsigned integral types
-				// in some telemetry layers
-				if(scaled_current < 0.0f) {
-					scaled_current = 0.0f;
-					adc_offset_invalid = true;
-				}
-			}
+		flightBatteryData.Voltage = scaled_voltage;
 
-			flightBatteryData.Current = scaled_current;
+		// generate alarms and warnings
+		if (flightBatteryData.Voltage < (batterySettings.CellVoltageThresholds[FLIGHTBATTERYSETTINGS_CELLVOLTAGETHRESHOLDS_ALARM] * cells))
+			AlarmsSet(SYSTEMALARMS_ALARM_BATTERY, SYSTEMALARMS_ALARM_CRITICAL);
+		else if (flightBatteryData.Voltage < (batterySettings.CellVoltageThresholds[FLIGHTBATTERYSETTINGS_CELLVOLTAGETHRESHOLDS_WARNING] * cells))
+			AlarmsSet(SYSTEMALARMS_ALARM_BATTERY, SYSTEMALARMS_ALARM_WARNING);
+		else
+			AlarmsClear(SYSTEMALARMS_ALARM_BATTERY);
+	} else {
+		flightBatteryData.Voltage = 0;
+	}
 
-			if (flightBatteryData.Current > flightBatteryData.PeakCurrent)
-				flightBatteryData.PeakCurrent = flightBatteryData.Current; //in Amps
+	// handle current
+	if (currentADCPin >= 0) {
+		float adc_voltage = (float)PIOS_ADC_GetChannelVolt(currentADCPin);
+		float scaled_current = 0.0f;
+
+		// A negative result indicates an error (PIOS_ADC_GetChannelVolt returns -1 on error)
+		if(adc_voltage < 0.0f)
+			adc_pin_invalid = true;
+		else {
+			// scale to actual current
+			scaled_current = (adc_voltage * 1000.0f
+					/ batterySettings.SensorCalibrationFactor[FLIGHTBATTERYSETTINGS_SENSORCALIBRATIONFACTOR_CURRENT])
+					+ batterySettings.SensorCalibrationOffset[FLIGHTBATTERYSETTINGS_SENSORCALIBRATIONOFFSET_CURRENT]; //in Amps
+
+			// disallow negative values as these are cast to unsigned integral types
+			// in some telemetry layers
+			if(scaled_current < 0.0f) {
+				scaled_current = 0.0f;
+				adc_offset_invalid = true;
+			}
+		}
 
-			flightBatteryData.ConsumedEnergy += (flightBatteryData.Current * dT * 1000.0f / 3600.0f); //in mAh
+		flightBatteryData.Current = scaled_current;
 
-			//Apply a 2 second rise time low-pass filter to average the current
-			float alpha = 1.0f - dT / (dT + 2.0f);
-			flightBatteryData.AvgCurrent = alpha * flightBatteryData.AvgCurrent + (1 - alpha) * flightBatteryData.Current; //in Amps
+		if (flightBatteryData.Current > flightBatteryData.PeakCurrent)
+			flightBatteryData.PeakCurrent = flightBatteryData.Current; //in Amps
 
-			// XXX Arguably this should be to 10% capacity or 15%
-			energyRemaining = batterySettings.Capacity - flightBatteryData.ConsumedEnergy; // in mAh
+		flightBatteryData.ConsumedEnergy += (flightBatteryData.Current * dT * 1000.0f / 3600.0f); //in mAh
 
-			// And for time estimation, smooth things much more.
-			// Second order since it incorporates the above
-			// smoothing, 12s time constant for this layer.
-			alpha = 1.0f - dT / (dT + 12.0f);
+		//Apply a 2 second rise time low-pass filter to average the current
+		float alpha = 1.0f - dT / (dT + 2.0f);
+		flightBatteryData.AvgCurrent = alpha * flightBatteryData.AvgCurrent + (1 - alpha) * flightBatteryData.Current; //in Amps
 
-			avg_current_lpf_for_time = avg_current_lpf_for_time * alpha + (1 - alpha) * flightBatteryData.AvgCurrent;
+		// XXX Arguably this should be to 10% capacity or 15%
+		energyRemaining = batterySettings.Capacity - flightBatteryData.ConsumedEnergy; // in mAh
 
-			if (avg_current_lpf_for_time > 0.1f)
-				flightBatteryData.EstimatedFlightTime = (energyRemaining / (avg_current_lpf_for_time * 1000.0f)) * 3600.0f; //in Sec
-			else
-				flightBatteryData.EstimatedFlightTime = 9999;
+		// And for time estimation, smooth things much more.
+		// Second order since it incorporates the above
+		// smoothing, 12s time constant for this layer.
+		alpha = 1.0f - dT / (dT + 12.0f);
 
-			// generate alarms and warnings
-			if ((batterySettings.FlightTimeThresholds[FLIGHTBATTERYSETTINGS_FLIGHTTIMETHRESHOLDS_ALARM] > 0)
-				&& (flightBatteryData.EstimatedFlightTime < batterySettings.FlightTimeThresholds[FLIGHTBATTERYSETTINGS_FLIGHTTIMETHRESHOLDS_ALARM]))
-				AlarmsSet(SYSTEMALARMS_ALARM_FLIGHTTIME, SYSTEMALARMS_ALARM_CRITICAL);
-			else if ((batterySettings.FlightTimeThresholds[FLIGHTBATTERYSETTINGS_FLIGHTTIMETHRESHOLDS_WARNING] > 0)
-					 && (flightBatteryData.EstimatedFlightTime < batterySettings.FlightTimeThresholds[FLIGHTBATTERYSETTINGS_FLIGHTTIMETHRESHOLDS_WARNING]))
-				AlarmsSet(SYSTEMALARMS_ALARM_FLIGHTTIME, SYSTEMALARMS_ALARM_WARNING);
-			else
-				AlarmsClear(SYSTEMALARMS_ALARM_FLIGHTTIME);
-		} else {
-			flightBatteryData.Current = 0;
-		}
+		avg_current_lpf_for_time = avg_current_lpf_for_time * alpha + (1 - alpha) * flightBatteryData.AvgCurrent;
 
-		if(adc_pin_invalid)
-			AlarmsSet(SYSTEMALARMS_ALARM_ADC, SYSTEMALARMS_ALARM_CRITICAL);
-		else if(adc_offset_invalid)
-			AlarmsSet(SYSTEMALARMS_ALARM_ADC, SYSTEMALARMS_ALARM_WARNING);
-		else if(voltageADCPin >= 0 || currentADCPin >= 0)
-			AlarmsSet(SYSTEMALARMS_ALARM_ADC, SYSTEMALARMS_ALARM_OK);
+		if (avg_current_lpf_for_time > 0.1f)
+			flightBatteryData.EstimatedFlightTime = (energyRemaining / (avg_current_lpf_for_time * 1000.0f)) * 3600.0f; //in Sec
 		else
-			AlarmsSet(SYSTEMALARMS_ALARM_ADC, SYSTEMALARMS_ALARM_UNINITIALISED);
-
-		FlightBatteryStateSet(&flightBatteryData);
+			flightBatteryData.EstimatedFlightTime = 9999;
+
+		// generate alarms and warnings
+		if ((batterySettings.FlightTimeThresholds[FLIGHTBATTERYSETTINGS_FLIGHTTIMETHRESHOLDS_ALARM] > 0)
+			&& (flightBatteryData.EstimatedFlightTime < batterySettings.FlightTimeThresholds[FLIGHTBATTERYSETTINGS_FLIGHTTIMETHRESHOLDS_ALARM]))
+			AlarmsSet(SYSTEMALARMS_ALARM_FLIGHTTIME, SYSTEMALARMS_ALARM_CRITICAL);
+		else if ((batterySettings.FlightTimeThresholds[FLIGHTBATTERYSETTINGS_FLIGHTTIMETHRESHOLDS_WARNING] > 0)
+				 && (flightBatteryData.EstimatedFlightTime < batterySettings.FlightTimeThresholds[FLIGHTBATTERYSETTINGS_FLIGHTTIMETHRESHOLDS_WARNING]))
+			AlarmsSet(SYSTEMALARMS_ALARM_FLIGHTTIME, SYSTEMALARMS_ALARM_WARNING);
+		else
+			AlarmsClear(SYSTEMALARMS_ALARM_FLIGHTTIME);
+	} else {
+		flightBatteryData.Current = 0;
 	}
+
+	if(adc_pin_invalid)
+		AlarmsSet(SYSTEMALARMS_ALARM_ADC, SYSTEMALARMS_ALARM_CRITICAL);
+	else if(adc_offset_invalid)
+		AlarmsSet(SYSTEMALARMS_ALARM_ADC, SYSTEMALARMS_ALARM_WARNING);
+	else if(voltageADCPin >= 0 || currentADCPin >= 0)
+		AlarmsSet(SYSTEMALARMS_ALARM_ADC, SYSTEMALARMS_ALARM_OK);
+	else
+		AlarmsSet(SYSTEMALARMS_ALARM_ADC, SYSTEMALARMS_ALARM_UNINITIALISED);
+
+	FlightBatteryStateSet(&flightBatteryData);
 }
 
 /**
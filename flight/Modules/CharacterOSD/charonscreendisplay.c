@@ -275,7 +275,7 @@ static void CharOnScreenDisplayTask(void *parameters)
 
 	charosd_state_t state;
 
-	state = PIOS_malloc(sizeof(*state));
+	state = PIOS_malloc_tagged(sizeof(*state), PIOS_HEAP_TAG_OSD);
 	state->dev = pios_max7456_id;
 	state->prev_font = 0xff;
 
@@ -57,6 +57,7 @@
 #include "modulesettings.h"
 #include "attitudeactual.h"
 #include "pathdesired.h"	// object that will be updated by the module
+#include "pathlookahead.h"
 #include "positionactual.h"
 #include "flightstatus.h"
 #include "pathstatus.h"
@@ -86,6 +87,7 @@
 static bool module_enabled = false;
 static struct pios_thread *pathfollowerTaskHandle;
 static PathDesiredData pathDesired;
+static PathLookaheadData pathLookahead;
 static PathStatusData pathStatus;
 static FixedWingPathFollowerSettingsData fixedwingpathfollowerSettings;
 static FixedWingAirspeedsData fixedWingAirspeeds;
@@ -145,6 +147,7 @@ int32_t FixedWingPathFollowerInitialize()
 		|| FixedWingAirspeedsInitialize() == -1 \
 		|| FixedWingPathFollowerStatusInitialize() == -1 \
 		|| PathDesiredInitialize() == -1 \
+		|| PathLookaheadInitialize() == -1 \
 		|| PathStatusInitialize() == -1 \
 		|| VelocityDesiredInitialize() == -1 \
 		|| AirspeedActualInitialize() == -1 ){
@@ -283,6 +286,7 @@ static void pathfollowerTask(void *parameters)
 				state = FW_FOLLOWER_RUNNING;
 
 				PathDesiredGet(&pathDesired);
+				PathLookaheadGet(&pathLookahead);
 				switch(pathDesired.Mode) {
 					case PATHDESIRED_MODE_ENDPOINT:
 					case PATHDESIRED_MODE_VECTOR:
@@ -352,7 +356,8 @@ static void updatePathVelocity()
 	float cur[3] = {positionActual.North, positionActual.East, positionActual.Down};
 	struct path_status progress;
 
-	path_progress(&pathDesired, cur, &progress);
+	// Only used when it matches the path, so stale after RTH is harmless
+	path_progress_lookahead(&pathDesired, &pathLookahead, cur, &progress);
 	
 	float groundspeed = 0;
 	float altitudeSetpoint = 0;
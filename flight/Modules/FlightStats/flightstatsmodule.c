@@ -42,22 +42,37 @@
 #include "positionactual.h"
 #include "velocityactual.h"
 
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+#include "eventexecutor.h"
+#include "eventexecutorstatus.h"
+#endif
+
 // Private constants
 #define STACK_SIZE_BYTES 600
 #define TASK_PRIORITY PIOS_THREAD_PRIO_LOW
+#define UPDATE_PERIOD_MS 100
 
 // Private types
 
 // Private variables
 static bool module_enabled;
+#if !defined(PIOS_INCLUDE_EVENTEXECUTOR)
 static struct pios_thread *flightStatsTaskHandle;
+#endif
 static volatile FlightStatsSettingsData settings;
 static PositionActualData lastPositionActual;
 static float initial_consumed_energy;
 static float previous_consumed_energy;
+static FlightStatsData flightStatsData;
+static bool first_run = true;
 
 // Private functions
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+static void flightStatsJob(const UAVObjEvent *ev, void *ctx);
+#else
 static void flightStatsTask(void *parameters);
+#endif
+static void flightStatsStep(void);
 static bool isArmed();
 static void resetStats(FlightStatsData *stats);
 static void collectStats(FlightStatsData *stats);
@@ -111,81 +126,109 @@ int32_t FlightStatModuleStart(void)
 		return -1;
 	}
 
+	resetStats(&flightStatsData);
+	flightStatsData.State = FLIGHTSTATS_STATE_IDLE;
+
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+	// Run from the event dispatcher rather than a task of our own
+	if (EventExecutorRegister(EVENTEXECUTORSTATUS_RUNS_FLIGHTSTATS,
+			flightStatsJob, NULL, STACK_SIZE_BYTES,
+			sizeof(flightStatsData) + sizeof(first_run)) ||
+			EventExecutorSetPeriod(EVENTEXECUTORSTATUS_RUNS_FLIGHTSTATS,
+				UPDATE_PERIOD_MS)) {
+		return -1;
+	}
+#else
 	// Start flight stats task
 	flightStatsTaskHandle = PIOS_Thread_Create(flightStatsTask, "FlightStats", STACK_SIZE_BYTES, NULL, TASK_PRIORITY);
 
 	TaskMonitorAdd(TASKINFO_RUNNING_FLIGHTSTATS, flightStatsTaskHandle);
+#endif
 	
 	return 0;
 }
 
 MODULE_INITCALL(FlightStatsModuleInitialize, FlightStatModuleStart);
 
-static void flightStatsTask(void *parameters)
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+/**
+ * Executor job, run every UPDATE_PERIOD_MS.
+ */
+static void flightStatsJob(const UAVObjEvent *ev, void *ctx)
 {
-	FlightStatsData flightStatsData;
-	bool first_run = true;
-
-	resetStats(&flightStatsData);
-	flightStatsData.State = FLIGHTSTATS_STATE_IDLE;
+	(void) ev; (void) ctx;
 
+	flightStatsStep();
+}
+#else
+static void flightStatsTask(void *parameters)
+{
 	// Loop forever
 	while (1) {
 		// Update stats at about 10Hz
-		PIOS_Thread_Sleep(100);
-		switch (flightStatsData.State) {
-			case FLIGHTSTATS_STATE_IDLE:
-				if (isArmed()) {
-					switch (settings.StatsBehavior) {
-					case FLIGHTSTATSSETTINGS_STATSBEHAVIOR_RESETONBOOT:
-						flightStatsData.State = FLIGHTSTATS_STATE_COLLECTING;
-						break;
-					case FLIGHTSTATSSETTINGS_STATSBEHAVIOR_RESETONARM:
-						flightStatsData.State = FLIGHTSTATS_STATE_RESET;
-						break;
-					}
-					first_run = true;
+		PIOS_Thread_Sleep(UPDATE_PERIOD_MS);
+		flightStatsStep();
+	}
+}
+#endif
+
+/**
+ * Advances the stats state machine and collects a sample when flying.
+ */
+static void flightStatsStep(void)
+{
+	switch (flightStatsData.State) {
+		case FLIGHTSTATS_STATE_IDLE:
+			if (isArmed()) {
+				switch (settings.StatsBehavior) {
+				case FLIGHTSTATSSETTINGS_STATSBEHAVIOR_RESETONBOOT:
+					flightStatsData.State = FLIGHTSTATS_STATE_COLLECTING;
+					break;
+				case FLIGHTSTATSSETTINGS_STATSBEHAVIOR_RESETONARM:
+					flightStatsData.State = FLIGHTSTATS_STATE_RESET;
+					break;
 				}
-				break;
-			case FLIGHTSTATS_STATE_RESET:
-				resetStats(&flightStatsData);
-				flightStatsData.State = FLIGHTSTATS_STATE_COLLECTING;
-				break;
-			case FLIGHTSTATS_STATE_COLLECTING:
-				if (first_run) { // get some initial values
-					// initial position
-					PositionActualGet(&lastPositionActual);
-
-					// get the initial battery voltage and consumed energy
-					if (FlightBatteryStateHandle()) {
-						FlightBatteryStateConsumedEnergyGet(&initial_consumed_energy);
-
-						// either start a new calculation of consumed energy, or combine with data
-						// from previous flight
-						if (settings.StatsBehavior == FLIGHTSTATSSETTINGS_STATSBEHAVIOR_RESETONARM) {
-							previous_consumed_energy = 0.f;
-						}
-						else {
-							previous_consumed_energy = flightStatsData.ConsumedEnergy;
-						}
-
-						// only get the initial voltage if we reset on arm or if it is uninitialized
-						if ((settings.StatsBehavior == FLIGHTSTATSSETTINGS_STATSBEHAVIOR_RESETONARM)\
-							|| (flightStatsData.InitialBatteryVoltage == 0)){
-							float voltage;
-							FlightBatteryStateVoltageGet(&voltage);
-							flightStatsData.InitialBatteryVoltage = roundf(1000.f * voltage);
-						}
+				first_run = true;
+			}
+			break;
+		case FLIGHTSTATS_STATE_RESET:
+			resetStats(&flightStatsData);
+			flightStatsData.State = FLIGHTSTATS_STATE_COLLECTING;
+			break;
+		case FLIGHTSTATS_STATE_COLLECTING:
+			if (first_run) { // get some initial values
+				// initial position
+				PositionActualGet(&lastPositionActual);
+
+				// get the initial battery voltage and consumed energy
+				if (FlightBatteryStateHandle()) {
+					FlightBatteryStateConsumedEnergyGet(&initial_consumed_energy);
+
+					// either start a new calculation of consumed energy, or combine with data
+					// from previous flight
+					if (settings.StatsBehavior == FLIGHTSTATSSETTINGS_STATSBEHAVIOR_RESETONARM) {
+						previous_consumed_energy = 0.f;
+					}
+					else {
+						previous_consumed_energy = flightStatsData.ConsumedEnergy;
+					}
+
+					// only get the initial voltage if we reset on arm or if it is uninitialized
+					if ((settings.StatsBehavior == FLIGHTSTATSSETTINGS_STATSBEHAVIOR_RESETONARM)\
+						|| (flightStatsData.InitialBatteryVoltage == 0)){
+						float voltage;
+						FlightBatteryStateVoltageGet(&voltage);
+						flightStatsData.InitialBatteryVoltage = roundf(1000.f * voltage);
 					}
-					first_run = false;
-				}
-				collectStats(&flightStatsData);
-				if (!isArmed()) {
-					flightStatsData.State = FLIGHTSTATS_STATE_IDLE;
 				}
-				FlightStatsSet(&flightStatsData);
-				break;
-		}
+				first_run = false;
+			}
+			collectStats(&flightStatsData);
+			if (!isArmed()) {
+				flightStatsData.State = FLIGHTSTATS_STATE_IDLE;
+			}
+			FlightStatsSet(&flightStatsData);
+			break;
 	}
 }
 
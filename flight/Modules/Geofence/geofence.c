@@ -33,9 +33,14 @@
 #include <eventdispatcher.h>
 #include "misc_math.h"
 #include "physical_constants.h"
+#include "geofence_index.h"
+#include "pios_thread.h"
 
+#include "geofencepolygon.h"
 #include "geofencesettings.h"
+#include "geofencevertex.h"
 #include "positionactual.h"
+#include "velocityactual.h"
 #include "modulesettings.h"
 
 
@@ -43,6 +48,9 @@
 // Configuration
 //
 #define SAMPLE_PERIOD_MS     250
+//! How long the polygon fence must stay unchanged before it is rebuilt;
+//! uploading one changes many objects in a row
+#define REBUILD_DELAY_MS     1000
 
 // Private types
 
@@ -50,10 +58,17 @@
 
 // Private functions
 static void settingsUpdated(UAVObjEvent* ev, void *ctx, void *obj, int len);
+static void fenceUpdated(UAVObjEvent* ev, void *ctx, void *obj, int len);
 static void checkPosition(UAVObjEvent* ev, void *ctx, void *obj, int len);
+static SystemAlarmsAlarmOptions checkFence(const PositionActualData *positionActual);
+static void rebuildFence(void);
 
 // Private variables
 static GeoFenceSettingsData *geofenceSettings;
+static struct geofence_index *fence;
+static bool fence_dirty;
+static bool fence_failed;
+static uint32_t fence_changed_time;
 
 /**
  * Initialise the module, called on startup
@@ -75,7 +90,9 @@ int32_t GeofenceInitialize(void)
 	}
 #endif
 
-	if (GeoFenceSettingsInitialize() == -1) {
+	if (GeoFenceSettingsInitialize() == -1 ||
+			GeoFencePolygonInitialize() == -1 ||
+			GeoFenceVertexInitialize() == -1) {
 		module_enabled = false;
 		return -1;
 	}
@@ -89,6 +106,8 @@ int32_t GeofenceInitialize(void)
 		}
 
 		GeoFenceSettingsConnectCallback(settingsUpdated);
+		GeoFencePolygonConnectCallback(fenceUpdated);
+		GeoFenceVertexConnectCallback(fenceUpdated);
 		settingsUpdated(NULL, NULL, NULL, 0);
 
 		return 0;
@@ -119,26 +138,179 @@ MODULE_INITCALL(GeofenceInitialize, GeofenceStart);
 
 /**
  * Periodic callback that processes changes in position and
- * sets the alarm.
+ * sets the alarm.  A changed fence is rebuilt here, on the event
+ * dispatcher, and never from the object callbacks that mark it dirty:
+ * those run in whichever task set the object.
  */
 static void checkPosition(UAVObjEvent* ev, void *ctx, void *obj, int len)
 {
 	(void) ev; (void) ctx; (void) obj; (void) len;
-	if (PositionActualHandle()) {
-		PositionActualData positionActual;
-		PositionActualGet(&positionActual);
-
-		const float distance2 = powf(positionActual.North, 2) + powf(positionActual.East, 2);
-
-		// ErrorRadius is squared when it is fetched, so this is correct
-		if (distance2 > geofenceSettings->ErrorRadius) {
-			AlarmsSet(SYSTEMALARMS_ALARM_GEOFENCE, SYSTEMALARMS_ALARM_ERROR);
-		} else if (distance2 > geofenceSettings->WarningRadius) {
-			AlarmsSet(SYSTEMALARMS_ALARM_GEOFENCE, SYSTEMALARMS_ALARM_WARNING);
-		} else {
-			AlarmsClear(SYSTEMALARMS_ALARM_GEOFENCE);
+
+	if (fence_dirty &&
+			PIOS_Thread_Systime() - fence_changed_time > REBUILD_DELAY_MS) {
+		fence_dirty = false;
+		rebuildFence();
+	}
+
+	PositionActualData positionActual;
+	PositionActualGet(&positionActual);
+
+	const float distance2 = powf(positionActual.North, 2) + powf(positionActual.East, 2);
+
+	SystemAlarmsAlarmOptions severity = SYSTEMALARMS_ALARM_OK;
+
+	// ErrorRadius is squared when it is fetched, so this is correct
+	if (distance2 > geofenceSettings->ErrorRadius) {
+		severity = SYSTEMALARMS_ALARM_ERROR;
+	} else if (distance2 > geofenceSettings->WarningRadius) {
+		severity = SYSTEMALARMS_ALARM_WARNING;
+	}
+
+	if (fence) {
+		severity = MAX(severity, checkFence(&positionActual));
+	} else if (fence_failed) {
+		// A fence was asked for but there is none to enforce
+		severity = SYSTEMALARMS_ALARM_CRITICAL;
+	}
+
+	if (severity == SYSTEMALARMS_ALARM_OK) {
+		AlarmsClear(SYSTEMALARMS_ALARM_GEOFENCE);
+	} else {
+		AlarmsSet(SYSTEMALARMS_ALARM_GEOFENCE, severity);
+	}
+}
+
+/**
+ * Check the position against the polygon fence, and also where holding
+ * the current velocity for PredictionTime would take the vehicle.
+ * \returns ERROR when the fence is breached, WARNING when it is close or
+ * about to be, otherwise OK
+ */
+static SystemAlarmsAlarmOptions checkFence(const PositionActualData *positionActual)
+{
+	const float pos[3] = {
+		positionActual->North,
+		positionActual->East,
+		positionActual->Down,
+	};
+	struct geofence_check result;
+
+	geofence_index_check(fence, pos, &result);
+
+	if (!result.allowed) {
+		return SYSTEMALARMS_ALARM_ERROR;
+	}
+
+	if (result.margin < geofenceSettings->WarningMargin) {
+		return SYSTEMALARMS_ALARM_WARNING;
+	}
+
+	if (geofenceSettings->PredictionTime > 0 && VelocityActualHandle()) {
+		VelocityActualData velocityActual;
+		VelocityActualGet(&velocityActual);
+
+		const float t = geofenceSettings->PredictionTime;
+		const float predicted[3] = {
+			pos[0] + velocityActual.North * t,
+			pos[1] + velocityActual.East * t,
+			pos[2] + velocityActual.Down * t,
+		};
+
+		geofence_index_check(fence, predicted, &result);
+
+		if (!result.allowed) {
+			return SYSTEMALARMS_ALARM_WARNING;
+		}
+	}
+
+	return SYSTEMALARMS_ALARM_OK;
+}
+
+/**
+ * Index the polygon fence described by the GeoFencePolygon and
+ * GeoFenceVertex instances.  Instances that don't exist yet are created,
+ * which loads them from flash.  If the settings ask for a fence and it
+ * can't be built, fence_failed is set and checkPosition() alarms.
+ */
+static void rebuildFence(void)
+{
+	geofence_index_free(fence);
+	fence = NULL;
+	fence_failed = false;
+
+	uint8_t num_polygons = MIN(geofenceSettings->PolygonCount, GEOFENCE_MAX_POLYGONS);
+	uint16_t num_vertices = MIN(geofenceSettings->VertexCount, GEOFENCEVERTEX_MAXINSTANCES);
+
+	if (num_polygons == 0 || num_vertices == 0) {
+		return;
+	}
+
+	fence_failed = true;
+
+	// Creating can fail without saying so; stop when the count doesn't move
+	uint16_t num_instances;
+
+	while ((num_instances = GeoFencePolygonGetNumInstances()) < num_polygons) {
+		GeoFencePolygonCreateInstance();
+
+		if (GeoFencePolygonGetNumInstances() == num_instances) {
+			return;
 		}
 	}
+
+	while ((num_instances = GeoFenceVertexGetNumInstances()) < num_vertices) {
+		GeoFenceVertexCreateInstance();
+
+		if (GeoFenceVertexGetNumInstances() == num_instances) {
+			return;
+		}
+	}
+
+	struct geofence_polygon polygons[GEOFENCE_MAX_POLYGONS];
+
+	for (int i = 0; i < num_polygons; i++) {
+		GeoFencePolygonData polygon;
+		GeoFencePolygonInstGet(i, &polygon);
+
+		polygons[i].type = (polygon.Type == GEOFENCEPOLYGON_TYPE_EXCLUSION) ?
+			GEOFENCE_POLYGON_EXCLUSION : GEOFENCE_POLYGON_INCLUSION;
+		polygons[i].floor = polygon.Floor;
+		polygons[i].ceiling = polygon.Ceiling;
+		polygons[i].first_vertex = polygon.FirstVertex;
+		polygons[i].num_vertices = polygon.VertexCount;
+	}
+
+	// The index keeps its own copy, so this is only needed while building
+	float (*vertices)[2] = PIOS_malloc(num_vertices * sizeof(*vertices));
+	if (vertices == NULL) {
+		return;
+	}
+
+	for (int i = 0; i < num_vertices; i++) {
+		GeoFenceVertexData vertex;
+		GeoFenceVertexInstGet(i, &vertex);
+
+		vertices[i][0] = vertex.Position[GEOFENCEVERTEX_POSITION_NORTH];
+		vertices[i][1] = vertex.Position[GEOFENCEVERTEX_POSITION_EAST];
+	}
+
+	fence = geofence_index_build(polygons, num_polygons,
+			(const float (*)[2]) vertices, num_vertices);
+
+	PIOS_free(vertices);
+
+	fence_failed = (fence == NULL);
+}
+
+/**
+ * Note that the polygon fence changed; it is rebuilt once it settles
+ */
+static void fenceUpdated(UAVObjEvent* ev, void *ctx, void *obj, int len)
+{
+	(void) ev; (void) ctx; (void) obj; (void) len;
+
+	fence_changed_time = PIOS_Thread_Systime();
+	fence_dirty = true;
 }
 
 /**
@@ -152,6 +324,8 @@ static void settingsUpdated(UAVObjEvent* ev, void *ctx, void *obj, int len)
 	// Cache squared distances to save computations
 	geofenceSettings->WarningRadius = powf(geofenceSettings->WarningRadius, 2);
 	geofenceSettings->ErrorRadius = powf(geofenceSettings->ErrorRadius, 2);
+
+	fenceUpdated(ev, ctx, obj, len);
 }
 
 /**
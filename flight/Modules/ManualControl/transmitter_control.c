@@ -47,6 +47,7 @@
 #include "pathdesired.h"
 #include "positionactual.h"
 #include "receiveractivity.h"
+#include "receiverlatency.h"
 #include "systemsettings.h"
 
 #include "misc_math.h"
@@ -77,12 +78,24 @@
  * arming, etc. */
 #define MIN_MEANINGFUL_RANGE 40
 
+/* Enough for the largest frame any receiver driver delivers (SBus) */
+#define RCVR_FRAME_CHANNELS 18
+
 struct rcvr_activity_fsm {
 	ManualControlSettingsChannelGroupsOptions group;
 	uint16_t prev[RCVR_ACTIVITY_MONITOR_CHANNELS_PER_GROUP];
 	uint8_t check_count;
 };
 
+/* The last frame read from a receiver in this update, so that all of its
+ * channels come from the same frame with one driver call */
+struct rcvr_frame {
+	uintptr_t rcvr_id;
+	int32_t num_channels;
+	uint32_t time;
+	int16_t channels[RCVR_FRAME_CHANNELS];
+};
+
 extern uintptr_t pios_rcvr_group_map[];
 
 // Private variables
@@ -97,6 +110,10 @@ static uint32_t               lastSysTime;
 static float                      flight_mode_value;
 static enum control_events        pending_control_event;
 static bool                       settings_updated;
+static struct rcvr_frame          frame;
+static uintptr_t                  timed_rcvr_id;
+static uint32_t                   timed_frame_time;
+static bool                       have_frame_time;
 enum arm_state {
 	ARM_STATE_DISARMED,
 	ARM_STATE_ARMING,
@@ -122,6 +139,8 @@ static void resetRcvrActivity(struct rcvr_activity_fsm * fsm);
 static bool updateRcvrActivity(struct rcvr_activity_fsm * fsm);
 static void set_loiter_command(ManualControlCommandData *cmd, SystemSettingsAirframeTypeOptions *airframe_type);
 static void set_armed_if_changed(uint8_t new_arm);
+static int32_t read_channel(uintptr_t rcvr_id, uint8_t channel);
+static void update_latency(uint32_t frame_time);
 
 // Exposed from manualcontrol to prevent attempts to arm when unsafe
 extern bool ok_to_arm();
@@ -151,6 +170,7 @@ int32_t transmitter_control_initialize()
 		|| FlightStatusInitialize() == -1 \
 		|| StabilizationDesiredInitialize() == -1 \
 		|| ReceiverActivityInitialize() == -1 \
+		|| ReceiverLatencyInitialize() == -1 \
 		|| ManualControlSettingsInitialize() == -1 ){
 
 		return -1;
@@ -208,6 +228,16 @@ int32_t transmitter_control_update()
 		ManualControlSettingsGet(&settings);
 	}
 
+	/* Read each receiver afresh this update; the throttle receiver is the
+	 * one whose latency is measured */
+	frame.rcvr_id = 0;
+	frame.num_channels = 0;
+	have_frame_time = false;
+
+	uint8_t throttle_group = settings.ChannelGroups[MANUALCONTROLSETTINGS_CHANNELGROUPS_THROTTLE];
+	timed_rcvr_id = (throttle_group < MANUALCONTROLSETTINGS_CHANNELGROUPS_NONE) ?
+		pios_rcvr_group_map[throttle_group] : 0;
+
 	/* Update channel activity monitor */
 	uint8_t arm_status;
 	FlightStatusArmedGet(&arm_status);
@@ -272,7 +302,7 @@ int32_t transmitter_control_update()
 			int mapped = rssitype_to_channelgroup();
 
 			if (mapped >= 0) {
-				value = PIOS_RCVR_Read(
+				value = read_channel(
 						pios_rcvr_group_map[mapped],
 						settings.RssiChannelNumber);
 			}
@@ -308,7 +338,7 @@ int32_t transmitter_control_update()
 			cmd.Channel[n] = PIOS_RCVR_INVALID;
 			validChannel[n] = false;
 		} else {
-			cmd.Channel[n] = PIOS_RCVR_Read(pios_rcvr_group_map[settings.ChannelGroups[n]],
+			cmd.Channel[n] = read_channel(pios_rcvr_group_map[settings.ChannelGroups[n]],
 							settings.ChannelNumber[n]);
 		}
 
@@ -450,6 +480,10 @@ int32_t transmitter_control_update()
 	// Update cmd object
 	ManualControlCommandSet(&cmd);
 
+	if (have_frame_time) {
+		update_latency(timed_frame_time);
+	}
+
 	return 0;
 }
 
@@ -1262,6 +1296,66 @@ static float scaleChannel(int n, int16_t value)
 	return valueScaled;
 }
 
+/**
+ * @brief Read a channel, taking it from the receiver's latest frame when the
+ * driver can deliver whole frames.
+ * @param[in] rcvr_id receiver to read from
+ * @param[in] channel channel to read, starting at 1
+ * @returns the value, or error value as PIOS_RCVR_Read() returns
+ */
+static int32_t read_channel(uintptr_t rcvr_id, uint8_t channel)
+{
+	if (rcvr_id != frame.rcvr_id) {
+		frame.rcvr_id = rcvr_id;
+		frame.num_channels = PIOS_RCVR_ReadFrame(rcvr_id, frame.channels,
+				RCVR_FRAME_CHANNELS, &frame.time);
+
+		if (frame.num_channels > 0 && rcvr_id == timed_rcvr_id) {
+			timed_frame_time = frame.time;
+			have_frame_time = true;
+		}
+	}
+
+	if (frame.num_channels <= 0 || channel == 0 ||
+			channel > frame.num_channels) {
+		return PIOS_RCVR_Read(rcvr_id, channel);
+	}
+
+	return frame.channels[channel - 1];
+}
+
+/**
+ * @brief Update ReceiverLatency with how long ago the frame just
+ * processed arrived.  Frames are only counted the first time they are seen,
+ * and nothing is counted before the receiver has delivered one.
+ */
+static void update_latency(uint32_t frame_time)
+{
+	static uint32_t last_frame_time;
+
+	if (frame_time == last_frame_time) {
+		return;
+	}
+
+	ReceiverLatencyData latency;
+	ReceiverLatencyGet(&latency);
+
+	latency.FrameAge = PIOS_DELAY_DiffuS(frame_time);
+	if (latency.FrameAge > latency.MaxFrameAge) {
+		latency.MaxFrameAge = latency.FrameAge;
+	}
+
+	if (last_frame_time) {
+		latency.FramePeriod = PIOS_DELAY_DiffuS2(last_frame_time, frame_time);
+	}
+
+	latency.Frames++;
+
+	ReceiverLatencySet(&latency);
+
+	last_frame_time = frame_time;
+}
+
 static uint32_t timeDifferenceMs(uint32_t start_time, uint32_t end_time) {
 	if (end_time >= start_time)
 		return end_time - start_time;
@@ -7,7 +7,7 @@
  *
  * @file       pathplanner.c
  * @author     Tau Labs, http://taulabs.org, Copyright (C) 2013-2014
- * @author     dRonin, http://dronin.org Copyright (C) 2015
+ * @author     dRonin, http://dronin.org Copyright (C) 2015-2017
  * @brief      Simple path planner which activates a sequence of waypoints
  *****************************************************************************/
 /*
@@ -28,9 +28,11 @@
 #include "openpilot.h"
 #include "physical_constants.h"
 #include "paths.h"
+#include "path_plan.h"
 
 #include "flightstatus.h"
 #include "pathdesired.h"
+#include "pathlookahead.h"
 #include "pathplannersettings.h"
 #include "pathstatus.h"
 #include "positionactual.h"
@@ -45,6 +47,7 @@
 #define TASK_PRIORITY PIOS_THREAD_PRIO_LOW
 #define MAX_QUEUE_SIZE 2
 #define UPDATE_RATE_MS 20
+#define ROUTE_MAX_LEGS 24	// Waypoint maxinstances
 
 // Private types
 
@@ -55,27 +58,38 @@ static PathPlannerSettingsData pathPlannerSettings;
 static WaypointActiveData waypointActive;
 static WaypointData waypoint;
 static bool path_completed;
+static struct path_plan_leg *route;
+static int32_t route_legs;
 
 // Private functions
 static void advanceWaypoint();
 static void activateWaypoint(int idx);
+static void replanActiveLeg();
 
 static void pathPlannerTask(void *parameters);
 static void process_pp_settings();
 
-static void waypointsUpdated(UAVObjEvent * ev, void *ctx, void *obj, int len);
 static void pathStatusUpdated(UAVObjEvent * ev, void *ctx, void *obj, int len);
 static void createPathBox();
 static void createPathLogo();
+static void buildRoute();
+static bool planLeg(int32_t idx, PathDesiredData *pathDesired);
+static void planLookahead(int32_t idx, PathLookaheadData *lookahead);
 
 static bool module_enabled;
 
 static volatile bool pathplanner_config_dirty;
+static volatile bool route_dirty;
 
 //! Store which waypoint has actually been pushed into PathDesired
 static int32_t active_waypoint = -1;
 //! Store the previous waypoint which is used to determine the path trajectory
 static int32_t previous_waypoint = -1;
+//! Whether PathDesired holds the active waypoint's leg, rather than a hold
+static bool leg_issued;
+//! The leg and lookahead last pushed, to tell whether a replan changed them
+static PathDesiredData issued_path;
+static PathLookaheadData issued_lookahead;
 /**
  * Module initialization
  */
@@ -118,7 +132,14 @@ int32_t PathPlannerInitialize()
 	}
 
 	if(module_enabled) {
-		if (WaypointInitialize() == -1 || WaypointActiveInitialize() == -1) {
+		if (WaypointInitialize() == -1 || WaypointActiveInitialize() == -1 ||
+				PathLookaheadInitialize() == -1) {
+			module_enabled = false;
+			return -1;
+		}
+
+		route = PIOS_malloc(ROUTE_MAX_LEGS * sizeof(*route));
+		if (!route) {
 			module_enabled = false;
 			return -1;
 		}
@@ -126,6 +147,7 @@ int32_t PathPlannerInitialize()
 		// Create object queue
 		queue = PIOS_Queue_Create(MAX_QUEUE_SIZE, sizeof(UAVObjEvent));
 		FlightStatusConnectQueue(queue);
+		WaypointActiveConnectQueue(queue);
 
 		return 0;
 	}
@@ -152,8 +174,9 @@ static void pathPlannerTask(void *parameters)
 			&pathplanner_config_dirty);
 	pathplanner_config_dirty = true;
 
-	WaypointConnectCallback(waypointsUpdated);
-	WaypointActiveConnectCallback(waypointsUpdated);
+	// Replan the route when the waypoints change, rather than on every leg
+	WaypointConnectCallbackCtx(UAVObjCbSetFlag, &route_dirty);
+	route_dirty = true;
 
 	FlightStatusData flightStatus;
 
@@ -171,6 +194,7 @@ static void pathPlannerTask(void *parameters)
 			process_pp_settings();
 
 			pathplanner_config_dirty = false;
+			route_dirty = true;
 		}
 
 		// Make sure when flight mode toggles, to immediately update the path
@@ -184,20 +208,29 @@ static void pathPlannerTask(void *parameters)
 			continue;
 		}
 
+		if (route_dirty) {
+			route_dirty = false;
+
+			buildRoute();
+
+			// Reissue the current leg only if replanning changed it
+			if (pathplanner_active) {
+				replanActiveLeg();
+			}
+		}
+
 		if(pathplanner_active == false) {
 			// Reset the state.  Active waypoint should be set to an invalid
 			// value to force waypoint 0 to become activated when starting
-			// Note: this needs to be done before the callback is triggered!
 			active_waypoint = -1;
 			previous_waypoint = -1;
+			leg_issued = false;
 
-			// This triggers callback to update variable
 			WaypointActiveGet(&waypointActive);
 			waypointActive.Index = 0;
 			WaypointActiveSet(&waypointActive);
 
 			pathplanner_active = true;
-			continue;
 		}
 
 		/* This method determines if we have achieved the goal of the active */
@@ -205,32 +238,89 @@ static void pathPlannerTask(void *parameters)
 		if (path_completed)
 			advanceWaypoint();
 
-		/* If advance waypoint takes a long time to calculate then it should */
-		/* be called from here when the active_waypoints does not equal the  */
-		/* WaypointActive.Index                                              */
-		/* if (active_waypoint != WaypointActive.Index)                      */
-		/*     advanceWaypoint(WaypointActive.Index)                         */
+		/* Push the active waypoint, whether we advanced to it or it was */
+		/* set from outside.  The route is already planned, so this is   */
+		/* only a lookup.                                                */
+		WaypointActiveGet(&waypointActive);
+		if (active_waypoint != waypointActive.Index) {
+			active_waypoint = waypointActive.Index;
+
+			activateWaypoint(waypointActive.Index);
+		}
 	}
 }
 
 /**
- * On changed waypoints or active waypoint update position desired
- * if we are in charge
+ * Plan the whole route: read the consecutive valid waypoints from the
+ * first and work out the corners and speeds between them.
  */
-static void waypointsUpdated(UAVObjEvent * ev, void *ctx, void *obj, int len)
+static void buildRoute()
 {
-	(void) ev; (void) ctx; (void) obj; (void) len;
+	int32_t num_waypoints = UAVObjGetNumInstances(WaypointHandle());
 
-	FlightStatusData flightStatus;
-	FlightStatusGet(&flightStatus);
-	if (flightStatus.FlightMode != FLIGHTSTATUS_FLIGHTMODE_PATHPLANNER)
-		return;
+	if (num_waypoints > ROUTE_MAX_LEGS) {
+		num_waypoints = ROUTE_MAX_LEGS;
+	}
 
-	WaypointActiveGet(&waypointActive);
-	if(active_waypoint != waypointActive.Index) {
-		active_waypoint = waypointActive.Index;
+	route_legs = 0;
+
+	for (int32_t i = 0; i < num_waypoints; i++) {
+		WaypointData wp;
+		WaypointInstGet(i, &wp);
 
-		activateWaypoint(waypointActive.Index);
+		if (wp.Mode == WAYPOINT_MODE_INVALID) {
+			break;
+		}
+
+		struct path_plan_leg *leg = &route[route_legs++];
+
+		leg->end[0] = wp.Position[WAYPOINT_POSITION_NORTH];
+		leg->end[1] = wp.Position[WAYPOINT_POSITION_EAST];
+		leg->end[2] = wp.Position[WAYPOINT_POSITION_DOWN];
+		leg->velocity = wp.Velocity;
+		leg->straight = wp.Mode == WAYPOINT_MODE_VECTOR;
+	}
+
+	const struct path_plan_limits limits = {
+		.corner_radius = pathPlannerSettings.CornerRadius,
+		.corner_accel = pathPlannerSettings.CornerAccel,
+		.max_accel = pathPlannerSettings.MaxAccel,
+	};
+
+	path_plan_build(route, route_legs, &limits);
+}
+
+/**
+ * Fill in the planned legs from idx on.  The turn at the end of the
+ * first is only valid if the leg really starts at the waypoint before.
+ */
+static void planLookahead(int32_t idx, PathLookaheadData *lookahead)
+{
+	memset(lookahead, 0, sizeof(*lookahead));
+
+	for (int i = 0; i < PATHLOOKAHEAD_WAYPOINT_NUMELEM; i++) {
+		int32_t leg_idx = idx + i;
+
+		if (idx < 0 || leg_idx >= route_legs) {
+			lookahead->Waypoint[i] = -1;
+			continue;
+		}
+
+		const struct path_plan_leg *leg = &route[leg_idx];
+
+		lookahead->Waypoint[i] = leg_idx;
+		lookahead->EndNorth[i] = leg->end[0];
+		lookahead->EndEast[i] = leg->end[1];
+		lookahead->EndDown[i] = leg->end[2];
+		lookahead->Length[i] = leg->length;
+		lookahead->Velocity[i] = leg->velocity;
+		lookahead->CornerDistance[i] = leg->corner_distance;
+		lookahead->CornerCurvature[i] = leg->corner_curvature;
+	}
+
+	if (previous_waypoint != idx - 1) {
+		lookahead->CornerDistance[0] = 0;
+		lookahead->CornerCurvature[0] = 0;
 	}
 }
 
@@ -274,6 +364,8 @@ static void holdCurrentPosition()
 	pathDesired.ModeParameters = 0;
 	pathDesired.Waypoint = -1;
 	PathDesiredSet(&pathDesired);
+
+	leg_issued = false;
 }
 
 /**
@@ -302,6 +394,8 @@ static void holdPosition(uint32_t idx)
 	pathDesired.ModeParameters = 0;
 	pathDesired.Waypoint = -1;
 	PathDesiredSet(&pathDesired);
+
+	leg_issued = false;
 }
 
 static bool waypointValid(int32_t idx) {
@@ -351,80 +445,97 @@ static void advanceWaypoint()
 }
 
 /**
- * This method is called when a new waypoint is activated
- *
- * Note: The way this is called, it runs in an object callback.  This is safe because
- * the execution time is extremely short.  If it starts to take a longer time then
- * the main task look should monitor a flag (such as the waypoint changing) and call
- * this method from the main task.
+ * Work out the PathDesired for flying to waypoint idx along the route.
+ * @returns false if the waypoint can't be flown to
  */
-static void activateWaypoint(int idx)
+static bool planLeg(int32_t idx, PathDesiredData *pathDesired)
 {
 	if (!waypointValid(idx)) {
-		// Attempting to access invalid waypoint.  Fall back to position hold at current location
-		AlarmsSet(SYSTEMALARMS_ALARM_PATHPLANNER, SYSTEMALARMS_ALARM_ERROR);
-		holdCurrentPosition();
-		return;
+		return false;
 	}
 
 	// Get the activated waypoint
 	WaypointInstGet(idx, &waypoint);
 
-	PathDesiredData pathDesired;
+	memset(pathDesired, 0, sizeof(*pathDesired));
 
-	pathDesired.Waypoint = idx;
+	pathDesired->Waypoint = idx;
 
-	pathDesired.End[PATHDESIRED_END_NORTH] = waypoint.Position[WAYPOINT_POSITION_NORTH];
-	pathDesired.End[PATHDESIRED_END_EAST] = waypoint.Position[WAYPOINT_POSITION_EAST];
-	pathDesired.End[PATHDESIRED_END_DOWN] = waypoint.Position[WAYPOINT_POSITION_DOWN];
-	pathDesired.ModeParameters = waypoint.ModeParameters;
+	pathDesired->End[PATHDESIRED_END_NORTH] = waypoint.Position[WAYPOINT_POSITION_NORTH];
+	pathDesired->End[PATHDESIRED_END_EAST] = waypoint.Position[WAYPOINT_POSITION_EAST];
+	pathDesired->End[PATHDESIRED_END_DOWN] = waypoint.Position[WAYPOINT_POSITION_DOWN];
+	pathDesired->ModeParameters = waypoint.ModeParameters;
 
 	// Use this to ensure the cases match up (catastrophic if not) and to cover any cases
 	// that don't make sense to come from the path planner
 	switch(waypoint.Mode) {
 		case WAYPOINT_MODE_VECTOR:
-			pathDesired.Mode = PATHDESIRED_MODE_VECTOR;
+			pathDesired->Mode = PATHDESIRED_MODE_VECTOR;
 			break;
 		case WAYPOINT_MODE_ENDPOINT:
-			pathDesired.Mode = PATHDESIRED_MODE_ENDPOINT;
+			pathDesired->Mode = PATHDESIRED_MODE_ENDPOINT;
 			break;
 		case WAYPOINT_MODE_CIRCLELEFT:
-			pathDesired.Mode = PATHDESIRED_MODE_CIRCLELEFT;
+			pathDesired->Mode = PATHDESIRED_MODE_CIRCLELEFT;
 			break;
 		case WAYPOINT_MODE_CIRCLERIGHT:
-			pathDesired.Mode = PATHDESIRED_MODE_CIRCLERIGHT;
+			pathDesired->Mode = PATHDESIRED_MODE_CIRCLERIGHT;
 			break;
 		case WAYPOINT_MODE_LAND:
-			pathDesired.Mode = PATHDESIRED_MODE_LAND;
+			pathDesired->Mode = PATHDESIRED_MODE_LAND;
 			break;
 		default:
-			holdCurrentPosition();
-			AlarmsSet(SYSTEMALARMS_ALARM_PATHPLANNER, SYSTEMALARMS_ALARM_ERROR);
-			return;
+			return false;
 	}
 
-	pathDesired.EndingVelocity = waypoint.Velocity;
+	// Planned speeds, where the route covers this far
+	pathDesired->EndingVelocity = (idx < route_legs) ?
+		route[idx].velocity : waypoint.Velocity;
 
 	if(previous_waypoint < 0) {
 		// For first waypoint, get current position as start point
 		PositionActualData positionActual;
 		PositionActualGet(&positionActual);
 
-		pathDesired.Start[PATHDESIRED_START_NORTH] = positionActual.North;
-		pathDesired.Start[PATHDESIRED_START_EAST] = positionActual.East;
-		pathDesired.Start[PATHDESIRED_START_DOWN] = positionActual.Down - 1;
-		pathDesired.StartingVelocity = waypoint.Velocity;
+		pathDesired->Start[PATHDESIRED_START_NORTH] = positionActual.North;
+		pathDesired->Start[PATHDESIRED_START_EAST] = positionActual.East;
+		pathDesired->Start[PATHDESIRED_START_DOWN] = positionActual.Down - 1;
+		pathDesired->StartingVelocity = waypoint.Velocity;
 	} else {
 		// Get previous waypoint as start point
 		WaypointData waypointPrev;
 		WaypointInstGet(previous_waypoint, &waypointPrev);
 
-		pathDesired.Start[PATHDESIRED_END_NORTH] = waypointPrev.Position[WAYPOINT_POSITION_NORTH];
-		pathDesired.Start[PATHDESIRED_END_EAST] = waypointPrev.Position[WAYPOINT_POSITION_EAST];
-		pathDesired.Start[PATHDESIRED_END_DOWN] = waypointPrev.Position[WAYPOINT_POSITION_DOWN];
-		pathDesired.StartingVelocity = waypointPrev.Velocity;
+		pathDesired->Start[PATHDESIRED_END_NORTH] = waypointPrev.Position[WAYPOINT_POSITION_NORTH];
+		pathDesired->Start[PATHDESIRED_END_EAST] = waypointPrev.Position[WAYPOINT_POSITION_EAST];
+		pathDesired->Start[PATHDESIRED_END_DOWN] = waypointPrev.Position[WAYPOINT_POSITION_DOWN];
+		pathDesired->StartingVelocity = (previous_waypoint < route_legs) ?
+			route[previous_waypoint].velocity : waypointPrev.Velocity;
+	}
+
+	return true;
+}
+
+/**
+ * This method is called from the main task when a new waypoint is activated
+ */
+static void activateWaypoint(int idx)
+{
+	PathDesiredData pathDesired;
+
+	if (!planLeg(idx, &pathDesired)) {
+		// Attempting to access invalid waypoint.  Fall back to position hold at current location
+		AlarmsSet(SYSTEMALARMS_ALARM_PATHPLANNER, SYSTEMALARMS_ALARM_ERROR);
+		holdCurrentPosition();
+		return;
 	}
 
+	planLookahead(idx, &issued_lookahead);
+	issued_path = pathDesired;
+	leg_issued = true;
+
+	// Followers read the lookahead when PathDesired changes
+	PathLookaheadSet(&issued_lookahead);
 	PathDesiredSet(&pathDesired);
 
 	// Invalidate any pending path status updates
@@ -433,6 +544,46 @@ static void activateWaypoint(int idx)
 	AlarmsClear(SYSTEMALARMS_ALARM_PATHPLANNER);
 }
 
+/**
+ * After the route has been replanned, push the active leg again only if
+ * what was planned for it changed.  Reissuing an unchanged leg would
+ * restart the follower on it mid-leg.
+ */
+static void replanActiveLeg()
+{
+	if (!leg_issued || active_waypoint < 0) {
+		return;
+	}
+
+	PathDesiredData pathDesired;
+	PathLookaheadData lookahead;
+
+	// Keep flying the leg as issued if its waypoint has been removed
+	if (!planLeg(active_waypoint, &pathDesired)) {
+		return;
+	}
+
+	// The first leg starts where the vehicle was, not at a planned point
+	if (previous_waypoint < 0) {
+		memcpy(pathDesired.Start, issued_path.Start, sizeof(pathDesired.Start));
+	}
+
+	planLookahead(active_waypoint, &lookahead);
+
+	if (!memcmp(&pathDesired, &issued_path, sizeof(pathDesired)) &&
+			!memcmp(&lookahead, &issued_lookahead, sizeof(lookahead))) {
+		return;
+	}
+
+	issued_path = pathDesired;
+	issued_lookahead = lookahead;
+
+	PathLookaheadSet(&issued_lookahead);
+	PathDesiredSet(&pathDesired);
+
+	path_completed = false;
+}
+
 static void process_pp_settings() {
 	uint8_t preprogrammedPath = pathPlannerSettings.PreprogrammedPath;
 
@@ -113,10 +113,14 @@ static int32_t UAVTalkSendHandler(void *ctx, uint8_t * buf, int32_t length);
 static int32_t RadioSendHandler(void *ctx, uint8_t * buf, int32_t length);
 static void ProcessTelemetryStream(UAVTalkConnection inConnectionHandle,
 				   UAVTalkConnection outConnectionHandle,
-				   uint8_t rxbyte);
+				   const uint8_t *rxbytes, int32_t numbytes);
+static void ProcessTelemetryFrame(UAVTalkConnection inConnectionHandle,
+				  UAVTalkConnection outConnectionHandle);
 static void ProcessRadioStream(UAVTalkConnection inConnectionHandle,
 			       UAVTalkConnection outConnectionHandle,
-			       uint8_t rxbyte);
+			       const uint8_t *rxbytes, int32_t numbytes);
+static void ProcessRadioFrame(UAVTalkConnection inConnectionHandle,
+			      UAVTalkConnection outConnectionHandle);
 static void objectPersistenceUpdatedCb(UAVObjEvent * objEv, void *ctx,
 				void *obj, int len);
 static void registerObject(UAVObjHandle obj);
@@ -403,13 +407,10 @@ static void radioRxTask( __attribute__ ((unused))
 						   sizeof(serial_data),
 						   MAX_PORT_DELAY);
 			if (bytes_to_process > 0) {
-				// Pass the data through the UAVTalk parser.
-				for (uint8_t i = 0;
-				     i < bytes_to_process; i++) {
-					ProcessRadioStream(data->radioUAVTalkCon,
-							   data->telemUAVTalkCon,
-							   serial_data[i]);
-				}
+				// Find the frames and pass them on.
+				ProcessRadioStream(data->radioUAVTalkCon,
+						   data->telemUAVTalkCon,
+						   serial_data, bytes_to_process);
 			}
 		} else {
 			PIOS_Thread_Sleep(3);
@@ -445,15 +446,9 @@ static void telemetryRxTask( __attribute__ ((unused))
 						   MAX_PORT_DELAY);
 			if (bytes_to_process > 0) {
 				PIOS_ANNUNC_Toggle(PIOS_LED_RX);
-				for (uint8_t i = 0; i < bytes_to_process;
-				     i++) {
-					ProcessTelemetryStream(data->
-							       telemUAVTalkCon,
-							       data->
-							       radioUAVTalkCon,
-							       serial_data
-							       [i]);
-				}
+				ProcessTelemetryStream(data->telemUAVTalkCon,
+						       data->radioUAVTalkCon,
+						       serial_data, bytes_to_process);
 			}
 		} else {
 			PIOS_Thread_Sleep(5);
@@ -542,138 +537,189 @@ static int32_t RadioSendHandler(void *ctx, uint8_t * buf, int32_t length)
 
 #define MetaObjectId(x) (x+1)
 /**
- * @brief Process a byte of data received on the telemetry stream
+ * @brief Process data received on the telemetry stream
+ *
+ * Only the framing and CRC are checked; frames are forwarded as received
+ * and only the objects the modem itself uses are decoded.
  *
  * @param[in] inConnectionHandle  The UAVTalk connection handle on the telemetry port
  * @param[in] outConnectionHandle  The UAVTalk connection handle on the radio port.
- * @param[in] rxbyte  The received byte.
+ * @param[in] rxbytes  The received bytes.
+ * @param[in] numbytes  How many there are.
  */
 static void ProcessTelemetryStream(UAVTalkConnection inConnectionHandle,
 				   UAVTalkConnection outConnectionHandle,
-				   uint8_t rxbyte)
+				   const uint8_t *rxbytes, int32_t numbytes)
 {
-	// Keep reading until we receive a completed packet.
-	UAVTalkRxState state =
-	    UAVTalkProcessInputStreamQuiet(inConnectionHandle, rxbyte);
-
-	if (state == UAVTALK_STATE_COMPLETE) {
-		// We only want to unpack certain telemetry objects
-		uint32_t objId = UAVTalkGetPacketObjId(inConnectionHandle);
-		switch (objId) {
-		case HWTAULINK_OBJID:
-		case RFM22BRECEIVER_OBJID:
-		case MetaObjectId(HWTAULINK_OBJID):
-		case MetaObjectId(RFM22BRECEIVER_OBJID):
-		case MetaObjectId(RFM22BSTATUS_OBJID):
-
-			// These objects are received here and only here
-			UAVTalkReceiveObject(inConnectionHandle);
-			break;
+	while (numbytes > 0) {
+		bool complete;
+		int32_t used = UAVTalkFrameInputStream(inConnectionHandle,
+				rxbytes, numbytes, &complete);
 
-		case OBJECTPERSISTENCE_OBJID:
-		case MetaObjectId(OBJECTPERSISTENCE_OBJID):
-			// Handle saving settings on modem
-			UAVTalkReceiveObject(inConnectionHandle);
-
-			ObjectPersistenceData objectPersistence;
-			ObjectPersistenceGet(&objectPersistence);
-			if (objectPersistence.ObjectID != HWTAULINK_OBJID &&
-				objectPersistence.ObjectID != MetaObjectId(HWTAULINK_OBJID)) {
-				// relay packet to remote modem except for requests to save
-				// the settings which happens locally
-				UAVTalkRelayPacket(inConnectionHandle, outConnectionHandle);
-			}
+		if (used < 0) {
+			return;
+		}
 
-			break;
+		if (complete) {
+			ProcessTelemetryFrame(inConnectionHandle,
+					outConnectionHandle);
+		}
 
-		case RFM22BSTATUS_OBJID:
-		{
-			uint32_t inst_id = UAVTalkGetPacketInstId(inConnectionHandle);
-			if (inst_id == 0) {
-				// dealing with local modem
-				UAVTalkReceiveObject(inConnectionHandle);
-			} else {
-				// for remote modem
-				UAVTalkRelayPacket(inConnectionHandle, outConnectionHandle);
-			}
+		rxbytes += used;
+		numbytes -= used;
+	}
+}
+
+/**
+ * @brief Dispatch a complete frame from the telemetry stream
+ *
+ * @param[in] inConnectionHandle  The UAVTalk connection handle on the telemetry port
+ * @param[in] outConnectionHandle  The UAVTalk connection handle on the radio port.
+ */
+static void ProcessTelemetryFrame(UAVTalkConnection inConnectionHandle,
+				  UAVTalkConnection outConnectionHandle)
+{
+	// We only want to unpack certain telemetry objects
+	uint32_t objId = UAVTalkGetPacketObjId(inConnectionHandle);
+	switch (objId) {
+	case HWTAULINK_OBJID:
+	case RFM22BRECEIVER_OBJID:
+	case MetaObjectId(HWTAULINK_OBJID):
+	case MetaObjectId(RFM22BRECEIVER_OBJID):
+	case MetaObjectId(RFM22BSTATUS_OBJID):
+
+		// These objects are received here and only here
+		UAVTalkReceiveFrame(inConnectionHandle);
+		break;
+
+	case OBJECTPERSISTENCE_OBJID:
+	case MetaObjectId(OBJECTPERSISTENCE_OBJID):
+		// Handle saving settings on modem
+		UAVTalkReceiveFrame(inConnectionHandle);
+
+		ObjectPersistenceData objectPersistence;
+		ObjectPersistenceGet(&objectPersistence);
+		if (objectPersistence.ObjectID != HWTAULINK_OBJID &&
+			objectPersistence.ObjectID != MetaObjectId(HWTAULINK_OBJID)) {
+			// relay packet to remote modem except for requests to save
+			// the settings which happens locally
+			UAVTalkRelayFrame(inConnectionHandle, outConnectionHandle);
 		}
-			break;
-		default:
-			// all other packets are transparently relayed to the remote modem
-			UAVTalkRelayPacket(inConnectionHandle, outConnectionHandle);
-			break;
+
+		break;
+
+	case RFM22BSTATUS_OBJID:
+	{
+		uint32_t inst_id = UAVTalkGetFrameInstId(inConnectionHandle);
+		if (inst_id == 0) {
+			// dealing with local modem
+			UAVTalkReceiveFrame(inConnectionHandle);
+		} else {
+			// for remote modem
+			UAVTalkRelayFrame(inConnectionHandle, outConnectionHandle);
 		}
 	}
+		break;
+	default:
+		// all other packets are transparently relayed to the remote modem
+		UAVTalkRelayFrame(inConnectionHandle, outConnectionHandle);
+		break;
+	}
 }
 
 /**
- * @brief Process a byte of data received on the radio data stream.
+ * @brief Process data received on the radio data stream.
+ *
+ * Like the telemetry stream, this is framed rather than parsed.
  *
  * @param[in] inConnectionHandle  The UAVTalk connection handle on the radio port.
  * @param[in] outConnectionHandle  The UAVTalk connection handle on the telemetry port.
- * @param[in] rxbyte  The received byte.
+ * @param[in] rxbytes  The received bytes.
+ * @param[in] numbytes  How many there are.
  */
 static void ProcessRadioStream(UAVTalkConnection inConnectionHandle,
 			       UAVTalkConnection outConnectionHandle,
-			       uint8_t rxbyte)
+			       const uint8_t *rxbytes, int32_t numbytes)
 {
-	// Keep reading until we receive a completed packet.
-	UAVTalkRxState state =
-	    UAVTalkProcessInputStreamQuiet(inConnectionHandle, rxbyte);
-
-	if (state == UAVTALK_STATE_COMPLETE) {
-		// We only want to unpack certain objects from the remote modem
-		// Similarly we only want to relay certain objects to the telemetry port
-		uint32_t objId = UAVTalkGetPacketObjId(inConnectionHandle);
-		switch (objId) {
-		case HWTAULINK_OBJID:
-		case MetaObjectId(RFM22BSTATUS_OBJID):
-		case MetaObjectId(HWTAULINK_OBJID):
-			// Ignore object...
-			// These objects are shadowed by the modem and are not transmitted to the telemetry port
-			// - RFM22BSTATUS_OBJID : ground station will receive the OPLM link status instead
-			// - HWTAULINK_OBJID : ground station will read and write the OPLM settings instead
-			break;
-		case RFM22BRECEIVER_OBJID:
-		case MetaObjectId(RFM22BRECEIVER_OBJID):
-			// Receive object locally
-			// These objects are received by the modem and are not transmitted to the telemetry port
-			// - RFM22BRECEIVER_OBJID : sent periodically from flight controller, not needed to echo
-			// some objects will send back a response to the remote modem
-			UAVTalkReceiveObject(inConnectionHandle);
-			break;
-		case FLIGHTBATTERYSTATE_OBJID:
-		case FLIGHTSTATUS_OBJID:
-		case POSITIONACTUAL_OBJID:
-		case VELOCITYACTUAL_OBJID:
-		case BAROALTITUDE_OBJID:
-
-			// process the battery voltage locally for relaying to taranis
-			UAVTalkReceiveObject(inConnectionHandle);
-			UAVTalkRelayPacket(inConnectionHandle, outConnectionHandle);
-			break;
-		case RFM22BSTATUS_OBJID:
-		{
-			uint32_t inst_id = UAVTalkGetPacketInstId(inConnectionHandle);
-			if (inst_id == 0) {
-				// instance 0 is from modem. do not pass this version
-			} else {
-				// process the remote link state locally for relaying to taranis
-				UAVTalkReceiveObject(inConnectionHandle);
-
-				// for remote modem
-				UAVTalkRelayPacket(inConnectionHandle, outConnectionHandle);
-			}
+	while (numbytes > 0) {
+		bool complete;
+		int32_t used = UAVTalkFrameInputStream(inConnectionHandle,
+				rxbytes, numbytes, &complete);
 
+		if (used < 0) {
+			return;
 		}
-			break;
 
-		default:
-			// all other packets are relayed to the telemetry port
-			UAVTalkRelayPacket(inConnectionHandle,
-					   outConnectionHandle);
-			break;
+		if (complete) {
+			ProcessRadioFrame(inConnectionHandle,
+					outConnectionHandle);
+		}
+
+		rxbytes += used;
+		numbytes -= used;
+	}
+}
+
+/**
+ * @brief Dispatch a complete frame from the radio data stream.
+ *
+ * @param[in] inConnectionHandle  The UAVTalk connection handle on the radio port.
+ * @param[in] outConnectionHandle  The UAVTalk connection handle on the telemetry port.
+ */
+static void ProcessRadioFrame(UAVTalkConnection inConnectionHandle,
+			      UAVTalkConnection outConnectionHandle)
+{
+	// We only want to unpack certain objects from the remote modem
+	// Similarly we only want to relay certain objects to the telemetry port
+	uint32_t objId = UAVTalkGetPacketObjId(inConnectionHandle);
+	switch (objId) {
+	case HWTAULINK_OBJID:
+	case MetaObjectId(RFM22BSTATUS_OBJID):
+	case MetaObjectId(HWTAULINK_OBJID):
+		// Ignore object...
+		// These objects are shadowed by the modem and are not transmitted to the telemetry port
+		// - RFM22BSTATUS_OBJID : ground station will receive the OPLM link status instead
+		// - HWTAULINK_OBJID : ground station will read and write the OPLM settings instead
+		break;
+	case RFM22BRECEIVER_OBJID:
+	case MetaObjectId(RFM22BRECEIVER_OBJID):
+		// Receive object locally
+		// These objects are received by the modem and are not transmitted to the telemetry port
+		// - RFM22BRECEIVER_OBJID : sent periodically from flight controller, not needed to echo
+		// some objects will send back a response to the remote modem
+		UAVTalkReceiveFrame(inConnectionHandle);
+		break;
+	case FLIGHTBATTERYSTATE_OBJID:
+	case FLIGHTSTATUS_OBJID:
+	case POSITIONACTUAL_OBJID:
+	case VELOCITYACTUAL_OBJID:
+	case BAROALTITUDE_OBJID:
+
+		// process the battery voltage locally for relaying to taranis
+		UAVTalkReceiveFrame(inConnectionHandle);
+		UAVTalkRelayFrame(inConnectionHandle, outConnectionHandle);
+		break;
+	case RFM22BSTATUS_OBJID:
+	{
+		uint32_t inst_id = UAVTalkGetFrameInstId(inConnectionHandle);
+		if (inst_id == 0) {
+			// instance 0 is from modem. do not pass this version
+		} else {
+			// process the remote link state locally for relaying to taranis
+			UAVTalkReceiveFrame(inConnectionHandle);
+
+			// for remote modem
+			UAVTalkRelayFrame(inConnectionHandle, outConnectionHandle);
 		}
+
+	}
+		break;
+
+	default:
+		// all other packets are relayed to the telemetry port
+		UAVTalkRelayFrame(inConnectionHandle,
+				  outConnectionHandle);
+		break;
 	}
 }
 
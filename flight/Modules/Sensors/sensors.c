@@ -36,6 +36,7 @@
 #include "pios_queue.h"
 #include "misc_math.h"
 #include "lpfilter.h"
+#include "loop_timing.h"
 
 #if defined(PIOS_INCLUDE_PX4FLOW)
 #include "pios_px4flow_priv.h"
@@ -77,6 +78,9 @@ enum mag_calibration_algo {
 static void SensorsTask(void *parameters);
 static void settingsUpdatedCb(UAVObjEvent * objEv, void *ctx, void *obj, int len);
 
+static bool receive_imu_batch(struct pios_queue *queue,
+		struct pios_sensor_gyro_data *gyro,
+		struct pios_sensor_accel_data *accel);
 static void update_accels(struct pios_sensor_accel_data *accel);
 static void update_gyros(struct pios_sensor_gyro_data *gyro);
 static void update_mags(struct pios_sensor_mag_data *mag);
@@ -256,19 +260,29 @@ static void SensorsTask(void *parameters)
 
 		//Block on gyro data but nothing else
 		struct pios_queue *queue;
-		queue = PIOS_SENSORS_GetQueue(PIOS_SENSOR_GYRO);
-		if (queue == NULL || PIOS_Queue_Receive(queue, &gyros, SENSOR_PERIOD) == false) {
-			good_runs = 0;
-			continue;
-		}
+		queue = PIOS_SENSORS_GetQueue(PIOS_SENSOR_IMU_BATCH);
+		if (queue != NULL) {
+			if (!receive_imu_batch(queue, &gyros, &accels)) {
+				good_runs = 0;
+				continue;
+			}
 
-		queue = PIOS_SENSORS_GetQueue(PIOS_SENSOR_ACCEL);
-		if (queue == NULL || PIOS_Queue_Receive(queue, &accels, 0) == false) {
-			//If no new accels data is ready, reuse the latest sample
-			AccelsSet(&accelsData);
-		}
-		else
 			update_accels(&accels);
+		} else {
+			queue = PIOS_SENSORS_GetQueue(PIOS_SENSOR_GYRO);
+			if (queue == NULL || PIOS_Queue_Receive(queue, &gyros, SENSOR_PERIOD) == false) {
+				good_runs = 0;
+				continue;
+			}
+
+			queue = PIOS_SENSORS_GetQueue(PIOS_SENSOR_ACCEL);
+			if (queue == NULL || PIOS_Queue_Receive(queue, &accels, 0) == false) {
+				//If no new accels data is ready, reuse the latest sample
+				AccelsSet(&accelsData);
+			}
+			else
+				update_accels(&accels);
+		}
 
 		// Update gyros after the accels since the rest of the code expects
 		// the accels to be available first
@@ -350,6 +364,53 @@ static void SensorsTask(void *parameters)
 	}
 }
 
+/**
+ * @brief Wait for a batch of IMU samples and reduce it to one gyro and
+ * accel sample by averaging, which also acts as the anti-aliasing filter
+ * for the lower output rate
+ * @param[in] queue The batch queue
+ * @param[out] gyro The averaged gyro data
+ * @param[out] accel The averaged accel data
+ * @returns true if a batch arrived in time
+ */
+static bool receive_imu_batch(struct pios_queue *queue,
+		struct pios_sensor_gyro_data *gyro,
+		struct pios_sensor_accel_data *accel)
+{
+	// Static to keep it off the task stack
+	static struct pios_sensor_imu_batch batch;
+
+	if (PIOS_Queue_Receive(queue, &batch, SENSOR_PERIOD) == false)
+		return false;
+
+	if (batch.count == 0)
+		return false;
+
+	float gyro_sum[3] = {0, 0, 0};
+	float accel_sum[3] = {0, 0, 0};
+
+	for (int i = 0; i < batch.count; i++) {
+		for (int j = 0; j < 3; j++) {
+			gyro_sum[j] += batch.samples[i].gyro[j];
+			accel_sum[j] += batch.samples[i].accel[j];
+		}
+	}
+
+	float scale = 1.0f / batch.count;
+
+	gyro->x = gyro_sum[0] * scale;
+	gyro->y = gyro_sum[1] * scale;
+	gyro->z = gyro_sum[2] * scale;
+	gyro->temperature = batch.temperature;
+
+	accel->x = accel_sum[0] * scale;
+	accel->y = accel_sum[1] * scale;
+	accel->z = accel_sum[2] * scale;
+	accel->temperature = batch.temperature;
+
+	return true;
+}
+
 /**
  * @brief Apply calibration and rotation to the raw accel data
  * @param[in] accels The raw accel data
@@ -441,6 +502,14 @@ static void update_gyros(struct pios_sensor_gyro_data *gyros)
 		}
 	}
 
+	/* Before the set: stabilization runs at a higher priority and may
+	 * have reached the outputs by the time it returns */
+	PIOS_TRACE_MARK(PIOS_TRACE_MARKER_GYROS);
+
+#if defined(LOOPTIMING_DIAGNOSTICS)
+	loop_timing_sample();
+#endif
+
 	GyrosSet(&gyrosData);
 }
 
@@ -50,6 +50,7 @@
 #include "cameradesired.h"
 #include "flightstatus.h"
 #include "gyros.h"
+#include "looptiming.h"
 #include "ratedesired.h"
 #include "systemident.h"
 #include "stabilizationdesired.h"
@@ -66,6 +67,7 @@
 #include "pid.h"
 #include "misc_math.h"
 #include "smoothcontrol.h"
+#include "loop_timing.h"
 
 // Includes for various stabilization algorithms
 #include "virtualflybar.h"
@@ -134,6 +136,14 @@ static bool lowThrottleZeroIntegral;
 static float max_rate_alpha = 0.8f;
 float vbar_decay = 0.991f;
 
+/* Maintain a second-order, lower cutof freq variant for
+ * dynamic flight modes.
+ */
+static float max_rate_filtered[MAX_AXES];
+
+// A flag to track which stabilization mode each axis is in
+static uint8_t previous_mode[MAX_AXES] = {255,255,255};
+
 struct pid pids[PID_MAX];
 smoothcontrol_state rc_smoothing;
 
@@ -212,6 +222,12 @@ int32_t StabilizationInitialize()
 	}
 #endif
 
+#if defined(LOOPTIMING_DIAGNOSTICS)
+	if (LoopTimingInitialize() == -1) {
+		return -1;
+	}
+#endif
+
 	return 0;
 }
 
@@ -274,6 +290,599 @@ void stabilization_failsafe_checks(StabilizationDesiredData *stab_desired,
 
 MODULE_HIPRI_INITCALL(StabilizationInitialize, StabilizationStart);
 
+/**
+ * Everything the per-axis control laws read or write in one iteration,
+ * gathered so the laws can be called through a pointer.
+ */
+struct stab_context {
+	const uint8_t *axis_mode;
+	const float *raw_input;
+	const float *attitude_error;
+	const float *gyro;
+	const StabilizationDesiredData *stab_desired;
+	const AttitudeActualData *attitude;
+
+	float horizon_rate_fraction;
+	float dT;
+	float dT_expected;
+
+	uint32_t iteration;
+	uint32_t timeval;
+	bool armed;
+
+	ActuatorDesiredData *actuator;
+	float *actuator_axis;
+	float *rate_axis;
+
+	bool error;
+};
+
+struct axis_pipeline;
+
+typedef void (*stab_stage)(struct axis_pipeline *p, struct stab_context *ctx, uint8_t axis);
+
+#define MAX_STAGES 3
+
+/**
+ * The control law for one axis, as the short chain of stages its mode
+ * needs and what they'd otherwise look up on every iteration.  Rebuilt
+ * whenever the axis changes mode or settings change.
+ */
+struct axis_pipeline {
+	stab_stage stages[MAX_STAGES];
+	uint8_t num_stages;
+
+	struct pid *outer;		// Attitude, axis lock or vbar loop
+	struct pid *inner;		// Rate loop
+	struct pid_deadband *deadband;
+
+	float rate_limit;		// deg/s the outer stage may ask for
+	float dyn_rate;			// Acro dynamic: rate at full stick
+	float break_point;		// Acro dynamic: where the dynamic rate begins
+
+	bool reinit;			// Whether the stages have run since the mode changed
+};
+
+static struct axis_pipeline pipelines[MAX_AXES];
+
+// System identification excitation progress, shared by all axes
+static struct {
+	bool measuring;
+	uint32_t enter_time;
+	uint32_t measure_remaining;
+} ident;
+
+static uint8_t ident_shift = 5;
+static uint32_t ident_mask;
+
+static void stage_stick_rate(struct axis_pipeline *p, struct stab_context *ctx, uint8_t axis)
+{
+	ctx->rate_axis[axis] = bound_sym(ctx->raw_input[axis], p->rate_limit);
+}
+
+static void stage_stick_rate_scaled(struct axis_pipeline *p, struct stab_context *ctx, uint8_t axis)
+{
+	ctx->rate_axis[axis] = bound_sym(ctx->raw_input[axis] * p->rate_limit, p->rate_limit);
+}
+
+static void stage_attitude(struct axis_pipeline *p, struct stab_context *ctx, uint8_t axis)
+{
+	float rate = pid_apply(p->outer, ctx->attitude_error[axis], ctx->dT_expected);
+
+	ctx->rate_axis[axis] = bound_sym(rate, p->rate_limit);
+}
+
+static void stage_acro_dynamic(struct axis_pipeline *p, struct stab_context *ctx, uint8_t axis)
+{
+	float raw = ctx->raw_input[axis];
+
+	float curve_cmd = expoM(raw,
+			settings.RateExpo[axis],
+			settings.RateExponent[axis]*0.1f);
+
+	uint16_t calc_max_rate = settings.ManualRate[axis];
+
+	float abs_cmd = fabsf(raw);
+
+	if (abs_cmd > p->break_point) {
+		calc_max_rate = (settings.ManualRate[axis] * (abs_cmd - 1.0f) * (2 * p->break_point - abs_cmd - 1.0f) + p->dyn_rate * powf(p->break_point - abs_cmd, 2.0f)) / powf(p->break_point - 1.0f, 2.0f);
+	}
+
+	calc_max_rate = MIN(calc_max_rate, p->dyn_rate);
+
+	max_rate_filtered[axis] = max_rate_filtered[axis] * max_rate_alpha + calc_max_rate * (1 - max_rate_alpha);
+
+	ctx->rate_axis[axis] = bound_sym(curve_cmd * max_rate_filtered[axis], max_rate_filtered[axis]);
+}
+
+static void stage_acro_plus(struct axis_pipeline *p, struct stab_context *ctx, uint8_t axis)
+{
+	// this implementation is based on the Openpilot/Librepilot Acro+ flightmode
+	// and our previous MWRate flightmodes
+	float raw = ctx->raw_input[axis];
+
+	ctx->rate_axis[axis] = bound_sym(raw * p->rate_limit, p->rate_limit);
+
+	// Zero integral for aggressive maneuvers
+	if ((axis < 2 && fabsf(ctx->gyro[axis]) > settings.AcroZeroIntegralGyro) ||
+		(axis == 0 && fabsf(raw) > settings.AcroZeroIntegralStick / 100.0f)) {
+		p->inner->iAccumulator = 0;
+	}
+}
+
+static void stage_weak_leveling(struct axis_pipeline *p, struct stab_context *ctx, uint8_t axis)
+{
+	float weak_leveling = ctx->attitude_error[axis] * weak_leveling_kp;
+	weak_leveling = bound_sym(weak_leveling, weak_leveling_max);
+
+	// Compute desired rate as input biased towards leveling
+	ctx->rate_axis[axis] = ctx->raw_input[axis] + weak_leveling;
+}
+
+static void stage_axis_lock(struct axis_pipeline *p, struct stab_context *ctx, uint8_t axis)
+{
+	float raw = ctx->raw_input[axis];
+
+	if (fabsf(raw) > max_axislock_rate) {
+		// While getting strong commands act like rate mode
+		ctx->rate_axis[axis] = bound_sym(raw, settings.ManualRate[axis]);
+
+		// Reset accumulator
+		axis_lock_accum[axis] = 0;
+	} else {
+		// For weaker commands or no command simply lock (almost) on no gyro change
+		axis_lock_accum[axis] += (raw - ctx->gyro[axis]) * ctx->dT_expected;
+		axis_lock_accum[axis] = bound_sym(axis_lock_accum[axis], max_axis_lock);
+
+		// Compute the inner loop
+		float tmpRateDesired = pid_apply(p->outer, axis_lock_accum[axis], ctx->dT_expected);
+		ctx->rate_axis[axis] = bound_sym(tmpRateDesired, p->rate_limit);
+	}
+}
+
+static void stage_horizon(struct axis_pipeline *p, struct stab_context *ctx, uint8_t axis)
+{
+	// Do not allow outer loop integral to wind up in this mode since the controller
+	// is often disengaged.
+	p->outer->iAccumulator = 0;
+
+	// Compute the outer loop for the attitude control
+	float rateDesiredAttitude = pid_apply(p->outer, ctx->attitude_error[axis], ctx->dT_expected);
+	// Compute the desire rate for a rate control
+	float rateDesiredRate = ctx->raw_input[axis] * p->rate_limit;
+
+	// Blend from one rate to another. The maximum of all stick positions is used for the
+	// amount so that when one axis goes completely to rate the other one does too. This
+	// prevents doing flips while one axis tries to stay in attitude mode.
+	float fraction = ctx->horizon_rate_fraction;
+
+	ctx->rate_axis[axis] = rateDesiredAttitude * (1.0f-fraction) + rateDesiredRate * fraction;
+	ctx->rate_axis[axis] = bound_sym(ctx->rate_axis[axis], p->rate_limit);
+}
+
+static void stage_poi(struct axis_pipeline *p, struct stab_context *ctx, uint8_t axis)
+{
+	float angle_error = 0;
+	float angle;
+
+	if (CameraDesiredHandle()) {
+		switch(axis) {
+		case PITCH:
+			CameraDesiredDeclinationGet(&angle);
+			angle_error = circular_modulus_deg(angle - ctx->attitude->Pitch);
+			break;
+		case ROLL:
+		{
+			uint8_t roll_fraction = 0;
+
+			// For ROLL POI mode we track the FC roll angle (scaled) to
+			// allow keeping some motion
+			CameraDesiredRollGet(&angle);
+			angle *= roll_fraction / 100.0f;
+			angle_error = circular_modulus_deg(angle - ctx->attitude->Roll);
+		}
+			break;
+		case YAW:
+			CameraDesiredBearingGet(&angle);
+			angle_error = circular_modulus_deg(angle - ctx->attitude->Yaw);
+			break;
+		}
+	} else
+		ctx->error = true;
+
+	// Compute the outer loop
+	float rate = pid_apply(p->outer, angle_error, ctx->dT_expected);
+	ctx->rate_axis[axis] = bound_sym(rate, p->rate_limit);
+}
+
+static void stage_rate_loop(struct axis_pipeline *p, struct stab_context *ctx, uint8_t axis)
+{
+	float out = pid_apply_setpoint(p->inner, p->deadband, ctx->rate_axis[axis], ctx->gyro[axis], ctx->dT_expected);
+
+	ctx->actuator_axis[axis] = bound_sym(out, 1.0f);
+}
+
+//! Acro dynamic runs the rate loop on the measured period
+static void stage_rate_loop_measured(struct axis_pipeline *p, struct stab_context *ctx, uint8_t axis)
+{
+	float out = pid_apply_setpoint(p->inner, p->deadband, ctx->rate_axis[axis], ctx->gyro[axis], ctx->dT);
+
+	ctx->actuator_axis[axis] = bound_sym(out, 1.0f);
+}
+
+//! For stages that go on to adjust the output, and bound it themselves
+static void stage_rate_loop_unbounded(struct axis_pipeline *p, struct stab_context *ctx, uint8_t axis)
+{
+	ctx->actuator_axis[axis] = pid_apply_setpoint(p->inner, p->deadband, ctx->rate_axis[axis], ctx->gyro[axis], ctx->dT_expected);
+}
+
+static void stage_acro_plus_mix(struct axis_pipeline *p, struct stab_context *ctx, uint8_t axis)
+{
+	float raw = ctx->raw_input[axis];
+
+	// The factor for gyro suppression / mixing raw stick input into the output; scaled by raw stick input
+	float factor = fabsf(raw) * settings.AcroInsanityFactor / 100.0f;
+
+	ctx->actuator_axis[axis] = factor * raw + (1.0f - factor) * ctx->actuator_axis[axis];
+	ctx->actuator_axis[axis] = bound_sym(ctx->actuator_axis[axis], 1.0f);
+}
+
+static void stage_virtual_flybar(struct axis_pipeline *p, struct stab_context *ctx, uint8_t axis)
+{
+	// Store for debugging output
+	ctx->rate_axis[axis] = ctx->raw_input[axis];
+
+	// Run a virtual flybar stabilization algorithm on this axis
+	stabilization_virtual_flybar(ctx->gyro[axis], ctx->rate_axis[axis], &ctx->actuator_axis[axis], ctx->dT_expected, p->reinit, axis, p->outer, &vbar_settings);
+}
+
+static void stage_system_ident(struct axis_pipeline *p, struct stab_context *ctx, uint8_t axis)
+{
+	// Takes 1250ms + the time to reach
+	// the '0th measurement'
+	// (could be the ~600ms period time)
+	const uint32_t PREPARE_TIME = 1250000;
+
+	if ((axis == 0) &&
+			(!ident.measuring) &&
+			((ctx->timeval - ident.enter_time) > PREPARE_TIME)) {
+		if (!(ctx->iteration & ident_mask)) {
+			ident.measuring = true;
+			ident.measure_remaining = 60 / ctx->dT_expected;
+			// Round down to an integer
+			// number of ident cycles.
+			ident.measure_remaining &= ~ident_mask;
+		}
+	}
+
+	if (!ctx->armed) {
+		ident.measuring = false;
+	}
+
+	if (!ident.measuring || !ident.measure_remaining) {
+		return;
+	}
+
+	const float scale = settings.AutotuneActuationEffort[axis];
+
+	uint32_t ident_iteration = ctx->iteration >> ident_shift;
+
+	if (axis == 2) {
+		// Only adjust the
+		// counter on one axis
+		ident.measure_remaining--;
+	}
+
+	ctx->actuator->SystemIdentCycle = (ctx->iteration & ident_mask);
+
+	switch (ident_iteration & 0x07) {
+		case 0:
+			if (axis == 2) {
+				ctx->actuator_axis[axis] += scale;
+			}
+			break;
+		case 1:
+			if (axis == 0) {
+				ctx->actuator_axis[axis] += scale;
+			}
+			break;
+		case 2:
+			if (axis == 2) {
+				ctx->actuator_axis[axis] -= scale;
+			}
+			break;
+		case 3:
+			if (axis == 0) {
+				ctx->actuator_axis[axis] -= scale;
+			}
+			break;
+		case 4:
+			if (axis == 2) {
+				ctx->actuator_axis[axis] += scale;
+			}
+			break;
+		case 5:
+			if (axis == 1) {
+				ctx->actuator_axis[axis] += scale;
+			}
+			break;
+		case 6:
+			if (axis == 2) {
+				ctx->actuator_axis[axis] -= scale;
+			}
+			break;
+		case 7:
+			if (axis == 1) {
+				ctx->actuator_axis[axis] -= scale;
+			}
+			break;
+	}
+
+	ctx->actuator_axis[axis] = bound_sym(ctx->actuator_axis[axis],1.0f);
+}
+
+static void stage_coordinated_flight(struct axis_pipeline *p, struct stab_context *ctx, uint8_t axis)
+{
+	const StabilizationDesiredData *stabDesired = ctx->stab_desired;
+	float *actuatorDesiredAxis = ctx->actuator_axis;
+
+	//If we are not in roll attitude mode, trigger an error
+	if (ctx->axis_mode[ROLL] != STABILIZATIONDESIRED_STABILIZATIONMODE_ATTITUDE)
+	{
+		ctx->error = true;
+		return;
+	}
+
+	if (fabsf(stabDesired->Yaw) < COORDINATED_FLIGHT_MAX_YAW_THRESHOLD) { //If yaw is within the deadband...
+		if (fabsf(stabDesired->Roll) > COORDINATED_FLIGHT_MIN_ROLL_THRESHOLD) { // We're requesting more roll than the threshold
+			float accelsDataY;
+			AccelsyGet(&accelsDataY);
+
+			//Reset integral if we have changed roll to opposite direction from rudder. This implies that we have changed desired turning direction.
+			if ((stabDesired->Roll > 0 && actuatorDesiredAxis[YAW] < 0) ||
+					(stabDesired->Roll < 0 && actuatorDesiredAxis[YAW] > 0)){
+				pids[PID_COORDINATED_FLIGHT_YAW].iAccumulator = 0;
+			}
+
+			// Coordinate flight can simply be seen as ensuring that there is no lateral acceleration in the
+			// body frame. As such, we use the (noisy) accelerometer data as our measurement. Ideally, at
+			// some point in the future we will estimate acceleration and then we can use the estimated value
+			// instead of the measured value.
+			float errorSlip = -accelsDataY;
+
+			float command = pid_apply(&pids[PID_COORDINATED_FLIGHT_YAW], errorSlip, ctx->dT_expected);
+			actuatorDesiredAxis[YAW] = bound_sym(command ,1.0);
+
+			// Reset axis-lock integrals
+			pids[PID_RATE_YAW].iAccumulator = 0;
+			axis_lock_accum[YAW] = 0;
+		} else if (fabsf(stabDesired->Roll) <= COORDINATED_FLIGHT_MIN_ROLL_THRESHOLD) { // We're requesting less roll than the threshold
+			// Axis lock on no gyro change
+			axis_lock_accum[YAW] += (0 - ctx->gyro[YAW]) * ctx->dT_expected;
+
+			ctx->rate_axis[YAW] = pid_apply(&pids[PID_ATT_YAW], axis_lock_accum[YAW], ctx->dT_expected);
+			ctx->rate_axis[YAW] = bound_sym(ctx->rate_axis[YAW], settings.MaximumRate[YAW]);
+
+			actuatorDesiredAxis[YAW] = pid_apply_setpoint(&pids[PID_RATE_YAW], NULL, ctx->rate_axis[YAW], ctx->gyro[YAW], ctx->dT_expected);
+			actuatorDesiredAxis[YAW] = bound_sym(actuatorDesiredAxis[YAW],1.0f);
+
+			// Reset coordinated-flight integral
+			pids[PID_COORDINATED_FLIGHT_YAW].iAccumulator = 0;
+		}
+	} else { //... yaw is outside the deadband. Pass the manual input directly to the actuator.
+		actuatorDesiredAxis[YAW] = bound_sym(ctx->raw_input[YAW], 1.0);
+
+		// Reset all integrals
+		pids[PID_COORDINATED_FLIGHT_YAW].iAccumulator = 0;
+		pids[PID_RATE_YAW].iAccumulator = 0;
+		axis_lock_accum[YAW] = 0;
+	}
+}
+
+static void stage_manual(struct axis_pipeline *p, struct stab_context *ctx, uint8_t axis)
+{
+	ctx->actuator_axis[axis] = bound_sym(ctx->raw_input[axis],1.0f);
+}
+
+static void stage_disabled(struct axis_pipeline *p, struct stab_context *ctx, uint8_t axis)
+{
+	ctx->actuator_axis[axis] = 0.0;
+}
+
+//! For modes this axis can't be in
+static void stage_config_error(struct axis_pipeline *p, struct stab_context *ctx, uint8_t axis)
+{
+	ctx->error = true;
+}
+
+static void pipeline_add(struct axis_pipeline *p, stab_stage stage)
+{
+	PIOS_Assert(p->num_stages < MAX_STAGES);
+
+	p->stages[p->num_stages++] = stage;
+}
+
+/**
+ * Chooses the stages that implement a mode's control law for an axis.
+ * @param[in] reinit true when the axis has just entered the mode, to
+ * reset the state it carries; false to only pick up new settings
+ */
+static void build_pipeline(uint8_t axis, uint8_t mode, bool reinit)
+{
+	struct axis_pipeline *p = &pipelines[axis];
+
+	p->num_stages = 0;
+	p->outer = &pids[PID_GROUP_ATT + axis];
+	p->inner = &pids[PID_GROUP_RATE + axis];
+	p->deadband = get_deadband(axis);
+	p->rate_limit = settings.MaximumRate[axis];
+	p->reinit = reinit;
+
+	bool zero_outer = false;
+	bool zero_inner = true;
+
+	switch (mode) {
+		case STABILIZATIONDESIRED_STABILIZATIONMODE_FAILSAFE:
+			PIOS_Assert(0); /* Shouldn't happen, per failsafe checks */
+			break;
+
+		case STABILIZATIONDESIRED_STABILIZATIONMODE_RATE:
+			p->rate_limit = settings.ManualRate[axis];
+			pipeline_add(p, stage_stick_rate);
+			pipeline_add(p, stage_rate_loop);
+			break;
+
+		case STABILIZATIONDESIRED_STABILIZATIONMODE_ACRODYNE:
+		{
+			uint16_t max_safe_rate = PIOS_SENSORS_GetMaxGyro() * 0.9f;
+
+			p->dyn_rate = settings.AcroDynamicRate[axis];
+
+			if (!p->dyn_rate) {
+				p->dyn_rate = settings.ManualRate[axis] + settings.ManualRate[axis] / 2;
+			}
+
+			if (p->dyn_rate > max_safe_rate) {
+				p->dyn_rate = max_safe_rate;
+			}
+
+			p->break_point = settings.AcroDynamicTransition[axis]/100.0f;
+
+			if (reinit) {
+				max_rate_filtered[axis] = settings.ManualRate[axis];
+			}
+
+			pipeline_add(p, stage_acro_dynamic);
+			pipeline_add(p, stage_rate_loop_measured);
+			break;
+		}
+
+		case STABILIZATIONDESIRED_STABILIZATIONMODE_ACROPLUS:
+			p->rate_limit = settings.ManualRate[axis];
+			pipeline_add(p, stage_acro_plus);
+			pipeline_add(p, stage_rate_loop_unbounded);
+			pipeline_add(p, stage_acro_plus_mix);
+			break;
+
+		case STABILIZATIONDESIRED_STABILIZATIONMODE_ATTITUDE:
+			zero_outer = true;
+			pipeline_add(p, stage_attitude);
+			pipeline_add(p, stage_rate_loop);
+			break;
+
+		case STABILIZATIONDESIRED_STABILIZATIONMODE_VIRTUALBAR:
+			p->outer = &pids[PID_GROUP_VBAR + axis];
+			zero_inner = false;
+			pipeline_add(p, stage_virtual_flybar);
+			break;
+
+		case STABILIZATIONDESIRED_STABILIZATIONMODE_WEAKLEVELING:
+			pipeline_add(p, stage_weak_leveling);
+			pipeline_add(p, stage_rate_loop);
+			break;
+
+		case STABILIZATIONDESIRED_STABILIZATIONMODE_AXISLOCK:
+			pipeline_add(p, stage_axis_lock);
+			pipeline_add(p, stage_rate_loop);
+			break;
+
+		case STABILIZATIONDESIRED_STABILIZATIONMODE_HORIZON:
+			p->rate_limit = settings.ManualRate[axis];
+			pipeline_add(p, stage_horizon);
+			pipeline_add(p, stage_rate_loop);
+			break;
+
+		case STABILIZATIONDESIRED_STABILIZATIONMODE_SYSTEMIDENT:
+			zero_outer = true;
+			pipeline_add(p, stage_attitude);
+			pipeline_add(p, stage_rate_loop_unbounded);
+			pipeline_add(p, stage_system_ident);
+			break;
+
+		case STABILIZATIONDESIRED_STABILIZATIONMODE_SYSTEMIDENTRATE:
+			// yaw is always in rate mode in system ident.
+			zero_outer = true;
+			p->rate_limit = settings.ManualRate[axis];
+			pipeline_add(p, stage_stick_rate);
+			pipeline_add(p, stage_rate_loop_unbounded);
+			pipeline_add(p, stage_system_ident);
+			break;
+
+		case STABILIZATIONDESIRED_STABILIZATIONMODE_COORDINATEDFLIGHT:
+			zero_inner = false;
+
+			if (axis != YAW) {
+				//Coordinated Flight has no effect in these modes. Trigger a configuration error.
+				pipeline_add(p, stage_config_error);
+				break;
+			}
+
+			if (reinit) {
+				pids[PID_COORDINATED_FLIGHT_YAW].iAccumulator = 0;
+				pids[PID_RATE_YAW].iAccumulator = 0;
+				axis_lock_accum[YAW] = 0;
+			}
+
+			pipeline_add(p, stage_coordinated_flight);
+			break;
+
+		case STABILIZATIONDESIRED_STABILIZATIONMODE_POI:
+			// The sanity check enforces this is only selectable for Yaw
+			// for a gimbal you can select pitch too.
+			zero_outer = true;
+			p->rate_limit = settings.PoiMaximumRate[axis];
+			pipeline_add(p, stage_poi);
+			pipeline_add(p, stage_rate_loop);
+			break;
+
+		case STABILIZATIONDESIRED_STABILIZATIONMODE_DISABLED:
+			zero_inner = false;
+			pipeline_add(p, stage_disabled);
+			break;
+
+		case STABILIZATIONDESIRED_STABILIZATIONMODE_MANUAL:
+			zero_inner = false;
+			pipeline_add(p, stage_manual);
+			break;
+
+		default:
+			zero_inner = false;
+			pipeline_add(p, stage_config_error);
+			break;
+	}
+
+	if (reinit) {
+		if (zero_outer) {
+			p->outer->iAccumulator = 0;
+		}
+
+		if (zero_inner) {
+			p->inner->iAccumulator = 0;
+		}
+
+		if ((axis == 0) &&
+				((mode == STABILIZATIONDESIRED_STABILIZATIONMODE_SYSTEMIDENT) ||
+				 (mode == STABILIZATIONDESIRED_STABILIZATIONMODE_SYSTEMIDENTRATE))) {
+			ident.enter_time = PIOS_DELAY_GetRaw();
+			ident.measuring = false;
+		}
+	}
+}
+
+/**
+ * Runs an axis' control law.
+ */
+static void run_pipeline(uint8_t axis, struct stab_context *ctx)
+{
+	struct axis_pipeline *p = &pipelines[axis];
+
+	for (int i = 0; i < p->num_stages; i++) {
+		p->stages[i](p, ctx, axis);
+	}
+
+	p->reinit = false;
+}
+
 /**
  * Module task
  */
@@ -310,8 +919,6 @@ static void stabilizationTask(void* parameters)
 	uint32_t iteration = 0;
 	float dT_measured = 0;
 
-	uint8_t ident_shift = 5;
-
 	float dT_expected = 0.001;	// assume 1KHz if we don't know.
 
 	uint16_t samp_rate = PIOS_SENSORS_GetSampleRate(PIOS_SENSOR_GYRO);
@@ -343,10 +950,22 @@ static void stabilizationTask(void* parameters)
 	}
 
 	ident_wiggle_points = (1 << (ident_shift + 3));
-	uint32_t ident_mask = ident_wiggle_points - 1;
+	ident_mask = ident_wiggle_points - 1;
 
 	zero_pids();
 
+#if defined(LOOPTIMING_DIAGNOSTICS)
+	struct loop_timing timing;
+
+	loop_timing_init(&timing, dT_expected * 1e6f);
+#endif
+
+	// Lets the simulator resume a flight with the loops where they were
+	PIOS_SNAPSHOT_VAR("stabilization", pids);
+	PIOS_SNAPSHOT_VAR("stabilization", axis_lock_accum);
+	PIOS_SNAPSHOT_VAR("stabilization", max_rate_filtered);
+	PIOS_SNAPSHOT_VAR("stabilization", previous_mode);
+
 	// Main task loop
 	while(1) {
 		iteration++;
@@ -369,6 +988,13 @@ static void stabilizationTask(void* parameters)
 				vbar_decay = expf(-dT_expected / vbar_settings.VbarTau);
 			}
 
+			// Pick up the new settings in the laws already running
+			for (uint8_t i = 0; i < MAX_AXES; i++) {
+				if (previous_mode[i] != 255) {
+					build_pipeline(i, previous_mode[i], false);
+				}
+			}
+
 			settings_flag = false;
 		}
 
@@ -379,6 +1005,10 @@ static void stabilizationTask(void* parameters)
 			continue;
 		}
 
+#if defined(LOOPTIMING_DIAGNOSTICS)
+		loop_timing_begin(&timing);
+#endif
+
 		static bool frequency_wrong = false;
 
 		float dT = PIOS_DELAY_DiffuS(timeval) * 1.0e-6f;
@@ -538,18 +1168,26 @@ static void stabilizationTask(void* parameters)
 
 		float *gyro_filtered = &gyrosData.x;
 
-		/* Maintain a second-order, lower cutof freq variant for
-		 * dynamic flight modes.
-		 */
-
-		static float max_rate_filtered[MAX_AXES];
-
-		// A flag to track which stabilization mode each axis is in
-		static uint8_t previous_mode[MAX_AXES] = {255,255,255};
-
 		actuatorDesired.SystemIdentCycle = 0xffff;
 
-		uint16_t max_safe_rate = PIOS_SENSORS_GetMaxGyro() * 0.9f;
+		struct stab_context ctx = {
+			.axis_mode = axis_mode,
+			.raw_input = raw_input,
+			.attitude_error = local_attitude_error,
+			.gyro = gyro_filtered,
+			.stab_desired = &stabDesired,
+			.attitude = &attitudeActual,
+			.horizon_rate_fraction = horizonRateFraction,
+			.dT = dT,
+			.dT_expected = dT_expected,
+			.iteration = iteration,
+			.timeval = timeval,
+			.armed = flightStatus.Armed == FLIGHTSTATUS_ARMED_ARMED,
+			.actuator = &actuatorDesired,
+			.actuator_axis = actuatorDesiredAxis,
+			.rate_axis = rateDesiredAxis,
+			.error = error,
+		};
 
 		//Run the selected stabilization algorithm on each axis:
 		for(uint8_t i=0; i< MAX_AXES; i++)
@@ -557,441 +1195,23 @@ static void stabilizationTask(void* parameters)
 			// Check whether this axis mode needs to be reinitialized
 			bool reinit = (axis_mode[i] != previous_mode[i]);
 
-			if(reinit && previous_mode[i] != 255) {
-				// Disable the integrator this round. And only do so on real mode switches.
-				smoothcontrol_reinit(rc_smoothing, i, raw_input[i]);
+			if (reinit) {
+				if (previous_mode[i] != 255) {
+					// Disable the integrator this round. And only do so on real mode switches.
+					smoothcontrol_reinit(rc_smoothing, i, raw_input[i]);
+				}
+
+				build_pipeline(i, axis_mode[i], true);
 			}
 
 			previous_mode[i] = axis_mode[i];
 
 			// Apply the selected control law
-			switch(axis_mode[i])
-			{
-				case STABILIZATIONDESIRED_STABILIZATIONMODE_FAILSAFE:
-					PIOS_Assert(0); /* Shouldn't happen, per above */
-					break;
-
-				case STABILIZATIONDESIRED_STABILIZATIONMODE_RATE:
-					if(reinit) {
-						pids[PID_GROUP_RATE + i].iAccumulator = 0;
-					}
-
-					// Store to rate desired variable for storing to UAVO
-					rateDesiredAxis[i] = bound_sym(raw_input[i], settings.ManualRate[i]);
-
-					// Compute the inner loop
-					actuatorDesiredAxis[i] = pid_apply_setpoint(&pids[PID_GROUP_RATE + i], get_deadband(i),  rateDesiredAxis[i],  gyro_filtered[i], dT_expected);
-					actuatorDesiredAxis[i] = bound_sym(actuatorDesiredAxis[i],1.0f);
-
-					break;
-
-				case STABILIZATIONDESIRED_STABILIZATIONMODE_ACRODYNE:
-					if(reinit) {
-						pids[PID_GROUP_RATE + i].iAccumulator = 0;
-						max_rate_filtered[i] = settings.ManualRate[i];
-					}
-
-					float curve_cmd = expoM(raw_input[i],
-							settings.RateExpo[i],
-							settings.RateExponent[i]*0.1f);
-
-					const float break_point = settings.AcroDynamicTransition[i]/100.0f;
-
-					uint16_t calc_max_rate = settings.ManualRate[i];
-
-					float abs_cmd = fabsf(raw_input[i]);
-
-					uint16_t acro_dynrate = settings.AcroDynamicRate[i];
-
-					if (!acro_dynrate) {
-						acro_dynrate = settings.ManualRate[i] + settings.ManualRate[i] / 2;
-					}
-
-					if (acro_dynrate > max_safe_rate) {
-						acro_dynrate = max_safe_rate;
-					}
-
-					// Could precompute much of this...
-					if (abs_cmd > break_point) {
-						calc_max_rate = (settings.ManualRate[i] * (abs_cmd - 1.0f) * (2 * break_point - abs_cmd - 1.0f) + acro_dynrate * powf(break_point - abs_cmd, 2.0f)) / powf(break_point - 1.0f, 2.0f);
-					}
-
-					calc_max_rate = MIN(calc_max_rate,
-							acro_dynrate);
-
-					max_rate_filtered[i] = max_rate_filtered[i] * max_rate_alpha + calc_max_rate * (1 - max_rate_alpha);
-
-					// Store to rate desired variable for storing to UAVO
-					rateDesiredAxis[i] = bound_sym(curve_cmd * max_rate_filtered[i], max_rate_filtered[i]);
-
-					// Compute the inner loop
-					actuatorDesiredAxis[i] = pid_apply_setpoint(&pids[PID_GROUP_RATE + i], get_deadband(i), rateDesiredAxis[i], gyro_filtered[i], dT);
-					actuatorDesiredAxis[i] = bound_sym(actuatorDesiredAxis[i], 1.0f);
-
-					break;
-
-				case STABILIZATIONDESIRED_STABILIZATIONMODE_ACROPLUS:
-					// this implementation is based on the Openpilot/Librepilot Acro+ flightmode
-					// and our previous MWRate flightmodes
-					if(reinit) {
-						pids[PID_GROUP_RATE + i].iAccumulator = 0;
-					}
-
-					// The factor for gyro suppression / mixing raw stick input into the output; scaled by raw stick input
-					float factor = fabsf(raw_input[i]) * settings.AcroInsanityFactor / 100.0f;
-
-					// Store to rate desired variable for storing to UAVO
-					rateDesiredAxis[i] = bound_sym(raw_input[i] * settings.ManualRate[i], settings.ManualRate[i]);
-
-					// Zero integral for aggressive maneuvers
-					if ((i < 2 && fabsf(gyro_filtered[i]) > settings.AcroZeroIntegralGyro) ||
-						(i == 0 && fabsf(raw_input[i]) > settings.AcroZeroIntegralStick / 100.0f)) {
-							pids[PID_GROUP_RATE + i].iAccumulator = 0;
-							}
-
-					// Compute the inner loop
-					actuatorDesiredAxis[i] = pid_apply_setpoint(&pids[PID_GROUP_RATE + i], get_deadband(i), rateDesiredAxis[i], gyro_filtered[i], dT_expected);
-					actuatorDesiredAxis[i] = factor * raw_input[i] + (1.0f - factor) * actuatorDesiredAxis[i];
-					actuatorDesiredAxis[i] = bound_sym(actuatorDesiredAxis[i], 1.0f);
-
-					break;
-
-				case STABILIZATIONDESIRED_STABILIZATIONMODE_ATTITUDE:
-					if(reinit) {
-						pids[PID_GROUP_ATT + i].iAccumulator = 0;
-						pids[PID_GROUP_RATE + i].iAccumulator = 0;
-					}
-
-					// Compute the outer loop
-					rateDesiredAxis[i] = pid_apply(&pids[PID_GROUP_ATT + i], local_attitude_error[i], dT_expected);
-					rateDesiredAxis[i] = bound_sym(rateDesiredAxis[i], settings.MaximumRate[i]);
-
-					// Compute the inner loop
-					actuatorDesiredAxis[i] = pid_apply_setpoint(&pids[PID_GROUP_RATE + i], get_deadband(i),  rateDesiredAxis[i],  gyro_filtered[i], dT_expected);
-					actuatorDesiredAxis[i] = bound_sym(actuatorDesiredAxis[i],1.0f);
-
-					break;
-
-				case STABILIZATIONDESIRED_STABILIZATIONMODE_VIRTUALBAR:
-					// Store for debugging output
-					rateDesiredAxis[i] = raw_input[i];
-
-					// Run a virtual flybar stabilization algorithm on this axis
-					stabilization_virtual_flybar(gyro_filtered[i], rateDesiredAxis[i], &actuatorDesiredAxis[i], dT_expected, reinit, i, &pids[PID_GROUP_VBAR + i], &vbar_settings);
-
-					break;
-
-				case STABILIZATIONDESIRED_STABILIZATIONMODE_WEAKLEVELING:
-				{
-					if (reinit) {
-						pids[PID_GROUP_RATE + i].iAccumulator = 0;
-					}
-
-					float weak_leveling = local_attitude_error[i] * weak_leveling_kp;
-					weak_leveling = bound_sym(weak_leveling, weak_leveling_max);
-
-					// Compute desired rate as input biased towards leveling
-					rateDesiredAxis[i] = raw_input[i] + weak_leveling;
-					actuatorDesiredAxis[i] = pid_apply_setpoint(&pids[PID_GROUP_RATE + i], get_deadband(i),  rateDesiredAxis[i],  gyro_filtered[i], dT_expected);
-					actuatorDesiredAxis[i] = bound_sym(actuatorDesiredAxis[i],1.0f);
-
-					break;
-				}
-				case STABILIZATIONDESIRED_STABILIZATIONMODE_AXISLOCK:
-					if (reinit) {
-						pids[PID_GROUP_RATE + i].iAccumulator = 0;
-					}
-
-					if (fabsf(raw_input[i]) > max_axislock_rate) {
-						// While getting strong commands act like rate mode
-						rateDesiredAxis[i] = bound_sym(raw_input[i], settings.ManualRate[i]);
-
-						// Reset accumulator
-						axis_lock_accum[i] = 0;
-					} else {
-						// For weaker commands or no command simply lock (almost) on no gyro change
-						axis_lock_accum[i] += (raw_input[i] - gyro_filtered[i]) * dT_expected;
-						axis_lock_accum[i] = bound_sym(axis_lock_accum[i], max_axis_lock);
-
-						// Compute the inner loop
-						float tmpRateDesired = pid_apply(&pids[PID_GROUP_ATT + i], axis_lock_accum[i], dT_expected);
-						rateDesiredAxis[i] = bound_sym(tmpRateDesired, settings.MaximumRate[i]);
-					}
-
-					actuatorDesiredAxis[i] = pid_apply_setpoint(&pids[PID_GROUP_RATE + i], get_deadband(i),  rateDesiredAxis[i],  gyro_filtered[i], dT_expected);
-					actuatorDesiredAxis[i] = bound_sym(actuatorDesiredAxis[i],1.0f);
-
-					break;
-
-				case STABILIZATIONDESIRED_STABILIZATIONMODE_HORIZON:
-					if(reinit) {
-						pids[PID_GROUP_RATE + i].iAccumulator = 0;
-					}
-
-					// Do not allow outer loop integral to wind up in this mode since the controller
-					// is often disengaged.
-					pids[PID_GROUP_ATT + i].iAccumulator = 0;
-
-					// Compute the outer loop for the attitude control
-					float rateDesiredAttitude = pid_apply(&pids[PID_GROUP_ATT + i], local_attitude_error[i], dT_expected);
-					// Compute the desire rate for a rate control
-					float rateDesiredRate = raw_input[i] * settings.ManualRate[i];
-
-					// Blend from one rate to another. The maximum of all stick positions is used for the
-					// amount so that when one axis goes completely to rate the other one does too. This
-					// prevents doing flips while one axis tries to stay in attitude mode.
-					rateDesiredAxis[i] = rateDesiredAttitude * (1.0f-horizonRateFraction) + rateDesiredRate * horizonRateFraction;
-					rateDesiredAxis[i] = bound_sym(rateDesiredAxis[i], settings.ManualRate[i]);
-
-					// Compute the inner loop
-					actuatorDesiredAxis[i] = pid_apply_setpoint(&pids[PID_GROUP_RATE + i], get_deadband(i),  rateDesiredAxis[i],  gyro_filtered[i], dT_expected);
-					actuatorDesiredAxis[i] = bound_sym(actuatorDesiredAxis[i],1.0f);
-
-					break;
-				case STABILIZATIONDESIRED_STABILIZATIONMODE_SYSTEMIDENT:
-				case STABILIZATIONDESIRED_STABILIZATIONMODE_SYSTEMIDENTRATE:
-					;
-					static bool measuring;
-					static uint32_t enter_time;
-
-					static uint32_t measure_remaining;
-
-					// Takes 1250ms + the time to reach
-					// the '0th measurement'
-					// (could be the ~600ms period time)
-					const uint32_t PREPARE_TIME = 1250000;
-
-					if (reinit) {
-						pids[PID_GROUP_ATT + i].iAccumulator = 0;
-						pids[PID_GROUP_RATE + i].iAccumulator = 0;
-
-						if (i == 0) {
-							enter_time = timeval;
-
-							measuring = false;
-						}
-					}
-
-					if ((i == 0) &&
-							(!measuring) &&
-							((timeval - enter_time) > PREPARE_TIME)) {
-						if (!(iteration & ident_mask)) {
-							measuring = true;
-							measure_remaining = 60 / dT_expected;
-							// Round down to an integer
-							// number of ident cycles.
-							measure_remaining &= ~ident_mask;
-						}
-					}
-
-					if (flightStatus.Armed != FLIGHTSTATUS_ARMED_ARMED) {
-						measuring = false;
-					}
-
-					if (axis_mode[i] == STABILIZATIONDESIRED_STABILIZATIONMODE_SYSTEMIDENT) {
-						// Compute the outer loop
-						rateDesiredAxis[i] = pid_apply(&pids[PID_GROUP_ATT + i], local_attitude_error[i], dT_expected);
-						rateDesiredAxis[i] = bound_sym(rateDesiredAxis[i], settings.MaximumRate[i]);
-
-						// Compute the inner loop
-						actuatorDesiredAxis[i] = pid_apply_setpoint(&pids[PID_GROUP_RATE + i], get_deadband(i), rateDesiredAxis[i],  gyro_filtered[i], dT_expected);
-					} else {
-						// Get the desired rate. yaw is always in rate mode in system ident.
-						rateDesiredAxis[i] = bound_sym(raw_input[i], settings.ManualRate[i]);
-
-						// Compute the inner loop only for yaw
-						actuatorDesiredAxis[i] = pid_apply_setpoint(&pids[PID_GROUP_RATE + i], get_deadband(i), rateDesiredAxis[i],  gyro_filtered[i], dT_expected);
-					}
-
-					const float scale = settings.AutotuneActuationEffort[i];
-
-					uint32_t ident_iteration =
-						iteration >> ident_shift;
-
-					if (measuring && measure_remaining) {
-						if (i == 2) {
-							// Only adjust the
-							// counter on one axis
-							measure_remaining--;
-						}
-
-						actuatorDesired.SystemIdentCycle = (iteration & ident_mask);
-
-						switch (ident_iteration & 0x07) {
-							case 0:
-								if (i == 2) {
-									actuatorDesiredAxis[i] += scale;
-								}
-								break;
-							case 1:
-								if (i == 0) {
-									actuatorDesiredAxis[i] += scale;
-								}
-								break;
-							case 2:
-								if (i == 2) {
-									actuatorDesiredAxis[i] -= scale;
-								}
-								break;
-							case 3:
-								if (i == 0) {
-									actuatorDesiredAxis[i] -= scale;
-								}
-								break;
-							case 4:
-								if (i == 2) {
-									actuatorDesiredAxis[i] += scale;
-								}
-								break;
-							case 5:
-								if (i == 1) {
-									actuatorDesiredAxis[i] += scale;
-								}
-								break;
-							case 6:
-								if (i == 2) {
-									actuatorDesiredAxis[i] -= scale;
-								}
-								break;
-							case 7:
-								if (i == 1) {
-									actuatorDesiredAxis[i] -= scale;
-								}
-								break;
-						}
-
-						actuatorDesiredAxis[i] = bound_sym(actuatorDesiredAxis[i],1.0f);
-					}
-
-					break;
-
-				case STABILIZATIONDESIRED_STABILIZATIONMODE_COORDINATEDFLIGHT:
-					switch (i) {
-						case YAW:
-							if (reinit) {
-								pids[PID_COORDINATED_FLIGHT_YAW].iAccumulator = 0;
-								pids[PID_RATE_YAW].iAccumulator = 0;
-								axis_lock_accum[YAW] = 0;
-							}
-
-							//If we are not in roll attitude mode, trigger an error
-							if (axis_mode[ROLL] != STABILIZATIONDESIRED_STABILIZATIONMODE_ATTITUDE)
-							{
-								error = true;
-								break ;
-							}
-
-							if (fabsf(stabDesired.Yaw) < COORDINATED_FLIGHT_MAX_YAW_THRESHOLD) { //If yaw is within the deadband...
-								if (fabsf(stabDesired.Roll) > COORDINATED_FLIGHT_MIN_ROLL_THRESHOLD) { // We're requesting more roll than the threshold
-									float accelsDataY;
-									AccelsyGet(&accelsDataY);
-
-									//Reset integral if we have changed roll to opposite direction from rudder. This implies that we have changed desired turning direction.
-									if ((stabDesired.Roll > 0 && actuatorDesiredAxis[YAW] < 0) ||
-											(stabDesired.Roll < 0 && actuatorDesiredAxis[YAW] > 0)){
-										pids[PID_COORDINATED_FLIGHT_YAW].iAccumulator = 0;
-									}
-
-									// Coordinate flight can simply be seen as ensuring that there is no lateral acceleration in the
-									// body frame. As such, we use the (noisy) accelerometer data as our measurement. Ideally, at
-									// some point in the future we will estimate acceleration and then we can use the estimated value
-									// instead of the measured value.
-									float errorSlip = -accelsDataY;
-
-									float command = pid_apply(&pids[PID_COORDINATED_FLIGHT_YAW], errorSlip, dT_expected);
-									actuatorDesiredAxis[YAW] = bound_sym(command ,1.0);
-
-									// Reset axis-lock integrals
-									pids[PID_RATE_YAW].iAccumulator = 0;
-									axis_lock_accum[YAW] = 0;
-								} else if (fabsf(stabDesired.Roll) <= COORDINATED_FLIGHT_MIN_ROLL_THRESHOLD) { // We're requesting less roll than the threshold
-									// Axis lock on no gyro change
-									axis_lock_accum[YAW] += (0 - gyro_filtered[YAW]) * dT_expected;
-
-									rateDesiredAxis[YAW] = pid_apply(&pids[PID_ATT_YAW], axis_lock_accum[YAW], dT_expected);
-									rateDesiredAxis[YAW] = bound_sym(rateDesiredAxis[YAW], settings.MaximumRate[YAW]);
-
-									actuatorDesiredAxis[YAW] = pid_apply_setpoint(&pids[PID_RATE_YAW], NULL, rateDesiredAxis[YAW], gyro_filtered[YAW], dT_expected);
-									actuatorDesiredAxis[YAW] = bound_sym(actuatorDesiredAxis[YAW],1.0f);
-
-									// Reset coordinated-flight integral
-									pids[PID_COORDINATED_FLIGHT_YAW].iAccumulator = 0;
-								}
-							} else { //... yaw is outside the deadband. Pass the manual input directly to the actuator.
-								actuatorDesiredAxis[YAW] = bound_sym(raw_input[YAW], 1.0);
-
-								// Reset all integrals
-								pids[PID_COORDINATED_FLIGHT_YAW].iAccumulator = 0;
-								pids[PID_RATE_YAW].iAccumulator = 0;
-								axis_lock_accum[YAW] = 0;
-							}
-							break;
-						case ROLL:
-						case PITCH:
-						default:
-							//Coordinated Flight has no effect in these modes. Trigger a configuration error.
-							error = true;
-							break;
-					}
-
-					break;
-
-				case STABILIZATIONDESIRED_STABILIZATIONMODE_POI:
-					// The sanity check enforces this is only selectable for Yaw
-					// for a gimbal you can select pitch too.
-					if(reinit) {
-						pids[PID_GROUP_ATT + i].iAccumulator = 0;
-						pids[PID_GROUP_RATE + i].iAccumulator = 0;
-					}
-
-					float angle_error = 0;
-					float angle;
-					if (CameraDesiredHandle()) {
-						switch(i) {
-						case PITCH:
-							CameraDesiredDeclinationGet(&angle);
-							angle_error = circular_modulus_deg(angle - attitudeActual.Pitch);
-							break;
-						case ROLL:
-						{
-							uint8_t roll_fraction = 0;
-
-							// For ROLL POI mode we track the FC roll angle (scaled) to
-							// allow keeping some motion
-							CameraDesiredRollGet(&angle);
-							angle *= roll_fraction / 100.0f;
-							angle_error = circular_modulus_deg(angle - attitudeActual.Roll);
-						}
-							break;
-						case YAW:
-							CameraDesiredBearingGet(&angle);
-							angle_error = circular_modulus_deg(angle - attitudeActual.Yaw);
-							break;
-						}
-					} else
-						error = true;
-
-					// Compute the outer loop
-					rateDesiredAxis[i] = pid_apply(&pids[PID_GROUP_ATT + i], angle_error, dT_expected);
-					rateDesiredAxis[i] = bound_sym(rateDesiredAxis[i], settings.PoiMaximumRate[i]);
-
-					// Compute the inner loop
-					actuatorDesiredAxis[i] = pid_apply_setpoint(&pids[PID_GROUP_RATE + i], get_deadband(i), rateDesiredAxis[i], gyro_filtered[i], dT_expected);
-					actuatorDesiredAxis[i] = bound_sym(actuatorDesiredAxis[i],1.0f);
-
-					break;
-				case STABILIZATIONDESIRED_STABILIZATIONMODE_DISABLED:
-					actuatorDesiredAxis[i] = 0.0;
-					break;
-				case STABILIZATIONDESIRED_STABILIZATIONMODE_MANUAL:
-					actuatorDesiredAxis[i] = bound_sym(raw_input[i],1.0f);
-					break;
-				default:
-					error = true;
-					break;
-			}
+			run_pipeline(i, &ctx);
 		}
 
+		error = ctx.error;
+
 		// Run the smoothing over the throttle stick.
 		smoothcontrol_run_thrust(rc_smoothing, &actuatorDesired.Thrust);
 
@@ -1010,6 +1230,25 @@ static void stabilizationTask(void* parameters)
 
 		ActuatorDesiredSet(&actuatorDesired);
 
+		PIOS_TRACE_MARK(PIOS_TRACE_MARKER_STABILIZATION);
+
+#if defined(LOOPTIMING_DIAGNOSTICS)
+		loop_timing_end(&timing);
+
+		// Every ident cycle, which is about half a second
+		if ((iteration & ident_mask) == 0) {
+			LoopTimingStabilizationJitterSet(timing.jitter.counts);
+			LoopTimingStabilizationExecutionSet(timing.execution.counts);
+
+			uint16_t max[LOOPTIMING_STABILIZATIONMAX_NUMELEM] = {
+				[LOOPTIMING_STABILIZATIONMAX_JITTER] = timing.jitter.max,
+				[LOOPTIMING_STABILIZATIONMAX_EXECUTION] = timing.execution.max,
+			};
+
+			LoopTimingStabilizationMaxSet(max);
+		}
+#endif
+
 		if(flightStatus.Armed != FLIGHTSTATUS_ARMED_ARMED ||
 		   (lowThrottleZeroIntegral && get_throttle(&stabDesired, &airframe_type) < 0))
 		{
@@ -45,6 +45,7 @@
 
 #include "annunciatorsettings.h"
 #include "flightstatus.h"
+#include "heapstatus.h"
 #include "manualcontrolsettings.h"
 #include "objectpersistence.h"
 #include "rfm22bstatus.h"
@@ -54,6 +55,11 @@
 #include "systemstats.h"
 #include "watchdogstatus.h"
 
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+#include "eventexecutor.h"
+#include "eventexecutorstatus.h"
+#endif
+
 #ifdef SYSTEMMOD_RGBLED_SUPPORT
 #include "rgbledsettings.h"
 #include "rgbleds.h"
@@ -83,6 +89,16 @@ extern annuncdac_dev_t pios_dac_annunciator_id;
 #define STACK_SIZE_BYTES 1024
 #endif
 
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+// Executor jobs run on this task's stack, from processPeriodicUpdates()
+#define TASK_STACK_BYTES (STACK_SIZE_BYTES + PIOS_EVENTEXECUTOR_STACK_HEADROOM)
+// Least stack the task may have had left, with the jobs' runs included
+#define TASK_STACK_LIMIT_WARNING 128
+#define TASK_STACK_LIMIT_CRITICAL 64
+#else
+#define TASK_STACK_BYTES STACK_SIZE_BYTES
+#endif
+
 #define TASK_PRIORITY PIOS_THREAD_PRIO_NORMAL
 
 /* When we're blinking morse code, this works out to 10.6 WPM.  It's also
@@ -151,6 +167,10 @@ static void configurationUpdatedCb(UAVObjEvent * ev, void *ctx, void *obj, int l
 
 static void systemTask(void *parameters);
 static inline void updateStats();
+static void updateHeapStatus();
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+static void updateEventExecutorStatus();
+#endif
 static inline void updateSystemAlarms();
 static inline void updateRfm22bStats();
 #if defined(WDG_STATS_DIAGNOSTICS)
@@ -171,7 +191,7 @@ int32_t SystemModStart(void)
 	EventClearStats();
 
 	// Create system task
-	systemTaskHandle = PIOS_Thread_Create(systemTask, "System", STACK_SIZE_BYTES, NULL, TASK_PRIORITY);
+	systemTaskHandle = PIOS_Thread_Create(systemTask, "System", TASK_STACK_BYTES, NULL, TASK_PRIORITY);
 	// Register task
 	TaskMonitorAdd(TASKINFO_RUNNING_SYSTEM, systemTaskHandle);
 
@@ -191,6 +211,10 @@ int32_t SystemModInitialize(void)
 
 	if (SystemSettingsInitialize() == -1
 			|| SystemStatsInitialize() == -1
+			|| HeapStatusInitialize() == -1
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+			|| EventExecutorStatusInitialize() == -1
+#endif
 			|| FlightStatusInitialize() == -1
 			|| ObjectPersistenceInitialize() == -1
 			|| AnnunciatorSettingsInitialize() == -1
@@ -403,6 +427,9 @@ static void systemPeriodicCb(UAVObjEvent *ev, void *ctx, void *obj_data, int len
 
 	counter++;
 
+	// Publish any alarm changes held back by AlarmsSet
+	AlarmsFlush();
+
 #ifndef NO_SENSORS
 	if (config_check_needed) {
 		configuration_check();
@@ -423,6 +450,10 @@ static void systemPeriodicCb(UAVObjEvent *ev, void *ctx, void *obj_data, int len
 #ifndef PIPXTREME
 		// Update the system statistics
 		updateStats();
+		updateHeapStatus();
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+		updateEventExecutorStatus();
+#endif
 
 		// Update the system alarms
 		updateSystemAlarms();
@@ -728,6 +759,71 @@ static void updateRfm22bStats() {
 #endif /* if defined(PIOS_INCLUDE_RFM22B) */
 }
 
+DONT_BUILD_IF(PIOS_HEAP_TAG_NUM != HEAPSTATUS_INUSE_NUMELEM, HeapTagMismatch);
+
+static uint8_t heapFragmentation(size_t free_bytes, size_t largest)
+{
+	if (free_bytes == 0)
+		return 0;
+
+	return 100 - (100 * largest) / free_bytes;
+}
+
+/**
+ * Called periodically to update the per-caller heap usage
+ */
+static void updateHeapStatus()
+{
+	HeapStatusData heap;
+
+	for (int i = 0; i < PIOS_HEAP_TAG_NUM; i++) {
+		uint32_t bytes, blocks;
+
+		PIOS_heap_get_tag_usage(i, &bytes, &blocks);
+
+		heap.InUse[i] = bytes;
+		heap.Blocks[i] = MIN(blocks, UINT16_MAX);
+	}
+
+	size_t largest = PIOS_heap_get_largest_free();
+	heap.LargestFree[HEAPSTATUS_LARGESTFREE_HEAP] = largest;
+	heap.Fragmentation[HEAPSTATUS_FRAGMENTATION_HEAP] =
+		heapFragmentation(PIOS_heap_get_free_size(), largest);
+
+	largest = PIOS_fastheap_get_largest_free();
+	heap.LargestFree[HEAPSTATUS_LARGESTFREE_FASTHEAP] = largest;
+	heap.Fragmentation[HEAPSTATUS_FRAGMENTATION_FASTHEAP] =
+		heapFragmentation(PIOS_fastheap_get_free_size(), largest);
+
+	HeapStatusSet(&heap);
+}
+
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+/**
+ * Called periodically to update the executor's per-job statistics
+ */
+static void updateEventExecutorStatus()
+{
+	EventExecutorStatusData status = { 0 };
+
+	for (int i = 0; i < EVENTEXECUTORSTATUS_RUNS_NUMELEM; i++) {
+		struct event_executor_stats stats;
+
+		if (EventExecutorGetStats(i, &stats)) {
+			continue;
+		}
+
+		status.Runs[i] = stats.runs;
+		status.MaxLatency[i] = stats.max_latency_us;
+		status.MaxRunTime[i] = stats.max_run_us;
+	}
+
+	status.RAMSaved = EventExecutorGetRAMSaved();
+
+	EventExecutorStatusSet(&status);
+}
+#endif
+
 /**
  * Called periodically to update the system stats
  */
@@ -772,6 +868,8 @@ static void updateStats()
 	// Get Irq stack status
 	stats.IRQStackRemaining = GetFreeIrqStackSize();
 
+	stats.AlarmUpdatesSuppressed = AlarmsGetSuppressed();
+
 	// When idleCounterClear was not reset by the idle-task, it means the idle-task did not run
 	if (idleCounterClear) {
 		idleCounter = 0;
@@ -832,6 +930,19 @@ static void updateSystemAlarms()
 		AlarmsClear(SYSTEMALARMS_ALARM_OUTOFMEMORY);
 	}
 
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR) && !defined(ARCH_POSIX) && !defined(ARCH_WIN32)
+	// Executor jobs share this task's stack; catch one outgrowing the headroom
+	uint32_t stack_remaining = PIOS_Thread_Get_Stack_Usage(systemTaskHandle);
+
+	if (stack_remaining < TASK_STACK_LIMIT_CRITICAL) {
+		AlarmsSet(SYSTEMALARMS_ALARM_STACKOVERFLOW, SYSTEMALARMS_ALARM_CRITICAL);
+	} else if (stack_remaining < TASK_STACK_LIMIT_WARNING) {
+		AlarmsSet(SYSTEMALARMS_ALARM_STACKOVERFLOW, SYSTEMALARMS_ALARM_WARNING);
+	} else {
+		AlarmsClear(SYSTEMALARMS_ALARM_STACKOVERFLOW);
+	}
+#endif
+
 	// Check CPU load
 #ifdef SIM_POSIX
 	// XXX do something meaningful here in the future.
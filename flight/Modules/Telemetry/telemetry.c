@@ -419,7 +419,7 @@ static void addAckPending(telem_t telem, UAVObjHandle obj, uint16_t inst_id)
 /**
  * Callback for when we receive a request for data.  Converts a file
  * id to the actual unit of information, and returns/copies it.
- * Currently only operates on partitions.
+ * Operates on partitions, and the trace when built with one.
  *
  * \param[in] ctx Callback context (telemetry subsystem handle)
  * \param[in] file_id The requested file_id
@@ -467,6 +467,12 @@ static int32_t fileReqCallback(void *ctx, uint8_t *buf,
 		return len;
 	}
 
+#if defined(PIOS_INCLUDE_TRACE)
+	if (file_id == PIOS_TRACE_FILE_ID) {
+		return PIOS_Trace_Read(buf, offset, len);
+	}
+#endif
+
 	return -1;
 }
 
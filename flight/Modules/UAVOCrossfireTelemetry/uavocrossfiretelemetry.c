@@ -38,28 +38,43 @@
 #include "taskinfo.h"
 
 #include "uavocrossfiretelemetry.h"
+#include "telemetry_snapshot.h"
 
 #include "modulesettings.h"
-#include "flightbatterystate.h"
-#include "flightbatterysettings.h"
 #include "gpsposition.h"
-#include "attitudeactual.h"
 #include "manualcontrolsettings.h"
 
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+#include "eventexecutor.h"
+#include "eventexecutorstatus.h"
+#endif
+
 // Private constants
 #define STACK_SIZE_BYTES 600		// Reevaluate.
 #define TASK_PRIORITY				PIOS_THREAD_PRIO_LOW
 
+// Three frames, each at UPDATE_HZ
+#define FRAME_PERIOD_MS (1000 / (3 * UPDATE_HZ))
+#define STARTUP_DELAY_MS 1000
+
 #define DEG2RAD(x) ((float)x * (float)M_PI / 180.0f)
 
 // Private variables
+#if !defined(PIOS_INCLUDE_EVENTEXECUTOR)
 static struct pios_thread *uavoCrossfireTelemetryTaskHandle;
+#endif
 static bool module_enabled;
+static uint8_t frame_counter;
 
 // Crossfire receiver device
 static uintptr_t crsf_telem_dev_id;
 
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+static void uavoCrossfireTelemetryJob(const UAVObjEvent *ev, void *ctx);
+#else
 static void uavoCrossfireTelemetryTask(void *parameters);
+#endif
+static int uavoCrossfireTelemetryStep(void);
 
 /**
  * start the module
@@ -75,12 +90,23 @@ static int32_t uavoCrossfireTelemetryStart(void)
 	if(rcvr) {
 		crsf_telem_dev_id = PIOS_RCVR_GetLowerDevice(rcvr);
 		if (module_enabled && (PIOS_Crossfire_InitTelemetry(crsf_telem_dev_id) == 0)) {
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+			// Run from the event dispatcher rather than a task of our own
+			if (EventExecutorRegister(EVENTEXECUTORSTATUS_RUNS_CROSSFIRETELEMETRY,
+					uavoCrossfireTelemetryJob, NULL, STACK_SIZE_BYTES,
+					sizeof(frame_counter)) ||
+					EventExecutorSetPeriod(EVENTEXECUTORSTATUS_RUNS_CROSSFIRETELEMETRY,
+						FRAME_PERIOD_MS)) {
+				return -1;
+			}
+#else
 			// Start task
 			uavoCrossfireTelemetryTaskHandle = PIOS_Thread_Create(
 					uavoCrossfireTelemetryTask, "uavoCrossfireTelemetry",
 					STACK_SIZE_BYTES, NULL, TASK_PRIORITY);
 			TaskMonitorAdd(TASKINFO_RUNNING_UAVOCROSSFIRETELEMETRY,
 					uavoCrossfireTelemetryTaskHandle);
+#endif
 			return 0;
 		}
 	}
@@ -91,6 +117,12 @@ static int32_t uavoCrossfireTelemetryStart(void)
 static int32_t uavoCrossfireTelemetryInitialize(void)
 {
 	module_enabled = PIOS_Modules_IsEnabled(PIOS_MODULE_UAVOCROSSFIRETELEMETRY); 
+
+	if (module_enabled && telemetry_snapshot_init()) {
+		module_enabled = false;
+		return -1;
+	}
+
 	return 0;
 }
 MODULE_INITCALL(uavoCrossfireTelemetryInitialize, uavoCrossfireTelemetryStart)
@@ -100,21 +132,19 @@ MODULE_INITCALL(uavoCrossfireTelemetryInitialize, uavoCrossfireTelemetryStart)
 #define WRITE_VAL16(buf,p,x)			{ typeof(x) v = x; uint8_t *q = (uint8_t*)&v; buf[p++] = q[1]; buf[p++] = q[0]; }
 #define WRITE_VAL32(buf,p,x)			{ typeof(x) v = x; uint8_t *q = (uint8_t*)&v; buf[p++] = q[3]; buf[p++] = q[2]; buf[p++] = q[1]; buf[p++] = q[0]; }
 
-static int crsftelem_create_attitude(uint8_t *buf)
+static int crsftelem_create_attitude(const struct telemetry_snapshot *snap,
+		uint8_t *buf)
 {
 	int pos = 0;
 
-	if(AttitudeActualHandle()) {
-		AttitudeActualData attitudeData;
-		AttitudeActualGet(&attitudeData);
-
+	if(snap->have_attitude) {
 		buf[pos++] = 0;
 		buf[pos++] = CRSF_PAYLOAD_LEN(CRSF_PAYLOAD_ATTITUDE);
 		buf[pos++] = CRSF_FRAME_ATTITUDE;
 
-		WRITE_VAL16(buf, pos, (int16_t)(DEG2RAD(attitudeData.Pitch)*10000.0f));
-		WRITE_VAL16(buf, pos, (int16_t)(DEG2RAD(attitudeData.Roll)*10000.0f));
-		WRITE_VAL16(buf, pos, (int16_t)(DEG2RAD(attitudeData.Yaw)*10000.0f));
+		WRITE_VAL16(buf, pos, (int16_t)(DEG2RAD(snap->pitch)*10000.0f));
+		WRITE_VAL16(buf, pos, (int16_t)(DEG2RAD(snap->roll)*10000.0f));
+		WRITE_VAL16(buf, pos, (int16_t)(DEG2RAD(snap->yaw)*10000.0f));
 
 		buf[pos++] = PIOS_CRC_updateCRC_TBS(0, buf+2, buf[1] - CRSF_CRC_LEN);
 	}
@@ -122,30 +152,25 @@ static int crsftelem_create_attitude(uint8_t *buf)
 	return pos;
 }
 
-static int crsftelem_create_battery(uint8_t *buf)
+static int crsftelem_create_battery(const struct telemetry_snapshot *snap,
+		uint8_t *buf)
 {
 	int pos = 0;
 
-	if(FlightBatteryStateHandle() && FlightBatterySettingsHandle()) {
-		FlightBatteryStateData batteryData;
-		FlightBatterySettingsData batterySettings;
-
-		FlightBatteryStateGet(&batteryData);
-		FlightBatterySettingsGet(&batterySettings);
-
+	if(snap->have_battery) {
 		buf[pos++] = 0;
 		buf[pos++] = CRSF_PAYLOAD_LEN(CRSF_PAYLOAD_BATTERY);
 		buf[pos++] = CRSF_FRAME_BATTERY;
 
-		WRITE_VAL16(buf, pos, (uint16_t)(batteryData.Voltage * 10.0f))
-		WRITE_VAL16(buf, pos, (uint16_t)(batteryData.Current * 10.0f))
+		WRITE_VAL16(buf, pos, (uint16_t)(snap->battery_voltage * 10.0f))
+		WRITE_VAL16(buf, pos, (uint16_t)(snap->battery_current * 10.0f))
 
 		// Should apparently be capacity used?
-		buf[pos++] = (uint8_t)((batterySettings.Capacity & 0x00FF0000) >> 16);
-		buf[pos++] = (uint8_t)((batterySettings.Capacity & 0x0000FF00) >> 8);
-		buf[pos++] = (uint8_t)(batterySettings.Capacity & 0x000000FF);
+		buf[pos++] = (uint8_t)((snap->battery_capacity & 0x00FF0000) >> 16);
+		buf[pos++] = (uint8_t)((snap->battery_capacity & 0x0000FF00) >> 8);
+		buf[pos++] = (uint8_t)(snap->battery_capacity & 0x000000FF);
 
-		float charge_state = batterySettings.Capacity == 0 ? 100.0f : (batteryData.ConsumedEnergy / batterySettings.Capacity);
+		float charge_state = snap->battery_capacity == 0 ? 100.0f : (snap->consumed_energy / snap->battery_capacity);
 		if(charge_state < 0) charge_state = 0;
 		else if(charge_state > 100) charge_state = 100;
 		buf[pos++] = (uint8_t)charge_state;
@@ -156,80 +181,106 @@ static int crsftelem_create_battery(uint8_t *buf)
 	return pos;
 }
 
-static int crsftelem_create_gps(uint8_t *buf)
+static int crsftelem_create_gps(const struct telemetry_snapshot *snap,
+		uint8_t *buf)
 {
 	int pos = 0;
 
-	if(GPSPositionHandle()) {
-		GPSPositionData gpsData;
-		GPSPositionGet(&gpsData);
-
-		if(gpsData.Status >= GPSPOSITION_STATUS_FIX2D) {
-			buf[pos++] = 0;
-			buf[pos++] = CRSF_PAYLOAD_LEN(CRSF_PAYLOAD_GPS);
-			buf[pos++] = CRSF_FRAME_GPS;
-
-			// Latitude (x10^7, as dRonin)
-			WRITE_VAL32(buf, pos, (int32_t)gpsData.Latitude);
-			// Longitude (x10^7, as dRonin)
-			WRITE_VAL32(buf, pos, (int32_t)gpsData.Longitude);
-			// Groundspeed (apparently tenth of km/h)
-			WRITE_VAL16(buf, pos, (uint16_t)(gpsData.Groundspeed*10.0f));
-			// Heading (apparently hundreth of a degree)
-			WRITE_VAL16(buf, pos, (uint16_t)(gpsData.Heading*100.0f));
-			// Altitude 1000 = 0m
-			WRITE_VAL16(buf, pos, (uint16_t)(1000.0f+
-				(gpsData.Status >= GPSPOSITION_STATUS_FIX3D ? gpsData.Altitude : 0.0f)));
-			// Satellites
-			buf[pos++] = gpsData.Satellites;
-
-			buf[pos++] = PIOS_CRC_updateCRC_TBS(0, buf+2, buf[1] - CRSF_CRC_LEN);
-		}
+	if(snap->gps_status >= GPSPOSITION_STATUS_FIX2D) {
+		buf[pos++] = 0;
+		buf[pos++] = CRSF_PAYLOAD_LEN(CRSF_PAYLOAD_GPS);
+		buf[pos++] = CRSF_FRAME_GPS;
+
+		// Latitude (x10^7, as dRonin)
+		WRITE_VAL32(buf, pos, snap->latitude);
+		// Longitude (x10^7, as dRonin)
+		WRITE_VAL32(buf, pos, snap->longitude);
+		// Groundspeed (apparently tenth of km/h)
+		WRITE_VAL16(buf, pos, (uint16_t)(snap->groundspeed*10.0f));
+		// Heading (apparently hundreth of a degree)
+		WRITE_VAL16(buf, pos, (uint16_t)(snap->course*100.0f));
+		// Altitude 1000 = 0m
+		WRITE_VAL16(buf, pos, (uint16_t)(1000.0f+
+			(snap->gps_status >= GPSPOSITION_STATUS_FIX3D ? snap->gps_altitude : 0.0f)));
+		// Satellites
+		buf[pos++] = snap->gps_satellites;
+
+		buf[pos++] = PIOS_CRC_updateCRC_TBS(0, buf+2, buf[1] - CRSF_CRC_LEN);
 	}
 
 	return pos;
 }
 
-static void uavoCrossfireTelemetryTask(void *parameters)
+/**
+ * Send the next frame in turn.
+ * \return -1 if the receiver wasn't ready for it, to try again later
+ */
+static int uavoCrossfireTelemetryStep(void)
+{
+	uint8_t buf[CRSF_MAX_FRAMELEN];
+	uint8_t len = 0;
+
+	if(PIOS_Crossfire_IsFailsafed(crsf_telem_dev_id)) {
+		return 0;
+	}
+
+	struct telemetry_snapshot snap;
+	telemetry_snapshot_get(&snap);
+
+	switch(frame_counter % 3) {
+		default:
+		case 0: // Attitude
+			len = crsftelem_create_attitude(&snap, buf);
+			break;
+		case 1: // Battery
+			len = crsftelem_create_battery(&snap, buf);
+			break;
+		case 2: // GPS
+			len = crsftelem_create_gps(&snap, buf);
+			break;
+	}
+
+	if(len && PIOS_Crossfire_SendTelemetry(crsf_telem_dev_id, buf, len)) {
+		return -1;
+	}
+
+	frame_counter++;
+
+	return 0;
+}
+
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+/**
+ * Executor job, run every FRAME_PERIOD_MS.  A frame the receiver wasn't
+ * ready for is retried on the next run rather than by waiting here.
+ */
+static void uavoCrossfireTelemetryJob(const UAVObjEvent *ev, void *ctx)
 {
-	// Three objects, each at UPDATE_HZ
-	uint32_t idledelay = 1000 / (3 * UPDATE_HZ);
-	uint8_t counter = 0;
+	(void) ev; (void) ctx;
 
 	// Wait for stuff to setup?
-	PIOS_Thread_Sleep(1000);
+	if (PIOS_Thread_Systime() < STARTUP_DELAY_MS) {
+		return;
+	}
 
-	while (1) {
-		uint8_t buf[CRSF_MAX_FRAMELEN];
-		uint8_t len = 0;
-
-		if(!PIOS_Crossfire_IsFailsafed(crsf_telem_dev_id)) {
-
-			switch(counter++ % 3) {
-				default:
-				case 0: // Attitude
-					len = crsftelem_create_attitude(buf);
-					break;
-				case 1: // Battery
-					len = crsftelem_create_battery(buf);
-					break;
-				case 2: // GPS
-					len = crsftelem_create_gps(buf);
-					break;
-			}
+	uavoCrossfireTelemetryStep();
+}
+#else
+static void uavoCrossfireTelemetryTask(void *parameters)
+{
+	// Wait for stuff to setup?
+	PIOS_Thread_Sleep(STARTUP_DELAY_MS);
 
-			if(len) {
-				while(PIOS_Crossfire_SendTelemetry(crsf_telem_dev_id, buf, len)) {
-					// Keep repeating until telemetry went through, without
-					// locking up the whole thing.
-					PIOS_Thread_Sleep(2);
-				}
-			}
+	while (1) {
+		while (uavoCrossfireTelemetryStep()) {
+			// Keep repeating until telemetry went through, without
+			// locking up the whole thing.
+			PIOS_Thread_Sleep(2);
 		}
 
-		PIOS_Thread_Sleep(idledelay);
+		PIOS_Thread_Sleep(FRAME_PERIOD_MS);
 	}
 }
-
+#endif
 
 #endif // PIOS_INCLUDE_CROSSFIRE
@@ -36,25 +36,30 @@
 #include "openpilot.h"
 #include "physical_constants.h"
 #include "modulesettings.h"
-#include "flightbatterysettings.h"
-#include "flightbatterystate.h"
+#include "telemetry_snapshot.h"
 #include "gpsposition.h"
-#include "airspeedactual.h"
-#include "baroaltitude.h"
-#include "homelocation.h"
 #include "accels.h"
 #include "flightstatus.h"
 #include "nedaccel.h"
-#include "velocityactual.h"
-#include "attitudeactual.h"
 #include "pios_thread.h"
 #include "pios_modules.h"
 
 #if defined(PIOS_INCLUDE_FRSKY_SENSOR_HUB)
+
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+#include "eventexecutor.h"
+#include "eventexecutorstatus.h"
+#endif
+
 // ****************
 // Private functions
 
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+static void uavoFrSKYSensorHubBridgeJob(const UAVObjEvent *ev, void *ctx);
+#else
 static void uavoFrSKYSensorHubBridgeTask(void *parameters);
+#endif
+static void uavoFrSKYSensorHubBridgeStep(void);
 
 static uint16_t frsky_pack_altitude(
 		float altitude,
@@ -184,12 +189,17 @@ static const uint8_t frsky_rates[] = {
 // Private variables
 
 static struct {
+#if !defined(PIOS_INCLUDE_EVENTEXECUTOR)
 	struct pios_thread *task_handle;
+#endif
 
 	uint32_t frsky_port;
 
 	uint8_t frame_ticks[MAXSTREAMS];
 
+	uint8_t last_armed;
+	float altitude_offset;
+
 	uint8_t serial_buf[FRSKY_MAX_PACKET_LEN];
 } *shub_global;
 
@@ -201,12 +211,23 @@ static struct {
 static int32_t uavoFrSKYSensorHubBridgeStart(void)
 {
 	if (shub_global) {
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+		// Run from the event dispatcher rather than a task of our own
+		if (EventExecutorRegister(EVENTEXECUTORSTATUS_RUNS_SENSORHUBBRIDGE,
+				uavoFrSKYSensorHubBridgeJob, NULL, STACK_SIZE_BYTES,
+				sizeof(shub_global->altitude_offset)) ||
+				EventExecutorSetPeriod(EVENTEXECUTORSTATUS_RUNS_SENSORHUBBRIDGE,
+					1000 / TASK_RATE_HZ)) {
+			return -1;
+		}
+#else
 		// Start tasks
 		shub_global->task_handle = PIOS_Thread_Create(
 				uavoFrSKYSensorHubBridgeTask, "uavoFrSKYSensorHubBridge",
 				STACK_SIZE_BYTES, NULL, TASK_PRIORITY);
 		TaskMonitorAdd(TASKINFO_RUNNING_UAVOFRSKYSENSORHUBBRIDGE,
 				shub_global->task_handle);
+#endif
 		return 0;
 	}
 	return -1;
@@ -228,7 +249,15 @@ static int32_t uavoFrSKYSensorHubBridgeInitialize(void)
 			return -1;
 		}
 
+		if (telemetry_snapshot_init()) {
+			PIOS_free(shub_global);
+			shub_global = NULL;
+			return -1;
+		}
+
 		shub_global->frsky_port = frsky_port;
+		shub_global->last_armed = FLIGHTSTATUS_ARMED_DISARMED;
+		shub_global->altitude_offset = 0.0f;
 
 		PIOS_COM_ChangeBaud(frsky_port, FRSKY_BAUD_RATE);
 
@@ -245,292 +274,233 @@ static int32_t uavoFrSKYSensorHubBridgeInitialize(void)
 }
 MODULE_INITCALL(uavoFrSKYSensorHubBridgeInitialize, uavoFrSKYSensorHubBridgeStart)
 
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+/**
+ * Executor job, run at TASK_RATE_HZ.
+ */
+static void uavoFrSKYSensorHubBridgeJob(const UAVObjEvent *ev, void *ctx)
+{
+	(void) ev; (void) ctx;
+
+	uavoFrSKYSensorHubBridgeStep();
+}
+#else
 /**
  * Main task. It does not return.
  */
 static void uavoFrSKYSensorHubBridgeTask(void *parameters)
 {
-	FlightBatterySettingsData batSettings;
-	FlightBatteryStateData batState;
-	GPSPositionData gpsPosData;
-	BaroAltitudeData baroAltitude;
-	FlightStatusData flightStatus;
-
-	float accX = 0, accY = 0, accZ = 0;
+	uint32_t lastSysTime;
 
-	if (FlightBatterySettingsHandle() != NULL )
-		FlightBatterySettingsGet(&batSettings);
-	else {
-		batSettings.Capacity = 0;
-		batSettings.SensorCalibrationFactor[FLIGHTBATTERYSETTINGS_SENSORCALIBRATIONFACTOR_CURRENT] = 0;
-		batSettings.SensorCalibrationFactor[FLIGHTBATTERYSETTINGS_SENSORCALIBRATIONFACTOR_VOLTAGE] = 0;
-		batSettings.CellVoltageThresholds[FLIGHTBATTERYSETTINGS_CELLVOLTAGETHRESHOLDS_WARNING] = 0;
-		batSettings.CellVoltageThresholds[FLIGHTBATTERYSETTINGS_CELLVOLTAGETHRESHOLDS_ALARM] = 0;
-		batSettings.NbCells = 0;
-		batSettings.VoltagePin = FLIGHTBATTERYSETTINGS_VOLTAGEPIN_NONE;
-		batSettings.CurrentPin = FLIGHTBATTERYSETTINGS_CURRENTPIN_NONE;
-	}
+	// Main task loop
+	lastSysTime = PIOS_Thread_Systime();
 
-	if (GPSPositionHandle() == NULL ) {
-		gpsPosData.Altitude = 0;
-		gpsPosData.GeoidSeparation = 0;
-		gpsPosData.Groundspeed = 0;
-		gpsPosData.HDOP = 0;
-		gpsPosData.Heading = 0;
-		gpsPosData.Latitude = 0;
-		gpsPosData.Longitude = 0;
-		gpsPosData.PDOP = 0;
-		gpsPosData.Satellites = 0;
-		gpsPosData.Status = 0;
-		gpsPosData.VDOP = 0;
-	}
+	while (1) {
+		PIOS_Thread_Sleep_Until(&lastSysTime, 1000 / TASK_RATE_HZ);
 
-	if (FlightBatteryStateHandle() == NULL ) {
-		batState.AvgCurrent = 0;
-		batState.BoardSupplyVoltage = 0;
-		batState.ConsumedEnergy = 0;
-		batState.Current = 0;
-		batState.EstimatedFlightTime = 0;
-		batState.PeakCurrent = 0;
-		batState.Voltage = 0;
+		uavoFrSKYSensorHubBridgeStep();
 	}
+}
+#endif
 
-	uint8_t last_armed = FLIGHTSTATUS_ARMED_DISARMED;
-	float altitude_offset = 0.0f;
-
+/**
+ * Send the frames that are due this tick.  Frames go out only if the port
+ * has room for them, so a slow link never holds up the caller.
+ */
+static void uavoFrSKYSensorHubBridgeStep(void)
+{
+	struct telemetry_snapshot snap;
 	uint16_t msg_length = 0;
-	uint32_t lastSysTime;
 
-	// Main task loop
-	lastSysTime = PIOS_Thread_Systime();
+	telemetry_snapshot_get(&snap);
 
-	while (1) {
-		PIOS_Thread_Sleep_Until(&lastSysTime, 1000 / TASK_RATE_HZ);
+	if (frame_trigger(FRSKY_FRAME_VARIO)) {
+		float accX = 0, accY = 0, accZ = 0;
 
-		if (frame_trigger(FRSKY_FRAME_VARIO)) {
-			msg_length = 0;
-
-			uint8_t accelDataSettings;
-			ModuleSettingsFrskyAccelDataGet(&accelDataSettings);
-			switch(accelDataSettings) {
-			case MODULESETTINGS_FRSKYACCELDATA_ACCELS: {
-				if (AccelsHandle() != NULL) {
-					AccelsxGet(&accX);
-					AccelsyGet(&accY);
-					AccelszGet(&accZ);
-				}
-				break;
-			}
-			case MODULESETTINGS_FRSKYACCELDATA_NEDACCELS: {
-				if (NedAccelHandle() != NULL) {
-					NedAccelNorthGet(&accX);
-					NedAccelEastGet(&accY);
-					NedAccelDownGet(&accZ);
-				}
-				break;
+		msg_length = 0;
+
+		uint8_t accelDataSettings;
+		ModuleSettingsFrskyAccelDataGet(&accelDataSettings);
+		switch(accelDataSettings) {
+		case MODULESETTINGS_FRSKYACCELDATA_ACCELS: {
+			if (AccelsHandle() != NULL) {
+				AccelsxGet(&accX);
+				AccelsyGet(&accY);
+				AccelszGet(&accZ);
 			}
-			case MODULESETTINGS_FRSKYACCELDATA_NEDVELOCITY: {
-				if (VelocityActualHandle() != NULL) {
-					VelocityActualNorthGet(&accX);
-					VelocityActualEastGet(&accY);
-					VelocityActualDownGet(&accZ);
-					accX *= GRAVITY / 10.0f;
-					accY *= GRAVITY / 10.0f;
-					accZ *= GRAVITY / 10.0f;
-				}
-				break;
+			break;
+		}
+		case MODULESETTINGS_FRSKYACCELDATA_NEDACCELS: {
+			if (NedAccelHandle() != NULL) {
+				NedAccelNorthGet(&accX);
+				NedAccelEastGet(&accY);
+				NedAccelDownGet(&accZ);
 			}
-#endif
-			case MODULESETTINGS_FRSKYACCELDATA_ATTITUDEANGLES: {
-				if (AttitudeActualHandle() != NULL) {
-					AttitudeActualRollGet(&accX);
-					AttitudeActualPitchGet(&accY);
-					AttitudeActualYawGet(&accZ);
-					accX *= GRAVITY / 10.0f;
-					accY *= GRAVITY / 10.0f;
-					accZ *= GRAVITY / 10.0f;
-				}
-				break;
+			break;
+		}
+		case MODULESETTINGS_FRSKYACCELDATA_NEDVELOCITY: {
+			if (snap.have_velocity) {
+				accX = snap.velocity[0] * GRAVITY / 10.0f;
+				accY = snap.velocity[1] * GRAVITY / 10.0f;
+				accZ = snap.velocity[2] * GRAVITY / 10.0f;
 			}
+			break;
+		}
+		case MODULESETTINGS_FRSKYACCELDATA_ATTITUDEANGLES: {
+			if (snap.have_attitude) {
+				accX = snap.roll * GRAVITY / 10.0f;
+				accY = snap.pitch * GRAVITY / 10.0f;
+				accZ = snap.yaw * GRAVITY / 10.0f;
 			}
+			break;
+		}
+		}
 
-			msg_length += frsky_pack_accel(
-					accX,
-					accY,
-					accZ,
-					shub_global->serial_buf + msg_length);
+		msg_length += frsky_pack_accel(
+				accX,
+				accY,
+				accZ,
+				shub_global->serial_buf + msg_length);
 
-			if (BaroAltitudeHandle() != NULL)
-				BaroAltitudeGet(&baroAltitude);
+		// set altitude offset when arming
+		if ((snap.armed == FLIGHTSTATUS_ARMED_ARMING) ||
+				((shub_global->last_armed != FLIGHTSTATUS_ARMED_ARMED) && (snap.armed == FLIGHTSTATUS_ARMED_ARMED))) {
+			shub_global->altitude_offset = snap.baro_altitude;
+		}
+		shub_global->last_armed = snap.armed;
 
-			FlightStatusGet(&flightStatus);
+		float altitude = snap.baro_altitude - shub_global->altitude_offset;
+		msg_length += frsky_pack_altitude(
+				altitude,
+				shub_global->serial_buf + msg_length);
 
-			// set altitude offset when arming
-			if ((flightStatus.Armed == FLIGHTSTATUS_ARMED_ARMING) ||
-					((last_armed != FLIGHTSTATUS_ARMED_ARMED) && (flightStatus.Armed == FLIGHTSTATUS_ARMED_ARMED))) {
-				altitude_offset = baroAltitude.Altitude;
+		msg_length += frsky_pack_stop(shub_global->serial_buf + msg_length);
+
+		PIOS_COM_SendBufferNonBlocking(shub_global->frsky_port,
+				shub_global->serial_buf, msg_length);
+	}
+
+	if (frame_trigger(FRSKY_FRAME_BATTERY)) {
+		msg_length = 0;
+
+		// As long as there is no voltage for each cell
+		// all cells will have the same voltage.
+		// Receiver will know number of cells.
+		if (snap.battery_cells > 0) {
+			float cell_v = snap.battery_voltage / snap.battery_cells;
+			for(uint8_t i = 0; i < snap.battery_cells; ++i) {
+				msg_length += frsky_pack_cellvoltage(
+						i,
+						cell_v,
+						shub_global->serial_buf + msg_length);
 			}
-			last_armed = flightStatus.Armed;
+		}
 
-			float altitude = baroAltitude.Altitude - altitude_offset;
-			msg_length += frsky_pack_altitude(
-					altitude,
-					shub_global->serial_buf + msg_length);
+		msg_length += frsky_pack_fas(
+				snap.battery_voltage,
+				snap.battery_current,
+				shub_global->serial_buf + msg_length);
 
-			msg_length += frsky_pack_stop(shub_global->serial_buf + msg_length);
+		if (snap.battery_capacity > 0) {
+			float fuel = 1.0f - snap.consumed_energy / snap.battery_capacity;
+			msg_length += frsky_pack_fuel(
+				fuel,
+				shub_global->serial_buf + msg_length);
+		}
+
+		msg_length += frsky_pack_stop(shub_global->serial_buf + msg_length);
 
-			PIOS_COM_SendBuffer(shub_global->frsky_port,
-					shub_global->serial_buf, msg_length);
+		PIOS_COM_SendBufferNonBlocking(shub_global->frsky_port,
+				shub_global->serial_buf, msg_length);
+	}
+
+	if (frame_trigger(FRSKY_FRAME_GPS)) {
+		msg_length = 0;
+
+		/**
+		 * Encodes ARM status and flight mode number as RPM value
+		 * Since there is no RPM information in any UAVO available,
+		 * we will intentionally misuse this item to encode other useful information.
+		 * It will encode flight status as three-digit number as follow:
+		 * most left digit encodes arm status (200=armed, 100=disarmed)
+		 * two most right digits encode flight mode number (see FlightStatus UAVO FlightMode enum)
+		 * To work properly on Taranis, you have to set Blades to "60" in telemetry setting
+		 */
+		uint16_t status = 0;
+		float hdop, vdop;
+
+		status = (snap.armed == FLIGHTSTATUS_ARMED_ARMED) ? 200 : 100;
+		status += snap.flight_mode;
+
+		msg_length += frsky_pack_rpm(status, shub_global->serial_buf + msg_length);
+
+		/**
+		 * Encode GPS status and visible satellites as T1 value
+		 * We will intentionally misuse this item to encode other useful information.
+		 * Right-most two digits encode visible satellite count, left-most digit has following meaning:
+		 * 1 - no GPS connected
+		 * 2 - no fix
+		 * 3 - 2D fix
+		 * 4 - 3D fix
+		 * 5 - 3D fix and HomeLocation is SET - should be safe for navigation
+		 */
+		switch (snap.gps_status) {
+		case GPSPOSITION_STATUS_NOGPS:
+			status = 100;
+			break;
+		case GPSPOSITION_STATUS_NOFIX:
+			status = 200;
+			break;
+		case GPSPOSITION_STATUS_FIX2D:
+			status = 300;
+			break;
+		case GPSPOSITION_STATUS_FIX3D:
+		case GPSPOSITION_STATUS_DIFF3D:
+			if (snap.home_set)
+				status = 500;
+			else
+				status = 400;
+			break;
 		}
 
-		if (frame_trigger(FRSKY_FRAME_BATTERY)) {
-			msg_length = 0;
-
-			if (FlightBatteryStateHandle() != NULL)
-				FlightBatteryStateGet(&batState);
-
-			float voltage = 0.0f;
-			if (batSettings.VoltagePin != FLIGHTBATTERYSETTINGS_VOLTAGEPIN_NONE)
-				voltage = batState.Voltage;
-
-			float current = 0.0f;
-			if (batSettings.CurrentPin != FLIGHTBATTERYSETTINGS_CURRENTPIN_NONE)
-				current = batState.Current;
-
-			// As long as there is no voltage for each cell
-			// all cells will have the same voltage.
-			// Receiver will know number of cells.
-			uint8_t cellCount = batState.DetectedCellCount;
-			if(cellCount)
-				batSettings.NbCells = cellCount;
-
-			if (batSettings.NbCells > 0) {
-				float cell_v = voltage / batSettings.NbCells;
-				for(uint8_t i = 0; i < batSettings.NbCells; ++i) {
-					msg_length += frsky_pack_cellvoltage(
-							i,
-							cell_v,
-							shub_global->serial_buf + msg_length);
-				}
-			}
+		if (snap.gps_satellites > 0)
+			status += snap.gps_satellites;
 
-			msg_length += frsky_pack_fas(
-					voltage,
-					current,
-					shub_global->serial_buf + msg_length);
+		msg_length += frsky_pack_temperature_01((float)status, shub_global->serial_buf + msg_length);
 
-			if (batSettings.Capacity > 0) {
-				float fuel = 1.0f - batState.ConsumedEnergy / batSettings.Capacity;
-				msg_length += frsky_pack_fuel(
-					fuel,
-					shub_global->serial_buf + msg_length);
-			}
+		/**
+		 * Encode GPS HDOP and VDOP as T2 value
+		 * We will intentionally misuse this item to encode other useful information.
+		 * VDOP in the upper 16 bits, max 256 (2.56 * 100)
+		 * HDOP in the lower 16 bits, max 256 (2.56 * 100)
+		 */
+		hdop = snap.hdop * 100.0f;
 
-			msg_length += frsky_pack_stop(shub_global->serial_buf + msg_length);
+		if (hdop > 255.0f)
+			hdop = 255.0f;
 
-			PIOS_COM_SendBuffer(shub_global->frsky_port,
-					shub_global->serial_buf, msg_length);
-		}
+		vdop = snap.vdop * 100.0f;
 
-		if (frame_trigger(FRSKY_FRAME_GPS)) {
-			msg_length = 0;
-
-			/**
-			 * Encodes ARM status and flight mode number as RPM value
-			 * Since there is no RPM information in any UAVO available,
-			 * we will intentionally misuse this item to encode other useful information.
-			 * It will encode flight status as three-digit number as follow:
-			 * most left digit encodes arm status (200=armed, 100=disarmed)
-			 * two most right digits encode flight mode number (see FlightStatus UAVO FlightMode enum)
-			 * To work properly on Taranis, you have to set Blades to "60" in telemetry setting
-			 */
-			FlightStatusData flight_status;
-			FlightStatusGet(&flight_status);
-
-			uint16_t status = 0;
-			float hdop, vdop;
-
-			status = (flight_status.Armed == FLIGHTSTATUS_ARMED_ARMED) ? 200 : 100;
-			status += flight_status.FlightMode;
-
-			msg_length += frsky_pack_rpm(status, shub_global->serial_buf + msg_length);
-
-			uint8_t hl_set = HOMELOCATION_SET_FALSE;
-			
-			if (GPSPositionHandle() != NULL)
-				GPSPositionGet(&gpsPosData);
-
-			if (HomeLocationHandle() != NULL)
-				HomeLocationSetGet(&hl_set);
-        
-			/**
-			 * Encode GPS status and visible satellites as T1 value
-			 * We will intentionally misuse this item to encode other useful information.
-			 * Right-most two digits encode visible satellite count, left-most digit has following meaning:
-			 * 1 - no GPS connected
-			 * 2 - no fix
-			 * 3 - 2D fix
-			 * 4 - 3D fix
-			 * 5 - 3D fix and HomeLocation is SET - should be safe for navigation
-			 */
-			switch (gpsPosData.Status) {
-			case GPSPOSITION_STATUS_NOGPS:
-			status = 100;
-				break;
-			case GPSPOSITION_STATUS_NOFIX:
-				status = 200;
-				break;
-			case GPSPOSITION_STATUS_FIX2D:
-				status = 300;
-				break;
-			case GPSPOSITION_STATUS_FIX3D:
-			case GPSPOSITION_STATUS_DIFF3D:
-				if (hl_set == HOMELOCATION_SET_TRUE)
-					status = 500;
-				else
-					status = 400;
-				break;
-			}
-	
-			if (gpsPosData.Satellites > 0)
-				status += gpsPosData.Satellites;
-
-			msg_length += frsky_pack_temperature_01((float)status, shub_global->serial_buf + msg_length);
-			
-			/**
-			 * Encode GPS HDOP and VDOP as T2 value
-			 * We will intentionally misuse this item to encode other useful information.
-			 * VDOP in the upper 16 bits, max 256 (2.56 * 100)
-			 * HDOP in the lower 16 bits, max 256 (2.56 * 100)
-			 */
-			hdop = gpsPosData.HDOP * 100.0f;
-			
-			if (hdop > 255.0f)
-				hdop = 255.0f;
-			
-			vdop = gpsPosData.VDOP * 100.0f;
-			
-			if (vdop > 255.0f)
-				vdop = 255.0f;
-			
-			msg_length += frsky_pack_temperature_02((vdop * 256 + hdop), shub_global->serial_buf + msg_length);
-
-			if (gpsPosData.Status == GPSPOSITION_STATUS_FIX2D ||
-			    gpsPosData.Status == GPSPOSITION_STATUS_FIX3D) {
-				msg_length += frsky_pack_gps(
-						gpsPosData.Heading,
-						gpsPosData.Latitude,
-						gpsPosData.Longitude,
-						gpsPosData.Altitude,
-						gpsPosData.Groundspeed,
-						shub_global->serial_buf + msg_length);
-			}
+		if (vdop > 255.0f)
+			vdop = 255.0f;
 
-			msg_length += frsky_pack_stop(shub_global->serial_buf + msg_length);
+		msg_length += frsky_pack_temperature_02((vdop * 256 + hdop), shub_global->serial_buf + msg_length);
 
-			PIOS_COM_SendBuffer(shub_global->frsky_port,
-					shub_global->serial_buf, msg_length);
+		if (snap.gps_status == GPSPOSITION_STATUS_FIX2D ||
+		    snap.gps_status == GPSPOSITION_STATUS_FIX3D) {
+			msg_length += frsky_pack_gps(
+					snap.course,
+					snap.latitude,
+					snap.longitude,
+					snap.gps_altitude,
+					snap.groundspeed,
+					shub_global->serial_buf + msg_length);
 		}
+
+		msg_length += frsky_pack_stop(shub_global->serial_buf + msg_length);
+
+		PIOS_COM_SendBufferNonBlocking(shub_global->frsky_port,
+				shub_global->serial_buf, msg_length);
 	}
 }
 
@@ -845,6 +815,8 @@ static void frsky_write_userdata_byte(uint8_t byte, uint8_t *serial_buf, uint8_t
 	}
 }
 
+#endif // PIOS_INCLUDE_FRSKY_SENSOR_HUB
+
 /**
  * @}
  * @}
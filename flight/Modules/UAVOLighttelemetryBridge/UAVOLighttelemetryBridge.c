@@ -53,17 +53,10 @@
 
 #include "openpilot.h"
 #include "modulesettings.h"
+#include "telemetry_snapshot.h"
 
-#include "accels.h"
-#include "airspeedactual.h"
-#include "attitudeactual.h"
-#include "baroaltitude.h"
 #include "flightstatus.h"
 #include "gpsposition.h"
-#include "flightbatterysettings.h"
-#include "flightbatterystate.h"
-#include "manualcontrolcommand.h"
-#include "positionactual.h"
 
 #include "pios_thread.h"
 #include "pios_modules.h"
@@ -71,6 +64,12 @@
 #include <pios_hal.h>
 
 #if defined(PIOS_INCLUDE_LIGHTTELEMETRY)
+
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+#include "eventexecutor.h"
+#include "eventexecutorstatus.h"
+#endif
+
 // Private constants
 #define STACK_SIZE_BYTES 600
 #define TASK_PRIORITY PIOS_THREAD_PRIO_LOW
@@ -89,19 +88,26 @@
 
 // Private variables
 static bool module_enabled = false;
+#if !defined(PIOS_INCLUDE_EVENTEXECUTOR)
 static struct pios_thread *taskHandle;
+#endif
 static uint32_t lighttelemetryPort;
 static uint8_t ltm_scheduler;
 static uint8_t ltm_slowrate;
 
 // Private functions
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+static void uavoLighttelemetryBridgeJob(const UAVObjEvent *ev, void *ctx);
+#else
 static void uavoLighttelemetryBridgeTask(void *parameters);
+#endif
+static void uavoLighttelemetryBridgeStep(void);
 static void updateSettings();
 
 static int send_LTM_Packet(uint8_t *LTPacket, uint8_t LTPacket_size);
-static int send_LTM_Gframe();
-static int send_LTM_Aframe();
-static int send_LTM_Sframe();
+static int send_LTM_Gframe(const struct telemetry_snapshot *snap);
+static int send_LTM_Aframe(const struct telemetry_snapshot *snap);
+static int send_LTM_Sframe(const struct telemetry_snapshot *snap);
 
 
 /**
@@ -113,6 +119,10 @@ int32_t uavoLighttelemetryBridgeInitialize()
 	lighttelemetryPort = PIOS_COM_LIGHTTELEMETRY;
 
 	if (lighttelemetryPort && PIOS_Modules_IsEnabled(PIOS_MODULE_UAVOLIGHTTELEMETRYBRIDGE)) {
+		if (telemetry_snapshot_init()) {
+			return -1;
+		}
+
 		// Update telemetry settings
 		module_enabled = true;
 		return 0;
@@ -129,8 +139,20 @@ int32_t uavoLighttelemetryBridgeStart()
 {
 	if ( module_enabled )
 	{
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+		updateSettings();
+
+		// Run from the event dispatcher rather than a task of our own
+		if (EventExecutorRegister(EVENTEXECUTORSTATUS_RUNS_LIGHTTELEMETRY,
+				uavoLighttelemetryBridgeJob, NULL, STACK_SIZE_BYTES, 0) ||
+				EventExecutorSetPeriod(EVENTEXECUTORSTATUS_RUNS_LIGHTTELEMETRY,
+					CHUNK_TIME)) {
+			return -1;
+		}
+#else
 		taskHandle = PIOS_Thread_Create(uavoLighttelemetryBridgeTask, "uavoLighttelemetryBridge", STACK_SIZE_BYTES, NULL, TASK_PRIORITY);
 		TaskMonitorAdd(TASKINFO_RUNNING_UAVOLIGHTTELEMETRYBRIDGE, taskHandle);
+#endif
 		return 0;
 	}
 	
@@ -140,6 +162,17 @@ int32_t uavoLighttelemetryBridgeStart()
 MODULE_INITCALL(uavoLighttelemetryBridgeInitialize, uavoLighttelemetryBridgeStart);
 
 
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+/**
+ * Executor job, run every CHUNK_TIME.
+ */
+static void uavoLighttelemetryBridgeJob(const UAVObjEvent *ev, void *ctx)
+{
+	(void) ev; (void) ctx;
+
+	uavoLighttelemetryBridgeStep();
+}
+#else
 /*#######################################################################
  * Module thread, should not return.
  *#######################################################################
@@ -152,54 +185,64 @@ static void uavoLighttelemetryBridgeTask(void *parameters)
 	// Main task loop
 	while (1)
 	{
-		int ret = 0;
-
-		if (!ret) {
-			switch (ltm_scheduler) {
-				case 0:
-				case 6:
-					ret = send_LTM_Sframe();
-					break;
-
-				case 3:
-				case 9:
-					ret = send_LTM_Gframe();
-					break;
-
-				case 1:
-				case 4:
-				case 7:
-				case 10:
-					if (ltm_slowrate) {
-						break;
-					}
-
-				case 2:
-				case 5:
-				case 8:
-				case 11:
-					ret = send_LTM_Aframe();
-					break;
-
-				default:
-					break;
-			}
-		}
+		uavoLighttelemetryBridgeStep();
 
 		PIOS_Thread_Sleep(CHUNK_TIME);
+	}
+}
+#endif
 
-		if (ret) {
-			/* If we couldn't tx, go around and try the same thing
-			 * again.
-			 */
-			continue;
-		}
+/**
+ * Send whatever frame is due this chunk.
+ */
+static void uavoLighttelemetryBridgeStep(void)
+{
+	struct telemetry_snapshot snap;
+	int ret = 0;
+
+	telemetry_snapshot_get(&snap);
+
+	switch (ltm_scheduler) {
+		case 0:
+		case 6:
+			ret = send_LTM_Sframe(&snap);
+			break;
+
+		case 3:
+		case 9:
+			ret = send_LTM_Gframe(&snap);
+			break;
+
+		case 1:
+		case 4:
+		case 7:
+		case 10:
+			if (ltm_slowrate) {
+				break;
+			}
 
-		ltm_scheduler++;
+		case 2:
+		case 5:
+		case 8:
+		case 11:
+			ret = send_LTM_Aframe(&snap);
+			break;
 
-		if (ltm_scheduler > 11) {
-			ltm_scheduler = 0;
-		}
+		default:
+			break;
+	}
+
+	if (ret) {
+		/* If we couldn't tx, go around and try the same thing
+		 * again.
+		 */
+		return;
+	}
+
+	ltm_scheduler++;
+
+	if (ltm_scheduler > 11) {
+		ltm_scheduler = 0;
 	}
 }
 
@@ -208,37 +251,24 @@ static void uavoLighttelemetryBridgeTask(void *parameters)
  *#######################################################################
 */
 //GPS packet
-static int send_LTM_Gframe()
+static int send_LTM_Gframe(const struct telemetry_snapshot *snap)
 {
-	GPSPositionData pdata = { };	/* Set to all 0's */
-
-	bool have_gps = false;
-
-	if (GPSPositionHandle() != NULL) {
-		have_gps = true;
-		GPSPositionGet(&pdata);
-	}
-
-	int32_t lt_latitude = pdata.Latitude;
-	int32_t lt_longitude = pdata.Longitude;
-	uint8_t lt_groundspeed = (uint8_t)roundf(pdata.Groundspeed); //rounded m/s .
+	int32_t lt_latitude = snap->latitude;
+	int32_t lt_longitude = snap->longitude;
+	uint8_t lt_groundspeed = (uint8_t)roundf(snap->groundspeed); //rounded m/s .
 	int32_t lt_altitude = 0;
-	if (PositionActualHandle() != NULL) {
-		float altitude;
-		PositionActualDownGet(&altitude);
-		lt_altitude = (int32_t)roundf(altitude * -100.0f);
-	} else if (BaroAltitudeHandle() != NULL) {
-		float altitude;
-		BaroAltitudeAltitudeGet(&altitude);
-		lt_altitude = (int32_t)roundf(altitude * 100.0f); //Baro alt in cm.
-	} else if (have_gps) {
-		lt_altitude = (int32_t)roundf(pdata.Altitude * 100.0f); //GPS alt in cm.
+	if (snap->have_position) {
+		lt_altitude = (int32_t)roundf(snap->position[2] * -100.0f);
+	} else if (snap->have_baro) {
+		lt_altitude = (int32_t)roundf(snap->baro_altitude * 100.0f); //Baro alt in cm.
+	} else if (snap->have_gps) {
+		lt_altitude = (int32_t)roundf(snap->gps_altitude * 100.0f); //GPS alt in cm.
 	} else {
 		return 0;	/* Don't even bother, no data for this frame! */
 	}
 	
 	uint8_t lt_gpsfix;
-	switch (pdata.Status) {
+	switch (snap->gps_status) {
 	case GPSPOSITION_STATUS_NOGPS:
 		lt_gpsfix = 0;
 		break;
@@ -256,7 +286,7 @@ static int send_LTM_Gframe()
 		break;
 	}
 	
-	uint8_t lt_gpssats = (int8_t)pdata.Satellites;
+	uint8_t lt_gpssats = (int8_t)snap->gps_satellites;
 	//pack G frame	
 	uint8_t LTBuff[LTM_GFRAME_SIZE];
 	//G Frame: $T(2 bytes)G(1byte)LAT(cm,4 bytes)LON(cm,4bytes)SPEED(m/s,1bytes)ALT(cm,4bytes)SATS(6bits)FIX(2bits)CRC(xor,1byte)
@@ -285,14 +315,12 @@ static int send_LTM_Gframe()
 }
 
 //Attitude packet
-static int send_LTM_Aframe()
+static int send_LTM_Aframe(const struct telemetry_snapshot *snap)
 {
 	//prepare data
-	AttitudeActualData adata;
-	AttitudeActualGet(&adata);
-	int16_t lt_pitch   = (int16_t)(roundf(adata.Pitch));	//-180/180°
-	int16_t lt_roll	   = (int16_t)(roundf(adata.Roll));		//-180/180°
-	int16_t lt_heading = (int16_t)(roundf(adata.Yaw));		//-180/180°
+	int16_t lt_pitch   = (int16_t)(roundf(snap->pitch));	//-180/180°
+	int16_t lt_roll	   = (int16_t)(roundf(snap->roll));		//-180/180°
+	int16_t lt_heading = (int16_t)(roundf(snap->yaw));		//-180/180°
 	//pack A frame	
 	uint8_t LTBuff[LTM_AFRAME_SIZE];
 	
@@ -314,7 +342,7 @@ static int send_LTM_Aframe()
 }
 
 //Sensors packet
-static int send_LTM_Sframe()
+static int send_LTM_Sframe(const struct telemetry_snapshot *snap)
 {
 	//prepare data
 	uint16_t lt_vbat = 0;
@@ -326,35 +354,23 @@ static int send_LTM_Sframe()
 	uint8_t	 lt_flightmode = 0;
 	
 	
-	if (FlightBatteryStateHandle() != NULL) {
-		FlightBatteryStateData sdata;
-		FlightBatteryStateGet(&sdata);
-		lt_vbat = (uint16_t)roundf(sdata.Voltage*1000);	  //Battery voltage in mv
-		lt_amp = (uint16_t)roundf(sdata.ConsumedEnergy);	  //mA consumed
-	}
-	if (ManualControlCommandHandle() != NULL) {
-		ManualControlCommandData mdata;
-		ManualControlCommandGet(&mdata);
-		lt_rssi = (uint8_t)mdata.Rssi;					  //RSSI in %
+	if (snap->have_battery) {
+		lt_vbat = (uint16_t)roundf(snap->battery_voltage*1000);	  //Battery voltage in mv
+		lt_amp = (uint16_t)roundf(snap->consumed_energy);	  //mA consumed
 	}
-	if (AirspeedActualHandle() != NULL) {
-		AirspeedActualData adata;
-		AirspeedActualGet (&adata);
-		lt_airspeed = (uint8_t)roundf(adata.TrueAirspeed);	  //Airspeed in m/s
-	} else if (GPSPositionHandle() != NULL) {
-		float groundspeed;
-		GPSPositionGroundspeedGet(&groundspeed);
-		lt_airspeed = (uint8_t)roundf(groundspeed);
+	lt_rssi = (uint8_t)snap->rssi;					  //RSSI in %
+	if (snap->have_airspeed) {
+		lt_airspeed = (uint8_t)roundf(snap->true_airspeed);	  //Airspeed in m/s
+	} else if (snap->have_gps) {
+		lt_airspeed = (uint8_t)roundf(snap->groundspeed);
 	}
 
-	FlightStatusData fdata;
-	FlightStatusGet(&fdata);
-	lt_arm = fdata.Armed;									  //Armed status
+	lt_arm = snap->armed;									  //Armed status
 	if (lt_arm == 1)		//arming , we don't use this one
 		lt_arm = 0;		
 	else if (lt_arm == 2)  // armed
 		lt_arm = 1;
-	if (fdata.ControlSource == FLIGHTSTATUS_CONTROLSOURCE_FAILSAFE)
+	if (snap->control_source == FLIGHTSTATUS_CONTROLSOURCE_FAILSAFE)
 		lt_failsafe = 1;
 	else
 		lt_failsafe = 0;
@@ -363,7 +379,7 @@ static int send_LTM_Sframe()
 	// 8: Altitude Hold, 9: Loiter/GPS Hold, 10: Auto/Waypoints, 11: Heading Hold / headFree,
 	// 12: Circle, 13: RTH, 14: FollowMe, 15: LAND, 16:FlybyWireA, 17: FlybywireB, 18: Cruise, 19: Unknown
 
-	switch (fdata.FlightMode) {
+	switch (snap->flight_mode) {
 	case FLIGHTSTATUS_FLIGHTMODE_MANUAL:
 		lt_flightmode = 0; break;
 	case FLIGHTSTATUS_FLIGHTMODE_STABILIZED1:
@@ -736,7 +736,8 @@ static void msp_send_status(struct msp_bridge *m)
 	if (GPSPositionHandle() != NULL)
 		GPSPositionGet(&gpsData);
 
-	data.status.sensors = (PIOS_SENSORS_IsRegistered(PIOS_SENSOR_ACCEL) ? MSP_SENSOR_ACC  : 0) |
+	data.status.sensors = ((PIOS_SENSORS_IsRegistered(PIOS_SENSOR_ACCEL) ||
+				PIOS_SENSORS_IsRegistered(PIOS_SENSOR_IMU_BATCH)) ? MSP_SENSOR_ACC  : 0) |
 		(PIOS_SENSORS_IsRegistered(PIOS_SENSOR_BARO) ? MSP_SENSOR_BARO : 0) |
 		(PIOS_SENSORS_IsRegistered(PIOS_SENSOR_MAG) ? MSP_SENSOR_MAG : 0) |
 		(gpsData.Status != GPSPOSITION_STATUS_NOGPS ? MSP_SENSOR_GPS : 0);
@@ -6,7 +6,7 @@
  * @{
  *
  * @file       UAVOMavlinkBridge.c
- * @author     dRonin, http://dRonin.org/, Copyright (C) 2015-2016
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2015-2017
  * @author     Tau Labs, http://taulabs.org, Copyright (C) 2013-2014
  * @brief      Bridges selected UAVObjects to Mavlink
  *
@@ -36,17 +36,11 @@
 #include "openpilot.h"
 #include "physical_constants.h"
 #include "modulesettings.h"
-#include "flightbatterysettings.h"
-#include "flightbatterystate.h"
+#include "telemetry_snapshot.h"
+#include "stream_sched.h"
 #include "gpsposition.h"
-#include "manualcontrolcommand.h"
-#include "attitudeactual.h"
-#include "airspeedactual.h"
 #include "actuatordesired.h"
 #include "flightstatus.h"
-#include "systemstats.h"
-#include "homelocation.h"
-#include "baroaltitude.h"
 #include "mavlink.h"
 #include "pios_thread.h"
 #include "pios_modules.h"
@@ -55,11 +49,28 @@
 
 #include "custom_types.h"
 
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+#include "eventexecutor.h"
+#include "eventexecutorstatus.h"
+#endif
+
 // ****************
 // Private functions
 
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+static void uavoMavlinkBridgeJob(const UAVObjEvent *ev, void *ctx);
+#else
 static void uavoMavlinkBridgeTask(void *parameters);
-static bool stream_trigger(enum MAV_DATA_STREAM stream_num);
+#endif
+static void uavoMavlinkBridgeStep(void);
+
+static void pack_heartbeat(const struct telemetry_snapshot *snap);
+static void pack_sys_status(const struct telemetry_snapshot *snap);
+static void pack_rc_channels_raw(const struct telemetry_snapshot *snap);
+static void pack_gps_raw_int(const struct telemetry_snapshot *snap);
+static void pack_gps_global_origin(const struct telemetry_snapshot *snap);
+static void pack_attitude(const struct telemetry_snapshot *snap);
+static void pack_vfr_hud(const struct telemetry_snapshot *snap);
 
 // ****************
 // Private constants
@@ -71,32 +82,105 @@ static bool stream_trigger(enum MAV_DATA_STREAM stream_num);
 #endif
 
 #define TASK_PRIORITY               PIOS_THREAD_PRIO_LOW
-#define TASK_RATE_HZ				10
+#define TICK_MS                     10	// Resolution of the message schedule
+
+#define MAV_SYSTEM_ID               0
+#define MAV_COMPONENT_ID            200
+
+// The bundled message set predates this command
+#ifndef MAV_CMD_SET_MESSAGE_INTERVAL
+#define MAV_CMD_SET_MESSAGE_INTERVAL 511
+#endif
 
-static const uint8_t mav_rates[] =
-	 { [MAV_DATA_STREAM_RAW_SENSORS]=0x02, //2Hz
-	   [MAV_DATA_STREAM_EXTENDED_STATUS]=0x02, //2Hz
-	   [MAV_DATA_STREAM_RC_CHANNELS]=0x05, //5Hz
-	   [MAV_DATA_STREAM_POSITION]=0x02, //2Hz
-	   [MAV_DATA_STREAM_EXTRA1]=0x0A, //10Hz
-	   [MAV_DATA_STREAM_EXTRA2]=0x02 }; //2Hz
+// Checksum seeds of the messages we accept, from MAVLINK_MESSAGE_CRCS
+#define REQUEST_DATA_STREAM_CRC_EXTRA 148
+#define COMMAND_LONG_CRC_EXTRA      152
 
-#define MAXSTREAMS sizeof(mav_rates)
+// Bytes per COM write; leaves the 128 byte port buffer room for the next
+#define TX_BUF_LEN                  96
+
+#define MSG_LEN(payload)            (MAVLINK_NUM_NON_PAYLOAD_BYTES + (payload))
+
+/*
+ * What is sent and how often by default.  The scheduler hands back indices
+ * into this table; mav_packers[] builds the message at the same index.
+ * The heartbeat is in no stream, so stopping streams never drops the link.
+ */
+static const struct stream_sched_message mav_messages[] = {
+	{ MAVLINK_MSG_ID_HEARTBEAT, 0,
+		500, MSG_LEN(MAVLINK_MSG_ID_HEARTBEAT_LEN) },
+	{ MAVLINK_MSG_ID_SYS_STATUS, MAV_DATA_STREAM_EXTENDED_STATUS,
+		500, MSG_LEN(MAVLINK_MSG_ID_SYS_STATUS_LEN) },
+	{ MAVLINK_MSG_ID_RC_CHANNELS_RAW, MAV_DATA_STREAM_RC_CHANNELS,
+		200, MSG_LEN(MAVLINK_MSG_ID_RC_CHANNELS_RAW_LEN) },
+	{ MAVLINK_MSG_ID_GPS_RAW_INT, MAV_DATA_STREAM_POSITION,
+		500, MSG_LEN(MAVLINK_MSG_ID_GPS_RAW_INT_LEN) },
+	{ MAVLINK_MSG_ID_GPS_GLOBAL_ORIGIN, MAV_DATA_STREAM_POSITION,
+		500, MSG_LEN(MAVLINK_MSG_ID_GPS_GLOBAL_ORIGIN_LEN) },
+	{ MAVLINK_MSG_ID_ATTITUDE, MAV_DATA_STREAM_EXTRA1,
+		100, MSG_LEN(MAVLINK_MSG_ID_ATTITUDE_LEN) },
+	{ MAVLINK_MSG_ID_VFR_HUD, MAV_DATA_STREAM_EXTRA2,
+		500, MSG_LEN(MAVLINK_MSG_ID_VFR_HUD_LEN) },
+};
+
+static void (* const mav_packers[])(const struct telemetry_snapshot *snap) = {
+	pack_heartbeat,
+	pack_sys_status,
+	pack_rc_channels_raw,
+	pack_gps_raw_int,
+	pack_gps_global_origin,
+	pack_attitude,
+	pack_vfr_hud,
+};
+
+// ****************
+// Private types
+
+enum mav_rx_state {
+	MAV_RX_IDLE,
+	MAV_RX_LEN,
+	MAV_RX_SEQ,
+	MAV_RX_SYSID,
+	MAV_RX_COMPID,
+	MAV_RX_MSGID,
+	MAV_RX_PAYLOAD,
+	MAV_RX_CK_A,
+	MAV_RX_CK_B,
+};
+
+/* Just enough of a parser for the requests we answer; anything else is
+ * skipped over without being stored */
+struct mav_rx {
+	enum mav_rx_state state;
+	uint8_t len;
+	uint8_t idx;
+	uint8_t msgid;
+	uint16_t crc;
+	uint8_t payload[MAVLINK_MSG_ID_COMMAND_LONG_LEN];
+};
 
 // ****************
 // Private variables
 
+#if !defined(PIOS_INCLUDE_EVENTEXECUTOR)
 static struct pios_thread *uavoMavlinkBridgeTaskHandle;
+#endif
 
 static uint32_t mavlink_port;
 
 static bool module_enabled = false;
 
-static uint8_t * stream_ticks;
+static bool mavlink_rx;
 
 static mavlink_message_t *mav_msg;
 
-static void updateSettings();
+static struct {
+	struct stream_sched sched;
+	struct mav_rx rx;
+	uint8_t tx_buf[TX_BUF_LEN];
+} *mav;
+
+static uint8_t updateSettings();
 
 /**
  * Initialise the module
@@ -105,15 +189,56 @@ static void updateSettings();
  */
 static int32_t uavoMavlinkBridgeStart(void) {
 	if (module_enabled) {
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+		// Run from the event dispatcher rather than a task of our own
+		if (EventExecutorRegister(EVENTEXECUTORSTATUS_RUNS_MAVLINKBRIDGE,
+				uavoMavlinkBridgeJob, NULL, STACK_SIZE_BYTES, 0) ||
+				EventExecutorSetPeriod(EVENTEXECUTORSTATUS_RUNS_MAVLINKBRIDGE,
+					TICK_MS)) {
+			return -1;
+		}
+#else
 		// Start tasks
 		uavoMavlinkBridgeTaskHandle = PIOS_Thread_Create(
 				uavoMavlinkBridgeTask, "uavoMavlinkBridge", STACK_SIZE_BYTES, NULL, TASK_PRIORITY);
 		TaskMonitorAdd(TASKINFO_RUNNING_UAVOMAVLINKBRIDGE,
 				uavoMavlinkBridgeTaskHandle);
+#endif
 		return 0;
 	}
 	return -1;
 }
+
+/**
+ * Link throughput for a port speed, allowing for start and stop bits
+ * \return bytes per second
+ */
+static uint32_t speed_to_bytes_per_s(uint8_t speed)
+{
+	switch (speed) {
+	case HWSHARED_SPEEDBPS_1200:
+		return 1200 / 10;
+	case HWSHARED_SPEEDBPS_2400:
+		return 2400 / 10;
+	case HWSHARED_SPEEDBPS_4800:
+		return 4800 / 10;
+	case HWSHARED_SPEEDBPS_9600:
+		return 9600 / 10;
+	case HWSHARED_SPEEDBPS_19200:
+		return 19200 / 10;
+	case HWSHARED_SPEEDBPS_38400:
+		return 38400 / 10;
+	case HWSHARED_SPEEDBPS_57600:
+		return 57600 / 10;
+	case HWSHARED_SPEEDBPS_230400:
+		return 230400 / 10;
+	case HWSHARED_SPEEDBPS_115200:
+	default:
+		/* The Bluetooth module setups all end at 115200 */
+		return 115200 / 10;
+	}
+}
+
 /**
  * Initialise the module
  * \return -1 if initialisation failed
@@ -123,15 +248,26 @@ static int32_t uavoMavlinkBridgeInitialize(void) {
 	mavlink_port = PIOS_COM_MAVLINK;
 
 	if (mavlink_port && PIOS_Modules_IsEnabled(PIOS_MODULE_UAVOMAVLINKBRIDGE)) {
-		updateSettings();
+		uint8_t speed = updateSettings();
 
 		mav_msg = PIOS_malloc(sizeof(*mav_msg));
-		stream_ticks = PIOS_malloc_no_dma(MAXSTREAMS);
+		mav = PIOS_malloc_no_dma(sizeof(*mav));
+
+		if (mav_msg && mav && !telemetry_snapshot_init()) {
+			memset(&mav->rx, 0, sizeof(mav->rx));
 
-		if (mav_msg && stream_ticks) {
-			for (int x = 0; x < MAXSTREAMS; ++x) {
-				stream_ticks[x] = (TASK_RATE_HZ / mav_rates[x]);
+			stream_sched_init(&mav->sched, mav_messages,
+					NELEMENTS(mav_messages),
+					speed_to_bytes_per_s(speed), TX_BUF_LEN,
+					PIOS_Thread_Systime());
+
+			// Shared with the GPS, whose bytes those are
+			mavlink_rx = true;
+#if defined(PIOS_COM_GPS)
+			if (mavlink_port == PIOS_COM_GPS) {
+				mavlink_rx = false;
 			}
+#endif
 
 			module_enabled = true;
 		}else {
@@ -144,13 +280,162 @@ static int32_t uavoMavlinkBridgeInitialize(void) {
 }
 MODULE_INITCALL(uavoMavlinkBridgeInitialize, uavoMavlinkBridgeStart)
 
-static void send_message() {
+/**
+ * Append the message in mav_msg to this tick's write, if there is room
+ * \return bytes appended
+ */
+static uint16_t append_message(uint16_t len) {
 	uint16_t msg_length = MAVLINK_NUM_NON_PAYLOAD_BYTES +
 		mav_msg->len;
 
-	PIOS_COM_SendBuffer(mavlink_port, &mav_msg->magic, msg_length);
+	if (len + msg_length > TX_BUF_LEN) {
+		return 0;
+	}
+
+	memcpy(mav->tx_buf + len, &mav_msg->magic, msg_length);
+
+	return msg_length;
 }
 
+/**
+ * Feed one received byte to the parser.
+ * \return true when it completes a request we handle
+ */
+static bool rx_byte(struct mav_rx *rx, uint8_t c)
+{
+	switch (rx->state) {
+	case MAV_RX_IDLE:
+		if (c == MAVLINK_STX) {
+			crc_init(&rx->crc);
+			rx->state = MAV_RX_LEN;
+		}
+		return false;
+	case MAV_RX_LEN:
+		rx->len = c;
+		rx->idx = 0;
+		break;
+	case MAV_RX_MSGID:
+		rx->msgid = c;
+		break;
+	case MAV_RX_PAYLOAD:
+		if (rx->idx < sizeof(rx->payload)) {
+			rx->payload[rx->idx] = c;
+		}
+		rx->idx++;
+		break;
+	case MAV_RX_CK_A:
+		switch (rx->msgid) {
+		case MAVLINK_MSG_ID_REQUEST_DATA_STREAM:
+			crc_accumulate(REQUEST_DATA_STREAM_CRC_EXTRA, &rx->crc);
+			break;
+		case MAVLINK_MSG_ID_COMMAND_LONG:
+			crc_accumulate(COMMAND_LONG_CRC_EXTRA, &rx->crc);
+			break;
+		default:
+			break;
+		}
+
+		if (c != (rx->crc & 0xFF)) {
+			rx->state = MAV_RX_IDLE;
+			return false;
+		}
+
+		rx->state = MAV_RX_CK_B;
+		return false;
+	case MAV_RX_CK_B:
+		rx->state = MAV_RX_IDLE;
+
+		if (c != (rx->crc >> 8)) {
+			return false;
+		}
+
+		switch (rx->msgid) {
+		case MAVLINK_MSG_ID_REQUEST_DATA_STREAM:
+			return rx->len == MAVLINK_MSG_ID_REQUEST_DATA_STREAM_LEN;
+		case MAVLINK_MSG_ID_COMMAND_LONG:
+			return rx->len == MAVLINK_MSG_ID_COMMAND_LONG_LEN;
+		default:
+			return false;
+		}
+	default:
+		break;
+	}
+
+	crc_accumulate(c, &rx->crc);
+
+	// Header and payload bytes lead on to the next state
+	if (rx->state == MAV_RX_PAYLOAD) {
+		if (rx->idx >= rx->len) {
+			rx->state = MAV_RX_CK_A;
+		}
+	} else if (rx->state == MAV_RX_MSGID) {
+		rx->state = rx->len ? MAV_RX_PAYLOAD : MAV_RX_CK_A;
+	} else {
+		rx->state++;
+	}
+
+	return false;
+}
+
+/**
+ * Act on a request.  We're the only system on the link, so whatever it is
+ * addressed to is taken to be us.
+ * \return bytes of reply appended to this tick's write
+ */
+static uint16_t handle_request(const struct mav_rx *rx, uint16_t len,
+		uint32_t now)
+{
+	memcpy(_MAV_PAYLOAD_NON_CONST(mav_msg), rx->payload, rx->len);
+	mav_msg->len = rx->len;
+	mav_msg->msgid = rx->msgid;
+
+	switch (rx->msgid) {
+	case MAVLINK_MSG_ID_REQUEST_DATA_STREAM: {
+		mavlink_request_data_stream_t req;
+		mavlink_msg_request_data_stream_decode(mav_msg, &req);
+
+		stream_sched_set_stream_rate(&mav->sched, req.req_stream_id,
+				req.req_message_rate, req.start_stop, now);
+		return 0;
+	}
+	case MAVLINK_MSG_ID_COMMAND_LONG: {
+		mavlink_command_long_t cmd;
+		mavlink_msg_command_long_decode(mav_msg, &cmd);
+
+		uint8_t result = MAV_RESULT_UNSUPPORTED;
+
+		if (cmd.command == MAV_CMD_SET_MESSAGE_INTERVAL) {
+			// param1 is the message, param2 the interval in us
+			if (stream_sched_set_interval(&mav->sched,
+					(uint8_t) cmd.param1,
+					(int32_t) cmd.param2, now)) {
+				result = MAV_RESULT_FAILED;
+			} else {
+				result = MAV_RESULT_ACCEPTED;
+			}
+		}
+
+		mavlink_msg_command_ack_pack(MAV_SYSTEM_ID, MAV_COMPONENT_ID,
+				mav_msg, cmd.command, result);
+
+		return append_message(len);
+	}
+	default:
+		return 0;
+	}
+}
+
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+/**
+ * Executor job, run every TICK_MS.
+ */
+static void uavoMavlinkBridgeJob(const UAVObjEvent *ev, void *ctx)
+{
+	(void) ev; (void) ctx;
+
+	uavoMavlinkBridgeStep();
+}
+#else
 /**
  * Main task. It does not return.
  */
@@ -160,347 +445,319 @@ static void uavoMavlinkBridgeTask(void *parameters) {
 	// Main task loop
 	lastSysTime = PIOS_Thread_Systime();
 
-	FlightBatterySettingsData batSettings = {};
-
-	if (FlightBatterySettingsHandle() != NULL )
-		FlightBatterySettingsGet(&batSettings);
-
-	SystemStatsData systemStats;
-
 	while (1) {
-		PIOS_Thread_Sleep_Until(&lastSysTime, 1000 / TASK_RATE_HZ);
-
-		if (stream_trigger(MAV_DATA_STREAM_EXTENDED_STATUS)) {
-			FlightBatteryStateData batState = {};
-
-			if (FlightBatteryStateHandle() != NULL )
-				FlightBatteryStateGet(&batState);
+		PIOS_Thread_Sleep_Until(&lastSysTime, TICK_MS);
 
-			SystemStatsGet(&systemStats);
+		uavoMavlinkBridgeStep();
+	}
+}
+#endif
 
-			int8_t battery_remaining = 0;
-			if (batSettings.Capacity != 0) {
-				if (batState.ConsumedEnergy < batSettings.Capacity) {
-					battery_remaining = 100 - lroundf(batState.ConsumedEnergy / batSettings.Capacity * 100);
+/**
+ * Answer any requests, then pack the messages that are due, most overdue
+ * first, into one write as far as the link budget allows.
+ */
+static void uavoMavlinkBridgeStep(void) {
+	uint32_t now = PIOS_Thread_Systime();
+	uint16_t len = 0;
+
+	if (mavlink_rx) {
+		uint8_t rx_buf[16];
+		uint16_t received;
+
+		while ((received = PIOS_COM_ReceiveBuffer(mavlink_port,
+						rx_buf, sizeof(rx_buf), 0)) > 0) {
+			for (uint16_t i = 0; i < received; i++) {
+				if (rx_byte(&mav->rx, rx_buf[i])) {
+					len += handle_request(&mav->rx, len, now);
 				}
 			}
-
-			uint16_t voltage = 0;
-			if (batSettings.VoltagePin != FLIGHTBATTERYSETTINGS_VOLTAGEPIN_NONE)
-				voltage = lroundf(batState.Voltage * 1000);
-
-			uint16_t current = 0;
-			if (batSettings.CurrentPin != FLIGHTBATTERYSETTINGS_CURRENTPIN_NONE)
-				current = lroundf(batState.Current * 100);
-
-			mavlink_msg_sys_status_pack(0, 200, mav_msg,
-					// onboard_control_sensors_present Bitmask showing which onboard controllers and sensors are present. Value of 0: not present. Value of 1: present. Indices: 0: 3D gyro, 1: 3D acc, 2: 3D mag, 3: absolute pressure, 4: differential pressure, 5: GPS, 6: optical flow, 7: computer vision position, 8: laser based position, 9: external ground-truth (Vicon or Leica). Controllers: 10: 3D angular rate control 11: attitude stabilization, 12: yaw position, 13: z/altitude control, 14: x/y position control, 15: motor outputs / control
-					0,
-					// onboard_control_sensors_enabled Bitmask showing which onboard controllers and sensors are enabled:  Value of 0: not enabled. Value of 1: enabled. Indices: 0: 3D gyro, 1: 3D acc, 2: 3D mag, 3: absolute pressure, 4: differential pressure, 5: GPS, 6: optical flow, 7: computer vision position, 8: laser based position, 9: external ground-truth (Vicon or Leica). Controllers: 10: 3D angular rate control 11: attitude stabilization, 12: yaw position, 13: z/altitude control, 14: x/y position control, 15: motor outputs / control
-					0,
-					// onboard_control_sensors_health Bitmask showing which onboard controllers and sensors are operational or have an error:  Value of 0: not enabled. Value of 1: enabled. Indices: 0: 3D gyro, 1: 3D acc, 2: 3D mag, 3: absolute pressure, 4: differential pressure, 5: GPS, 6: optical flow, 7: computer vision position, 8: laser based position, 9: external ground-truth (Vicon or Leica). Controllers: 10: 3D angular rate control 11: attitude stabilization, 12: yaw position, 13: z/altitude control, 14: x/y position control, 15: motor outputs / control
-					0,
-					// load Maximum usage in percent of the mainloop time, (0%: 0, 100%: 1000) should be always below 1000
-					(uint16_t)systemStats.CPULoad * 10,
-					// voltage_battery Battery voltage, in millivolts (1 = 1 millivolt)
-					voltage,
-					// current_battery Battery current, in 10*milliamperes (1 = 10 milliampere), -1: autopilot does not measure the current
-					current,
-					// battery_remaining Remaining battery energy: (0%: 0, 100%: 100), -1: autopilot estimate the remaining battery
-					battery_remaining,
-					// drop_rate_comm Communication drops in percent, (0%: 0, 100%: 10'000), (UART, I2C, SPI, CAN), dropped packets on all links (packets that were corrupted on reception on the MAV)
-					0,
-					// errors_comm Communication errors (UART, I2C, SPI, CAN), dropped packets on all links (packets that were corrupted on reception on the MAV)
-					0,
-					// errors_count1 Autopilot-specific errors
-					0,
-					// errors_count2 Autopilot-specific errors
-					0,
-					// errors_count3 Autopilot-specific errors
-					0,
-					// errors_count4 Autopilot-specific errors
-					0);
-
-			send_message();
 		}
+	}
 
-		if (stream_trigger(MAV_DATA_STREAM_RC_CHANNELS)) {
-			ManualControlCommandData manualState;
-			FlightStatusData flightStatus;
-
-			ManualControlCommandGet(&manualState);
-			FlightStatusGet(&flightStatus);
-			SystemStatsGet(&systemStats);
-
-			//TODO connect with RSSI object and pass in last argument
-			mavlink_msg_rc_channels_raw_pack(0, 200, mav_msg,
-					// time_boot_ms Timestamp (milliseconds since system boot)
-					systemStats.FlightTime,
-					// port Servo output port (set of 8 outputs = 1 port). Most MAVs will just use one, but this allows to encode more than 8 servos.
-					0,
-					// chan1_raw RC channel 1 value, in microseconds
-					manualState.Channel[0],
-					// chan2_raw RC channel 2 value, in microseconds
-					manualState.Channel[1],
-					// chan3_raw RC channel 3 value, in microseconds
-					manualState.Channel[2],
-					// chan4_raw RC channel 4 value, in microseconds
-					manualState.Channel[3],
-					// chan5_raw RC channel 5 value, in microseconds
-					manualState.Channel[4],
-					// chan6_raw RC channel 6 value, in microseconds
-					manualState.Channel[5],
-					// chan7_raw RC channel 7 value, in microseconds
-					manualState.Channel[6],
-					// chan8_raw RC channel 8 value, in microseconds
-					manualState.Channel[7],
-					// rssi Receive signal strength indicator, 0: 0%, 255: 100%
-					manualState.Rssi);
-
-			send_message();
-		}
+	stream_sched_tick(&mav->sched, now);
 
-		if (stream_trigger(MAV_DATA_STREAM_POSITION)) {
-			GPSPositionData gpsPosData = {};
-			HomeLocationData homeLocation = {};
-			SystemStatsGet(&systemStats);
-
-			if (GPSPositionHandle() != NULL )
-				GPSPositionGet(&gpsPosData);
-			if (HomeLocationHandle() != NULL )
-				HomeLocationGet(&homeLocation);
-			SystemStatsGet(&systemStats);
-
-			uint8_t gps_fix_type;
-			switch (gpsPosData.Status)
-			{
-			case GPSPOSITION_STATUS_NOGPS:
-				gps_fix_type = 0;
-				break;
-			case GPSPOSITION_STATUS_NOFIX:
-				gps_fix_type = 1;
-				break;
-			case GPSPOSITION_STATUS_FIX2D:
-				gps_fix_type = 2;
-				break;
-			case GPSPOSITION_STATUS_FIX3D:
-			case GPSPOSITION_STATUS_DIFF3D:
-				gps_fix_type = 3;
-				break;
-			default:
-				gps_fix_type = 0;
-				break;
-			}
+	struct telemetry_snapshot snap;
+	bool sampled = false;
+	int idx;
 
-			mavlink_msg_gps_raw_int_pack(0, 200, mav_msg,
-					// time_usec Timestamp (microseconds since UNIX epoch or microseconds since system boot)
-					(uint64_t)systemStats.FlightTime * 1000,
-					// fix_type 0-1: no fix, 2: 2D fix, 3: 3D fix. Some applications will not use the value of this field unless it is at least two, so always correctly fill in the fix.
-					gps_fix_type,
-					// lat Latitude in 1E7 degrees
-					gpsPosData.Latitude,
-					// lon Longitude in 1E7 degrees
-					gpsPosData.Longitude,
-					// alt Altitude in 1E3 meters (millimeters) above MSL
-					gpsPosData.Altitude * 1000,
-					// eph GPS HDOP horizontal dilution of position in cm (m*100). If unknown, set to: 65535
-					gpsPosData.HDOP * 100,
-					// epv GPS VDOP horizontal dilution of position in cm (m*100). If unknown, set to: 65535
-					gpsPosData.VDOP * 100,
-					// vel GPS ground speed (m/s * 100). If unknown, set to: 65535
-					gpsPosData.Groundspeed * 100,
-					// cog Course over ground (NOT heading, but direction of movement) in degrees * 100, 0.0..359.99 degrees. If unknown, set to: 65535
-					gpsPosData.Heading * 100,
-					// satellites_visible Number of satellites visible. If unknown, set to 255
-					gpsPosData.Satellites);
-
-			send_message();
-
-			mavlink_msg_gps_global_origin_pack(0, 200, mav_msg,
-					// latitude Latitude (WGS84), expressed as * 1E7
-					homeLocation.Latitude,
-					// longitude Longitude (WGS84), expressed as * 1E7
-					homeLocation.Longitude,
-					// altitude Altitude(WGS84), expressed as * 1000
-					homeLocation.Altitude * 1000);
-
-			send_message();
-
-			//TODO add waypoint nav stuff
-			//wp_target_bearing
-			//wp_dist = mavlink_msg_nav_controller_output_get_wp_dist(&msg);
-			//alt_error = mavlink_msg_nav_controller_output_get_alt_error(&msg);
-			//aspd_error = mavlink_msg_nav_controller_output_get_aspd_error(&msg);
-			//xtrack_error = mavlink_msg_nav_controller_output_get_xtrack_error(&msg);
-			//mavlink_msg_nav_controller_output_pack
-			//wp_number
-			//mavlink_msg_mission_current_pack
+	while ((idx = stream_sched_next(&mav->sched, now,
+					TX_BUF_LEN - len)) >= 0) {
+		// Only sample when something is due
+		if (!sampled) {
+			telemetry_snapshot_get(&snap);
+			sampled = true;
 		}
 
-		if (stream_trigger(MAV_DATA_STREAM_EXTRA1)) {
-			AttitudeActualData attActual;
-			SystemStatsData systemStats;
-
-			AttitudeActualGet(&attActual);
-			SystemStatsGet(&systemStats);
-
-			mavlink_msg_attitude_pack(0, 200, mav_msg,
-					// time_boot_ms Timestamp (milliseconds since system boot)
-					systemStats.FlightTime,
-					// roll Roll angle (rad)
-					attActual.Roll * DEG2RAD,
-					// pitch Pitch angle (rad)
-					attActual.Pitch * DEG2RAD,
-					// yaw Yaw angle (rad)
-					attActual.Yaw * DEG2RAD,
-					// rollspeed Roll angular speed (rad/s)
-					0,
-					// pitchspeed Pitch angular speed (rad/s)
-					0,
-					// yawspeed Yaw angular speed (rad/s)
-					0);
-
-			send_message();
-		}
+		mav_packers[idx](&snap);
 
-		if (stream_trigger(MAV_DATA_STREAM_EXTRA2)) {
-			ActuatorDesiredData actDesired;
-			AttitudeActualData attActual;
-			AirspeedActualData airspeedActual = {};
-			GPSPositionData gpsPosData = {};
-			BaroAltitudeData baroAltitude = {};
-			FlightStatusData flightStatus;
-
-			if (AirspeedActualHandle() != NULL )
-				AirspeedActualGet(&airspeedActual);
-			if (GPSPositionHandle() != NULL )
-				GPSPositionGet(&gpsPosData);
-			if (BaroAltitudeHandle() != NULL )
-				BaroAltitudeGet(&baroAltitude);
-			ActuatorDesiredGet(&actDesired);
-			AttitudeActualGet(&attActual);
-			FlightStatusGet(&flightStatus);
-
-			float altitude = 0;
-			if (BaroAltitudeHandle() != NULL)
-				altitude = baroAltitude.Altitude;
-			else if (GPSPositionHandle() != NULL)
-				altitude = gpsPosData.Altitude;
-
-			// round attActual.Yaw to nearest int and transfer from (-180 ... 180) to (0 ... 360)
-			int16_t heading = lroundf(attActual.Yaw);
-			if (heading < 0)
-				heading += 360;
-
-			mavlink_msg_vfr_hud_pack(0, 200, mav_msg,
-					// airspeed Current airspeed in m/s
-					airspeedActual.TrueAirspeed,
-					// groundspeed Current ground speed in m/s
-					gpsPosData.Groundspeed,
-					// heading Current heading in degrees, in compass units (0..360, 0=north)
-					heading,
-					// throttle Current throttle setting in integer percent, 0 to 100
-					actDesired.Thrust * 100,
-					// alt Current altitude (MSL), in meters
-					altitude,
-					// climb Current climb rate in meters/second
-					0);
-
-			send_message();
-
-			uint8_t armed_mode = 0;
-			if (flightStatus.Armed == FLIGHTSTATUS_ARMED_ARMED)
-				armed_mode |= MAV_MODE_FLAG_SAFETY_ARMED;
-
-			uint8_t custom_mode = CUSTOM_MODE_STAB;
-
-			switch (flightStatus.FlightMode) {
-				case FLIGHTSTATUS_FLIGHTMODE_MANUAL:
-				case FLIGHTSTATUS_FLIGHTMODE_VIRTUALBAR:
-				case FLIGHTSTATUS_FLIGHTMODE_HORIZON:
-					/* Kinda a catch all */
-					custom_mode = CUSTOM_MODE_SPORT;
-					break;
-				case FLIGHTSTATUS_FLIGHTMODE_ACRO:
-				case FLIGHTSTATUS_FLIGHTMODE_AXISLOCK:
-					custom_mode = CUSTOM_MODE_ACRO;
-					break;
-				case FLIGHTSTATUS_FLIGHTMODE_STABILIZED1:
-				case FLIGHTSTATUS_FLIGHTMODE_STABILIZED2:
-				case FLIGHTSTATUS_FLIGHTMODE_STABILIZED3:
-					/* May want these three to try and
-					 * infer based on roll axis */
-				case FLIGHTSTATUS_FLIGHTMODE_LEVELING:
-					custom_mode = CUSTOM_MODE_STAB;
-					break;
-				case FLIGHTSTATUS_FLIGHTMODE_AUTOTUNE:
-					custom_mode = CUSTOM_MODE_DRIFT;
-					break;
-				case FLIGHTSTATUS_FLIGHTMODE_ALTITUDEHOLD:
-					custom_mode = CUSTOM_MODE_ALTH;
-					break;
-				case FLIGHTSTATUS_FLIGHTMODE_RETURNTOHOME:
-					custom_mode = CUSTOM_MODE_RTL;
-					break;
-				case FLIGHTSTATUS_FLIGHTMODE_TABLETCONTROL:
-				case FLIGHTSTATUS_FLIGHTMODE_POSITIONHOLD:
-					custom_mode = CUSTOM_MODE_POSH;
-					break;
-				case FLIGHTSTATUS_FLIGHTMODE_FAILSAFE:
-					/* (make it clear we're in charge) */
-				case FLIGHTSTATUS_FLIGHTMODE_PATHPLANNER:
-					custom_mode = CUSTOM_MODE_AUTO;
-					break;
-			}
+		uint16_t msg_length = append_message(len);
+
+		len += msg_length;
+		stream_sched_sent(&mav->sched, idx, msg_length, now);
+	}
+
+	if (len) {
+		// A full port drops the lot; the schedule has moved on anyway
+		PIOS_COM_SendBufferNonBlocking(mavlink_port, mav->tx_buf, len);
+	}
+}
 
-			mavlink_msg_heartbeat_pack(0, 200, mav_msg,
-					// type Type of the MAV (quadrotor, helicopter, etc., up to 15 types, defined in MAV_TYPE ENUM)
-					MAV_TYPE_GENERIC,
-					// autopilot Autopilot type / class. defined in MAV_AUTOPILOT ENUM
-					MAV_AUTOPILOT_GENERIC,
-					// base_mode System mode bitfield, see MAV_MODE_FLAGS ENUM in mavlink/include/mavlink_types.h
-					armed_mode,
-					// custom_mode A bitfield for use for autopilot-specific flags.
-					custom_mode,
-					// system_status System status flag, see MAV_STATE ENUM
-					0);
-
-			send_message();
+static void pack_sys_status(const struct telemetry_snapshot *snap)
+{
+	int8_t battery_remaining = 0;
+	if (snap->battery_capacity != 0) {
+		if (snap->consumed_energy < snap->battery_capacity) {
+			battery_remaining = 100 - lroundf(snap->consumed_energy / snap->battery_capacity * 100);
 		}
 	}
+
+	uint16_t voltage = lroundf(snap->battery_voltage * 1000);
+	uint16_t current = lroundf(snap->battery_current * 100);
+
+	mavlink_msg_sys_status_pack(MAV_SYSTEM_ID, MAV_COMPONENT_ID, mav_msg,
+			// onboard_control_sensors_present Bitmask showing which onboard controllers and sensors are present. Value of 0: not present. Value of 1: present. Indices: 0: 3D gyro, 1: 3D acc, 2: 3D mag, 3: absolute pressure, 4: differential pressure, 5: GPS, 6: optical flow, 7: computer vision position, 8: laser based position, 9: external ground-truth (Vicon or Leica). Controllers: 10: 3D angular rate control 11: attitude stabilization, 12: yaw position, 13: z/altitude control, 14: x/y position control, 15: motor outputs / control
+			0,
+			// onboard_control_sensors_enabled Bitmask showing which onboard controllers and sensors are enabled:  Value of 0: not enabled. Value of 1: enabled. Indices: 0: 3D gyro, 1: 3D acc, 2: 3D mag, 3: absolute pressure, 4: differential pressure, 5: GPS, 6: optical flow, 7: computer vision position, 8: laser based position, 9: external ground-truth (Vicon or Leica). Controllers: 10: 3D angular rate control 11: attitude stabilization, 12: yaw position, 13: z/altitude control, 14: x/y position control, 15: motor outputs / control
+			0,
+			// onboard_control_sensors_health Bitmask showing which onboard controllers and sensors are operational or have an error:  Value of 0: not enabled. Value of 1: enabled. Indices: 0: 3D gyro, 1: 3D acc, 2: 3D mag, 3: absolute pressure, 4: differential pressure, 5: GPS, 6: optical flow, 7: computer vision position, 8: laser based position, 9: external ground-truth (Vicon or Leica). Controllers: 10: 3D angular rate control 11: attitude stabilization, 12: yaw position, 13: z/altitude control, 14: x/y position control, 15: motor outputs / control
+			0,
+			// load Maximum usage in percent of the mainloop time, (0%: 0, 100%: 1000) should be always below 1000
+			(uint16_t)snap->cpu_load * 10,
+			// voltage_battery Battery voltage, in millivolts (1 = 1 millivolt)
+			voltage,
+			// current_battery Battery current, in 10*milliamperes (1 = 10 milliampere), -1: autopilot does not measure the current
+			current,
+			// battery_remaining Remaining battery energy: (0%: 0, 100%: 100), -1: autopilot estimate the remaining battery
+			battery_remaining,
+			// drop_rate_comm Communication drops in percent, (0%: 0, 100%: 10'000), (UART, I2C, SPI, CAN), dropped packets on all links (packets that were corrupted on reception on the MAV)
+			0,
+			// errors_comm Communication errors (UART, I2C, SPI, CAN), dropped packets on all links (packets that were corrupted on reception on the MAV)
+			0,
+			// errors_count1 Autopilot-specific errors
+			0,
+			// errors_count2 Autopilot-specific errors
+			0,
+			// errors_count3 Autopilot-specific errors
+			0,
+			// errors_count4 Autopilot-specific errors
+			0);
 }
 
-static bool stream_trigger(enum MAV_DATA_STREAM stream_num) {
-	uint8_t rate = (uint8_t) mav_rates[stream_num];
+static void pack_rc_channels_raw(const struct telemetry_snapshot *snap)
+{
+	//TODO connect with RSSI object and pass in last argument
+	mavlink_msg_rc_channels_raw_pack(MAV_SYSTEM_ID, MAV_COMPONENT_ID, mav_msg,
+			// time_boot_ms Timestamp (milliseconds since system boot)
+			snap->flight_time,
+			// port Servo output port (set of 8 outputs = 1 port). Most MAVs will just use one, but this allows to encode more than 8 servos.
+			0,
+			// chan1_raw RC channel 1 value, in microseconds
+			snap->channels[0],
+			// chan2_raw RC channel 2 value, in microseconds
+			snap->channels[1],
+			// chan3_raw RC channel 3 value, in microseconds
+			snap->channels[2],
+			// chan4_raw RC channel 4 value, in microseconds
+			snap->channels[3],
+			// chan5_raw RC channel 5 value, in microseconds
+			snap->channels[4],
+			// chan6_raw RC channel 6 value, in microseconds
+			snap->channels[5],
+			// chan7_raw RC channel 7 value, in microseconds
+			snap->channels[6],
+			// chan8_raw RC channel 8 value, in microseconds
+			snap->channels[7],
+			// rssi Receive signal strength indicator, 0: 0%, 255: 100%
+			snap->rssi);
+}
 
-	if (rate == 0) {
-		return false;
+static void pack_gps_raw_int(const struct telemetry_snapshot *snap)
+{
+	uint8_t gps_fix_type;
+	switch (snap->gps_status)
+	{
+	case GPSPOSITION_STATUS_NOGPS:
+		gps_fix_type = 0;
+		break;
+	case GPSPOSITION_STATUS_NOFIX:
+		gps_fix_type = 1;
+		break;
+	case GPSPOSITION_STATUS_FIX2D:
+		gps_fix_type = 2;
+		break;
+	case GPSPOSITION_STATUS_FIX3D:
+	case GPSPOSITION_STATUS_DIFF3D:
+		gps_fix_type = 3;
+		break;
+	default:
+		gps_fix_type = 0;
+		break;
 	}
 
-	if (stream_ticks[stream_num] == 0) {
-		// we're triggering now, setup the next trigger point
-		if (rate > TASK_RATE_HZ) {
-			rate = TASK_RATE_HZ;
-		}
-		stream_ticks[stream_num] = (TASK_RATE_HZ / rate);
-		return true;
-	}
+	mavlink_msg_gps_raw_int_pack(MAV_SYSTEM_ID, MAV_COMPONENT_ID, mav_msg,
+			// time_usec Timestamp (microseconds since UNIX epoch or microseconds since system boot)
+			(uint64_t)snap->flight_time * 1000,
+			// fix_type 0-1: no fix, 2: 2D fix, 3: 3D fix. Some applications will not use the value of this field unless it is at least two, so always correctly fill in the fix.
+			gps_fix_type,
+			// lat Latitude in 1E7 degrees
+			snap->latitude,
+			// lon Longitude in 1E7 degrees
+			snap->longitude,
+			// alt Altitude in 1E3 meters (millimeters) above MSL
+			snap->gps_altitude * 1000,
+			// eph GPS HDOP horizontal dilution of position in cm (m*100). If unknown, set to: 65535
+			snap->hdop * 100,
+			// epv GPS VDOP horizontal dilution of position in cm (m*100). If unknown, set to: 65535
+			snap->vdop * 100,
+			// vel GPS ground speed (m/s * 100). If unknown, set to: 65535
+			snap->groundspeed * 100,
+			// cog Course over ground (NOT heading, but direction of movement) in degrees * 100, 0.0..359.99 degrees. If unknown, set to: 65535
+			snap->course * 100,
+			// satellites_visible Number of satellites visible. If unknown, set to 255
+			snap->gps_satellites);
+}
 
-	// count down at 50Hz
-	stream_ticks[stream_num]--;
-	return false;
+static void pack_gps_global_origin(const struct telemetry_snapshot *snap)
+{
+	mavlink_msg_gps_global_origin_pack(MAV_SYSTEM_ID, MAV_COMPONENT_ID, mav_msg,
+			// latitude Latitude (WGS84), expressed as * 1E7
+			snap->home_latitude,
+			// longitude Longitude (WGS84), expressed as * 1E7
+			snap->home_longitude,
+			// altitude Altitude(WGS84), expressed as * 1000
+			snap->home_altitude * 1000);
+
+	//TODO add waypoint nav stuff
+	//wp_target_bearing
+	//wp_dist = mavlink_msg_nav_controller_output_get_wp_dist(&msg);
+	//alt_error = mavlink_msg_nav_controller_output_get_alt_error(&msg);
+	//aspd_error = mavlink_msg_nav_controller_output_get_aspd_error(&msg);
+	//xtrack_error = mavlink_msg_nav_controller_output_get_xtrack_error(&msg);
+	//mavlink_msg_nav_controller_output_pack
+	//wp_number
+	//mavlink_msg_mission_current_pack
 }
 
-static void updateSettings()
+static void pack_attitude(const struct telemetry_snapshot *snap)
 {
-	
-	if (mavlink_port) {
-		// Retrieve settings
-		uint8_t speed;
-		ModuleSettingsMavlinkSpeedGet(&speed);
+	mavlink_msg_attitude_pack(MAV_SYSTEM_ID, MAV_COMPONENT_ID, mav_msg,
+			// time_boot_ms Timestamp (milliseconds since system boot)
+			snap->flight_time,
+			// roll Roll angle (rad)
+			snap->roll * DEG2RAD,
+			// pitch Pitch angle (rad)
+			snap->pitch * DEG2RAD,
+			// yaw Yaw angle (rad)
+			snap->yaw * DEG2RAD,
+			// rollspeed Roll angular speed (rad/s)
+			0,
+			// pitchspeed Pitch angular speed (rad/s)
+			0,
+			// yawspeed Yaw angular speed (rad/s)
+			0);
+}
+
+static void pack_vfr_hud(const struct telemetry_snapshot *snap)
+{
+	float thrust;
+	ActuatorDesiredThrustGet(&thrust);
+
+	float altitude = 0;
+	if (snap->have_baro)
+		altitude = snap->baro_altitude;
+	else if (snap->have_gps)
+		altitude = snap->gps_altitude;
+
+	// round the yaw to nearest int and transfer from (-180 ... 180) to (0 ... 360)
+	int16_t heading = lroundf(snap->yaw);
+	if (heading < 0)
+		heading += 360;
+
+	mavlink_msg_vfr_hud_pack(MAV_SYSTEM_ID, MAV_COMPONENT_ID, mav_msg,
+			// airspeed Current airspeed in m/s
+			snap->true_airspeed,
+			// groundspeed Current ground speed in m/s
+			snap->groundspeed,
+			// heading Current heading in degrees, in compass units (0..360, 0=north)
+			heading,
+			// throttle Current throttle setting in integer percent, 0 to 100
+			thrust * 100,
+			// alt Current altitude (MSL), in meters
+			altitude,
+			// climb Current climb rate in meters/second
+			0);
+}
 
-		PIOS_HAL_ConfigureSerialSpeed(mavlink_port, speed);
+static void pack_heartbeat(const struct telemetry_snapshot *snap)
+{
+	uint8_t armed_mode = 0;
+	if (snap->armed == FLIGHTSTATUS_ARMED_ARMED)
+		armed_mode |= MAV_MODE_FLAG_SAFETY_ARMED;
+
+	uint8_t custom_mode = CUSTOM_MODE_STAB;
+
+	switch (snap->flight_mode) {
+		case FLIGHTSTATUS_FLIGHTMODE_MANUAL:
+		case FLIGHTSTATUS_FLIGHTMODE_VIRTUALBAR:
+		case FLIGHTSTATUS_FLIGHTMODE_HORIZON:
+			/* Kinda a catch all */
+			custom_mode = CUSTOM_MODE_SPORT;
+			break;
+		case FLIGHTSTATUS_FLIGHTMODE_ACRO:
+		case FLIGHTSTATUS_FLIGHTMODE_AXISLOCK:
+			custom_mode = CUSTOM_MODE_ACRO;
+			break;
+		case FLIGHTSTATUS_FLIGHTMODE_STABILIZED1:
+		case FLIGHTSTATUS_FLIGHTMODE_STABILIZED2:
+		case FLIGHTSTATUS_FLIGHTMODE_STABILIZED3:
+			/* May want these three to try and
+			 * infer based on roll axis */
+		case FLIGHTSTATUS_FLIGHTMODE_LEVELING:
+			custom_mode = CUSTOM_MODE_STAB;
+			break;
+		case FLIGHTSTATUS_FLIGHTMODE_AUTOTUNE:
+			custom_mode = CUSTOM_MODE_DRIFT;
+			break;
+		case FLIGHTSTATUS_FLIGHTMODE_ALTITUDEHOLD:
+			custom_mode = CUSTOM_MODE_ALTH;
+			break;
+		case FLIGHTSTATUS_FLIGHTMODE_RETURNTOHOME:
+			custom_mode = CUSTOM_MODE_RTL;
+			break;
+		case FLIGHTSTATUS_FLIGHTMODE_TABLETCONTROL:
+		case FLIGHTSTATUS_FLIGHTMODE_POSITIONHOLD:
+			custom_mode = CUSTOM_MODE_POSH;
+			break;
+		case FLIGHTSTATUS_FLIGHTMODE_FAILSAFE:
+			/* (make it clear we're in charge) */
+		case FLIGHTSTATUS_FLIGHTMODE_PATHPLANNER:
+			custom_mode = CUSTOM_MODE_AUTO;
+			break;
 	}
+
+	mavlink_msg_heartbeat_pack(MAV_SYSTEM_ID, MAV_COMPONENT_ID, mav_msg,
+			// type Type of the MAV (quadrotor, helicopter, etc., up to 15 types, defined in MAV_TYPE ENUM)
+			MAV_TYPE_GENERIC,
+			// autopilot Autopilot type / class. defined in MAV_AUTOPILOT ENUM
+			MAV_AUTOPILOT_GENERIC,
+			// base_mode System mode bitfield, see MAV_MODE_FLAGS ENUM in mavlink/include/mavlink_types.h
+			armed_mode,
+			// custom_mode A bitfield for use for autopilot-specific flags.
+			custom_mode,
+			// system_status System status flag, see MAV_STATE ENUM
+			0);
+}
+
+static uint8_t updateSettings()
+{
+	// Retrieve settings
+	uint8_t speed;
+	ModuleSettingsMavlinkSpeedGet(&speed);
+
+	PIOS_HAL_ConfigureSerialSpeed(mavlink_port, speed);
+
+	return speed;
 }
 /**
  * @}
@@ -78,13 +78,14 @@ static int32_t vtol_follower_control_impl(const float dT,
  * Compute desired velocity to follow the desired path from the current location.
  * @param[in] dT the time since last evaluation
  * @param[in] pathDesired the desired path to follow
+ * @param[in] lookahead the planned route ahead of that path, or NULL
  * @param[out] progress the current progress information along that path
  * @returns 0 if successful, <0 if an error occurred
  *
  * The calculated velocity to attempt is stored in @ref VelocityDesired
  */
 int32_t vtol_follower_control_path(const float dT, const PathDesiredData *pathDesired,
-	struct path_status *progress)
+	const PathLookaheadData *lookahead, struct path_status *progress)
 {
 	PositionActualData positionActual;
 	PositionActualGet(&positionActual);
@@ -102,7 +103,10 @@ int32_t vtol_follower_control_path(const float dT, const PathDesiredData *pathDe
 		    velocityActual.East * guidanceSettings.PositionFeedforward,
 		positionActual.Down };
 
-	path_progress(pathDesired, cur_pos_ned, progress);
+	// In the turn onto the next leg, keep flying it past completion
+	// rather than stopping on the corner until the planner moves on
+	const bool turning = path_progress_lookahead(pathDesired, lookahead,
+		cur_pos_ned, progress);
 
 	// Check if we have already completed this leg
 	bool current_leg_completed = 
@@ -120,7 +124,10 @@ int32_t vtol_follower_control_path(const float dT, const PathDesiredData *pathDe
 	const float downError = altitudeSetpoint - positionActual.Down;
 
 	// If leg is completed signal this
-	if (current_leg_completed || pathStatus.fractional_progress > 1.0f) {
+	const bool leg_done = current_leg_completed ||
+		pathStatus.fractional_progress > 1.0f;
+
+	if (leg_done) {
 		const bool criterion_altitude =
 			(downError > -guidanceSettings.WaypointAltitudeTol) ||
 			(!guidanceSettings.ThrottleControl);
@@ -140,8 +147,10 @@ int32_t vtol_follower_control_path(const float dT, const PathDesiredData *pathDe
 		}
 
 		// Wait here for new path segment
-		return vtol_follower_control_impl(dT, pathDesired->End,
-				0, false);
+		if (!turning) {
+			return vtol_follower_control_impl(dT, pathDesired->End,
+					0, false);
+		}
 	}
 	
 	// Interpolate desired velocity and altitude along the path
@@ -176,6 +185,11 @@ int32_t vtol_follower_control_path(const float dT, const PathDesiredData *pathDe
 	velocityDesired.Down = commands_ned[2];
 	VelocityDesiredSet(&velocityDesired);
 
+	// Still turning after completion; the status was set above
+	if (leg_done) {
+		return 0;
+	}
+
 	pathStatus.Status = PATHSTATUS_STATUS_INPROGRESS;
 	PathStatusSet(&pathStatus);
 
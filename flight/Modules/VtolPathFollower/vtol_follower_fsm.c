@@ -52,6 +52,7 @@
 #include "vtol_follower_priv.h"
 
 #include "pathdesired.h"
+#include "pathlookahead.h"
 #include "positionactual.h"
 #include "vtolpathfollowersettings.h"
 #include "vtolpathfollowerstatus.h"
@@ -113,6 +114,7 @@ static void go_enable_land_home(void);
 // Methods that actually achieve the desired nav mode
 static int32_t do_hold(void);
 static int32_t do_path(void);
+static int32_t follow_path(const PathLookaheadData *lookahead);
 static int32_t do_requested_path(void);
 static int32_t do_land(void);
 static int32_t do_loiter(void);
@@ -418,6 +420,9 @@ static PathDesiredData vtol_fsm_path_desired = {
 	.Waypoint = 8000	// Unlikely to clash with pathplanner
 };
 
+//! The route ahead of a path requested by the path planner
+static PathLookaheadData vtol_fsm_lookahead;
+
 /**
  * Update control values to fly along a path.
  *
@@ -427,9 +432,21 @@ static PathDesiredData vtol_fsm_path_desired = {
  * @return 0 if successful, <0 if failure
  */
 static int32_t do_path()
+{
+	return follow_path(NULL);
+}
+
+/**
+ * Fly along the desired path, turning onto the next leg of the route
+ * early if one is given.
+ * @param[in] lookahead the route ahead, or NULL
+ * @return 0 if successful, <0 if failure
+ */
+static int32_t follow_path(const PathLookaheadData *lookahead)
 {
 	struct path_status progress;
-	if (vtol_follower_control_path(DT, &vtol_fsm_path_desired, &progress) == 0) {
+	if (vtol_follower_control_path(DT, &vtol_fsm_path_desired, lookahead,
+				&progress) == 0) {
 		if (vtol_follower_control_attitude(DT, NULL) == 0) {
 
 			if (progress.fractional_progress >= 1.0f) {
@@ -465,7 +482,8 @@ static int32_t do_requested_path()
 			vtol_hold_position_ned[i] = vtol_fsm_path_desired.End[i];
 		return do_hold();
 	default:
-		return do_path();
+		PathLookaheadGet(&vtol_fsm_lookahead);
+		return follow_path(&vtol_fsm_lookahead);
 	}
 }
 
@@ -30,6 +30,7 @@
 
 #include "openpilot.h"
 #include "pathdesired.h"
+#include "pathlookahead.h"
 #include "paths.h"
 
 /**
@@ -57,7 +58,8 @@ enum vtol_pid {
 };
 
 // Control code public API methods
-int32_t vtol_follower_control_path(const float dT, const PathDesiredData *pathDesired, struct path_status *progress);
+int32_t vtol_follower_control_path(const float dT, const PathDesiredData *pathDesired,
+	const PathLookaheadData *lookahead, struct path_status *progress);
 int32_t vtol_follower_control_endpoint(const float dT, const float *hold_pos_ned);
 int32_t vtol_follower_control_altrate(const float dT, const float *hold_pos_ned,
 		float alt_adj);
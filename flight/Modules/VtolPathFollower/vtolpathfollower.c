@@ -49,6 +49,7 @@
 #include "altitudeholdstate.h"
 #include "modulesettings.h"
 #include "pathdesired.h"        // object that will be updated by the module
+#include "pathlookahead.h"
 #include "flightstatus.h"
 #include "pathstatus.h"
 #include "stabilizationdesired.h"
@@ -130,6 +131,7 @@ int32_t VtolPathFollowerInitialize()
 	if (AccelDesiredInitialize() == -1 \
 		|| AltitudeHoldStateInitialize() == -1 \
 		|| PathDesiredInitialize() == -1 \
+		|| PathLookaheadInitialize() == -1 \
 		|| PathStatusInitialize() == -1 \
 		|| VelocityDesiredInitialize() == -1 \
 		|| VtolPathFollowerStatusInitialize() == -1 ) {
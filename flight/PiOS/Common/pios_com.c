@@ -73,7 +73,8 @@ static struct pios_com_dev *PIOS_COM_alloc(void)
 {
 	struct pios_com_dev *com_dev;
 
-	com_dev = (struct pios_com_dev *)PIOS_malloc(sizeof(*com_dev));
+	com_dev = (struct pios_com_dev *)PIOS_malloc_tagged(sizeof(*com_dev),
+			PIOS_HEAP_TAG_COMMS);
 	if (!com_dev) return (NULL);
 
 	memset(com_dev, 0, sizeof(*com_dev));
@@ -57,6 +57,7 @@ struct pios_crossfire_dev {
 	uint8_t bytes_expected;
 
 	uint16_t channel_data[PIOS_CROSSFIRE_CHANNELS];
+	uint32_t frame_time;
 
 	union {
 		struct crsf_frame_t frame;
@@ -94,6 +95,16 @@ static bool PIOS_Crossfire_Validate(const struct pios_crossfire_dev *dev);
  * @retval raw channel value, or error value (see pios_rcvr.h)
  */
 static int32_t PIOS_Crossfire_Read(uintptr_t id, uint8_t channel);
+/**
+ * @brief Read all channels of the last received frame
+ * @param[in] id Driver instance
+ * @param[out] channels Channel values, 0-based
+ * @param[in] num_channels Room in channels
+ * @param[out] frame_time When the frame arrived
+ * @retval number of channels read, or error value (see pios_rcvr.h)
+ */
+static int32_t PIOS_Crossfire_ReadFrame(uintptr_t id, int16_t *channels,
+		uint8_t num_channels, uint32_t *frame_time);
 /**
  * @brief Set all channels in the last frame buffer to a given value
  * @param[in] dev Driver instance
@@ -130,6 +141,7 @@ static void PIOS_Crossfire_Supervisor(uintptr_t context);
 // public
 const struct pios_rcvr_driver pios_crossfire_rcvr_driver = {
 	.read = PIOS_Crossfire_Read,
+	.read_frame = PIOS_Crossfire_ReadFrame,
 };
 
 
@@ -200,6 +212,17 @@ static int32_t PIOS_Crossfire_Read(uintptr_t context, uint8_t channel)
 	return dev->channel_data[channel];
 }
 
+static int32_t PIOS_Crossfire_ReadFrame(uintptr_t context, int16_t *channels,
+		uint8_t num_channels, uint32_t *frame_time)
+{
+	struct pios_crossfire_dev *dev = (struct pios_crossfire_dev *)context;
+	if (!PIOS_Crossfire_Validate(dev))
+		return PIOS_RCVR_NODRIVER;
+
+	return PIOS_RCVR_CopyFrame(dev->channel_data, PIOS_CROSSFIRE_CHANNELS,
+			dev->frame_time, channels, num_channels, frame_time);
+}
+
 static void PIOS_Crossfire_SetAllChannels(struct pios_crossfire_dev *dev, uint16_t value)
 {
 	for (int i = 0; i < PIOS_CROSSFIRE_CHANNELS; i++)
@@ -307,6 +330,7 @@ static bool PIOS_Crossfire_UnpackFrame(struct pios_crossfire_dev *dev)
 			d[15] = F(s[20] | s[21] << 8, 5);
 
 			// RC control is still happening.
+			dev->frame_time = PIOS_DELAY_GetRaw();
 			dev->failsafe_timer = 0;
 
 			PIOS_Crossfire_ResetBuffer(dev);
@@ -40,6 +40,8 @@
 
 /* Forward Declarations */
 static int32_t PIOS_DSM_Get(uintptr_t rcvr_id, uint8_t channel);
+static int32_t PIOS_DSM_GetFrame(uintptr_t rcvr_id, int16_t *channels,
+				 uint8_t num_channels, uint32_t *frame_time);
 static uint16_t PIOS_DSM_RxInCallback(uintptr_t context,
 				      uint8_t *buf,
 				      uint16_t buf_len,
@@ -50,6 +52,7 @@ static void PIOS_DSM_Supervisor(uintptr_t dsm_id);
 /* Local Variables */
 const struct pios_rcvr_driver pios_dsm_rcvr_driver = {
 	.read = PIOS_DSM_Get,
+	.read_frame = PIOS_DSM_GetFrame,
 };
 
 enum dsm_resolution {
@@ -62,6 +65,7 @@ enum pios_dsm_dev_magic {
 
 struct pios_dsm_state {
 	uint16_t channel_data[PIOS_DSM_NUM_INPUTS];
+	uint32_t frame_time;
 	uint8_t received_data[DSM_FRAME_LENGTH];
 	uint8_t receive_timer;
 	uint8_t failsafe_timer;
@@ -285,6 +289,7 @@ static void PIOS_DSM_UpdateState(struct pios_dsm_dev *dsm_dev, uint8_t byte)
 				/* full frame received - process and wait for new one */
 				if (!PIOS_DSM_UnrollChannels(dsm_dev)) {
 					/* data looking good */
+					state->frame_time = PIOS_DELAY_GetRaw();
 					state->failsafe_timer = 0;
 					PIOS_RCVR_ActiveFromISR();
 				}
@@ -416,6 +421,23 @@ static int32_t PIOS_DSM_Get(uintptr_t rcvr_id, uint8_t channel)
 	return dsm_dev->state.channel_data[channel];
 }
 
+/**
+ * Get all the channels of the latest frame at once
+ */
+static int32_t PIOS_DSM_GetFrame(uintptr_t rcvr_id, int16_t *channels,
+				 uint8_t num_channels, uint32_t *frame_time)
+{
+	struct pios_dsm_dev *dsm_dev = (struct pios_dsm_dev *)rcvr_id;
+
+	if (!PIOS_DSM_Validate(dsm_dev))
+		return PIOS_RCVR_INVALID;
+
+	return PIOS_RCVR_CopyFrame(dsm_dev->state.channel_data,
+				   PIOS_DSM_NUM_INPUTS,
+				   dsm_dev->state.frame_time,
+				   channels, num_channels, frame_time);
+}
+
 /**
  * Input data supervisor is called periodically and provides
  * two functions: frame syncing and failsafe triggering.
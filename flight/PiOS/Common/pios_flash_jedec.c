@@ -71,6 +71,10 @@ struct jedec_flash_dev {
 
 	const struct pios_flash_jedec_cfg *cfg;
 	struct pios_semaphore *transaction_lock;
+#if defined(PIOS_INCLUDE_SPI_QUEUE)
+	struct pios_spi_queue *spi_queue;
+	struct pios_semaphore *spi_done;
+#endif /* PIOS_INCLUDE_SPI_QUEUE */
 	enum pios_jedec_dev_magic magic;
 };
 
@@ -80,6 +84,9 @@ static struct jedec_flash_dev *PIOS_Flash_Jedec_alloc(void);
 
 static int32_t PIOS_Flash_Jedec_ReadID(struct jedec_flash_dev *flash_dev);
 static int32_t PIOS_Flash_Jedec_ReadStatus(struct jedec_flash_dev *flash_dev);
+static int32_t PIOS_Flash_Jedec_Transfer(struct jedec_flash_dev *flash_dev,
+		const uint8_t *cmd, uint8_t *cmd_in, uint16_t cmd_len,
+		const uint8_t *data_out, uint8_t *data_in, uint16_t data_len);
 static int32_t PIOS_Flash_Jedec_ClaimBus(struct jedec_flash_dev *flash_dev);
 static int32_t PIOS_Flash_Jedec_ReleaseBus(struct jedec_flash_dev *flash_dev);
 static int32_t PIOS_Flash_Jedec_WriteEnable(struct jedec_flash_dev *flash_dev);
@@ -140,6 +147,19 @@ int32_t PIOS_Flash_Jedec_Init(uintptr_t *chip_id, uint32_t spi_id, uint32_t slav
 	flash_dev->slave_num = slave_num;
 	flash_dev->cfg = cfg;
 
+#if defined(PIOS_INCLUDE_SPI_QUEUE)
+	/* Use the bus's transaction queue if the board set one up */
+	flash_dev->spi_queue = PIOS_SPI_Queue_Find(spi_id);
+
+	if (flash_dev->spi_queue) {
+		flash_dev->spi_done = PIOS_Semaphore_Create();
+		if (flash_dev->spi_done == NULL)
+			return -1;
+
+		PIOS_Semaphore_Take(flash_dev->spi_done, 0);
+	}
+#endif /* PIOS_INCLUDE_SPI_QUEUE */
+
 	(void) PIOS_Flash_Jedec_ReadID(flash_dev);
 
 	if (flash_dev->manufacturer != flash_dev->cfg->expect_manufacturer) {
@@ -192,6 +212,65 @@ static int32_t PIOS_Flash_Jedec_ReleaseBus(struct jedec_flash_dev *flash_dev)
 	return 0;
 }
 
+/**
+ * @brief Send a command and optionally move data, all under one chip
+ * select.  Goes through the bus's queue at low priority when there is one,
+ * so sensor reads on the same bus are not held up behind page programs.
+ * @param[in] cmd command bytes to send
+ * @param[out] cmd_in where to store what arrives during the command, or NULL
+ * @param[in] data_out data to send after the command, or NULL
+ * @param[out] data_in where to store the data read after the command, or NULL
+ * @param[in] data_len length of the data phase; 0 for none
+ * @return 0 for success, -1 if unable to claim the bus, -2 if the transfer
+ * failed (or the queue's error codes)
+ */
+static int32_t PIOS_Flash_Jedec_Transfer(struct jedec_flash_dev *flash_dev,
+		const uint8_t *cmd, uint8_t *cmd_in, uint16_t cmd_len,
+		const uint8_t *data_out, uint8_t *data_in, uint16_t data_len)
+{
+#if defined(PIOS_INCLUDE_SPI_QUEUE)
+	if (flash_dev->spi_queue) {
+		struct pios_spi_xfer data = {
+			.tx = data_out,
+			.rx = data_in,
+			.len = data_len,
+		};
+		struct pios_spi_xfer command = {
+			.tx = cmd,
+			.rx = cmd_in,
+			.len = cmd_len,
+			.next = data_len ? &data : NULL,
+		};
+		struct pios_spi_txn txn = {
+			.slave = flash_dev->slave_num,
+			.prio = PIOS_SPI_PRIO_LOW,
+			.xfers = &command,
+		};
+
+		return PIOS_SPI_Queue_Transact(flash_dev->spi_queue, &txn,
+				flash_dev->spi_done);
+	}
+#endif /* PIOS_INCLUDE_SPI_QUEUE */
+
+	if (PIOS_Flash_Jedec_ClaimBus(flash_dev) != 0)
+		return -1;
+
+	if (PIOS_SPI_TransferBlock(flash_dev->spi_id, cmd, cmd_in, cmd_len) < 0) {
+		PIOS_Flash_Jedec_ReleaseBus(flash_dev);
+		return -2;
+	}
+
+	if (data_len && PIOS_SPI_TransferBlock(flash_dev->spi_id, data_out,
+				data_in, data_len) < 0) {
+		PIOS_Flash_Jedec_ReleaseBus(flash_dev);
+		return -2;
+	}
+
+	PIOS_Flash_Jedec_ReleaseBus(flash_dev);
+
+	return 0;
+}
+
 /**
  * @brief Returns if the flash chip is busy
  * @returns -1 for failure, 0 for not busy, 1 for busy
@@ -210,14 +289,12 @@ static int32_t PIOS_Flash_Jedec_Busy(struct jedec_flash_dev *flash_dev)
  */
 static int32_t PIOS_Flash_Jedec_WriteEnable(struct jedec_flash_dev *flash_dev)
 {
-	if (PIOS_Flash_Jedec_ClaimBus(flash_dev) != 0)
-		return -1;
-
 	uint8_t out[] = {
 		JEDEC_WRITE_ENABLE,
 	};
-	PIOS_SPI_TransferBlock(flash_dev->spi_id,out,NULL,sizeof(out));
-	PIOS_Flash_Jedec_ReleaseBus(flash_dev);
+
+	if (PIOS_Flash_Jedec_Transfer(flash_dev, out, NULL, sizeof(out), NULL, NULL, 0) != 0)
+		return -1;
 
 	return 0;
 }
@@ -228,20 +305,15 @@ static int32_t PIOS_Flash_Jedec_WriteEnable(struct jedec_flash_dev *flash_dev)
  */
 static int32_t PIOS_Flash_Jedec_ReadStatus(struct jedec_flash_dev *flash_dev)
 {
-	if (PIOS_Flash_Jedec_ClaimBus(flash_dev) < 0)
-		return -1;
-
 	uint8_t out[2] = {
 		JEDEC_READ_STATUS,
 		0,
 	};
 	uint8_t in[2] = {0,0};
-	if (PIOS_SPI_TransferBlock(flash_dev->spi_id,out,in,sizeof(out)) < 0) {
-		PIOS_Flash_Jedec_ReleaseBus(flash_dev);
-		return -2;
-	}
 
-	PIOS_Flash_Jedec_ReleaseBus(flash_dev);
+	int32_t ret = PIOS_Flash_Jedec_Transfer(flash_dev, out, in, sizeof(out), NULL, NULL, 0);
+	if (ret < 0)
+		return ret;
 
 	return in[1];
 }
@@ -251,9 +323,6 @@ static int32_t PIOS_Flash_Jedec_ReadStatus(struct jedec_flash_dev *flash_dev)
  */
 static int32_t PIOS_Flash_Jedec_ReadID(struct jedec_flash_dev *flash_dev)
 {
-	if (PIOS_Flash_Jedec_ClaimBus(flash_dev) < 0)
-		return -2;
-
 	uint8_t out[] = {
 		JEDEC_DEVICE_ID,
 		0,
@@ -261,13 +330,16 @@ static int32_t PIOS_Flash_Jedec_ReadID(struct jedec_flash_dev *flash_dev)
 		0,
 	};
 	uint8_t in[4];
-	if (PIOS_SPI_TransferBlock(flash_dev->spi_id,out,in,sizeof(out)) < 0) {
-		PIOS_Flash_Jedec_ReleaseBus(flash_dev);
+
+	switch (PIOS_Flash_Jedec_Transfer(flash_dev, out, in, sizeof(out), NULL, NULL, 0)) {
+	case 0:
+		break;
+	case -1:
+		return -2;
+	default:
 		return -3;
 	}
 
-	PIOS_Flash_Jedec_ReleaseBus(flash_dev);
-
 	flash_dev->manufacturer = in[1];
 	flash_dev->memorytype   = in[2];
 	flash_dev->capacity     = in[3];
@@ -336,7 +408,7 @@ static int32_t PIOS_Flash_Jedec_EraseSector(uintptr_t chip_id, uint32_t chip_sec
 	if (PIOS_Flash_Jedec_Validate(flash_dev) != 0)
 		return -1;
 
-	uint8_t ret;
+	int32_t ret;
 	uint8_t out[] = {
 		flash_dev->cfg->sector_erase,
 		(chip_offset >> 16) & 0xff,
@@ -347,15 +419,8 @@ static int32_t PIOS_Flash_Jedec_EraseSector(uintptr_t chip_id, uint32_t chip_sec
 	if ((ret = PIOS_Flash_Jedec_WriteEnable(flash_dev)) != 0)
 		return ret;
 
-	if (PIOS_Flash_Jedec_ClaimBus(flash_dev) != 0)
-		return -1;
-
-	if (PIOS_SPI_TransferBlock(flash_dev->spi_id,out,NULL,sizeof(out)) < 0) {
-		PIOS_Flash_Jedec_ReleaseBus(flash_dev);
-		return -2;
-	}
-
-	PIOS_Flash_Jedec_ReleaseBus(flash_dev);
+	if ((ret = PIOS_Flash_Jedec_Transfer(flash_dev, out, NULL, sizeof(out), NULL, NULL, 0)) != 0)
+		return ret;
 
 	// Keep polling when bus is busy too
 	while (PIOS_Flash_Jedec_Busy(flash_dev) != 0) {
@@ -385,7 +450,7 @@ static int32_t PIOS_Flash_Jedec_WriteData(uintptr_t chip_id, uint32_t chip_offse
 	if(PIOS_Flash_Jedec_Validate(flash_dev) != 0)
 		return -1;
 
-	uint8_t ret;
+	int32_t ret;
 	uint8_t out[4] = {
 		JEDEC_PAGE_WRITE,
 		(chip_offset >> 16) & 0xff,
@@ -404,22 +469,9 @@ static int32_t PIOS_Flash_Jedec_WriteData(uintptr_t chip_id, uint32_t chip_offse
 	if ((ret = PIOS_Flash_Jedec_WriteEnable(flash_dev)) != 0)
 		return ret;
 
-	/* Execute write page command and clock in address.  Keep CS asserted */
-	if (PIOS_Flash_Jedec_ClaimBus(flash_dev) != 0)
-		return -1;
-
-	if (PIOS_SPI_TransferBlock(flash_dev->spi_id,out,NULL,sizeof(out)) < 0) {
-		PIOS_Flash_Jedec_ReleaseBus(flash_dev);
-		return -1;
-	}
-
-	/* Clock out data to flash */
-	if (PIOS_SPI_TransferBlock(flash_dev->spi_id,data,NULL,len) < 0) {
-		PIOS_Flash_Jedec_ReleaseBus(flash_dev);
+	/* Execute write page command, clock in address and clock out data */
+	if (PIOS_Flash_Jedec_Transfer(flash_dev, out, NULL, sizeof(out), data, NULL, len) != 0)
 		return -1;
-	}
-
-	PIOS_Flash_Jedec_ReleaseBus(flash_dev);
 
 	// Keep polling when bus is busy too
 #if defined(PIOS_INCLUDE_RTOS)
@@ -457,10 +509,7 @@ static int32_t PIOS_Flash_Jedec_ReadData(uintptr_t chip_id, uint32_t chip_offset
 	if (PIOS_Flash_Jedec_Validate(flash_dev) != 0)
 		return -1;
 
-	if (PIOS_Flash_Jedec_ClaimBus(flash_dev) == -1)
-		return -1;
-
-	/* Execute read command and clock in address.  Keep CS asserted */
+	/* Execute read command, clock in address and copy the data to the buffer */
 	uint8_t out[] = {
 		JEDEC_READ_DATA,
 		(chip_offset >> 16) & 0xff,
@@ -468,20 +517,7 @@ static int32_t PIOS_Flash_Jedec_ReadData(uintptr_t chip_id, uint32_t chip_offset
 		(chip_offset >>  0) & 0xff,
 	};
 
-	if (PIOS_SPI_TransferBlock(flash_dev->spi_id,out,NULL,sizeof(out)) < 0) {
-		PIOS_Flash_Jedec_ReleaseBus(flash_dev);
-		return -2;
-	}
-
-	/* Copy the transfer data to the buffer */
-	if (PIOS_SPI_TransferBlock(flash_dev->spi_id,NULL,data,len) < 0) {
-		PIOS_Flash_Jedec_ReleaseBus(flash_dev);
-		return -3;
-	}
-
-	PIOS_Flash_Jedec_ReleaseBus(flash_dev);
-
-	return 0;
+	return PIOS_Flash_Jedec_Transfer(flash_dev, out, NULL, sizeof(out), NULL, data, len);
 }
 
 /**
@@ -500,10 +536,7 @@ int32_t PIOS_Flash_Jedec_ReadOTPData(uintptr_t chip_id, uint32_t chip_offset, ui
 	if (PIOS_Flash_Jedec_Validate(flash_dev) != 0)
 		return -1;
 
-	if (PIOS_Flash_Jedec_ClaimBus(flash_dev) == -1)
-		return -1;
-
-	/* Execute read command and clock in address.  Keep CS asserted */
+	/* Execute read command, clock in address and copy the data to the buffer */
 	uint8_t out[] = {
 		JEDED_READ_OPT_DATA,
 		(chip_offset >> 16) & 0xff,
@@ -511,20 +544,7 @@ int32_t PIOS_Flash_Jedec_ReadOTPData(uintptr_t chip_id, uint32_t chip_offset, ui
 		(chip_offset >>  0) & 0xff,
 	};
 
-	if (PIOS_SPI_TransferBlock(flash_dev->spi_id,out,NULL,sizeof(out)) < 0) {
-		PIOS_Flash_Jedec_ReleaseBus(flash_dev);
-		return -2;
-	}
-
-	/* Copy the transfer data to the buffer */
-	if (PIOS_SPI_TransferBlock(flash_dev->spi_id,NULL,data,len) < 0) {
-		PIOS_Flash_Jedec_ReleaseBus(flash_dev);
-		return -3;
-	}
-
-	PIOS_Flash_Jedec_ReleaseBus(flash_dev);
-
-	return 0;
+	return PIOS_Flash_Jedec_Transfer(flash_dev, out, NULL, sizeof(out), NULL, data, len);
 }
 
 /* Provide a flash driver to external drivers */
@@ -162,6 +162,10 @@ uintptr_t pios_com_debug_id;
 #define PIOS_COM_MAVLINK_TX_BUF_LEN 128
 #endif
 
+#ifndef PIOS_COM_MAVLINK_RX_BUF_LEN
+#define PIOS_COM_MAVLINK_RX_BUF_LEN 64
+#endif
+
 #ifndef PIOS_COM_MSP_TX_BUF_LEN
 #define PIOS_COM_MSP_TX_BUF_LEN 128
 #endif
@@ -784,7 +788,7 @@ void PIOS_HAL_ConfigurePort(HwSharedPortTypesOptions port_type,
 
 	case HWSHARED_PORTTYPES_MAVLINKTX:
 #if defined(PIOS_INCLUDE_MAVLINK)
-		PIOS_HAL_ConfigureCom(usart_port_cfg, &usart_port_params, 0, PIOS_COM_MAVLINK_TX_BUF_LEN, com_driver, &port_driver_id);
+		PIOS_HAL_ConfigureCom(usart_port_cfg, &usart_port_params, PIOS_COM_MAVLINK_RX_BUF_LEN, PIOS_COM_MAVLINK_TX_BUF_LEN, com_driver, &port_driver_id);
 		target = &pios_com_mavlink_id;
 		PIOS_Modules_Enable(PIOS_MODULE_UAVOMAVLINKBRIDGE);
 #endif          /* PIOS_INCLUDE_MAVLINK */
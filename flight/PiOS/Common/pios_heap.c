@@ -1,6 +1,7 @@
 /**
  ******************************************************************************
  * @file       pios_heap.c
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
  * @author     Tau Labs, http://taulabs.org, Copyright (C) 2013-2014
  * @addtogroup PIOS PIOS Core hardware abstraction layer
  * @{
@@ -50,13 +51,19 @@ bool PIOS_heap_malloc_failed_p(void)
 }
 
 #include "pios_thread.h"
+#include "pios_tlsf.h"
 
 struct pios_heap {
 	const uintptr_t start_addr;
 	uintptr_t end_addr;
-	uintptr_t free_addr;
+	bool initialized;
+	struct pios_tlsf tlsf;
 };
 
+/* Usage per caller tag, summed over both heaps */
+static uint32_t tag_bytes[PIOS_HEAP_TAG_NUM];
+static uint32_t tag_blocks[PIOS_HEAP_TAG_NUM];
+
 static bool is_ptr_in_heap_p(const struct pios_heap *heap, void *buf)
 {
 	uintptr_t buf_addr = (uintptr_t)buf;
@@ -64,46 +71,96 @@ static bool is_ptr_in_heap_p(const struct pios_heap *heap, void *buf)
 	return ((buf_addr >= heap->start_addr) && (buf_addr <= heap->end_addr));
 }
 
-static void * simple_malloc(struct pios_heap *heap, size_t size)
+static void heap_lock(void)
+{
+#if defined(PIOS_INCLUDE_RTOS)
+	PIOS_Thread_Scheduler_Suspend();
+#endif	/* PIOS_INCLUDE_RTOS */
+}
+
+static void heap_unlock(void)
+{
+#if defined(PIOS_INCLUDE_RTOS)
+	PIOS_Thread_Scheduler_Resume();
+#endif	/* PIOS_INCLUDE_RTOS */
+}
+
+/* Must be called with the heap locked */
+static void tlsf_init_heap(struct pios_heap *heap)
+{
+	if (heap->initialized)
+		return;
+
+	PIOS_TLSF_Init(&heap->tlsf, (void *)heap->start_addr,
+			heap->end_addr - heap->start_addr);
+	heap->initialized = true;
+}
+
+static void * tlsf_malloc(struct pios_heap *heap, size_t size,
+		enum pios_heap_tag tag)
 {
 	if (heap == NULL)
 		return NULL;
 
-	void * buf = NULL;
-	uint32_t align_pad = (sizeof(uintptr_t) - (size & (sizeof(uintptr_t) - 1))) % sizeof(uintptr_t);
+	if (tag >= PIOS_HEAP_TAG_NUM)
+		tag = PIOS_HEAP_TAG_OTHER;
 
-#if defined(PIOS_INCLUDE_RTOS) 
-	PIOS_Thread_Scheduler_Suspend();
-#endif	/* PIOS_INCLUDE_RTOS */
+	heap_lock();
+
+	tlsf_init_heap(heap);
+
+	void *buf = PIOS_TLSF_Malloc(&heap->tlsf, size, tag);
 
-	if (heap->free_addr + size <= heap->end_addr) {
-		buf = (void *)heap->free_addr;
-		heap->free_addr += size + align_pad;
+	if (buf != NULL) {
+		tag_bytes[tag] += PIOS_TLSF_BlockSize(buf);
+		tag_blocks[tag]++;
 	}
 
-#if defined(PIOS_INCLUDE_RTOS)
-	PIOS_Thread_Scheduler_Resume();
-#endif	/* PIOS_INCLUDE_RTOS */
+	heap_unlock();
 
 	return buf;
 }
 
-static void simple_free(struct pios_heap *heap, void *buf)
+static void tlsf_free(struct pios_heap *heap, void *buf)
 {
-	/* This allocator doesn't support free */
+	heap_lock();
+
+	uint8_t tag = PIOS_TLSF_BlockTag(buf);
+
+	if (tag < PIOS_HEAP_TAG_NUM) {
+		tag_bytes[tag] -= PIOS_TLSF_BlockSize(buf);
+		tag_blocks[tag]--;
+	}
+
+	PIOS_TLSF_Free(&heap->tlsf, buf);
+
+	heap_unlock();
 }
 
-static size_t simple_get_free_bytes(struct pios_heap *heap)
+static size_t tlsf_get_free_bytes(struct pios_heap *heap)
 {
-	if (heap->free_addr > heap->end_addr)
-		return 0;
+	heap_lock();
+
+	tlsf_init_heap(heap);
 
-	return heap->end_addr - heap->free_addr;
+	size_t free_bytes = PIOS_TLSF_GetFreeSize(&heap->tlsf);
+
+	heap_unlock();
+
+	return free_bytes;
 }
 
-static void simple_extend_heap(struct pios_heap *heap, size_t bytes)
+static size_t tlsf_get_largest_free(struct pios_heap *heap)
 {
-	heap->end_addr += bytes;
+	heap_lock();
+
+	tlsf_init_heap(heap);
+
+	size_t largest = PIOS_TLSF_GetLargestFree(&heap->tlsf);
+
+	heap_unlock();
+
+	return largest;
 }
 
 /*
@@ -115,14 +172,11 @@ extern const void * _sheap;	/* defined in linker script */
 static struct pios_heap pios_standard_heap = {
 	.start_addr = (const uintptr_t)&_sheap,
 	.end_addr   = (const uintptr_t)&_eheap,
-	.free_addr  = (uintptr_t)&_sheap,
 };
 
-
-void * pvPortMalloc(size_t size) __attribute__((alias ("PIOS_malloc"), weak));
-void * PIOS_malloc(size_t size)
+void * PIOS_malloc_tagged(size_t size, enum pios_heap_tag tag)
 {
-	void *buf = simple_malloc(&pios_standard_heap, size);
+	void *buf = tlsf_malloc(&pios_standard_heap, size, tag);
 
 	if (buf == NULL)
 		malloc_failed_hook();
@@ -130,6 +184,12 @@ void * PIOS_malloc(size_t size)
 	return buf;
 }
 
+void * pvPortMalloc(size_t size) __attribute__((alias ("PIOS_malloc"), weak));
+void * PIOS_malloc(size_t size)
+{
+	return PIOS_malloc_tagged(size, PIOS_HEAP_TAG_OTHER);
+}
+
 /*
  * Fast heap.  Memory in this heap is NOT DMA-safe.
  * Note: This should not be used to allocate RAM for task stacks since a task may pass
@@ -143,14 +203,13 @@ extern const void * _sfastheap;	/* defined in linker script */
 static struct pios_heap pios_nodma_heap = {
 	.start_addr = (const uintptr_t)&_sfastheap,
 	.end_addr   = (const uintptr_t)&_efastheap,
-	.free_addr  = (uintptr_t)&_sfastheap,
 };
-void * PIOS_malloc_no_dma(size_t size)
+void * PIOS_malloc_no_dma_tagged(size_t size, enum pios_heap_tag tag)
 {
-	void * buf = simple_malloc(&pios_nodma_heap, size);
+	void * buf = tlsf_malloc(&pios_nodma_heap, size, tag);
 
 	if (buf == NULL)
-		buf = PIOS_malloc(size);
+		buf = PIOS_malloc_tagged(size, tag);
 
 	if (buf == NULL)
 		malloc_failed_hook();
@@ -161,57 +220,54 @@ void * PIOS_malloc_no_dma(size_t size)
 #else	/* PIOS_INCLUDE_FASTHEAP */
 
 /* This platform only has a standard heap.  Fall back directly to that */
-void * PIOS_malloc_no_dma(size_t size)
+void * PIOS_malloc_no_dma_tagged(size_t size, enum pios_heap_tag tag)
 {
-	return PIOS_malloc(size);
+	return PIOS_malloc_tagged(size, tag);
 }
 
 #endif	/* PIOS_INCLUDE_FASTHEAP */
 
+void * PIOS_malloc_no_dma(size_t size)
+{
+	return PIOS_malloc_no_dma_tagged(size, PIOS_HEAP_TAG_OTHER);
+}
+
 void vPortFree(void * buf) __attribute__((alias ("PIOS_free")));
 void PIOS_free(void * buf)
 {
+	if (buf == NULL)
+		return;
+
 #if defined(PIOS_INCLUDE_FASTHEAP)
 	if (is_ptr_in_heap_p(&pios_nodma_heap, buf))
-		return simple_free(&pios_nodma_heap, buf);
+		return tlsf_free(&pios_nodma_heap, buf);
 #endif	/* PIOS_INCLUDE_FASTHEAP */
 
 	if (is_ptr_in_heap_p(&pios_standard_heap, buf))
-		return simple_free(&pios_standard_heap, buf);
+		return tlsf_free(&pios_standard_heap, buf);
 }
 
 size_t xPortGetFreeHeapSize(void) __attribute__((alias ("PIOS_heap_get_free_size")));
 size_t PIOS_heap_get_free_size(void)
 {
-#if defined(PIOS_INCLUDE_RTOS)
-	PIOS_Thread_Scheduler_Suspend();
-#endif	/* PIOS_INCLUDE_RTOS */
-
-	size_t free_bytes = simple_get_free_bytes(&pios_standard_heap);
-
-#if defined(PIOS_INCLUDE_RTOS)
-	PIOS_Thread_Scheduler_Resume();
-#endif	/* PIOS_INCLUDE_RTOS */
-
-	return free_bytes;
+	return tlsf_get_free_bytes(&pios_standard_heap);
 }
 
+size_t PIOS_heap_get_largest_free(void)
+{
+	return tlsf_get_largest_free(&pios_standard_heap);
+}
 
 #if defined(PIOS_INCLUDE_FASTHEAP)
 
 size_t PIOS_fastheap_get_free_size(void)
 {
-#if defined(PIOS_INCLUDE_RTOS)
-	PIOS_Thread_Scheduler_Suspend();
-#endif	/* PIOS_INCLUDE_RTOS */
-
-	size_t free_bytes = simple_get_free_bytes(&pios_nodma_heap);
-
-#if defined(PIOS_INCLUDE_RTOS)
-	PIOS_Thread_Scheduler_Resume();
-#endif	/* PIOS_INCLUDE_RTOS */
+	return tlsf_get_free_bytes(&pios_nodma_heap);
+}
 
-	return free_bytes;
+size_t PIOS_fastheap_get_largest_free(void)
+{
+	return tlsf_get_largest_free(&pios_nodma_heap);
 }
 
 #else
@@ -221,24 +277,46 @@ size_t PIOS_fastheap_get_free_size(void)
 	return 0;
 }
 
+size_t PIOS_fastheap_get_largest_free(void)
+{
+	return 0;
+}
+
 #endif // PIOS_INCLUDE_FASTHEAP
 
+void PIOS_heap_get_tag_usage(enum pios_heap_tag tag, uint32_t *bytes,
+		uint32_t *blocks)
+{
+	heap_lock();
+
+	*bytes = tag_bytes[tag];
+	*blocks = tag_blocks[tag];
+
+	heap_unlock();
+}
+
 void PIOS_heap_initialize_blocks(void)
 {
-	/* NOP for the simple allocator */
+	heap_lock();
+
+	tlsf_init_heap(&pios_standard_heap);
+#if defined(PIOS_INCLUDE_FASTHEAP)
+	tlsf_init_heap(&pios_nodma_heap);
+#endif	/* PIOS_INCLUDE_FASTHEAP */
+
+	heap_unlock();
 }
 
 void PIOS_heap_increase_size(size_t bytes)
 {
-#if defined(PIOS_INCLUDE_RTOS)
-	PIOS_Thread_Scheduler_Suspend();
-#endif	/* PIOS_INCLUDE_RTOS */
+	heap_lock();
 
-	simple_extend_heap(&pios_standard_heap, bytes);
+	pios_standard_heap.end_addr += bytes;
 
-#if defined(PIOS_INCLUDE_RTOS)
-	PIOS_Thread_Scheduler_Resume();
-#endif	/* PIOS_INCLUDE_RTOS */
+	if (pios_standard_heap.initialized)
+		PIOS_TLSF_Extend(&pios_standard_heap.tlsf, bytes);
+
+	heap_unlock();
 }
 
 
@@ -48,6 +48,7 @@ struct pios_ibus_dev {
 	int failsafe_timer;
 	uint16_t checksum;
 	uint16_t channel_data[PIOS_IBUS_CHANNELS];
+	uint32_t frame_time;
 	uint8_t rx_buf[PIOS_IBUS_BUFLEN];
 };
 
@@ -69,6 +70,16 @@ static bool PIOS_IBus_Validate(const struct pios_ibus_dev *dev);
  * @retval raw channel value, or error value (see pios_rcvr.h)
  */
 static int32_t PIOS_IBus_Read(uintptr_t id, uint8_t channel);
+/**
+ * @brief Read all channels of the last received frame
+ * @param[in] id Driver instance
+ * @param[out] channels Channel values, 0-based
+ * @param[in] num_channels Room in channels
+ * @param[out] frame_time When the frame arrived
+ * @retval number of channels read, or error value (see pios_rcvr.h)
+ */
+static int32_t PIOS_IBus_ReadFrame(uintptr_t id, int16_t *channels,
+		uint8_t num_channels, uint32_t *frame_time);
 /**
  * @brief Set all channels in the last frame buffer to a given value
  * @param[in] dev Driver instance
@@ -105,6 +116,7 @@ static void PIOS_IBus_Supervisor(uintptr_t context);
 // public
 const struct pios_rcvr_driver pios_ibus_rcvr_driver = {
 	.read = PIOS_IBus_Read,
+	.read_frame = PIOS_IBus_ReadFrame,
 };
 
 
@@ -157,6 +169,17 @@ static int32_t PIOS_IBus_Read(uintptr_t context, uint8_t channel)
 	return dev->channel_data[channel];
 }
 
+static int32_t PIOS_IBus_ReadFrame(uintptr_t context, int16_t *channels,
+		uint8_t num_channels, uint32_t *frame_time)
+{
+	struct pios_ibus_dev *dev = (struct pios_ibus_dev *)context;
+	if (!PIOS_IBus_Validate(dev))
+		return PIOS_RCVR_NODRIVER;
+
+	return PIOS_RCVR_CopyFrame(dev->channel_data, PIOS_IBUS_CHANNELS,
+			dev->frame_time, channels, num_channels, frame_time);
+}
+
 static void PIOS_IBus_SetAllChannels(struct pios_ibus_dev *dev, uint16_t value)
 {
 	for (int i = 0; i < PIOS_IBUS_CHANNELS; i++)
@@ -222,8 +245,11 @@ static void PIOS_IBus_UnpackFrame(struct pios_ibus_dev *dev)
 	for (int i = 0; i < PIOS_IBUS_CHANNELS; i++)
 		dev->channel_data[i] = *chan++;
 
+	dev->frame_time = PIOS_DELAY_GetRaw();
 	dev->failsafe_timer = 0;
 
+	PIOS_RCVR_ActiveFromISR();
+
 out_fail:
 	PIOS_IBus_ResetBuffer(dev);
 }
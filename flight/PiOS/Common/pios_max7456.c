@@ -290,7 +290,7 @@ int PIOS_MAX7456_init(max7456_dev_t *dev_out,
 		uint32_t spi_handle, uint32_t slave_idx)
 {
 	// Reset
-	max7456_dev_t dev = PIOS_malloc(sizeof(*dev));
+	max7456_dev_t dev = PIOS_malloc_tagged(sizeof(*dev), PIOS_HEAP_TAG_OSD);
 
 	bzero(dev, sizeof(*dev));
 	dev->magic = MAX7456_MAGIC;
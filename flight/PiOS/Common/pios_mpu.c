@@ -50,6 +50,11 @@
 
 #define PIOS_MPU_QUEUE_LEN       2
 
+/* Each FIFO record holds accel, temperature and gyro, in register order */
+#define PIOS_MPU_FIFO_RECORD_SIZE 14
+/* Smallest FIFO among the supported parts */
+#define PIOS_MPU_FIFO_SIZE       512
+
 #ifndef PIOS_MPU_SPI_HIGH_SPEED
 #define PIOS_MPU_SPI_HIGH_SPEED              20000000	// should result in 10.5MHz clock on F4 targets like Sparky2
 #endif // PIOS_MPU_SPI_HIGH_SPEED
@@ -67,6 +72,7 @@ static const uint8_t pios_mpu_whoami[PIOS_MPU_NUM] = {
 	[PIOS_ICM20608G] = 0xAF,
 };
 
+#if defined(PIOS_INCLUDE_I2C)
 /**
  * I2C addresses to probe for device
  */
@@ -74,6 +80,7 @@ static const uint8_t pios_mpu_i2c_addr[] = {
 	0x68,
 	0x69,
 };
+#endif // defined(PIOS_INCLUDE_I2C)
 
 /**
  * The available underlying communication drivers
@@ -102,6 +109,7 @@ struct pios_mpu_dev {
 	uint32_t com_slave_addr;                    /**< The slave address (I2C) or number (SPI) */
 	struct pios_queue *gyro_queue;
 	struct pios_queue *accel_queue;
+	struct pios_queue *imu_queue;               /**< Batches, only in FIFO mode */
 	struct pios_thread *task_handle;
 	struct pios_semaphore *data_ready_sema;
 	enum pios_mpu_gyro_range gyro_range;
@@ -112,6 +120,14 @@ struct pios_mpu_dev {
 	struct pios_queue *mag_queue;
 #endif // PIOS_INCLUDE_MPU_MAG
 	volatile uint32_t interrupt_count;
+	uint8_t fifo_batch;                         /**< Samples per FIFO burst; 0 if not using the FIFO */
+	uint8_t fifo_irqs;                          /**< Data ready interrupts since the last burst */
+	uint16_t internal_rate;                     /**< Rate the sample rate divider runs from, Hz */
+	uint16_t requested_rate;                    /**< Last sample rate asked for, Hz */
+#if defined(PIOS_INCLUDE_SPI_QUEUE)
+	struct pios_spi_queue *spi_queue;           /**< The bus's transaction queue, if the board set one up */
+	struct pios_semaphore *spi_done;
+#endif // defined(PIOS_INCLUDE_SPI_QUEUE)
 };
 
 //! Global structure for this device device
@@ -142,6 +158,10 @@ static int32_t PIOS_MPU_Validate(struct pios_mpu_dev *dev);
  */
 static int32_t PIOS_MPU_Config(struct pios_mpu_cfg const *cfg);
 static void PIOS_MPU_Task(void *parameters);
+#if defined(PIOS_INCLUDE_SPI)
+static int32_t PIOS_MPU_FIFO_Start(void);
+static void PIOS_MPU_FIFO_Task(void *parameters);
+#endif // defined(PIOS_INCLUDE_SPI)
 static int32_t PIOS_MPU_ReadReg(uint8_t reg);
 static int32_t PIOS_MPU_WriteReg(uint8_t reg, uint8_t data);
 
@@ -158,6 +178,12 @@ static int32_t PIOS_MPU_ClaimBus(bool lowspeed);
  * @return 0 if successful
  */
 static int32_t PIOS_MPU_ReleaseBus(bool lowspeed);
+/**
+ * @brief Read a block of registers at high speed, through the bus's
+ * transaction queue when there is one
+ * @return 0 if successful, negative otherwise
+ */
+static int32_t PIOS_MPU_SPI_ReadBlock(const uint8_t *tx, uint8_t *rx, uint16_t len);
 /**
  * @brief Probe the SPI bus for an MPU device
  * @param[out] Detected device type, only valid on success
@@ -185,6 +211,11 @@ static struct pios_mpu_dev *PIOS_MPU_Alloc(const struct pios_mpu_cfg *cfg)
 		return NULL;
 
 	dev->magic = PIOS_MPU_DEV_MAGIC;
+	dev->imu_queue = NULL;
+	dev->fifo_batch = 0;
+	dev->fifo_irqs = 0;
+	dev->internal_rate = 1000;
+	dev->requested_rate = cfg->default_samplerate;
 
 	dev->accel_queue = PIOS_Queue_Create(PIOS_MPU_QUEUE_LEN, sizeof(struct pios_sensor_accel_data));
 	if (dev->accel_queue == NULL) {
@@ -441,6 +472,21 @@ static int32_t PIOS_MPU_Common_Init(void)
 	}
 #endif // PIOS_INCLUDE_MPU_MAG
 
+#if defined(PIOS_INCLUDE_SPI)
+	/* Bursts from the FIFO need SPI, and the internal mag is only read
+	 * through the sensor registers, not the FIFO */
+	if ((mpu_dev->cfg->fifo_batch > 1) &&
+			(mpu_dev->com_driver_type == PIOS_MPU_COM_SPI)) {
+#ifdef PIOS_INCLUDE_MPU_MAG
+		if (!mpu_dev->use_mag)
+#endif // PIOS_INCLUDE_MPU_MAG
+		{
+			if (PIOS_MPU_FIFO_Start() != 0)
+				return -PIOS_MPU_ERROR_WRITEFAILED;
+		}
+	}
+#endif // defined(PIOS_INCLUDE_SPI)
+
 	/* Set up EXTI line */
 	PIOS_EXTI_Init(mpu_dev->cfg->exti_cfg);
 
@@ -459,13 +505,25 @@ static int32_t PIOS_MPU_Common_Init(void)
 		}
 	}
 
-	mpu_dev->task_handle = PIOS_Thread_Create(
-			PIOS_MPU_Task, "pios_mpu", PIOS_MPU_TASK_STACK, NULL, PIOS_MPU_TASK_PRIORITY);
+#if defined(PIOS_INCLUDE_SPI)
+	if (mpu_dev->fifo_batch) {
+		mpu_dev->task_handle = PIOS_Thread_Create(
+				PIOS_MPU_FIFO_Task, "pios_mpu", PIOS_MPU_TASK_STACK, NULL, PIOS_MPU_TASK_PRIORITY);
+	} else
+#endif // defined(PIOS_INCLUDE_SPI)
+	{
+		mpu_dev->task_handle = PIOS_Thread_Create(
+				PIOS_MPU_Task, "pios_mpu", PIOS_MPU_TASK_STACK, NULL, PIOS_MPU_TASK_PRIORITY);
+	}
 	PIOS_Assert(mpu_dev->task_handle != NULL);
 	TaskMonitorAdd(TASKINFO_RUNNING_IMU, mpu_dev->task_handle);
 
-	PIOS_SENSORS_Register(PIOS_SENSOR_ACCEL, mpu_dev->accel_queue);
-	PIOS_SENSORS_Register(PIOS_SENSOR_GYRO, mpu_dev->gyro_queue);
+	if (mpu_dev->fifo_batch) {
+		PIOS_SENSORS_Register(PIOS_SENSOR_IMU_BATCH, mpu_dev->imu_queue);
+	} else {
+		PIOS_SENSORS_Register(PIOS_SENSOR_ACCEL, mpu_dev->accel_queue);
+		PIOS_SENSORS_Register(PIOS_SENSOR_GYRO, mpu_dev->gyro_queue);
+	}
 #ifdef PIOS_INCLUDE_MPU_MAG
 	if (mpu_dev->use_mag)
 		PIOS_SENSORS_Register(PIOS_SENSOR_MAG, mpu_dev->mag_queue);
@@ -563,7 +621,10 @@ static float PIOS_MPU_GetAccelScale(void)
 void PIOS_MPU_SetGyroBandwidth(uint16_t bandwidth)
 {
 	uint8_t filter;
-	// TODO: investigate 250/256 Hz (Fs=8 kHz, aliasing?)
+	// The MPU-6000/6500 250/256 Hz settings sample at 8 kHz.  Only offer
+	// them when the FIFO is in use; nothing else can keep up with that
+	// rate.  The ICM-20608 offers its wide filters as it always has.
+	bool allow_8khz = mpu_dev->fifo_batch != 0;
 	if (mpu_dev->mpu_type == PIOS_MPU6500 || mpu_dev->mpu_type == PIOS_MPU9250) {
 		if (bandwidth <= 5)
 			filter = PIOS_MPU6500_GYRO_LOWPASS_5_HZ;
@@ -575,8 +636,10 @@ void PIOS_MPU_SetGyroBandwidth(uint16_t bandwidth)
 			filter = PIOS_MPU6500_GYRO_LOWPASS_41_HZ;
 		else if (bandwidth <= 92)
 			filter = PIOS_MPU6500_GYRO_LOWPASS_92_HZ;
-		else
+		else if (bandwidth <= 184 || !allow_8khz)
 			filter = PIOS_MPU6500_GYRO_LOWPASS_184_HZ;
+		else
+			filter = PIOS_MPU6500_GYRO_LOWPASS_250_HZ;
 	} else if ((mpu_dev->mpu_type == PIOS_MPU60X0) ||
 			(mpu_dev->mpu_type == PIOS_MPU9150)) {
 		if (bandwidth <= 5)
@@ -589,8 +652,10 @@ void PIOS_MPU_SetGyroBandwidth(uint16_t bandwidth)
 			filter = PIOS_MPU60X0_GYRO_LOWPASS_42_HZ;
 		else if (bandwidth <= 98)
 			filter = PIOS_MPU60X0_GYRO_LOWPASS_98_HZ;
-		else
+		else if (bandwidth <= 188 || !allow_8khz)
 			filter = PIOS_MPU60X0_GYRO_LOWPASS_188_HZ;
+		else
+			filter = PIOS_MPU60X0_GYRO_LOWPASS_256_HZ;
 	} else {
 		if (bandwidth <= 5)
 			filter = PIOS_ICM20608G_GYRO_LOWPASS_5_HZ;
@@ -609,6 +674,14 @@ void PIOS_MPU_SetGyroBandwidth(uint16_t bandwidth)
 	}
 
 	PIOS_MPU_WriteReg(PIOS_MPU_DLPF_CFG_REG, filter);
+
+	// All the part's 8 kHz modes share the encodings 0 and 7
+	uint16_t internal_rate = (filter == 0 || filter == 7) ? 8000 : 1000;
+
+	if (internal_rate != mpu_dev->internal_rate) {
+		mpu_dev->internal_rate = internal_rate;
+		PIOS_MPU_SetSampleRate(mpu_dev->requested_rate);
+	}
 }
 
 void PIOS_MPU_SetAccelBandwidth(uint16_t bandwidth)
@@ -654,8 +727,10 @@ void PIOS_MPU_SetAccelBandwidth(uint16_t bandwidth)
 
 int32_t PIOS_MPU_SetSampleRate(uint16_t samplerate_hz)
 {
-	// TODO: think about supporting >1 khz, aliasing/noise issues though..
-	uint16_t internal_rate = 1000;
+	// 8 kHz only with the widest gyro filter, which needs the FIFO
+	uint16_t internal_rate = mpu_dev->internal_rate;
+
+	mpu_dev->requested_rate = samplerate_hz;
 
 	// limit samplerate to filter frequency
 	if (samplerate_hz > internal_rate)
@@ -677,6 +752,12 @@ int32_t PIOS_MPU_SetSampleRate(uint16_t samplerate_hz)
 	int32_t retval = PIOS_MPU_WriteReg(PIOS_MPU_SMPLRT_DIV_REG, (uint8_t)divisor);
 
 	if (retval == 0) {
+		if (mpu_dev->fifo_batch) {
+			PIOS_SENSORS_SetSampleRate(PIOS_SENSOR_IMU_BATCH, samplerate_hz);
+			// Each batch gets reduced to one accel and gyro update
+			samplerate_hz /= mpu_dev->fifo_batch;
+		}
+
 		PIOS_SENSORS_SetSampleRate(PIOS_SENSOR_ACCEL, samplerate_hz);
 		PIOS_SENSORS_SetSampleRate(PIOS_SENSOR_GYRO, samplerate_hz);
 #ifdef PIOS_INCLUDE_MPU_MAG
@@ -797,6 +878,18 @@ int32_t PIOS_MPU_SPI_Init(pios_mpu_dev_t *dev, uint32_t spi_id, uint32_t slave_n
 	mpu_dev->com_slave_addr = slave_num;
 	mpu_dev->cfg = cfg;
 
+#if defined(PIOS_INCLUDE_SPI_QUEUE)
+	mpu_dev->spi_queue = PIOS_SPI_Queue_Find(spi_id);
+
+	if (mpu_dev->spi_queue && !mpu_dev->spi_done) {
+		mpu_dev->spi_done = PIOS_Semaphore_Create();
+		if (mpu_dev->spi_done == NULL)
+			return -1;
+
+		PIOS_Semaphore_Take(mpu_dev->spi_done, 0);
+	}
+#endif // defined(PIOS_INCLUDE_SPI_QUEUE)
+
 	int32_t ret = PIOS_MPU_SPI_Probe(&mpu_dev->mpu_type);
 
 	if (ret) {
@@ -843,6 +936,42 @@ static int32_t PIOS_MPU_ReleaseBus(bool lowspeed)
 	return 0;
 }
 
+static int32_t PIOS_MPU_SPI_ReadBlock(const uint8_t *tx, uint8_t *rx, uint16_t len)
+{
+#if defined(PIOS_INCLUDE_SPI_QUEUE)
+	/* Sample reads go ahead of anything else queued for the bus */
+	if (mpu_dev->spi_queue) {
+		struct pios_spi_xfer xfer = {
+			.tx = tx,
+			.rx = rx,
+			.len = len,
+		};
+		struct pios_spi_txn txn = {
+			.slave = mpu_dev->com_slave_addr,
+			.speed_hz = PIOS_MPU_SPI_HIGH_SPEED,
+			.prio = PIOS_SPI_PRIO_HIGH,
+			.xfers = &xfer,
+		};
+
+		return PIOS_SPI_Queue_Transact(mpu_dev->spi_queue, &txn,
+				mpu_dev->spi_done);
+	}
+#endif // defined(PIOS_INCLUDE_SPI_QUEUE)
+
+	// claim bus in high speed mode
+	if (PIOS_MPU_ClaimBus(false) != 0)
+		return -1;
+
+	if (PIOS_SPI_TransferBlock(mpu_dev->com_driver_id, tx, rx, len) < 0) {
+		PIOS_MPU_ReleaseBus(false);
+		return -2;
+	}
+
+	PIOS_MPU_ReleaseBus(false);
+
+	return 0;
+}
+
 static int32_t PIOS_MPU_SPI_Read(uint8_t address, uint8_t *buffer)
 {
 	if (PIOS_MPU_ClaimBus(true) != 0)
@@ -913,11 +1042,79 @@ bool PIOS_MPU_IRQHandler(void)
 
 	mpu_dev->interrupt_count++;
 
+	// In FIFO mode only wake the task once a batch has built up
+	if (mpu_dev->fifo_batch) {
+		if (++mpu_dev->fifo_irqs < mpu_dev->fifo_batch)
+			return false;
+
+		mpu_dev->fifo_irqs = 0;
+	}
+
 	PIOS_Semaphore_Give_FromISR(mpu_dev->data_ready_sema, &woken);
 
 	return woken;
 }
 
+/**
+ * @brief Rotate an accel or gyro reading to our convention (x forward,
+ * y right, z down).  Sensor orientation for all supported Invensense
+ * variants is x right, y forward, z up.
+ * See flight/Doc/imu_orientation.md for further detail
+ */
+static void PIOS_MPU_Rotate(float x, float y, float z, float *out)
+{
+	switch (mpu_dev->cfg->orientation) {
+	case PIOS_MPU_TOP_0DEG:
+		out[0] =  y;
+		out[1] =  x;
+		out[2] = -z;
+		break;
+	case PIOS_MPU_TOP_90DEG:
+		out[0] = -x;
+		out[1] =  y;
+		out[2] = -z;
+		break;
+	case PIOS_MPU_TOP_180DEG:
+		out[0] = -y;
+		out[1] = -x;
+		out[2] = -z;
+		break;
+	case PIOS_MPU_TOP_270DEG:
+		out[0] =  x;
+		out[1] = -y;
+		out[2] = -z;
+		break;
+	case PIOS_MPU_BOTTOM_0DEG:
+		out[0] =  y;
+		out[1] = -x;
+		out[2] =  z;
+		break;
+	case PIOS_MPU_BOTTOM_90DEG:
+		out[0] =  x;
+		out[1] =  y;
+		out[2] =  z;
+		break;
+	case PIOS_MPU_BOTTOM_180DEG:
+		out[0] = -y;
+		out[1] =  x;
+		out[2] =  z;
+		break;
+	case PIOS_MPU_BOTTOM_270DEG:
+		out[0] = -x;
+		out[1] = -y;
+		out[2] =  z;
+		break;
+	}
+}
+
+static float PIOS_MPU_Temperature(int16_t raw_temp)
+{
+	if (mpu_dev->mpu_type == PIOS_MPU6500 || mpu_dev->mpu_type == PIOS_MPU9250)
+		return 21.0f + ((float)raw_temp) / 333.87f;
+	else
+		return 35.0f + ((float)raw_temp + 512.0f) / 340.0f;
+}
+
 static void PIOS_MPU_Task(void *parameters)
 {
 	(void)parameters;
@@ -993,16 +1190,8 @@ static void PIOS_MPU_Task(void *parameters)
 
 #if defined(PIOS_INCLUDE_SPI)
 		if (mpu_dev->com_driver_type == PIOS_MPU_COM_SPI) {
-			// claim bus in high speed mode
-			if (PIOS_MPU_ClaimBus(false) != 0)
-				continue;
-
-			if (PIOS_SPI_TransferBlock(mpu_dev->com_driver_id, mpu_tx_buf, mpu_rec_buf, transfer_size) < 0) {
-				PIOS_MPU_ReleaseBus(false);
+			if (PIOS_MPU_SPI_ReadBlock(mpu_tx_buf, mpu_rec_buf, transfer_size) != 0)
 				continue;
-			}
-
-			PIOS_MPU_ReleaseBus(false);
 		}
 #endif // defined(PIOS_INCLUDE_SPI)
 
@@ -1032,129 +1221,72 @@ static void PIOS_MPU_Task(void *parameters)
 		float mag_z = (int16_t)(mpu_rec_buf[IDX_MAG_ZOUT_H] << 8 | mpu_rec_buf[IDX_MAG_ZOUT_L]);
 #endif // PIOS_INCLUDE_MPU_MAG
 
-		/* 
-		 * Rotate the sensor to our convention (x forward, y right, z down).
-		 * Sensor orientation for all supported Invensense variants is
-		 * x right, y forward, z up.
-		 * The embedded AK8xxx magnetometer in MPU9x50 variants matches our convention.
-		 * See flight/Doc/imu_orientation.md for further detail
+		float accel[3], gyro[3];
+
+		PIOS_MPU_Rotate(accel_x, accel_y, accel_z, accel);
+		PIOS_MPU_Rotate(gyro_x, gyro_y, gyro_z, gyro);
+
+		accel_data.x = accel[0];
+		accel_data.y = accel[1];
+		accel_data.z = accel[2];
+		gyro_data.x  = gyro[0];
+		gyro_data.y  = gyro[1];
+		gyro_data.z  = gyro[2];
+
+#ifdef PIOS_INCLUDE_MPU_MAG
+		/*
+		 * The embedded AK8xxx magnetometer in MPU9x50 variants matches
+		 * our convention.
 		 */
 		switch (mpu_dev->cfg->orientation) {
 		case PIOS_MPU_TOP_0DEG:
-			accel_data.x =  accel_y;
-			accel_data.y =  accel_x;
-			accel_data.z = -accel_z;
-			gyro_data.x  =  gyro_y;
-			gyro_data.y  =  gyro_x;
-			gyro_data.z  = -gyro_z;
-#ifdef PIOS_INCLUDE_MPU_MAG
 			mag_data.x   =  mag_x;
 			mag_data.y   =  mag_y;
 			mag_data.z   =  mag_z;
-#endif // PIOS_INCLUDE_MPU_MAG
 			break;
 		case PIOS_MPU_TOP_90DEG:
-			accel_data.x = -accel_x;
-			accel_data.y =  accel_y;
-			accel_data.z = -accel_z;
-			gyro_data.x  = -gyro_x;
-			gyro_data.y  =  gyro_y;
-			gyro_data.z  = -gyro_z;
-#ifdef PIOS_INCLUDE_MPU_MAG
 			mag_data.x   = -mag_y;
 			mag_data.y   =  mag_x;
 			mag_data.z   =  mag_z;
-#endif // PIOS_INCLUDE_MPU_MAG
 			break;
 		case PIOS_MPU_TOP_180DEG:
-			accel_data.x = -accel_y;
-			accel_data.y = -accel_x;
-			accel_data.z = -accel_z;
-			gyro_data.x  = -gyro_y;
-			gyro_data.y  = -gyro_x;
-			gyro_data.z  = -gyro_z;
-#ifdef PIOS_INCLUDE_MPU_MAG
 			mag_data.x   = -mag_x;
 			mag_data.y   = -mag_y;
 			mag_data.z   =  mag_z;
-#endif // PIOS_INCLUDE_MPU_MAG
 			break;
 		case PIOS_MPU_TOP_270DEG:
-			accel_data.x =  accel_x;
-			accel_data.y = -accel_y;
-			accel_data.z = -accel_z;
-			gyro_data.x  =  gyro_x;
-			gyro_data.y  = -gyro_y;
-			gyro_data.z  = -gyro_z;
-#ifdef PIOS_INCLUDE_MPU_MAG
 			mag_data.x   =  mag_y;
 			mag_data.y   = -mag_x;
 			mag_data.z   =  mag_z;
-#endif // PIOS_INCLUDE_MPU_MAG
 			break;
 		case PIOS_MPU_BOTTOM_0DEG:
-			accel_data.x =  accel_y;
-			accel_data.y = -accel_x;
-			accel_data.z =  accel_z;
-			gyro_data.x  =  gyro_y;
-			gyro_data.y  = -gyro_x;
-			gyro_data.z  =  gyro_z;
-#ifdef PIOS_INCLUDE_MPU_MAG
 			mag_data.x   =  mag_x;
 			mag_data.y   = -mag_y;
 			mag_data.z   = -mag_z;
-#endif // PIOS_INCLUDE_MPU_MAG
 			break;
 
 		case PIOS_MPU_BOTTOM_90DEG:
-			accel_data.x =  accel_x;
-			accel_data.y =  accel_y;
-			accel_data.z =  accel_z;
-			gyro_data.x  =  gyro_x;
-			gyro_data.y  =  gyro_y;
-			gyro_data.z  =  gyro_z;
-#ifdef PIOS_INCLUDE_MPU_MAG
 			mag_data.x   =  mag_y;
 			mag_data.y   =  mag_x;
 			mag_data.z   = -mag_z;
-#endif // PIOS_INCLUDE_MPU_MAG
 			break;
 
 		case PIOS_MPU_BOTTOM_180DEG:
-			accel_data.x = -accel_y;
-			accel_data.y =  accel_x;
-			accel_data.z =  accel_z;
-			gyro_data.x  = -gyro_y;
-			gyro_data.y  =  gyro_x;
-			gyro_data.z  =  gyro_z;
-#ifdef PIOS_INCLUDE_MPU_MAG
 			mag_data.x   = -mag_x;
 			mag_data.y   =  mag_y;
 			mag_data.z   = -mag_z;
-#endif // PIOS_INCLUDE_MPU_MAG
 			break;
 
 		case PIOS_MPU_BOTTOM_270DEG:
-			accel_data.x = -accel_x;
-			accel_data.y = -accel_y;
-			accel_data.z =  accel_z;
-			gyro_data.x  = -gyro_x;
-			gyro_data.y  = -gyro_y;
-			gyro_data.z  =  gyro_z;
-#ifdef PIOS_INCLUDE_MPU_MAG
 			mag_data.x   = -mag_y;
 			mag_data.y   = -mag_x;
 			mag_data.z   = -mag_z;
-#endif // PIOS_INCLUDE_MPU_MAG
 			break;
 		}
+#endif // PIOS_INCLUDE_MPU_MAG
 
 		int16_t raw_temp = (int16_t)(mpu_rec_buf[IDX_TEMP_OUT_H] << 8 | mpu_rec_buf[IDX_TEMP_OUT_L]);
-		float temperature;
-		if (mpu_dev->mpu_type == PIOS_MPU6500 || mpu_dev->mpu_type == PIOS_MPU9250)
-			temperature = 21.0f + ((float)raw_temp) / 333.87f;
-		else
-			temperature = 35.0f + ((float)raw_temp + 512.0f) / 340.0f;
+		float temperature = PIOS_MPU_Temperature(raw_temp);
 
 		// Apply sensor scaling
 		float accel_scale = PIOS_MPU_GetAccelScale();
@@ -1212,6 +1344,128 @@ static void PIOS_MPU_Task(void *parameters)
 	}
 }
 
+#if defined(PIOS_INCLUDE_SPI)
+/**
+ * @brief Switch the device over to queueing samples in its FIFO, to be
+ * read out in bursts of fifo_batch
+ * @returns 0 when success
+ */
+static int32_t PIOS_MPU_FIFO_Start(void)
+{
+	uint8_t batch = mpu_dev->cfg->fifo_batch;
+
+	if (batch > PIOS_SENSOR_IMU_BATCH_MAX)
+		batch = PIOS_SENSOR_IMU_BATCH_MAX;
+
+	mpu_dev->imu_queue = PIOS_Queue_Create(PIOS_MPU_QUEUE_LEN, sizeof(struct pios_sensor_imu_batch));
+	if (mpu_dev->imu_queue == NULL)
+		return -1;
+
+	if (PIOS_MPU_WriteReg(PIOS_MPU_FIFO_EN_REG, PIOS_MPU_FIFO_TEMP_OUT |
+				PIOS_MPU_FIFO_GYRO_X_OUT | PIOS_MPU_FIFO_GYRO_Y_OUT |
+				PIOS_MPU_FIFO_GYRO_Z_OUT | PIOS_MPU_ACCEL_OUT) != 0)
+		return -1;
+
+	if (PIOS_MPU_WriteReg(PIOS_MPU_USER_CTRL_REG, PIOS_MPU_USERCTL_DIS_I2C |
+				PIOS_MPU_USERCTL_FIFO_EN | PIOS_MPU_USERCTL_FIFO_RST) != 0)
+		return -1;
+
+	mpu_dev->fifo_batch = batch;
+
+	// Update the published rates for batching
+	return PIOS_MPU_SetSampleRate(mpu_dev->requested_rate);
+}
+
+/**
+ * @brief Throw away whatever is in the FIFO, after an overflow has left
+ * it out of step with the record boundaries
+ */
+static void PIOS_MPU_FIFO_Reset(void)
+{
+	PIOS_MPU_WriteReg(PIOS_MPU_USER_CTRL_REG, PIOS_MPU_USERCTL_DIS_I2C |
+			PIOS_MPU_USERCTL_FIFO_EN | PIOS_MPU_USERCTL_FIFO_RST);
+}
+
+static void PIOS_MPU_FIFO_Task(void *parameters)
+{
+	(void)parameters;
+
+	// Static to keep these off the task stack
+	static uint8_t fifo_tx_buf[1 + PIOS_SENSOR_IMU_BATCH_MAX * PIOS_MPU_FIFO_RECORD_SIZE];
+	static uint8_t fifo_rx_buf[1 + PIOS_SENSOR_IMU_BATCH_MAX * PIOS_MPU_FIFO_RECORD_SIZE];
+	static struct pios_sensor_imu_batch batch;
+
+	const uint8_t count_tx_buf[3] = {PIOS_MPU_FIFO_CNT_MSB | 0x80, };
+	uint8_t count_rx_buf[3];
+
+	fifo_tx_buf[0] = PIOS_MPU_FIFO_REG | 0x80;
+
+	bool backlog = false;
+
+	while (true) {
+		// Catch up without waiting if the last burst left samples behind
+		if (!backlog && PIOS_Semaphore_Take(mpu_dev->data_ready_sema, PIOS_SEMAPHORE_TIMEOUT_MAX) != true)
+			continue;
+
+		backlog = false;
+
+		if (PIOS_MPU_SPI_ReadBlock(count_tx_buf, count_rx_buf, sizeof(count_rx_buf)) != 0)
+			continue;
+
+		uint16_t fifo_bytes = count_rx_buf[1] << 8 | count_rx_buf[2];
+
+		if ((fifo_bytes % PIOS_MPU_FIFO_RECORD_SIZE) != 0 ||
+				fifo_bytes > PIOS_MPU_FIFO_SIZE - PIOS_MPU_FIFO_RECORD_SIZE) {
+			PIOS_MPU_FIFO_Reset();
+			continue;
+		}
+
+		uint16_t samples = fifo_bytes / PIOS_MPU_FIFO_RECORD_SIZE;
+
+		if (samples > PIOS_SENSOR_IMU_BATCH_MAX) {
+			samples = PIOS_SENSOR_IMU_BATCH_MAX;
+			backlog = true;
+		}
+
+		if (samples == 0)
+			continue;
+
+		// More may have arrived since the count; only whole records are read
+		if (PIOS_MPU_SPI_ReadBlock(fifo_tx_buf, fifo_rx_buf,
+					1 + samples * PIOS_MPU_FIFO_RECORD_SIZE) != 0)
+			continue;
+
+		batch.timestamp = PIOS_DELAY_GetRaw();
+		batch.sample_period_us = 1000000 / PIOS_SENSORS_GetSampleRate(PIOS_SENSOR_IMU_BATCH);
+		batch.count = samples;
+
+		float accel_scale = PIOS_MPU_GetAccelScale();
+		float gyro_scale = PIOS_MPU_GetGyroScale();
+
+		for (int i = 0; i < samples; i++) {
+			const uint8_t *rec = &fifo_rx_buf[1 + i * PIOS_MPU_FIFO_RECORD_SIZE];
+
+			float accel_x = (int16_t)(rec[0] << 8 | rec[1]);
+			float accel_y = (int16_t)(rec[2] << 8 | rec[3]);
+			float accel_z = (int16_t)(rec[4] << 8 | rec[5]);
+			float gyro_x  = (int16_t)(rec[8] << 8 | rec[9]);
+			float gyro_y  = (int16_t)(rec[10] << 8 | rec[11]);
+			float gyro_z  = (int16_t)(rec[12] << 8 | rec[13]);
+
+			PIOS_MPU_Rotate(accel_x * accel_scale, accel_y * accel_scale,
+					accel_z * accel_scale, batch.samples[i].accel);
+			PIOS_MPU_Rotate(gyro_x * gyro_scale, gyro_y * gyro_scale,
+					gyro_z * gyro_scale, batch.samples[i].gyro);
+
+			if (i == samples - 1)
+				batch.temperature = PIOS_MPU_Temperature((int16_t)(rec[6] << 8 | rec[7]));
+		}
+
+		PIOS_Queue_Send(mpu_dev->imu_queue, &batch, 0);
+	}
+}
+#endif // defined(PIOS_INCLUDE_SPI)
+
 #endif // PIOS_INCLUDE_MPU
 
 /**
@@ -54,12 +54,13 @@ struct pios_queue
  */
 struct pios_queue *PIOS_Queue_Create(size_t queue_length, size_t item_size)
 {
-	struct pios_queue *queuep = PIOS_malloc_no_dma(sizeof(struct pios_queue));
+	struct pios_queue *queuep = PIOS_malloc_no_dma_tagged(sizeof(struct pios_queue), PIOS_HEAP_TAG_QUEUE);
 	if (queuep == NULL)
 		return NULL;
 
 	/* Create the memory pool. */
-	queuep->mpb = PIOS_malloc_no_dma(item_size * (queue_length + PIOS_QUEUE_MAX_WAITERS));
+	queuep->mpb = PIOS_malloc_no_dma_tagged(item_size * (queue_length + PIOS_QUEUE_MAX_WAITERS),
+			PIOS_HEAP_TAG_QUEUE);
 	if (queuep->mpb == NULL) {
 		PIOS_free(queuep);
 		return NULL;
@@ -68,7 +69,7 @@ struct pios_queue *PIOS_Queue_Create(size_t queue_length, size_t item_size)
 	chPoolLoadArray(&queuep->mp, queuep->mpb, queue_length + PIOS_QUEUE_MAX_WAITERS);
 
 	/* Create the mailbox. */
-	msg_t *mb_buf = PIOS_malloc_no_dma(sizeof(msg_t) * queue_length);
+	msg_t *mb_buf = PIOS_malloc_no_dma_tagged(sizeof(msg_t) * queue_length, PIOS_HEAP_TAG_QUEUE);
 	chMBInit(&queuep->mb, mb_buf, queue_length);
 
 	return queuep;
@@ -122,6 +123,8 @@ bool PIOS_Queue_Send(struct pios_queue *queuep, const void *itemp, uint32_t time
 		return false;
 	}
 
+	PIOS_TRACE(PIOS_TRACE_QUEUE_SEND, queuep);
+
 	return true;
 }
 
@@ -159,6 +162,8 @@ bool PIOS_Queue_Send_FromISR(struct pios_queue *queuep, const void *itemp, bool
 
 	chSysUnlockFromIsr();
 
+	PIOS_TRACE(PIOS_TRACE_QUEUE_SEND, queuep);
+
 	return true;
 }
 
@@ -194,6 +199,8 @@ bool PIOS_Queue_Receive(struct pios_queue *queuep, void *itemp, uint32_t timeout
 
 	chPoolFree(&queuep->mp, (void*)buf);
 
+	PIOS_TRACE(PIOS_TRACE_QUEUE_RECEIVE, queuep);
+
 	return true;
 }
 
@@ -118,6 +118,66 @@ int32_t PIOS_RCVR_Read(uintptr_t rcvr_id, uint8_t channel)
   return rcvr_dev->driver->read(rcvr_dev->lower_id, channel);
 }
 
+/**
+ * @brief Reads all the channels of one receiver at once
+ * @param[in] rcvr_id driver to read from
+ * @param[out] channels the values, starting with channel 1; each may be
+ * PIOS_RCVR_TIMEOUT or PIOS_RCVR_INVALID like PIOS_RCVR_Read() returns
+ * @param[in] num_channels room in channels
+ * @param[out] frame_time PIOS_DELAY_GetRaw() when the frame arrived
+ * @returns number of channels read; 0 if the driver can't read whole
+ * frames and PIOS_RCVR_Read() must be used instead
+ *  @retval PIOS_RCVR_NODRIVER driver was not initialized
+ */
+int32_t PIOS_RCVR_ReadFrame(uintptr_t rcvr_id, int16_t *channels,
+		uint8_t num_channels, uint32_t *frame_time)
+{
+  if (rcvr_id == 0)
+    return PIOS_RCVR_NODRIVER;
+
+  struct pios_rcvr_dev * rcvr_dev = (struct pios_rcvr_dev *)rcvr_id;
+
+  if (!PIOS_RCVR_validate(rcvr_dev)) {
+    /* Undefined RCVR port for this board (see pios_board.c) */
+    PIOS_Assert(0);
+  }
+
+  if (!rcvr_dev->driver->read_frame)
+    return 0;
+
+  return rcvr_dev->driver->read_frame(rcvr_dev->lower_id, channels,
+		  num_channels, frame_time);
+}
+
+/**
+ * @brief Helper for drivers' read_frame: copies a channel array that is
+ * updated from interrupts without catching it halfway through a frame.
+ * Channels the driver doesn't have read as PIOS_RCVR_INVALID.
+ * @returns num_channels
+ */
+int32_t PIOS_RCVR_CopyFrame(const uint16_t *src, uint8_t src_channels,
+		uint32_t src_time, int16_t *channels, uint8_t num_channels,
+		uint32_t *frame_time)
+{
+  uint8_t i;
+
+  PIOS_IRQ_Disable();
+
+  for (i = 0; i < num_channels && i < src_channels; i++) {
+    channels[i] = src[i];
+  }
+
+  *frame_time = src_time;
+
+  PIOS_IRQ_Enable();
+
+  for (; i < num_channels; i++) {
+    channels[i] = PIOS_RCVR_INVALID;
+  }
+
+  return num_channels;
+}
+
 #define MIN_WAKE_INTERVAL_uS 4000	/* 250Hz ought to be enough for anyone*/
 
 bool PIOS_RCVR_WaitActivity(uint32_t timeout_ms) {
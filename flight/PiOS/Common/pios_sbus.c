@@ -36,6 +36,8 @@
 
 /* Forward Declarations */
 static int32_t PIOS_SBus_Get(uintptr_t rcvr_id, uint8_t channel);
+static int32_t PIOS_SBus_GetFrame(uintptr_t rcvr_id, int16_t *channels,
+				  uint8_t num_channels, uint32_t *frame_time);
 static uint16_t PIOS_SBus_RxInCallback(uintptr_t context,
 				       uint8_t *buf,
 				       uint16_t buf_len,
@@ -47,6 +49,7 @@ static void PIOS_SBus_Supervisor(uintptr_t sbus_id);
 /* Local Variables */
 const struct pios_rcvr_driver pios_sbus_rcvr_driver = {
 	.read = PIOS_SBus_Get,
+	.read_frame = PIOS_SBus_GetFrame,
 };
 
 enum pios_sbus_dev_magic {
@@ -55,6 +58,7 @@ enum pios_sbus_dev_magic {
 
 struct pios_sbus_state {
 	uint16_t channel_data[PIOS_SBUS_NUM_INPUTS];
+	uint32_t frame_time;
 	uint8_t received_data[SBUS_FRAME_LENGTH - 2];
 	uint8_t receive_timer;
 	uint8_t failsafe_timer;
@@ -150,6 +154,23 @@ static int32_t PIOS_SBus_Get(uintptr_t rcvr_id, uint8_t channel)
 	return sbus_dev->state.channel_data[channel];
 }
 
+/**
+ * Get all the channels of the latest frame at once
+ */
+static int32_t PIOS_SBus_GetFrame(uintptr_t rcvr_id, int16_t *channels,
+				  uint8_t num_channels, uint32_t *frame_time)
+{
+	struct pios_sbus_dev *sbus_dev = (struct pios_sbus_dev *)rcvr_id;
+
+	if (!PIOS_SBus_Validate(sbus_dev))
+		return PIOS_RCVR_INVALID;
+
+	return PIOS_RCVR_CopyFrame(sbus_dev->state.channel_data,
+				   PIOS_SBUS_NUM_INPUTS,
+				   sbus_dev->state.frame_time,
+				   channels, num_channels, frame_time);
+}
+
 /**
  * Compute channel_data[] from received_data[].
  * For efficiency it unrolls first 8 channels without loops and does the
@@ -216,6 +237,7 @@ static void PIOS_SBus_UpdateState(struct pios_sbus_state *state, uint8_t b)
 			} else {
 				/* data looking good */
 				PIOS_SBus_UnrollChannels(state);
+				state->frame_time = PIOS_DELAY_GetRaw();
 				state->failsafe_timer = 0;
 				PIOS_RCVR_ActiveFromISR();
 			}
@@ -0,0 +1,425 @@
+/**
+ ******************************************************************************
+ * @addtogroup PIOS PIOS Core hardware abstraction layer
+ * @{
+ * @addtogroup   PIOS_SPI SPI Functions
+ * @{
+ *
+ * @file       pios_spi_queue.c
+ * @author     dRonin, http://dronin.org, Copyright (C) 2017
+ * @brief      Prioritized, asynchronous transaction queue for a SPI bus
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "pios.h"
+
+#if defined(PIOS_INCLUDE_SPI_QUEUE)
+
+#include "pios_spi_queue.h"
+#include "pios_semaphore.h"
+#include "pios_thread.h"
+
+#if defined(SIM_POSIX)
+#include "pios_mutex.h"
+#endif
+
+#define PIOS_SPI_QUEUE_MAX_BUSES 4
+#define PIOS_SPI_QUEUE_TASK_STACK 512
+#define PIOS_SPI_QUEUE_TASK_PRIORITY PIOS_THREAD_PRIO_HIGHEST
+
+enum pios_spi_queue_magic {
+	PIOS_SPI_QUEUE_MAGIC = 0x51495053,	/* 'SPIQ' */
+};
+
+struct pios_spi_queue {
+	enum pios_spi_queue_magic magic;
+	uint32_t spi_id;
+
+	struct pios_spi_txn *head[PIOS_SPI_PRIO_NUM];
+	struct pios_spi_txn *tail[PIOS_SPI_PRIO_NUM];
+
+	struct pios_semaphore *work;
+	struct pios_thread *task;
+
+#if defined(SIM_POSIX)
+	/* Submitters and the worker are real threads here, which the IRQ
+	 * calls don't exclude */
+	struct pios_mutex *lock;
+#endif
+
+	struct pios_spi_queue_stats stats[PIOS_SPI_PRIO_NUM];
+};
+
+static struct pios_spi_queue *queues[PIOS_SPI_QUEUE_MAX_BUSES];
+
+static void PIOS_SPI_Queue_Task(void *parameters);
+
+static bool PIOS_SPI_Queue_Validate(struct pios_spi_queue *queue)
+{
+	return (queue != NULL) && (queue->magic == PIOS_SPI_QUEUE_MAGIC);
+}
+
+/* Guards the lists and the stats */
+static void PIOS_SPI_Queue_Lock(struct pios_spi_queue *queue)
+{
+#if defined(SIM_POSIX)
+	PIOS_Mutex_Lock(queue->lock, PIOS_MUTEX_TIMEOUT_MAX);
+#else
+	PIOS_IRQ_Disable();
+#endif
+}
+
+static void PIOS_SPI_Queue_Unlock(struct pios_spi_queue *queue)
+{
+#if defined(SIM_POSIX)
+	PIOS_Mutex_Unlock(queue->lock);
+#else
+	PIOS_IRQ_Enable();
+#endif
+}
+
+/**
+ * Creates the queue and worker for a bus.  Only one queue may exist per
+ * bus.
+ * @param[out] queue handle of the new queue
+ * @param[in] spi_id the bus, as returned by PIOS_SPI_Init
+ * @return 0 if successful, negative otherwise
+ */
+int32_t PIOS_SPI_Queue_Init(struct pios_spi_queue **queue, uint32_t spi_id)
+{
+	int slot = -1;
+
+	for (int i = 0; i < PIOS_SPI_QUEUE_MAX_BUSES; i++) {
+		if (!queues[i]) {
+			if (slot < 0) {
+				slot = i;
+			}
+		} else if (queues[i]->spi_id == spi_id) {
+			return -1;
+		}
+	}
+
+	if (slot < 0) {
+		return -2;
+	}
+
+	struct pios_spi_queue *q = PIOS_malloc_no_dma(sizeof(*q));
+	if (!q) {
+		return -3;
+	}
+
+	memset(q, 0, sizeof(*q));
+
+	q->magic = PIOS_SPI_QUEUE_MAGIC;
+	q->spi_id = spi_id;
+
+	q->work = PIOS_Semaphore_Create();
+	if (!q->work) {
+		goto fail;
+	}
+
+#if defined(SIM_POSIX)
+	q->lock = PIOS_Mutex_Create();
+	if (!q->lock) {
+		goto fail;
+	}
+#endif
+
+	q->task = PIOS_Thread_Create(PIOS_SPI_Queue_Task, "pios_spiq",
+			PIOS_SPI_QUEUE_TASK_STACK, q,
+			PIOS_SPI_QUEUE_TASK_PRIORITY);
+	if (!q->task) {
+		goto fail;
+	}
+
+	queues[slot] = q;
+	*queue = q;
+
+	return 0;
+
+fail:
+	/* The semaphore can't be deleted; this only happens when out of
+	 * memory at init anyway. */
+	q->magic = 0;
+	PIOS_free(q);
+
+	return -3;
+}
+
+/**
+ * Finds the queue serving a bus, so drivers handed only a spi_id can use
+ * it when the board set one up.
+ * @return the queue, or NULL if the bus has none
+ */
+struct pios_spi_queue *PIOS_SPI_Queue_Find(uint32_t spi_id)
+{
+	for (int i = 0; i < PIOS_SPI_QUEUE_MAX_BUSES; i++) {
+		if (queues[i] && (queues[i]->spi_id == spi_id)) {
+			return queues[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Queues a transaction behind others of the same priority.  Returns
+ * without waiting; the callback reports the result.  Callable from tasks
+ * and from transaction callbacks.
+ * @return 0 if queued, negative if the queue or transaction is invalid
+ */
+int32_t PIOS_SPI_Queue_Submit(struct pios_spi_queue *queue,
+		struct pios_spi_txn *txn)
+{
+	if (!PIOS_SPI_Queue_Validate(queue)) {
+		return -1;
+	}
+
+	if (!txn || (txn->prio >= PIOS_SPI_PRIO_NUM) || !txn->xfers) {
+		return -2;
+	}
+
+	enum pios_spi_queue_prio prio = txn->prio;
+
+	txn->next = NULL;
+	txn->queued_raw = PIOS_DELAY_GetRaw();
+
+	PIOS_SPI_Queue_Lock(queue);
+
+	if (queue->tail[prio]) {
+		queue->tail[prio]->next = txn;
+	} else {
+		queue->head[prio] = txn;
+	}
+
+	queue->tail[prio] = txn;
+
+	PIOS_SPI_Queue_Unlock(queue);
+
+	PIOS_Semaphore_Give(queue->work);
+
+	return 0;
+}
+
+struct pios_spi_queue_waiter {
+	struct pios_semaphore *done;
+	int32_t status;
+};
+
+static void PIOS_SPI_Queue_Wake(struct pios_spi_txn *txn, int32_t status)
+{
+	struct pios_spi_queue_waiter *waiter = txn->ctx;
+
+	waiter->status = status;
+
+	PIOS_Semaphore_Give(waiter->done);
+}
+
+/**
+ * Queues a transaction and sleeps until it has run.  The transaction
+ * still goes in priority order; only the submitter waits.  Sets the
+ * transaction's callback and context.
+ * @param[in] done a semaphore owned by the caller, already taken, and not
+ * shared with transactions that may be in flight at the same time
+ * @return 0 if successful, negative if the transaction couldn't be queued
+ * or failed
+ */
+int32_t PIOS_SPI_Queue_Transact(struct pios_spi_queue *queue,
+		struct pios_spi_txn *txn, struct pios_semaphore *done)
+{
+	struct pios_spi_queue_waiter waiter = {
+		.done = done,
+		.status = -1,
+	};
+
+	txn->cb = PIOS_SPI_Queue_Wake;
+	txn->ctx = &waiter;
+
+	int32_t ret = PIOS_SPI_Queue_Submit(queue, txn);
+
+	if (ret) {
+		return ret;
+	}
+
+	PIOS_Semaphore_Take(done, PIOS_SEMAPHORE_TIMEOUT_MAX);
+
+	return waiter.status;
+}
+
+static struct pios_spi_txn *PIOS_SPI_Queue_Pop(struct pios_spi_queue *queue)
+{
+	struct pios_spi_txn *txn = NULL;
+
+	PIOS_SPI_Queue_Lock(queue);
+
+	for (int i = 0; i < PIOS_SPI_PRIO_NUM; i++) {
+		txn = queue->head[i];
+
+		if (txn) {
+			queue->head[i] = txn->next;
+
+			if (!queue->head[i]) {
+				queue->tail[i] = NULL;
+			}
+
+			break;
+		}
+	}
+
+	PIOS_SPI_Queue_Unlock(queue);
+
+	return txn;
+}
+
+static int32_t PIOS_SPI_Queue_Transfer(struct pios_spi_queue *queue,
+		struct pios_spi_txn *txn)
+{
+	int32_t ret = 0;
+
+	if (txn->speed_hz) {
+		PIOS_SPI_SetClockSpeed(queue->spi_id, txn->speed_hz);
+	}
+
+	PIOS_SPI_RC_PinSet(queue->spi_id, txn->slave, false);
+
+	for (struct pios_spi_xfer *xfer = txn->xfers; xfer;
+			xfer = xfer->next) {
+		if (PIOS_SPI_TransferBlock(queue->spi_id, xfer->tx, xfer->rx,
+					xfer->len) < 0) {
+			ret = -2;
+			break;
+		}
+	}
+
+	PIOS_SPI_RC_PinSet(queue->spi_id, txn->slave, true);
+
+	return ret;
+}
+
+/**
+ * Runs the highest priority pending transaction to completion, including
+ * its callback.  The worker task calls this; tests and single threaded
+ * environments may call it directly.
+ * @return true if a transaction ran, false if the queue was empty
+ */
+bool PIOS_SPI_Queue_RunOne(struct pios_spi_queue *queue)
+{
+	struct pios_spi_txn *txn = PIOS_SPI_Queue_Pop(queue);
+
+	if (!txn) {
+		return false;
+	}
+
+	int32_t status;
+	bool claimed = false;
+	uint32_t busy_us = 0, wait_us = 0;
+
+	/* Blocks while a driver that hasn't moved to the queue holds the
+	 * bus */
+	if (PIOS_SPI_ClaimBus(queue->spi_id) != 0) {
+		status = -1;
+	} else {
+		uint32_t start = PIOS_DELAY_GetRaw();
+
+		claimed = true;
+
+		status = PIOS_SPI_Queue_Transfer(queue, txn);
+
+		PIOS_SPI_ReleaseBus(queue->spi_id);
+
+		busy_us = PIOS_DELAY_DiffuS(start);
+		wait_us = PIOS_DELAY_DiffuS2(txn->queued_raw, start);
+	}
+
+	struct pios_spi_queue_stats *stats = &queue->stats[txn->prio];
+
+	PIOS_SPI_Queue_Lock(queue);
+
+	if (status == 0) {
+		stats->completed++;
+	} else {
+		stats->failed++;
+	}
+
+	if (claimed) {
+		stats->wait_total_us += wait_us;
+
+		if (wait_us > stats->wait_max_us) {
+			stats->wait_max_us = wait_us;
+		}
+
+		if (busy_us > stats->busy_max_us) {
+			stats->busy_max_us = busy_us;
+		}
+	}
+
+	PIOS_SPI_Queue_Unlock(queue);
+
+	if (txn->cb) {
+		txn->cb(txn, status);
+	}
+
+	return true;
+}
+
+/**
+ * Gets the timing counters of one priority level.
+ */
+void PIOS_SPI_Queue_GetStats(struct pios_spi_queue *queue,
+		enum pios_spi_queue_prio prio,
+		struct pios_spi_queue_stats *stats)
+{
+	if (!PIOS_SPI_Queue_Validate(queue) || (prio >= PIOS_SPI_PRIO_NUM)) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	PIOS_SPI_Queue_Lock(queue);
+	*stats = queue->stats[prio];
+	PIOS_SPI_Queue_Unlock(queue);
+}
+
+void PIOS_SPI_Queue_ClearStats(struct pios_spi_queue *queue)
+{
+	if (!PIOS_SPI_Queue_Validate(queue)) {
+		return;
+	}
+
+	PIOS_SPI_Queue_Lock(queue);
+	memset(queue->stats, 0, sizeof(queue->stats));
+	PIOS_SPI_Queue_Unlock(queue);
+}
+
+static void PIOS_SPI_Queue_Task(void *parameters)
+{
+	struct pios_spi_queue *queue = parameters;
+
+	while (true) {
+		PIOS_Semaphore_Take(queue->work, PIOS_SEMAPHORE_TIMEOUT_MAX);
+
+		/* One give may stand for several submissions */
+		while (PIOS_SPI_Queue_RunOne(queue));
+	}
+}
+
+#endif /* PIOS_INCLUDE_SPI_QUEUE */
+
+/**
+ * @}
+ * @}
+ */
@@ -179,7 +179,8 @@ static struct streamfs_state *streamfs_alloc(void)
 {
 	struct streamfs_state *streamfs;
 
-	streamfs = (struct streamfs_state *)PIOS_malloc_no_dma(sizeof(*streamfs));
+	streamfs = (struct streamfs_state *)PIOS_malloc_no_dma_tagged(sizeof(*streamfs),
+			PIOS_HEAP_TAG_LOGGING);
 	if (!streamfs) return (NULL);
 
 	streamfs->magic = PIOS_FLASHFS_STREAMFS_DEV_MAGIC;
@@ -610,7 +611,8 @@ int32_t PIOS_STREAMFS_Init(uintptr_t *fs_id, const struct streamfs_cfg *cfg, enu
 		goto out_exit;
 	}
 
-	streamfs->com_buffer = (uint8_t *)PIOS_malloc(cfg->write_size);
+	streamfs->com_buffer = (uint8_t *)PIOS_malloc_tagged(cfg->write_size,
+			PIOS_HEAP_TAG_LOGGING);
 	if (!streamfs->com_buffer) {
 		PIOS_free(streamfs);
 		return -1;
@@ -54,14 +54,21 @@ static uint32_t ceil_size(uint32_t size)
  * to 8 byte boundaries. This makes sure to allocate enough
  * memory and return an address that has the requested size
  * or more with these constraints.
+ *
+ * @param[out] base what was allocated, which is what must be freed
  */
-static uint8_t * align8_alloc(uint32_t size)
+static uint8_t * align8_alloc(uint32_t size, void **base)
 {
 	// round size up to at nearest multiple of 8 + 4 bytes to guarantee
 	// sufficient size within. This is because PIOS_malloc only guarantees
 	// uintptr_t alignment which is 4 bytes.
 	size = size + sizeof(uintptr_t);
-	uint8_t *wap = PIOS_malloc(size);
+	uint8_t *wap = PIOS_malloc_tagged(size, PIOS_HEAP_TAG_STACK);
+
+	*base = wap;
+
+	if (wap == NULL)
+		return NULL;
 
 	// shift start point to nearest 8 byte boundary.
 	uint32_t pad = ((uint32_t) wap) % sizeof(stkalign_t);
@@ -85,13 +92,15 @@ static uint8_t * align8_alloc(uint32_t size)
  */
 struct pios_thread *PIOS_Thread_Create(void (*fp)(void *), const char *namep, size_t stack_bytes, void *argp, enum pios_thread_prio_e prio)
 {
-	struct pios_thread *thread = PIOS_malloc_no_dma(sizeof(struct pios_thread));
+	struct pios_thread *thread = PIOS_malloc_no_dma_tagged(sizeof(struct pios_thread),
+			PIOS_HEAP_TAG_STACK);
 	if (thread == NULL)
 		return NULL;
 
 	// Use special functions to ensure ChibiOS stack requirements
 	stack_bytes = ceil_size(stack_bytes);
-	uint8_t *wap = align8_alloc(stack_bytes);
+	void *stack_base;
+	uint8_t *wap = align8_alloc(stack_bytes, &stack_base);
 	if (wap == NULL)
 	{
 		PIOS_free(thread);
@@ -102,7 +111,7 @@ struct pios_thread *PIOS_Thread_Create(void (*fp)(void *), const char *namep, si
 	if (thread->threadp == NULL)
 	{
 		PIOS_free(thread);
-		PIOS_free(wap);
+		PIOS_free(stack_base);
 		return NULL;
 	}
 
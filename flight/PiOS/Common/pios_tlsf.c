@@ -0,0 +1,682 @@
+/**
+ ******************************************************************************
+ * @file       pios_tlsf.c
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @addtogroup PIOS PIOS Core hardware abstraction layer
+ * @{
+ * @addtogroup PIOS_HEAP Heap Allocation Abstraction
+ * @{
+ * @brief Two-level segregated fit allocator used behind PIOS_malloc
+ *
+ * Free blocks are kept in lists indexed by a power of two size class and
+ * a linear subdivision of it, with a bitmap per level, so both malloc and
+ * free are constant time: a couple of find-first-set operations and list
+ * manipulation; only a malloc that would otherwise fail walks a list.
+ * Freed blocks are coalesced with their physical neighbours immediately.
+ *
+ * Each block is preceded by one word holding its size, two state flags
+ * and an 8 bit tag identifying the caller.  A free block additionally
+ * holds its free list links, and the last word of a free block holds the
+ * pointer back to its start used when coalescing.  Nothing here locks;
+ * that is up to the caller.
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "pios_tlsf.h"
+
+#include <string.h>
+
+struct pios_tlsf_block {
+	/* Physically previous block; only valid if it is free.  This word
+	 * lies in the last word of the previous block. */
+	struct pios_tlsf_block *prev_phys;
+
+	/* Payload size, flags and tag */
+	uintptr_t size;
+
+	/* Free list links; only valid if this block is free */
+	struct pios_tlsf_block *next_free;
+	struct pios_tlsf_block *prev_free;
+};
+
+#define ALIGN_SIZE ((size_t) 1 << PIOS_TLSF_ALIGN_LOG2)
+
+#define BLOCK_FREE		0x1
+#define BLOCK_PREV_FREE		0x2
+#define BLOCK_SIZE_MASK		0x00fffffc
+#define BLOCK_TAG_SHIFT		24
+#define BLOCK_TAG_MASK		((uintptr_t) 0xff << BLOCK_TAG_SHIFT)
+
+/* Only the size word is overhead once a block is handed out */
+#define BLOCK_OVERHEAD		sizeof(uintptr_t)
+#define BLOCK_START_OFFSET	(offsetof(struct pios_tlsf_block, size) + \
+		sizeof(uintptr_t))
+
+/* A free block must hold its links and the next block's prev_phys */
+#define BLOCK_SIZE_MIN		(sizeof(struct pios_tlsf_block) - \
+		sizeof(struct pios_tlsf_block *))
+#define BLOCK_SIZE_MAX		(((size_t) 1 << PIOS_TLSF_FL_INDEX_MAX) - \
+		ALIGN_SIZE)
+
+#define SMALL_BLOCK_SIZE	((size_t) 1 << PIOS_TLSF_FL_SHIFT)
+
+static inline int tlsf_fls(uint32_t word)
+{
+	return word ? 31 - __builtin_clz(word) : -1;
+}
+
+static inline int tlsf_ffs(uint32_t word)
+{
+	return __builtin_ffs(word) - 1;
+}
+
+static inline size_t align_up(size_t x)
+{
+	return (x + (ALIGN_SIZE - 1)) & ~(ALIGN_SIZE - 1);
+}
+
+static inline size_t align_down(size_t x)
+{
+	return x & ~(ALIGN_SIZE - 1);
+}
+
+static inline size_t block_size(const struct pios_tlsf_block *block)
+{
+	return block->size & BLOCK_SIZE_MASK;
+}
+
+static inline void block_set_size(struct pios_tlsf_block *block, size_t size)
+{
+	block->size = (block->size & ~BLOCK_SIZE_MASK) | size;
+}
+
+static inline bool block_is_free(const struct pios_tlsf_block *block)
+{
+	return block->size & BLOCK_FREE;
+}
+
+static inline bool block_is_prev_free(const struct pios_tlsf_block *block)
+{
+	return block->size & BLOCK_PREV_FREE;
+}
+
+static inline void *block_to_ptr(const struct pios_tlsf_block *block)
+{
+	return (void *) ((uintptr_t) block + BLOCK_START_OFFSET);
+}
+
+static inline struct pios_tlsf_block *block_from_ptr(const void *ptr)
+{
+	return (struct pios_tlsf_block *) ((uintptr_t) ptr -
+			BLOCK_START_OFFSET);
+}
+
+static inline struct pios_tlsf_block *block_next(
+		const struct pios_tlsf_block *block)
+{
+	return (struct pios_tlsf_block *) ((uintptr_t) block_to_ptr(block) +
+			block_size(block) - BLOCK_OVERHEAD);
+}
+
+static inline struct pios_tlsf_block *block_link_next(
+		struct pios_tlsf_block *block)
+{
+	struct pios_tlsf_block *next = block_next(block);
+
+	next->prev_phys = block;
+
+	return next;
+}
+
+static inline void block_mark_as_free(struct pios_tlsf_block *block)
+{
+	struct pios_tlsf_block *next = block_link_next(block);
+
+	next->size |= BLOCK_PREV_FREE;
+	block->size |= BLOCK_FREE;
+}
+
+static inline void block_mark_as_used(struct pios_tlsf_block *block)
+{
+	struct pios_tlsf_block *next = block_next(block);
+
+	next->size &= ~BLOCK_PREV_FREE;
+	block->size &= ~BLOCK_FREE;
+}
+
+/**
+ * Find the list a free block of this size belongs in.
+ */
+static void mapping_insert(size_t size, int *fli, int *sli)
+{
+	int fl, sl;
+
+	if (size < SMALL_BLOCK_SIZE) {
+		/* Small sizes are spread linearly over the first class */
+		fl = 0;
+		sl = size >> PIOS_TLSF_ALIGN_LOG2;
+	} else {
+		fl = tlsf_fls(size);
+		sl = (size >> (fl - PIOS_TLSF_SL_LOG2)) ^ PIOS_TLSF_SL_COUNT;
+		fl -= (PIOS_TLSF_FL_SHIFT - 1);
+	}
+
+	*fli = fl;
+	*sli = sl;
+}
+
+/**
+ * Find the first list whose blocks are all big enough for this size;
+ * rounds up to the next list boundary so the search never has to walk a
+ * list.
+ */
+static void mapping_search(size_t size, int *fli, int *sli)
+{
+	if (size >= SMALL_BLOCK_SIZE) {
+		size += ((size_t) 1 << (tlsf_fls(size) - PIOS_TLSF_SL_LOG2)) - 1;
+	}
+
+	mapping_insert(size, fli, sli);
+}
+
+static struct pios_tlsf_block *search_suitable_block(struct pios_tlsf *tlsf,
+		int *fli, int *sli)
+{
+	int fl = *fli;
+	int sl = *sli;
+
+	uint32_t sl_map = tlsf->sl_bitmap[fl] & (~0U << sl);
+
+	if (!sl_map) {
+		/* Nothing in this class; take the next bigger class */
+		uint32_t fl_map = tlsf->fl_bitmap & (~0U << (fl + 1));
+
+		if (!fl_map) {
+			return NULL;
+		}
+
+		fl = tlsf_ffs(fl_map);
+		sl_map = tlsf->sl_bitmap[fl];
+	}
+
+	sl = tlsf_ffs(sl_map);
+
+	*fli = fl;
+	*sli = sl;
+
+	return tlsf->blocks[fl][sl];
+}
+
+static void remove_free_block(struct pios_tlsf *tlsf,
+		struct pios_tlsf_block *block, int fl, int sl)
+{
+	struct pios_tlsf_block *prev = block->prev_free;
+	struct pios_tlsf_block *next = block->next_free;
+
+	if (next) {
+		next->prev_free = prev;
+	}
+
+	if (prev) {
+		prev->next_free = next;
+	}
+
+	if (tlsf->blocks[fl][sl] == block) {
+		tlsf->blocks[fl][sl] = next;
+
+		if (!next) {
+			tlsf->sl_bitmap[fl] &= ~(1U << sl);
+
+			if (!tlsf->sl_bitmap[fl]) {
+				tlsf->fl_bitmap &= ~(1U << fl);
+			}
+		}
+	}
+
+	tlsf->free_bytes -= block_size(block);
+}
+
+static void insert_free_block(struct pios_tlsf *tlsf,
+		struct pios_tlsf_block *block, int fl, int sl)
+{
+	struct pios_tlsf_block *current = tlsf->blocks[fl][sl];
+
+	block->next_free = current;
+	block->prev_free = NULL;
+
+	if (current) {
+		current->prev_free = block;
+	}
+
+	tlsf->blocks[fl][sl] = block;
+	tlsf->fl_bitmap |= 1U << fl;
+	tlsf->sl_bitmap[fl] |= 1U << sl;
+
+	tlsf->free_bytes += block_size(block);
+}
+
+static void block_remove(struct pios_tlsf *tlsf, struct pios_tlsf_block *block)
+{
+	int fl, sl;
+
+	mapping_insert(block_size(block), &fl, &sl);
+	remove_free_block(tlsf, block, fl, sl);
+}
+
+static void block_insert(struct pios_tlsf *tlsf, struct pios_tlsf_block *block)
+{
+	int fl, sl;
+
+	mapping_insert(block_size(block), &fl, &sl);
+	insert_free_block(tlsf, block, fl, sl);
+}
+
+static bool block_can_merge(const struct pios_tlsf_block *a,
+		const struct pios_tlsf_block *b)
+{
+	return block_size(a) + block_size(b) + BLOCK_OVERHEAD <= BLOCK_SIZE_MAX;
+}
+
+static struct pios_tlsf_block *block_absorb(struct pios_tlsf_block *prev,
+		struct pios_tlsf_block *block)
+{
+	block_set_size(prev, block_size(prev) + block_size(block) +
+			BLOCK_OVERHEAD);
+	block_link_next(prev);
+
+	return prev;
+}
+
+static struct pios_tlsf_block *block_merge_prev(struct pios_tlsf *tlsf,
+		struct pios_tlsf_block *block)
+{
+	if (block_is_prev_free(block)) {
+		struct pios_tlsf_block *prev = block->prev_phys;
+
+		if (block_can_merge(prev, block)) {
+			block_remove(tlsf, prev);
+			block = block_absorb(prev, block);
+		}
+	}
+
+	return block;
+}
+
+static struct pios_tlsf_block *block_merge_next(struct pios_tlsf *tlsf,
+		struct pios_tlsf_block *block)
+{
+	struct pios_tlsf_block *next = block_next(block);
+
+	if (block_is_free(next) && block_can_merge(block, next)) {
+		block_remove(tlsf, next);
+		block = block_absorb(block, next);
+	}
+
+	return block;
+}
+
+/**
+ * Split the tail off a free block that is bigger than needed and put it
+ * back on the free lists.
+ */
+static void block_trim_free(struct pios_tlsf *tlsf,
+		struct pios_tlsf_block *block, size_t size)
+{
+	if (block_size(block) < sizeof(struct pios_tlsf_block) + size) {
+		return;
+	}
+
+	struct pios_tlsf_block *remaining = (struct pios_tlsf_block *)
+		((uintptr_t) block_to_ptr(block) + size - BLOCK_OVERHEAD);
+
+	remaining->size = block_size(block) - (size + BLOCK_OVERHEAD);
+	block_set_size(block, size);
+
+	block_mark_as_free(remaining);
+	block_link_next(block);
+	remaining->size |= BLOCK_PREV_FREE;
+
+	block_insert(tlsf, remaining);
+}
+
+/**
+ * Turn remaining bytes starting at block into free blocks, each no
+ * bigger than the largest size class, and end them with a sentinel.
+ * The flags of block itself say whether its predecessor is free.
+ */
+static void pool_carve(struct pios_tlsf *tlsf, struct pios_tlsf_block *block,
+		size_t remaining)
+{
+	while (true) {
+		size_t size = remaining;
+
+		if (size > BLOCK_SIZE_MAX) {
+			size = align_down(BLOCK_SIZE_MAX / 2);
+		}
+
+		block->size = (block->size & BLOCK_PREV_FREE) | size;
+		block_mark_as_free(block);
+
+		block = block_merge_prev(tlsf, block);
+		block_insert(tlsf, block);
+
+		remaining -= size;
+
+		if (remaining < BLOCK_OVERHEAD + BLOCK_SIZE_MIN) {
+			break;
+		}
+
+		remaining -= BLOCK_OVERHEAD;
+		block = block_next(block);
+	}
+
+	struct pios_tlsf_block *sentinel = block_next(block);
+
+	sentinel->size = BLOCK_PREV_FREE;
+	tlsf->sentinel = sentinel;
+}
+
+/**
+ * Set up an allocator over a region of memory.
+ * @param[out] tlsf allocator state
+ * @param[in] mem start of the region
+ * @param[in] bytes length of the region
+ */
+void PIOS_TLSF_Init(struct pios_tlsf *tlsf, void *mem, size_t bytes)
+{
+	memset(tlsf, 0, sizeof(*tlsf));
+
+	uintptr_t start = align_up((uintptr_t) mem);
+	uintptr_t end = (uintptr_t) mem + bytes;
+
+	tlsf->end_addr = end;
+
+	if (end < start + 2 * BLOCK_OVERHEAD + BLOCK_SIZE_MIN) {
+		/* Too small to hold anything; every malloc will fail */
+		return;
+	}
+
+	/* The first block's prev_phys would lie just before the pool, but
+	 * it's never used since there's no previous block to be free. */
+	tlsf->first = (struct pios_tlsf_block *) (start - BLOCK_OVERHEAD);
+	tlsf->first->size = 0;
+
+	pool_carve(tlsf, tlsf->first,
+			align_down(end - start - 2 * BLOCK_OVERHEAD));
+}
+
+/**
+ * Grow the region the allocator manages; the bytes directly after its
+ * current end become available.
+ */
+void PIOS_TLSF_Extend(struct pios_tlsf *tlsf, size_t bytes)
+{
+	tlsf->end_addr += bytes;
+
+	struct pios_tlsf_block *sentinel = tlsf->sentinel;
+
+	if (sentinel == NULL) {
+		return;
+	}
+
+	/* The sentinel becomes the first new free block; a new sentinel
+	 * must fit after it. */
+	uintptr_t payload = (uintptr_t) block_to_ptr(sentinel);
+
+	if (tlsf->end_addr < payload + BLOCK_SIZE_MIN + BLOCK_OVERHEAD) {
+		return;
+	}
+
+	pool_carve(tlsf, sentinel,
+			align_down(tlsf->end_addr - payload - BLOCK_OVERHEAD));
+}
+
+/**
+ * Allocate memory.
+ * @param[in] tlsf allocator state
+ * @param[in] size bytes needed
+ * @param[in] tag caller tag stored with the allocation
+ * @returns the memory, aligned to a pointer, or NULL
+ */
+void *PIOS_TLSF_Malloc(struct pios_tlsf *tlsf, size_t size, uint8_t tag)
+{
+	if (size > BLOCK_SIZE_MAX) {
+		return NULL;
+	}
+
+	size = align_up(size);
+
+	if (size < BLOCK_SIZE_MIN) {
+		size = BLOCK_SIZE_MIN;
+	}
+
+	int fl, sl;
+
+	mapping_search(size, &fl, &sl);
+
+	if (fl >= PIOS_TLSF_FL_COUNT) {
+		return NULL;
+	}
+
+	struct pios_tlsf_block *block = search_suitable_block(tlsf, &fl, &sl);
+
+	if (block == NULL) {
+		/* The good fit search skips the list the size itself falls
+		 * in, since not every block there is big enough.  Before
+		 * failing, look through that list too; otherwise the last
+		 * few hundred bytes of a nearly full heap can't be used. */
+		mapping_insert(size, &fl, &sl);
+
+		for (block = tlsf->blocks[fl][sl]; block;
+				block = block->next_free) {
+			if (block_size(block) >= size) {
+				break;
+			}
+		}
+
+		if (block == NULL) {
+			return NULL;
+		}
+	}
+
+	remove_free_block(tlsf, block, fl, sl);
+	block_trim_free(tlsf, block, size);
+	block_mark_as_used(block);
+
+	block->size = (block->size & ~BLOCK_TAG_MASK) |
+		((uintptr_t) tag << BLOCK_TAG_SHIFT);
+
+	return block_to_ptr(block);
+}
+
+/**
+ * Return memory from PIOS_TLSF_Malloc to the allocator.
+ */
+void PIOS_TLSF_Free(struct pios_tlsf *tlsf, void *ptr)
+{
+	if (ptr == NULL) {
+		return;
+	}
+
+	struct pios_tlsf_block *block = block_from_ptr(ptr);
+
+	if (block_is_free(block)) {
+		/* Double free */
+		return;
+	}
+
+	block->size &= ~BLOCK_TAG_MASK;
+	block_mark_as_free(block);
+
+	block = block_merge_prev(tlsf, block);
+	block = block_merge_next(tlsf, block);
+
+	block_insert(tlsf, block);
+}
+
+/**
+ * Usable size of an allocation; may be slightly more than was asked for.
+ */
+size_t PIOS_TLSF_BlockSize(const void *ptr)
+{
+	return block_size(block_from_ptr(ptr));
+}
+
+uint8_t PIOS_TLSF_BlockTag(const void *ptr)
+{
+	return (block_from_ptr(ptr)->size & BLOCK_TAG_MASK) >> BLOCK_TAG_SHIFT;
+}
+
+size_t PIOS_TLSF_GetFreeSize(const struct pios_tlsf *tlsf)
+{
+	return tlsf->free_bytes;
+}
+
+/**
+ * Size of the biggest block malloc could currently hand out.
+ */
+size_t PIOS_TLSF_GetLargestFree(const struct pios_tlsf *tlsf)
+{
+	if (!tlsf->fl_bitmap) {
+		return 0;
+	}
+
+	int fl = tlsf_fls(tlsf->fl_bitmap);
+	int sl = tlsf_fls(tlsf->sl_bitmap[fl]);
+
+	size_t largest = 0;
+
+	for (const struct pios_tlsf_block *block = tlsf->blocks[fl][sl];
+			block; block = block->next_free) {
+		if (block_size(block) > largest) {
+			largest = block_size(block);
+		}
+	}
+
+	return largest;
+}
+
+static bool block_in_free_list(const struct pios_tlsf *tlsf,
+		const struct pios_tlsf_block *block)
+{
+	int fl, sl;
+
+	mapping_insert(block_size(block), &fl, &sl);
+
+	for (const struct pios_tlsf_block *b = tlsf->blocks[fl][sl]; b;
+			b = b->next_free) {
+		if (b == block) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Walk the whole pool and the free lists checking the allocator's
+ * invariants.  Slow; meant for tests.
+ * @returns true if everything is consistent
+ */
+bool PIOS_TLSF_Check(const struct pios_tlsf *tlsf)
+{
+	if (tlsf->first == NULL) {
+		return tlsf->free_bytes == 0;
+	}
+
+	size_t free_bytes = 0;
+	bool prev_free = false;
+
+	const struct pios_tlsf_block *block = tlsf->first;
+
+	while (block != tlsf->sentinel) {
+		if ((uintptr_t) block_to_ptr(block) >= tlsf->end_addr) {
+			return false;
+		}
+
+		if (block_is_prev_free(block) != prev_free) {
+			return false;
+		}
+
+		if (block_size(block) < BLOCK_SIZE_MIN) {
+			return false;
+		}
+
+		const struct pios_tlsf_block *next = block_next(block);
+
+		if (block_is_free(block)) {
+			/* Adjacent free blocks are only allowed when they
+			 * would be too big together */
+			if (prev_free && block_can_merge(block->prev_phys,
+						block)) {
+				return false;
+			}
+
+			if (next->prev_phys != block) {
+				return false;
+			}
+
+			if (!block_in_free_list(tlsf, block)) {
+				return false;
+			}
+
+			free_bytes += block_size(block);
+		}
+
+		prev_free = block_is_free(block);
+		block = next;
+	}
+
+	if ((block_is_prev_free(block) != prev_free) || block_is_free(block)) {
+		return false;
+	}
+
+	if (free_bytes != tlsf->free_bytes) {
+		return false;
+	}
+
+	/* Every list the bitmaps advertise is populated, and vice versa */
+	for (int fl = 0; fl < PIOS_TLSF_FL_COUNT; fl++) {
+		bool fl_set = tlsf->fl_bitmap & (1U << fl);
+
+		if (fl_set != (tlsf->sl_bitmap[fl] != 0)) {
+			return false;
+		}
+
+		for (int sl = 0; sl < PIOS_TLSF_SL_COUNT; sl++) {
+			bool sl_set = tlsf->sl_bitmap[fl] & (1U << sl);
+
+			if (sl_set != (tlsf->blocks[fl][sl] != NULL)) {
+				return false;
+			}
+
+			for (const struct pios_tlsf_block *b =
+					tlsf->blocks[fl][sl]; b;
+					b = b->next_free) {
+				if (!block_is_free(b)) {
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @}
+ * @}
+ */
@@ -0,0 +1,304 @@
+/**
+ ******************************************************************************
+ * @addtogroup PIOS PIOS Core hardware abstraction layer
+ * @{
+ * @addtogroup PIOS_TRACE Trace event recorder
+ * @{
+ *
+ * @file       pios_trace.c
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Records a timeline of scheduler, queue and object events.
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * Additional note on redistribution: The copyright and license notices above
+ * must be maintained in each individual source file that is a derivative work
+ * of this source file; otherwise redistribution is prohibited.
+ */
+
+#include "pios.h"
+
+#if defined(PIOS_INCLUDE_TRACE)
+
+#include "pios_trace.h"
+
+#if defined(PIOS_INCLUDE_CHIBIOS)
+#include "ch.h"
+#endif
+
+#if !defined(PIOS_TRACE_NUM_EVENTS)
+#define PIOS_TRACE_NUM_EVENTS 512
+#endif
+
+#if !defined(PIOS_TRACE_MAX_NAMES)
+#define PIOS_TRACE_MAX_NAMES 32
+#endif
+
+DONT_BUILD_IF((PIOS_TRACE_NUM_EVENTS & (PIOS_TRACE_NUM_EVENTS - 1)) != 0,
+		TraceRingNotPowerOfTwo);
+
+/* The file is a header, then names for threads and markers, then the
+ * events oldest first.  Everything is little endian. */
+
+#define PIOS_TRACE_MAGIC 0x45435254	/* "TRCE" */
+#define PIOS_TRACE_VERSION 1
+
+struct pios_trace_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t num_names;
+	uint32_t num_events;
+	/* Timestamps are PIOS_DELAY raw ticks; raw_span of them take
+	 * us_span microseconds */
+	uint32_t raw_span;
+	uint32_t us_span;
+} __attribute__((packed));
+
+struct pios_trace_name {
+	uint32_t arg;
+	uint8_t type;		/* The event type arg goes with */
+	char name[19];
+} __attribute__((packed));
+
+struct pios_trace_event {
+	uint32_t timestamp;
+	uint32_t arg;
+	uint8_t type;
+} __attribute__((packed));
+
+static struct pios_trace_event events[PIOS_TRACE_NUM_EVENTS];
+static uint32_t head;
+static bool ring_full;
+static volatile bool recording = true;
+
+/* What is being read out, fixed when the read starts */
+static bool frozen;
+static struct pios_trace_header header;
+static struct pios_trace_name names[PIOS_TRACE_MAX_NAMES];
+static uint32_t first_event;
+
+static const char * const marker_names[] = {
+	[PIOS_TRACE_MARKER_GYROS] = "Gyros",
+	[PIOS_TRACE_MARKER_ATTITUDE] = "Attitude",
+	[PIOS_TRACE_MARKER_STABILIZATION] = "Stabilization",
+	[PIOS_TRACE_MARKER_ACTUATOR] = "Actuator",
+};
+
+DONT_BUILD_IF(NELEMENTS(marker_names) != PIOS_TRACE_MARKER_NUM,
+		TraceMarkerNamesMismatch);
+
+void PIOS_Trace_Record(enum pios_trace_type type, uint32_t arg)
+{
+	if (!recording) {
+		return;
+	}
+
+	uint32_t timestamp = PIOS_DELAY_GetRaw();
+
+	/* Claiming the slot is the only shared step; an interrupt that
+	 * records in between takes the next one */
+	uint32_t idx = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED) &
+		(PIOS_TRACE_NUM_EVENTS - 1);
+
+	if (idx == PIOS_TRACE_NUM_EVENTS - 1) {
+		ring_full = true;
+	}
+
+	struct pios_trace_event *ev = &events[idx];
+
+	ev->timestamp = timestamp;
+	ev->arg = arg;
+	ev->type = type;
+}
+
+void PIOS_Trace_IRQ(bool enter)
+{
+	uint32_t irq = 0;
+
+#if !defined(SIM_POSIX)
+	irq = __get_IPSR();
+#endif
+
+	PIOS_Trace_Record(enter ? PIOS_TRACE_IRQ_ENTER : PIOS_TRACE_IRQ_EXIT,
+			irq);
+}
+
+static void add_name(enum pios_trace_type type, uint32_t arg,
+		const char *name)
+{
+	if (header.num_names >= PIOS_TRACE_MAX_NAMES) {
+		return;
+	}
+
+	struct pios_trace_name *entry = &names[header.num_names++];
+
+	entry->arg = arg;
+	entry->type = type;
+	strncpy(entry->name, name ? name : "", sizeof(entry->name) - 1);
+	entry->name[sizeof(entry->name) - 1] = 0;
+}
+
+/**
+ * Stops recording and fixes what will be read out.
+ */
+static void freeze(void)
+{
+	recording = false;
+
+	uint32_t end = __atomic_load_n(&head, __ATOMIC_RELAXED);
+
+	memset(&header, 0, sizeof(header));
+	memset(names, 0, sizeof(names));
+
+	header.magic = PIOS_TRACE_MAGIC;
+	header.version = PIOS_TRACE_VERSION;
+
+	if (ring_full) {
+		header.num_events = PIOS_TRACE_NUM_EVENTS;
+		first_event = end;
+	} else {
+		header.num_events = end;
+		first_event = 0;
+	}
+
+	/* Large enough that the integer division loses nothing much */
+	header.raw_span = 0xF0000000;
+	header.us_span = PIOS_DELAY_DiffuS2(0, header.raw_span);
+
+#if defined(PIOS_INCLUDE_CHIBIOS)
+	Thread *tp = chRegFirstThread();
+
+	while (tp) {
+		add_name(PIOS_TRACE_TASK_SWITCH, (uint32_t) tp, tp->p_name);
+		tp = chRegNextThread(tp);
+	}
+#endif
+
+	for (int i = 0; i < PIOS_TRACE_MARKER_NUM; i++) {
+		add_name(PIOS_TRACE_MARK, i, marker_names[i]);
+	}
+
+	frozen = true;
+}
+
+/**
+ * Copies the part of a block of the file that overlaps the read.
+ * @returns bytes copied
+ */
+static uint32_t copy_part(uint8_t *buf, uint32_t offset, uint32_t len,
+		uint32_t block_offset, const void *block, uint32_t block_len)
+{
+	if (offset >= block_offset + block_len || offset + len <= block_offset) {
+		return 0;
+	}
+
+	uint32_t start = (offset > block_offset) ? offset - block_offset : 0;
+	uint32_t end = offset + len - block_offset;
+
+	if (end > block_len) {
+		end = block_len;
+	}
+
+	memcpy(buf + (block_offset + start - offset),
+			(const uint8_t *) block + start, end - start);
+
+	return end - start;
+}
+
+int32_t PIOS_Trace_Read(uint8_t *buf, uint32_t offset, uint32_t len)
+{
+	if (offset == 0) {
+		freeze();
+	} else if (!frozen) {
+		return -1;
+	}
+
+	uint32_t names_offset = sizeof(header);
+	uint32_t events_offset = names_offset +
+		header.num_names * sizeof(*names);
+	uint32_t size = events_offset +
+		header.num_events * sizeof(*events);
+
+	if (offset >= size) {
+		frozen = false;
+		recording = true;
+
+		return 0;
+	}
+
+	if (len > size - offset) {
+		len = size - offset;
+	}
+
+	uint32_t copied = 0;
+
+	copied += copy_part(buf, offset, len, 0, &header, sizeof(header));
+	copied += copy_part(buf, offset, len, names_offset, names,
+			header.num_names * sizeof(*names));
+
+	/* The events wrap around the ring; copy the two runs */
+	uint32_t start = first_event & (PIOS_TRACE_NUM_EVENTS - 1);
+	uint32_t first_run = PIOS_TRACE_NUM_EVENTS - start;
+
+	if (first_run > header.num_events) {
+		first_run = header.num_events;
+	}
+
+	copied += copy_part(buf, offset, len, events_offset, &events[start],
+			first_run * sizeof(*events));
+	copied += copy_part(buf, offset, len,
+			events_offset + first_run * sizeof(*events), events,
+			(header.num_events - first_run) * sizeof(*events));
+
+	return copied;
+}
+
+#if defined(SIM_POSIX)
+int32_t PIOS_Trace_Save(const char *path)
+{
+	FILE *f = fopen(path, "wb");
+
+	if (!f) {
+		return -1;
+	}
+
+	uint8_t buf[256];
+	uint32_t offset = 0;
+	int32_t len;
+
+	while ((len = PIOS_Trace_Read(buf, offset, sizeof(buf))) > 0) {
+		if (fwrite(buf, 1, len, f) != (size_t) len) {
+			break;
+		}
+
+		offset += len;
+	}
+
+	if (fclose(f) || len != 0) {
+		return -1;
+	}
+
+	return 0;
+}
+#endif
+
+#endif /* PIOS_INCLUDE_TRACE */
+
+/**
+ * @}
+ * @}
+ */
@@ -525,10 +525,17 @@ typedef uint32_t halrtcnt_t;
  * @details This hook is invoked just before switching between threads.
  */
 #if !defined(THREAD_CONTEXT_SWITCH_HOOK) || defined(__DOXYGEN__)
+#if defined(PIOS_INCLUDE_TRACE)
+#include "pios_trace.h"
+#define THREAD_TRACE_SWITCH(ntp) PIOS_TRACE(PIOS_TRACE_TASK_SWITCH, ntp)
+#else
+#define THREAD_TRACE_SWITCH(ntp)
+#endif
+
 #define THREAD_CONTEXT_SWITCH_HOOK(ntp, otp) {                              \
   ntp->ticks_switched_in = halGetCounterValue();                            \
   otp->ticks_total += ntp->ticks_switched_in - otp->ticks_switched_in;      \
-  /* System halt code here.*/                                               \
+  THREAD_TRACE_SWITCH(ntp);                                                 \
 }
 #endif
 
@@ -1,7 +1,7 @@
 /**
  ******************************************************************************
  * @file       pios_heap.h
- * @author     dRonin, http://dRonin.org/, Copyright (C) 2015
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2015-2017
  * @author     Tau Labs, http://taulabs.org, Copyright (C) 2013
  * @addtogroup PIOS PIOS Core hardware abstraction layer
  * @{
@@ -29,16 +29,40 @@
 
 #include <stdlib.h>		/* size_t */
 #include <stdbool.h>		/* bool */
+#include <stdint.h>		/* uint32_t */
+
+/**
+ * Who an allocation was made for.  Usage is accounted per tag and
+ * published in HeapStatus, whose element names follow this order.
+ */
+enum pios_heap_tag {
+	PIOS_HEAP_TAG_OTHER,
+	PIOS_HEAP_TAG_UAVOBJ,
+	PIOS_HEAP_TAG_STACK,
+	PIOS_HEAP_TAG_QUEUE,
+	PIOS_HEAP_TAG_FILTER,
+	PIOS_HEAP_TAG_LOGGING,
+	PIOS_HEAP_TAG_OSD,
+	PIOS_HEAP_TAG_COMMS,
+	PIOS_HEAP_TAG_NUM
+};
 
 extern bool PIOS_heap_malloc_failed_p(void);
 
 extern void * PIOS_malloc_no_dma(size_t size);
 extern void * PIOS_malloc(size_t size);
 
+extern void * PIOS_malloc_no_dma_tagged(size_t size, enum pios_heap_tag tag);
+extern void * PIOS_malloc_tagged(size_t size, enum pios_heap_tag tag);
+
 extern void PIOS_free(void * buf);
 
 extern size_t PIOS_heap_get_free_size(void);
 extern size_t PIOS_fastheap_get_free_size(void);
+extern size_t PIOS_heap_get_largest_free(void);
+extern size_t PIOS_fastheap_get_largest_free(void);
+extern void PIOS_heap_get_tag_usage(enum pios_heap_tag tag, uint32_t *bytes,
+		uint32_t *blocks);
 extern void PIOS_heap_initialize_blocks(void);
 extern void PIOS_heap_increase_size(size_t bytes);
 
@@ -38,7 +38,11 @@ extern int32_t PIOS_IRQ_Disable(void);
 extern int32_t PIOS_IRQ_Enable(void);
 extern bool PIOS_IRQ_InISR(void);
 
-#if defined(PIOS_INCLUDE_CHIBIOS)
+#if defined(PIOS_INCLUDE_CHIBIOS) && defined(PIOS_INCLUDE_TRACE)
+#	include <pios_trace.h>
+#	define PIOS_IRQ_Prologue() do { CH_IRQ_PROLOGUE(); PIOS_Trace_IRQ(true); } while (0)
+#	define PIOS_IRQ_Epilogue() do { PIOS_Trace_IRQ(false); CH_IRQ_EPILOGUE(); } while (0)
+#elif defined(PIOS_INCLUDE_CHIBIOS)
 #	define PIOS_IRQ_Prologue() CH_IRQ_PROLOGUE()
 #	define PIOS_IRQ_Epilogue() CH_IRQ_EPILOGUE()
 #else
@@ -104,8 +104,9 @@
 #define PIOS_MPU_USERCTL_FIFO_EN      0X40
 #define PIOS_MPU_USERCTL_I2C_MST_EN   0X20
 #define PIOS_MPU_USERCTL_DIS_I2C      0X10
-#define PIOS_MPU_USERCTL_FIFO_RST     0X02
-#define PIOS_MPU_USERCTL_GYRO_RST     0X01
+#define PIOS_MPU_USERCTL_FIFO_RST     0X04
+#define PIOS_MPU_USERCTL_I2C_MST_RST  0X02
+#define PIOS_MPU_USERCTL_SIG_COND_RST 0X01
 
 /* Power management and clock selection */
 #define PIOS_MPU_PWRMGMT_IMU_RST      0X80
@@ -33,10 +33,19 @@
 struct pios_rcvr_driver {
 	void    (*init)(uintptr_t id);
 	int32_t (*read)(uintptr_t id, uint8_t channel);
+	/* Optional: copies the latest complete frame, zero based, and when it
+	 * arrived; returns the number of channels copied */
+	int32_t (*read_frame)(uintptr_t id, int16_t *channels,
+			uint8_t num_channels, uint32_t *frame_time);
 };
 
 /* Public Functions */
 int32_t PIOS_RCVR_Read(uintptr_t rcvr_id, uint8_t channel);
+int32_t PIOS_RCVR_ReadFrame(uintptr_t rcvr_id, int16_t *channels,
+		uint8_t num_channels, uint32_t *frame_time);
+int32_t PIOS_RCVR_CopyFrame(const uint16_t *src, uint8_t src_channels,
+		uint32_t src_time, int16_t *channels, uint8_t num_channels,
+		uint32_t *frame_time);
 bool PIOS_RCVR_WaitActivity(uint32_t timeout_ms);
 void PIOS_RCVR_Active();
 void PIOS_RCVR_ActiveFromISR();
@@ -50,6 +50,21 @@ struct pios_sensor_accel_data {
 	float temperature;
 };
 
+//! Most samples a pios_sensor_imu_batch can carry
+#define PIOS_SENSOR_IMU_BATCH_MAX 8
+
+//! Pios sensor structure for accel and gyro samples read out together
+struct pios_sensor_imu_batch {
+	uint32_t timestamp;		/* PIOS_DELAY raw time the newest sample was read */
+	uint16_t sample_period_us;
+	uint8_t count;
+	float temperature;
+	struct {
+		float gyro[3];
+		float accel[3];
+	} samples[PIOS_SENSOR_IMU_BATCH_MAX];	/* oldest first */
+};
+
 //! Pios sensor structure for generic mag data
 struct pios_sensor_mag_data {
 	float x;
@@ -90,6 +105,7 @@ enum pios_sensor_type
 	PIOS_SENSOR_BARO,
 	PIOS_SENSOR_OPTICAL_FLOW,
 	PIOS_SENSOR_RANGEFINDER,
+	PIOS_SENSOR_IMU_BATCH,		/* replaces ACCEL and GYRO */
 	PIOS_SENSOR_LAST
 };
 
@@ -0,0 +1,133 @@
+/**
+ ******************************************************************************
+ * @addtogroup PIOS PIOS Core hardware abstraction layer
+ * @{
+ * @addtogroup PIOS_SNAPSHOT Flight state snapshots
+ * @{
+ *
+ * @file       pios_snapshot.h
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Saves and restores the complete flight state of the simulator.
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * Additional note on redistribution: The copyright and license notices above
+ * must be maintained in each individual source file that is a derivative work
+ * of this source file; otherwise redistribution is prohibited.
+ */
+
+#ifndef PIOS_SNAPSHOT_H
+#define PIOS_SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * A snapshot holds every UAVObject instance plus whatever private state
+ * modules have registered -- filter states, PID accumulators, the physics
+ * plant -- so a scenario can start from the middle of a flight instead of
+ * from boot.
+ *
+ * Modules register their state once it is initialized, typically just
+ * before the task's main loop.  If a snapshot is being restored, the saved
+ * copy is written over the state right then, so whatever the module did
+ * to set itself up is replaced by where it was when the snapshot was
+ * taken.  Registration is a no-op on targets without snapshots.
+ */
+
+#define PIOS_SNAPSHOT_NAME_LEN 48
+
+#if defined(PIOS_INCLUDE_SNAPSHOT)
+
+/**
+ * Starts the snapshot service.
+ * @param[in] save_path where snapshots are written, or NULL
+ * @param[in] save_at_ms also save once the clock reaches this, or 0
+ * @returns 0 on success
+ */
+int32_t PIOS_SNAPSHOT_Init(const char *save_path, uint32_t save_at_ms);
+
+/**
+ * Registers module state to be saved and restored.
+ * @param[in] name unique name, prefixed with the module
+ * @param[in] state the state; must stay valid for the program's life
+ * @param[in] len its size
+ * @returns 0 on success
+ */
+int32_t PIOS_SNAPSHOT_Register(const char *name, void *state, uint32_t len);
+
+/**
+ * Loads a snapshot for restoring: the clock is set to when it was taken
+ * and state already registered is restored now, the rest as it
+ * registers.  Call before the modules start.
+ */
+int32_t PIOS_SNAPSHOT_Load(const char *path);
+
+/**
+ * Restores the UAVObjects of the loaded snapshot.  Call once every
+ * module has initialized its objects.  Releases the pacer.
+ */
+int32_t PIOS_SNAPSHOT_RestoreObjects(void);
+
+/**
+ * Writes a snapshot now.
+ */
+int32_t PIOS_SNAPSHOT_Save(const char *path);
+
+/**
+ * Asks for a snapshot to be written to the save path soon.  Safe to call
+ * from a signal handler.
+ */
+void PIOS_SNAPSHOT_Request(void);
+
+/**
+ * Called by whatever paces the simulation (the physics plant), between
+ * steps, when the firmware has finished with the last one.  Snapshots are
+ * taken here when there is a pacer, so they don't catch the firmware
+ * halfway through a control cycle; and the pacer is held here until a
+ * restore is complete.
+ */
+void PIOS_SNAPSHOT_Pace(void);
+
+#else
+
+static inline int32_t PIOS_SNAPSHOT_Register(const char *name, void *state,
+		uint32_t len)
+{
+	(void) name; (void) state; (void) len;
+
+	return 0;
+}
+
+static inline void PIOS_SNAPSHOT_Pace(void)
+{
+}
+
+#endif /* PIOS_INCLUDE_SNAPSHOT */
+
+/**
+ * Registers a variable under its own name.
+ */
+#define PIOS_SNAPSHOT_VAR(module, var) \
+	PIOS_SNAPSHOT_Register(module "." #var, &(var), sizeof(var))
+
+#endif /* PIOS_SNAPSHOT_H */
+
+/**
+ * @}
+ * @}
+ */
@@ -0,0 +1,114 @@
+/**
+ ******************************************************************************
+ * @addtogroup PIOS PIOS Core hardware abstraction layer
+ * @{
+ * @addtogroup   PIOS_SPI SPI Functions
+ * @{
+ *
+ * @file       pios_spi_queue.h
+ * @author     dRonin, http://dronin.org, Copyright (C) 2017
+ * @brief      Prioritized, asynchronous transaction queue for a SPI bus
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef PIOS_SPI_QUEUE_H
+#define PIOS_SPI_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Drivers describe a transaction -- a chip select assertion holding a
+ * chain of transfers -- and submit it without waiting.  Each bus has one
+ * worker that runs the highest priority pending transaction next and
+ * calls the submitter back when it is done, so a short IMU read waits for
+ * at most the transaction in progress instead of every flash write
+ * queued ahead of it.  The worker claims the bus around each transaction,
+ * so drivers still using PIOS_SPI_ClaimBus share the bus safely.
+ *
+ * Transactions and their transfers belong to the submitter and must stay
+ * valid until the callback runs.  Drivers written around blocking
+ * transfers can use PIOS_SPI_Queue_Transact, which sleeps until then.
+ */
+
+enum pios_spi_queue_prio {
+	PIOS_SPI_PRIO_HIGH,	/* sensors sampled in the control loop */
+	PIOS_SPI_PRIO_NORMAL,
+	PIOS_SPI_PRIO_LOW,	/* bulk flash, OSD */
+	PIOS_SPI_PRIO_NUM
+};
+
+struct pios_spi_xfer {
+	const uint8_t *tx;	/* NULL sends 0xff */
+	uint8_t *rx;		/* NULL discards */
+	uint16_t len;
+	struct pios_spi_xfer *next;	/* same chip select */
+};
+
+struct pios_spi_txn;
+
+typedef void (*pios_spi_txn_cb)(struct pios_spi_txn *txn, int32_t status);
+
+struct pios_spi_txn {
+	uint32_t slave;
+	uint32_t speed_hz;	/* 0 leaves the clock alone */
+	enum pios_spi_queue_prio prio;
+	struct pios_spi_xfer *xfers;
+
+	pios_spi_txn_cb cb;	/* runs in the worker; must not block */
+	void *ctx;
+
+	/* Owned by the queue */
+	struct pios_spi_txn *next;
+	uint32_t queued_raw;
+};
+
+struct pios_spi_queue_stats {
+	uint32_t completed;
+	uint32_t failed;
+	uint32_t wait_max_us;	/* submit to start of transfer */
+	uint32_t wait_total_us;
+	uint32_t busy_max_us;	/* start to end of transfer */
+};
+
+struct pios_spi_queue;
+
+int32_t PIOS_SPI_Queue_Init(struct pios_spi_queue **queue, uint32_t spi_id);
+struct pios_spi_queue *PIOS_SPI_Queue_Find(uint32_t spi_id);
+
+int32_t PIOS_SPI_Queue_Submit(struct pios_spi_queue *queue,
+		struct pios_spi_txn *txn);
+
+struct pios_semaphore;
+
+int32_t PIOS_SPI_Queue_Transact(struct pios_spi_queue *queue,
+		struct pios_spi_txn *txn, struct pios_semaphore *done);
+
+bool PIOS_SPI_Queue_RunOne(struct pios_spi_queue *queue);
+
+void PIOS_SPI_Queue_GetStats(struct pios_spi_queue *queue,
+		enum pios_spi_queue_prio prio,
+		struct pios_spi_queue_stats *stats);
+void PIOS_SPI_Queue_ClearStats(struct pios_spi_queue *queue);
+
+#endif /* PIOS_SPI_QUEUE_H */
+
+/**
+ * @}
+ * @}
+ */
@@ -0,0 +1,91 @@
+/**
+ ******************************************************************************
+ * @file       pios_tlsf.h
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @addtogroup PIOS PIOS Core hardware abstraction layer
+ * @{
+ * @addtogroup PIOS_HEAP Heap Allocation Abstraction
+ * @{
+ * @brief Two-level segregated fit allocator used behind PIOS_malloc
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef PIOS_TLSF_H
+#define PIOS_TLSF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Each first-level class (a power of two) is split into this many
+ * linearly spaced second-level lists.  8 keeps the worst case waste of a
+ * good fit at 1/8 while the list heads stay small enough for F1 parts. */
+#define PIOS_TLSF_SL_LOG2 3
+#define PIOS_TLSF_SL_COUNT (1 << PIOS_TLSF_SL_LOG2)
+
+/* Largest block is just under 2^FL_INDEX_MAX bytes; bigger pools are
+ * carved up into several blocks. */
+#define PIOS_TLSF_FL_INDEX_MAX 18
+
+#if UINTPTR_MAX > 0xffffffff
+#define PIOS_TLSF_ALIGN_LOG2 3
+#else
+#define PIOS_TLSF_ALIGN_LOG2 2
+#endif
+
+#define PIOS_TLSF_FL_SHIFT (PIOS_TLSF_SL_LOG2 + PIOS_TLSF_ALIGN_LOG2)
+#define PIOS_TLSF_FL_COUNT (PIOS_TLSF_FL_INDEX_MAX - PIOS_TLSF_FL_SHIFT + 1)
+
+/* Allocations carry an 8 bit caller tag in their header */
+#define PIOS_TLSF_MAX_TAGS 256
+
+struct pios_tlsf_block;
+
+struct pios_tlsf {
+	uint32_t fl_bitmap;
+	uint8_t sl_bitmap[PIOS_TLSF_FL_COUNT];
+
+	struct pios_tlsf_block *blocks[PIOS_TLSF_FL_COUNT][PIOS_TLSF_SL_COUNT];
+
+	/* First block of the pool, and the zero sized, always used block
+	 * that ends it */
+	struct pios_tlsf_block *first;
+	struct pios_tlsf_block *sentinel;
+	uintptr_t end_addr;
+
+	size_t free_bytes;
+};
+
+void PIOS_TLSF_Init(struct pios_tlsf *tlsf, void *mem, size_t bytes);
+void PIOS_TLSF_Extend(struct pios_tlsf *tlsf, size_t bytes);
+
+void *PIOS_TLSF_Malloc(struct pios_tlsf *tlsf, size_t size, uint8_t tag);
+void PIOS_TLSF_Free(struct pios_tlsf *tlsf, void *ptr);
+
+size_t PIOS_TLSF_BlockSize(const void *ptr);
+uint8_t PIOS_TLSF_BlockTag(const void *ptr);
+
+size_t PIOS_TLSF_GetFreeSize(const struct pios_tlsf *tlsf);
+size_t PIOS_TLSF_GetLargestFree(const struct pios_tlsf *tlsf);
+
+bool PIOS_TLSF_Check(const struct pios_tlsf *tlsf);
+
+#endif /* PIOS_TLSF_H */
+
+/**
+ * @}
+ * @}
+ */
@@ -0,0 +1,131 @@
+/**
+ ******************************************************************************
+ * @addtogroup PIOS PIOS Core hardware abstraction layer
+ * @{
+ * @addtogroup PIOS_TRACE Trace event recorder
+ * @{
+ *
+ * @file       pios_trace.h
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Records a timeline of scheduler, queue and object events.
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * Additional note on redistribution: The copyright and license notices above
+ * must be maintained in each individual source file that is a derivative work
+ * of this source file; otherwise redistribution is prohibited.
+ */
+
+#ifndef PIOS_TRACE_H
+#define PIOS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Events go into a ring in RAM as they happen, the oldest being
+ * overwritten, so the ring always holds the last PIOS_TRACE_NUM_EVENTS.
+ * Recording is a few stores and an atomic increment, safe from any task
+ * or interrupt.
+ *
+ * The ring is read out as a file, PIOS_TRACE_FILE_ID over UAVTalk file
+ * transfer or written to disk by the simulator; recording pauses while
+ * it is read.  python/dronin-trace turns it into a Chrome trace / Perfetto
+ * JSON timeline.
+ *
+ * Build with ENABLE_TRACE=YES to record; otherwise every hook compiles
+ * away.
+ */
+
+//! File ID the trace is read through, above the flash partitions
+#define PIOS_TRACE_FILE_ID 0x100
+
+enum pios_trace_type {
+	PIOS_TRACE_TASK_SWITCH = 1,	//!< arg: thread switched in
+	PIOS_TRACE_QUEUE_SEND,		//!< arg: queue
+	PIOS_TRACE_QUEUE_RECEIVE,	//!< arg: queue
+	PIOS_TRACE_UAVO_SET,		//!< arg: object ID
+	PIOS_TRACE_IRQ_ENTER,		//!< arg: exception number
+	PIOS_TRACE_IRQ_EXIT,		//!< arg: exception number
+	PIOS_TRACE_MARK,		//!< arg: enum pios_trace_marker
+	PIOS_TRACE_BEGIN,		//!< arg: enum pios_trace_marker
+	PIOS_TRACE_END,			//!< arg: enum pios_trace_marker
+};
+
+/**
+ * Points of interest, named in the trace.  The first few mark each stage
+ * of the control loop finishing, so the converter can show the latency
+ * from a gyro sample to the outputs it leads to.
+ */
+enum pios_trace_marker {
+	PIOS_TRACE_MARKER_GYROS,
+	PIOS_TRACE_MARKER_ATTITUDE,
+	PIOS_TRACE_MARKER_STABILIZATION,
+	PIOS_TRACE_MARKER_ACTUATOR,
+
+	PIOS_TRACE_MARKER_NUM
+};
+
+#if defined(PIOS_INCLUDE_TRACE)
+
+/**
+ * Records an event.
+ * @param[in] type what happened
+ * @param[in] arg which thread, queue, object etc; see enum pios_trace_type
+ */
+void PIOS_Trace_Record(enum pios_trace_type type, uint32_t arg);
+
+/**
+ * Records entering or leaving the current interrupt handler.
+ */
+void PIOS_Trace_IRQ(bool enter);
+
+/**
+ * Reads the trace as a file.  Recording stops when offset 0 is read, so
+ * the ring holds still, and starts again once the end has been read.
+ * @param[out] buf where to copy the data
+ * @param[in] offset into the file
+ * @param[in] len the most to copy
+ * @returns bytes copied, 0 at the end
+ */
+int32_t PIOS_Trace_Read(uint8_t *buf, uint32_t offset, uint32_t len);
+
+#if defined(SIM_POSIX)
+/**
+ * Writes the trace to a file.
+ */
+int32_t PIOS_Trace_Save(const char *path);
+#endif
+
+#define PIOS_TRACE(type, arg) PIOS_Trace_Record((type), (uint32_t) (uintptr_t) (arg))
+
+#else
+
+#define PIOS_TRACE(type, arg) do { } while (0)
+
+#endif /* PIOS_INCLUDE_TRACE */
+
+#define PIOS_TRACE_MARK(marker) PIOS_TRACE(PIOS_TRACE_MARK, marker)
+#define PIOS_TRACE_BEGIN(marker) PIOS_TRACE(PIOS_TRACE_BEGIN, marker)
+#define PIOS_TRACE_END(marker) PIOS_TRACE(PIOS_TRACE_END, marker)
+
+#endif /* PIOS_TRACE_H */
+
+/**
+ * @}
+ * @}
+ */
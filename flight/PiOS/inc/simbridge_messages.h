@@ -0,0 +1,191 @@
+/**
+ ******************************************************************************
+ * @addtogroup PIOS PIOS Core hardware abstraction layer
+ * @{
+ * @addtogroup PIOS_SIMBRIDGE Simulator bridge protocol
+ * @{
+ *
+ * @file       simbridge_messages.h
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Binary protocol between the posix flight build and a simulator
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * Additional note on redistribution: The copyright and license notices above
+ * must be maintained in each individual source file that is a derivative work
+ * of this source file; otherwise redistribution is prohibited.
+ */
+
+#ifndef _SIMBRIDGE_MESSAGES_H
+#define _SIMBRIDGE_MESSAGES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The simulator sends SENSORS datagrams, each holding a batch of
+ * timestamped samples in the order they were taken.  The flight side
+ * answers each batch with one ACTUATORS datagram once it has run its
+ * control loop over every gyro sample in the batch.  Everything is
+ * little endian, and a receiver drops datagrams whose magic, version or
+ * length doesn't check out.
+ */
+
+#define SIMBRIDGE_MAGIC 0x6e725364	/* "dSrn" */
+#define SIMBRIDGE_VERSION 1
+
+#define SIMBRIDGE_MAX_SAMPLES 64
+#define SIMBRIDGE_MAX_CHANNELS 16
+
+enum simbridge_msg_type {
+	SIMBRIDGE_MSG_SENSORS = 1,
+	SIMBRIDGE_MSG_ACTUATORS = 2,
+};
+
+enum simbridge_sample_type {
+	SIMBRIDGE_SAMPLE_GYRO = 1,	/* deg/s, body frame */
+	SIMBRIDGE_SAMPLE_ACCEL = 2,	/* m/s^2 specific force, body frame */
+	SIMBRIDGE_SAMPLE_MAG = 3,	/* mGa, body frame */
+	SIMBRIDGE_SAMPLE_BARO = 4,
+	SIMBRIDGE_SAMPLE_GPS = 5,
+};
+
+/* 12 bytes */
+struct simbridge_hdr {
+	uint32_t magic;
+	uint8_t version;
+	uint8_t type;
+	uint16_t count;		/* samples or channels that follow */
+	uint32_t seq;
+} __attribute__((__packed__));
+
+/* 40 bytes */
+struct simbridge_sample {
+	uint64_t time_us;	/* simulator time the sample was taken */
+	uint8_t type;
+	uint8_t resv[3];
+
+	union {
+		struct {
+			float x;
+			float y;
+			float z;
+			float temperature;	/* deg C */
+		} vec;
+
+		struct {
+			float altitude;		/* m */
+			float pressure;		/* kPa */
+			float temperature;	/* deg C */
+		} baro;
+
+		struct {
+			int32_t lat;		/* degrees x 10^-7 */
+			int32_t lon;		/* degrees x 10^-7 */
+			float altitude;		/* m above MSL */
+			float vel[3];		/* NED, m/s */
+			uint8_t fix;		/* GPSPosition.Status */
+			uint8_t satellites;
+			uint16_t resv;
+		} gps;
+	} data;
+} __attribute__((__packed__));
+
+struct simbridge_sensors {
+	struct simbridge_hdr hdr;
+	struct simbridge_sample samples[SIMBRIDGE_MAX_SAMPLES];
+} __attribute__((__packed__));
+
+/* 8 bytes */
+struct simbridge_channel {
+	float pulse_us;		/* commanded pulse width */
+	uint16_t min;		/* configured range, us; min > max if reversed */
+	uint16_t max;
+} __attribute__((__packed__));
+
+struct simbridge_actuators {
+	struct simbridge_hdr hdr;
+
+	uint64_t sensor_time_us;	/* last gyro sample the loop ran on */
+	float desired[4];		/* roll, pitch, yaw, thrust */
+	uint8_t armed;
+	uint8_t resv[3];
+
+	struct simbridge_channel channels[SIMBRIDGE_MAX_CHANNELS];
+} __attribute__((__packed__));
+
+/**
+ * Size of a message carrying count samples/channels.
+ */
+static inline size_t simbridge_msg_len(uint8_t type, uint16_t count)
+{
+	switch (type) {
+		case SIMBRIDGE_MSG_SENSORS:
+			return offsetof(struct simbridge_sensors, samples) +
+				count * sizeof(struct simbridge_sample);
+		case SIMBRIDGE_MSG_ACTUATORS:
+			return offsetof(struct simbridge_actuators, channels) +
+				count * sizeof(struct simbridge_channel);
+		default:
+			return 0;
+	}
+}
+
+static inline void simbridge_fill_hdr(struct simbridge_hdr *hdr,
+		uint8_t type, uint16_t count, uint32_t seq)
+{
+	hdr->magic = SIMBRIDGE_MAGIC;
+	hdr->version = SIMBRIDGE_VERSION;
+	hdr->type = type;
+	hdr->count = count;
+	hdr->seq = seq;
+}
+
+/**
+ * Checks that a received datagram is a well formed message of the given
+ * type.
+ */
+static inline bool simbridge_check_hdr(const struct simbridge_hdr *hdr,
+		size_t len, uint8_t type)
+{
+	if (len < sizeof(*hdr)) {
+		return false;
+	}
+
+	if ((hdr->magic != SIMBRIDGE_MAGIC) ||
+			(hdr->version != SIMBRIDGE_VERSION) ||
+			(hdr->type != type)) {
+		return false;
+	}
+
+	uint16_t max_count = (type == SIMBRIDGE_MSG_SENSORS) ?
+		SIMBRIDGE_MAX_SAMPLES : SIMBRIDGE_MAX_CHANNELS;
+
+	if (hdr->count > max_count) {
+		return false;
+	}
+
+	return len == simbridge_msg_len(type, hdr->count);
+}
+
+#endif /* _SIMBRIDGE_MESSAGES_H */
+
+/**
+ * @}
+ * @}
+ */
@@ -94,6 +94,7 @@
 #include <pios_i2c.h>
 #include <pios_can.h>
 #include <pios_spi.h>
+#include <pios_spi_queue.h>
 #include <pios_ppm.h>
 #include <pios_pwm.h>
 #include <pios_rcvr.h>
@@ -105,6 +106,8 @@
 #include <pios_sensors.h>
 #endif
 #include <pios_wdg.h>
+#include <pios_snapshot.h>
+#include <pios_trace.h>
 
 #if !defined(SIM_POSIX) && !defined(PIOS_NO_HW)
 #include <pios_exti.h>
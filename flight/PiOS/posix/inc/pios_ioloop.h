@@ -0,0 +1,76 @@
+/**
+ ******************************************************************************
+ *
+ * @file       pios_ioloop.h
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Shared descriptor event loop for the posix drivers.
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * Additional note on redistribution: The copyright and license notices above
+ * must be maintained in each individual source file that is a derivative work
+ * of this source file; otherwise redistribution is prohibited.
+ */
+
+#ifndef PIOS_IOLOOP_H
+#define PIOS_IOLOOP_H
+
+#include <pios.h>
+
+/*
+ * One thread waits on every registered descriptor and calls the owner's
+ * handler when it is ready, instead of each driver blocking in a thread
+ * of its own.  Handlers run on that thread, so they must not block: read
+ * what is there and return.
+ */
+
+#define PIOS_IOLOOP_READ	0x01
+#define PIOS_IOLOOP_WRITE	0x02
+#define PIOS_IOLOOP_HANGUP	0x04	/* error or peer closed */
+#define PIOS_IOLOOP_KICK	0x08	/* PIOS_IOLoop_Kick was called */
+
+#define PIOS_IOLOOP_MAX_FDS	64
+
+typedef void (*pios_ioloop_cb)(int fd, uint8_t events, void *ctx);
+
+/**
+ * Starts watching a descriptor.
+ * @param[in] fd the descriptor; it is not closed on removal
+ * @param[in] events PIOS_IOLOOP_READ and/or PIOS_IOLOOP_WRITE
+ * @returns 0 on success
+ */
+int32_t PIOS_IOLoop_Add(int fd, uint8_t events, pios_ioloop_cb cb, void *ctx);
+
+/**
+ * Changes which events are waited for; 0 pauses the descriptor without
+ * giving up its slot.
+ */
+int32_t PIOS_IOLoop_Modify(int fd, uint8_t events);
+
+/**
+ * Stops watching a descriptor.  Must be called before closing it.
+ */
+int32_t PIOS_IOLoop_Remove(int fd);
+
+/**
+ * Calls the descriptor's handler with PIOS_IOLOOP_KICK on the loop
+ * thread, soon.  Callable from any thread; kicks made before the handler
+ * runs are merged.
+ */
+int32_t PIOS_IOLoop_Kick(int fd);
+
+#endif /* PIOS_IOLOOP_H */
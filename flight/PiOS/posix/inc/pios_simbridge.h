@@ -0,0 +1,45 @@
+/**
+ ******************************************************************************
+ *
+ * @file       pios_simbridge.h
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Binary simulator bridge driver header.
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * Additional note on redistribution: The copyright and license notices above
+ * must be maintained in each individual source file that is a derivative work
+ * of this source file; otherwise redistribution is prohibited.
+ */
+
+#ifndef PIOS_SIMBRIDGE_H
+#define PIOS_SIMBRIDGE_H
+
+#include <pios.h>
+
+typedef struct simbridge_dev * simbridge_dev_t;
+
+/**
+ * Start the simulator bridge.
+ * @param[out] dev the device handle
+ * @param[in] addr "port[,rate]" for UDP or "unix:path[,rate]" for a
+ * local datagram socket; rate is the simulator's IMU rate in Hz
+ * @returns 0 on success
+ */
+int32_t PIOS_SIMBRIDGE_Init(simbridge_dev_t *dev, const char *addr);
+
+#endif /* PIOS_SIMBRIDGE_H */
@@ -0,0 +1,45 @@
+/**
+ ******************************************************************************
+ *
+ * @file       pios_simplant.h
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Built-in physics plant driver header.
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * Additional note on redistribution: The copyright and license notices above
+ * must be maintained in each individual source file that is a derivative work
+ * of this source file; otherwise redistribution is prohibited.
+ */
+
+#ifndef PIOS_SIMPLANT_H
+#define PIOS_SIMPLANT_H
+
+#include <pios.h>
+
+typedef struct simplant_dev * simplant_dev_t;
+
+/**
+ * Start the built-in physics plant.
+ * @param[out] dev the device handle
+ * @param[in] config "model[:key=val,...]"; model is quad or plane, keys
+ * are rate, mass, ixx, iyy, izz, thrust, tau, expo, noise, seed, lockstep
+ * @returns 0 on success
+ */
+int32_t PIOS_SIMPLANT_Init(simplant_dev_t *dev, const char *config);
+
+#endif /* PIOS_SIMPLANT_H */
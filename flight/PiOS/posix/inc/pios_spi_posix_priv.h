@@ -8,6 +8,11 @@
 
 #define SPI_MAX_SUBDEV 8
 
+/* A base path of "sim:N" gives a bus with N simulated slaves that echo
+ * what they are sent, taking as long as the real clock rate would. */
+#define SPI_SIM_PREFIX "sim:"
+#define SPI_SIM_DEFAULT_HZ 1000000
+
 struct pios_spi_dev {
 	const struct pios_spi_cfg *cfg;
 	struct pios_semaphore *busy;
@@ -17,6 +22,8 @@ struct pios_spi_dev {
 	int fd[SPI_MAX_SUBDEV];
 
 	int selected;
+
+	bool simulated;
 };
 
 struct pios_spi_cfg {
@@ -0,0 +1,88 @@
+/**
+ ******************************************************************************
+ *
+ * @file       pios_swarm.h
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Runs several simulated vehicles on one shared clock.
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * Additional note on redistribution: The copyright and license notices above
+ * must be maintained in each individual source file that is a derivative work
+ * of this source file; otherwise redistribution is prohibited.
+ */
+
+#ifndef PIOS_SWARM_H
+#define PIOS_SWARM_H
+
+#include <pios.h>
+#include <time.h>
+
+/*
+ * The firmware keeps its state in file scope statics, so each vehicle is
+ * its own process, forked from the launcher before any thread exists.
+ * Vehicles run in their own directory (vehicle-N, so flash images and
+ * logs don't collide) and offset every port they open by
+ * PIOS_SWARM_PORT_STRIDE times their instance number.
+ *
+ * All vehicles keep time from the same epoch, optionally sped up, so
+ * their timestamps agree and a scenario can run faster than real time
+ * where the host has the cores for it.
+ */
+
+#define PIOS_SWARM_MAX_INSTANCES 256
+#define PIOS_SWARM_PORT_STRIDE 10
+
+/**
+ * Parses -N count[,speed] out of the arguments and, for more than one
+ * instance, forks the vehicles.  Returns only in the vehicles; the
+ * launcher waits for them and exits.  Call from main() before starting
+ * any thread.
+ */
+void PIOS_SWARM_Start(int argc, char *argv[]);
+
+uint32_t PIOS_SWARM_Instance(void);
+uint32_t PIOS_SWARM_Count(void);
+
+/**
+ * The port this instance should use in place of base_port.
+ */
+uint16_t PIOS_SWARM_Port(uint16_t base_port);
+
+/**
+ * Shared virtual time since the swarm started, in microseconds.
+ */
+uint64_t PIOS_SWARM_GetTime_us(void);
+
+/**
+ * Moves this instance's clock so that it reads time_us now, for resuming
+ * from a snapshot.  Only this instance's clock moves.
+ */
+void PIOS_SWARM_SetTime_us(uint64_t time_us);
+
+/**
+ * Real time to sleep for a virtual duration.
+ */
+uint64_t PIOS_SWARM_Real_ns(uint64_t virtual_ns);
+
+/**
+ * Absolute CLOCK_REALTIME deadline timeout_ms of virtual time from now,
+ * for pthread timed waits.
+ */
+void PIOS_SWARM_Deadline(struct timespec *abstime, uint32_t timeout_ms);
+
+#endif /* PIOS_SWARM_H */
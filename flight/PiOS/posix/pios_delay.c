@@ -31,16 +31,10 @@
 /* Project Includes */
 #include "pios.h"
 #include "time.h"
+#include "pios_swarm.h"
 
 #include <time.h>
 
-/**
- * This is the value used as a base.  Strictly not required, as times
- * can be expected to wrap... But it makes sense to get sane numbers at
- * first that will agree with the PIOS_Thread ones etc.
- */
-static uint32_t base_time;
-
 #ifdef DRONIN_GETTIME
 int clock_gettime(clockid_t clk_id, struct timespec *t)
 {
@@ -70,23 +64,22 @@ int clock_gettime(clockid_t clk_id, struct timespec *t)
 }
 
 #endif /* CLOCK_MONOTONIC */
+/* Shared with every vehicle when simulating several, and sped up if asked */
 static uint32_t get_monotonic_us_time(void) {
-	clockid_t id = CLOCK_MONOTONIC;
+	return PIOS_SWARM_GetTime_us();
+}
 
-#ifdef CLOCK_BOOTTIME
-	id = CLOCK_BOOTTIME;
-#endif /* CLOCK_BOOTTIME; assumes it's a define */
+static void sleep_ns(uint64_t ns)
+{
+	struct timespec wait,rest;
 
-	struct timespec tp;
+	ns = PIOS_SWARM_Real_ns(ns);
 
-	if (clock_gettime(id, &tp)) {
-		perror("clock_gettime");
-		abort();
+	wait.tv_sec=ns/1000000000;
+	wait.tv_nsec=ns%1000000000;
+	while (nanosleep(&wait,&rest)) {
+		wait=rest;
 	}
-
-	uint32_t val = tp.tv_sec * 1000000 + tp.tv_nsec / 1000;
-
-	return val;
 }
 
 /**
@@ -97,8 +90,6 @@ static uint32_t get_monotonic_us_time(void) {
 */
 int32_t PIOS_DELAY_Init(void)
 {
-	base_time = get_monotonic_us_time();
-
 	/* No error */
 	return 0;
 }
@@ -115,12 +106,7 @@ int32_t PIOS_DELAY_Init(void)
 */
 int32_t PIOS_DELAY_WaituS(uint32_t uS)
 {
-	struct timespec wait,rest;
-	wait.tv_sec=0;
-	wait.tv_nsec=1000*uS;
-	while (nanosleep(&wait,&rest)) {
-		wait=rest;
-	}
+	sleep_ns((uint64_t) uS * 1000);
 
 	/* No error */
 	return 0;
@@ -139,12 +125,7 @@ int32_t PIOS_DELAY_WaituS(uint32_t uS)
 */
 int32_t PIOS_DELAY_WaitmS(uint32_t mS)
 {
-	struct timespec wait,rest;
-	wait.tv_sec=mS/1000;
-	wait.tv_nsec=(mS%1000)*1000000;
-	while (nanosleep(&wait, &rest)) {
-		wait=rest;
-	}
+	sleep_ns((uint64_t) mS * 1000000);
 
 	/* No error */
 	return 0;
@@ -152,7 +133,7 @@ int32_t PIOS_DELAY_WaitmS(uint32_t mS)
 
 uint32_t PIOS_DELAY_GetRaw()
 {
-	uint32_t raw_us = get_monotonic_us_time() - base_time;
+	uint32_t raw_us = get_monotonic_us_time();
 	return raw_us;
 }
 
@@ -35,6 +35,7 @@
 #include "pios.h"
 #include "pios_thread.h"
 #include "pios_flightgear.h"
+#include "pios_swarm.h"
 #include <unistd.h>
 #include <sys/types.h>
 #include <errno.h>
@@ -179,6 +180,8 @@ int32_t PIOS_FLIGHTGEAR_Init(flightgear_dev_t *dev, uint16_t port)
         /* Allow reuse of address if you restart. */
         setsockopt(fg_dev->socket, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
 
+	port = PIOS_SWARM_Port(port);
+
 	printf("binding sockets on ports %d, %d\n", port, port+1);
 
 	const struct in_addr any_addr = {
@@ -62,6 +62,18 @@ void * PIOS_malloc_no_dma(size_t size)
 	return PIOS_malloc(size);
 }
 
+/* The host allocator does the work here, so allocations aren't tracked
+ * per tag. */
+void * PIOS_malloc_tagged(size_t size, enum pios_heap_tag tag)
+{
+	return PIOS_malloc(size);
+}
+
+void * PIOS_malloc_no_dma_tagged(size_t size, enum pios_heap_tag tag)
+{
+	return PIOS_malloc(size);
+}
+
 void PIOS_free(void * buf)
 {
 	free(buf);
@@ -81,6 +93,23 @@ size_t PIOS_fastheap_get_free_size(void)
 	return 0;
 }
 
+size_t PIOS_heap_get_largest_free(void)
+{
+	return 4096;
+}
+
+size_t PIOS_fastheap_get_largest_free(void)
+{
+	return 0;
+}
+
+void PIOS_heap_get_tag_usage(enum pios_heap_tag tag, uint32_t *bytes,
+		uint32_t *blocks)
+{
+	*bytes = 0;
+	*blocks = 0;
+}
+
 /**
  * @}
  * @}
@@ -0,0 +1,366 @@
+/**
+ ******************************************************************************
+ *
+ * @file       pios_ioloop.c
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Shared descriptor event loop for the posix drivers.
+ * @see        The GNU Public License (GPL) Version 3
+ * @addtogroup PIOS PIOS Core hardware abstraction layer
+ * @{
+ * @addtogroup PIOS_IOLOOP Descriptor event loop
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * Additional note on redistribution: The copyright and license notices above
+ * must be maintained in each individual source file that is a derivative work
+ * of this source file; otherwise redistribution is prohibited.
+ */
+
+#include "pios.h"
+
+#if defined(PIOS_INCLUDE_IOLOOP)
+
+#include <pios_ioloop.h>
+#include "pios_mutex.h"
+#include "pios_thread.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define IOLOOP_MAX_EVENTS 16
+
+/* epoll data for the wakeup eventfd; entries use their index */
+#define IOLOOP_WAKE_INDEX 0xffffffff
+
+struct pios_ioloop_entry {
+	int fd;			/* -1 when free */
+	uint32_t gen;		/* bumped on reuse, so stale events are dropped */
+
+	pios_ioloop_cb cb;
+	void *ctx;
+
+	bool kicked;
+};
+
+static struct pios_ioloop_entry entries[PIOS_IOLOOP_MAX_FDS];
+
+static int epoll_fd = -1;
+static int wake_fd = -1;
+static struct pios_mutex *lock;
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+static uint32_t to_epoll(uint8_t events)
+{
+	uint32_t ev = 0;
+
+	if (events & PIOS_IOLOOP_READ) {
+		ev |= EPOLLIN;
+	}
+
+	if (events & PIOS_IOLOOP_WRITE) {
+		ev |= EPOLLOUT;
+	}
+
+	return ev;
+}
+
+static uint8_t from_epoll(uint32_t ev)
+{
+	uint8_t events = 0;
+
+	if (ev & EPOLLIN) {
+		events |= PIOS_IOLOOP_READ;
+	}
+
+	if (ev & EPOLLOUT) {
+		events |= PIOS_IOLOOP_WRITE;
+	}
+
+	if (ev & (EPOLLERR | EPOLLHUP)) {
+		events |= PIOS_IOLOOP_HANGUP;
+	}
+
+	return events;
+}
+
+static uint64_t entry_data(int idx)
+{
+	return ((uint64_t) entries[idx].gen << 32) | idx;
+}
+
+/* Call with the lock held */
+static int find_entry(int fd)
+{
+	for (int i = 0; i < PIOS_IOLOOP_MAX_FDS; i++) {
+		if (entries[i].fd == fd) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * Looks up who to call for an event, without holding the lock across the
+ * call so handlers may add and remove descriptors.
+ */
+static bool claim_event(uint64_t data, int *fd, pios_ioloop_cb *cb,
+		void **ctx)
+{
+	uint32_t idx = data & 0xffffffff;
+	uint32_t gen = data >> 32;
+
+	bool ok = false;
+
+	PIOS_Mutex_Lock(lock, PIOS_MUTEX_TIMEOUT_MAX);
+
+	if ((idx < PIOS_IOLOOP_MAX_FDS) && (entries[idx].fd >= 0) &&
+			(entries[idx].gen == gen)) {
+		*fd = entries[idx].fd;
+		*cb = entries[idx].cb;
+		*ctx = entries[idx].ctx;
+
+		ok = true;
+	}
+
+	PIOS_Mutex_Unlock(lock);
+
+	return ok;
+}
+
+static void run_kicks(void)
+{
+	uint64_t count;
+
+	if (read(wake_fd, &count, sizeof(count)) < 0) {
+		/* Spurious; nothing to drain */
+	}
+
+	for (int i = 0; i < PIOS_IOLOOP_MAX_FDS; i++) {
+		if (!__atomic_exchange_n(&entries[i].kicked, false,
+					__ATOMIC_ACQ_REL)) {
+			continue;
+		}
+
+		int fd;
+		pios_ioloop_cb cb;
+		void *ctx;
+
+		if (claim_event(entry_data(i), &fd, &cb, &ctx)) {
+			cb(fd, PIOS_IOLOOP_KICK, ctx);
+		}
+	}
+}
+
+static void PIOS_IOLoop_Task(void *unused)
+{
+	struct epoll_event evs[IOLOOP_MAX_EVENTS];
+
+	while (true) {
+		int n = epoll_wait(epoll_fd, evs, IOLOOP_MAX_EVENTS, -1);
+
+		if (n < 0) {
+			if (errno != EINTR) {
+				perror("epoll_wait");
+				PIOS_Thread_Sleep(1);
+			}
+
+			continue;
+		}
+
+		for (int i = 0; i < n; i++) {
+			if ((evs[i].data.u64 & 0xffffffff) == IOLOOP_WAKE_INDEX) {
+				run_kicks();
+				continue;
+			}
+
+			int fd;
+			pios_ioloop_cb cb;
+			void *ctx;
+
+			/* An earlier handler in this batch may have removed
+			 * the descriptor, or even reused the slot */
+			if (claim_event(evs[i].data.u64, &fd, &cb, &ctx)) {
+				cb(fd, from_epoll(evs[i].events), ctx);
+			}
+		}
+	}
+}
+
+static void PIOS_IOLoop_Init(void)
+{
+	for (int i = 0; i < PIOS_IOLOOP_MAX_FDS; i++) {
+		entries[i].fd = -1;
+	}
+
+	lock = PIOS_Mutex_Create();
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (!lock || (epoll_fd < 0) || (wake_fd < 0)) {
+		perror("ioloop-init");
+		exit(1);
+	}
+
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.u64 = IOLOOP_WAKE_INDEX,
+	};
+
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev)) {
+		perror("ioloop-wake");
+		exit(1);
+	}
+
+	struct pios_thread *handle = PIOS_Thread_Create(PIOS_IOLoop_Task,
+			"pios_ioloop", PIOS_THREAD_STACK_SIZE_MIN, NULL,
+			PIOS_THREAD_PRIO_HIGHEST);
+
+	if (!handle) {
+		exit(1);
+	}
+}
+
+int32_t PIOS_IOLoop_Add(int fd, uint8_t events, pios_ioloop_cb cb, void *ctx)
+{
+	PIOS_Assert(cb);
+
+	pthread_once(&init_once, PIOS_IOLoop_Init);
+
+	int32_t ret = -1;
+
+	PIOS_Mutex_Lock(lock, PIOS_MUTEX_TIMEOUT_MAX);
+
+	if (find_entry(fd) >= 0) {
+		goto out;
+	}
+
+	int idx = find_entry(-1);
+
+	if (idx < 0) {
+		goto out;
+	}
+
+	entries[idx].fd = fd;
+	entries[idx].gen++;
+	entries[idx].cb = cb;
+	entries[idx].ctx = ctx;
+	entries[idx].kicked = false;
+
+	struct epoll_event ev = {
+		.events = to_epoll(events),
+		.data.u64 = entry_data(idx),
+	};
+
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+		perror("ioloop-add");
+		entries[idx].fd = -1;
+		goto out;
+	}
+
+	ret = 0;
+
+out:
+	PIOS_Mutex_Unlock(lock);
+
+	return ret;
+}
+
+int32_t PIOS_IOLoop_Modify(int fd, uint8_t events)
+{
+	pthread_once(&init_once, PIOS_IOLoop_Init);
+
+	int32_t ret = -1;
+
+	PIOS_Mutex_Lock(lock, PIOS_MUTEX_TIMEOUT_MAX);
+
+	int idx = find_entry(fd);
+
+	if (idx >= 0) {
+		struct epoll_event ev = {
+			.events = to_epoll(events),
+			.data.u64 = entry_data(idx),
+		};
+
+		ret = epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+	}
+
+	PIOS_Mutex_Unlock(lock);
+
+	return ret;
+}
+
+int32_t PIOS_IOLoop_Remove(int fd)
+{
+	pthread_once(&init_once, PIOS_IOLoop_Init);
+
+	int32_t ret = -1;
+
+	PIOS_Mutex_Lock(lock, PIOS_MUTEX_TIMEOUT_MAX);
+
+	int idx = find_entry(fd);
+
+	if (idx >= 0) {
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+
+		entries[idx].fd = -1;
+		ret = 0;
+	}
+
+	PIOS_Mutex_Unlock(lock);
+
+	return ret;
+}
+
+int32_t PIOS_IOLoop_Kick(int fd)
+{
+	pthread_once(&init_once, PIOS_IOLoop_Init);
+
+	PIOS_Mutex_Lock(lock, PIOS_MUTEX_TIMEOUT_MAX);
+
+	int idx = find_entry(fd);
+
+	if (idx >= 0) {
+		__atomic_store_n(&entries[idx].kicked, true, __ATOMIC_RELEASE);
+	}
+
+	PIOS_Mutex_Unlock(lock);
+
+	if (idx < 0) {
+		return -1;
+	}
+
+	uint64_t one = 1;
+
+	if (write(wake_fd, &one, sizeof(one)) < 0) {
+		/* Counter saturated; a wakeup is already pending */
+	}
+
+	return 0;
+}
+
+#endif /* PIOS_INCLUDE_IOLOOP */
+
+/**
+ * @}
+ * @}
+ */
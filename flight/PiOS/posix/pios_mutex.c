@@ -30,6 +30,7 @@
 
 #include <pios.h>
 #include <pios_mutex.h>
+#include <pios_swarm.h>
 
 struct pios_mutex {
 	pthread_mutex_t mutex;
@@ -75,15 +76,7 @@ bool PIOS_Mutex_Lock(struct pios_mutex *mtx, uint32_t timeout_ms)
 #ifdef __linux__
 		struct timespec abstime;
 
-		clock_gettime(CLOCK_REALTIME, &abstime);
-
-		abstime.tv_nsec += (timeout_ms % 1000) * 1000000;
-		abstime.tv_sec += timeout_ms / 1000;
-
-		if (abstime.tv_nsec > 1000000000) {
-			abstime.tv_nsec -= 1000000000;
-			abstime.tv_sec += 1;
-		}
+		PIOS_SWARM_Deadline(&abstime, timeout_ms);
 
 		ret = pthread_mutex_timedlock(&mtx->mutex, &abstime);
 #else
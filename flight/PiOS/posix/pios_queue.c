@@ -30,6 +30,8 @@
 
 #include <pios_queue.h>
 #include <pios_thread.h>
+#include <pios_swarm.h>
+#include <pios_trace.h>
 
 struct pios_queue {
 #define QUEUE_MAGIC 75657551	/* 'Queu' */
@@ -106,15 +108,7 @@ bool PIOS_Queue_Send(struct pios_queue *queuep,
 	struct timespec abstime;
 
 	if (timeout_ms != PIOS_QUEUE_TIMEOUT_MAX) {
-		clock_gettime(CLOCK_REALTIME, &abstime);
-
-		abstime.tv_nsec += (timeout_ms % 1000) * 1000000;
-		abstime.tv_sec += timeout_ms / 1000;
-
-		if (abstime.tv_nsec > 1000000000) {
-			abstime.tv_nsec -= 1000000000;
-			abstime.tv_sec += 1;
-		}
+		PIOS_SWARM_Deadline(&abstime, timeout_ms);
 	}
 
 	pthread_mutex_lock(&queuep->mutex);
@@ -135,6 +129,8 @@ bool PIOS_Queue_Send(struct pios_queue *queuep,
 
 	pthread_mutex_unlock(&queuep->mutex);
 
+	PIOS_TRACE(PIOS_TRACE_QUEUE_SEND, queuep);
+
 	return true;
 }
 
@@ -158,15 +154,7 @@ bool PIOS_Queue_Receive(struct pios_queue *queuep,
 	struct timespec abstime;
 
 	if (timeout_ms != PIOS_QUEUE_TIMEOUT_MAX) {
-		clock_gettime(CLOCK_REALTIME, &abstime);
-
-		abstime.tv_nsec += (timeout_ms % 1000) * 1000000;
-		abstime.tv_sec += timeout_ms / 1000;
-
-		if (abstime.tv_nsec > 1000000000) {
-			abstime.tv_nsec -= 1000000000;
-			abstime.tv_sec += 1;
-		}
+		PIOS_SWARM_Deadline(&abstime, timeout_ms);
 	}
 
 	pthread_mutex_lock(&queuep->mutex);
@@ -187,6 +175,8 @@ bool PIOS_Queue_Receive(struct pios_queue *queuep,
 
 	pthread_mutex_unlock(&queuep->mutex);
 
+	PIOS_TRACE(PIOS_TRACE_QUEUE_RECEIVE, queuep);
+
 	return true;
 }
 
@@ -28,6 +28,7 @@
 
 #include <pios.h>
 #include <pios_semaphore.h>
+#include <pios_swarm.h>
 
 struct pios_semaphore {
 #define SEMAPHORE_MAGIC 0x616d6553	/* 'Sema' */
@@ -77,15 +78,7 @@ bool PIOS_Semaphore_Take(struct pios_semaphore *sema, uint32_t timeout_ms)
         struct timespec abstime;
 
         if (timeout_ms != PIOS_QUEUE_TIMEOUT_MAX) {
-                clock_gettime(CLOCK_REALTIME, &abstime);
-
-                abstime.tv_nsec += (timeout_ms % 1000) * 1000000;
-                abstime.tv_sec += timeout_ms / 1000;
-
-                if (abstime.tv_nsec > 1000000000) {
-                        abstime.tv_nsec -= 1000000000;
-                        abstime.tv_sec += 1;
-                }
+                PIOS_SWARM_Deadline(&abstime, timeout_ms);
         }
 
         pthread_mutex_lock(&sema->mutex);
@@ -4,7 +4,7 @@
  * @file       pios_serial.c
  * @author     The OpenPilot Team, http://www.openpilot.org Copyright (C) 2012.
  * @author     Tau Labs, http://taulabs.org, Copyright (C) 2014
- * @author     dRonin, http://dRonin.org/, Copyright (C) 2016
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2016-2017
  * @brief      SERIAL communications interface
  * @see        The GNU Public License (GPL) Version 3
  * @addtogroup PIOS PIOS Core hardware abstraction layer
@@ -48,6 +48,10 @@
 #include <linux/serial.h>
 #include <sys/ioctl.h>
 
+#if defined(PIOS_INCLUDE_IOLOOP)
+#include <pios_ioloop.h>
+#endif
+
 /* Provide a COM driver */
 static void PIOS_SERIAL_ChangeBaud(uintptr_t udp_id, uint32_t baud);
 static void PIOS_SERIAL_RegisterRxCallback(uintptr_t udp_id, pios_com_callback rx_in_cb, uintptr_t context);
@@ -63,6 +67,11 @@ typedef struct {
 	pios_com_callback rx_in_cb;
 	uintptr_t rx_in_context;
 
+	/* Received bytes PIOS_COM had no room for yet */
+	uint16_t rx_pending;
+	uint16_t rx_offset;
+	volatile bool rx_stalled;
+
 	uint8_t rx_buffer[PIOS_SERIAL_RX_BUFFER_SIZE];
 	uint8_t tx_buffer[PIOS_SERIAL_RX_BUFFER_SIZE];
 } pios_ser_dev;
@@ -80,6 +89,87 @@ static pios_ser_dev * find_ser_dev_by_id(uintptr_t serial)
 	return (pios_ser_dev *) serial;
 }
 
+/**
+ * Hands pending received bytes to PIOS_COM.
+ * @returns true if it took all of them
+ */
+static bool PIOS_SERIAL_Deliver(pios_ser_dev *ser_dev)
+{
+	while (ser_dev->rx_pending) {
+		if (!ser_dev->rx_in_cb) {
+			/* Nobody listening yet */
+			ser_dev->rx_pending = 0;
+			break;
+		}
+
+		bool rx_need_yield = false;
+
+		uint16_t taken = ser_dev->rx_in_cb(ser_dev->rx_in_context,
+				ser_dev->rx_buffer + ser_dev->rx_offset,
+				ser_dev->rx_pending, NULL, &rx_need_yield);
+
+		if (!taken) {
+			return false;
+		}
+
+		ser_dev->rx_offset += taken;
+		ser_dev->rx_pending -= taken;
+	}
+
+	return true;
+}
+
+#if defined(PIOS_INCLUDE_IOLOOP)
+
+static void PIOS_SERIAL_Event(int fd, uint8_t events, void *ctx)
+{
+	pios_ser_dev *ser_dev = ctx;
+
+	if (events & PIOS_IOLOOP_KICK) {
+		if (ser_dev->rx_stalled && PIOS_SERIAL_Deliver(ser_dev)) {
+			ser_dev->rx_stalled = false;
+
+			PIOS_IOLoop_Modify(fd, PIOS_IOLOOP_READ);
+		}
+
+		return;
+	}
+
+	if (ser_dev->rx_stalled) {
+		return;
+	}
+
+	/* Readable, so this returns at once with what has arrived */
+	int result = read(fd, ser_dev->rx_buffer, sizeof(ser_dev->rx_buffer));
+
+	if (result > 0) {
+		ser_dev->rx_offset = 0;
+		ser_dev->rx_pending = result;
+
+		/* Set first, so an RxStart racing with a short delivery
+		 * still kicks the loop */
+		ser_dev->rx_stalled = true;
+
+		if (PIOS_SERIAL_Deliver(ser_dev)) {
+			ser_dev->rx_stalled = false;
+		} else {
+			/* Let the tty buffer fill meanwhile */
+			PIOS_IOLoop_Modify(fd, 0);
+		}
+
+		return;
+	}
+
+	if ((result < 0) && ((errno == EAGAIN) || (errno == EINTR))) {
+		return;
+	}
+
+	/* Device went away */
+	PIOS_IOLoop_Remove(fd);
+}
+
+#else
+
 /**
  * RxTask
  */
@@ -87,16 +177,17 @@ static void PIOS_SERIAL_RxTask(void *ser_dev_n)
 {
 	pios_ser_dev *ser_dev = (pios_ser_dev*)ser_dev_n;
 
-	const int INCOMING_BUFFER_SIZE = 16;
-	char incoming_buffer[INCOMING_BUFFER_SIZE];
-
 	while (1) {
-		int result = read(ser_dev->fd, incoming_buffer, INCOMING_BUFFER_SIZE);
+		int result = read(ser_dev->fd, ser_dev->rx_buffer,
+				sizeof(ser_dev->rx_buffer));
 
-		if (result > 0 && ser_dev->rx_in_cb) {
-			bool rx_need_yield = false;
+		if (result > 0) {
+			ser_dev->rx_offset = 0;
+			ser_dev->rx_pending = result;
 
-			ser_dev->rx_in_cb(ser_dev->rx_in_context, (uint8_t*)incoming_buffer, result, NULL, &rx_need_yield);
+			/* Whatever PIOS_COM has no room for is lost */
+			PIOS_SERIAL_Deliver(ser_dev);
+			ser_dev->rx_pending = 0;
 		}
 
 		if (result == 0) {
@@ -109,6 +200,8 @@ static void PIOS_SERIAL_RxTask(void *ser_dev_n)
 	}
 }
 
+#endif /* PIOS_INCLUDE_IOLOOP */
+
 /**
  * Open SERIAL connection
  */
@@ -130,8 +223,16 @@ int32_t PIOS_SERIAL_Init(uintptr_t *serial_id, const char *path)
 		return -1;
 	}
 
+#if defined(PIOS_INCLUDE_IOLOOP)
+	if (PIOS_IOLoop_Add(ser_dev->fd, PIOS_IOLOOP_READ, PIOS_SERIAL_Event,
+				ser_dev)) {
+		close(ser_dev->fd);
+		return -1;
+	}
+#else
 	PIOS_Thread_Create(PIOS_SERIAL_RxTask, "pios_serial_rx",
 		PIOS_THREAD_STACK_SIZE_MIN, ser_dev, PIOS_THREAD_PRIO_HIGHEST);
+#endif
 
 	printf("serial dev %p - path %s - fd %i opened\n", ser_dev,
 		path, ser_dev->fd);
@@ -207,8 +308,17 @@ void PIOS_SERIAL_ChangeBaud(uintptr_t serial_id, uint32_t baud)
 	}
 }
 
-static void PIOS_SERIAL_RxStart(uintptr_t tp_id, uint16_t rx_bytes_avail)
+static void PIOS_SERIAL_RxStart(uintptr_t serial_id, uint16_t rx_bytes_avail)
 {
+#if defined(PIOS_INCLUDE_IOLOOP)
+	pios_ser_dev *ser_dev = find_ser_dev_by_id(serial_id);
+
+	PIOS_Assert(ser_dev);
+
+	if (ser_dev->rx_stalled && rx_bytes_avail) {
+		PIOS_IOLoop_Kick(ser_dev->fd);
+	}
+#endif
 }
 
 static void PIOS_SERIAL_TxStart(uintptr_t serial_id, uint16_t tx_bytes_avail)
@@ -229,7 +339,8 @@ static void PIOS_SERIAL_TxStart(uintptr_t serial_id, uint16_t tx_bytes_avail)
 			rem = length;
 			while (rem > 0) {
 				ssize_t len = 0;
-				len = write(ser_dev->fd, ser_dev->tx_buffer, length);
+				len = write(ser_dev->fd,
+					ser_dev->tx_buffer + (length - rem), rem);
 				if (len <= 0) {
 					rem = 0;
 				} else {
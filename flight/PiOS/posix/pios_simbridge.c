@@ -0,0 +1,597 @@
+/**
+ ******************************************************************************
+ *
+ * @file       pios_simbridge.c
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Simulator bridge: takes batched, timestamped sensor frames
+ *             from a simulator and answers with actuator outputs.
+ * @see        The GNU Public License (GPL) Version 3
+ * @addtogroup PIOS PIOS Core hardware abstraction layer
+ * @{
+ * @addtogroup PIOS_SIMBRIDGE Simulator bridge driver
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * Additional note on redistribution: The copyright and license notices above
+ * must be maintained in each individual source file that is a derivative work
+ * of this source file; otherwise redistribution is prohibited.
+ */
+
+
+/* Project Includes */
+#include "openpilot.h"
+#include "pios.h"
+#include "pios_thread.h"
+#include "pios_mutex.h"
+#include "pios_simbridge.h"
+#include "pios_swarm.h"
+#include "simbridge_messages.h"
+#include "physical_constants.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if !(defined(_WIN32) || defined(WIN32) || defined(__MINGW32__))
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#define SIMBRIDGE_HAVE_UNIX
+#else
+#include <ws2tcpip.h>
+#endif
+
+#include <actuatorcommand.h>
+#include <actuatordesired.h>
+#include <flightstatus.h>
+#include <gpsposition.h>
+#include <gpsvelocity.h>
+
+#define SIMBRIDGE_NUM_CHANNELS ACTUATORCOMMAND_CHANNEL_NUMELEM
+
+/* Gyro and accel queues hold a whole batch, so the bridge never has to
+ * drop or smooth samples to keep up. */
+#define SIMBRIDGE_IMU_QUEUE_LEN SIMBRIDGE_MAX_SAMPLES
+#define SIMBRIDGE_AUX_QUEUE_LEN 4
+
+/* How long the rx task waits on a full gyro queue before it drops a
+ * sample; this is what applies back pressure to a fast simulator. */
+#define SIMBRIDGE_QUEUE_TIMEOUT_MS 20
+
+#define SIMBRIDGE_DEFAULT_RATE 1000
+
+struct simbridge_dev {
+	int socket;
+
+	struct sockaddr_storage peer_addr;
+	socklen_t peer_len;
+
+	struct pios_queue *accel_queue, *gyro_queue, *mag_queue, *baro_queue;
+
+	uint16_t channel_min[SIMBRIDGE_NUM_CHANNELS];
+	uint16_t channel_max[SIMBRIDGE_NUM_CHANNELS];
+	float position[SIMBRIDGE_NUM_CHANNELS];
+
+	/* Reply bookkeeping and the peer, shared between the rx task and
+	 * the actuator callbacks; guarded by lock */
+	struct pios_mutex *lock;
+	uint32_t pending_updates;
+	uint64_t batch_time_us;
+	uint32_t tx_seq;
+
+	uint32_t rx_seq;
+	uint32_t dropped;
+
+	bool gps_ready;
+};
+
+/* The servo callbacks carry no context, and there's only one simulator. */
+static struct simbridge_dev *bridge_dev;
+
+static int PIOS_SIMBRIDGE_ActuatorSetMode(const uint16_t *out_rate,
+	const int banks, const uint16_t *channel_max,
+	const uint16_t *channel_min);
+static void PIOS_SIMBRIDGE_ActuatorSet(uint8_t servo, float position);
+static void PIOS_SIMBRIDGE_ActuatorUpdate();
+
+const struct pios_servo_callbacks simbridge_callbacks = {
+	.update = PIOS_SIMBRIDGE_ActuatorUpdate,
+	.set_mode = PIOS_SIMBRIDGE_ActuatorSetMode,
+	.set = PIOS_SIMBRIDGE_ActuatorSet
+};
+
+static int PIOS_SIMBRIDGE_ActuatorSetMode(const uint16_t *out_rate,
+	const int banks, const uint16_t *channel_max,
+	const uint16_t *channel_min)
+{
+	(void) out_rate; (void) banks;
+
+	for (int i = 0; i < SIMBRIDGE_NUM_CHANNELS; i++) {
+		bridge_dev->channel_max[i] = channel_max[i];
+		bridge_dev->channel_min[i] = channel_min[i];
+	}
+
+	return 0;
+}
+
+static void PIOS_SIMBRIDGE_ActuatorSet(uint8_t servo, float position)
+{
+	if (servo < SIMBRIDGE_NUM_CHANNELS) {
+		bridge_dev->position[servo] = position;
+	}
+}
+
+static void PIOS_SIMBRIDGE_SendActuators(struct simbridge_dev *dev,
+		uint64_t sensor_time_us)
+{
+	struct simbridge_actuators msg;
+	struct sockaddr_storage peer_addr;
+	socklen_t peer_len;
+
+	PIOS_Mutex_Lock(dev->lock, PIOS_MUTEX_TIMEOUT_MAX);
+
+	simbridge_fill_hdr(&msg.hdr, SIMBRIDGE_MSG_ACTUATORS,
+			SIMBRIDGE_NUM_CHANNELS, dev->tx_seq++);
+
+	memcpy(&peer_addr, &dev->peer_addr, dev->peer_len);
+	peer_len = dev->peer_len;
+
+	PIOS_Mutex_Unlock(dev->lock);
+
+	msg.sensor_time_us = sensor_time_us;
+
+	ActuatorDesiredData act_desired;
+	ActuatorDesiredGet(&act_desired);
+
+	msg.desired[0] = act_desired.Roll;
+	msg.desired[1] = act_desired.Pitch;
+	msg.desired[2] = act_desired.Yaw;
+	msg.desired[3] = act_desired.Thrust;
+
+	uint8_t armed;
+	FlightStatusArmedGet(&armed);
+
+	msg.armed = (armed == FLIGHTSTATUS_ARMED_ARMED);
+	memset(msg.resv, 0, sizeof(msg.resv));
+
+	for (int i = 0; i < SIMBRIDGE_NUM_CHANNELS; i++) {
+		msg.channels[i].pulse_us = dev->position[i];
+		msg.channels[i].min = dev->channel_min[i];
+		msg.channels[i].max = dev->channel_max[i];
+	}
+
+	if (sendto(dev->socket, (const void *) &msg,
+			simbridge_msg_len(SIMBRIDGE_MSG_ACTUATORS,
+				SIMBRIDGE_NUM_CHANNELS), 0,
+			(struct sockaddr *) &peer_addr,
+			peer_len) < 0) {
+		perror("simbridge-sendto");
+	}
+}
+
+/**
+ * Accounts for one gyro sample of the current batch, either run through
+ * the control loop or dropped, and replies once all of them are.
+ */
+static void PIOS_SIMBRIDGE_CompleteSample(struct simbridge_dev *dev)
+{
+	bool reply = false;
+	uint64_t batch_time_us = 0;
+
+	PIOS_Mutex_Lock(dev->lock, PIOS_MUTEX_TIMEOUT_MAX);
+
+	if (dev->pending_updates > 0) {
+		dev->pending_updates--;
+
+		if (dev->pending_updates == 0) {
+			reply = true;
+			batch_time_us = dev->batch_time_us;
+		}
+	}
+
+	PIOS_Mutex_Unlock(dev->lock);
+
+	if (reply) {
+		PIOS_SIMBRIDGE_SendActuators(dev, batch_time_us);
+	}
+}
+
+/**
+ * Called once per actuator cycle.  The reply to a sensor batch goes out
+ * after the control loop has run once for each gyro sample in it, so a
+ * simulator that waits for the reply stays in lockstep with the firmware.
+ */
+static void PIOS_SIMBRIDGE_ActuatorUpdate()
+{
+	PIOS_SIMBRIDGE_CompleteSample(bridge_dev);
+}
+
+static void PIOS_SIMBRIDGE_PublishGPS(struct simbridge_dev *dev,
+		const struct simbridge_sample *sample)
+{
+	if (!dev->gps_ready) {
+		/* Normally done by the GPS module; harmless if it was */
+		GPSPositionInitialize();
+		GPSVelocityInitialize();
+
+		dev->gps_ready = true;
+	}
+
+	float vel[3] = {
+		sample->data.gps.vel[0],
+		sample->data.gps.vel[1],
+		sample->data.gps.vel[2],
+	};
+
+	GPSVelocityData gps_vel;
+	GPSVelocityGet(&gps_vel);
+
+	gps_vel.North = vel[0];
+	gps_vel.East = vel[1];
+	gps_vel.Down = vel[2];
+	gps_vel.Accuracy = 0.1f;
+
+	GPSVelocitySet(&gps_vel);
+
+	GPSPositionData gps_pos;
+	GPSPositionGet(&gps_pos);
+
+	gps_pos.Status = sample->data.gps.fix;
+	gps_pos.Latitude = sample->data.gps.lat;
+	gps_pos.Longitude = sample->data.gps.lon;
+	gps_pos.Altitude = sample->data.gps.altitude;
+	gps_pos.Groundspeed = sqrtf(vel[0] * vel[0] + vel[1] * vel[1]);
+	gps_pos.Heading = atan2f(vel[1], vel[0]) * RAD2DEG;
+	gps_pos.Satellites = sample->data.gps.satellites;
+	gps_pos.Accuracy = 1.0f;
+	gps_pos.PDOP = 1.0f;
+	gps_pos.HDOP = 1.0f;
+	gps_pos.VDOP = 1.0f;
+
+	GPSPositionSet(&gps_pos);
+}
+
+/**
+ * Feeds one sample to the sensor queues.
+ * @returns false if it was a gyro sample that had to be dropped
+ */
+static bool PIOS_SIMBRIDGE_HandleSample(struct simbridge_dev *dev,
+		const struct simbridge_sample *sample)
+{
+	switch (sample->type) {
+		case SIMBRIDGE_SAMPLE_GYRO:
+		{
+			struct pios_sensor_gyro_data gyro_data = {
+				.x = sample->data.vec.x,
+				.y = sample->data.vec.y,
+				.z = sample->data.vec.z,
+				.temperature = sample->data.vec.temperature,
+			};
+
+			if (!PIOS_Queue_Send(dev->gyro_queue, &gyro_data,
+						SIMBRIDGE_QUEUE_TIMEOUT_MS)) {
+				dev->dropped++;
+				return false;
+			}
+
+			break;
+		}
+		case SIMBRIDGE_SAMPLE_ACCEL:
+		{
+			struct pios_sensor_accel_data accel_data = {
+				.x = sample->data.vec.x,
+				.y = sample->data.vec.y,
+				.z = sample->data.vec.z,
+				.temperature = sample->data.vec.temperature,
+			};
+
+			/* Sensors reads the accel when the matching gyro
+			 * arrives, so the queue never fills before the
+			 * gyro queue does. */
+			PIOS_Queue_Send(dev->accel_queue, &accel_data, 0);
+			break;
+		}
+		case SIMBRIDGE_SAMPLE_MAG:
+		{
+			struct pios_sensor_mag_data mag_data = {
+				.x = sample->data.vec.x,
+				.y = sample->data.vec.y,
+				.z = sample->data.vec.z,
+			};
+
+			PIOS_Queue_Send(dev->mag_queue, &mag_data, 0);
+			break;
+		}
+		case SIMBRIDGE_SAMPLE_BARO:
+		{
+			struct pios_sensor_baro_data baro_data = {
+				.altitude = sample->data.baro.altitude,
+				.pressure = sample->data.baro.pressure,
+				.temperature = sample->data.baro.temperature,
+			};
+
+			PIOS_Queue_Send(dev->baro_queue, &baro_data, 0);
+			break;
+		}
+		case SIMBRIDGE_SAMPLE_GPS:
+			PIOS_SIMBRIDGE_PublishGPS(dev, sample);
+			break;
+		default:
+			/* Newer simulators may send types we don't know;
+			 * skip them. */
+			break;
+	}
+
+	return true;
+}
+
+/**
+ * RxTask
+ */
+static void PIOS_SIMBRIDGE_RxTask(void *param)
+{
+	struct simbridge_dev *dev = param;
+
+	struct simbridge_sensors msg;
+
+	while (true) {
+		struct sockaddr_storage from;
+		socklen_t from_len = sizeof(from);
+
+		ssize_t cnt = recvfrom(dev->socket, (void *) &msg, sizeof(msg),
+				0, (struct sockaddr *) &from, &from_len);
+
+		if (cnt < 0) {
+			perror("simbridge-recv");
+
+			return;
+		}
+
+		if (!simbridge_check_hdr(&msg.hdr, cnt,
+					SIMBRIDGE_MSG_SENSORS)) {
+			dev->dropped++;
+			continue;
+		}
+
+		if ((msg.hdr.seq != dev->rx_seq) && (dev->rx_seq != 0)) {
+			printf("simbridge: expected batch %u, got %u\n",
+					(unsigned int) dev->rx_seq,
+					(unsigned int) msg.hdr.seq);
+		}
+
+		dev->rx_seq = msg.hdr.seq + 1;
+
+		uint32_t gyros = 0;
+		uint64_t gyro_time_us = 0;
+
+		for (int i = 0; i < msg.hdr.count; i++) {
+			if (msg.samples[i].type == SIMBRIDGE_SAMPLE_GYRO) {
+				gyros++;
+				gyro_time_us = msg.samples[i].time_us;
+			}
+		}
+
+		/* Owe the reply before the first gyro sample is queued, as
+		 * the control loop may run on it straight away.  Any reply
+		 * still owed for the previous batch is moot now. */
+		PIOS_Mutex_Lock(dev->lock, PIOS_MUTEX_TIMEOUT_MAX);
+		dev->pending_updates = gyros;
+		dev->batch_time_us = gyro_time_us;
+		memcpy(&dev->peer_addr, &from, from_len);
+		dev->peer_len = from_len;
+		PIOS_Mutex_Unlock(dev->lock);
+
+		for (int i = 0; i < msg.hdr.count; i++) {
+			if (!PIOS_SIMBRIDGE_HandleSample(dev,
+						&msg.samples[i])) {
+				/* The loop will never run on it */
+				PIOS_SIMBRIDGE_CompleteSample(dev);
+			}
+		}
+
+		if (gyros == 0) {
+			/* Nothing for the control loop to run on; answer
+			 * right away so the simulator doesn't stall. */
+			PIOS_SIMBRIDGE_SendActuators(dev, msg.hdr.count ?
+					msg.samples[msg.hdr.count - 1].time_us : 0);
+		}
+	}
+}
+
+static int PIOS_SIMBRIDGE_Open(struct simbridge_dev *dev, const char *addr)
+{
+	int optval = 1;
+
+#ifdef SIMBRIDGE_HAVE_UNIX
+	if (!strncmp(addr, "unix:", 5)) {
+		struct sockaddr_un saddr = {
+			.sun_family = AF_UNIX,
+		};
+
+		const char *path = addr + 5;
+
+		if (strlen(path) >= sizeof(saddr.sun_path)) {
+			printf("simbridge: socket path too long\n");
+			return -1;
+		}
+
+		strcpy(saddr.sun_path, path);
+
+		dev->socket = socket(AF_UNIX, SOCK_DGRAM, 0);
+
+		if (dev->socket < 0) {
+			perror("simbridge-socket");
+			return -1;
+		}
+
+		/* Clear out the socket from a previous run */
+		unlink(path);
+
+		if (bind(dev->socket, (struct sockaddr *) &saddr,
+					sizeof(saddr)) < 0) {
+			perror("Binding socket failed");
+			return -1;
+		}
+
+		printf("simbridge listening on %s\n", path);
+
+		return 0;
+	}
+#endif
+
+	char *endptr;
+	long port = strtol(addr, &endptr, 10);
+
+	if (*endptr || (port <= 0) || (port > 65535)) {
+		printf("simbridge: bad address %s\n", addr);
+		return -1;
+	}
+
+	port = PIOS_SWARM_Port(port);
+
+	dev->socket = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+	if (dev->socket < 0) {
+		perror("simbridge-socket");
+		return -1;
+	}
+
+	/* Allow reuse of address if you restart. */
+	setsockopt(dev->socket, SOL_SOCKET, SO_REUSEADDR, (void *) &optval,
+			sizeof(optval));
+
+	const struct in_addr any_addr = {
+		.s_addr = (INADDR_ANY) /* parentheses to silence clang warning */
+	};
+
+	struct sockaddr_in saddr = {
+		.sin_family = AF_INET,
+		.sin_addr = any_addr,
+		.sin_port = htons(port)
+	};
+
+	if (bind(dev->socket, (struct sockaddr *) &saddr,
+				sizeof(saddr)) < 0) {
+		perror("Binding socket failed");
+		return -1;
+	}
+
+	printf("simbridge listening on UDP port %ld\n", port);
+
+	return 0;
+}
+
+/**
+ * Open the socket, register the sensor queues and take over the servo
+ * outputs.  Nothing is sent until the simulator's first batch arrives;
+ * replies go back to whichever address that came from.
+ */
+int32_t PIOS_SIMBRIDGE_Init(simbridge_dev_t *dev, const char *addr)
+{
+	struct simbridge_dev *b_dev = PIOS_malloc(sizeof(*b_dev));
+
+	if (b_dev == NULL) {
+		return -1;
+	}
+
+	memset(b_dev, 0, sizeof(*b_dev));
+
+	b_dev->lock = PIOS_Mutex_Create();
+
+	if (b_dev->lock == NULL) {
+		return -1;
+	}
+
+	char addr_copy[128];
+
+	strncpy(addr_copy, addr, sizeof(addr_copy));
+	addr_copy[sizeof(addr_copy) - 1] = 0;
+
+	uint32_t rate_hz = SIMBRIDGE_DEFAULT_RATE;
+
+	char *rate_str = strrchr(addr_copy, ',');
+
+	if (rate_str) {
+		*rate_str++ = 0;
+
+		char *endptr;
+		rate_hz = strtoul(rate_str, &endptr, 10);
+
+		if (*endptr || (rate_hz < 100) || (rate_hz > 8000)) {
+			printf("simbridge: bad rate %s\n", rate_str);
+			return -1;
+		}
+	}
+
+	if (PIOS_SIMBRIDGE_Open(b_dev, addr_copy)) {
+		return -1;
+	}
+
+	b_dev->accel_queue = PIOS_Queue_Create(SIMBRIDGE_IMU_QUEUE_LEN,
+			sizeof(struct pios_sensor_accel_data));
+	b_dev->gyro_queue = PIOS_Queue_Create(SIMBRIDGE_IMU_QUEUE_LEN,
+			sizeof(struct pios_sensor_gyro_data));
+	b_dev->mag_queue = PIOS_Queue_Create(SIMBRIDGE_AUX_QUEUE_LEN,
+			sizeof(struct pios_sensor_mag_data));
+	b_dev->baro_queue = PIOS_Queue_Create(SIMBRIDGE_AUX_QUEUE_LEN,
+			sizeof(struct pios_sensor_baro_data));
+
+	if (!b_dev->accel_queue || !b_dev->gyro_queue ||
+			!b_dev->mag_queue || !b_dev->baro_queue) {
+		return -1;
+	}
+
+	bridge_dev = b_dev;
+
+	PIOS_Servo_SetCallbacks(&simbridge_callbacks);
+
+	/* The simulator decides the real rates; this is what the
+	 * filters get configured for. */
+	PIOS_SENSORS_SetSampleRate(PIOS_SENSOR_ACCEL, rate_hz);
+	PIOS_SENSORS_SetSampleRate(PIOS_SENSOR_GYRO, rate_hz);
+	PIOS_SENSORS_SetSampleRate(PIOS_SENSOR_MAG, 75);
+	PIOS_SENSORS_SetSampleRate(PIOS_SENSOR_BARO, 50);
+
+	PIOS_SENSORS_Register(PIOS_SENSOR_ACCEL, b_dev->accel_queue);
+	PIOS_SENSORS_Register(PIOS_SENSOR_GYRO, b_dev->gyro_queue);
+	PIOS_SENSORS_Register(PIOS_SENSOR_MAG, b_dev->mag_queue);
+	PIOS_SENSORS_Register(PIOS_SENSOR_BARO, b_dev->baro_queue);
+
+	PIOS_SENSORS_SetMaxGyro(2000);
+
+	struct pios_thread *rx_handle = PIOS_Thread_Create(
+			PIOS_SIMBRIDGE_RxTask, "pios_simbridge",
+			PIOS_THREAD_STACK_SIZE_MIN, b_dev,
+			PIOS_THREAD_PRIO_HIGHEST);
+
+	(void) rx_handle;
+
+	printf("simbridge expecting %u Hz IMU samples\n",
+			(unsigned int) rate_hz);
+
+	*dev = b_dev;
+
+	return 0;
+}
+
+/**
+ * @}
+ * @}
+ */
@@ -0,0 +1,407 @@
+/**
+ ******************************************************************************
+ *
+ * @file       pios_simplant.c
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Built-in physics plant: closed loop simulation without an
+ *             external simulator.
+ * @see        The GNU Public License (GPL) Version 3
+ * @addtogroup PIOS PIOS Core hardware abstraction layer
+ * @{
+ * @addtogroup PIOS_SIMPLANT Simulated plant driver
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * Additional note on redistribution: The copyright and license notices above
+ * must be maintained in each individual source file that is a derivative work
+ * of this source file; otherwise redistribution is prohibited.
+ */
+
+/* Project Includes */
+#include "openpilot.h"
+#include "pios.h"
+#include "pios_thread.h"
+#include "pios_semaphore.h"
+#include "pios_simplant.h"
+#include "pios_swarm.h"
+
+#include "physsim.h"
+
+#include <actuatorcommand.h>
+
+#define SIMPLANT_MAX_CHANNELS ACTUATORCOMMAND_CHANNEL_NUMELEM
+
+#define SIMPLANT_DEFAULT_RATE 1000
+#define SIMPLANT_MAG_RATE 75
+#define SIMPLANT_BARO_RATE 50
+
+/* How long the plant waits for the firmware to answer a sensor sample
+ * with new actuator outputs before it gives up and steps anyway. */
+#define SIMPLANT_LOCKSTEP_TIMEOUT_MS 5
+
+struct simplant_dev {
+	struct physsim_params params;
+	struct physsim_state state;
+
+	struct pios_queue *accel_queue, *gyro_queue, *mag_queue, *baro_queue;
+	struct pios_semaphore *actuator_sema;
+
+	uint16_t channel_min[SIMPLANT_MAX_CHANNELS];
+	uint16_t channel_max[SIMPLANT_MAX_CHANNELS];
+	float position[SIMPLANT_MAX_CHANNELS];
+	float outputs[SIMPLANT_MAX_CHANNELS];
+
+	uint32_t rate_hz;
+	bool lockstep;
+};
+
+/* The servo callbacks carry no context, and there's only one airframe. */
+static struct simplant_dev *plant_dev;
+
+static int PIOS_SIMPLANT_ActuatorSetMode(const uint16_t *out_rate,
+	const int banks, const uint16_t *channel_max,
+	const uint16_t *channel_min);
+static void PIOS_SIMPLANT_ActuatorSet(uint8_t servo, float position);
+static void PIOS_SIMPLANT_ActuatorUpdate();
+
+const struct pios_servo_callbacks simplant_callbacks = {
+	.update = PIOS_SIMPLANT_ActuatorUpdate,
+	.set_mode = PIOS_SIMPLANT_ActuatorSetMode,
+	.set = PIOS_SIMPLANT_ActuatorSet
+};
+
+static int PIOS_SIMPLANT_ActuatorSetMode(const uint16_t *out_rate,
+	const int banks, const uint16_t *channel_max,
+	const uint16_t *channel_min)
+{
+	(void) out_rate; (void) banks;
+
+	for (int i = 0; i < SIMPLANT_MAX_CHANNELS; i++) {
+		plant_dev->channel_max[i] = channel_max[i];
+		plant_dev->channel_min[i] = channel_min[i];
+	}
+
+	return 0;
+}
+
+static void PIOS_SIMPLANT_ActuatorSet(uint8_t servo, float position)
+{
+	if (servo < SIMPLANT_MAX_CHANNELS) {
+		plant_dev->position[servo] = position;
+	}
+}
+
+/**
+ * Latch the pulse widths the actuator just set as normalized outputs and
+ * let the plant take its next step.
+ */
+static void PIOS_SIMPLANT_ActuatorUpdate()
+{
+	struct simplant_dev *dev = plant_dev;
+
+	for (int i = 0; i < SIMPLANT_MAX_CHANNELS; i++) {
+		float span = (float) dev->channel_max[i] - dev->channel_min[i];
+
+		if (span == 0) {
+			dev->outputs[i] = 0;
+			continue;
+		}
+
+		/* Works for reversed channels too */
+		float frac = (dev->position[i] - dev->channel_min[i]) / span;
+
+		if ((dev->params.frame == PHYSSIM_FRAME_FIXEDWING) &&
+				(i != dev->params.ch_throttle)) {
+			frac = frac * 2 - 1;
+		}
+
+		dev->outputs[i] = frac;
+	}
+
+	PIOS_Semaphore_Give(dev->actuator_sema);
+}
+
+/**
+ * Plant task.  Steps the physics at a fixed rate and publishes the
+ * resulting sensor samples.  Simulated time only advances by one period
+ * per sample, and with lockstep enabled the plant waits for the firmware
+ * to respond to each sample; a slow host slows the simulation down rather
+ * than letting the plant and the firmware drift apart.
+ */
+static void PIOS_SIMPLANT_Task(void *param)
+{
+	struct simplant_dev *dev = param;
+
+	float dT = 1.0f / dev->rate_hz;
+	uint32_t period_us = 1000000 / dev->rate_hz;
+
+	uint32_t mag_div = dev->rate_hz / SIMPLANT_MAG_RATE;
+	uint32_t baro_div = dev->rate_hz / SIMPLANT_BARO_RATE;
+
+	uint32_t tick = 0;
+	uint32_t deadline = PIOS_DELAY_GetRaw();
+
+	while (true) {
+		/* The firmware is done with the last sample */
+		PIOS_SNAPSHOT_Pace();
+
+		physsim_step(&dev->params, &dev->state, dev->outputs,
+				SIMPLANT_MAX_CHANNELS, dT);
+
+		struct pios_sensor_accel_data accel_data;
+		struct pios_sensor_gyro_data gyro_data;
+		float vec[3];
+
+		physsim_sense_accel(&dev->params, &dev->state, vec);
+		accel_data.x = vec[0];
+		accel_data.y = vec[1];
+		accel_data.z = vec[2];
+		accel_data.temperature = 25;
+
+		physsim_sense_gyro(&dev->params, &dev->state, vec);
+		gyro_data.x = vec[0];
+		gyro_data.y = vec[1];
+		gyro_data.z = vec[2];
+		gyro_data.temperature = 25;
+
+		/* Accels first; the sensors task blocks on the gyro */
+		PIOS_Queue_Send(dev->accel_queue, &accel_data, 0);
+		PIOS_Queue_Send(dev->gyro_queue, &gyro_data, 0);
+
+		if ((tick % mag_div) == 0) {
+			struct pios_sensor_mag_data mag_data;
+
+			physsim_sense_mag(&dev->params, &dev->state, vec);
+			mag_data.x = vec[0];
+			mag_data.y = vec[1];
+			mag_data.z = vec[2];
+
+			PIOS_Queue_Send(dev->mag_queue, &mag_data, 0);
+		}
+
+		if ((tick % baro_div) == 0) {
+			struct pios_sensor_baro_data baro_data;
+
+			baro_data.altitude = physsim_sense_baro(&dev->params,
+					&dev->state, &baro_data.pressure);
+			baro_data.temperature = 25;
+
+			PIOS_Queue_Send(dev->baro_queue, &baro_data, 0);
+		}
+
+		tick++;
+
+		if (dev->lockstep) {
+			PIOS_Semaphore_Take(dev->actuator_sema,
+					SIMPLANT_LOCKSTEP_TIMEOUT_MS);
+		}
+
+		deadline += period_us;
+
+		int32_t remaining = deadline - PIOS_DELAY_GetRaw();
+
+		if (remaining > 0) {
+			PIOS_DELAY_WaituS(remaining);
+		} else if (remaining < -(int32_t) (period_us * 10)) {
+			/* Way behind; don't try to catch up in a burst */
+			deadline = PIOS_DELAY_GetRaw();
+		}
+	}
+}
+
+static int PIOS_SIMPLANT_ParseConfig(struct simplant_dev *dev,
+		const char *config)
+{
+	char arg_copy[128];
+
+	strncpy(arg_copy, config, sizeof(arg_copy));
+	arg_copy[sizeof(arg_copy) - 1] = 0;
+
+	char *saveptr;
+
+	char *model = strtok_r(arg_copy, ":", &saveptr);
+	if (model == NULL) {
+		return -1;
+	}
+
+	if (!strcmp(model, "quad")) {
+		physsim_default_params(&dev->params,
+				PHYSSIM_FRAME_MULTIROTOR);
+	} else if (!strcmp(model, "plane")) {
+		physsim_default_params(&dev->params,
+				PHYSSIM_FRAME_FIXEDWING);
+	} else {
+		printf("Unknown plant model %s\n", model);
+		return -1;
+	}
+
+	dev->rate_hz = SIMPLANT_DEFAULT_RATE;
+	dev->lockstep = true;
+
+	/* Vehicles of a swarm get their own noise */
+	uint32_t seed = 1 + PIOS_SWARM_Instance();
+
+	char *opts = strtok_r(NULL, ":", &saveptr);
+	if (opts == NULL) {
+		physsim_reset(&dev->state, seed);
+		return 0;
+	}
+
+	char *opt_saveptr;
+
+	for (char *opt = strtok_r(opts, ",", &opt_saveptr); opt;
+			opt = strtok_r(NULL, ",", &opt_saveptr)) {
+		char *val_str = strchr(opt, '=');
+
+		if (val_str == NULL) {
+			goto fail;
+		}
+
+		*val_str++ = 0;
+
+		char *endptr;
+		float val = strtof(val_str, &endptr);
+
+		if (*endptr) {
+			goto fail;
+		}
+
+		struct physsim_params *p = &dev->params;
+
+		if (!strcmp(opt, "rate")) {
+			if ((val < SIMPLANT_MAG_RATE) || (val > 8000)) {
+				goto fail;
+			}
+
+			dev->rate_hz = val;
+		} else if (!strcmp(opt, "mass")) {
+			p->mass = val;
+		} else if (!strcmp(opt, "ixx")) {
+			p->inertia[0] = val;
+		} else if (!strcmp(opt, "iyy")) {
+			p->inertia[1] = val;
+		} else if (!strcmp(opt, "izz")) {
+			p->inertia[2] = val;
+		} else if (!strcmp(opt, "thrust")) {
+			p->max_thrust = val;
+		} else if (!strcmp(opt, "tau")) {
+			p->motor_tau = val;
+		} else if (!strcmp(opt, "expo")) {
+			p->thrust_expo = val;
+		} else if (!strcmp(opt, "noise")) {
+			/* Scales all of the sensor noise at once */
+			p->gyro_noise *= val;
+			p->accel_noise *= val;
+			p->mag_noise *= val;
+			p->baro_noise *= val;
+		} else if (!strcmp(opt, "seed")) {
+			seed = val + PIOS_SWARM_Instance();
+		} else if (!strcmp(opt, "lockstep")) {
+			dev->lockstep = (val != 0);
+		} else {
+			goto fail;
+		}
+
+		continue;
+fail:
+		printf("Bad plant option %s\n", opt);
+		return -1;
+	}
+
+	if ((dev->params.mass <= 0) || (dev->params.inertia[0] <= 0) ||
+			(dev->params.inertia[1] <= 0) ||
+			(dev->params.inertia[2] <= 0)) {
+		printf("Plant mass and inertia must be positive\n");
+		return -1;
+	}
+
+	physsim_reset(&dev->state, seed);
+
+	return 0;
+}
+
+/**
+ * Configure the plant, register its sensor queues and take over the
+ * servo outputs.
+ */
+int32_t PIOS_SIMPLANT_Init(simplant_dev_t *dev, const char *config)
+{
+	struct simplant_dev *s_dev = PIOS_malloc(sizeof(*s_dev));
+
+	if (s_dev == NULL) {
+		return -1;
+	}
+
+	memset(s_dev, 0, sizeof(*s_dev));
+
+	if (PIOS_SIMPLANT_ParseConfig(s_dev, config)) {
+		return -1;
+	}
+
+	s_dev->accel_queue = PIOS_Queue_Create(2, sizeof(struct pios_sensor_accel_data));
+	s_dev->gyro_queue = PIOS_Queue_Create(2, sizeof(struct pios_sensor_gyro_data));
+	s_dev->mag_queue = PIOS_Queue_Create(2, sizeof(struct pios_sensor_mag_data));
+	s_dev->baro_queue = PIOS_Queue_Create(2, sizeof(struct pios_sensor_baro_data));
+	s_dev->actuator_sema = PIOS_Semaphore_Create();
+
+	if (!s_dev->accel_queue || !s_dev->gyro_queue ||
+			!s_dev->mag_queue || !s_dev->baro_queue ||
+			!s_dev->actuator_sema) {
+		return -1;
+	}
+
+	plant_dev = s_dev;
+
+	PIOS_SNAPSHOT_Register("simplant.state", &s_dev->state,
+			sizeof(s_dev->state));
+	PIOS_SNAPSHOT_Register("simplant.outputs", s_dev->outputs,
+			sizeof(s_dev->outputs));
+
+	PIOS_Servo_SetCallbacks(&simplant_callbacks);
+
+	PIOS_SENSORS_SetSampleRate(PIOS_SENSOR_ACCEL, s_dev->rate_hz);
+	PIOS_SENSORS_SetSampleRate(PIOS_SENSOR_GYRO, s_dev->rate_hz);
+	PIOS_SENSORS_SetSampleRate(PIOS_SENSOR_MAG, SIMPLANT_MAG_RATE);
+	PIOS_SENSORS_SetSampleRate(PIOS_SENSOR_BARO, SIMPLANT_BARO_RATE);
+
+	PIOS_SENSORS_Register(PIOS_SENSOR_ACCEL, s_dev->accel_queue);
+	PIOS_SENSORS_Register(PIOS_SENSOR_GYRO, s_dev->gyro_queue);
+	PIOS_SENSORS_Register(PIOS_SENSOR_MAG, s_dev->mag_queue);
+	PIOS_SENSORS_Register(PIOS_SENSOR_BARO, s_dev->baro_queue);
+
+	PIOS_SENSORS_SetMaxGyro(2000);
+
+	struct pios_thread *plant_handle = PIOS_Thread_Create(
+			PIOS_SIMPLANT_Task, "pios_plant",
+			PIOS_THREAD_STACK_SIZE_MIN, s_dev,
+			PIOS_THREAD_PRIO_HIGHEST);
+
+	(void) plant_handle;
+
+	printf("plant %s running at %u Hz%s\n", config,
+			(unsigned int) s_dev->rate_hz,
+			s_dev->lockstep ? " (lockstep)" : "");
+
+	*dev = s_dev;
+
+	return 0;
+}
+
+/**
+ * @}
+ * @}
+ */
@@ -0,0 +1,482 @@
+/**
+ ******************************************************************************
+ * @addtogroup PIOS PIOS Core hardware abstraction layer
+ * @{
+ * @addtogroup PIOS_SNAPSHOT Flight state snapshots
+ * @{
+ *
+ * @file       pios_snapshot.c
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Saves and restores the complete flight state of the simulator.
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * Additional note on redistribution: The copyright and license notices above
+ * must be maintained in each individual source file that is a derivative work
+ * of this source file; otherwise redistribution is prohibited.
+ */
+
+#include "pios.h"
+
+#if defined(PIOS_INCLUDE_SNAPSHOT)
+
+#include <pios_snapshot.h>
+#include "pios_thread.h"
+#include "pios_swarm.h"
+
+#include "uavobjectmanager.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+
+#define SNAPSHOT_MAGIC		0x50414e53	/* "SNAP" */
+#define SNAPSHOT_VERSION	1
+
+#define SNAPSHOT_MAX_REGIONS	32
+#define SNAPSHOT_POLL_MS	10
+
+/*
+ * File layout, in host byte order (snapshots don't travel between
+ * machines): a header, then records, each followed by len bytes of data.
+ */
+struct snapshot_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t reserved;
+	uint64_t time_us;
+};
+
+enum snapshot_record_type {
+	SNAPSHOT_RECORD_OBJECT = 1,	/* a UAVObject instance, by ID */
+	SNAPSHOT_RECORD_STATE,		/* registered module state, by name */
+};
+
+struct snapshot_record {
+	uint8_t type;
+	uint8_t reserved;
+	uint16_t inst_id;
+	uint32_t obj_id;
+	uint32_t len;
+	char name[PIOS_SNAPSHOT_NAME_LEN];
+};
+
+struct snapshot_region {
+	char name[PIOS_SNAPSHOT_NAME_LEN];
+	void *state;
+	uint32_t len;
+};
+
+static struct snapshot_region regions[SNAPSHOT_MAX_REGIONS];
+static int num_regions;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The snapshot being restored */
+static uint8_t *loaded;
+static size_t loaded_len;
+
+static const char *save_path;
+static uint32_t save_at_ms;
+
+static volatile sig_atomic_t save_pending;
+static volatile bool restore_pending;
+static volatile bool paced;
+
+/* For the UAVObjIterate callback, which has no context */
+static FILE *save_file;
+static int save_errors;
+static uint32_t saved_objects;
+
+/**
+ * Steps through the records of the loaded snapshot.
+ * @returns false at the end, or if the rest is truncated
+ */
+static bool next_record(size_t *offset, struct snapshot_record *rec,
+		const uint8_t **data)
+{
+	if (*offset + sizeof(*rec) > loaded_len) {
+		return false;
+	}
+
+	memcpy(rec, loaded + *offset, sizeof(*rec));
+
+	if (*offset + sizeof(*rec) + rec->len > loaded_len) {
+		return false;
+	}
+
+	*data = loaded + *offset + sizeof(*rec);
+	*offset += sizeof(*rec) + rec->len;
+
+	return true;
+}
+
+/* Call with the lock held */
+static bool restore_region(const struct snapshot_region *region)
+{
+	if (!loaded) {
+		return false;
+	}
+
+	size_t offset = sizeof(struct snapshot_header);
+
+	struct snapshot_record rec;
+	const uint8_t *data;
+
+	while (next_record(&offset, &rec, &data)) {
+		if ((rec.type != SNAPSHOT_RECORD_STATE) ||
+				strncmp(rec.name, region->name,
+					PIOS_SNAPSHOT_NAME_LEN)) {
+			continue;
+		}
+
+		if (rec.len != region->len) {
+			printf("snapshot: %s changed size, not restored\n",
+					region->name);
+			return false;
+		}
+
+		memcpy(region->state, data, rec.len);
+
+		return true;
+	}
+
+	return false;
+}
+
+int32_t PIOS_SNAPSHOT_Register(const char *name, void *state, uint32_t len)
+{
+	int32_t ret = -1;
+
+	pthread_mutex_lock(&lock);
+
+	for (int i = 0; i < num_regions; i++) {
+		if (!strncmp(regions[i].name, name, PIOS_SNAPSHOT_NAME_LEN)) {
+			printf("snapshot: %s registered twice\n", name);
+			goto out;
+		}
+	}
+
+	if (num_regions >= SNAPSHOT_MAX_REGIONS) {
+		printf("snapshot: no room to register %s\n", name);
+		goto out;
+	}
+
+	struct snapshot_region *region = &regions[num_regions++];
+
+	strncpy(region->name, name, sizeof(region->name) - 1);
+	region->state = state;
+	region->len = len;
+
+	restore_region(region);
+
+	ret = 0;
+
+out:
+	pthread_mutex_unlock(&lock);
+
+	return ret;
+}
+
+int32_t PIOS_SNAPSHOT_Load(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+
+	fseek(f, 0, SEEK_END);
+	long len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	struct snapshot_header hdr;
+
+	if ((len < (long) sizeof(hdr)) || (fread(&hdr, sizeof(hdr), 1, f) != 1) ||
+			(hdr.magic != SNAPSHOT_MAGIC) ||
+			(hdr.version != SNAPSHOT_VERSION)) {
+		printf("snapshot: %s isn't a snapshot\n", path);
+		fclose(f);
+		return -1;
+	}
+
+	uint8_t *buf = malloc(len);
+
+	fseek(f, 0, SEEK_SET);
+
+	if (!buf || (fread(buf, len, 1, f) != 1)) {
+		printf("snapshot: couldn't read %s\n", path);
+		free(buf);
+		fclose(f);
+		return -1;
+	}
+
+	fclose(f);
+
+	pthread_mutex_lock(&lock);
+
+	free(loaded);
+	loaded = buf;
+	loaded_len = len;
+
+	/* Hold the pacer until the objects are back too */
+	restore_pending = true;
+
+	/* Pick up from where the snapshot left off, so timestamps in the
+	 * restored state still make sense */
+	PIOS_SWARM_SetTime_us(hdr.time_us);
+
+	for (int i = 0; i < num_regions; i++) {
+		restore_region(&regions[i]);
+	}
+
+	pthread_mutex_unlock(&lock);
+
+	printf("snapshot: loaded %s, resuming at %u ms\n", path,
+			(unsigned int) (hdr.time_us / 1000));
+
+	return 0;
+}
+
+int32_t PIOS_SNAPSHOT_RestoreObjects(void)
+{
+	uint32_t restored = 0, skipped = 0;
+
+	pthread_mutex_lock(&lock);
+
+	if (!loaded) {
+		pthread_mutex_unlock(&lock);
+		return 0;
+	}
+
+	size_t offset = sizeof(struct snapshot_header);
+
+	struct snapshot_record rec;
+	const uint8_t *data;
+
+	while (next_record(&offset, &rec, &data)) {
+		if (rec.type != SNAPSHOT_RECORD_OBJECT) {
+			continue;
+		}
+
+		/* The ID covers the object's layout, so objects whose
+		 * definition changed since the snapshot aren't found */
+		UAVObjHandle obj = UAVObjGetByID(rec.obj_id);
+
+		if (!obj || (UAVObjGetNumBytes(obj) != rec.len) ||
+				UAVObjUnpack(obj, rec.inst_id, data)) {
+			skipped++;
+			continue;
+		}
+
+		restored++;
+	}
+
+	restore_pending = false;
+
+	pthread_mutex_unlock(&lock);
+
+	printf("snapshot: restored %u objects, skipped %u\n",
+			(unsigned int) restored, (unsigned int) skipped);
+
+	return 0;
+}
+
+static int write_record(FILE *f, const struct snapshot_record *rec,
+		const void *data)
+{
+	if ((fwrite(rec, sizeof(*rec), 1, f) != 1) ||
+			(fwrite(data, rec->len, 1, f) != 1)) {
+		return -1;
+	}
+
+	return 0;
+}
+
+static void save_object(UAVObjHandle obj)
+{
+	uint32_t len = UAVObjGetNumBytes(obj);
+	uint8_t data[len];
+
+	uint16_t num_inst = UAVObjGetNumInstances(obj);
+
+	for (uint16_t i = 0; i < num_inst; i++) {
+		struct snapshot_record rec = {
+			.type = SNAPSHOT_RECORD_OBJECT,
+			.inst_id = i,
+			.obj_id = UAVObjGetID(obj),
+			.len = len,
+		};
+
+		if (UAVObjPack(obj, i, data) ||
+				write_record(save_file, &rec, data)) {
+			save_errors++;
+			continue;
+		}
+
+		saved_objects++;
+	}
+}
+
+int32_t PIOS_SNAPSHOT_Save(const char *path)
+{
+	char tmp_path[strlen(path) + 5];
+
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+	/* Write aside and rename, so a reader never sees half a snapshot */
+	FILE *f = fopen(tmp_path, "wb");
+
+	if (!f) {
+		perror(tmp_path);
+		return -1;
+	}
+
+	pthread_mutex_lock(&lock);
+
+	struct snapshot_header hdr = {
+		.magic = SNAPSHOT_MAGIC,
+		.version = SNAPSHOT_VERSION,
+		.time_us = PIOS_SWARM_GetTime_us(),
+	};
+
+	save_file = f;
+	save_errors = 0;
+	saved_objects = 0;
+
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) {
+		save_errors++;
+	}
+
+	UAVObjIterate(save_object);
+
+	for (int i = 0; i < num_regions; i++) {
+		struct snapshot_record rec = {
+			.type = SNAPSHOT_RECORD_STATE,
+			.len = regions[i].len,
+		};
+
+		memcpy(rec.name, regions[i].name, sizeof(rec.name));
+
+		if (write_record(f, &rec, regions[i].state)) {
+			save_errors++;
+		}
+	}
+
+	int errors = save_errors;
+	uint32_t objects = saved_objects;
+	int states = num_regions;
+
+	save_file = NULL;
+
+	pthread_mutex_unlock(&lock);
+
+	if (fclose(f) || errors || rename(tmp_path, path)) {
+		printf("snapshot: couldn't write %s\n", path);
+		remove(tmp_path);
+		return -1;
+	}
+
+	printf("snapshot: saved %u objects and %d states to %s at %u ms\n",
+			(unsigned int) objects, states, path,
+			(unsigned int) (hdr.time_us / 1000));
+
+	return 0;
+}
+
+void PIOS_SNAPSHOT_Request(void)
+{
+	save_pending = true;
+}
+
+static void take_pending(void)
+{
+	if (!__atomic_exchange_n(&save_pending, false, __ATOMIC_ACQ_REL)) {
+		return;
+	}
+
+	if (save_path) {
+		PIOS_SNAPSHOT_Save(save_path);
+	}
+}
+
+void PIOS_SNAPSHOT_Pace(void)
+{
+	paced = true;
+
+	while (restore_pending) {
+		PIOS_Thread_Sleep(1);
+	}
+
+	take_pending();
+}
+
+#ifdef SIGUSR1
+static void sigusr1_handler(int signum)
+{
+	(void) signum;
+
+	PIOS_SNAPSHOT_Request();
+}
+#endif
+
+static void PIOS_SNAPSHOT_Task(void *unused)
+{
+	(void) unused;
+
+	while (true) {
+		PIOS_Thread_Sleep(SNAPSHOT_POLL_MS);
+
+		if (save_at_ms && (PIOS_Thread_Systime() >= save_at_ms)) {
+			save_at_ms = 0;
+			PIOS_SNAPSHOT_Request();
+		}
+
+		/* Without a pacer to wait for, just take it */
+		if (!paced) {
+			take_pending();
+		}
+	}
+}
+
+int32_t PIOS_SNAPSHOT_Init(const char *path, uint32_t at_ms)
+{
+	save_path = path;
+	save_at_ms = at_ms;
+
+#ifdef SIGUSR1
+	signal(SIGUSR1, sigusr1_handler);
+#endif
+
+	struct pios_thread *handle = PIOS_Thread_Create(PIOS_SNAPSHOT_Task,
+			"pios_snapshot", PIOS_THREAD_STACK_SIZE_MIN, NULL,
+			PIOS_THREAD_PRIO_LOW);
+
+	if (!handle) {
+		return -1;
+	}
+
+	return 0;
+}
+
+#endif /* PIOS_INCLUDE_SNAPSHOT */
+
+/**
+ * @}
+ * @}
+ */
@@ -31,6 +31,7 @@
 
 #if defined(PIOS_INCLUDE_SPI)
 #include <stdio.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
@@ -64,8 +65,22 @@ int32_t PIOS_SPI_Init(uint32_t *spi_id, const struct pios_spi_cfg *cfg)
 
 	spi_dev->busy = PIOS_Semaphore_Create();
 	spi_dev->slave_count = 0;
+	spi_dev->selected = -1;
+	spi_dev->simulated = false;
 
-	for (int i=0; i < SPI_MAX_SUBDEV; i++) {
+	if (!strncmp(cfg->base_path, SPI_SIM_PREFIX, strlen(SPI_SIM_PREFIX))) {
+		int slaves = atoi(cfg->base_path + strlen(SPI_SIM_PREFIX));
+
+		if ((slaves < 1) || (slaves > SPI_MAX_SUBDEV)) {
+			goto out_fail;
+		}
+
+		spi_dev->simulated = true;
+		spi_dev->slave_count = slaves;
+		spi_dev->speed_hz = SPI_SIM_DEFAULT_HZ;
+	}
+
+	for (int i=0; (i < SPI_MAX_SUBDEV) && !spi_dev->simulated; i++) {
 		char path[PATH_MAX];
 
 		snprintf(path, PATH_MAX, "%s.%d", cfg->base_path, i);
@@ -153,6 +168,18 @@ int32_t PIOS_SPI_RC_PinSet(uint32_t spi_id, uint32_t slave_id, bool pin_value)
 		.delay_usecs = 1,
 	};
 
+	if (spi_dev->simulated) {
+		if (!pin_value) {
+			spi_dev->selected = slave_id;
+		} else {
+			PIOS_Assert(spi_dev->selected == slave_id);
+
+			spi_dev->selected = -1;
+		}
+
+		return 0;
+	}
+
 	if (!pin_value) {	 // Select this device
 		spi_dev->selected = slave_id;
 
@@ -196,6 +223,24 @@ int32_t PIOS_SPI_TransferBlock(uint32_t spi_id, const uint8_t *send_buffer, uint
 	PIOS_Assert(slave_id < spi_dev->slave_count)
 	PIOS_Assert(slave_id >= 0);
 
+	if (spi_dev->simulated) {
+		/* Slaves echo MOSI; the bus is held as long as the clock
+		 * rate says the bytes take to shift out. */
+		if (receive_buffer) {
+			if (send_buffer) {
+				memmove(receive_buffer, send_buffer, len);
+			} else {
+				memset(receive_buffer, 0xff, len);
+			}
+		}
+
+		uint32_t speed = spi_dev->speed_hz ? : SPI_SIM_DEFAULT_HZ;
+
+		PIOS_DELAY_WaituS((uint64_t) len * 8 * 1000000 / speed);
+
+		return 0;
+	}
+
         struct spi_ioc_transfer xfer = {
 		.rx_buf = (uintptr_t) receive_buffer,
 		.tx_buf = (uintptr_t) send_buffer,
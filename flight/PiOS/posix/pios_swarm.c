@@ -0,0 +1,308 @@
+/**
+ ******************************************************************************
+ *
+ * @file       pios_swarm.c
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Runs several simulated vehicles on one shared clock.
+ * @see        The GNU Public License (GPL) Version 3
+ * @addtogroup PIOS PIOS Core hardware abstraction layer
+ * @{
+ * @addtogroup PIOS_SWARM Multi-vehicle simulation
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ * Additional note on redistribution: The copyright and license notices above
+ * must be maintained in each individual source file that is a derivative work
+ * of this source file; otherwise redistribution is prohibited.
+ */
+
+#include <pios.h>
+#include <pios_swarm.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#if !(defined(_WIN32) || defined(WIN32) || defined(__MINGW32__))
+#include <sys/wait.h>
+#define SWARM_CAN_FORK
+#endif
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+static uint32_t instance;
+static uint32_t count = 1;
+static double speed = 1.0;
+
+static uint64_t epoch_ns;
+static bool epoch_set;
+
+#ifdef SWARM_CAN_FORK
+static pid_t children[PIOS_SWARM_MAX_INSTANCES];
+#endif
+
+static uint64_t monotonic_ns(void)
+{
+	struct timespec tp;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &tp)) {
+		perror("clock_gettime");
+		abort();
+	}
+
+	return (uint64_t) tp.tv_sec * 1000000000 + tp.tv_nsec;
+}
+
+static void set_epoch(void)
+{
+	if (!epoch_set) {
+		epoch_ns = monotonic_ns();
+		epoch_set = true;
+	}
+}
+
+static int parse_option(const char *arg)
+{
+	char *endptr;
+
+	long n = strtol(arg, &endptr, 10);
+
+	if ((n < 1) || (n > PIOS_SWARM_MAX_INSTANCES)) {
+		return -1;
+	}
+
+	count = n;
+
+	if (*endptr == ',') {
+		speed = strtod(endptr + 1, &endptr);
+
+		if (!(speed > 0)) {
+			return -1;
+		}
+	}
+
+	if (*endptr) {
+		return -1;
+	}
+
+	return 0;
+}
+
+#ifdef SWARM_CAN_FORK
+static void forward_signal(int signum)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		if (children[i] > 0) {
+			kill(children[i], signum);
+		}
+	}
+}
+
+/**
+ * Puts a vehicle in its own directory with its own console log.
+ */
+static void enter_instance(uint32_t i)
+{
+	char dir[32];
+
+	instance = i;
+
+	snprintf(dir, sizeof(dir), "vehicle-%u", (unsigned int) i);
+
+	if ((mkdir(dir, 0755) && (errno != EEXIST)) || chdir(dir)) {
+		perror(dir);
+		exit(1);
+	}
+
+	int fd = open("console.log", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fd >= 0) {
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		close(fd);
+	}
+
+#ifdef __linux__
+	/* Don't outlive the launcher */
+	prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+
+	printf("Vehicle %u of %u, clock x%g\n", (unsigned int) i,
+			(unsigned int) count, speed);
+}
+
+static void run_launcher(void)
+{
+	signal(SIGINT, forward_signal);
+	signal(SIGTERM, forward_signal);
+
+	uint32_t running = count;
+
+	while (running) {
+		int status;
+
+		pid_t pid = wait(&status);
+
+		if (pid < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			break;
+		}
+
+		for (uint32_t i = 0; i < count; i++) {
+			if (children[i] == pid) {
+				printf("Vehicle %u exited (%d)\n",
+						(unsigned int) i, status);
+				children[i] = 0;
+				running--;
+			}
+		}
+	}
+
+	exit(0);
+}
+#endif /* SWARM_CAN_FORK */
+
+void PIOS_SWARM_Start(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++) {
+		const char *arg = NULL;
+
+		if (!strcmp(argv[i], "-N") && (i + 1 < argc)) {
+			arg = argv[i + 1];
+		} else if (!strncmp(argv[i], "-N", 2) && argv[i][2]) {
+			arg = argv[i] + 2;
+		}
+
+		if (arg && parse_option(arg)) {
+			printf("Bad instance count/speed %s\n", arg);
+			exit(1);
+		}
+	}
+
+	/* Before forking, so every vehicle keeps the same time */
+	set_epoch();
+
+	if (count == 1) {
+		return;
+	}
+
+#ifdef SWARM_CAN_FORK
+	printf("Starting %u vehicles, clock x%g\n", (unsigned int) count,
+			speed);
+
+	/* Or the vehicles inherit and repeat whatever is buffered */
+	fflush(stdout);
+	fflush(stderr);
+
+	for (uint32_t i = 0; i < count; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0) {
+			perror("fork");
+			forward_signal(SIGTERM);
+			exit(1);
+		}
+
+		if (pid == 0) {
+			enter_instance(i);
+			return;
+		}
+
+		children[i] = pid;
+	}
+
+	run_launcher();
+#else
+	printf("Multiple vehicles need fork()\n");
+	exit(1);
+#endif
+}
+
+uint32_t PIOS_SWARM_Instance(void)
+{
+	return instance;
+}
+
+uint32_t PIOS_SWARM_Count(void)
+{
+	return count;
+}
+
+uint16_t PIOS_SWARM_Port(uint16_t base_port)
+{
+	return base_port + instance * PIOS_SWARM_PORT_STRIDE;
+}
+
+uint64_t PIOS_SWARM_GetTime_us(void)
+{
+	set_epoch();
+
+	uint64_t elapsed_ns = monotonic_ns() - epoch_ns;
+
+	if (speed == 1.0) {
+		return elapsed_ns / 1000;
+	}
+
+	return (uint64_t) (elapsed_ns * speed / 1000);
+}
+
+void PIOS_SWARM_SetTime_us(uint64_t time_us)
+{
+	uint64_t real_ns = PIOS_SWARM_Real_ns(time_us * 1000);
+	uint64_t now_ns = monotonic_ns();
+
+	/* Can't go back past when the host booted; close enough */
+	epoch_ns = (real_ns < now_ns) ? (now_ns - real_ns) : 0;
+	epoch_set = true;
+}
+
+uint64_t PIOS_SWARM_Real_ns(uint64_t virtual_ns)
+{
+	if (speed == 1.0) {
+		return virtual_ns;
+	}
+
+	return (uint64_t) (virtual_ns / speed);
+}
+
+void PIOS_SWARM_Deadline(struct timespec *abstime, uint32_t timeout_ms)
+{
+	uint64_t wait_ns = PIOS_SWARM_Real_ns((uint64_t) timeout_ms * 1000000);
+
+	clock_gettime(CLOCK_REALTIME, abstime);
+
+	wait_ns += abstime->tv_nsec;
+
+	abstime->tv_sec += wait_ns / 1000000000;
+	abstime->tv_nsec = wait_ns % 1000000000;
+}
+
+/**
+ * @}
+ * @}
+ */
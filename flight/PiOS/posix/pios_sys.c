@@ -57,6 +57,8 @@
 #include "pios_serial_priv.h"
 #include "pios_tcp_priv.h"
 #include "pios_flightgear.h"
+#include "pios_simplant.h"
+#include "pios_simbridge.h"
 #include "pios_thread.h"
 
 #include "pios_hal.h"
@@ -100,17 +102,34 @@ uintptr_t external_i2c_adapter_id;
 static void Usage(char *cmdName) {
 	printf( "usage: %s [-f] [-r] [-m orientation] [-s spibase] [-d drvname:bus:id]\n"
 		"\t\t[-l logfile] [-I i2cdev] [-i drvname:bus] [-g port]"
+		"\t\t[-p model[:key=val,...]] [-b addr[,rate]] [-N count[,speed]]"
+		"\t\t[-W path[@seconds]] [-R path] [-T path]"
 		"\n"
 		"\t-f\tEnables floating point exception trapping mode\n"
 		"\t-r\tGoes realtime-class and pins all memory (requires root)\n"
 		"\t-l log\tWrites simulation data to a log\n"
 		"\t-g port\tStarts FlightGear driver on port\n"
+		"\t-p model\tRuns the built-in physics plant (quad, plane)\n"
+		"\t\t\tKeys: rate mass ixx iyy izz thrust tau expo noise\n"
+		"\t\t\tseed lockstep\n"
+		"\t-b addr\tStarts the binary simulator bridge on a UDP port\n"
+		"\t\t\tor unix:path, expecting rate Hz IMU samples\n"
+		"\t-N count\tRuns count vehicles, each in ./vehicle-N with ports\n"
+		"\t\t\toffset by 10*N, on a clock running speed times\n"
+		"\t\t\treal time\n"
+		"\t-W path\tSaves a flight state snapshot to path on SIGUSR1,\n"
+		"\t\t\tand once the clock reaches seconds if given\n"
+		"\t-R path\tResumes from a flight state snapshot; must come\n"
+		"\t\t\tbefore hw\n"
+		"\t-T path\tWrites the trace to path on exit, for\n"
+		"\t\t\tdronin-trace (needs ENABLE_TRACE=YES)\n"
 #ifdef PIOS_INCLUDE_SERIAL
 		"\t-S drvname:serialpath\tStarts a serial driver on serialpath\n"
 		"\t\t\tAvailable drivers: gps msp lighttelemetry telemetry omnip\n"
 #endif
 #ifdef PIOS_INCLUDE_SPI
 		"\t-s spibase\tConfigures a SPI interface on the base path\n"
+		"\t\t\tsim:N simulates a bus with N loopback slaves\n"
 		"\t-d drvname:bus:id\tStarts driver drvname on bus/id\n"
 		"\t\t\tAvailable drivers: bmm150 bmx055 flyingpio ms5611\n"
 #endif
@@ -435,6 +454,17 @@ static void go_realtime() {
 static int saved_argc;
 static char **saved_argv;
 
+#if defined(PIOS_INCLUDE_TRACE)
+static const char *trace_path;
+
+static void save_trace(void)
+{
+	if (PIOS_Trace_Save(trace_path)) {
+		printf("Couldn't save trace to %s\n", trace_path);
+	}
+}
+#endif
+
 void PIOS_SYS_Args(int argc, char *argv[]) {
 	saved_argc = argc;
 	saved_argv = argv;
@@ -443,7 +473,7 @@ void PIOS_SYS_Args(int argc, char *argv[]) {
 
 	bool first_arg = true;
 
-	while ((opt = getopt(argc, argv, "frg:l:s:d:S:I:i:")) != -1) {
+	while ((opt = getopt(argc, argv, "frg:l:p:b:s:d:S:I:i:N:W:R:T:")) != -1) {
 		switch (opt) {
 			case 'f':
 				debug_fpe = true;
@@ -477,6 +507,30 @@ void PIOS_SYS_Args(int argc, char *argv[]) {
 				first_arg = false;
 				break;
 			}
+			case 'p':
+			{
+				simplant_dev_t dontcare;
+
+				if (PIOS_SIMPLANT_Init(&dontcare, optarg)) {
+					printf("Couldn't init physics plant\n");
+					exit(1);
+				}
+
+				first_arg = false;
+				break;
+			}
+			case 'b':
+			{
+				simbridge_dev_t dontcare;
+
+				if (PIOS_SIMBRIDGE_Init(&dontcare, optarg)) {
+					printf("Couldn't init simulator bridge\n");
+					exit(1);
+				}
+
+				first_arg = false;
+				break;
+			}
 #ifdef PIOS_INCLUDE_SERIAL
 			case 'S':
 				if (handle_serial_device(optarg)) {
@@ -571,6 +625,47 @@ void PIOS_SYS_Args(int argc, char *argv[]) {
 			}
 #endif
 
+			case 'N':
+				/* Handled by PIOS_SWARM_Start before init */
+				break;
+			case 'W':
+			{
+				uint32_t at_ms = 0;
+
+				char *at = strchr(optarg, '@');
+
+				if (at) {
+					*at = 0;
+					at_ms = strtod(at + 1, NULL) * 1000;
+				}
+
+				if (PIOS_SNAPSHOT_Init(optarg, at_ms)) {
+					printf("Couldn't start snapshots\n");
+					exit(1);
+				}
+				break;
+			}
+			case 'R':
+				/* The plant must not step before it's restored */
+				if (!first_arg) {
+					printf("Restore must be before hw\n");
+					exit(1);
+				}
+
+				if (PIOS_SNAPSHOT_Load(optarg)) {
+					printf("Couldn't load snapshot\n");
+					exit(1);
+				}
+				break;
+			case 'T':
+#if defined(PIOS_INCLUDE_TRACE)
+				trace_path = optarg;
+				atexit(save_trace);
+#else
+				printf("Built without trace; use ENABLE_TRACE=YES\n");
+				exit(1);
+#endif
+				break;
 			default:
 				Usage(argv[0]);
 				break;
@@ -4,7 +4,7 @@
  * @file       pios_tcp.c
  * @author     The OpenPilot Team, http://www.openpilot.org Copyright (C) 2012.
  * @author     Tau Labs, http://taulabs.org, Copyright (C) 2014
- * @author     dRonin, http://dRonin.org/, Copyright (C) 2016
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2016-2017
  * @brief      TCP commands. Inits UDPs, controls UDPs & Interupt handlers.
  * @see        The GNU Public License (GPL) Version 3
  * @addtogroup PIOS PIOS Core hardware abstraction layer
@@ -33,22 +33,49 @@
  */
 
 
+/* For accept4 */
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif /* !defined(_GNU_SOURCE) */
+
 /* Project Includes */
 #include "pios.h"
 
 #if defined(PIOS_INCLUDE_TCP)
 
 #include <pios_tcp_priv.h>
+#include "pios_mutex.h"
+#include "pios_swarm.h"
 #include "pios_thread.h"
 #include <unistd.h>
 #include <sys/types.h>
 #include <errno.h>
 #include <fcntl.h>
 
+#if defined(PIOS_INCLUDE_IOLOOP)
+#include <pios_ioloop.h>
+#include <sys/timerfd.h>
+#endif
+
 #ifndef INVALID_SOCKET
 #define INVALID_SOCKET (-1)
 #endif
 
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#ifndef MSG_DONTWAIT
+#define MSG_DONTWAIT 0
+#endif
+
+#define PIOS_TCP_MAX_CLIENTS 8
+
+/* How long the client feeding the receive stream must be quiet before
+ * another may take over.  Senders write whole frames at once, so a pause
+ * this long falls between frames. */
+#define PIOS_TCP_HANDOFF_MS 100
+
 /* Provide a COM driver */
 static void PIOS_TCP_ChangeBaud(uintptr_t udp_id, uint32_t baud);
 static void PIOS_TCP_RegisterRxCallback(uintptr_t udp_id, pios_com_callback rx_in_cb, uintptr_t context);
@@ -61,14 +88,32 @@ typedef struct {
 
 	int socket;
 	struct sockaddr_in6 server;
-	struct sockaddr_in6 client;
-	int socket_connection;
+
+	/* Only the active client feeds the receive stream, so partial
+	 * frames from two clients never interleave.  The others wait their
+	 * turn with their bytes left in the socket.  Sends go to all
+	 * clients, waiting or not. */
+	struct pios_mutex *clients_lock;
+	int clients[PIOS_TCP_MAX_CLIENTS];
+	int active;
+
+#if defined(PIOS_INCLUDE_IOLOOP)
+	/* Loop thread only */
+	int handoff_timer;
+	bool handoff_armed;
+	bool active_spoke;
+#endif
 
 	pios_com_callback tx_out_cb;
 	uintptr_t tx_out_context;
 	pios_com_callback rx_in_cb;
 	uintptr_t rx_in_context;
 
+	/* Received bytes PIOS_COM had no room for yet */
+	uint16_t rx_pending;
+	uint16_t rx_offset;
+	volatile bool rx_stalled;
+
 	uint8_t rx_buffer[PIOS_TCP_RX_BUFFER_SIZE];
 	uint8_t tx_buffer[PIOS_TCP_RX_BUFFER_SIZE];
 } pios_tcp_dev;
@@ -87,49 +132,315 @@ static pios_tcp_dev * find_tcp_dev_by_id(uintptr_t tcp)
 	return (pios_tcp_dev *) tcp;
 }
 
+#if defined(PIOS_INCLUDE_IOLOOP)
+static void PIOS_TCP_SetClientEvents(pios_tcp_dev *tcp_dev, uint8_t events);
+#endif
+
+static int PIOS_TCP_AddClient(pios_tcp_dev *tcp_dev, int conn)
+{
+	int slot = -1;
+
+	PIOS_Mutex_Lock(tcp_dev->clients_lock, PIOS_MUTEX_TIMEOUT_MAX);
+
+	for (int i = 0; i < PIOS_TCP_MAX_CLIENTS; i++) {
+		if (tcp_dev->clients[i] == INVALID_SOCKET) {
+			tcp_dev->clients[i] = conn;
+			slot = i;
+			break;
+		}
+	}
+
+	PIOS_Mutex_Unlock(tcp_dev->clients_lock);
+
+	return slot;
+}
+
+static void PIOS_TCP_CloseClient(pios_tcp_dev *tcp_dev, int conn)
+{
+	PIOS_Mutex_Lock(tcp_dev->clients_lock, PIOS_MUTEX_TIMEOUT_MAX);
+
+	for (int i = 0; i < PIOS_TCP_MAX_CLIENTS; i++) {
+		if (tcp_dev->clients[i] == conn) {
+			tcp_dev->clients[i] = INVALID_SOCKET;
+		}
+	}
+
+	bool was_active = (tcp_dev->active == conn);
+
+	if (was_active) {
+		tcp_dev->active = INVALID_SOCKET;
+	}
+
+	PIOS_Mutex_Unlock(tcp_dev->clients_lock);
+
+#if defined(PIOS_INCLUDE_IOLOOP)
+	PIOS_IOLoop_Remove(conn);
+
+	/* Let any waiting clients take over */
+	if (was_active && !tcp_dev->rx_stalled) {
+		PIOS_TCP_SetClientEvents(tcp_dev, PIOS_IOLOOP_READ);
+	}
+#endif
+
+	close(conn);
+
+	fprintf(stderr, "Connection closed\n");
+}
+
+/**
+ * Hands pending received bytes to PIOS_COM.
+ * @returns true if it took all of them
+ */
+static bool PIOS_TCP_Deliver(pios_tcp_dev *tcp_dev)
+{
+	while (tcp_dev->rx_pending) {
+		if (!tcp_dev->rx_in_cb) {
+			/* Nobody listening yet */
+			tcp_dev->rx_pending = 0;
+			break;
+		}
+
+		bool rx_need_yield = false;
+
+		uint16_t taken = tcp_dev->rx_in_cb(tcp_dev->rx_in_context,
+				tcp_dev->rx_buffer + tcp_dev->rx_offset,
+				tcp_dev->rx_pending, NULL, &rx_need_yield);
+
+		if (!taken) {
+			return false;
+		}
+
+		tcp_dev->rx_offset += taken;
+		tcp_dev->rx_pending -= taken;
+	}
+
+	return true;
+}
+
+#if defined(PIOS_INCLUDE_IOLOOP)
+
+static void PIOS_TCP_SetClientEvents(pios_tcp_dev *tcp_dev, uint8_t events)
+{
+	PIOS_Mutex_Lock(tcp_dev->clients_lock, PIOS_MUTEX_TIMEOUT_MAX);
+
+	for (int i = 0; i < PIOS_TCP_MAX_CLIENTS; i++) {
+		if (tcp_dev->clients[i] != INVALID_SOCKET) {
+			PIOS_IOLoop_Modify(tcp_dev->clients[i], events);
+		}
+	}
+
+	PIOS_Mutex_Unlock(tcp_dev->clients_lock);
+}
+
+/**
+ * Checks back in PIOS_TCP_HANDOFF_MS on whether the active client has
+ * gone quiet, so a waiting one can take over.
+ */
+static void PIOS_TCP_ArmHandoff(pios_tcp_dev *tcp_dev)
+{
+	if (tcp_dev->handoff_armed) {
+		return;
+	}
+
+	struct itimerspec its = {
+		.it_value = {
+			.tv_sec = 0,
+			.tv_nsec = PIOS_TCP_HANDOFF_MS * 1000000,
+		},
+	};
+
+	tcp_dev->active_spoke = false;
+	tcp_dev->handoff_armed = true;
+
+	timerfd_settime(tcp_dev->handoff_timer, 0, &its, NULL);
+}
+
+static void PIOS_TCP_HandoffEvent(int fd, uint8_t events, void *ctx)
+{
+	pios_tcp_dev *tcp_dev = ctx;
+
+	uint64_t expirations;
+
+	if (read(fd, &expirations, sizeof(expirations)) < 0) {
+		/* Spurious */
+		return;
+	}
+
+	tcp_dev->handoff_armed = false;
+
+	if (tcp_dev->active_spoke || tcp_dev->rx_stalled) {
+		/* Still mid-conversation */
+		PIOS_TCP_ArmHandoff(tcp_dev);
+		return;
+	}
+
+	PIOS_Mutex_Lock(tcp_dev->clients_lock, PIOS_MUTEX_TIMEOUT_MAX);
+	tcp_dev->active = INVALID_SOCKET;
+	PIOS_Mutex_Unlock(tcp_dev->clients_lock);
+
+	/* The first waiting client to be read takes over */
+	PIOS_TCP_SetClientEvents(tcp_dev, PIOS_IOLOOP_READ);
+}
+
+static void PIOS_TCP_ClientEvent(int conn, uint8_t events, void *ctx)
+{
+	pios_tcp_dev *tcp_dev = ctx;
+
+	if (tcp_dev->rx_stalled) {
+		/* Paused clients are still told of errors and hangups, and
+		 * keep being told until their socket is closed */
+		if (events & PIOS_IOLOOP_HANGUP) {
+			PIOS_TCP_CloseClient(tcp_dev, conn);
+		}
+
+		return;
+	}
+
+	PIOS_Mutex_Lock(tcp_dev->clients_lock, PIOS_MUTEX_TIMEOUT_MAX);
+
+	if (tcp_dev->active == INVALID_SOCKET) {
+		tcp_dev->active = conn;
+	}
+
+	bool is_active = (tcp_dev->active == conn);
+
+	PIOS_Mutex_Unlock(tcp_dev->clients_lock);
+
+	if (!is_active) {
+		if (events & PIOS_IOLOOP_HANGUP) {
+			PIOS_TCP_CloseClient(tcp_dev, conn);
+			return;
+		}
+
+		/* Wait its turn */
+		PIOS_IOLoop_Modify(conn, 0);
+		PIOS_TCP_ArmHandoff(tcp_dev);
+		return;
+	}
+
+	int result = recv(conn, tcp_dev->rx_buffer, sizeof(tcp_dev->rx_buffer),
+			MSG_DONTWAIT);
+
+	if (result > 0) {
+		tcp_dev->active_spoke = true;
+
+		tcp_dev->rx_offset = 0;
+		tcp_dev->rx_pending = result;
+
+		/* Set first, so an RxStart racing with a short delivery
+		 * still kicks the loop */
+		tcp_dev->rx_stalled = true;
+
+		if (PIOS_TCP_Deliver(tcp_dev)) {
+			tcp_dev->rx_stalled = false;
+		} else {
+			/* Leave the rest in the socket buffers, so TCP
+			 * pushes back on the senders */
+			PIOS_TCP_SetClientEvents(tcp_dev, 0);
+		}
+
+		return;
+	}
+
+	if ((result < 0) && ((errno == EAGAIN) || (errno == EINTR))) {
+		return;
+	}
+
+	PIOS_TCP_CloseClient(tcp_dev, conn);
+}
+
+static void PIOS_TCP_ListenEvent(int fd, uint8_t events, void *ctx)
+{
+	pios_tcp_dev *tcp_dev = ctx;
+
+	if ((events & PIOS_IOLOOP_KICK) && tcp_dev->rx_stalled) {
+		if (PIOS_TCP_Deliver(tcp_dev)) {
+			tcp_dev->rx_stalled = false;
+
+			PIOS_TCP_SetClientEvents(tcp_dev, PIOS_IOLOOP_READ);
+		}
+	}
+
+	if (!(events & PIOS_IOLOOP_READ)) {
+		return;
+	}
+
+	int conn = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+	if (conn < 0) {
+		if ((errno != EAGAIN) && (errno != EINTR)) {
+			perror("Accept failed");
+		}
+
+		return;
+	}
+
+	int optval = 1;
+	setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+
+	if (PIOS_TCP_AddClient(tcp_dev, conn) < 0) {
+		fprintf(stderr, "Too many connections; refused\n");
+		close(conn);
+		return;
+	}
+
+	if (PIOS_IOLoop_Add(conn, tcp_dev->rx_stalled ? 0 : PIOS_IOLOOP_READ,
+				PIOS_TCP_ClientEvent, tcp_dev)) {
+		PIOS_TCP_CloseClient(tcp_dev, conn);
+		return;
+	}
+
+	fprintf(stderr, "Connection accepted\n");
+}
+
+#else
+
 /**
- * RxTask
+ * RxTask, for hosts without the I/O loop; serves one client at a time
  */
 static void PIOS_TCP_RxTask(void *tcp_dev_n)
 {
 	pios_tcp_dev *tcp_dev = (pios_tcp_dev*)tcp_dev_n;
-	
-	const int INCOMING_BUFFER_SIZE = 16;
-	char incoming_buffer[INCOMING_BUFFER_SIZE];
+
 	int error;
 
 	while (1) {
-	
+		int conn;
+
 		do
 		{
-			tcp_dev->socket_connection = accept(tcp_dev->socket, NULL, NULL);
+			conn = accept(tcp_dev->socket, NULL, NULL);
 			error = errno;
 
 			PIOS_Thread_Sleep(1);
-		} while (tcp_dev->socket_connection == INVALID_SOCKET && (error == EINTR || error == EAGAIN));
+		} while (conn == INVALID_SOCKET && (error == EINTR || error == EAGAIN));
 
-		if (tcp_dev->socket_connection < 0) {
-			int error = errno;
-			(void)error;
+		if (conn < 0) {
 			perror("Accept failed");
 			close(tcp_dev->socket);
 			exit(EXIT_FAILURE);
 		}
 
+		PIOS_TCP_AddClient(tcp_dev, conn);
+
+		PIOS_Mutex_Lock(tcp_dev->clients_lock, PIOS_MUTEX_TIMEOUT_MAX);
+		tcp_dev->active = conn;
+		PIOS_Mutex_Unlock(tcp_dev->clients_lock);
+
 		fprintf(stderr, "Connection accepted\n");
 
 		while (1) {
-			// Received is used to track the scoket whereas the dev variable is only updated when it can be
-
-			int result = recv(tcp_dev->socket_connection, (char *) incoming_buffer, INCOMING_BUFFER_SIZE, 0);
+			int result = recv(conn, (char *) tcp_dev->rx_buffer,
+					sizeof(tcp_dev->rx_buffer), 0);
 			error = errno;
 
-			if (result > 0 && tcp_dev->rx_in_cb) {
-
-				bool rx_need_yield = false;
-
-				tcp_dev->rx_in_cb(tcp_dev->rx_in_context, (uint8_t*)incoming_buffer, result, NULL, &rx_need_yield);
+			if (result > 0) {
+				tcp_dev->rx_offset = 0;
+				tcp_dev->rx_pending = result;
 
+				/* Whatever PIOS_COM has no room for is lost */
+				PIOS_TCP_Deliver(tcp_dev);
+				tcp_dev->rx_pending = 0;
 			}
 
 			if (result == 0) {
@@ -145,17 +456,16 @@ static void PIOS_TCP_RxTask(void *tcp_dev_n)
 					break;
 			}
 		}
-		
-		close(tcp_dev->socket_connection);
-		tcp_dev->socket_connection = INVALID_SOCKET;
+
+		PIOS_TCP_CloseClient(tcp_dev, conn);
 	}
 }
 
+#endif /* PIOS_INCLUDE_IOLOOP */
 
 /**
  * Open TCP socket
  */
-struct pios_thread *tcpRxTaskHandle;
 int32_t PIOS_TCP_Init(uintptr_t *tcp_id, const struct pios_tcp_cfg * cfg)
 {
 	pios_tcp_dev *tcp_dev = PIOS_malloc(sizeof(pios_tcp_dev));
@@ -166,10 +476,17 @@ int32_t PIOS_TCP_Init(uintptr_t *tcp_id, const struct pios_tcp_cfg * cfg)
 	tcp_dev->rx_in_cb = NULL;
 	tcp_dev->tx_out_cb = NULL;
 	tcp_dev->cfg=cfg;
-	
+
+	tcp_dev->clients_lock = PIOS_Mutex_Create();
+
+	for (int i = 0; i < PIOS_TCP_MAX_CLIENTS; i++) {
+		tcp_dev->clients[i] = INVALID_SOCKET;
+	}
+
+	tcp_dev->active = INVALID_SOCKET;
+
 	/* assign socket */
 	tcp_dev->socket = socket(PF_INET6, SOCK_STREAM, IPPROTO_TCP);
-	tcp_dev->socket_connection = INVALID_SOCKET;
 
 #if defined(_WIN32) || defined(WIN32) || defined(__MINGW32__)
 	char optval = 1;
@@ -187,31 +504,48 @@ int32_t PIOS_TCP_Init(uintptr_t *tcp_id, const struct pios_tcp_cfg * cfg)
         setsockopt(tcp_dev->socket, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
 
 	memset(&tcp_dev->server, 0, sizeof(tcp_dev->server));
-	memset(&tcp_dev->client, 0, sizeof(tcp_dev->client));
 
 	tcp_dev->server.sin6_family = AF_INET6;
 	tcp_dev->server.sin6_addr = in6addr_any;
-	tcp_dev->server.sin6_port = htons(tcp_dev->cfg->port);
+	tcp_dev->server.sin6_port = htons(PIOS_SWARM_Port(tcp_dev->cfg->port));
 
 	int res = bind(tcp_dev->socket, (struct sockaddr*)&tcp_dev->server, sizeof(tcp_dev->server));
 	if (res == -1) {
 		perror("Binding socket failed");
 		exit(EXIT_FAILURE);
 	}
-	
+
 	res = listen(tcp_dev->socket, 10);
 	if (res == -1) {
 		perror("Socket listen failed");
 		exit(EXIT_FAILURE);
 	}
-	
-	tcpRxTaskHandle = PIOS_Thread_Create(
+
+#if defined(PIOS_INCLUDE_IOLOOP)
+	fcntl(tcp_dev->socket, F_SETFL,
+			fcntl(tcp_dev->socket, F_GETFL) | O_NONBLOCK);
+
+	tcp_dev->handoff_timer = timerfd_create(CLOCK_MONOTONIC,
+			TFD_NONBLOCK | TFD_CLOEXEC);
+
+	if ((tcp_dev->handoff_timer < 0) ||
+			PIOS_IOLoop_Add(tcp_dev->handoff_timer, PIOS_IOLOOP_READ,
+				PIOS_TCP_HandoffEvent, tcp_dev)) {
+		perror("TCP handoff timer failed");
+		exit(EXIT_FAILURE);
+	}
+
+	res = PIOS_IOLoop_Add(tcp_dev->socket, PIOS_IOLOOP_READ,
+			PIOS_TCP_ListenEvent, tcp_dev);
+#else
+	PIOS_Thread_Create(
 			PIOS_TCP_RxTask, "pios_tcp_rx", PIOS_THREAD_STACK_SIZE_MIN, tcp_dev, PIOS_THREAD_PRIO_HIGHEST);
-	
+#endif
+
 	printf("tcp dev %p - socket %i opened - result %i\n", tcp_dev, tcp_dev->socket, res);
-	
+
 	*tcp_id = (uintptr_t) tcp_dev;
-	
+
 	return res;
 }
 
@@ -224,52 +558,84 @@ void PIOS_TCP_ChangeBaud(uintptr_t tcp_id, uint32_t baud)
 }
 
 
-static void PIOS_TCP_RxStart(uintptr_t tp_id, uint16_t rx_bytes_avail)
+static void PIOS_TCP_RxStart(uintptr_t tcp_id, uint16_t rx_bytes_avail)
 {
-	/**
-	 * lazy!
-	 */
+#if defined(PIOS_INCLUDE_IOLOOP)
+	pios_tcp_dev *tcp_dev = find_tcp_dev_by_id(tcp_id);
+
+	PIOS_Assert(tcp_dev);
+
+	/* There's room again; have the loop hand over what's pending and
+	 * resume reading */
+	if (tcp_dev->rx_stalled && rx_bytes_avail) {
+		PIOS_IOLoop_Kick(tcp_dev->socket);
+	}
+#endif
 }
 
 
 static void PIOS_TCP_TxStart(uintptr_t tcp_id, uint16_t tx_bytes_avail)
 {
 	pios_tcp_dev *tcp_dev = find_tcp_dev_by_id(tcp_id);
-	
+
 	PIOS_Assert(tcp_dev);
-	
-	int32_t length,rem;
-	
+
 	/**
 	 * we send everything directly whenever notified of data to send (lazy!)
 	 */
-	if (tcp_dev->tx_out_cb) {
-		while (tx_bytes_avail > 0) {
-			bool tx_need_yield = false;
-			length = (tcp_dev->tx_out_cb)(tcp_dev->tx_out_context, tcp_dev->tx_buffer, PIOS_TCP_RX_BUFFER_SIZE, NULL, &tx_need_yield);
-			rem = length;
-			while (rem > 0) {
-				ssize_t len = 0;
-				if (tcp_dev->socket_connection != INVALID_SOCKET) {
-					len = send(tcp_dev->socket_connection, (char *) tcp_dev->tx_buffer, length, 0);
-				}
+	if (!tcp_dev->tx_out_cb) {
+		return;
+	}
+
+	while (tx_bytes_avail > 0) {
+		bool tx_need_yield = false;
+		uint16_t length = (tcp_dev->tx_out_cb)(tcp_dev->tx_out_context, tcp_dev->tx_buffer, PIOS_TCP_RX_BUFFER_SIZE, NULL, &tx_need_yield);
+
+		if (!length) {
+			break;
+		}
+
+		PIOS_Mutex_Lock(tcp_dev->clients_lock, PIOS_MUTEX_TIMEOUT_MAX);
+
+		for (int i = 0; i < PIOS_TCP_MAX_CLIENTS; i++) {
+			int conn = tcp_dev->clients[i];
+
+			if (conn == INVALID_SOCKET) {
+				continue;
+			}
+
+			/* A client that can't keep up loses the rest of the
+			 * chunk rather than stalling the others; failed
+			 * sockets are closed by the receive side */
+			uint16_t sent = 0;
+
+			while (sent < length) {
+				ssize_t len = send(conn,
+						(char *) tcp_dev->tx_buffer + sent,
+						length - sent,
+						MSG_NOSIGNAL | MSG_DONTWAIT);
+
 				if (len <= 0) {
-					rem = 0;
-				} else {
-					rem -= len;
+					break;
 				}
+
+				sent += len;
 			}
-			tx_bytes_avail -= length;
 		}
+
+		PIOS_Mutex_Unlock(tcp_dev->clients_lock);
+
+		tx_bytes_avail -= (length < tx_bytes_avail) ?
+			length : tx_bytes_avail;
 	}
 }
 
 static void PIOS_TCP_RegisterRxCallback(uintptr_t tcp_id, pios_com_callback rx_in_cb, uintptr_t context)
 {
 	pios_tcp_dev *tcp_dev = find_tcp_dev_by_id(tcp_id);
-	
+
 	PIOS_Assert(tcp_dev);
-	
+
 	/*
 	 * Order is important in these assignments since ISR uses _cb
 	 * field to determine if it's ok to dereference _cb and _context
@@ -281,9 +647,9 @@ static void PIOS_TCP_RegisterRxCallback(uintptr_t tcp_id, pios_com_callback rx_i
 static void PIOS_TCP_RegisterTxCallback(uintptr_t tcp_id, pios_com_callback tx_out_cb, uintptr_t context)
 {
 	pios_tcp_dev *tcp_dev = find_tcp_dev_by_id(tcp_id);
-	
+
 	PIOS_Assert(tcp_dev);
-	
+
 	/*
 	 * Order is important in these assignments since ISR uses _cb
 	 * field to determine if it's ok to dereference _cb and _context
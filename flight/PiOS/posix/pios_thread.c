@@ -29,6 +29,7 @@
 
 #include <pios.h>
 #include <pios_thread.h>
+#include <pios_swarm.h>
 
 struct pios_thread
 {
@@ -100,19 +101,7 @@ void PIOS_Thread_Delete(struct pios_thread *threadp)
 
 uint32_t PIOS_Thread_Systime(void)
 {
-	struct timespec monotime;
-
-	clock_gettime(CLOCK_MONOTONIC, &monotime);
-
-	uint32_t t = monotime.tv_sec * 1000 + monotime.tv_nsec / 1000000;
-
-	static uint32_t base = 0;
-
-	if (!base) {
-		base = t;
-	}
-
-	return t - base;
+	return PIOS_SWARM_GetTime_us() / 1000;
 }
 
 void PIOS_Thread_Sleep(uint32_t time_ms)
@@ -123,7 +112,16 @@ void PIOS_Thread_Sleep(uint32_t time_ms)
 		}
 	}
 
-	usleep(1000 * time_ms);
+	uint64_t ns = PIOS_SWARM_Real_ns((uint64_t) time_ms * 1000000);
+
+	struct timespec wait, rest;
+
+	wait.tv_sec = ns / 1000000000;
+	wait.tv_nsec = ns % 1000000000;
+
+	while (nanosleep(&wait, &rest)) {
+		wait = rest;
+	}
 }
 
 void PIOS_Thread_Sleep_Until(uint32_t *previous_ms, uint32_t increment_ms)
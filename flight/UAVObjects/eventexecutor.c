@@ -0,0 +1,188 @@
+/**
+ ******************************************************************************
+ * @addtogroup UAVObjects UAVObject set
+ * @{
+ * @addtogroup EventExecutor Shared stack event executor
+ * @{
+ *
+ * @file       eventexecutor.c
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Runs low priority module work on the event dispatcher.
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "openpilot.h"
+#include "eventexecutor.h"
+#include "eventdispatcher.h"
+
+#if defined(PIOS_INCLUDE_EVENTEXECUTOR)
+
+// Private types
+struct executor_job {
+	EventExecutorHandler handler;
+	void *ctx;
+
+	uint16_t period_ms;
+	bool scheduled;		// known to the dispatcher
+	bool due_known;
+	uint32_t due_ms;
+
+	struct event_executor_stats stats;
+};
+
+// Private variables
+static struct executor_job jobs[EVENTEXECUTOR_MAX_JOBS];
+
+// Private functions
+static void runJob(UAVObjEvent *ev, void *ctx, void *obj, int len);
+
+/**
+ * Dispatcher callback, on the system task.  The event's instance id is
+ * the job; that also keeps the jobs' registrations distinct.
+ */
+static void runJob(UAVObjEvent *ev, void *ctx, void *obj, int len)
+{
+	(void) ctx; (void) obj; (void) len;
+
+	if (ev->instId >= EVENTEXECUTOR_MAX_JOBS) {
+		return;
+	}
+
+	struct executor_job *job = &jobs[ev->instId];
+
+	if (!job->handler || !job->period_ms) {
+		return;
+	}
+
+	uint32_t now = PIOS_Thread_Systime();
+	uint32_t start = PIOS_DELAY_GetRaw();
+
+	/* The dispatcher randomizes the first deadline, so lateness is
+	 * measured from the first run on, on the same grid it uses. */
+	if (job->due_known) {
+		uint32_t late_ms = now - job->due_ms;
+
+		if (late_ms * 1000 > job->stats.max_latency_us) {
+			job->stats.max_latency_us = late_ms * 1000;
+		}
+
+		job->due_ms = now + job->period_ms - late_ms % job->period_ms;
+	} else {
+		job->due_ms = now + job->period_ms;
+		job->due_known = true;
+	}
+
+	job->handler(ev, job->ctx);
+
+	uint32_t run_us = PIOS_DELAY_DiffuS(start);
+
+	job->stats.runs++;
+
+	if (run_us > job->stats.max_run_us) {
+		job->stats.max_run_us = run_us;
+	}
+}
+
+int32_t EventExecutorRegister(uint8_t job_id, EventExecutorHandler handler,
+		void *ctx, uint16_t stack_bytes, uint16_t state_bytes)
+{
+	if ((job_id >= EVENTEXECUTOR_MAX_JOBS) || !handler ||
+			jobs[job_id].handler) {
+		return -1;
+	}
+
+	/* It would run on the system task's stack, which only has this much
+	 * spare for it */
+	if (stack_bytes > PIOS_EVENTEXECUTOR_STACK_HEADROOM) {
+		return -1;
+	}
+
+	struct executor_job *job = &jobs[job_id];
+
+	job->ctx = ctx;
+	job->stats.stack_bytes = stack_bytes;
+	job->stats.state_bytes = state_bytes;
+	job->handler = handler;
+
+	return 0;
+}
+
+int32_t EventExecutorSetPeriod(uint8_t job_id, uint16_t period_ms)
+{
+	if ((job_id >= EVENTEXECUTOR_MAX_JOBS) || !jobs[job_id].handler) {
+		return -1;
+	}
+
+	struct executor_job *job = &jobs[job_id];
+
+	UAVObjEvent ev = {
+		.obj = NULL,
+		.instId = job_id,
+		.event = EV_NONE,
+	};
+
+	job->period_ms = period_ms;
+	job->due_known = false;
+
+	if (job->scheduled) {
+		return EventPeriodicCallbackUpdate(&ev, runJob, period_ms);
+	}
+
+	if (EventPeriodicCallbackCreate(&ev, runJob, period_ms)) {
+		return -1;
+	}
+
+	job->scheduled = true;
+
+	return 0;
+}
+
+int32_t EventExecutorGetStats(uint8_t job_id,
+		struct event_executor_stats *stats)
+{
+	if ((job_id >= EVENTEXECUTOR_MAX_JOBS) || !jobs[job_id].handler) {
+		return -1;
+	}
+
+	*stats = jobs[job_id].stats;
+
+	return 0;
+}
+
+int32_t EventExecutorGetRAMSaved(void)
+{
+	int32_t saved = 0;
+
+	for (int i = 0; i < EVENTEXECUTOR_MAX_JOBS; i++) {
+		if (jobs[i].handler) {
+			saved += jobs[i].stats.stack_bytes;
+			saved -= jobs[i].stats.state_bytes;
+		}
+	}
+
+	saved -= PIOS_EVENTEXECUTOR_STACK_HEADROOM;
+
+	return saved;
+}
+
+#endif /* PIOS_INCLUDE_EVENTEXECUTOR */
+
+/**
+ * @}
+ * @}
+ */
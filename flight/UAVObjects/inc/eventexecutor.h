@@ -0,0 +1,104 @@
+/**
+ ******************************************************************************
+ * @addtogroup UAVObjects UAVObject set
+ * @{
+ * @addtogroup EventExecutor Shared stack event executor
+ * @{
+ *
+ * @file       eventexecutor.h
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Runs low priority module work on the event dispatcher.
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef EVENTEXECUTOR_H
+#define EVENTEXECUTOR_H
+
+#include "uavobjectmanager.h"
+
+/*
+ * Instead of a thread and stack of their own, low priority modules can
+ * register a handler that runs to completion as a periodic callback of the
+ * event dispatcher, on the system task's stack.  Handlers must not block;
+ * they share the thread with every other periodic callback, so one that
+ * sleeps delays them all.
+ *
+ * Jobs are identified by their element in EventExecutorStatus, like tasks
+ * are in TaskInfo.
+ */
+
+#define EVENTEXECUTOR_MAX_JOBS 8
+
+/*
+ * The system task's stack grows by this much when the executor is on.
+ * Jobs run one at a time, so it only has to hold the deepest of them: the
+ * largest stack any converted module had as a task, which is the MAVLink
+ * bridge's 696 bytes.  Registering a job that asked for more fails, and
+ * systemmod raises the stack overflow alarm if the system task runs low.
+ */
+#ifndef PIOS_EVENTEXECUTOR_STACK_HEADROOM
+#define PIOS_EVENTEXECUTOR_STACK_HEADROOM 704
+#endif
+
+/**
+ * Called with the dispatcher's event for the job, whose instId is the job.
+ */
+typedef void (*EventExecutorHandler)(const UAVObjEvent *ev, void *ctx);
+
+struct event_executor_stats {
+	uint32_t runs;
+	uint32_t max_latency_us;	/* deadline to start of run */
+	uint32_t max_run_us;
+	uint16_t stack_bytes;		/* the stack the job would need as a task */
+	uint16_t state_bytes;		/* task locals the job keeps in statics */
+};
+
+/**
+ * Adds a job.
+ * @param[in] job_id the job's element in EventExecutorStatus
+ * @param[in] stack_bytes the stack the module needs as its own task; no
+ * more than PIOS_EVENTEXECUTOR_STACK_HEADROOM
+ * @param[in] state_bytes what the module keeps in statics only because it
+ * runs as a job rather than a task
+ * @returns 0 on success, -1 if the job can't be added or needs more
+ * stack than the system task has spare
+ */
+int32_t EventExecutorRegister(uint8_t job_id, EventExecutorHandler handler,
+		void *ctx, uint16_t stack_bytes, uint16_t state_bytes);
+
+/**
+ * Runs the job every period_ms; 0 stops periodic runs.
+ */
+int32_t EventExecutorSetPeriod(uint8_t job_id, uint16_t period_ms);
+
+int32_t EventExecutorGetStats(uint8_t job_id,
+		struct event_executor_stats *stats);
+
+/**
+ * Memory saved by running the registered jobs on the dispatcher rather
+ * than as tasks: their stacks, less the state they moved into statics and
+ * the system task's extra stack.  Negative if it costs more than it saves.
+ */
+int32_t EventExecutorGetRAMSaved(void);
+
+#endif /* EVENTEXECUTOR_H */
+
+/**
+ * @}
+ * @}
+ */
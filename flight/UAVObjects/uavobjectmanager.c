@@ -80,11 +80,14 @@ struct ObjectEventEntryThrottled {
 /*
   MetaInstance   == [UAVOBase [UAVObjMetadata]]
   SingleInstance == [UAVOBase [UAVOData [InstanceData]]]
-  MultiInstance  == [UAVOBase [UAVOData [NumInstances [InstanceData0 [next]]]]
-                                                  ____________________/
-                                                  \-->[InstanceData1 [next]]
-                                                  _________...________/
-                                                  \-->[InstanceDataN [next]]
+  MultiInstance  == [UAVOBase [UAVOData [NumInstances [chunks [InstanceData0]]]]]
+                                                  ______/
+                                                  \-->[next [InstanceData1 .. InstanceDataK]]
+                                                  ______/
+                                                  \-->[next [InstanceDataK+1 .. InstanceDataN]]
+
+  Instances past the first are stored contiguously in chunks, each sized
+  from the maxinstances hint in the object definition.
  */
 
 /*
@@ -135,28 +138,38 @@ struct UAVOSingle {
 	 */
 } __attribute__((packed));
 
-/* Part of a linked list of instances chained off of a multi instance UAVO. */
-struct UAVOMultiInst {
-	struct UAVOMultiInst * next;
-	uint8_t                instance[];
-	/* 
-	 * Additional space will be malloc'd here to hold the
-	 * the data for this instance.
+/* Block of instances chained off of a multi instance UAVO. */
+struct UAVOMultiChunk {
+	struct UAVOMultiChunk * next;
+	uint16_t                num_used;
+	uint16_t                capacity;
+	uint8_t                 instances[] __attribute__((aligned(4)));
+	/*
+	 * Additional space will be malloc'd here to hold the data for
+	 * capacity instances, each InstanceStride() bytes apart.
 	 */
-} __attribute__((packed));
+};
 
 /* Augmented type for Multi Instance Data UAVO */
 struct UAVOMulti {
 	struct UAVOData        uavo;
 
 	uint16_t               num_instances;
-	struct UAVOMultiInst   instance0;
+	uint16_t               chunk_capacity;
+	struct UAVOMultiChunk * chunks;
+	uint8_t                instance0[];
 	/*
 	 * Additional space will be malloc'd here to hold the
 	 * the data for instance 0.
 	 */
 } __attribute__((packed));
 
+/* Chunk size for multi instance objects without a maxinstances hint */
+#define UAVO_INSTANCE_CHUNK_DEFAULT 4
+
+/* Event entries are carved out of blocks this many at a time */
+#define UAVO_EVENT_SLAB_ENTRIES 8
+
 /** all information about a metaobject are hardcoded constants **/
 #define MetaNumBytes sizeof(UAVObjMetadata)
 
@@ -170,7 +183,7 @@ struct UAVOMulti {
 
 /** all information about instances are dependant on object type **/
 #define ObjSingleInstanceDataOffset(obj) ((void*)(&(( (struct UAVOSingle*)obj )->instance0)))
-#define InstanceDataOffset(inst) ((void*)&(( (struct UAVOMultiInst*)inst )->instance))
+#define InstanceStride(obj) (((obj)->instance_size + 3) & ~3)
 #define InstanceData(instance) (void*)instance
 
 // Private functions
@@ -221,7 +234,7 @@ int32_t UAVObjInitialize()
 	events_unused_throttled = NULL;
 
 	// Allocate the stack used for callbacks.
-	cb_stack = PIOS_malloc_no_dma(UAVO_CB_STACK_SIZE);
+	cb_stack = PIOS_malloc_no_dma_tagged(UAVO_CB_STACK_SIZE, PIOS_HEAP_TAG_UAVOBJ);
 
 	PIOS_Assert(cb_stack);
 
@@ -286,7 +299,8 @@ static struct UAVOData * UAVObjAllocSingle(uint32_t num_bytes)
 	uint32_t object_size = sizeof(struct UAVOSingle) + num_bytes;
 
 	/* Allocate the object from the heap */
-	struct UAVOSingle * uavo_single = (struct UAVOSingle *) PIOS_malloc_no_dma(object_size);
+	struct UAVOSingle * uavo_single = (struct UAVOSingle *)
+		PIOS_malloc_no_dma_tagged(object_size, PIOS_HEAP_TAG_UAVOBJ);
 	if (!uavo_single)
 		return (NULL);
 
@@ -303,13 +317,15 @@ static struct UAVOData * UAVObjAllocSingle(uint32_t num_bytes)
 	return (&(uavo_single->uavo));
 }
 
-static struct UAVOData * UAVObjAllocMulti(uint32_t num_bytes)
+static struct UAVOData * UAVObjAllocMulti(uint32_t num_bytes,
+		uint16_t max_instances)
 {
 	/* Compute the complete size of the object, including the data for a single embedded instance */
 	uint32_t object_size = sizeof(struct UAVOMulti) + num_bytes;
 
 	/* Allocate the object from the heap */
-	struct UAVOMulti * uavo_multi = (struct UAVOMulti *) PIOS_malloc_no_dma(object_size);
+	struct UAVOMulti * uavo_multi = (struct UAVOMulti *)
+		PIOS_malloc_no_dma_tagged(object_size, PIOS_HEAP_TAG_UAVOBJ);
 	if (!uavo_multi)
 		return (NULL);
 
@@ -319,12 +335,19 @@ static struct UAVOData * UAVObjAllocMulti(uint32_t num_bytes)
 	uavo_base->flags.isSingle = false;
 	uavo_base->next_event     = NULL;
 
-	/* Set up the type-specific part of the UAVO */
+	/* Set up the type-specific part of the UAVO.  Instance 0 is
+	 * embedded, so a chunk holds the rest of the expected instances. */
 	uavo_multi->num_instances = 1;
+	uavo_multi->chunks = NULL;
+
+	if (max_instances > 1) {
+		uavo_multi->chunk_capacity = max_instances - 1;
+	} else {
+		uavo_multi->chunk_capacity = UAVO_INSTANCE_CHUNK_DEFAULT;
+	}
 
 	/* Clear the instance data carried in the UAVO */
-	uavo_multi->instance0.next = NULL;
-	memset (&(uavo_multi->instance0.instance), 0, num_bytes);
+	memset (&(uavo_multi->instance0), 0, num_bytes);
 
 	/* Give back the generic UAVO part */
 	return (&(uavo_multi->uavo));
@@ -340,13 +363,15 @@ static struct UAVOData * UAVObjAllocMulti(uint32_t num_bytes)
  * \param[in] isSingleInstance Is this a single instance or multi-instance object
  * \param[in] isSettings Is this a settings object
  * \param[in] numBytes Number of bytes of object data (for one instance)
+ * \param[in] maxInstances Expected number of instances of a multi instance
+ * object, used to size its storage; 0 if unknown
  * \param[in] initCb Default field and metadata initialization function
  * \return Object handle, or NULL if failure.
  * \return
  */
 UAVObjHandle UAVObjRegister(uint32_t id, 
 			int32_t isSingleInstance, int32_t isSettings,
-			uint32_t num_bytes,
+			uint32_t num_bytes, uint16_t maxInstances,
 			UAVObjInitializeCallback initCb)
 {
 	struct UAVOData * uavo_data = NULL;
@@ -361,7 +386,7 @@ UAVObjHandle UAVObjRegister(uint32_t id,
 	if (isSingleInstance) {
 		uavo_data = UAVObjAllocSingle (num_bytes);
 	} else {
-		uavo_data = UAVObjAllocMulti (num_bytes);
+		uavo_data = UAVObjAllocMulti (num_bytes, maxInstances);
 	}
 
 	if (!uavo_data)
@@ -558,6 +583,11 @@ uint16_t UAVObjCreateInstance(UAVObjHandle obj_handle, UAVObjInitializeCallback
 		initCb(obj_handle, instId);
 	}
 
+	// Settings instances come back from flash like the first one does
+	if (UAVObjIsSettings(obj_handle)) {
+		UAVObjLoad(obj_handle, instId);
+	}
+
 unlock_exit:
 	PIOS_Recursive_Mutex_Unlock(mutex);
 
@@ -899,10 +929,14 @@ int32_t UAVObjSaveSettings()
 	LL_FOREACH(uavo_list, obj) {
 		// Check if this is a settings object
 		if (UAVObjIsSettings(&obj->base)) {
+			uint16_t num_instances = UAVObjGetNumInstances(&obj->base);
+
 			// Save object
-			if (UAVObjSave(&obj->base, 0) ==
-				-1) {
-				goto unlock_exit;
+			for (uint16_t i = 0; i < num_instances; i++) {
+				if (UAVObjSave(&obj->base, i) ==
+					-1) {
+					goto unlock_exit;
+				}
 			}
 		}
 	}
@@ -931,10 +965,14 @@ int32_t UAVObjLoadSettings()
 	LL_FOREACH(uavo_list, obj) {
 		// Check if this is a settings object
 		if (UAVObjIsSettings(&obj->base)) {
+			uint16_t num_instances = UAVObjGetNumInstances(&obj->base);
+
 			// Load object
-			if (UAVObjLoad((UAVObjHandle) obj, 0) ==
-				-1) {
-				goto unlock_exit;
+			for (uint16_t i = 0; i < num_instances; i++) {
+				if (UAVObjLoad((UAVObjHandle) obj, i) ==
+					-1) {
+					goto unlock_exit;
+				}
 			}
 		}
 	}
@@ -963,10 +1001,14 @@ int32_t UAVObjDeleteSettings()
 	LL_FOREACH(uavo_list, obj) {
 		// Check if this is a settings object
 		if (UAVObjIsSettings(&obj->base)) {
+			uint16_t num_instances = UAVObjGetNumInstances(&obj->base);
+
 			// Save object
-			if (UAVObjDeleteById(UAVObjGetID(&obj->base), 0)
-				== -1) {
-				goto unlock_exit;
+			for (uint16_t i = 0; i < num_instances; i++) {
+				if (UAVObjDeleteById(UAVObjGetID(&obj->base), i)
+					== -1) {
+					goto unlock_exit;
+				}
 			}
 		}
 	}
@@ -1189,6 +1231,8 @@ int32_t UAVObjSetInstanceDataField(UAVObjHandle obj_handle, uint16_t instId, con
 	// Set data
 	memcpy(target + offset, dataIn, size);
 
+	PIOS_TRACE(PIOS_TRACE_UAVO_SET, UAVObjGetID(obj_handle));
+
 	// Fire event
 	sendEvent((struct UAVOBase *)obj_handle, instId, EV_UPDATED,
 		target, obj_len);
@@ -1498,6 +1542,34 @@ int8_t UAVObjReadOnly(UAVObjHandle obj_handle)
 	return -1;
 }
 
+/**
+ * Allocate a block of event entries and put them on a free list.
+ * Must be called with the mutex held.
+ * \param[in] unused The free list to fill
+ * \param[in] entrySize Size of one entry
+ * \return 0 if success or -1 if failure
+ */
+static int32_t refillEvents(struct ObjectEventEntry **unused, int entrySize)
+{
+	/* Keep every entry pointer aligned */
+	entrySize = (entrySize + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+	uint8_t *slab = PIOS_malloc_no_dma_tagged(
+			entrySize * UAVO_EVENT_SLAB_ENTRIES, PIOS_HEAP_TAG_UAVOBJ);
+	if (!slab) {
+		return -1;
+	}
+
+	for (int i = 0; i < UAVO_EVENT_SLAB_ENTRIES; i++) {
+		struct ObjectEventEntry *entry =
+			(struct ObjectEventEntry *) (slab + i * entrySize);
+
+		LL_PREPEND(*unused, entry);
+	}
+
+	return 0;
+}
+
 /**
  * Connect an event queue to the object, if the queue is already connected then the event mask is only updated.
  * All events matching the event mask will be pushed to the event queue.
@@ -1851,7 +1923,9 @@ static int32_t sendEvent(struct UAVOBase * obj, uint16_t instId,
  */
 static InstanceHandle createInstance(struct UAVOData * obj, uint16_t instId)
 {
-	struct UAVOMultiInst *instEntry;
+	struct UAVOMulti *uavo_multi = (struct UAVOMulti *) obj;
+	struct UAVOMultiChunk *chunk;
+	void *instData;
 
 	/* Don't allow more than one instance for single instance objects */
 	if (UAVObjIsSingleInstance(&(obj->base))) {
@@ -1876,14 +1950,39 @@ static InstanceHandle createInstance(struct UAVOData * obj, uint16_t instId)
 		}
 	}
 
+	/* Find room in the last chunk, or start a new one */
+	chunk = uavo_multi->chunks;
+	while (chunk && chunk->next) {
+		chunk = chunk->next;
+	}
+
+	if (!chunk || chunk->num_used >= chunk->capacity) {
+		struct UAVOMultiChunk *newChunk = (struct UAVOMultiChunk *)
+			PIOS_malloc_no_dma_tagged(sizeof(struct UAVOMultiChunk) +
+				uavo_multi->chunk_capacity * InstanceStride(obj),
+				PIOS_HEAP_TAG_UAVOBJ);
+		if (!newChunk)
+			return NULL;
+
+		newChunk->next = NULL;
+		newChunk->num_used = 0;
+		newChunk->capacity = uavo_multi->chunk_capacity;
+
+		if (chunk) {
+			chunk->next = newChunk;
+		} else {
+			uavo_multi->chunks = newChunk;
+		}
+
+		chunk = newChunk;
+	}
+
 	/* Create the actual instance */
-	instEntry = (struct UAVOMultiInst *) PIOS_malloc_no_dma(sizeof(struct UAVOMultiInst)+obj->instance_size);
-	if (!instEntry)
-		return NULL;
-	memset(InstanceDataOffset(instEntry), 0, obj->instance_size);
-	LL_APPEND(( (struct UAVOMulti*)obj )->instance0.next, instEntry);
+	instData = &chunk->instances[chunk->num_used * InstanceStride(obj)];
+	memset(instData, 0, obj->instance_size);
 
-	( (struct UAVOMulti*)obj )->num_instances++;
+	chunk->num_used++;
+	uavo_multi->num_instances++;
 
 	// Fire event
 	UAVObjInstanceUpdated((UAVObjHandle) obj, instId);
@@ -1892,7 +1991,7 @@ static InstanceHandle createInstance(struct UAVOData * obj, uint16_t instId)
 	if (newUavObjInstanceCB) {
 		newUavObjInstanceCB(obj->id, UAVObjGetNumInstances(&obj->base));
 	}
-	return InstanceDataOffset(instEntry);
+	return instData;
 }
 
 /**
@@ -1926,14 +2025,19 @@ static InstanceHandle getInstance(struct UAVOData * obj, uint16_t instId)
 		if (instId >= uavo_multi->num_instances)
 			return NULL;
 
-		// Look for specified instance ID
-		uint16_t instance = 0;
-		struct UAVOMultiInst *instEntry;
-		LL_FOREACH(&(uavo_multi->instance0), instEntry) {
-			if (instance++ == instId) {
+		if (instId == 0)
+			return &(uavo_multi->instance0);
+
+		// Skip whole chunks until the one holding this instance
+		uint16_t index = instId - 1;
+		struct UAVOMultiChunk *chunk;
+		LL_FOREACH(uavo_multi->chunks, chunk) {
+			if (index < chunk->num_used) {
 				/* Found it */
-				return &(instEntry->instance);
+				return &chunk->instances[index * InstanceStride(obj)];
 			}
+
+			index -= chunk->num_used;
 		}
 		/* Instance was not found */
 		return NULL;
@@ -1985,8 +2089,11 @@ static int32_t connectObj(UAVObjHandle obj_handle, struct pios_queue *queue,
 				}
 				else {
 					// We are changing the callback from unthrottled to throttled,
-					// need to allocate a new event (not ideal, as it leaks memory)
+					// need a bigger entry; recycle the old one
 					LL_DELETE(obj->next_event, event);
+					PIOS_Recursive_Mutex_Lock(mutex, PIOS_MUTEX_TIMEOUT_MAX);
+					LL_PREPEND(events_unused, event);
+					PIOS_Recursive_Mutex_Unlock(mutex);
 					break;
 				}
 			}
@@ -2002,18 +2109,18 @@ static int32_t connectObj(UAVObjHandle obj_handle, struct pios_queue *queue,
 	}
 
 	PIOS_Recursive_Mutex_Lock(mutex, PIOS_MUTEX_TIMEOUT_MAX);
-	if (*unused != NULL) {
-		// We can re-use the memory of a previously disconnected event
-		event = *unused;
-		LL_DELETE(*unused, event);
-	}
-	else {
-		event =	(struct ObjectEventEntry *) PIOS_malloc_no_dma(mallocSize);
-		if (event == NULL) {
+	if (*unused == NULL) {
+		// Carve a fresh block of entries rather than paying heap
+		// overhead on each one
+		if (refillEvents(unused, mallocSize)) {
 			PIOS_Recursive_Mutex_Unlock(mutex);
 			return -1;
 		}
 	}
+
+	// Take a free entry, possibly from a previously disconnected event
+	event = *unused;
+	LL_DELETE(*unused, event);
 	PIOS_Recursive_Mutex_Unlock(mutex);
 
 	memset(event, 0, mallocSize);
@@ -54,6 +54,7 @@
 
 
 /* Flags that alter behaviors */
+#define PIOS_INCLUDE_EVENTEXECUTOR	/* Low priority modules run from the event dispatcher */
 //#define PIOS_TELEM_PRIORITY_QUEUE       /* Enable a priority queue in telemetry */
 #define AUTOTUNE_AVERAGING_DECIMATION 2
 
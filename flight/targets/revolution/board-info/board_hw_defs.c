@@ -1977,6 +1977,7 @@ static const struct pios_mpu_cfg pios_mpu_cfg = {
 	.exti_cfg           = &pios_exti_mpu_cfg,
 	.default_samplerate = 1000,
 	.orientation        = PIOS_MPU_TOP_180DEG,
+	.fifo_batch         = 2,
 };
 #endif /* PIOS_INCLUDE_MPU */
 
@@ -106,6 +106,20 @@ void PIOS_Board_Init(void) {
 		PIOS_DEBUG_Assert(0);
 	}
 
+#if defined(PIOS_INCLUDE_SPI_QUEUE)
+	/* The MPU and flash drivers find these and queue their transfers
+	 * by priority; the radio and OSD still claim the bus directly */
+	struct pios_spi_queue *spi_queue;
+
+	if (PIOS_SPI_Queue_Init(&spi_queue, pios_spi_gyro_id)) {
+		PIOS_DEBUG_Assert(0);
+	}
+
+	if (PIOS_SPI_Queue_Init(&spi_queue, pios_spi_telem_flash_id)) {
+		PIOS_DEBUG_Assert(0);
+	}
+#endif /* PIOS_INCLUDE_SPI_QUEUE */
+
 #if defined(PIOS_INCLUDE_FLASH)
 	/* Inititialize all flash drivers */
 	if (PIOS_Flash_Jedec_Init(&pios_external_flash_id, pios_spi_telem_flash_id, 1, &flash_m25p_cfg) != 0) {
@@ -45,6 +45,7 @@
 #define PIOS_INCLUDE_FLASH_JEDEC
 #define PIOS_INCLUDE_I2C
 #define PIOS_INCLUDE_SPI
+#define PIOS_INCLUDE_SPI_QUEUE
 #define PIOS_INCLUDE_FASTHEAP
 #define PIOS_INCLUDE_WS2811
 #define PIOS_INCLUDE_FRSKY_RSSI
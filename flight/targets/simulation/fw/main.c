@@ -37,6 +37,7 @@
 #include "uavobjectsinit.h"
 #include "systemmod.h"
 #include "pios_thread.h"
+#include "pios_swarm.h"
 
 /* Prototype of PIOS_Board_Init() function */
 extern void PIOS_Board_Init(void);
@@ -73,6 +74,9 @@ int main(int argc, char *argv[]) {
 	g_argc = argc;
 	g_argv = argv;
 
+	/* Forks the vehicles of a swarm; must come before any thread */
+	PIOS_SWARM_Start(argc, argv);
+
 	/* NOTE: Do NOT modify the following start-up sequence */
 	PIOS_heap_initialize_blocks();
 
@@ -120,6 +124,10 @@ void initTask(void *parameters)
 	/* create all modules thread */
 	MODULE_TASKCREATE_ALL;
 
+	/* After the modules' start functions, which reset some objects;
+	 * the physics plant holds still until this is done */
+	PIOS_SNAPSHOT_RestoreObjects();
+
 	printf("Initialization task completed\n");
 
 	/* terminate this task */
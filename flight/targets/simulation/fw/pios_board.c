@@ -58,9 +58,17 @@ const struct pios_tcp_cfg pios_tcp_telem_cfg = {
   .port = 9000,
 };
 
+/* MAVLink bridge output, e.g. for the standin's mavlink_rates */
+const struct pios_tcp_cfg pios_tcp_mavlink_cfg = {
+  .ip = "0.0.0.0",
+  .port = 9002,
+};
+
 #define PIOS_COM_TELEM_RF_RX_BUF_LEN 384
 #define PIOS_COM_TELEM_RF_TX_BUF_LEN 384
 #define PIOS_COM_GPS_RX_BUF_LEN 96
+#define PIOS_COM_MAVLINK_RX_BUF_LEN 64
+#define PIOS_COM_MAVLINK_TX_BUF_LEN 128
 
 /**
  * Simulation of the flash filesystem
@@ -141,6 +149,19 @@ void PIOS_Board_Init(void) {
 		PIOS_Assert(0);
 	}
 
+#if defined(PIOS_INCLUDE_MAVLINK)
+	uintptr_t pios_tcp_mavlink_id;
+	if (PIOS_TCP_Init(&pios_tcp_mavlink_id, &pios_tcp_mavlink_cfg)) {
+		PIOS_Assert(0);
+	}
+
+	if (PIOS_COM_Init(&pios_com_mavlink_id, &pios_tcp_com_driver, pios_tcp_mavlink_id,
+			PIOS_COM_MAVLINK_RX_BUF_LEN,
+			PIOS_COM_MAVLINK_TX_BUF_LEN)) {
+		PIOS_Assert(0);
+	}
+#endif	/* PIOS_INCLUDE_MAVLINK */
+
 #if defined(PIOS_INCLUDE_GCSRCVR)
 	GCSReceiverInitialize();
 	uintptr_t pios_gcsrcvr_id;
@@ -60,6 +60,7 @@ extern uintptr_t pios_com_debug_id;
 extern uintptr_t pios_com_openlog_id;
 extern uintptr_t pios_com_lighttelemetry_id;
 extern uintptr_t pios_com_msp_id;
+extern uintptr_t pios_com_mavlink_id;
 
 #define PIOS_COM_TELEM_RF                       (pios_com_telem_rf_id)
 #define PIOS_COM_TELEM_USB                      (pios_com_telem_usb_id)
@@ -68,6 +69,7 @@ extern uintptr_t pios_com_msp_id;
 #define PIOS_COM_DEBUG                          (pios_com_debug_id)
 #define PIOS_COM_OPENLOG                        (pios_com_openlog_id)
 #define PIOS_COM_LIGHTTELEMETRY                 (pios_com_lighttelemetry_id)
+#define PIOS_COM_MAVLINK                        (pios_com_mavlink_id)
 
 #define PIOS_GCSRCVR_TIMEOUT_MS 200
 
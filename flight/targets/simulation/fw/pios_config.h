@@ -43,6 +43,7 @@
 #define PIOS_INCLUDE_GPS_UBX_PARSER
 #define PIOS_INCLUDE_MSP_BRIDGE
 #define PIOS_INCLUDE_LIGHTTELEMETRY
+#define PIOS_INCLUDE_MAVLINK
 #define PIOS_INCLUDE_OPENLOG
 
 #define PIOS_INCLUDE_TCP
@@ -56,6 +57,8 @@
 #define PIOS_INCLUDE_LOGFS_SETTINGS
 #define PIOS_INCLUDE_RANGEFINDER
 #define PIOS_INCLUDE_INITCALL           /* Include init call structures */
+#define PIOS_INCLUDE_SNAPSHOT
+#define PIOS_INCLUDE_EVENTEXECUTOR
 
 #define PIOS_RCVR_MAX_CHANNELS			12
 #define PIOS_RCVR_MAX_DEVS              3
@@ -91,6 +94,7 @@
 
 /* Hardware support on Linux only */
 #ifdef __linux__
+#define PIOS_INCLUDE_IOLOOP
 #define PIOS_INCLUDE_SERIAL
 #define PIOS_INCLUDE_I2C
 #define PIOS_INCLUDE_SPI
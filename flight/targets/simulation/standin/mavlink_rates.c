@@ -0,0 +1,402 @@
+/**
+ ******************************************************************************
+ *
+ * @file       mavlink_rates.c
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Stand-in ground station for the MAVLink bridge.  Connects to
+ *             the posix flight build's MAVLink port, optionally asks for
+ *             different stream rates, and reports the rates achieved.
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "mavlink.h"
+
+#define RATES_SYSTEM_ID 255
+#define RATES_COMPONENT_ID MAV_COMP_ID_MISSIONPLANNER
+
+/* Same as the bridge's, which predates the dedicated message */
+#ifndef MAV_CMD_SET_MESSAGE_INTERVAL
+#define MAV_CMD_SET_MESSAGE_INTERVAL 511
+#endif
+
+#define RATES_MAX_REQUESTS 16
+
+struct request {
+	bool is_stream;
+	uint8_t id;
+	int32_t value;		/* Hz for streams, ms for messages */
+};
+
+struct rates {
+	int sock;
+
+	struct request requests[RATES_MAX_REQUESTS];
+	int num_requests;
+
+	double window;
+	double duration;
+
+	/* Per window, by message id */
+	uint32_t count[256];
+	uint32_t bytes[256];
+	uint32_t lost;
+	uint32_t bad_crc;
+
+	bool have_seq;
+	uint8_t last_seq;
+
+	mavlink_message_t msg;
+	mavlink_status_t status;
+};
+
+static void usage(const char *cmd)
+{
+	fprintf(stderr,
+		"usage: %s [-a host:port] [-w seconds] [-t seconds]\n"
+		"\t\t[-s stream:hz]... [-i msgid:ms]...\n"
+		"\t-a addr\tFlight side MAVLink port (default 127.0.0.1:9002)\n"
+		"\t-w secs\tReport every this many seconds (default 5)\n"
+		"\t-t secs\tStop after this long\n"
+		"\t-s s:hz\tREQUEST_DATA_STREAM; 0 Hz for defaults, -1 stops\n"
+		"\t-i id:ms\tSET_MESSAGE_INTERVAL; -1 stops, 0 restores default\n"
+		"\n"
+		"UAVOMavlinkBridge must be enabled in ModuleSettings.\n",
+		cmd);
+
+	exit(1);
+}
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static const char *msg_name(uint8_t msgid)
+{
+	switch (msgid) {
+	case MAVLINK_MSG_ID_HEARTBEAT:
+		return "HEARTBEAT";
+	case MAVLINK_MSG_ID_SYS_STATUS:
+		return "SYS_STATUS";
+	case MAVLINK_MSG_ID_RC_CHANNELS_RAW:
+		return "RC_CHANNELS_RAW";
+	case MAVLINK_MSG_ID_GPS_RAW_INT:
+		return "GPS_RAW_INT";
+	case MAVLINK_MSG_ID_GPS_GLOBAL_ORIGIN:
+		return "GPS_GLOBAL_ORIGIN";
+	case MAVLINK_MSG_ID_ATTITUDE:
+		return "ATTITUDE";
+	case MAVLINK_MSG_ID_VFR_HUD:
+		return "VFR_HUD";
+	case MAVLINK_MSG_ID_COMMAND_ACK:
+		return "COMMAND_ACK";
+	default:
+		return "?";
+	}
+}
+
+static int parse_request(struct rates *r, bool is_stream, const char *arg)
+{
+	char *sep;
+	long id = strtol(arg, &sep, 0);
+
+	if ((*sep != ':') || (id < 0) || (id > 255) ||
+			(r->num_requests >= RATES_MAX_REQUESTS)) {
+		return -1;
+	}
+
+	struct request *req = &r->requests[r->num_requests++];
+
+	req->is_stream = is_stream;
+	req->id = id;
+	req->value = strtol(sep + 1, NULL, 0);
+
+	return 0;
+}
+
+static int open_socket(struct rates *r, const char *addr)
+{
+	char host[128];
+
+	strncpy(host, addr, sizeof(host));
+	host[sizeof(host) - 1] = 0;
+
+	char *port = strrchr(host, ':');
+	if (port == NULL) {
+		fprintf(stderr, "address must be host:port\n");
+		return -1;
+	}
+
+	*port++ = 0;
+
+	struct addrinfo hints = {
+		.ai_family = AF_INET,
+		.ai_socktype = SOCK_STREAM,
+	};
+	struct addrinfo *res;
+
+	int err = getaddrinfo(host, port, &hints, &res);
+	if (err) {
+		fprintf(stderr, "%s: %s\n", host, gai_strerror(err));
+		return -1;
+	}
+
+	/* Wait for the flight side to come up */
+	while (true) {
+		r->sock = socket(AF_INET, SOCK_STREAM, 0);
+		if (r->sock < 0) {
+			perror("socket");
+			break;
+		}
+
+		if (connect(r->sock, res->ai_addr, res->ai_addrlen) == 0) {
+			break;
+		}
+
+		if (errno != ECONNREFUSED) {
+			perror("connect");
+			close(r->sock);
+			r->sock = -1;
+			break;
+		}
+
+		close(r->sock);
+		sleep(1);
+	}
+
+	freeaddrinfo(res);
+
+	return (r->sock < 0) ? -1 : 0;
+}
+
+static int send_message(struct rates *r, const mavlink_message_t *msg)
+{
+	uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+	uint16_t len = mavlink_msg_to_send_buffer(buf, msg);
+
+	if (send(r->sock, buf, len, 0) != len) {
+		perror("send");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int send_requests(struct rates *r)
+{
+	for (int i = 0; i < r->num_requests; i++) {
+		const struct request *req = &r->requests[i];
+		mavlink_message_t msg;
+
+		if (req->is_stream) {
+			printf("requesting stream %u at %d Hz\n",
+					req->id, (int) req->value);
+
+			mavlink_msg_request_data_stream_pack(RATES_SYSTEM_ID,
+					RATES_COMPONENT_ID, &msg, 0, 0, req->id,
+					(req->value > 0) ? req->value : 0,
+					req->value >= 0);
+		} else {
+			printf("requesting %s every %d ms\n",
+					msg_name(req->id), (int) req->value);
+
+			/* The interval goes in microseconds; negative stops */
+			float interval = (req->value > 0) ?
+				req->value * 1000.0f : req->value;
+
+			mavlink_msg_command_long_pack(RATES_SYSTEM_ID,
+					RATES_COMPONENT_ID, &msg, 0, 0,
+					MAV_CMD_SET_MESSAGE_INTERVAL, 0,
+					req->id, interval, 0, 0, 0, 0, 0);
+		}
+
+		if (send_message(r, &msg)) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void handle_message(struct rates *r, const mavlink_message_t *msg)
+{
+	r->count[msg->msgid]++;
+	r->bytes[msg->msgid] += MAVLINK_NUM_NON_PAYLOAD_BYTES + msg->len;
+
+	/* A gap in the sequence is a write the port had no room for */
+	if (r->have_seq) {
+		r->lost += (uint8_t) (msg->seq - r->last_seq - 1);
+	}
+
+	r->last_seq = msg->seq;
+	r->have_seq = true;
+
+	if (msg->msgid == MAVLINK_MSG_ID_COMMAND_ACK) {
+		printf("command %u: result %u\n",
+				mavlink_msg_command_ack_get_command(msg),
+				mavlink_msg_command_ack_get_result(msg));
+	}
+}
+
+static void report(struct rates *r, double elapsed)
+{
+	uint32_t total_bytes = 0;
+
+	printf("%-18s %6s %8s %8s\n", "message", "id", "Hz", "bytes/s");
+
+	for (int i = 0; i < 256; i++) {
+		if (!r->count[i]) {
+			continue;
+		}
+
+		printf("%-18s %6d %8.2f %8.1f\n", msg_name(i), i,
+				r->count[i] / elapsed, r->bytes[i] / elapsed);
+
+		total_bytes += r->bytes[i];
+	}
+
+	printf("%-18s %6s %8s %8.1f   %u lost, %u bad crc\n\n", "total", "",
+			"", total_bytes / elapsed, (unsigned int) r->lost,
+			(unsigned int) r->bad_crc);
+
+	memset(r->count, 0, sizeof(r->count));
+	memset(r->bytes, 0, sizeof(r->bytes));
+	r->lost = 0;
+	r->bad_crc = 0;
+
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	static struct rates r;
+
+	const char *addr = "127.0.0.1:9002";
+
+	r.window = 5;
+
+	int opt;
+
+	while ((opt = getopt(argc, argv, "a:w:t:s:i:")) != -1) {
+		switch (opt) {
+			case 'a':
+				addr = optarg;
+				break;
+			case 'w':
+				r.window = atof(optarg);
+				break;
+			case 't':
+				r.duration = atof(optarg);
+				break;
+			case 's':
+				if (parse_request(&r, true, optarg)) {
+					usage(argv[0]);
+				}
+				break;
+			case 'i':
+				if (parse_request(&r, false, optarg)) {
+					usage(argv[0]);
+				}
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+
+	if (r.window <= 0) {
+		usage(argv[0]);
+	}
+
+	if (open_socket(&r, addr)) {
+		return 1;
+	}
+
+	printf("listening to %s\n", addr);
+
+	if (send_requests(&r)) {
+		return 1;
+	}
+
+	double start = now_s();
+	double window_start = start;
+
+	while ((r.duration <= 0) || (now_s() - start < r.duration)) {
+		struct pollfd pfd = { .fd = r.sock, .events = POLLIN };
+
+		if (poll(&pfd, 1, 100) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			perror("poll");
+			return 1;
+		}
+
+		if (pfd.revents) {
+			uint8_t buf[256];
+			ssize_t len = recv(r.sock, buf, sizeof(buf), 0);
+
+			if (len <= 0) {
+				if (len < 0) {
+					perror("recv");
+				} else {
+					fprintf(stderr, "flight side closed\n");
+				}
+				return 1;
+			}
+
+			for (ssize_t i = 0; i < len; i++) {
+				if (mavlink_parse_char(MAVLINK_COMM_0, buf[i],
+						&r.msg, &r.status)) {
+					handle_message(&r, &r.msg);
+				}
+
+				/* The parser only reports errors per call */
+				r.bad_crc += r.status.packet_rx_drop_count;
+			}
+		}
+
+		double now = now_s();
+
+		if (now - window_start >= r.window) {
+			report(&r, now - window_start);
+			window_start = now;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,502 @@
+/**
+ ******************************************************************************
+ *
+ * @file       simbridge_standin.c
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @brief      Stand-in simulator for the simbridge protocol.  Runs the
+ *             physsim plant as a separate process and drives the posix
+ *             flight build with batched sensor frames.
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "physsim.h"
+#include "simbridge_messages.h"
+
+#define STANDIN_MAG_RATE 75
+#define STANDIN_BARO_RATE 50
+#define STANDIN_GPS_RATE 10
+
+/* How long to wait for the flight side to answer a batch.  If it doesn't
+ * (e.g. it is still booting) the plant carries on with the old outputs. */
+#define STANDIN_REPLY_TIMEOUT_MS 50
+
+/* Where the GPS puts the origin of the plant's NED frame */
+#define STANDIN_HOME_LAT 47.2583
+#define STANDIN_HOME_LON 11.3341
+#define STANDIN_HOME_ALT 580.0
+#define STANDIN_M_PER_DEG 111319.5
+
+struct standin {
+	int sock;
+
+	struct sockaddr_storage dest;
+	socklen_t dest_len;
+
+	char local_path[108];
+
+	struct physsim_params params;
+	struct physsim_state state;
+	float outputs[SIMBRIDGE_MAX_CHANNELS];
+
+	uint32_t rate_hz;
+	uint32_t batch;
+	double duration;
+	bool realtime;
+
+	uint64_t time_us;
+	uint64_t tick;
+	uint32_t seq;
+
+	/* Statistics */
+	uint32_t replies;
+	uint32_t timeouts;
+	double rtt_sum;
+	double rtt_max;
+};
+
+static void usage(const char *cmd)
+{
+	fprintf(stderr,
+		"usage: %s [-a addr] [-m quad|plane] [-r rate] [-b batch]\n"
+		"\t\t[-t seconds] [-f]\n"
+		"\t-a addr\tFlight side address: unix:path or host:port\n"
+		"\t\t(default unix:/tmp/dronin-simbridge)\n"
+		"\t-m model\tPlant model (default quad)\n"
+		"\t-r rate\tIMU rate in Hz, 100-8000 (default 1000)\n"
+		"\t-b batch\tIMU samples per datagram (default rate/1000)\n"
+		"\t-t secs\tStop after this much simulated time\n"
+		"\t-f\tFree-run as fast as the flight side answers\n",
+		cmd);
+
+	exit(1);
+}
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int open_socket(struct standin *s, const char *addr)
+{
+	if (!strncmp(addr, "unix:", 5)) {
+		struct sockaddr_un *dest = (struct sockaddr_un *) &s->dest;
+		const char *path = addr + 5;
+
+		if (strlen(path) + sizeof(".standin") > sizeof(dest->sun_path)) {
+			fprintf(stderr, "socket path too long\n");
+			return -1;
+		}
+
+		dest->sun_family = AF_UNIX;
+		strcpy(dest->sun_path, path);
+		s->dest_len = sizeof(*dest);
+
+		s->sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+		if (s->sock < 0) {
+			perror("socket");
+			return -1;
+		}
+
+		/* Datagram unix sockets need a name of their own to get
+		 * replies */
+		struct sockaddr_un local = { .sun_family = AF_UNIX };
+
+		snprintf(s->local_path, sizeof(s->local_path), "%s.standin",
+				path);
+		strcpy(local.sun_path, s->local_path);
+		unlink(s->local_path);
+
+		if (bind(s->sock, (struct sockaddr *) &local,
+					sizeof(local)) < 0) {
+			perror("bind");
+			return -1;
+		}
+
+		return 0;
+	}
+
+	char host[128];
+
+	strncpy(host, addr, sizeof(host));
+	host[sizeof(host) - 1] = 0;
+
+	char *port = strrchr(host, ':');
+	if (port == NULL) {
+		fprintf(stderr, "address must be unix:path or host:port\n");
+		return -1;
+	}
+
+	*port++ = 0;
+
+	struct addrinfo hints = {
+		.ai_family = AF_INET,
+		.ai_socktype = SOCK_DGRAM,
+	};
+	struct addrinfo *res;
+
+	int err = getaddrinfo(host, port, &hints, &res);
+	if (err) {
+		fprintf(stderr, "%s: %s\n", host, gai_strerror(err));
+		return -1;
+	}
+
+	memcpy(&s->dest, res->ai_addr, res->ai_addrlen);
+	s->dest_len = res->ai_addrlen;
+
+	freeaddrinfo(res);
+
+	s->sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (s->sock < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	return 0;
+}
+
+static struct simbridge_sample *add_sample(struct simbridge_sensors *msg,
+		uint64_t time_us, uint8_t type)
+{
+	struct simbridge_sample *sample = &msg->samples[msg->hdr.count++];
+
+	memset(sample, 0, sizeof(*sample));
+
+	sample->time_us = time_us;
+	sample->type = type;
+
+	return sample;
+}
+
+static void add_vec(struct simbridge_sensors *msg, uint64_t time_us,
+		uint8_t type, const float v[3])
+{
+	struct simbridge_sample *sample = add_sample(msg, time_us, type);
+
+	sample->data.vec.x = v[0];
+	sample->data.vec.y = v[1];
+	sample->data.vec.z = v[2];
+	sample->data.vec.temperature = 25;
+}
+
+/**
+ * Steps the plant through one batch worth of IMU periods and fills out
+ * the sensor datagram.
+ */
+static void build_batch(struct standin *s, struct simbridge_sensors *msg)
+{
+	float dT = 1.0f / s->rate_hz;
+
+	uint32_t mag_div = s->rate_hz / STANDIN_MAG_RATE;
+	uint32_t baro_div = s->rate_hz / STANDIN_BARO_RATE;
+	uint32_t gps_div = s->rate_hz / STANDIN_GPS_RATE;
+
+	simbridge_fill_hdr(&msg->hdr, SIMBRIDGE_MSG_SENSORS, 0, s->seq++);
+
+	for (uint32_t i = 0; i < s->batch; i++) {
+		float v[3];
+
+		physsim_step(&s->params, &s->state, s->outputs,
+				SIMBRIDGE_MAX_CHANNELS, dT);
+
+		s->time_us = (uint64_t) (s->tick + 1) * 1000000 / s->rate_hz;
+
+		/* Accel ahead of gyro, as the sensors task expects */
+		physsim_sense_accel(&s->params, &s->state, v);
+		add_vec(msg, s->time_us, SIMBRIDGE_SAMPLE_ACCEL, v);
+
+		physsim_sense_gyro(&s->params, &s->state, v);
+		add_vec(msg, s->time_us, SIMBRIDGE_SAMPLE_GYRO, v);
+
+		if ((s->tick % mag_div) == 0) {
+			physsim_sense_mag(&s->params, &s->state, v);
+			add_vec(msg, s->time_us, SIMBRIDGE_SAMPLE_MAG, v);
+		}
+
+		if ((s->tick % baro_div) == 0) {
+			struct simbridge_sample *sample = add_sample(msg,
+					s->time_us, SIMBRIDGE_SAMPLE_BARO);
+			float pressure;
+
+			sample->data.baro.altitude = physsim_sense_baro(
+					&s->params, &s->state, &pressure);
+			sample->data.baro.pressure = pressure;
+			sample->data.baro.temperature = 25;
+		}
+
+		if ((s->tick % gps_div) == 0) {
+			struct simbridge_sample *sample = add_sample(msg,
+					s->time_us, SIMBRIDGE_SAMPLE_GPS);
+
+			double lat = STANDIN_HOME_LAT +
+				s->state.pos[0] / STANDIN_M_PER_DEG;
+			double lon = STANDIN_HOME_LON +
+				s->state.pos[1] / (STANDIN_M_PER_DEG *
+					cos(STANDIN_HOME_LAT * M_PI / 180));
+
+			sample->data.gps.lat = lat * 1e7;
+			sample->data.gps.lon = lon * 1e7;
+			sample->data.gps.altitude = STANDIN_HOME_ALT -
+				s->state.pos[2];
+			sample->data.gps.vel[0] = s->state.vel[0];
+			sample->data.gps.vel[1] = s->state.vel[1];
+			sample->data.gps.vel[2] = s->state.vel[2];
+			sample->data.gps.fix = 3;	/* Fix3D */
+			sample->data.gps.satellites = 12;
+		}
+
+		s->tick++;
+	}
+}
+
+/**
+ * Turns the pulse widths in an actuator reply into normalized plant
+ * outputs: 0..1 for motors, -1..1 for fixed wing surfaces.
+ */
+static void apply_actuators(struct standin *s,
+		const struct simbridge_actuators *msg)
+{
+	for (int i = 0; i < msg->hdr.count; i++) {
+		const struct simbridge_channel *ch = &msg->channels[i];
+
+		float span = (float) ch->max - ch->min;
+
+		if (span == 0) {
+			s->outputs[i] = 0;
+			continue;
+		}
+
+		float frac = (ch->pulse_us - ch->min) / span;
+
+		if ((s->params.frame == PHYSSIM_FRAME_FIXEDWING) &&
+				(i != s->params.ch_throttle)) {
+			frac = frac * 2 - 1;
+		}
+
+		s->outputs[i] = frac;
+	}
+}
+
+/**
+ * Waits for the reply to the batch just sent.  Replies to older batches
+ * (which can turn up after a timeout) are applied but don't end the wait.
+ */
+static void wait_reply(struct standin *s, double sent_at)
+{
+	int timeout_ms = STANDIN_REPLY_TIMEOUT_MS;
+
+	while (true) {
+		struct pollfd pfd = { .fd = s->sock, .events = POLLIN };
+
+		int ret = poll(&pfd, 1, timeout_ms);
+
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			perror("poll");
+			exit(1);
+		}
+
+		if (ret == 0) {
+			s->timeouts++;
+			return;
+		}
+
+		struct simbridge_actuators msg;
+
+		ssize_t len = recv(s->sock, &msg, sizeof(msg), 0);
+
+		if (len < 0) {
+			/* e.g. the flight side isn't listening yet */
+			usleep(timeout_ms * 1000);
+			s->timeouts++;
+			return;
+		}
+
+		if (!simbridge_check_hdr(&msg.hdr, len,
+					SIMBRIDGE_MSG_ACTUATORS)) {
+			continue;
+		}
+
+		apply_actuators(s, &msg);
+
+		if (msg.sensor_time_us == s->time_us) {
+			double rtt = now_s() - sent_at;
+
+			s->replies++;
+			s->rtt_sum += rtt;
+
+			if (rtt > s->rtt_max) {
+				s->rtt_max = rtt;
+			}
+
+			return;
+		}
+
+		timeout_ms = 1;
+	}
+}
+
+static void report(struct standin *s, double wall)
+{
+	printf("t=%.1fs sim/wall=%.2f batches=%u replies=%u timeouts=%u "
+			"rtt avg=%.0fus max=%.0fus alt=%.1fm\n",
+			s->time_us * 1e-6, s->time_us * 1e-6 / wall,
+			(unsigned int) s->seq, (unsigned int) s->replies,
+			(unsigned int) s->timeouts,
+			s->replies ? s->rtt_sum / s->replies * 1e6 : 0,
+			s->rtt_max * 1e6, -s->state.pos[2]);
+
+	s->rtt_max = 0;
+}
+
+int main(int argc, char **argv)
+{
+	static struct standin s;
+
+	const char *addr = "unix:/tmp/dronin-simbridge";
+	const char *model = "quad";
+
+	s.rate_hz = 1000;
+	s.realtime = true;
+
+	int opt;
+
+	while ((opt = getopt(argc, argv, "a:m:r:b:t:f")) != -1) {
+		switch (opt) {
+			case 'a':
+				addr = optarg;
+				break;
+			case 'm':
+				model = optarg;
+				break;
+			case 'r':
+				s.rate_hz = atoi(optarg);
+				break;
+			case 'b':
+				s.batch = atoi(optarg);
+				break;
+			case 't':
+				s.duration = atof(optarg);
+				break;
+			case 'f':
+				s.realtime = false;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+
+	if ((s.rate_hz < 100) || (s.rate_hz > 8000)) {
+		usage(argv[0]);
+	}
+
+	if (s.batch == 0) {
+		/* A datagram per millisecond by default */
+		s.batch = (s.rate_hz + 999) / 1000;
+	}
+
+	/* Worst case every IMU sample comes with mag, baro and GPS */
+	if (s.batch * 5 > SIMBRIDGE_MAX_SAMPLES) {
+		fprintf(stderr, "batch too large, at most %d\n",
+				SIMBRIDGE_MAX_SAMPLES / 5);
+		return 1;
+	}
+
+	if (!strcmp(model, "quad")) {
+		physsim_default_params(&s.params, PHYSSIM_FRAME_MULTIROTOR);
+	} else if (!strcmp(model, "plane")) {
+		physsim_default_params(&s.params, PHYSSIM_FRAME_FIXEDWING);
+	} else {
+		usage(argv[0]);
+	}
+
+	physsim_reset(&s.state, 1);
+
+	if (open_socket(&s, addr)) {
+		return 1;
+	}
+
+	printf("driving %s at %u Hz, %u samples per batch\n", addr,
+			(unsigned int) s.rate_hz, (unsigned int) s.batch);
+
+	double start = now_s();
+	double next_report = 1;
+
+	while ((s.duration <= 0) || (s.time_us * 1e-6 < s.duration)) {
+		struct simbridge_sensors msg;
+
+		build_batch(&s, &msg);
+
+		double sent_at = now_s();
+
+		if (sendto(s.sock, &msg,
+				simbridge_msg_len(SIMBRIDGE_MSG_SENSORS,
+					msg.hdr.count), 0,
+				(struct sockaddr *) &s.dest, s.dest_len) < 0) {
+			/* Flight side not up yet; keep the clock going */
+			if ((errno != ENOENT) && (errno != ECONNREFUSED)) {
+				perror("sendto");
+				return 1;
+			}
+		} else {
+			wait_reply(&s, sent_at);
+		}
+
+		if (s.realtime) {
+			double ahead = s.time_us * 1e-6 - (now_s() - start);
+
+			if (ahead > 0) {
+				usleep(ahead * 1e6);
+			}
+		}
+
+		if (s.time_us * 1e-6 >= next_report) {
+			report(&s, now_s() - start);
+			next_report += 1;
+		}
+	}
+
+	if (s.local_path[0]) {
+		unlink(s.local_path);
+	}
+
+	return 0;
+}
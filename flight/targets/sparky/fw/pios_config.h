@@ -59,6 +59,7 @@
 
 
 /* Flags that alter behaviors */
+#define PIOS_INCLUDE_EVENTEXECUTOR	/* Low priority modules run from the event dispatcher */
 
 /* Alarm Thresholds */
 
@@ -58,6 +58,7 @@
 
 
 /* Flags that alter behaviors */
+#define PIOS_INCLUDE_EVENTEXECUTOR	/* Low priority modules run from the event dispatcher */
 #define AUTOTUNE_AVERAGING_DECIMATION 2
 
 /* Alarm Thresholds */
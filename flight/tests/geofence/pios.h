@@ -0,0 +1,8 @@
+/* Just enough of PiOS for the fence index */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+void *PIOS_malloc(size_t size);
+void PIOS_free(void *buf);
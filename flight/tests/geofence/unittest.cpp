@@ -0,0 +1,376 @@
+/**
+ ******************************************************************************
+ * @file       unittest.cpp
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @addtogroup UnitTests
+ * @{
+ * @addtogroup UnitTests
+ * @{
+ * @brief Unit test and benchmark for the polygon geofence index
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+/*
+ * NOTE: This program uses the Google Test infrastructure to drive the unit test
+ *
+ * Main site for Google Test: http://code.google.com/p/googletest/
+ * Documentation and examples: http://code.google.com/p/googletest/wiki/Documentation
+ */
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>		/* printf */
+#include <stdlib.h>		/* abort */
+#include <string.h>		/* memset */
+#include <stdint.h>		/* uint*_t */
+#include <math.h>
+#include <float.h>
+#include <time.h>
+
+extern "C" {
+
+#include "geofence_index.h"
+
+void *PIOS_malloc(size_t size)
+{
+	return malloc(size);
+}
+
+void PIOS_free(void *buf)
+{
+	free(buf);
+}
+
+}
+
+#include <vector>
+
+class GeofenceIndex : public testing::Test {
+protected:
+	virtual void SetUp() {
+		seed = 0x2545f491;
+		idx = NULL;
+	}
+
+	virtual void TearDown() {
+		geofence_index_free(idx);
+	}
+
+	float rand_float(float lo, float hi) {
+		/* xorshift32; deterministic across platforms */
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+
+		return lo + (hi - lo) * (seed >> 8) / (float) (1 << 24);
+	}
+
+	/* A jagged star shaped polygon around a center, which has plenty of
+	 * concave corners to get containment wrong on */
+	void add_star(enum geofence_polygon_type type, float n, float e,
+			float r_min, float r_max, int count,
+			float floor, float ceiling) {
+		struct geofence_polygon poly;
+
+		poly.type = type;
+		poly.floor = floor;
+		poly.ceiling = ceiling;
+		poly.first_vertex = verts.size() / 2;
+		poly.num_vertices = count;
+
+		for (int i = 0; i < count; i++) {
+			float angle = 2 * M_PI * i / count;
+			float r = rand_float(r_min, r_max);
+
+			verts.push_back(n + r * cosf(angle));
+			verts.push_back(e + r * sinf(angle));
+		}
+
+		polys.push_back(poly);
+	}
+
+	void build() {
+		idx = geofence_index_build(polys.data(), polys.size(),
+				(const float (*)[2]) verts.data(), verts.size() / 2);
+	}
+
+	const float *vertex(int v) {
+		return &verts[2 * v];
+	}
+
+	/* Plain crossing number test against every edge */
+	bool brute_inside(const struct geofence_polygon &poly, const float p[2]) {
+		bool inside = false;
+
+		for (int i = 0; i < poly.num_vertices; i++) {
+			const float *a = vertex(poly.first_vertex + i);
+			const float *b = vertex(poly.first_vertex +
+					(i + 1) % poly.num_vertices);
+
+			if ((a[1] > p[1]) != (b[1] > p[1])) {
+				float n = a[0] + (p[1] - a[1]) * (b[0] - a[0]) / (b[1] - a[1]);
+
+				if (p[0] < n) {
+					inside = !inside;
+				}
+			}
+		}
+
+		return inside;
+	}
+
+	float brute_distance(const float p[2]) {
+		float best = FLT_MAX;
+
+		for (size_t k = 0; k < polys.size(); k++) {
+			for (int i = 0; i < polys[k].num_vertices; i++) {
+				const float *a = vertex(polys[k].first_vertex + i);
+				const float *b = vertex(polys[k].first_vertex +
+						(i + 1) % polys[k].num_vertices);
+
+				float d[2] = { b[0] - a[0], b[1] - a[1] };
+				float t = ((p[0] - a[0]) * d[0] + (p[1] - a[1]) * d[1]) /
+					(d[0] * d[0] + d[1] * d[1]);
+
+				t = fminf(fmaxf(t, 0), 1);
+
+				best = fminf(best, hypotf(a[0] + t * d[0] - p[0],
+							a[1] + t * d[1] - p[1]));
+			}
+		}
+
+		return best;
+	}
+
+	bool brute_allowed(const float pos[3]) {
+		bool any_inclusion = false, included = false, excluded = false;
+
+		for (size_t k = 0; k < polys.size(); k++) {
+			bool inside = brute_inside(polys[k], pos) &&
+				-pos[2] >= polys[k].floor && -pos[2] <= polys[k].ceiling;
+
+			if (polys[k].type == GEOFENCE_POLYGON_INCLUSION) {
+				any_inclusion = true;
+				included |= inside;
+			} else {
+				excluded |= inside;
+			}
+		}
+
+		return (!any_inclusion || included) && !excluded;
+	}
+
+	/* Builds the fence added so far, checks it and times checks; the
+	 * fence should fit within extent of home */
+	void benchmark(const char *what, float extent) {
+		struct timespec t0, t1, t2;
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		build();
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		ASSERT_NE((void *) NULL, idx);
+
+		double build_us = (t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3;
+
+		check_random_points(2000, extent * 1.15f);
+
+		/* Wander around like a vehicle would, so consecutive queries land in
+		 * nearby cells */
+		const int queries = 200000;
+		float pos[3] = { 0, 0, -50 };
+		float vel[2] = { 10, 0 };
+		float sum = 0;
+
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+
+		for (int i = 0; i < queries; i++) {
+			struct geofence_check result;
+
+			vel[0] = 0.999f * vel[0] + rand_float(-1, 1);
+			vel[1] = 0.999f * vel[1] + rand_float(-1, 1);
+
+			/* Turn back towards home when straying past the fence */
+			if (fabsf(pos[0]) > extent && pos[0] * vel[0] > 0) {
+				vel[0] = -vel[0];
+			}
+			if (fabsf(pos[1]) > extent && pos[1] * vel[1] > 0) {
+				vel[1] = -vel[1];
+			}
+
+			pos[0] += vel[0] * 0.02f;
+			pos[1] += vel[1] * 0.02f;
+
+			geofence_index_check(idx, pos, &result);
+			sum += result.margin;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &t2);
+
+		double query_ns = ((t2.tv_sec - t1.tv_sec) * 1e9 + (t2.tv_nsec - t1.tv_nsec)) / queries;
+
+		/* And the same thing by walking every edge, for comparison */
+		const int brute_queries = 2000;
+
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+
+		for (int i = 0; i < brute_queries; i++) {
+			pos[0] = rand_float(-extent, extent);
+			pos[1] = rand_float(-extent, extent);
+
+			sum += brute_allowed(pos) ? brute_distance(pos) : 0;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &t2);
+
+		double brute_ns = ((t2.tv_sec - t1.tv_sec) * 1e9 + (t2.tv_nsec - t1.tv_nsec)) / brute_queries;
+
+		printf("%s: built in %.0f us, %.0f ns per check, "
+				"%.0f ns walking every edge (%g)\n",
+				what, build_us, query_ns, brute_ns, sum);
+	}
+
+	/* Compare against the brute force answers at random points; points
+	 * within a hair of an edge may legitimately go either way */
+	void check_random_points(int count, float extent) {
+		int checked = 0;
+
+		for (int i = 0; i < count; i++) {
+			float pos[3] = {
+				rand_float(-extent, extent),
+				rand_float(-extent, extent),
+				-rand_float(-20, 140),
+			};
+			struct geofence_check result;
+
+			geofence_index_check(idx, pos, &result);
+
+			float distance = brute_distance(pos);
+
+			/* Never more clearance than the nearest edge gives */
+			EXPECT_LE(fabsf(result.margin), distance + 1e-3f);
+
+			if (distance < 1e-3f) {
+				continue;
+			}
+
+			EXPECT_EQ(brute_allowed(pos), result.allowed)
+				<< "at " << pos[0] << ", " << pos[1] << ", " << pos[2];
+			EXPECT_EQ(result.allowed, result.margin >= 0);
+
+			checked++;
+		}
+
+		EXPECT_GT(checked, count * 9 / 10);
+	}
+
+	std::vector<struct geofence_polygon> polys;
+	std::vector<float> verts;
+	struct geofence_index *idx;
+	uint32_t seed;
+};
+
+TEST_F(GeofenceIndex, NothingUsable) {
+	build();
+	EXPECT_EQ(NULL, idx);
+
+	/* Too few vertices, and vertices past the end of the array */
+	add_star(GEOFENCE_POLYGON_INCLUSION, 0, 0, 10, 20, 2, -100, 100);
+	polys.push_back(polys[0]);
+	polys[1].num_vertices = 3;
+	build();
+	EXPECT_EQ(NULL, idx);
+}
+
+TEST_F(GeofenceIndex, Square) {
+	const float square[4][2] = {
+		{ -100, -100 }, { 100, -100 }, { 100, 100 }, { -100, 100 },
+	};
+	struct geofence_polygon poly = {
+		GEOFENCE_POLYGON_INCLUSION, 0, 50, 0, 4,
+	};
+	struct geofence_check result;
+
+	idx = geofence_index_build(&poly, 1, square, 4);
+	ASSERT_NE((void *) NULL, idx);
+
+	float center[3] = { 0, 0, -25 };
+	geofence_index_check(idx, center, &result);
+	EXPECT_TRUE(result.allowed);
+	EXPECT_NEAR(25, result.margin, 1e-4f);
+
+	float near_edge[3] = { 90, 0, -25 };
+	geofence_index_check(idx, near_edge, &result);
+	EXPECT_TRUE(result.allowed);
+	EXPECT_NEAR(10, result.margin, 1e-4f);
+
+	float outside[3] = { 130, 0, -25 };
+	geofence_index_check(idx, outside, &result);
+	EXPECT_FALSE(result.allowed);
+	EXPECT_NEAR(-30, result.margin, 1e-4f);
+
+	float far_outside[3] = { 0, -5000, -25 };
+	geofence_index_check(idx, far_outside, &result);
+	EXPECT_FALSE(result.allowed);
+	EXPECT_NEAR(-4900, result.margin, 1e-2f);
+
+	float too_high[3] = { 0, 0, -60 };
+	geofence_index_check(idx, too_high, &result);
+	EXPECT_FALSE(result.allowed);
+	EXPECT_NEAR(-10, result.margin, 1e-4f);
+}
+
+TEST_F(GeofenceIndex, InclusionWithExclusions) {
+	add_star(GEOFENCE_POLYGON_INCLUSION, 0, 0, 300, 500, 60, -10, 120);
+	add_star(GEOFENCE_POLYGON_EXCLUSION, 100, 50, 30, 80, 20, -10, 40);
+	add_star(GEOFENCE_POLYGON_EXCLUSION, -150, -100, 20, 60, 12, -1000, 1000);
+	build();
+	ASSERT_NE((void *) NULL, idx);
+
+	check_random_points(20000, 600);
+}
+
+TEST_F(GeofenceIndex, OverlappingExclusionsOnly) {
+	add_star(GEOFENCE_POLYGON_EXCLUSION, 0, 0, 50, 150, 40, -100, 100);
+	add_star(GEOFENCE_POLYGON_EXCLUSION, 80, 40, 50, 150, 40, 20, 60);
+	build();
+	ASSERT_NE((void *) NULL, idx);
+
+	check_random_points(20000, 300);
+}
+
+TEST_F(GeofenceIndex, FlightSizedBenchmark) {
+	// All 64 GeoFenceVertex instances a flight controller has
+	add_star(GEOFENCE_POLYGON_INCLUSION, 0, 0, 150, 250, 40, -10, 120);
+	add_star(GEOFENCE_POLYGON_EXCLUSION, 40, -30, 10, 40, 12, -10, 80);
+	add_star(GEOFENCE_POLYGON_EXCLUSION, -80, 60, 10, 30, 12, -10, 1000);
+
+	benchmark("64 vertices", 260);
+}
+
+TEST_F(GeofenceIndex, StressBenchmark) {
+	/* Far beyond what the objects can hold; this stresses the index
+	 * rather than describing anything that flies */
+	add_star(GEOFENCE_POLYGON_INCLUSION, 0, 0, 1500, 2500, 1000, -10, 120);
+	add_star(GEOFENCE_POLYGON_EXCLUSION, 400, -300, 100, 400, 500, -10, 80);
+	add_star(GEOFENCE_POLYGON_EXCLUSION, -800, 600, 100, 300, 200, -10, 1000);
+
+	benchmark("1700 vertices", 2600);
+}
+
+/**
+ * @}
+ * @}
+ */
@@ -0,0 +1,384 @@
+/**
+ ******************************************************************************
+ * @file       unittest.cpp
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @addtogroup UnitTests
+ * @{
+ * @addtogroup UnitTests
+ * @{
+ * @brief Unit test for the TLSF heap allocator
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+/*
+ * NOTE: This program uses the Google Test infrastructure to drive the unit test
+ *
+ * Main site for Google Test: http://code.google.com/p/googletest/
+ * Documentation and examples: http://code.google.com/p/googletest/wiki/Documentation
+ */
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>		/* printf */
+#include <stdlib.h>		/* abort */
+#include <string.h>		/* memset */
+#include <stdint.h>		/* uint*_t */
+
+extern "C" {
+
+#include "pios_tlsf.h"
+
+}
+
+#include <vector>
+
+/* About the size of the main heap on an F3/F4 target */
+#define HEAP_SIZE (48 * 1024)
+
+struct allocation {
+	uint8_t *ptr;
+	size_t size;
+	uint8_t fill;
+};
+
+// To use a test fixture, derive a class from testing::Test.
+class TLSF : public testing::Test {
+protected:
+	virtual void SetUp() {
+		/* Deliberately misaligned to exercise the alignment fixup */
+		mem = (uint8_t *) malloc(HEAP_SIZE + 1);
+		PIOS_TLSF_Init(&tlsf, mem + 1, HEAP_SIZE);
+
+		initial_free = PIOS_TLSF_GetFreeSize(&tlsf);
+		seed = 0x2545f491;
+	}
+
+	virtual void TearDown() {
+		free(mem);
+	}
+
+	uint32_t rand_next() {
+		/* xorshift32; deterministic across platforms */
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+
+		return seed;
+	}
+
+	/* Mostly small allocations with the odd big one, like firmware
+	 * init: queues and objects, then stacks and buffers. */
+	size_t rand_size() {
+		uint32_t r = rand_next();
+
+		if ((r & 0xf) == 0) {
+			return 256 + (r >> 8) % 2048;
+		}
+
+		return 1 + (r >> 8) % 160;
+	}
+
+	bool alloc(std::vector<struct allocation> &live, size_t size) {
+		struct allocation a;
+
+		a.ptr = (uint8_t *) PIOS_TLSF_Malloc(&tlsf, size, live.size());
+		if (a.ptr == NULL) {
+			return false;
+		}
+
+		a.size = size;
+		a.fill = rand_next();
+
+		EXPECT_EQ(0U, (uintptr_t) a.ptr % sizeof(uintptr_t));
+		EXPECT_GE(PIOS_TLSF_BlockSize(a.ptr), size);
+		EXPECT_GE(a.ptr, mem + 1);
+		EXPECT_LE(a.ptr + size, mem + 1 + HEAP_SIZE);
+
+		memset(a.ptr, a.fill, size);
+		live.push_back(a);
+
+		return true;
+	}
+
+	void release(std::vector<struct allocation> &live, size_t idx) {
+		struct allocation a = live[idx];
+
+		/* Anything that wrote over this block would show here */
+		for (size_t i = 0; i < a.size; i++) {
+			ASSERT_EQ(a.fill, a.ptr[i]);
+		}
+
+		PIOS_TLSF_Free(&tlsf, a.ptr);
+
+		live[idx] = live.back();
+		live.pop_back();
+	}
+
+	float fragmentation() {
+		size_t free_bytes = PIOS_TLSF_GetFreeSize(&tlsf);
+
+		if (free_bytes == 0) {
+			return 0;
+		}
+
+		return 1.0f - (float) PIOS_TLSF_GetLargestFree(&tlsf) / free_bytes;
+	}
+
+	uint8_t *mem;
+	struct pios_tlsf tlsf;
+	size_t initial_free;
+	uint32_t seed;
+};
+
+TEST_F(TLSF, FreshHeap) {
+	EXPECT_TRUE(PIOS_TLSF_Check(&tlsf));
+
+	/* All but a few words of overhead is one free block */
+	EXPECT_GT(initial_free, HEAP_SIZE - 32U);
+	EXPECT_EQ(initial_free, PIOS_TLSF_GetLargestFree(&tlsf));
+}
+
+TEST_F(TLSF, MallocFreeRoundTrip) {
+	void *a = PIOS_TLSF_Malloc(&tlsf, 100, 3);
+	void *b = PIOS_TLSF_Malloc(&tlsf, 0, 4);
+	void *c = PIOS_TLSF_Malloc(&tlsf, 1000, 5);
+
+	ASSERT_NE((void *) NULL, a);
+	ASSERT_NE((void *) NULL, b);
+	ASSERT_NE((void *) NULL, c);
+
+	EXPECT_EQ(3, PIOS_TLSF_BlockTag(a));
+	EXPECT_EQ(4, PIOS_TLSF_BlockTag(b));
+	EXPECT_EQ(5, PIOS_TLSF_BlockTag(c));
+
+	EXPECT_TRUE(PIOS_TLSF_Check(&tlsf));
+	EXPECT_LT(PIOS_TLSF_GetFreeSize(&tlsf), initial_free - 1100);
+
+	/* Free the middle one first so both kinds of coalescing happen */
+	PIOS_TLSF_Free(&tlsf, b);
+	EXPECT_TRUE(PIOS_TLSF_Check(&tlsf));
+	PIOS_TLSF_Free(&tlsf, a);
+	EXPECT_TRUE(PIOS_TLSF_Check(&tlsf));
+	PIOS_TLSF_Free(&tlsf, c);
+	EXPECT_TRUE(PIOS_TLSF_Check(&tlsf));
+
+	EXPECT_EQ(initial_free, PIOS_TLSF_GetFreeSize(&tlsf));
+	EXPECT_EQ(initial_free, PIOS_TLSF_GetLargestFree(&tlsf));
+}
+
+TEST_F(TLSF, FreeNullAndDoubleFree) {
+	PIOS_TLSF_Free(&tlsf, NULL);
+
+	void *a = PIOS_TLSF_Malloc(&tlsf, 64, 0);
+	void *b = PIOS_TLSF_Malloc(&tlsf, 64, 0);
+
+	PIOS_TLSF_Free(&tlsf, a);
+	PIOS_TLSF_Free(&tlsf, a);
+
+	EXPECT_TRUE(PIOS_TLSF_Check(&tlsf));
+
+	PIOS_TLSF_Free(&tlsf, b);
+
+	EXPECT_EQ(initial_free, PIOS_TLSF_GetFreeSize(&tlsf));
+}
+
+TEST_F(TLSF, Exhaustion) {
+	std::vector<struct allocation> live;
+
+	while (alloc(live, 48));
+
+	EXPECT_TRUE(PIOS_TLSF_Check(&tlsf));
+	EXPECT_LT(PIOS_TLSF_GetLargestFree(&tlsf), 48U);
+
+	/* 48 bytes plus one word of overhead each */
+	EXPECT_GT(live.size(), HEAP_SIZE / (48 + sizeof(uintptr_t)) - 2);
+
+	while (!live.empty()) {
+		release(live, rand_next() % live.size());
+	}
+
+	EXPECT_TRUE(PIOS_TLSF_Check(&tlsf));
+	EXPECT_EQ(initial_free, PIOS_TLSF_GetLargestFree(&tlsf));
+}
+
+TEST_F(TLSF, TooBig) {
+	EXPECT_EQ((void *) NULL, PIOS_TLSF_Malloc(&tlsf, HEAP_SIZE, 0));
+	EXPECT_EQ((void *) NULL, PIOS_TLSF_Malloc(&tlsf, SIZE_MAX, 0));
+
+	EXPECT_NE((void *) NULL, PIOS_TLSF_Malloc(&tlsf,
+				PIOS_TLSF_GetLargestFree(&tlsf), 0));
+	EXPECT_TRUE(PIOS_TLSF_Check(&tlsf));
+}
+
+TEST_F(TLSF, PoolBiggerThanLargestClass) {
+	size_t size = 5 << PIOS_TLSF_FL_INDEX_MAX;
+	uint8_t *big = (uint8_t *) malloc(size);
+
+	struct pios_tlsf big_tlsf;
+
+	PIOS_TLSF_Init(&big_tlsf, big, size);
+	EXPECT_TRUE(PIOS_TLSF_Check(&big_tlsf));
+	EXPECT_GT(PIOS_TLSF_GetFreeSize(&big_tlsf), size - 256);
+
+	std::vector<void *> blocks;
+
+	void *p;
+	while ((p = PIOS_TLSF_Malloc(&big_tlsf, 100000, 0)) != NULL) {
+		blocks.push_back(p);
+	}
+
+	EXPECT_GE(blocks.size(), size / 100000 - 5);
+	EXPECT_TRUE(PIOS_TLSF_Check(&big_tlsf));
+
+	for (size_t i = 0; i < blocks.size(); i++) {
+		PIOS_TLSF_Free(&big_tlsf, blocks[i]);
+	}
+
+	EXPECT_TRUE(PIOS_TLSF_Check(&big_tlsf));
+	EXPECT_GT(PIOS_TLSF_GetFreeSize(&big_tlsf), size - 256);
+
+	free(big);
+}
+
+TEST_F(TLSF, Extend) {
+	struct pios_tlsf small;
+
+	PIOS_TLSF_Init(&small, mem + 1, HEAP_SIZE / 2);
+
+	size_t before = PIOS_TLSF_GetFreeSize(&small);
+
+	void *a = PIOS_TLSF_Malloc(&small, 1000, 0);
+
+	PIOS_TLSF_Extend(&small, HEAP_SIZE / 2);
+	EXPECT_TRUE(PIOS_TLSF_Check(&small));
+
+	/* The new space merged into the free block at the old end */
+	PIOS_TLSF_Free(&small, a);
+	EXPECT_TRUE(PIOS_TLSF_Check(&small));
+	EXPECT_GE(PIOS_TLSF_GetFreeSize(&small), before + HEAP_SIZE / 2);
+	EXPECT_EQ(PIOS_TLSF_GetFreeSize(&small),
+			PIOS_TLSF_GetLargestFree(&small));
+}
+
+TEST_F(TLSF, TinyPool) {
+	struct pios_tlsf tiny;
+
+	PIOS_TLSF_Init(&tiny, mem, 8);
+	EXPECT_TRUE(PIOS_TLSF_Check(&tiny));
+	EXPECT_EQ((void *) NULL, PIOS_TLSF_Malloc(&tiny, 1, 0));
+}
+
+/* Random allocation and free with random sizes, checking the allocator's
+ * invariants and that no two live allocations overlap. */
+TEST_F(TLSF, RandomStress) {
+	std::vector<struct allocation> live;
+
+	for (int i = 0; i < 200000; i++) {
+		uint32_t r = rand_next();
+
+		/* Bias towards allocating while the heap is emptyish */
+		bool do_alloc = live.empty() || ((r % 100) <
+				(PIOS_TLSF_GetFreeSize(&tlsf) * 100 / initial_free));
+
+		if (do_alloc) {
+			alloc(live, rand_size());
+		} else {
+			release(live, r % live.size());
+		}
+
+		if ((i % 1000) == 0) {
+			ASSERT_TRUE(PIOS_TLSF_Check(&tlsf));
+		}
+	}
+
+	while (!live.empty()) {
+		release(live, rand_next() % live.size());
+	}
+
+	ASSERT_TRUE(PIOS_TLSF_Check(&tlsf));
+
+	/* Everything coalesces back into one block */
+	EXPECT_EQ(initial_free, PIOS_TLSF_GetFreeSize(&tlsf));
+	EXPECT_EQ(initial_free, PIOS_TLSF_GetLargestFree(&tlsf));
+}
+
+/* The pattern that leaked with the bump allocator: long lived objects
+ * allocated at init, then filters and buffers that get torn down and
+ * rebuilt in a different size whenever settings change.  The heap must
+ * keep satisfying the rebuilds, and the free space must stay mostly
+ * contiguous. */
+TEST_F(TLSF, ReconfigurationFragmentation) {
+	std::vector<struct allocation> permanent;
+	std::vector<struct allocation> transient;
+
+	for (int i = 0; i < 100; i++) {
+		ASSERT_TRUE(alloc(permanent, rand_size()));
+	}
+
+	size_t permanent_free = PIOS_TLSF_GetFreeSize(&tlsf);
+
+	float worst_frag = 0;
+
+	for (int cycle = 0; cycle < 5000; cycle++) {
+		/* Settings changed: rebuild everything transient */
+		while (!transient.empty()) {
+			release(transient, rand_next() % transient.size());
+		}
+
+		/* Now and then something long lived appears, too */
+		if ((cycle % 500) == 0) {
+			ASSERT_TRUE(alloc(permanent, rand_size()));
+		}
+
+		int count = 10 + rand_next() % 40;
+
+		for (int i = 0; i < count; i++) {
+			ASSERT_TRUE(alloc(transient, rand_size()));
+		}
+
+		float frag = fragmentation();
+
+		if (frag > worst_frag) {
+			worst_frag = frag;
+		}
+	}
+
+	ASSERT_TRUE(PIOS_TLSF_Check(&tlsf));
+
+	while (!transient.empty()) {
+		release(transient, rand_next() % transient.size());
+	}
+
+	/* With only the long lived objects left, nearly all the free space
+	 * is back in one piece. */
+	EXPECT_LT(fragmentation(), 0.1f);
+	EXPECT_GT(PIOS_TLSF_GetFreeSize(&tlsf), permanent_free - 10 * 2400);
+
+	RecordProperty("WorstFragmentationPct", (int) (worst_frag * 100));
+	printf("worst fragmentation during churn: %d%%\n",
+			(int) (worst_frag * 100));
+
+	while (!permanent.empty()) {
+		release(permanent, rand_next() % permanent.size());
+	}
+
+	EXPECT_EQ(initial_free, PIOS_TLSF_GetLargestFree(&tlsf));
+}
+
+/**
+ * @}
+ * @}
+ */
@@ -0,0 +1 @@
+/* pios_mpu.c needs nothing from here */
@@ -0,0 +1,19 @@
+/* PIOS Feature Selection */
+#include "pios_config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <pios_heap.h>
+#include <pios_delay.h>
+#include <pios_spi.h>
+#include <pios_sensors.h>
+
+/* The real pios_exti.h needs the STM32 headers */
+struct pios_exti_cfg;
+extern int32_t PIOS_EXTI_Init(const struct pios_exti_cfg *cfg);
+extern void PIOS_EXTI_DeInit(const struct pios_exti_cfg *cfg);
+
+#define PIOS_Assert(x) if (!(x)) { while (1) ; }
+#define PIOS_DEBUG_Assert(x) PIOS_Assert(x)
@@ -0,0 +1,2 @@
+#define PIOS_INCLUDE_SPI
+#define PIOS_INCLUDE_MPU
@@ -0,0 +1,4 @@
+/* Stands in for the generated UAVO header taskmonitor.h wants */
+typedef enum {
+	TASKINFO_RUNNING_IMU = 0,
+} TaskInfoRunningElem;
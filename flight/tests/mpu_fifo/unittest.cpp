@@ -0,0 +1,489 @@
+/**
+ ******************************************************************************
+ * @file       unittest.cpp
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @addtogroup UnitTests
+ * @{
+ * @addtogroup UnitTests
+ * @{
+ * @brief Unit test for the MPU driver's FIFO burst reads
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+/*
+ * NOTE: This program uses the Google Test infrastructure to drive the unit test
+ *
+ * Main site for Google Test: http://code.google.com/p/googletest/
+ * Documentation and examples: http://code.google.com/p/googletest/wiki/Documentation
+ */
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>		/* printf */
+#include <stdlib.h>		/* malloc */
+#include <string.h>		/* memset */
+#include <stdint.h>		/* uint*_t */
+#include <setjmp.h>		/* setjmp */
+
+extern "C" {
+
+#include "pios.h"
+#include "pios_semaphore.h"
+#include "pios_thread.h"
+#include "pios_queue.h"
+#include "taskmonitor.h"
+#include "pios_mpu_priv.h"
+#include "physical_constants.h"
+
+}
+
+#include <deque>
+#include <vector>
+
+#define TEST_SPI_ID 0x5a5a0002
+
+/*
+ * Simulated MPU-6000 on the bus.  Register reads and writes auto-increment
+ * like the part does, except that reads of the FIFO register pop the FIFO
+ * and the count registers follow its length.
+ */
+static uint8_t regs[128];
+static std::deque<uint8_t> fifo;
+static int fifo_resets;
+
+static bool selected;
+static int xfer_pos;
+static uint8_t xfer_addr;
+static bool xfer_read;
+
+/* The data ready semaphore hands out this many wakeups before the task
+ * is stopped */
+static int wakeups;
+static jmp_buf task_exit;
+
+static void (*task_func)(void *);
+static std::vector<struct pios_sensor_imu_batch> batches;
+static uint32_t batch_rate;
+
+static uint8_t reg_read(uint8_t addr)
+{
+	switch (addr) {
+	case PIOS_MPU_FIFO_CNT_MSB:
+		return fifo.size() >> 8;
+	case PIOS_MPU_FIFO_CNT_LSB:
+		return fifo.size() & 0xff;
+	case PIOS_MPU_FIFO_REG:
+		if (fifo.empty())
+			return 0xff;
+		else {
+			uint8_t b = fifo.front();
+			fifo.pop_front();
+			return b;
+		}
+	case PIOS_MPU_WHOAMI:
+		return 0x68;
+	}
+
+	return regs[addr & 0x7f];
+}
+
+static void reg_write(uint8_t addr, uint8_t val)
+{
+	if (addr == PIOS_MPU_USER_CTRL_REG && (val & PIOS_MPU_USERCTL_FIFO_RST)) {
+		fifo.clear();
+		fifo_resets++;
+		val &= ~PIOS_MPU_USERCTL_FIFO_RST;
+	}
+
+	regs[addr & 0x7f] = val;
+}
+
+extern "C" {
+
+uint32_t PIOS_DELAY_GetRaw()
+{
+	return 0;
+}
+
+uint32_t PIOS_DELAY_DiffuS(uint32_t)
+{
+	return 0;
+}
+
+int32_t PIOS_DELAY_WaitmS(uint32_t)
+{
+	return 0;
+}
+
+int32_t PIOS_EXTI_Init(const struct pios_exti_cfg *)
+{
+	return 0;
+}
+
+void PIOS_EXTI_DeInit(const struct pios_exti_cfg *)
+{
+}
+
+void *PIOS_malloc(size_t size)
+{
+	return calloc(1, size);
+}
+
+void PIOS_free(void *buf)
+{
+	free(buf);
+}
+
+int32_t TaskMonitorAdd(TaskInfoRunningElem, struct pios_thread *)
+{
+	return 0;
+}
+
+static int semaphore_dummy;
+static int thread_dummy;
+
+struct pios_semaphore *PIOS_Semaphore_Create(void)
+{
+	return (struct pios_semaphore *) &semaphore_dummy;
+}
+
+bool PIOS_Semaphore_Take(struct pios_semaphore *, uint32_t)
+{
+	if (wakeups-- <= 0)
+		longjmp(task_exit, 1);
+
+	return true;
+}
+
+bool PIOS_Semaphore_Give_FromISR(struct pios_semaphore *, bool *)
+{
+	return true;
+}
+
+struct pios_thread *PIOS_Thread_Create(void (*fp)(void *), const char *,
+		size_t, void *, enum pios_thread_prio_e)
+{
+	/* The tests run the task by hand */
+	task_func = fp;
+
+	return (struct pios_thread *) &thread_dummy;
+}
+
+struct pios_queue {
+	size_t item_size;
+};
+
+struct pios_queue *PIOS_Queue_Create(size_t, size_t item_size)
+{
+	struct pios_queue *queue = (struct pios_queue *) malloc(sizeof(*queue));
+
+	queue->item_size = item_size;
+
+	return queue;
+}
+
+void PIOS_Queue_Delete(struct pios_queue *queue)
+{
+	free(queue);
+}
+
+bool PIOS_Queue_Send(struct pios_queue *queue, const void *item, uint32_t)
+{
+	EXPECT_EQ(sizeof(struct pios_sensor_imu_batch), queue->item_size);
+
+	batches.push_back(*(const struct pios_sensor_imu_batch *) item);
+
+	return true;
+}
+
+int32_t PIOS_SENSORS_Register(enum pios_sensor_type, struct pios_queue *)
+{
+	return 0;
+}
+
+void PIOS_SENSORS_SetMaxGyro(int32_t)
+{
+}
+
+void PIOS_SENSORS_SetSampleRate(enum pios_sensor_type type, uint32_t sample_rate)
+{
+	if (type == PIOS_SENSOR_IMU_BATCH)
+		batch_rate = sample_rate;
+}
+
+uint32_t PIOS_SENSORS_GetSampleRate(enum pios_sensor_type type)
+{
+	return (type == PIOS_SENSOR_IMU_BATCH) ? batch_rate : 0;
+}
+
+int32_t PIOS_SPI_ClaimBus(uint32_t spi_id)
+{
+	EXPECT_EQ((uint32_t) TEST_SPI_ID, spi_id);
+
+	return 0;
+}
+
+int32_t PIOS_SPI_ReleaseBus(uint32_t)
+{
+	return 0;
+}
+
+int32_t PIOS_SPI_SetClockSpeed(uint32_t, uint32_t)
+{
+	return 0;
+}
+
+int32_t PIOS_SPI_RC_PinSet(uint32_t, uint32_t, bool pin_value)
+{
+	selected = !pin_value;
+	xfer_pos = 0;
+
+	return 0;
+}
+
+uint8_t PIOS_SPI_TransferByte(uint32_t, uint8_t b)
+{
+	EXPECT_TRUE(selected);
+
+	if (xfer_pos++ == 0) {
+		xfer_addr = b & 0x7f;
+		xfer_read = b & 0x80;
+		return 0;
+	}
+
+	uint8_t addr = xfer_addr;
+
+	/* Bursts keep reading the FIFO rather than walking on past it */
+	if (addr != PIOS_MPU_FIFO_REG)
+		xfer_addr++;
+
+	if (xfer_read)
+		return reg_read(addr);
+
+	reg_write(addr, b);
+
+	return 0;
+}
+
+int32_t PIOS_SPI_TransferBlock(uint32_t spi_id, const uint8_t *send_buffer,
+		uint8_t *receive_buffer, uint16_t len)
+{
+	for (uint16_t i = 0; i < len; i++) {
+		uint8_t b = PIOS_SPI_TransferByte(spi_id, send_buffer ? send_buffer[i] : 0);
+
+		if (receive_buffer)
+			receive_buffer[i] = b;
+	}
+
+	return 0;
+}
+
+}
+
+/* One FIFO record, in the part's register order */
+struct fifo_record {
+	int16_t accel[3];
+	int16_t temp;
+	int16_t gyro[3];
+};
+
+static void push16(int16_t v)
+{
+	fifo.push_back((uint16_t) v >> 8);
+	fifo.push_back((uint16_t) v & 0xff);
+}
+
+static void push_record(const struct fifo_record &rec)
+{
+	for (int i = 0; i < 3; i++)
+		push16(rec.accel[i]);
+
+	push16(rec.temp);
+
+	for (int i = 0; i < 3; i++)
+		push16(rec.gyro[i]);
+}
+
+static struct fifo_record make_record(int n)
+{
+	struct fifo_record rec = {
+		{ (int16_t) (100 * n + 1), (int16_t) (-100 * n - 2), (int16_t) 4096 },
+		(int16_t) (-521 + 34 * n),
+		{ (int16_t) (33 * n), (int16_t) (-66 * n), (int16_t) (32767 - n) },
+	};
+
+	return rec;
+}
+
+/* Scales for the driver's defaults of 1000 deg/s and 8 G */
+static const float gyro_scale = 1.0f / 32.8f;
+static const float accel_scale = GRAVITY / 4096.0f;
+
+// To use a test fixture, derive a class from testing::Test.
+class MPUFifo : public testing::Test {
+protected:
+	virtual void SetUp() {
+		memset(regs, 0, sizeof(regs));
+		fifo.clear();
+		fifo_resets = 0;
+		selected = false;
+		wakeups = 0;
+		task_func = NULL;
+		batches.clear();
+		batch_rate = 0;
+	}
+
+	void Start(uint8_t batch) {
+		memset(&cfg, 0, sizeof(cfg));
+		cfg.default_samplerate = 1000;
+		cfg.orientation = PIOS_MPU_TOP_0DEG;
+		cfg.skip_startup_irq_check = true;
+		cfg.fifo_batch = batch;
+
+		pios_mpu_dev_t dev = NULL;
+		ASSERT_EQ(0, PIOS_MPU_SPI_Init(&dev, TEST_SPI_ID, 0, &cfg));
+		ASSERT_TRUE(task_func != NULL);
+
+		/* Throw away the FIFO setup's reset */
+		fifo_resets = 0;
+	}
+
+	/* Run the task until it has used up its wakeups and blocks */
+	void RunTask(int n) {
+		wakeups = n;
+
+		if (setjmp(task_exit) == 0)
+			task_func(NULL);
+	}
+
+	void ExpectRecord(const struct pios_sensor_imu_batch &b, int i,
+			const struct fifo_record &rec) {
+		/* TOP_0DEG maps the part's (x, y, z) to (y, x, -z) */
+		EXPECT_FLOAT_EQ(rec.accel[1] * accel_scale, b.samples[i].accel[0]);
+		EXPECT_FLOAT_EQ(rec.accel[0] * accel_scale, b.samples[i].accel[1]);
+		EXPECT_FLOAT_EQ(-rec.accel[2] * accel_scale, b.samples[i].accel[2]);
+		EXPECT_FLOAT_EQ(rec.gyro[1] * gyro_scale, b.samples[i].gyro[0]);
+		EXPECT_FLOAT_EQ(rec.gyro[0] * gyro_scale, b.samples[i].gyro[1]);
+		EXPECT_FLOAT_EQ(-rec.gyro[2] * gyro_scale, b.samples[i].gyro[2]);
+	}
+
+	struct pios_mpu_cfg cfg;
+};
+
+TEST_F(MPUFifo, StartEnablesFifo) {
+	Start(2);
+
+	EXPECT_EQ(PIOS_MPU_FIFO_TEMP_OUT | PIOS_MPU_FIFO_GYRO_X_OUT |
+			PIOS_MPU_FIFO_GYRO_Y_OUT | PIOS_MPU_FIFO_GYRO_Z_OUT |
+			PIOS_MPU_ACCEL_OUT, regs[PIOS_MPU_FIFO_EN_REG]);
+	EXPECT_TRUE(regs[PIOS_MPU_USER_CTRL_REG] & PIOS_MPU_USERCTL_FIFO_EN);
+	EXPECT_EQ(1000u, batch_rate);
+}
+
+TEST_F(MPUFifo, DecodesBurst) {
+	Start(2);
+
+	struct fifo_record recs[2] = { make_record(1), make_record(2) };
+	push_record(recs[0]);
+	push_record(recs[1]);
+
+	RunTask(1);
+
+	ASSERT_EQ(1u, batches.size());
+	EXPECT_EQ(2, batches[0].count);
+	EXPECT_EQ(1000u, batches[0].sample_period_us);
+	ExpectRecord(batches[0], 0, recs[0]);
+	ExpectRecord(batches[0], 1, recs[1]);
+
+	/* Temperature comes from the newest record */
+	EXPECT_FLOAT_EQ(35.0f + (recs[1].temp + 512.0f) / 340.0f,
+			batches[0].temperature);
+
+	EXPECT_TRUE(fifo.empty());
+	EXPECT_EQ(0, fifo_resets);
+}
+
+TEST_F(MPUFifo, EmptyFifoSendsNothing) {
+	Start(2);
+
+	RunTask(1);
+
+	EXPECT_EQ(0u, batches.size());
+	EXPECT_EQ(0, fifo_resets);
+}
+
+TEST_F(MPUFifo, MisalignedCountResets) {
+	Start(2);
+
+	push_record(make_record(1));
+	fifo.push_back(0x12);
+
+	RunTask(1);
+
+	EXPECT_EQ(0u, batches.size());
+	EXPECT_EQ(1, fifo_resets);
+	EXPECT_TRUE(fifo.empty());
+
+	/* Back in step on the next burst */
+	struct fifo_record rec = make_record(3);
+	push_record(rec);
+
+	RunTask(1);
+
+	ASSERT_EQ(1u, batches.size());
+	EXPECT_EQ(1, batches[0].count);
+	ExpectRecord(batches[0], 0, rec);
+}
+
+TEST_F(MPUFifo, OverflowResets) {
+	Start(2);
+
+	/* A full FIFO has wrapped and lost its place */
+	for (int i = 0; i < 512 / 14; i++)
+		push_record(make_record(i));
+
+	RunTask(1);
+
+	EXPECT_EQ(0u, batches.size());
+	EXPECT_EQ(1, fifo_resets);
+}
+
+TEST_F(MPUFifo, BacklogDrainsWithoutWaiting) {
+	Start(2);
+
+	const int n = PIOS_SENSOR_IMU_BATCH_MAX + 3;
+	std::vector<struct fifo_record> recs;
+
+	for (int i = 0; i < n; i++) {
+		recs.push_back(make_record(i));
+		push_record(recs.back());
+	}
+
+	/* A single wakeup is enough to empty it */
+	RunTask(1);
+
+	ASSERT_EQ(2u, batches.size());
+	EXPECT_EQ(PIOS_SENSOR_IMU_BATCH_MAX, batches[0].count);
+	EXPECT_EQ(3, batches[1].count);
+
+	for (int i = 0; i < PIOS_SENSOR_IMU_BATCH_MAX; i++)
+		ExpectRecord(batches[0], i, recs[i]);
+
+	for (int i = 0; i < 3; i++)
+		ExpectRecord(batches[1], i, recs[PIOS_SENSOR_IMU_BATCH_MAX + i]);
+
+	EXPECT_TRUE(fifo.empty());
+}
@@ -0,0 +1,227 @@
+/**
+ ******************************************************************************
+ * @file       unittest.cpp
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @addtogroup UnitTests
+ * @{
+ * @addtogroup UnitTests
+ * @{
+ * @brief Unit test for the route planner
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+/*
+ * NOTE: This program uses the Google Test infrastructure to drive the unit test
+ *
+ * Main site for Google Test: http://code.google.com/p/googletest/
+ * Documentation and examples: http://code.google.com/p/googletest/wiki/Documentation
+ */
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>		/* printf */
+#include <stdlib.h>		/* abort */
+#include <string.h>		/* memset */
+#include <stdint.h>		/* uint*_t */
+#include <math.h>		/* sqrtf */
+
+extern "C" {
+
+#include "path_plan.h"
+
+}
+
+#define EPS 1e-4f
+
+class PathPlan : public testing::Test {
+protected:
+	virtual void SetUp() {
+		memset(legs, 0, sizeof(legs));
+		num_legs = 0;
+
+		limits.corner_radius = 5;
+		limits.corner_accel = 0;
+		limits.max_accel = 0;
+	}
+
+	void add(float north, float east, float velocity, bool straight = true) {
+		struct path_plan_leg *leg = &legs[num_legs++];
+
+		leg->end[0] = north;
+		leg->end[1] = east;
+		leg->end[2] = -10;
+		leg->velocity = velocity;
+		leg->straight = straight;
+	}
+
+	void build() {
+		path_plan_build(legs, num_legs, &limits);
+	}
+
+	struct path_plan_leg legs[8];
+	int num_legs;
+	struct path_plan_limits limits;
+};
+
+TEST_F(PathPlan, Empty) {
+	build();
+}
+
+TEST_F(PathPlan, SquareCorners) {
+	// North, then east, then south: two right angle turns to the right
+	add(0, 0, 5);
+	add(20, 0, 5);
+	add(20, 20, 5);
+	add(0, 20, 5);
+	build();
+
+	EXPECT_NEAR(0, legs[0].length, EPS);
+	EXPECT_NEAR(20, legs[1].length, EPS);
+	EXPECT_NEAR(20, legs[2].length, EPS);
+	EXPECT_NEAR(20, legs[3].length, EPS);
+
+	// Where the first leg starts isn't known, nor is there a next leg
+	// after the last
+	EXPECT_EQ(0, legs[0].corner_distance);
+	EXPECT_EQ(0, legs[3].corner_distance);
+
+	// A right angle fillet starts one radius before the corner
+	EXPECT_NEAR(5, legs[1].corner_distance, EPS);
+	EXPECT_NEAR(1 / 5.0f, legs[1].corner_curvature, EPS);
+	EXPECT_NEAR(5, legs[2].corner_distance, EPS);
+	EXPECT_NEAR(1 / 5.0f, legs[2].corner_curvature, EPS);
+
+	// No limits, so speeds are as asked
+	for (int i = 0; i < num_legs; i++) {
+		EXPECT_EQ(5, legs[i].velocity);
+	}
+}
+
+TEST_F(PathPlan, LeftTurn) {
+	add(0, 0, 5);
+	add(20, 0, 5);
+	add(20, -20, 5);
+	build();
+
+	EXPECT_NEAR(5, legs[1].corner_distance, EPS);
+	EXPECT_NEAR(-1 / 5.0f, legs[1].corner_curvature, EPS);
+}
+
+TEST_F(PathPlan, ShortLegsShrinkFillet) {
+	add(0, 0, 5);
+	add(6, 0, 5);
+	add(6, 20, 5);
+	build();
+
+	// Only half the 6m leg is available, so the radius drops to 3m
+	EXPECT_NEAR(3, legs[1].corner_distance, EPS);
+	EXPECT_NEAR(1 / 3.0f, legs[1].corner_curvature, EPS);
+}
+
+TEST_F(PathPlan, ShallowTurn) {
+	// 30 degrees to the right: tan(15 deg) of the radius
+	add(0, 0, 5);
+	add(20, 0, 5);
+	add(20 + 20 * cosf(M_PI / 6), 20 * sinf(M_PI / 6), 5);
+	build();
+
+	EXPECT_NEAR(5 * tanf(M_PI / 12), legs[1].corner_distance, EPS);
+	EXPECT_NEAR(1 / 5.0f, legs[1].corner_curvature, EPS);
+}
+
+TEST_F(PathPlan, SharpCornersLeftAlone) {
+	add(0, 0, 5);
+	add(20, 0, 5);
+	add(40, 0, 5);			// Straight on
+	add(20, 0, 5);			// Straight back
+	add(20, 20, 5, false);		// Onto a curve
+	add(40, 20, 5);
+	build();
+
+	for (int i = 0; i < num_legs; i++) {
+		EXPECT_EQ(0, legs[i].corner_distance) << "leg " << i;
+		EXPECT_EQ(0, legs[i].corner_curvature) << "leg " << i;
+	}
+}
+
+TEST_F(PathPlan, NoRadiusNoFillets) {
+	limits.corner_radius = 0;
+
+	add(0, 0, 5);
+	add(20, 0, 5);
+	add(20, 20, 5);
+	build();
+
+	EXPECT_EQ(0, legs[1].corner_distance);
+}
+
+TEST_F(PathPlan, CornerSpeed) {
+	limits.corner_accel = 2.5f;
+
+	add(0, 0, 10);
+	add(20, 0, 10);
+	add(20, 20, 10);
+	add(20.5f, 20, 10);	// Tight fillet, as the leg is short
+	build();
+
+	// v^2 = a r
+	EXPECT_NEAR(sqrtf(2.5f * 5), legs[1].velocity, EPS);
+
+	// The fillet into the short leg is only 0.25m in radius
+	EXPECT_NEAR(0.25f, legs[2].corner_distance, EPS);
+	EXPECT_NEAR(sqrtf(2.5f * 0.25f), legs[2].velocity, EPS);
+
+	// Unconstrained ends
+	EXPECT_EQ(10, legs[0].velocity);
+	EXPECT_EQ(10, legs[3].velocity);
+}
+
+TEST_F(PathPlan, AccelerationProfile) {
+	limits.corner_radius = 0;
+	limits.max_accel = 1.5f;
+
+	add(0, 0, 10);
+	add(100, 0, 10);
+	add(110, 0, 1);		// Slow point 10m on
+	add(120, 0, 10);	// And 10m after that
+	add(300, 0, 10);
+	build();
+
+	float reach = sqrtf(1 + 2 * 1.5f * 10);
+
+	// Braking before the slow point, and not reaching full speed after
+	EXPECT_NEAR(reach, legs[1].velocity, EPS);
+	EXPECT_EQ(1, legs[2].velocity);
+	EXPECT_NEAR(reach, legs[3].velocity, EPS);
+
+	// Plenty of room to get back up to speed
+	EXPECT_EQ(10, legs[0].velocity);
+	EXPECT_EQ(10, legs[4].velocity);
+
+	// Every leg is flyable within the limit
+	for (int i = 1; i < num_legs; i++) {
+		float dv2 = fabsf(legs[i].velocity * legs[i].velocity -
+				legs[i - 1].velocity * legs[i - 1].velocity);
+
+		EXPECT_LE(dv2, 2 * limits.max_accel * legs[i].length + EPS)
+			<< "leg " << i;
+	}
+}
+
+/**
+ * @}
+ * @}
+ */
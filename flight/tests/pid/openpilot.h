@@ -0,0 +1 @@
+/* pid.c needs nothing from here */
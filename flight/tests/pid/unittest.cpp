@@ -0,0 +1,225 @@
+/**
+ ******************************************************************************
+ * @file       unittest.cpp
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @addtogroup UnitTests
+ * @{
+ * @addtogroup UnitTests
+ * @{
+ * @brief Unit test for the PID controllers
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+/*
+ * NOTE: This program uses the Google Test infrastructure to drive the unit test
+ *
+ * Main site for Google Test: http://code.google.com/p/googletest/
+ * Documentation and examples: http://code.google.com/p/googletest/wiki/Documentation
+ */
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>		/* printf */
+#include <stdlib.h>		/* abort */
+#include <string.h>		/* memset */
+#include <stdint.h>		/* uint*_t */
+#include <math.h>		/* fabsf */
+
+#define restrict		/* neuter restrict keyword since it's not in C++ */
+
+extern "C" {
+
+#include "misc_math.h"
+#include "pid.h"
+
+}
+
+#define PI 3.14159265358979323846f
+
+/* The controller as it was before its derivative coefficients were cached,
+ * dividing on every call */
+struct ref_pid {
+	float p, i, d, iLim;
+	float iAccumulator, lastErr, lastDer;
+	float tau;
+};
+
+static float ref_apply(struct ref_pid *pid, float err, float dT)
+{
+	if (pid->i != 0) {
+		pid->iAccumulator += err * (pid->i * dT);
+		pid->iAccumulator = bound_sym(pid->iAccumulator, pid->iLim);
+	}
+
+	float diff = err - pid->lastErr;
+	float dterm = 0;
+	pid->lastErr = err;
+
+	if (pid->d && dT) {
+		dterm = pid->lastDer + dT / (dT + pid->tau) * ((diff * pid->d / dT) - pid->lastDer);
+		pid->lastDer = dterm;
+	}
+
+	return err * pid->p + pid->iAccumulator + dterm;
+}
+
+static float ref_apply_antiwindup(struct ref_pid *pid, float err,
+		float min_bound, float max_bound, float dT)
+{
+	if (pid->i != 0) {
+		pid->iAccumulator += err * (pid->i * dT);
+	}
+
+	float diff = err - pid->lastErr;
+	float dterm = 0;
+	pid->lastErr = err;
+
+	if (pid->d && dT) {
+		dterm = pid->lastDer + dT / (dT + pid->tau) * ((diff * pid->d / dT) - pid->lastDer);
+		pid->lastDer = dterm;
+	}
+
+	float ideal_output = err * pid->p + pid->iAccumulator + dterm;
+	float saturation = 0;
+
+	if (ideal_output > max_bound) {
+		saturation = max_bound - ideal_output;
+		ideal_output = max_bound;
+	} else if (ideal_output < min_bound) {
+		saturation = min_bound - ideal_output;
+		ideal_output = min_bound;
+	}
+
+	pid->iAccumulator += saturation * (pid->i * 10.0f * dT);
+	pid->iAccumulator = bound_sym(pid->iAccumulator, pid->iLim);
+
+	return ideal_output;
+}
+
+class PidTest : public testing::Test {
+protected:
+	virtual void SetUp() {
+		memset(&pid, 0, sizeof(pid));
+		memset(&ref, 0, sizeof(ref));
+
+		srand(1);
+		configure(0.003f, 0.008f, 0.00004f, 0.3f);
+		set_cutoff(20);
+	}
+
+	void configure(float p, float i, float d, float iLim) {
+		pid_configure(&pid, p, i, d, iLim);
+
+		ref.p = p;
+		ref.i = i;
+		ref.d = d;
+		ref.iLim = iLim;
+	}
+
+	void set_cutoff(float cutoff) {
+		pid_configure_derivative(cutoff, 1);
+		ref.tau = 1.0f / (2 * PI * cutoff);
+	}
+
+	/* Errors like a rate loop sees: a wandering signal plus gyro noise */
+	float next_err() {
+		phase += 0.013f;
+		return 200 * sinf(phase) + 20 * ((rand() / (float) RAND_MAX) - 0.5f);
+	}
+
+	/* Caching the quotients reorders the arithmetic, so allow a little
+	 * rounding relative to the output's size */
+	void expect_same(float expected, float actual) {
+		EXPECT_NEAR(expected, actual, 1e-5f * fmaxf(1, fabsf(expected)));
+	}
+
+	struct pid pid;
+	struct ref_pid ref;
+	float phase = 0;
+};
+
+TEST_F(PidTest, MatchesReference) {
+	for (int i = 0; i < 5000; i++) {
+		float err = next_err();
+
+		expect_same(ref_apply(&ref, err, 0.001f), pid_apply(&pid, err, 0.001f));
+	}
+}
+
+TEST_F(PidTest, AntiwindupMatchesReference) {
+	for (int i = 0; i < 5000; i++) {
+		float err = next_err();
+
+		expect_same(ref_apply_antiwindup(&ref, err, -0.2f, 0.2f, 0.001f),
+			pid_apply_antiwindup(&pid, err, -0.2f, 0.2f, 0.001f));
+	}
+}
+
+TEST_F(PidTest, SetpointMatchesReference) {
+	for (int i = 0; i < 5000; i++) {
+		float setpoint = next_err();
+		float measured = setpoint - next_err() * 0.1f;
+
+		expect_same(ref_apply(&ref, setpoint - measured, 0.001f),
+			pid_apply_setpoint(&pid, NULL, setpoint, measured, 0.001f));
+	}
+}
+
+TEST_F(PidTest, FollowsJitteryDt) {
+	/* Scheduling jitter changes dT from call to call */
+	for (int i = 0; i < 5000; i++) {
+		float err = next_err();
+		float dT = 0.001f + 0.0002f * ((rand() / (float) RAND_MAX) - 0.5f);
+
+		expect_same(ref_apply(&ref, err, dT), pid_apply(&pid, err, dT));
+	}
+}
+
+TEST_F(PidTest, FollowsReconfiguration) {
+	for (int i = 0; i < 6000; i++) {
+		float err = next_err();
+
+		/* Gains and the cutoff change while the dT stays put, as when
+		 * settings are edited in flight */
+		if (i == 2000) {
+			configure(0.004f, 0.01f, 0.0001f, 0.3f);
+		} else if (i == 4000) {
+			set_cutoff(60);
+		}
+
+		expect_same(ref_apply(&ref, err, 0.001f), pid_apply(&pid, err, 0.001f));
+	}
+}
+
+TEST_F(PidTest, ZeroDtLeavesDerivative) {
+	pid_apply(&pid, 10, 0.001f);
+
+	float last_der = pid.lastDer;
+
+	pid_apply(&pid, 20, 0);
+	EXPECT_EQ(last_der, pid.lastDer);
+
+	/* And the coefficients still come right afterwards */
+	ref_apply(&ref, 10, 0.001f);
+	ref_apply(&ref, 20, 0);
+
+	expect_same(ref_apply(&ref, 30, 0.001f), pid_apply(&pid, 30, 0.001f));
+}
+
+/**
+ * @}
+ * @}
+ */
@@ -0,0 +1,172 @@
+/**
+ ******************************************************************************
+ * @file       unittest.cpp
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @addtogroup UnitTests
+ * @{
+ * @addtogroup UnitTests
+ * @{
+ * @brief Unit test for the autotune identifier
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+/*
+ * NOTE: This program uses the Google Test infrastructure to drive the unit test
+ *
+ * Main site for Google Test: http://code.google.com/p/googletest/
+ * Documentation and examples: http://code.google.com/p/googletest/wiki/Documentation
+ */
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>		/* printf */
+#include <stdlib.h>		/* abort */
+#include <string.h>		/* memset */
+#include <stdint.h>		/* uint*_t */
+#include <math.h>		/* expf */
+
+extern "C" {
+
+#include "rls_ident.h"
+
+}
+
+#define DT 0.001f
+
+class RlsIdent : public testing::Test {
+protected:
+	virtual void SetUp() {
+		rls_ident_init(&ident, DT, 2);
+
+		rate = 0;
+		accel = 0;
+		memset(u_hist, 0, sizeof(u_hist));
+	}
+
+	/* Flies a first order plant with a dead time, wiggled by a square
+	 * wave like the one stabilization uses */
+	void fly(float seconds, float gain, float tau, int delay, float bias,
+			float rate_noise = 0) {
+		float alpha = expf(-DT / tau);
+
+		for (int i = 0; i < seconds / DT; i++) {
+			float u = ((i / 64) & 1) ? 0.1f : -0.1f;
+
+			for (int j = RLS_IDENT_NUM_DELAYS; j > 0; j--) {
+				u_hist[j] = u_hist[j - 1];
+			}
+
+			u_hist[0] = u;
+
+			accel = alpha * accel +
+				(1 - alpha) * (gain * u_hist[1 + delay] + bias);
+			rate += accel * DT;
+
+			float noise = rate_noise * ((rand() / (float) RAND_MAX) - 0.5f);
+
+			rls_ident_update(&ident, rate + noise, u);
+		}
+	}
+
+	struct rls_ident ident;
+	float rate;
+	float accel;
+	float u_hist[RLS_IDENT_NUM_DELAYS + 1];
+};
+
+TEST_F(RlsIdent, NothingAtFirst) {
+	struct rls_ident_estimate est;
+
+	EXPECT_FALSE(rls_ident_get_estimate(&ident, &est));
+
+	// Not yet a memory's worth
+	fly(1, 20000, 0.03f, 2, 0);
+	EXPECT_FALSE(rls_ident_get_estimate(&ident, &est));
+}
+
+TEST_F(RlsIdent, Exact) {
+	struct rls_ident_estimate est;
+
+	fly(5, 20000, 0.03f, 2, 100);
+	ASSERT_TRUE(rls_ident_get_estimate(&ident, &est));
+
+	EXPECT_NEAR(20000, est.gain, 200);
+	EXPECT_NEAR(0.03f, est.tau, 0.001f);
+	EXPECT_NEAR(2 * DT, est.delay, 1e-6f);
+	EXPECT_NEAR(100, est.bias, 10);
+	EXPECT_LT(est.noise, 10);
+}
+
+TEST_F(RlsIdent, EachDelay) {
+	for (int delay = 0; delay < RLS_IDENT_NUM_DELAYS; delay++) {
+		struct rls_ident_estimate est;
+
+		SetUp();
+		fly(5, 5000, 0.05f, delay, 0);
+		ASSERT_TRUE(rls_ident_get_estimate(&ident, &est));
+
+		EXPECT_NEAR(delay * DT, est.delay, 1e-6f) << "delay " << delay;
+	}
+}
+
+TEST_F(RlsIdent, NoisyGyro) {
+	struct rls_ident_estimate est;
+
+	// Differentiated, this is a lot of noise
+	srand(1);
+	fly(10, 20000, 0.03f, 3, 0, 0.5f);
+	ASSERT_TRUE(rls_ident_get_estimate(&ident, &est));
+
+	EXPECT_NEAR(20000, est.gain, 500);
+	EXPECT_NEAR(0.03f, est.tau, 0.002f);
+	EXPECT_NEAR(3 * DT, est.delay, 1e-6f);
+}
+
+TEST_F(RlsIdent, FollowsChange) {
+	struct rls_ident_estimate est;
+
+	fly(5, 20000, 0.03f, 2, 0);
+
+	// Say, a bigger battery
+	fly(10, 12000, 0.04f, 2, 0);
+	ASSERT_TRUE(rls_ident_get_estimate(&ident, &est));
+
+	EXPECT_NEAR(12000, est.gain, 300);
+	EXPECT_NEAR(0.04f, est.tau, 0.002f);
+}
+
+/**
+ * @}
+ * @}
+ */
+
+TEST_F(RlsIdent, SkipsGap) {
+	struct rls_ident_estimate est;
+
+	fly(5, 20000, 0.03f, 2, 0);
+	ASSERT_TRUE(rls_ident_get_estimate(&ident, &est));
+
+	// Samples lost while the rate moved on; the jump isn't fit
+	rate += 500;
+	rls_ident_skip_gap(&ident);
+
+	fly(0.1f, 20000, 0.03f, 2, 0);
+	ASSERT_TRUE(rls_ident_get_estimate(&ident, &est));
+
+	EXPECT_NEAR(20000, est.gain, 200);
+	EXPECT_NEAR(0.03f, est.tau, 0.001f);
+	EXPECT_NEAR(2 * DT, est.delay, 1e-6f);
+}
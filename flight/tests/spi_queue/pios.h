@@ -0,0 +1,18 @@
+/* PIOS Feature Selection */
+#include "pios_config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <pios_heap.h>
+#include <pios_delay.h>
+#include <pios_irq.h>
+
+#if defined(PIOS_INCLUDE_SPI)
+#include <pios_spi.h>
+#include <pios_spi_queue.h>
+#endif
+
+#define PIOS_Assert(x) if (!(x)) { while (1) ; }
+#define PIOS_DEBUG_Assert(x) PIOS_Assert(x)
@@ -0,0 +1,540 @@
+/**
+ ******************************************************************************
+ * @file       unittest.cpp
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @addtogroup UnitTests
+ * @{
+ * @addtogroup UnitTests
+ * @{
+ * @brief Unit test for the SPI transaction queue
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+/*
+ * NOTE: This program uses the Google Test infrastructure to drive the unit test
+ *
+ * Main site for Google Test: http://code.google.com/p/googletest/
+ * Documentation and examples: http://code.google.com/p/googletest/wiki/Documentation
+ */
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>		/* printf */
+#include <stdlib.h>		/* malloc */
+#include <string.h>		/* memset */
+#include <stdint.h>		/* uint*_t */
+
+extern "C" {
+
+#include "pios.h"
+#include "pios_semaphore.h"
+#include "pios_thread.h"
+
+}
+
+#include <vector>
+
+#define TEST_SPI_ID 0x5a5a0001
+
+/*
+ * Simulated bus and virtual clock.  Time only passes while bytes are
+ * shifted, at the rate the transaction asked for, so wait and busy times
+ * are exact.
+ */
+static uint32_t now_us;
+static uint32_t bus_hz;
+static bool bus_claimed;
+static int bus_selected = -1;
+static int bus_selects;
+static bool fail_claim;
+static bool fail_transfer;
+
+/* Called as each transfer starts, to inject submissions mid-transfer */
+static void (*transfer_hook)(uint16_t len);
+
+/* Stands in for the worker while a caller sleeps on a semaphore */
+static bool take_runs_queue;
+static int takes;
+
+extern "C" {
+
+uint32_t PIOS_DELAY_GetRaw()
+{
+	return now_us;
+}
+
+uint32_t PIOS_DELAY_DiffuS(uint32_t raw)
+{
+	return now_us - raw;
+}
+
+uint32_t PIOS_DELAY_DiffuS2(uint32_t raw, uint32_t later)
+{
+	return later - raw;
+}
+
+int32_t PIOS_IRQ_Disable(void)
+{
+	return 0;
+}
+
+int32_t PIOS_IRQ_Enable(void)
+{
+	return 0;
+}
+
+static int semaphore_dummy;
+static int thread_dummy;
+
+struct pios_semaphore *PIOS_Semaphore_Create(void)
+{
+	return (struct pios_semaphore *) &semaphore_dummy;
+}
+
+bool PIOS_Semaphore_Take(struct pios_semaphore *, uint32_t)
+{
+	takes++;
+
+	if (take_runs_queue) {
+		while (PIOS_SPI_Queue_RunOne(PIOS_SPI_Queue_Find(TEST_SPI_ID)));
+	}
+
+	return true;
+}
+
+bool PIOS_Semaphore_Give(struct pios_semaphore *)
+{
+	return true;
+}
+
+struct pios_thread *PIOS_Thread_Create(void (*)(void *), const char *,
+		size_t, void *, enum pios_thread_prio_e)
+{
+	/* The tests run the queue by hand */
+	return (struct pios_thread *) &thread_dummy;
+}
+
+void *PIOS_malloc_no_dma(size_t size)
+{
+	return malloc(size);
+}
+
+void PIOS_free(void *buf)
+{
+	free(buf);
+}
+
+int32_t PIOS_SPI_ClaimBus(uint32_t)
+{
+	if (fail_claim) {
+		return -1;
+	}
+
+	EXPECT_FALSE(bus_claimed);
+	bus_claimed = true;
+
+	return 0;
+}
+
+int32_t PIOS_SPI_ReleaseBus(uint32_t)
+{
+	EXPECT_TRUE(bus_claimed);
+	bus_claimed = false;
+
+	return 0;
+}
+
+int32_t PIOS_SPI_SetClockSpeed(uint32_t, uint32_t speed)
+{
+	bus_hz = speed;
+
+	return speed;
+}
+
+int32_t PIOS_SPI_RC_PinSet(uint32_t, uint32_t slave_id, bool pin_value)
+{
+	EXPECT_TRUE(bus_claimed);
+
+	if (!pin_value) {
+		EXPECT_EQ(-1, bus_selected);
+		bus_selected = slave_id;
+		bus_selects++;
+	} else {
+		EXPECT_EQ((int) slave_id, bus_selected);
+		bus_selected = -1;
+	}
+
+	return 0;
+}
+
+int32_t PIOS_SPI_TransferBlock(uint32_t spi_id, const uint8_t *send_buffer,
+		uint8_t *receive_buffer, uint16_t len)
+{
+	EXPECT_EQ((uint32_t) TEST_SPI_ID, spi_id);
+	EXPECT_NE(-1, bus_selected);
+
+	if (transfer_hook) {
+		transfer_hook(len);
+	}
+
+	if (fail_transfer) {
+		return -1;
+	}
+
+	/* Slaves echo what they are sent */
+	for (uint16_t i = 0; i < len; i++) {
+		uint8_t b = send_buffer ? send_buffer[i] : 0xff;
+
+		if (receive_buffer) {
+			receive_buffer[i] = b;
+		}
+	}
+
+	now_us += (uint64_t) len * 8 * 1000000 / bus_hz;
+
+	return 0;
+}
+
+}
+
+struct completion {
+	struct pios_spi_txn *txn;
+	int32_t status;
+	uint32_t time_us;
+};
+
+static std::vector<struct completion> completions;
+
+static void record_completion(struct pios_spi_txn *txn, int32_t status)
+{
+	struct completion c = { txn, status, now_us };
+
+	completions.push_back(c);
+}
+
+// To use a test fixture, derive a class from testing::Test.
+class SPIQueue : public testing::Test {
+protected:
+	static struct pios_spi_queue *queue;
+
+	static void SetUpTestCase() {
+		ASSERT_EQ(0, PIOS_SPI_Queue_Init(&queue, TEST_SPI_ID));
+	}
+
+	virtual void SetUp() {
+		now_us = 1000;
+		bus_hz = 1000000;
+		bus_claimed = false;
+		bus_selected = -1;
+		bus_selects = 0;
+		fail_claim = false;
+		fail_transfer = false;
+		transfer_hook = NULL;
+		take_runs_queue = false;
+		takes = 0;
+
+		completions.clear();
+
+		PIOS_SPI_Queue_ClearStats(queue);
+	}
+
+	virtual void TearDown() {
+		/* Nothing may be left behind for the next test */
+		EXPECT_FALSE(PIOS_SPI_Queue_RunOne(queue));
+		EXPECT_FALSE(bus_claimed);
+	}
+
+	void fill_txn(struct pios_spi_txn *txn, struct pios_spi_xfer *xfer,
+			enum pios_spi_queue_prio prio, uint32_t slave,
+			uint32_t speed_hz, const uint8_t *tx, uint8_t *rx,
+			uint16_t len) {
+		memset(xfer, 0, sizeof(*xfer));
+		xfer->tx = tx;
+		xfer->rx = rx;
+		xfer->len = len;
+
+		memset(txn, 0, sizeof(*txn));
+		txn->slave = slave;
+		txn->speed_hz = speed_hz;
+		txn->prio = prio;
+		txn->xfers = xfer;
+		txn->cb = record_completion;
+	}
+
+	int run_all() {
+		int ran = 0;
+
+		while (PIOS_SPI_Queue_RunOne(queue)) {
+			ran++;
+		}
+
+		return ran;
+	}
+};
+
+struct pios_spi_queue *SPIQueue::queue;
+
+TEST_F(SPIQueue, InitAndFind) {
+	struct pios_spi_queue *dup;
+
+	EXPECT_EQ(queue, PIOS_SPI_Queue_Find(TEST_SPI_ID));
+	EXPECT_EQ(NULL, PIOS_SPI_Queue_Find(TEST_SPI_ID + 1));
+
+	/* One queue per bus */
+	EXPECT_GT(0, PIOS_SPI_Queue_Init(&dup, TEST_SPI_ID));
+}
+
+TEST_F(SPIQueue, RejectsBadTransactions) {
+	struct pios_spi_txn txn;
+	struct pios_spi_xfer xfer;
+
+	fill_txn(&txn, &xfer, PIOS_SPI_PRIO_NORMAL, 0, 0, NULL, NULL, 1);
+
+	EXPECT_GT(0, PIOS_SPI_Queue_Submit(NULL, &txn));
+	EXPECT_GT(0, PIOS_SPI_Queue_Submit(queue, NULL));
+
+	txn.xfers = NULL;
+	EXPECT_GT(0, PIOS_SPI_Queue_Submit(queue, &txn));
+
+	txn.xfers = &xfer;
+	txn.prio = PIOS_SPI_PRIO_NUM;
+	EXPECT_GT(0, PIOS_SPI_Queue_Submit(queue, &txn));
+
+	EXPECT_EQ(0, run_all());
+}
+
+TEST_F(SPIQueue, HigherPriorityRunsFirst) {
+	struct pios_spi_txn txn[6];
+	struct pios_spi_xfer xfer[6];
+	enum pios_spi_queue_prio prios[6] = {
+		PIOS_SPI_PRIO_LOW, PIOS_SPI_PRIO_NORMAL, PIOS_SPI_PRIO_LOW,
+		PIOS_SPI_PRIO_HIGH, PIOS_SPI_PRIO_NORMAL, PIOS_SPI_PRIO_HIGH,
+	};
+
+	for (int i = 0; i < 6; i++) {
+		fill_txn(&txn[i], &xfer[i], prios[i], 0, 0, NULL, NULL, 4);
+		ASSERT_EQ(0, PIOS_SPI_Queue_Submit(queue, &txn[i]));
+	}
+
+	EXPECT_EQ(6, run_all());
+	ASSERT_EQ(6u, completions.size());
+
+	/* By priority, then in submission order */
+	int expected[6] = { 3, 5, 1, 4, 0, 2 };
+
+	for (int i = 0; i < 6; i++) {
+		EXPECT_EQ(&txn[expected[i]], completions[i].txn);
+		EXPECT_EQ(0, completions[i].status);
+	}
+}
+
+TEST_F(SPIQueue, ChainedTransfersShareChipSelect) {
+	uint8_t cmd[2] = { 0x3b | 0x80, 0x00 };
+	uint8_t data[6] = { 1, 2, 3, 4, 5, 6 };
+	uint8_t cmd_rx[2];
+	uint8_t data_rx[6];
+
+	struct pios_spi_xfer second = { data, data_rx, sizeof(data), NULL };
+	struct pios_spi_xfer first = { cmd, cmd_rx, sizeof(cmd), &second };
+
+	struct pios_spi_txn txn;
+	memset(&txn, 0, sizeof(txn));
+	txn.slave = 2;
+	txn.speed_hz = 8000000;
+	txn.prio = PIOS_SPI_PRIO_HIGH;
+	txn.xfers = &first;
+	txn.cb = record_completion;
+
+	ASSERT_EQ(0, PIOS_SPI_Queue_Submit(queue, &txn));
+	EXPECT_EQ(1, run_all());
+
+	EXPECT_EQ(1, bus_selects);
+	EXPECT_EQ(8000000u, bus_hz);
+	EXPECT_EQ(0, memcmp(cmd, cmd_rx, sizeof(cmd)));
+	EXPECT_EQ(0, memcmp(data, data_rx, sizeof(data)));
+
+	/* 8 bytes at 8MHz */
+	ASSERT_EQ(1u, completions.size());
+	EXPECT_EQ(1000u + 8, completions[0].time_us);
+
+	struct pios_spi_queue_stats stats;
+	PIOS_SPI_Queue_GetStats(queue, PIOS_SPI_PRIO_HIGH, &stats);
+
+	EXPECT_EQ(1u, stats.completed);
+	EXPECT_EQ(0u, stats.failed);
+	EXPECT_EQ(8u, stats.busy_max_us);
+	EXPECT_EQ(0u, stats.wait_max_us);
+}
+
+TEST_F(SPIQueue, CallbackCanResubmit) {
+	static struct pios_spi_txn txn;
+	static struct pios_spi_xfer xfer;
+	static int runs;
+
+	runs = 0;
+
+	fill_txn(&txn, &xfer, PIOS_SPI_PRIO_NORMAL, 0, 0, NULL, NULL, 1);
+	txn.cb = [](struct pios_spi_txn *t, int32_t) {
+		if (++runs < 3) {
+			EXPECT_EQ(0, PIOS_SPI_Queue_Submit(
+						PIOS_SPI_Queue_Find(TEST_SPI_ID), t));
+		}
+	};
+
+	ASSERT_EQ(0, PIOS_SPI_Queue_Submit(queue, &txn));
+
+	EXPECT_EQ(3, run_all());
+	EXPECT_EQ(3, runs);
+}
+
+TEST_F(SPIQueue, FailuresReachCallback) {
+	struct pios_spi_txn txn[2];
+	struct pios_spi_xfer xfer[2];
+
+	fill_txn(&txn[0], &xfer[0], PIOS_SPI_PRIO_LOW, 0, 0, NULL, NULL, 1);
+	fill_txn(&txn[1], &xfer[1], PIOS_SPI_PRIO_LOW, 1, 0, NULL, NULL, 1);
+
+	fail_claim = true;
+	ASSERT_EQ(0, PIOS_SPI_Queue_Submit(queue, &txn[0]));
+	EXPECT_EQ(1, run_all());
+	fail_claim = false;
+
+	fail_transfer = true;
+	ASSERT_EQ(0, PIOS_SPI_Queue_Submit(queue, &txn[1]));
+	EXPECT_EQ(1, run_all());
+	fail_transfer = false;
+
+	ASSERT_EQ(2u, completions.size());
+	EXPECT_GT(0, completions[0].status);
+	EXPECT_GT(0, completions[1].status);
+
+	/* A failed transfer still deselects and releases the bus */
+	EXPECT_EQ(-1, bus_selected);
+
+	struct pios_spi_queue_stats stats;
+	PIOS_SPI_Queue_GetStats(queue, PIOS_SPI_PRIO_LOW, &stats);
+
+	EXPECT_EQ(0u, stats.completed);
+	EXPECT_EQ(2u, stats.failed);
+}
+
+TEST_F(SPIQueue, TransactWaitsForResult) {
+	uint8_t tx[3] = { 0x9f, 0, 0 };
+	uint8_t rx[3];
+	struct pios_spi_txn txn;
+	struct pios_spi_xfer xfer;
+
+	fill_txn(&txn, &xfer, PIOS_SPI_PRIO_LOW, 1, 0, tx, rx, sizeof(tx));
+
+	take_runs_queue = true;
+
+	EXPECT_EQ(0, PIOS_SPI_Queue_Transact(queue, &txn,
+				PIOS_Semaphore_Create()));
+	EXPECT_EQ(1, takes);
+	EXPECT_EQ(0, memcmp(tx, rx, sizeof(tx)));
+
+	/* Failures come back as the return value */
+	fail_transfer = true;
+	EXPECT_GT(0, PIOS_SPI_Queue_Transact(queue, &txn,
+				PIOS_Semaphore_Create()));
+	fail_transfer = false;
+
+	txn.xfers = NULL;
+	EXPECT_GT(0, PIOS_SPI_Queue_Transact(queue, &txn,
+				PIOS_Semaphore_Create()));
+	EXPECT_EQ(2, takes);
+}
+
+/*
+ * The case the queue exists for: an IMU read becomes ready while a run
+ * of flash page programs is queued.  It should wait for at most the
+ * page in progress, where first come first served makes it wait for
+ * the whole run.
+ */
+#define FLASH_PAGES 8
+#define FLASH_PAGE_BYTES (4 + 256)
+#define FLASH_HZ 10000000
+#define IMU_BYTES 15
+#define IMU_HZ 1000000
+
+static struct pios_spi_txn imu_txn;
+static struct pios_spi_xfer imu_xfer;
+static bool imu_pending;
+
+static void submit_imu_midway(uint16_t len)
+{
+	if (imu_pending) {
+		/* Half way through the first page */
+		now_us += (uint64_t) len * 4 * 1000000 / bus_hz;
+		imu_pending = false;
+
+		EXPECT_EQ(0, PIOS_SPI_Queue_Submit(
+					PIOS_SPI_Queue_Find(TEST_SPI_ID), &imu_txn));
+
+		now_us -= (uint64_t) len * 4 * 1000000 / bus_hz;
+	}
+}
+
+TEST_F(SPIQueue, ImuLatencyBehindFlash) {
+	static uint8_t page[FLASH_PAGE_BYTES];
+	uint8_t imu_rx[IMU_BYTES];
+	struct pios_spi_txn flash_txn[FLASH_PAGES];
+	struct pios_spi_xfer flash_xfer[FLASH_PAGES];
+
+	for (int i = 0; i < FLASH_PAGES; i++) {
+		fill_txn(&flash_txn[i], &flash_xfer[i], PIOS_SPI_PRIO_LOW, 0,
+				FLASH_HZ, page, NULL, sizeof(page));
+		ASSERT_EQ(0, PIOS_SPI_Queue_Submit(queue, &flash_txn[i]));
+	}
+
+	fill_txn(&imu_txn, &imu_xfer, PIOS_SPI_PRIO_HIGH, 1, IMU_HZ, NULL,
+			imu_rx, sizeof(imu_rx));
+
+	imu_pending = true;
+	transfer_hook = submit_imu_midway;
+
+	EXPECT_EQ(FLASH_PAGES + 1, run_all());
+	ASSERT_EQ((size_t) FLASH_PAGES + 1, completions.size());
+
+	/* Preempts the rest of the flash run */
+	EXPECT_EQ(&flash_txn[0], completions[0].txn);
+	EXPECT_EQ(&imu_txn, completions[1].txn);
+
+	struct pios_spi_queue_stats imu, flash;
+	PIOS_SPI_Queue_GetStats(queue, PIOS_SPI_PRIO_HIGH, &imu);
+	PIOS_SPI_Queue_GetStats(queue, PIOS_SPI_PRIO_LOW, &flash);
+
+	uint32_t page_us = FLASH_PAGE_BYTES * 8 * 1000000 / FLASH_HZ;
+
+	EXPECT_EQ(1u, imu.completed);
+	EXPECT_EQ(page_us, flash.busy_max_us);
+	EXPECT_GE(page_us, imu.wait_max_us);
+
+	/* First come first served would have waited for the rest of the
+	 * first page and all of the others */
+	uint32_t fifo_wait_us = page_us / 2 + (FLASH_PAGES - 1) * page_us;
+
+	printf("IMU read waited %u us behind %d flash pages "
+			"(%u us if served in order)\n",
+			imu.wait_max_us, FLASH_PAGES, fifo_wait_us);
+
+	EXPECT_LT(imu.wait_max_us * (FLASH_PAGES - 1), fifo_wait_us);
+}
+
+/**
+ * @}
+ * @}
+ */
@@ -0,0 +1,348 @@
+/**
+ ******************************************************************************
+ * @file       unittest.cpp
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @addtogroup UnitTests
+ * @{
+ * @addtogroup UnitTests
+ * @{
+ * @brief Unit test for the telemetry message scheduler
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+/*
+ * NOTE: This program uses the Google Test infrastructure to drive the unit test
+ *
+ * Main site for Google Test: http://code.google.com/p/googletest/
+ * Documentation and examples: http://code.google.com/p/googletest/wiki/Documentation
+ */
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>		/* printf */
+#include <stdlib.h>		/* abort */
+#include <string.h>		/* memset */
+#include <stdint.h>		/* uint*_t */
+
+extern "C" {
+
+#include "stream_sched.h"
+
+}
+
+#include <deque>
+#include <map>
+
+/* Roughly what the MAVLink bridge sends; ids and lengths as on the wire */
+enum {
+	MSG_HEARTBEAT = 0,
+	MSG_SYS_STATUS = 1,
+	MSG_GPS_RAW_INT = 24,
+	MSG_ATTITUDE = 30,
+	MSG_RC_CHANNELS_RAW = 35,
+	MSG_GPS_GLOBAL_ORIGIN = 49,
+	MSG_VFR_HUD = 74,
+};
+
+enum {
+	STREAM_EXTENDED_STATUS = 2,
+	STREAM_RC_CHANNELS = 3,
+	STREAM_POSITION = 6,
+	STREAM_EXTRA1 = 10,
+	STREAM_EXTRA2 = 11,
+};
+
+static const struct stream_sched_message messages[] = {
+	{ MSG_HEARTBEAT, 0, 1000, 17 },
+	{ MSG_SYS_STATUS, STREAM_EXTENDED_STATUS, 500, 39 },
+	{ MSG_RC_CHANNELS_RAW, STREAM_RC_CHANNELS, 200, 30 },
+	{ MSG_GPS_RAW_INT, STREAM_POSITION, 500, 38 },
+	{ MSG_GPS_GLOBAL_ORIGIN, STREAM_POSITION, 500, 20 },
+	{ MSG_ATTITUDE, STREAM_EXTRA1, 100, 36 },
+	{ MSG_VFR_HUD, STREAM_EXTRA2, 500, 28 },
+};
+
+#define NUM_MESSAGES (sizeof(messages) / sizeof(messages[0]))
+
+/*
+ * Stands in for the bridge, the serial port and whatever listens on the
+ * far end.  The bridge runs every TICK_MS and packs what is due into one
+ * write; the port queues up to its buffer size and drains at the baud
+ * rate; the listener counts what arrives.
+ */
+class StreamSched : public testing::Test {
+protected:
+	static const uint32_t TICK_MS = 10;
+	static const uint16_t WRITE_LEN = 128;
+	static const uint16_t PORT_BUFFER = 256;
+
+	virtual void SetUp() {
+		now = 1000;
+		bytes_per_s = 0;
+		queued = 0;
+		drain_credit = 0;
+		writes = 0;
+		dropped = 0;
+		received.clear();
+		in_flight.clear();
+	}
+
+	void init(uint32_t baud) {
+		bytes_per_s = baud / 10;
+
+		ASSERT_EQ(0, stream_sched_init(&sched, messages, NUM_MESSAGES,
+					bytes_per_s, WRITE_LEN, now));
+	}
+
+	/* One bridge tick: pack everything due into one write */
+	void bridge_tick() {
+		uint16_t len = 0;
+		std::deque<std::pair<uint8_t, uint16_t> > packed;
+		int idx;
+
+		stream_sched_tick(&sched, now);
+
+		while ((idx = stream_sched_next(&sched, now, WRITE_LEN - len)) >= 0) {
+			uint16_t msg_len = messages[idx].max_len;
+
+			packed.push_back(std::make_pair(messages[idx].msgid, msg_len));
+			len += msg_len;
+
+			stream_sched_sent(&sched, idx, msg_len, now);
+		}
+
+		if (len == 0) {
+			return;
+		}
+
+		writes++;
+
+		/* Non-blocking write; a full port loses the lot */
+		if (queued + len > PORT_BUFFER) {
+			dropped += packed.size();
+			return;
+		}
+
+		queued += len;
+		in_flight.insert(in_flight.end(), packed.begin(), packed.end());
+	}
+
+	/* The port drains for a millisecond */
+	void port_ms() {
+		if (bytes_per_s == 0) {
+			while (!in_flight.empty()) {
+				received[in_flight.front().first]++;
+				in_flight.pop_front();
+			}
+
+			queued = 0;
+			return;
+		}
+
+		drain_credit += bytes_per_s;
+
+		while (!in_flight.empty() &&
+				drain_credit >= in_flight.front().second * 1000u) {
+			drain_credit -= in_flight.front().second * 1000u;
+			queued -= in_flight.front().second;
+			received[in_flight.front().first]++;
+			in_flight.pop_front();
+		}
+
+		if (in_flight.empty()) {
+			drain_credit = 0;
+		}
+	}
+
+	void run(uint32_t ms) {
+		for (uint32_t i = 0; i < ms; i++) {
+			if (now % TICK_MS == 0) {
+				bridge_tick();
+			}
+
+			port_ms();
+			now++;
+		}
+	}
+
+	double rate(uint8_t msgid, uint32_t ms) {
+		return received[msgid] * 1000.0 / ms;
+	}
+
+	uint32_t total_bytes() {
+		uint32_t total = 0;
+
+		for (size_t i = 0; i < NUM_MESSAGES; i++) {
+			total += received[messages[i].msgid] * messages[i].max_len;
+		}
+
+		return total;
+	}
+
+	void print_rates(const char *name, uint32_t ms) {
+		printf("%s:", name);
+
+		for (size_t i = 0; i < NUM_MESSAGES; i++) {
+			printf(" %d=%.2fHz", messages[i].msgid,
+					rate(messages[i].msgid, ms));
+		}
+
+		printf(" (%u B/s of %u, %u writes, %u dropped)\n",
+				total_bytes() * 1000 / ms, bytes_per_s,
+				writes, dropped);
+	}
+
+	struct stream_sched sched;
+	uint32_t now;
+	uint32_t bytes_per_s;
+	uint32_t queued;
+	uint32_t drain_credit;
+	uint32_t writes;
+	uint32_t dropped;
+	std::map<uint8_t, uint32_t> received;
+	std::deque<std::pair<uint8_t, uint16_t> > in_flight;
+};
+
+TEST_F(StreamSched, TableTooLong) {
+	struct stream_sched_message big[STREAM_SCHED_MAX_MESSAGES + 1] = { };
+
+	EXPECT_EQ(-1, stream_sched_init(&sched, big,
+				STREAM_SCHED_MAX_MESSAGES + 1, 0, 0, now));
+}
+
+TEST_F(StreamSched, DefaultRatesOnFastLink) {
+	const uint32_t ms = 60000;
+
+	init(57600);
+	run(ms);
+	print_rates("57600", ms);
+
+	for (size_t i = 0; i < NUM_MESSAGES; i++) {
+		EXPECT_NEAR(1000.0 / messages[i].default_interval_ms,
+				rate(messages[i].msgid, ms), 0.05)
+			<< "message " << (int) messages[i].msgid;
+	}
+
+	EXPECT_EQ(0u, dropped);
+
+	/* Messages due together share a write */
+	EXPECT_LT(writes, ms / 100 + ms / 200);
+}
+
+TEST_F(StreamSched, SaturatedLinkSharesBudget) {
+	const uint32_t ms = 60000;
+
+	/* ~240 B/s, against ~700 B/s of default traffic */
+	init(2400);
+	run(ms);
+	print_rates("2400", ms);
+
+	/* Never more than the link carries, and the port never overflows */
+	EXPECT_LE(total_bytes() * 1000 / ms, bytes_per_s);
+	EXPECT_GT(total_bytes() * 1000 / ms, bytes_per_s * 9 / 10);
+	EXPECT_EQ(0u, dropped);
+
+	/* Everything still gets through at some rate */
+	for (size_t i = 0; i < NUM_MESSAGES; i++) {
+		EXPECT_GT(rate(messages[i].msgid, ms), 0.1)
+			<< "message " << (int) messages[i].msgid;
+	}
+}
+
+TEST_F(StreamSched, MessageInterval) {
+	const uint32_t ms = 20000;
+
+	init(0);
+
+	/* 25 Hz attitude */
+	EXPECT_EQ(0, stream_sched_set_interval(&sched, MSG_ATTITUDE, 40000, now));
+	EXPECT_EQ(40, stream_sched_get_interval(&sched, MSG_ATTITUDE));
+
+	/* VFR_HUD off */
+	EXPECT_EQ(0, stream_sched_set_interval(&sched, MSG_VFR_HUD, -1, now));
+
+	/* Not in the table */
+	EXPECT_EQ(-1, stream_sched_set_interval(&sched, 200, 1000, now));
+	EXPECT_EQ(-1, stream_sched_get_interval(&sched, 200));
+
+	run(ms);
+	print_rates("interval", ms);
+
+	EXPECT_NEAR(25, rate(MSG_ATTITUDE, ms), 0.1);
+	EXPECT_EQ(0u, received[MSG_VFR_HUD]);
+	EXPECT_NEAR(2, rate(MSG_SYS_STATUS, ms), 0.1);
+
+	/* Back to the default */
+	EXPECT_EQ(0, stream_sched_set_interval(&sched, MSG_VFR_HUD, 0, now));
+	EXPECT_EQ(500, stream_sched_get_interval(&sched, MSG_VFR_HUD));
+
+	received.clear();
+	run(ms);
+
+	EXPECT_NEAR(2, rate(MSG_VFR_HUD, ms), 0.1);
+}
+
+TEST_F(StreamSched, RequestDataStream) {
+	const uint32_t ms = 20000;
+
+	init(0);
+
+	/* Everything off but the heartbeat, which isn't part of a stream */
+	EXPECT_EQ((int32_t) NUM_MESSAGES - 1,
+			stream_sched_set_stream_rate(&sched,
+				STREAM_SCHED_ALL_STREAMS, 0, false, now));
+
+	/* Position at 4 Hz; both its messages follow */
+	EXPECT_EQ(2, stream_sched_set_stream_rate(&sched, STREAM_POSITION,
+				4, true, now));
+
+	/* A stream with nothing in it */
+	EXPECT_EQ(0, stream_sched_set_stream_rate(&sched, 7, 4, true, now));
+
+	run(ms);
+	print_rates("streams", ms);
+
+	EXPECT_NEAR(1, rate(MSG_HEARTBEAT, ms), 0.1);
+	EXPECT_NEAR(4, rate(MSG_GPS_RAW_INT, ms), 0.1);
+	EXPECT_NEAR(4, rate(MSG_GPS_GLOBAL_ORIGIN, ms), 0.1);
+	EXPECT_EQ(0u, received[MSG_ATTITUDE]);
+	EXPECT_EQ(0u, received[MSG_SYS_STATUS]);
+}
+
+TEST_F(StreamSched, EarliestDeadlineFirst) {
+	init(0);
+
+	/* Everything is due at once after init; heartbeat first, as the
+	 * ties go to the table order */
+	EXPECT_EQ(0, stream_sched_next(&sched, now, WRITE_LEN));
+
+	/* Make attitude overdue the longest */
+	stream_sched_set_stream_rate(&sched, STREAM_SCHED_ALL_STREAMS, 0,
+			false, now);
+	stream_sched_set_interval(&sched, MSG_HEARTBEAT, -1, now);
+	stream_sched_set_interval(&sched, MSG_ATTITUDE, 0, now);
+	stream_sched_set_interval(&sched, MSG_SYS_STATUS, 0, now + 5);
+
+	EXPECT_EQ(5, stream_sched_next(&sched, now + 10, WRITE_LEN));
+
+	/* And a message that doesn't fit holds up the rest */
+	EXPECT_EQ(-1, stream_sched_next(&sched, now + 10, 20));
+}
+
+/**
+ * @}
+ * @}
+ */
@@ -0,0 +1,132 @@
+/**
+ ******************************************************************************
+ * @file       unittest.cpp
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @addtogroup UnitTests
+ * @{
+ * @addtogroup UnitTests
+ * @{
+ * @brief Unit test for the vertical estimator
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+/*
+ * NOTE: This program uses the Google Test infrastructure to drive the unit test
+ *
+ * Main site for Google Test: http://code.google.com/p/googletest/
+ * Documentation and examples: http://code.google.com/p/googletest/wiki/Documentation
+ */
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>		/* printf */
+#include <stdlib.h>		/* abort */
+#include <string.h>		/* memset */
+#include <stdint.h>		/* uint*_t */
+#include <math.h>		/* fabsf */
+
+extern "C" {
+
+#include "vert_est.h"
+
+}
+
+#define DT 0.001f
+#define BARO_DIVIDER 20		/* Baro samples at 50 Hz */
+#define TAU 2.0f
+
+class VertEst : public testing::Test {
+protected:
+	virtual void SetUp() {
+		vert_est_reset(&est, 100, TAU);
+
+		altitude = 100;
+		climb_rate = 0;
+		samples = 0;
+	}
+
+	/* Flies, climbing at climb_rate and accelerating by accel, with the
+	 * accels reading accel_bias too much */
+	void fly(float seconds, float accel = 0, float accel_bias = 0) {
+		for (int i = 0; i < seconds / DT; i++) {
+			climb_rate += accel * DT;
+			altitude += climb_rate * DT;
+
+			vert_est_predict(&est, -accel + accel_bias, DT);
+
+			if (++samples % BARO_DIVIDER == 0) {
+				vert_est_update_baro(&est, altitude);
+			}
+		}
+	}
+
+	struct vert_est est;
+	float altitude;
+	float climb_rate;
+	int samples;
+};
+
+TEST_F(VertEst, HoldsStill) {
+	fly(10);
+
+	EXPECT_EQ(0, est.position_z);
+	EXPECT_EQ(0, est.velocity_z);
+}
+
+TEST_F(VertEst, FollowsClimb) {
+	/* Accelerate to 2 m/s up, then hold it */
+	fly(1, 2);
+	fly(20);
+
+	EXPECT_NEAR(-2, est.velocity_z, 0.05f);
+	EXPECT_NEAR(100 - altitude, est.position_z, 0.2f);
+}
+
+TEST_F(VertEst, LearnsAccelBias) {
+	fly(30, 0, 0.5f);
+
+	EXPECT_NEAR(0, est.velocity_z, 0.02f);
+	EXPECT_NEAR(0, est.position_z, 0.05f);
+	EXPECT_NEAR(-0.5f, est.accel_correction_z, 0.02f);
+}
+
+TEST_F(VertEst, VelocityLeadsBaro) {
+	/* A sharp climb shows in the velocity before the next baro sample */
+	fly(10);
+
+	float before = est.velocity_z;
+
+	fly(BARO_DIVIDER / 2 * DT, 10);
+
+	EXPECT_LT(est.velocity_z, before - 0.05f);
+}
+
+TEST_F(VertEst, ResetZeroesAltitude) {
+	fly(1, 2);
+	fly(5);
+
+	vert_est_reset(&est, altitude, TAU);
+	climb_rate = 0;
+	fly(5);
+
+	EXPECT_NEAR(0, est.position_z, 0.05f);
+	EXPECT_NEAR(0, est.velocity_z, 0.05f);
+}
+
+/**
+ * @}
+ * @}
+ */
@@ -0,0 +1,25 @@
+include(../tools.pri)
+
+QT = core
+
+macx {
+    QMAKE_MACOSX_DEPLOYMENT_TARGET=10.9
+}
+
+cache()
+
+TARGET = autotuneanalyzer
+CONFIG += console thread
+CONFIG += c++11 strict_c++
+CONFIG -= app_bundle
+TEMPLATE = app
+
+# Build the GCS autotune library in, so the tool stands alone
+AUTOTUNE_LIB_DIR = $$PWD/../gcs/src/libs/autotune
+DEFINES += AUTOTUNE_STATIC_LIB
+INCLUDEPATH += $$AUTOTUNE_LIB_DIR $$PWD/../gcs/src/libs
+
+SOURCES += main.cpp \
+    $$AUTOTUNE_LIB_DIR/autotuneanalysis.cpp
+HEADERS += $$AUTOTUNE_LIB_DIR/autotuneanalysis.h \
+    $$AUTOTUNE_LIB_DIR/autotune_global.h
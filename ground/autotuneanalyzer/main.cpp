@@ -0,0 +1,276 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     dRonin, http://dronin.org Copyright (C) 2017
+ * @brief      Reprocesses saved autotune measurements in bulk.
+ *
+ * @see        The GNU Public License (GPL) Version 3
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "autotuneanalysis.h"
+
+#define RETURN_ERR_USAGE 1
+#define RETURN_ERR_INPUT 2
+#define RETURN_OK 0
+
+using namespace std;
+
+struct TuneFile
+{
+    string path;
+
+    bool readable;
+    bool valid;
+    bool converged;
+
+    AutotuneAnalysis::Properties props;
+    AutotuneAnalysis::Gains gains;
+};
+
+/* Defaults match the GCS autotune wizard's sliders */
+static double damping = 1.05;
+static double noiseSens = 0.010;
+static bool doOuterKi = false;
+
+/**
+ * print usage info
+ */
+static void usage()
+{
+    cout << "Usage: autotuneanalyzer [-j jobs] [-d damping] [-n noise] [-outerki] tune1 ... [tuneN]" << endl;
+    cout << "\t-j jobs        files to process at once (default: one per CPU)" << endl;
+    cout << "\t-d damping     damping, as the GCS's damping slider / 100 (default 1.05)" << endl;
+    cout << "\t-n noise       noise sensitivity, as the GCS's slider / 1000 (default 0.010)" << endl;
+    cout << "\t-outerki       compute an outer loop Ki" << endl;
+    cout << "\t-h             this help" << endl;
+    cout << "\ttune           an at_flash dump, as downloaded from the flight controller." << endl;
+    cout << "Writes one line of CSV per tune to stdout, in the order given." << endl;
+}
+
+/**
+ * inform user of invalid usage
+ */
+static int usage_err()
+{
+    cerr << "Invalid usage!" << endl;
+    usage();
+    return RETURN_ERR_USAGE;
+}
+
+static void processFile(AutotuneAnalysis &analysis, TuneFile *tune, bool parallel)
+{
+    ifstream in(tune->path, ios::binary);
+
+    tune->readable = in.good();
+    tune->valid = false;
+    tune->converged = false;
+
+    if (!tune->readable) {
+        return;
+    }
+
+    vector<char> data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+    tune->valid = analysis.process(data.data(), data.size(), &tune->props, parallel);
+
+    if (!tune->valid) {
+        return;
+    }
+
+    float tau[3], beta[3];
+
+    for (int axis = 0; axis < 3; axis++) {
+        tau[axis] = tune->props.axes[axis].tau;
+        beta[axis] = tune->props.axes[axis].beta;
+    }
+
+    tune->converged = AutotuneAnalysis::computeGains(tau, beta, damping, noiseSens,
+                                                     beta[2] >= AutotuneAnalysis::MIN_YAW_BETA,
+                                                     doOuterKi, &tune->gains);
+}
+
+static void printHeader()
+{
+    const char *axes[] = { "roll", "pitch", "yaw" };
+    const char *props[] = { "tau", "beta", "bias", "noise" };
+    const char *gains[] = { "kp", "ki", "kd" };
+
+    cout << "file,valid,sample_rate";
+
+    for (const char *prop : props) {
+        for (const char *axis : axes) {
+            cout << "," << prop << "_" << axis;
+        }
+    }
+
+    cout << ",converged,iterations";
+
+    for (const char *gain : gains) {
+        for (const char *axis : axes) {
+            cout << "," << gain << "_" << axis;
+        }
+    }
+
+    cout << ",derivative_cutoff,natural_freq,outer_kp,outer_ki" << endl;
+}
+
+static void printTune(const TuneFile &tune)
+{
+    cout << tune.path << "," << (tune.valid ? 1 : 0);
+
+    if (!tune.valid) {
+        cout << endl;
+        return;
+    }
+
+    const AutotuneAnalysis::Properties &props = tune.props;
+    const AutotuneAnalysis::Gains &gains = tune.gains;
+
+    cout << "," << props.sampleRate;
+
+    for (int axis = 0; axis < 3; axis++)
+        cout << "," << props.axes[axis].tau;
+    for (int axis = 0; axis < 3; axis++)
+        cout << "," << props.axes[axis].beta;
+    for (int axis = 0; axis < 3; axis++)
+        cout << "," << props.axes[axis].bias;
+    for (int axis = 0; axis < 3; axis++)
+        cout << "," << props.axes[axis].noise;
+
+    cout << "," << (tune.converged ? 1 : 0) << "," << gains.iterations;
+
+    for (int axis = 0; axis < 3; axis++)
+        cout << "," << gains.kp[axis];
+    for (int axis = 0; axis < 3; axis++)
+        cout << "," << gains.ki[axis];
+    for (int axis = 0; axis < 3; axis++)
+        cout << "," << gains.kd[axis];
+
+    cout << "," << gains.derivativeCutoff << "," << gains.naturalFreq << "," << gains.outerKp
+         << "," << gains.outerKi << endl;
+}
+
+/**
+ * entrance
+ */
+int main(int argc, char *argv[])
+{
+    unsigned int jobs = thread::hardware_concurrency();
+    vector<TuneFile> tunes;
+
+    // process arguments
+    for (int argi = 1; argi < argc; argi++) {
+        string arg = argv[argi];
+
+        if (arg == "-h") {
+            usage();
+            return RETURN_OK;
+        } else if (arg == "-outerki") {
+            doOuterKi = true;
+        } else if (arg == "-j" || arg == "-d" || arg == "-n") {
+            if (++argi >= argc) {
+                return usage_err();
+            }
+
+            char *end;
+            double value = strtod(argv[argi], &end);
+
+            if (*end || value <= 0) {
+                return usage_err();
+            }
+
+            if (arg == "-j") {
+                jobs = value;
+            } else if (arg == "-d") {
+                damping = value;
+            } else {
+                noiseSens = value;
+            }
+        } else {
+            TuneFile tune;
+            tune.path = arg;
+            tunes.push_back(tune);
+        }
+    }
+
+    if (tunes.empty()) {
+        return usage_err();
+    }
+
+    if (jobs < 1) {
+        jobs = 1;
+    }
+
+    if (jobs > tunes.size()) {
+        jobs = tunes.size();
+    }
+
+    if (jobs == 1) {
+        // Use the cores on one tune's axes instead
+        AutotuneAnalysis analysis;
+
+        for (TuneFile &tune : tunes) {
+            processFile(analysis, &tune, true);
+        }
+    } else {
+        // Each worker keeps its own analysis, and so its own FFT plans
+        atomic<size_t> next(0);
+        vector<thread> workers;
+
+        for (unsigned int i = 0; i < jobs; i++) {
+            workers.push_back(thread([&]() {
+                AutotuneAnalysis analysis;
+                size_t idx;
+
+                while ((idx = next++) < tunes.size()) {
+                    processFile(analysis, &tunes[idx], false);
+                }
+            }));
+        }
+
+        for (thread &worker : workers) {
+            worker.join();
+        }
+    }
+
+    int ret = RETURN_OK;
+
+    printHeader();
+
+    for (const TuneFile &tune : tunes) {
+        if (!tune.readable) {
+            cerr << tune.path << ": unable to read" << endl;
+            ret = RETURN_ERR_INPUT;
+        } else if (!tune.valid) {
+            cerr << tune.path << ": not a valid autotune" << endl;
+        }
+
+        printTune(tune);
+    }
+
+    return ret;
+}
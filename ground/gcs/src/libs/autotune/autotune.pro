@@ -0,0 +1,15 @@
+TEMPLATE = lib
+TARGET = Autotune
+
+QT *= core
+
+DEFINES += AUTOTUNE_LIB
+
+include(../../gcslibrary.pri)
+
+SOURCES += \
+    autotuneanalysis.cpp
+
+HEADERS += \
+    autotune_global.h \
+    autotuneanalysis.h
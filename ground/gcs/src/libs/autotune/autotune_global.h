@@ -0,0 +1,39 @@
+/**
+ ******************************************************************************
+ * @file       autotune_global.h
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @addtogroup libs GCS Libraries
+ * @{
+ * @addtogroup autotune Autotune
+ * @{
+ * @brief Analysis of autotune measurements into a tune
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef AUTOTUNE_GLOBAL_H
+#define AUTOTUNE_GLOBAL_H
+
+#include <QtCore/qglobal.h>
+
+#if defined(AUTOTUNE_LIB)
+#  define AUTOTUNE_EXPORT Q_DECL_EXPORT
+#elif  defined(AUTOTUNE_STATIC_LIB)
+#  define AUTOTUNE_EXPORT
+#else
+#  define AUTOTUNE_EXPORT Q_DECL_IMPORT
+#endif
+
+#endif // AUTOTUNE_GLOBAL_H
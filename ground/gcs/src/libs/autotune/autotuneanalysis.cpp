@@ -0,0 +1,411 @@
+/**
+ ******************************************************************************
+ * @file       autotuneanalysis.cpp
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2015-2017
+ * @addtogroup libs GCS Libraries
+ * @{
+ * @addtogroup autotune Autotune
+ * @{
+ * @brief Analysis of autotune measurements into a tune
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#define _USE_MATH_DEFINES
+
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <thread>
+
+#include "ffft/FFTReal.h"
+
+#include "autotuneanalysis.h"
+
+const uint64_t AutotuneAnalysis::ATFLASH_MAGIC;
+constexpr float AutotuneAnalysis::MIN_YAW_BETA;
+
+AutotuneAnalysis::AutotuneAnalysis()
+    : planPoints(0)
+{
+}
+
+AutotuneAnalysis::~AutotuneAnalysis()
+{
+}
+
+/* Run a Butterworth biquad filter on a circular buffer.  First go around once
+ * to "prime" the filter, then actually filter in place.  This is derived from
+ * @glowtape's excellent flight implementation
+ */
+void AutotuneAnalysis::biquadFilter(float cutoff, int pts, float *data)
+{
+    float f = 1.0f / tan(M_PI * cutoff);
+    float q = 1.4142f;
+
+    float y2 = 0, y1 = 0, x2 = 0, x1 = 0;
+
+    float b0 = 1.0f / (1.0f + q * f + f * f);
+    float a1 = 2.0f * (f * f - 1.0f) * b0;
+    float a2 = -(1.0f - q * f + f * f) * b0;
+
+    for (int i = 0; i < pts; i++) {
+        float y = b0 * (data[i] + 2.0f * x1 + x2) + a1 * y1 + a2 * y2;
+
+        y2 = y1;
+        y1 = y;
+
+        x2 = x1;
+        x1 = data[i];
+    }
+
+    for (int i = 0; i < pts; i++) {
+        float y = b0 * (data[i] + 2.0f * x1 + x2) + a1 * y1 + a2 * y2;
+
+        y2 = y1;
+        y1 = y;
+
+        x2 = x1;
+        x1 = data[i];
+
+        data[i] = y;
+    }
+}
+
+/* Returns number of samples of delay between series */
+float AutotuneAnalysis::getSampleDelay(int axis, int pts, const float *delayed,
+                                       const float *orig, int seriesCutoff)
+{
+    ffft::FFTReal<float> &fft = *plans[axis];
+
+    /* Convert to frequency domain */
+    std::vector<float> delayed_fft(pts);
+    fft.do_fft(delayed_fft.data(), delayed);
+
+    std::vector<float> orig_fft(pts);
+    fft.do_fft(orig_fft.data(), orig);
+
+    /* Now perform a correlation by multiplying -orig_fft* by delayed_fft.
+     * The types are all floats here, so we need to do the heavy lifting
+     * ourselves.   gfft = x+yi, dfft = u+vi, dfft* = u-vi,
+     * -dfft* = -u + vi
+     *
+     * -dfft* x gfft = (-ux - vy) + (vx - uy)i
+     */
+
+    std::vector<float> product(pts);
+
+    int fpts = pts / 2;
+
+    // Memory layout here is annoyin'.  All reals, then all imaginaries
+    for (int i = 0; i < fpts; i++) {
+        float x = delayed_fft[i];
+        float y = delayed_fft[i + fpts];
+        float u = orig_fft[i];
+        float v = orig_fft[i + fpts];
+
+        product[i] = -(u * x) - (v * y);
+        product[i + fpts] = (v * x) - (u * y);
+    }
+
+    /* Inverse FFT converts this to the time domain */
+    std::vector<float> prod_time(pts);
+
+    fft.do_ifft(product.data(), prod_time.data());
+
+    /* And we take magnitudes to find tau. */
+    int max_idx = 0;
+    float max_val = 0;
+
+    for (int i = 0; i < fpts / seriesCutoff; i++) {
+        float real = prod_time[i];
+        float imag = prod_time[i + fpts];
+        float mag = sqrt(real * real + imag * imag);
+
+        if (mag > max_val) {
+            max_val = mag;
+            max_idx = i;
+        }
+    }
+
+    // TODO / optional: interpolate/find a better peak around max_idx.
+
+    return max_idx;
+}
+
+void AutotuneAnalysis::processAxis(int axis, int pts, int sampleRate,
+                                   const at_measurement *meas, AxisProperties *props)
+{
+    std::vector<float> gyro_deriv(pts);
+    std::vector<float> actu_desired(pts);
+
+    for (int i = 0; i < pts; i++) {
+        actu_desired[i] = meas[i].u[axis];
+    }
+
+    // Differentiate the gyro data
+    for (int i = 1; i < pts; i++) {
+        gyro_deriv[i] = meas[i].y[axis] - meas[i - 1].y[axis];
+    }
+
+    gyro_deriv[0] = meas[0].y[axis] - meas[pts - 1].y[axis];
+
+    float sample_tau = getSampleDelay(axis, pts, gyro_deriv.data(), actu_desired.data(),
+                                      (axis == 2) ? 8 : 4);
+
+    float tau = sample_tau / sampleRate;
+
+    biquadFilter(1 / (sample_tau * M_PI * 1.414), pts, actu_desired.data());
+
+    std::vector<float> gyro_sorted = gyro_deriv;
+    std::vector<float> actu_sorted = actu_desired;
+
+    std::sort(gyro_sorted.begin(), gyro_sorted.end());
+    std::sort(actu_sorted.begin(), actu_sorted.end());
+
+    int low_idx = pts * 0.05 + 0.5;
+    int high_idx = pts - 1 - low_idx;
+
+    float gyro_span = gyro_sorted[high_idx] - gyro_sorted[low_idx];
+    float actu_span = actu_sorted[high_idx] - actu_sorted[low_idx];
+
+    float gain = gyro_span / actu_span * sampleRate;
+
+    float avg = std::accumulate(gyro_deriv.begin(), gyro_deriv.end(), 0.0f) / pts;
+
+    for (int i = 0; i < pts; i++) {
+        gyro_deriv[i] = gyro_deriv[i] - avg;
+    }
+
+    float avg_act = std::accumulate(actu_desired.begin(), actu_desired.end(), 0.0f) / pts;
+
+    for (int i = 0; i < pts; i++) {
+        actu_desired[i] = (actu_desired[i] - avg_act) * (gain / sampleRate);
+    }
+
+    float bias = avg - avg_act * (gain / sampleRate);
+
+    double noise = 0;
+
+    for (int i = 0; i < pts; i++) {
+        noise += (actu_desired[i] - gyro_deriv[i]) * (actu_desired[i] - gyro_deriv[i]);
+    }
+
+    noise = sqrt(noise / pts);
+
+    props->tau = tau;
+    props->beta = log(gain);
+    props->bias = bias;
+    props->noise = noise;
+
+    props->model.swap(actu_desired);
+    props->actual.swap(gyro_deriv);
+}
+
+bool AutotuneAnalysis::process(const void *data, size_t size, Properties *props, bool parallel)
+{
+    at_flash_header hdr;
+
+    /* Determine whether we have a sane amount of data, etc. */
+    if (size < sizeof(hdr)) {
+        return false;
+    }
+
+    memcpy(&hdr, data, sizeof(hdr));
+
+    if (hdr.magic != ATFLASH_MAGIC) {
+        return false;
+    }
+
+    size_t size_expected =
+        sizeof(hdr) + sizeof(at_measurement) * hdr.wiggle_points + hdr.aux_data_len;
+
+    if (size < size_expected) {
+        return false;
+    }
+
+    int pts = hdr.wiggle_points;
+
+    /* The FFT only handles powers of two */
+    if ((pts < 2) || (pts & (pts - 1)) || !hdr.sample_rate) {
+        return false;
+    }
+
+    float duration = (float)pts / hdr.sample_rate;
+
+    if ((duration < 0.25f) || (duration > 5.0f)) {
+        return false;
+    }
+
+    /* The measurements may not be aligned within the dump */
+    std::vector<at_measurement> meas(pts);
+    memcpy(meas.data(), static_cast<const char *>(data) + sizeof(hdr),
+           sizeof(at_measurement) * pts);
+
+    if (planPoints != pts) {
+        for (int axis = 0; axis < 3; axis++) {
+            plans[axis].reset(new ffft::FFTReal<float>(pts));
+        }
+
+        planPoints = pts;
+    }
+
+    props->sampleRate = hdr.sample_rate;
+
+    if (parallel) {
+        std::thread threads[3];
+
+        for (int axis = 0; axis < 3; axis++) {
+            threads[axis] = std::thread(&AutotuneAnalysis::processAxis, this, axis, pts,
+                                        hdr.sample_rate, meas.data(), &props->axes[axis]);
+        }
+
+        for (int axis = 0; axis < 3; axis++) {
+            threads[axis].join();
+        }
+    } else {
+        for (int axis = 0; axis < 3; axis++) {
+            processAxis(axis, pts, hdr.sample_rate, meas.data(), &props->axes[axis]);
+        }
+    }
+
+    return true;
+}
+
+bool AutotuneAnalysis::computeGains(const float tau_in[3], const float beta_in[3], double damp,
+                                    double ghf, bool doYaw, bool doOuterKi, Gains *gains)
+{
+    // These three parameters define the desired response properties
+    // - rate scale in the fraction of the natural speed of the system
+    //   to strive for.
+    // - damp is the amount of damping in the system. higher values
+    //   make oscillations less likely
+    // - ghf is the amount of high frequency gain and limits the influence
+    //   of noise
+
+    /* Average roll and pitch tau for now. */
+    double tau = (tau_in[0] + tau_in[1]) / 2.0;
+    double beta_roll = beta_in[0];
+    double beta_pitch = beta_in[1];
+
+    double wn = 1 / tau, wn_last = 1 / tau + 10;
+    double tau_d = 0, tau_d_last = 1000;
+
+    const int iteration_limit = 100, stability_limit = 5;
+    bool converged = false;
+    int iterations = 0;
+    int stable_iterations = 0;
+
+    while (!converged && (++iterations <= iteration_limit)) {
+        double tau_d_roll =
+            (2 * damp * tau * wn - 1) / (4 * tau * damp * damp * wn * wn - 2 * damp * wn
+                                         - tau * wn * wn + exp(beta_roll) * ghf);
+        double tau_d_pitch =
+            (2 * damp * tau * wn - 1) / (4 * tau * damp * damp * wn * wn - 2 * damp * wn
+                                         - tau * wn * wn + exp(beta_pitch) * ghf);
+
+        // Select the slowest filter property
+        tau_d = (tau_d_roll > tau_d_pitch) ? tau_d_roll : tau_d_pitch;
+        wn = (tau + tau_d) / (tau * tau_d) / (2 * damp + 2);
+
+        // check for convergence
+        if (fabs(tau_d - tau_d_last) <= 0.00001 && fabs(wn - wn_last) <= 0.00001) {
+            if (++stable_iterations >= stability_limit)
+                converged = true;
+        } else {
+            stable_iterations = 0;
+        }
+        tau_d_last = tau_d;
+        wn_last = wn;
+    }
+
+    gains->iterations = iterations;
+    gains->converged = converged;
+
+    gains->derivativeCutoff = 1 / (2 * M_PI * tau_d);
+    gains->naturalFreq = wn / 2 / M_PI;
+
+    // Set the real pole position. The first pole is quite slow, which
+    // prevents the integral being too snappy and driving too much
+    // overshoot.
+    const double a = ((tau + tau_d) / tau / tau_d - 2 * damp * wn) / 20.0;
+    const double b = ((tau + tau_d) / tau / tau_d - 2 * damp * wn - a);
+
+    // Calculate the gain for the outer loop by approximating the
+    // inner loop as a single order lpf. Set the outer loop to be
+    // critically damped;
+    const double zeta_o = 1.3;
+    gains->outerKp = 1 / 4.0 / (zeta_o * zeta_o) / (1 / wn);
+
+    // Except, if this is very high, we may be slew rate limited and pick
+    // up oscillation that way.  Fix it with very soft clamping.
+    // MaximumRate defaults to 350, 6.5 corresponds to where we begin
+    // clamping rate ourselves.  ESCs, etc, it depends upon gains
+    // and any pre-emphasis they do.   Still give ourselves partial credit
+    // for inner loop bandwidth.
+    if (gains->outerKp > 6.5) {
+        gains->outerKp = 6.5 - sqrt(6.5) + sqrt(gains->outerKp);
+    }
+
+    if (doOuterKi) {
+        gains->outerKp *= 0.95f; // Pick up some margin.
+        // Add a zero at 1/15th the innermost bandwidth.
+        gains->outerKi = 0.75 * gains->outerKp / (2 * M_PI * tau * 15.0);
+    } else {
+        gains->outerKi = 0;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        double beta = exp(beta_in[i]);
+
+        double ki;
+        double kp;
+        double kd;
+
+        ki = a * b * wn * wn * tau * tau_d / beta;
+        kp = tau * tau_d * ((a + b) * wn * wn + 2 * a * b * damp * wn) / beta - ki * tau_d;
+        kd = (tau * tau_d * (a * b + wn * wn + (a + b) * 2 * damp * wn) - 1) / beta - kp * tau_d;
+
+        gains->kp[i] = kp;
+        gains->ki[i] = ki;
+        gains->kd[i] = kd;
+    }
+
+    if (doYaw) {
+        // Don't take yaw beta completely seriously.  Why?
+        // 1) It's got two different time constants and magnitudes of
+        // effect (reaction wheel vs. drag).  Don't want to overcontrol.
+        // 2) Far better to be undertuned on yaw than to get into weird
+        // scenarios from coupling between axes.  If yaw is far less
+        // powerful than other axes, even a small amount of nonlinearity
+        // or cross-axis coupling will excite pitch and roll.
+        double scale = exp(0.6 * (beta_in[0] - beta_in[2]));
+        gains->kp[2] = gains->kp[0] * scale;
+        gains->ki[2] = 0.8 * gains->ki[0] * scale;
+        gains->kd[2] = 0.8 * gains->kd[0] * scale;
+    } else {
+        gains->kp[2] = -1;
+        gains->ki[2] = -1;
+        gains->kd[2] = -1;
+    }
+
+    return converged;
+}
+
+/**
+ * @}
+ * @}
+ */
@@ -0,0 +1,149 @@
+/**
+ ******************************************************************************
+ * @file       autotuneanalysis.h
+ * @author     dRonin, http://dRonin.org/, Copyright (C) 2017
+ * @addtogroup libs GCS Libraries
+ * @{
+ * @addtogroup autotune Autotune
+ * @{
+ * @brief Analysis of autotune measurements into a tune
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef AUTOTUNEANALYSIS_H
+#define AUTOTUNEANALYSIS_H
+
+#include "autotune_global.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace ffft {
+template <class DT>
+class FFTReal;
+}
+
+/**
+ * Turns the measurements the Autotune module saves to flash into the
+ * properties of each axis, and those into gains.  Doesn't depend on the
+ * GCS, so that archives of tunes can be reprocessed without it.
+ *
+ * An instance keeps its FFT plans between tunes, so reuse one to process
+ * many tunes of the same length.  An instance isn't reentrant; use one per
+ * thread.
+ */
+class AUTOTUNE_EXPORT AutotuneAnalysis
+{
+public:
+    static const uint64_t ATFLASH_MAGIC = 0x656e755480008041;
+
+    /* Layout of the flight side's struct at_flash */
+    struct at_flash_header
+    {
+        uint64_t magic;
+        uint16_t wiggle_points;
+        uint16_t aux_data_len;
+        uint16_t sample_rate;
+
+        // Consider total number of averages here
+        uint16_t resv;
+    };
+
+    struct at_measurement
+    {
+        float y[3]; /* Gyro measurements */
+        float u[3]; /* Actuator desired */
+    };
+
+    struct AxisProperties
+    {
+        float tau;
+        float beta;
+        float bias;
+        float noise;
+
+        /* Modelled and measured gyro derivative, one per sample */
+        std::vector<float> model;
+        std::vector<float> actual;
+    };
+
+    struct Properties
+    {
+        int sampleRate;
+        AxisProperties axes[3];
+    };
+
+    struct Gains
+    {
+        bool converged;
+        int iterations;
+
+        // -1 means "not calculated"
+        float kp[3];
+        float ki[3];
+        float kd[3];
+
+        float derivativeCutoff;
+        float naturalFreq;
+
+        float outerKp;
+        float outerKi;
+    };
+
+    /* Below this yaw beta, yaw gains can't be computed */
+    static constexpr float MIN_YAW_BETA = 6.8f;
+
+    AutotuneAnalysis();
+    ~AutotuneAnalysis();
+
+    AutotuneAnalysis(const AutotuneAnalysis &) = delete;
+    AutotuneAnalysis &operator=(const AutotuneAnalysis &) = delete;
+
+    /**
+     * Processes an at_flash dump.
+     * @param[in] data the dump
+     * @param[in] size its length
+     * @param[out] props properties of each axis
+     * @param[in] parallel whether to analyze the axes on their own threads
+     * @returns false if the dump isn't a plausible tune
+     */
+    bool process(const void *data, size_t size, Properties *props, bool parallel = true);
+
+    /**
+     * Computes gains from measured properties.
+     * @param[in] damp damping, 1 being critical
+     * @param[in] ghf high frequency gain; limits the influence of noise
+     * @returns whether the computation converged
+     */
+    static bool computeGains(const float tau[3], const float beta[3], double damp, double ghf,
+                             bool doYaw, bool doOuterKi, Gains *gains);
+
+    static void biquadFilter(float cutoff, int pts, float *data);
+
+private:
+    void processAxis(int axis, int pts, int sampleRate, const at_measurement *meas,
+                     AxisProperties *props);
+    float getSampleDelay(int axis, int pts, const float *delayed, const float *orig,
+                         int seriesCutoff);
+
+    /* FFTReal's plans keep a scratch buffer, so each axis gets its own */
+    int planPoints;
+    std::unique_ptr<ffft::FFTReal<float>> plans[3];
+};
+
+#endif // AUTOTUNEANALYSIS_H
@@ -9,7 +9,8 @@ SUBDIRS   = \
     tlmapcontrol \
     qwt \
     libcrashreporter-qt \
-    runguard
+    runguard \
+    autotune
 
 win32 {
 SUBDIRS   += \
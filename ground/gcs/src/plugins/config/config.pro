@@ -9,6 +9,7 @@ QT += charts
 
 include(../../gcsplugin.pri)
 
+include(../../libs/autotune/autotune.pri)
 include(../../libs/qwt/qwt.pri)
 include(../../libs/utils/utils.pri)
 
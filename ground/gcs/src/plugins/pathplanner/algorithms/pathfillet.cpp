@@ -25,6 +25,7 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
 #include <QInputDialog>
+#include <QStringList>
 #include <cmath>
 #include <algorithms/pathfillet.h>
 #include <waypoint.h>
@@ -33,8 +34,12 @@
 
 #define SIGN(x) (x < 0 ? -1 : 1)
 
+// Sideways acceleration a fillet may ask for, about a 45 degree bank
+#define MAX_TURN_ACCEL GRAVITY
+
 PathFillet::PathFillet(QObject *parent)
     : IPathAlgorithm(parent)
+    , cached_radius(-1)
 {
     // TODO: move into the constructor and come from the UI
     fillet_radius = 5;
@@ -54,16 +59,133 @@ bool PathFillet::configure(QWidget *callingUi)
 
     return ok;
 }
+
 /**
- * Verify the path is valid to run through this algorithm
+ * Verify the path is valid to run through this algorithm.  The fillets are
+ * worked out here, for the whole path at once, and kept for processPath.
  * @param[in] model the flight model to validate
  * @param[out] err an error message for the user for invalid paths
  * @return true for valid path, false for invalid
  */
 bool PathFillet::verifyPath(FlightDataModel *model, QString &err)
 {
-    Q_UNUSED(model);
-    Q_UNUSED(err);
+    const QVector<PathPlanNED> path = model->getPathNED();
+    QStringList problems;
+
+    for (int i = 0; i < path.size(); i++) {
+        if (path[i].mode == Waypoint::MODE_CIRCLEPOSITIONLEFT
+            || path[i].mode == Waypoint::MODE_CIRCLEPOSITIONRIGHT)
+            problems << tr("Waypoint %1 circles a position, which cannot be filleted.").arg(i + 1);
+    }
+
+    if (problems.isEmpty() && updateCorners(path)) {
+        for (int i = 0; i < corners.size(); i++) {
+            const struct Corner &corner = corners.at(i);
+
+            if (!corner.filleted)
+                continue;
+
+            if (corner.radius <= 0) {
+                problems << tr("Waypoint %1 is too close to its neighbours to fillet.").arg(i + 1);
+                continue;
+            }
+
+            float velocity = path[i].velocity;
+            if (velocity * velocity / corner.radius > MAX_TURN_ACCEL)
+                problems << tr("Waypoint %1 needs a turn radius of %2 m at %3 m/s, but only %4 m "
+                               "fits.")
+                                .arg(i + 1)
+                                .arg(velocity * velocity / MAX_TURN_ACCEL, 0, 'f', 1)
+                                .arg(velocity, 0, 'f', 1)
+                                .arg(corner.radius, 0, 'f', 1);
+        }
+    }
+
+    if (!problems.isEmpty()) {
+        err = problems.join("\n");
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Process the flight path according to the algorithm.  Corners already
+ * worked out by verifyPath, or by an earlier run on a path that only
+ * differs elsewhere, are reused; the result is written back in one go.
+ * @param[in,out] model the flight model to process
+ * @return true for success, false for failure
+ */
+bool PathFillet::processPath(FlightDataModel *model)
+{
+    if (!updateCorners(model->getPathNED()))
+        return false;
+
+    QVector<PathPlanNED> output;
+
+    foreach (const struct Corner &corner, corners)
+        output += corner.points;
+
+    return model->setPathNED(output);
+}
+
+//! Whether two waypoints would fillet the same
+static bool samePoint(const PathPlanNED &a, const PathPlanNED &b)
+{
+    return a.north == b.north && a.east == b.east && a.down == b.down && a.velocity == b.velocity
+        && a.mode == b.mode && a.mode_params == b.mode_params;
+}
+
+/**
+ * @brief PathFillet::updateCorners Bring the corners up to date with a path.
+ * A waypoint's corner depends on it, the next waypoint, and where the corner
+ * before it leaves off, so only those around a change are recomputed.
+ * @param path The path to fillet
+ * @return true for success, false if a waypoint cannot be filleted
+ */
+bool PathFillet::updateCorners(const QVector<PathPlanNED> &path)
+{
+    const int old_count = input.size();
+    const int count = path.size();
+
+    bool all = fillet_radius != cached_radius || corners.size() != old_count;
+
+    QVector<bool> changed(count);
+    for (int i = 0; i < count; i++)
+        changed[i] = all || i >= old_count || !samePoint(path[i], input[i]);
+
+    corners.resize(count);
+
+    bool prev_moved = false;
+
+    for (int i = 0; i < count; i++) {
+        bool was_last = i == old_count - 1;
+        bool is_last = i == count - 1;
+
+        if (!changed[i] && !(i + 1 < count && changed[i + 1]) && was_last == is_last
+            && !prev_moved)
+            continue;
+
+        bool had_points = !corners[i].points.isEmpty();
+        PathPlanNED old_exit;
+        if (had_points)
+            old_exit = corners[i].points.last();
+
+        PathPlanNED prev_exit;
+        if (i > 0)
+            prev_exit = corners[i - 1].points.last();
+
+        if (!filletWaypoint(path, i, (i > 0) ? &prev_exit : NULL, corners[i])) {
+            input.clear();
+            corners.clear();
+            return false;
+        }
+
+        prev_moved = !had_points || !samePoint(old_exit, corners[i].points.last());
+    }
+
+    input = path;
+    cached_radius = fillet_radius;
 
     return true;
 }
@@ -76,376 +198,349 @@ bool PathFillet::verifyPath(FlightDataModel *model, QString &err)
  * The general approach is that before adding a new segment, the
  * path planner looks ahead at the next waypoint, and adds in fillets that align the vehicle with
  * this next waypoint.
- * @param[in] original the flight model to process
- * @param[out] new the resulting flight model
+ * @param[in] path the waypoints to process
+ * @param[in] wpIdx the waypoint to fillet
+ * @param[in] prev_exit the last waypoint the one before turned into, or NULL for the first
+ * @param[out] corner what this waypoint turns into
  * @return true for success, false for failure
  */
-bool PathFillet::processPath(FlightDataModel *model)
+bool PathFillet::filletWaypoint(const QVector<PathPlanNED> &path, int wpIdx,
+                                const PathPlanNED *prev_exit, struct Corner &corner)
 {
-    new_model = new FlightDataModel(this);
-
-    int newWaypointIdx = 0;
-
     float pos_prev[3];
     float pos_current[3];
     float pos_next[3];
 
     float previous_curvature;
 
-    for (int wpIdx = 0; wpIdx < model->rowCount(); wpIdx++) {
+    corner.points.clear();
+    corner.filleted = false;
+    corner.radius = 0;
+
+    const PathPlanNED &wp = path.at(wpIdx);
+
+    // Get the location
+    pos_current[0] = wp.north;
+    pos_current[1] = wp.east;
+    pos_current[2] = wp.down;
+
+    // Get the internal parameters
+    quint8 Mode = wp.mode;
+    float ModeParameters = wp.mode_params;
+    float finalVelocity = wp.velocity;
+
+    // Determine if the path is a straight line or if it arcs
+    float curvature = 0;
+    switch (Mode) {
+    case Waypoint::MODE_CIRCLEPOSITIONRIGHT:
+        return false;
+    case Waypoint::MODE_CIRCLERIGHT:
+        curvature = 1.0f / ModeParameters;
+        break;
+    case Waypoint::MODE_CIRCLEPOSITIONLEFT:
+        return false;
+    case Waypoint::MODE_CIRCLELEFT:
+        curvature = -1.0f / ModeParameters;
+        break;
+    }
 
-        // Get the location
-        pos_current[0] = model->data(model->index(wpIdx, FlightDataModel::NED_NORTH)).toDouble();
-        pos_current[1] = model->data(model->index(wpIdx, FlightDataModel::NED_EAST)).toDouble();
-        pos_current[2] = model->data(model->index(wpIdx, FlightDataModel::NED_DOWN)).toDouble();
+    // First waypoint cannot be fileting since we don't have start.  Keep intact.  Nor can
+    // the last, or any when filleting is off.
+    if (wpIdx == 0 || wpIdx == path.size() - 1 || fillet_radius <= 0) {
+        setNewWaypoint(corner, pos_current, finalVelocity, curvature);
+        return true;
+    }
 
-        // Get the internal parameters
-        quint8 Mode = model->data(model->index(wpIdx, FlightDataModel::MODE), Qt::UserRole).toInt();
-        float ModeParameters =
-            model->data(model->index(wpIdx, FlightDataModel::MODE_PARAMS)).toFloat();
-        float finalVelocity = model->data(model->index(wpIdx, FlightDataModel::VELOCITY)).toFloat();
+    // If waypoints have been set on the new path then use that to know the previous
+    // location.  Otherwise this is setting the first segment.  On board that uses the
+    // current location but while planning offline this is unknown so we use home.
+    if (prev_exit) {
+        pos_prev[0] = prev_exit->north;
+        pos_prev[1] = prev_exit->east;
+        pos_prev[2] = prev_exit->down;
+        // TODO: fix sign
+        float previous_radius = prev_exit->mode_params;
+        previous_curvature = (previous_radius < 1e-4) ? 0 : 1.0 / previous_radius;
+    } else {
+        // Use the home location as the starting point of paths.
+        pos_prev[0] = 0;
+        pos_prev[1] = 0;
+        pos_prev[2] = 0;
+        previous_curvature = 0;
+    }
 
-        // Determine if the path is a straight line or if it arcs
-        float curvature = 0;
-        switch (Mode) {
-        case Waypoint::MODE_CIRCLEPOSITIONRIGHT:
-            return false;
-        case Waypoint::MODE_CIRCLERIGHT:
-            curvature = 1.0f / ModeParameters;
-            break;
-        case Waypoint::MODE_CIRCLEPOSITIONLEFT:
-            return false;
-        case Waypoint::MODE_CIRCLELEFT:
-            curvature = -1.0f / ModeParameters;
-            break;
+    // Get the settings for the upcoming waypoint
+    const PathPlanNED &next = path.at(wpIdx + 1);
+    pos_next[0] = next.north;
+    pos_next[1] = next.east;
+    pos_next[2] = next.down;
+    quint8 NextMode = next.mode;
+
+    float NextModeParameter = 0;
+    bool future_path_is_circle = NextMode == Waypoint::MODE_CIRCLEPOSITIONRIGHT
+        || NextMode == Waypoint::MODE_CIRCLEPOSITIONLEFT;
+
+    // The vector in and out of the current waypoint
+    float q_future[3];
+    float q_future_mag = 0;
+    float q_current[3];
+    float q_current_mag = 0;
+
+    // In the case of line-line intersection lines, this is simply the direction of
+    // the old and new segments.
+    if (curvature == 0
+        && (NextModeParameter == 0
+            || future_path_is_circle)) { // Fixme: waypoint_future.ModeParameters needs to
+                                         // be replaced by waypoint_future.Mode. FOr this,
+                                         // we probably need a new function to handle the
+                                         // switch(waypoint.Mode)
+
+        // Vector from past to present switching locus
+        q_current[0] = pos_current[0] - pos_prev[0];
+        q_current[1] = pos_current[1] - pos_prev[1];
+
+        // Calculate vector from preset to future switching locus
+        q_future[0] = pos_next[0] - pos_current[0];
+        q_future[1] = pos_next[1] - pos_current[1];
+    }
+    // In the case of line-arc intersections, calculate the tangent of the new section.
+    else if (curvature == 0
+             && (NextModeParameter != 0
+                 && !future_path_is_circle)) { // Fixme: waypoint_future.ModeParameters
+                                               // needs to be replaced by
+                                               // waypoint_future.Mode. FOr this, we
+                                               // probably need a new function to handle the
+                                               // switch(waypoint.Mode)
+        // Old segment: straight line
+        q_current[0] = pos_current[0] - pos_prev[0];
+        q_current[1] = pos_current[1] - pos_prev[1];
+
+        // New segment: Vector perpendicular to the vector from arc center to tangent point
+        bool clockwise = curvature > 0;
+        qint8 lambda;
+
+        if (clockwise == true) { // clockwise
+            lambda = 1;
+        } else { // counterclockwise
+            lambda = -1;
         }
 
-        // First waypoint cannot be fileting since we don't have start.  Keep intact.
-        if (wpIdx == 0) {
-            setNewWaypoint(newWaypointIdx++, pos_current, finalVelocity, curvature);
-            continue;
+        // Calculate circle center
+        float arcCenter_NE[2];
+        find_arc_center(pos_current, pos_next, 1.0f / curvature, arcCenter_NE, curvature > 0,
+                        true);
+
+        // Vector perpendicular to the vector from arc center to tangent point
+        q_future[0] = -lambda * (pos_current[1] - arcCenter_NE[1]);
+        q_future[1] = lambda * (pos_current[0] - arcCenter_NE[0]);
+    }
+    // In the case of arc-line intersections, calculate the tangent of the old section.
+    else if (curvature != 0
+             && (NextModeParameter == 0
+                 || future_path_is_circle)) { // Fixme: waypoint_future.ModeParameters needs
+                                              // to be replaced by waypoint_future.Mode. FOr
+                                              // this, we probably need a new function to
+                                              // handle the switch(waypoint.Mode)
+        // Old segment: Vector perpendicular to the vector from arc center to tangent point
+        bool clockwise = previous_curvature > 0;
+        bool minor = true;
+        qint8 lambda;
+
+        if ((clockwise == true && minor == true)
+            || (clockwise == false && minor == false)) { // clockwise minor OR counterclockwise major
+            lambda = 1;
+        } else { // counterclockwise minor OR clockwise major
+            lambda = -1;
         }
 
-        // Only add fillets if the radius is greater than 0, and this is not the last waypoint
-        if (fillet_radius > 0 && wpIdx < (model->rowCount() - 1)) {
-            // If waypoints have been set on the new model then use that to know the previous
-            // location.  Otherwise this is setting the first segment.  On board that uses the
-            // current location but while planning offline this is unknown so we use home.
-            if (newWaypointIdx > 0) {
-                pos_prev[0] =
-                    new_model
-                        ->data(new_model->index(newWaypointIdx - 1, FlightDataModel::NED_NORTH))
-                        .toDouble();
-                pos_prev[1] =
-                    new_model->data(new_model->index(newWaypointIdx - 1, FlightDataModel::NED_EAST))
-                        .toDouble();
-                pos_prev[2] =
-                    new_model->data(new_model->index(newWaypointIdx - 1, FlightDataModel::NED_DOWN))
-                        .toDouble();
-                // TODO: fix sign
-                float previous_radius =
-                    new_model
-                        ->data(new_model->index(newWaypointIdx - 1, FlightDataModel::MODE_PARAMS))
-                        .toDouble();
-                previous_curvature = (previous_radius < 1e-4) ? 0 : 1.0 / previous_radius;
-            } else {
-                // Use the home location as the starting point of paths.
-                pos_prev[0] = 0;
-                pos_prev[1] = 0;
-                pos_prev[2] = 0;
-                previous_curvature = 0;
-            }
+        // Calculate old circle center
+        float arcCenter_NE[2];
+        find_arc_center(pos_prev, pos_current, 1.0f / previous_curvature, arcCenter_NE, clockwise,
+                        minor);
 
-            // Get the settings for the upcoming waypoint
-            pos_next[0] =
-                model->data(model->index(wpIdx + 1, FlightDataModel::NED_NORTH)).toDouble();
-            pos_next[1] =
-                model->data(model->index(wpIdx + 1, FlightDataModel::NED_EAST)).toDouble();
-            pos_next[2] =
-                model->data(model->index(wpIdx + 1, FlightDataModel::NED_DOWN)).toDouble();
-            quint8 NextMode =
-                model->data(model->index(wpIdx + 1, FlightDataModel::MODE), Qt::UserRole).toInt();
-            float NextModeParameter =
-                model->data(model->index(wpIdx + 1, FlightDataModel::MODE_PARAMS), Qt::UserRole)
-                    .toInt();
-
-            NextModeParameter = 0;
-            bool future_path_is_circle = NextMode == Waypoint::MODE_CIRCLEPOSITIONRIGHT
-                || NextMode == Waypoint::MODE_CIRCLEPOSITIONLEFT;
-
-            // The vector in and out of the current waypoint
-            float q_future[3];
-            float q_future_mag = 0;
-            float q_current[3];
-            float q_current_mag = 0;
-
-            // In the case of line-line intersection lines, this is simply the direction of
-            // the old and new segments.
-            if (curvature == 0
-                && (NextModeParameter == 0
-                    || future_path_is_circle)) { // Fixme: waypoint_future.ModeParameters needs to
-                                                 // be replaced by waypoint_future.Mode. FOr this,
-                                                 // we probably need a new function to handle the
-                                                 // switch(waypoint.Mode)
-
-                // Vector from past to present switching locus
-                q_current[0] = pos_current[0] - pos_prev[0];
-                q_current[1] = pos_current[1] - pos_prev[1];
-
-                // Calculate vector from preset to future switching locus
-                q_future[0] = pos_next[0] - pos_current[0];
-                q_future[1] = pos_next[1] - pos_current[1];
-            }
-            // In the case of line-arc intersections, calculate the tangent of the new section.
-            else if (curvature == 0
-                     && (NextModeParameter != 0
-                         && !future_path_is_circle)) { // Fixme: waypoint_future.ModeParameters
-                                                       // needs to be replaced by
-                                                       // waypoint_future.Mode. FOr this, we
-                                                       // probably need a new function to handle the
-                                                       // switch(waypoint.Mode)
-                // Old segment: straight line
-                q_current[0] = pos_current[0] - pos_prev[0];
-                q_current[1] = pos_current[1] - pos_prev[1];
-
-                // New segment: Vector perpendicular to the vector from arc center to tangent point
-                bool clockwise = curvature > 0;
-                qint8 lambda;
-
-                if (clockwise == true) { // clockwise
-                    lambda = 1;
-                } else { // counterclockwise
-                    lambda = -1;
-                }
-
-                // Calculate circle center
-                float arcCenter_NE[2];
-                find_arc_center(pos_current, pos_next, 1.0f / curvature, arcCenter_NE,
-                                curvature > 0, true);
-
-                // Vector perpendicular to the vector from arc center to tangent point
-                q_future[0] = -lambda * (pos_current[1] - arcCenter_NE[1]);
-                q_future[1] = lambda * (pos_current[0] - arcCenter_NE[0]);
-            }
-            // In the case of arc-line intersections, calculate the tangent of the old section.
-            else if (curvature != 0
-                     && (NextModeParameter == 0
-                         || future_path_is_circle)) { // Fixme: waypoint_future.ModeParameters needs
-                                                      // to be replaced by waypoint_future.Mode. FOr
-                                                      // this, we probably need a new function to
-                                                      // handle the switch(waypoint.Mode)
-                // Old segment: Vector perpendicular to the vector from arc center to tangent point
-                bool clockwise = previous_curvature > 0;
-                bool minor = true;
-                qint8 lambda;
-
-                if ((clockwise == true && minor == true)
-                    || (clockwise == false
-                        && minor == false)) { // clockwise minor OR counterclockwise major
-                    lambda = 1;
-                } else { // counterclockwise minor OR clockwise major
-                    lambda = -1;
-                }
-
-                // Calculate old circle center
-                float arcCenter_NE[2];
-                find_arc_center(pos_prev, pos_current, 1.0f / previous_curvature, arcCenter_NE,
-                                clockwise, minor);
-
-                // Vector perpendicular to the vector from arc center to tangent point
-                q_current[0] = -lambda * (pos_current[1] - arcCenter_NE[1]);
-                q_current[1] = lambda * (pos_current[0] - arcCenter_NE[0]);
-
-                // New segment: straight line
-                q_future[0] = pos_next[0] - pos_current[0];
-                q_future[1] = pos_next[1] - pos_current[1];
-            }
-            // In the case of arc-arc intersections, calculate the tangent of the old and new
-            // sections.
-            else if (curvature != 0
-                     && (NextModeParameter != 0
-                         && !future_path_is_circle)) { // Fixme: waypoint_future.ModeParameters
-                                                       // needs to be replaced by
-                                                       // waypoint_future.Mode. FOr this, we
-                                                       // probably need a new function to handle the
-                                                       // switch(waypoint.Mode)
-                // Old segment: Vector perpendicular to the vector from arc center to tangent point
-                bool clockwise = previous_curvature > 0;
-                bool minor = true;
-                qint8 lambda;
-
-                if ((clockwise == true && minor == true)
-                    || (clockwise == false
-                        && minor == false)) { // clockwise minor OR counterclockwise major
-                    lambda = 1;
-                } else { // counterclockwise minor OR clockwise major
-                    lambda = -1;
-                }
-
-                // Calculate old arc center
-                float arcCenter_NE[2];
-                find_arc_center(pos_prev, pos_current, 1.0f / previous_curvature, arcCenter_NE,
-                                clockwise, minor);
-
-                // New segment: Vector perpendicular to the vector from arc center to tangent point
-                q_current[0] = -lambda * (pos_prev[1] - arcCenter_NE[1]);
-                q_current[1] = lambda * (pos_prev[0] - arcCenter_NE[0]);
-
-                if (curvature > 0) { // clockwise
-                    lambda = 1;
-                } else { // counterclockwise
-                    lambda = -1;
-                }
-
-                // Calculate new arc center
-                find_arc_center(pos_current, pos_next, 1.0f / curvature, arcCenter_NE,
-                                curvature > 0, true);
-
-                // Vector perpendicular to the vector from arc center to tangent point
-                q_future[0] = -lambda * (pos_current[1] - arcCenter_NE[1]);
-                q_future[1] = lambda * (pos_current[0] - arcCenter_NE[0]);
-            }
+        // Vector perpendicular to the vector from arc center to tangent point
+        q_current[0] = -lambda * (pos_current[1] - arcCenter_NE[1]);
+        q_current[1] = lambda * (pos_current[0] - arcCenter_NE[0]);
 
-            q_current[2] = 0;
-            q_current_mag = VectorMagnitude(q_current); // Normalize
-            q_future[2] = 0;
-            q_future_mag = VectorMagnitude(q_future); // Normalize
+        // New segment: straight line
+        q_future[0] = pos_next[0] - pos_current[0];
+        q_future[1] = pos_next[1] - pos_current[1];
+    }
+    // In the case of arc-arc intersections, calculate the tangent of the old and new
+    // sections.
+    else if (curvature != 0
+             && (NextModeParameter != 0
+                 && !future_path_is_circle)) { // Fixme: waypoint_future.ModeParameters
+                                               // needs to be replaced by
+                                               // waypoint_future.Mode. FOr this, we
+                                               // probably need a new function to handle the
+                                               // switch(waypoint.Mode)
+        // Old segment: Vector perpendicular to the vector from arc center to tangent point
+        bool clockwise = previous_curvature > 0;
+        bool minor = true;
+        qint8 lambda;
+
+        if ((clockwise == true && minor == true)
+            || (clockwise == false && minor == false)) { // clockwise minor OR counterclockwise major
+            lambda = 1;
+        } else { // counterclockwise minor OR clockwise major
+            lambda = -1;
+        }
 
-            // Normalize q_current and q_future
-            if (q_current_mag > 0) {
-                for (int i = 0; i < 3; i++)
-                    q_current[i] = q_current[i] / q_current_mag;
-            }
-            if (q_future_mag > 0) {
-                for (int i = 0; i < 3; i++)
-                    q_future[i] = q_future[i] / q_future_mag;
-            }
+        // Calculate old arc center
+        float arcCenter_NE[2];
+        find_arc_center(pos_prev, pos_current, 1.0f / previous_curvature, arcCenter_NE, clockwise,
+                        minor);
 
-            // Compute heading difference between current and future tangents.
-            float theta = angle_between_2d_vectors(q_current, q_future);
-
-            // Compute angle between current and future tangents.
-            float rho = circular_modulus_rad(theta - M_PI);
-
-            // Compute half angle
-            float rho2 = rho / 2.0f;
-
-            // Circle the outside of acute angles
-            if (fabsf(rho) < M_PI / 3.0f) {
-                float R = fillet_radius;
-                if (q_current_mag > 0 && q_current_mag < R * sqrtf(3))
-                    R = q_current_mag / sqrtf(3)
-                        - 0.1f; // Remove 10cm to guarantee that no two points overlap.
-                if (q_future_mag > 0 && q_future_mag < R * sqrtf(3))
-                    R = q_future_mag / sqrtf(3)
-                        - 0.1f; // Remove 10cm to guarantee that no two points overlap.
-
-                // The sqrt(3) term comes from the fact that the triangle that connects the center
-                // of
-                // the first/second arc with the center of the second/third arc is a 1-2-sqrt(3)
-                // triangle
-                float f1[3] = { pos_current[0] - R * q_current[0] * sqrtf(3),
-                                pos_current[1] - R * q_current[1] * sqrtf(3), pos_current[2] };
-                float f2[3] = { pos_current[0] + R * q_future[0] * sqrtf(3),
-                                pos_current[1] + R * q_future[1] * sqrtf(3), pos_current[2] };
-
-                // Add the waypoint segment
-                newWaypointIdx +=
-                    addNonCircleToSwitchingLoci(f1, finalVelocity, curvature, newWaypointIdx);
-
-                float gamma = atan2f(q_current[1], q_current[0]);
-
-                // Compute eta, which is the angle between the horizontal and the center of the
-                // filleting arc f1 and
-                // sigma, which is the angle between the horizontal and the center of the filleting
-                // arc f2.
-                float eta;
-                float sigma;
-                if (theta > 0) { // Change in direction is clockwise, so fillets are clockwise
-                    eta = gamma - M_PI / 2.0f;
-                    sigma = gamma + theta - M_PI / 2.0f;
-                } else {
-                    eta = gamma + M_PI / 2.0f;
-                    sigma = gamma + theta + M_PI / 2.0f;
-                }
-
-                // This starts the fillet into the circle
-                float pos[3] = { (pos_current[0] + f1[0] + R * cosf(eta)) / 2,
-                                 (pos_current[1] + f1[1] + R * sinf(eta)) / 2, pos_current[2] };
-                setNewWaypoint(newWaypointIdx++, pos, finalVelocity, -SIGN(theta) * 1.0f / R);
-
-                // This is the halfway point through the circle
-                pos[0] = pos_current[0] + R * cosf(gamma);
-                pos[1] = pos_current[1] + R * sinf(gamma);
-                pos[2] = pos_current[2];
-                setNewWaypoint(newWaypointIdx++, pos, finalVelocity, SIGN(theta) * 1.0f / R);
-
-                // This is the transition from the circle to the fillet back onto the path
-                pos[0] = (pos_current[0] + (f2[0] + R * cosf(sigma))) / 2;
-                pos[1] = (pos_current[1] + (f2[1] + R * sinf(sigma))) / 2;
-                pos[2] = pos_current[2];
-                setNewWaypoint(newWaypointIdx++, pos, finalVelocity, SIGN(theta) * 1.0f / R);
-
-                // This is the point back on the path
-                pos[0] = f2[0];
-                pos[1] = f2[1];
-                pos[2] = pos_current[2];
-                setNewWaypoint(newWaypointIdx++, pos, finalVelocity, -SIGN(theta) * 1.0f / R);
-            } else if (theta != 0) { // The two tangents have different directions
-                float R = fillet_radius;
-
-                // Remove 10cm to guarantee that no two points overlap. This would be better if we
-                // solved it by removing the next point instead.
-                if (q_current_mag > 0 && q_current_mag < fabsf(R / tanf(rho2)))
-                    R = qMin(R, q_current_mag * fabsf(tanf(rho2)) - 0.1f);
-                if (q_future_mag > 0 && q_future_mag < fabsf(R / tanf(rho2)))
-                    R = qMin(R, q_future_mag * fabsf(tanf(rho2)) - 0.1f);
-
-                // Add the waypoint segment
-                float f1[3];
-                f1[0] = pos_current[0] - R / fabsf(tanf(rho2)) * q_current[0];
-                f1[1] = pos_current[1] - R / fabsf(tanf(rho2)) * q_current[1];
-                f1[2] = pos_current[2];
-                newWaypointIdx +=
-                    addNonCircleToSwitchingLoci(f1, finalVelocity, curvature, newWaypointIdx);
-
-                // Add the filleting segment in preparation for the next waypoint
-                float pos[3] = { pos_current[0] + R / fabsf(tanf(rho2)) * q_future[0],
-                                 pos_current[1] + R / fabsf(tanf(rho2)) * q_future[1],
-                                 pos_current[2] };
-                setNewWaypoint(newWaypointIdx++, pos, finalVelocity, SIGN(theta) * 1.0f / R);
-
-            } else {
-                // In this case, the two tangents are colinear
-                newWaypointIdx += addNonCircleToSwitchingLoci(pos_current, finalVelocity, curvature,
-                                                              newWaypointIdx);
-            }
-        } else if (wpIdx == model->rowCount() - 1)
-            // This is the final waypoint
-            newWaypointIdx +=
-                addNonCircleToSwitchingLoci(pos_current, finalVelocity, curvature, newWaypointIdx);
+        // New segment: Vector perpendicular to the vector from arc center to tangent point
+        q_current[0] = -lambda * (pos_prev[1] - arcCenter_NE[1]);
+        q_current[1] = lambda * (pos_prev[0] - arcCenter_NE[0]);
+
+        if (curvature > 0) { // clockwise
+            lambda = 1;
+        } else { // counterclockwise
+            lambda = -1;
+        }
+
+        // Calculate new arc center
+        find_arc_center(pos_current, pos_next, 1.0f / curvature, arcCenter_NE, curvature > 0,
+                        true);
+
+        // Vector perpendicular to the vector from arc center to tangent point
+        q_future[0] = -lambda * (pos_current[1] - arcCenter_NE[1]);
+        q_future[1] = lambda * (pos_current[0] - arcCenter_NE[0]);
     }
 
-    // Migrate the data to the original model now it is complete
-    model->replaceData(new_model);
-    delete new_model;
-    new_model = NULL;
+    q_current[2] = 0;
+    q_current_mag = VectorMagnitude(q_current); // Normalize
+    q_future[2] = 0;
+    q_future_mag = VectorMagnitude(q_future); // Normalize
+
+    // Normalize q_current and q_future
+    if (q_current_mag > 0) {
+        for (int i = 0; i < 3; i++)
+            q_current[i] = q_current[i] / q_current_mag;
+    }
+    if (q_future_mag > 0) {
+        for (int i = 0; i < 3; i++)
+            q_future[i] = q_future[i] / q_future_mag;
+    }
+
+    // Compute heading difference between current and future tangents.
+    float theta = angle_between_2d_vectors(q_current, q_future);
+
+    // Compute angle between current and future tangents.
+    float rho = circular_modulus_rad(theta - M_PI);
+
+    // Compute half angle
+    float rho2 = rho / 2.0f;
+
+    // Circle the outside of acute angles
+    if (fabsf(rho) < M_PI / 3.0f) {
+        float R = fillet_radius;
+        if (q_current_mag > 0 && q_current_mag < R * sqrtf(3))
+            R = q_current_mag / sqrtf(3) - 0.1f; // Remove 10cm to guarantee that no two points
+                                                 // overlap.
+        if (q_future_mag > 0 && q_future_mag < R * sqrtf(3))
+            R = q_future_mag / sqrtf(3) - 0.1f; // Remove 10cm to guarantee that no two points
+                                                // overlap.
+
+        corner.filleted = true;
+        corner.radius = R;
+
+        // The sqrt(3) term comes from the fact that the triangle that connects the center
+        // of
+        // the first/second arc with the center of the second/third arc is a 1-2-sqrt(3)
+        // triangle
+        float f1[3] = { pos_current[0] - R * q_current[0] * sqrtf(3),
+                        pos_current[1] - R * q_current[1] * sqrtf(3), pos_current[2] };
+        float f2[3] = { pos_current[0] + R * q_future[0] * sqrtf(3),
+                        pos_current[1] + R * q_future[1] * sqrtf(3), pos_current[2] };
+
+        // Add the waypoint segment
+        addNonCircleToSwitchingLoci(corner, f1, finalVelocity, curvature);
+
+        float gamma = atan2f(q_current[1], q_current[0]);
+
+        // Compute eta, which is the angle between the horizontal and the center of the
+        // filleting arc f1 and
+        // sigma, which is the angle between the horizontal and the center of the filleting
+        // arc f2.
+        float eta;
+        float sigma;
+        if (theta > 0) { // Change in direction is clockwise, so fillets are clockwise
+            eta = gamma - M_PI / 2.0f;
+            sigma = gamma + theta - M_PI / 2.0f;
+        } else {
+            eta = gamma + M_PI / 2.0f;
+            sigma = gamma + theta + M_PI / 2.0f;
+        }
+
+        // This starts the fillet into the circle
+        float pos[3] = { (pos_current[0] + f1[0] + R * cosf(eta)) / 2,
+                         (pos_current[1] + f1[1] + R * sinf(eta)) / 2, pos_current[2] };
+        setNewWaypoint(corner, pos, finalVelocity, -SIGN(theta) * 1.0f / R);
+
+        // This is the halfway point through the circle
+        pos[0] = pos_current[0] + R * cosf(gamma);
+        pos[1] = pos_current[1] + R * sinf(gamma);
+        pos[2] = pos_current[2];
+        setNewWaypoint(corner, pos, finalVelocity, SIGN(theta) * 1.0f / R);
+
+        // This is the transition from the circle to the fillet back onto the path
+        pos[0] = (pos_current[0] + (f2[0] + R * cosf(sigma))) / 2;
+        pos[1] = (pos_current[1] + (f2[1] + R * sinf(sigma))) / 2;
+        pos[2] = pos_current[2];
+        setNewWaypoint(corner, pos, finalVelocity, SIGN(theta) * 1.0f / R);
+
+        // This is the point back on the path
+        pos[0] = f2[0];
+        pos[1] = f2[1];
+        pos[2] = pos_current[2];
+        setNewWaypoint(corner, pos, finalVelocity, -SIGN(theta) * 1.0f / R);
+    } else if (theta != 0) { // The two tangents have different directions
+        float R = fillet_radius;
+
+        // Remove 10cm to guarantee that no two points overlap. This would be better if we
+        // solved it by removing the next point instead.
+        if (q_current_mag > 0 && q_current_mag < fabsf(R / tanf(rho2)))
+            R = qMin(R, q_current_mag * fabsf(tanf(rho2)) - 0.1f);
+        if (q_future_mag > 0 && q_future_mag < fabsf(R / tanf(rho2)))
+            R = qMin(R, q_future_mag * fabsf(tanf(rho2)) - 0.1f);
+
+        corner.filleted = true;
+        corner.radius = R;
+
+        // Add the waypoint segment
+        float f1[3];
+        f1[0] = pos_current[0] - R / fabsf(tanf(rho2)) * q_current[0];
+        f1[1] = pos_current[1] - R / fabsf(tanf(rho2)) * q_current[1];
+        f1[2] = pos_current[2];
+        addNonCircleToSwitchingLoci(corner, f1, finalVelocity, curvature);
+
+        // Add the filleting segment in preparation for the next waypoint
+        float pos[3] = { pos_current[0] + R / fabsf(tanf(rho2)) * q_future[0],
+                         pos_current[1] + R / fabsf(tanf(rho2)) * q_future[1], pos_current[2] };
+        setNewWaypoint(corner, pos, finalVelocity, SIGN(theta) * 1.0f / R);
+
+    } else {
+        // In this case, the two tangents are colinear
+        addNonCircleToSwitchingLoci(corner, pos_current, finalVelocity, curvature);
+    }
 
     return true;
 }
 
 /**
- * @brief PathFillet::setNewWaypoint Store a waypoint in the new data model
- * @param index The waypoint to store
+ * @brief PathFillet::setNewWaypoint Add a waypoint to what a corner turns into
+ * @param corner The corner to add to
  * @param pos The position for this waypoint
  * @param velocity The velocity at this waypoint
  * @param curvature The curvature to enter this waypoint with
  */
-void PathFillet::setNewWaypoint(int index, float *pos, float velocity, float curvature)
+void PathFillet::setNewWaypoint(struct Corner &corner, float *pos, float velocity,
+                                float curvature)
 {
-    if (index >= new_model->rowCount() - 1)
-        new_model->insertRow(index);
-
     // Convert from curvature representation to waypoint
     quint8 mode = Waypoint::MODE_VECTOR;
     float radius = 0;
@@ -457,28 +552,31 @@ void PathFillet::setNewWaypoint(int index, float *pos, float velocity, float cur
         radius = -1.0 / curvature;
     }
 
-    new_model->setData(new_model->index(index, FlightDataModel::NED_NORTH), pos[0]);
-    new_model->setData(new_model->index(index, FlightDataModel::NED_EAST), pos[1]);
-    new_model->setData(new_model->index(index, FlightDataModel::NED_DOWN), pos[2]);
-    new_model->setData(new_model->index(index, FlightDataModel::VELOCITY), velocity);
-    new_model->setData(new_model->index(index, FlightDataModel::MODE_PARAMS), radius);
-    new_model->setData(new_model->index(index, FlightDataModel::MODE), mode);
+    PathPlanNED wp;
+    wp.north = pos[0];
+    wp.east = pos[1];
+    wp.down = pos[2];
+    wp.velocity = velocity;
+    wp.mode = mode;
+    wp.mode_params = radius;
+
+    corner.points.append(wp);
 }
 
 /**
  * @brief addNonCircleToSwitchingLoci In the case of pure circles, the given waypoint is for a
  * circle center,
  * so we have to convert it into a pair of switching loci.
+ * @param corner The corner to add to
  * @param position Switching locus
  * @param finalVelocity Final velocity to be attained along path
  * @param curvature Path curvature
- * @param index Current descriptor index
  * @return
  */
-int PathFillet::addNonCircleToSwitchingLoci(float position[3], float finalVelocity, float curvature,
-                                            int index)
+int PathFillet::addNonCircleToSwitchingLoci(struct Corner &corner, float position[3],
+                                            float finalVelocity, float curvature)
 {
-    setNewWaypoint(index, position, finalVelocity, curvature);
+    setNewWaypoint(corner, position, finalVelocity, curvature);
 
     return 1;
 }
@@ -27,6 +27,8 @@
 #define PATHFILLET_H
 
 #include <ipathalgorithm.h>
+#include <flightdatamodel.h>
+#include <QVector>
 
 class PATHPLANNER_EXPORT PathFillet : public IPathAlgorithm
 {
@@ -61,19 +63,42 @@ private:
     //! Fileting radius to use
     double fillet_radius;
 
-    //! The new model to add data to while processing
-    FlightDataModel *new_model;
+    //! What one waypoint of the input turns into
+    struct Corner
+    {
+        QVector<PathPlanNED> points;
+        //! Radius of the fillet that was fit
+        float radius;
+        //! Whether the waypoint was filleted at all
+        bool filleted;
+    };
+
+    //! The path the corners were last computed for
+    QVector<PathPlanNED> input;
+
+    //! The corners, one per waypoint of input
+    QVector<struct Corner> corners;
+
+    //! The fillet radius the corners were computed with
+    double cached_radius;
 
 private:
     enum arc_center_results { CENTER_FOUND, COINCIDENT_POINTS, INSUFFICIENT_RADIUS };
 
     // Private functions
 
-    //! Set a waypoint in the new model
-    void setNewWaypoint(int index, float *pos, float velocity, float curvature);
+    //! Recompute the corners that changed since the last path
+    bool updateCorners(const QVector<PathPlanNED> &path);
+
+    //! Work out what one waypoint turns into
+    bool filletWaypoint(const QVector<PathPlanNED> &path, int wpIdx, const PathPlanNED *prev_exit,
+                        struct Corner &corner);
+
+    //! Add a waypoint to a corner
+    void setNewWaypoint(struct Corner &corner, float *pos, float velocity, float curvature);
 
-    int addNonCircleToSwitchingLoci(float position[3], float finalVelocity, float radius,
-                                    int index);
+    int addNonCircleToSwitchingLoci(struct Corner &corner, float position[3], float finalVelocity,
+                                    float curvature);
 
     //! Compute the magnitude of a vector
     float VectorMagnitude(float *);
@@ -812,6 +812,10 @@ bool FlightDataModel::setNED(int index, struct FlightDataModel::NED NED)
  */
 bool FlightDataModel::replaceData(FlightDataModel *newModel)
 {
+    // Validate once at the end rather than after every field
+    bool wasPaused = valPaused;
+    valPaused = true;
+
     // Delete existing data
     removeRows(0, rowCount());
 
@@ -823,6 +827,85 @@ bool FlightDataModel::replaceData(FlightDataModel *newModel)
         }
     }
 
+    valPaused = wasPaused;
+    fixupValidationErrors();
+
+    return true;
+}
+
+/**
+ * @brief FlightDataModel::getPathNED Get the whole path relative to home
+ * @return The waypoints in order
+ */
+QVector<PathPlanNED> FlightDataModel::getPathNED() const
+{
+    QVector<PathPlanNED> path;
+    path.reserve(dataStorage.length());
+
+    double homeLLA[3];
+    getHomeLocation(homeLLA);
+
+    Utils::CoordinateConversions conversions;
+
+    foreach (PathPlanData *row, dataStorage) {
+        double LLA[3] = { row->latPosition, row->lngPosition, row->altitude };
+        double f_NED[3];
+
+        conversions.LLA2NED_HomeLLA(LLA, homeLLA, f_NED);
+
+        PathPlanNED wp;
+        wp.north = f_NED[0];
+        wp.east = f_NED[1];
+        wp.down = f_NED[2];
+        wp.velocity = row->velocity;
+        wp.mode = row->mode;
+        wp.mode_params = row->mode_params;
+
+        path.append(wp);
+    }
+
+    return path;
+}
+
+/**
+ * @brief FlightDataModel::setPathNED Replace the whole path with one relative
+ * to home.  The model is reset and validated once, rather than for every field
+ * of every row.
+ * @param path The waypoints in order
+ * @return true if successful
+ */
+bool FlightDataModel::setPathNED(const QVector<PathPlanNED> &path)
+{
+    double homeLLA[3];
+    getHomeLocation(homeLLA);
+
+    Utils::CoordinateConversions conversions;
+
+    beginResetModel();
+
+    qDeleteAll(dataStorage);
+    dataStorage.clear();
+
+    foreach (const PathPlanNED &wp, path) {
+        double f_NED[3] = { wp.north, wp.east, wp.down };
+        double LLA[3];
+
+        conversions.NED2LLA_HomeLLA(homeLLA, f_NED, LLA);
+
+        PathPlanData *row = new PathPlanData;
+        row->latPosition = LLA[0];
+        row->lngPosition = LLA[1];
+        row->altitude = LLA[2];
+        row->velocity = wp.velocity;
+        row->mode = wp.mode;
+        row->mode_params = wp.mode_params;
+        row->locked = false;
+
+        dataStorage.append(row);
+    }
+
+    endResetModel();
+
     fixupValidationErrors();
 
     return true;
@@ -28,6 +28,7 @@
 #define FlightDataModel_H
 
 #include <QAbstractTableModel>
+#include <QVector>
 #include "pathplanner_global.h"
 
 /**
@@ -46,6 +47,21 @@ struct PathPlanData
     bool locked; //!< Lock a waypoint
 };
 
+/**
+ * @brief The PathPlanNED struct is a waypoint relative to home, as
+ * path algorithms work on it.  Fetched and stored for the whole path at
+ * once so the home location is only looked up once.
+ */
+struct PathPlanNED
+{
+    double north; //!< North of home (m)
+    double east; //!< East of home (m)
+    double down; //!< Below home (m)
+    float velocity; //!< Velocity associated with this waypoint
+    int mode; //!< Navigation mode for this waypoint
+    float mode_params; //!< Optional parameters associated with this waypoint
+};
+
 class PATHPLANNER_EXPORT FlightDataModel : public QAbstractTableModel
 {
     Q_OBJECT
@@ -85,6 +101,12 @@ public:
     //! Replace a model data with another model
     bool replaceData(FlightDataModel *newModel);
 
+    //! Get all the waypoints relative to home
+    QVector<PathPlanNED> getPathNED() const;
+
+    //! Replace all the waypoints with ones relative to home
+    bool setPathNED(const QVector<PathPlanNED> &path);
+
     //! Prevent validation/correction of data
     void pauseValidation(bool pausing);
 
@@ -33,6 +33,7 @@
 #include <QTextEdit>
 #include <QVBoxLayout>
 #include <QPushButton>
+#include <QMessageBox>
 
 #include "algorithms/pathfillet.h"
 #include "extensionsystem/pluginmanager.h"
@@ -40,6 +41,7 @@
 PathPlannerGadgetWidget::PathPlannerGadgetWidget(QWidget *parent)
     : QLabel(parent)
     , prevModel(NULL)
+    , filletAlgo(NULL)
 {
     ui = new Ui_PathPlanner();
     ui->setupUi(this);
@@ -168,15 +170,23 @@ void PathPlannerGadgetWidget::on_tbFilletPath_clicked()
     if (prevModel)
         prevModel->replaceData(model);
 
-    IPathAlgorithm *algo = new PathFillet(this);
+    if (!filletAlgo)
+        filletAlgo = new PathFillet(this);
+
     // Only process is successfully configured and the verification of the model succeeds
+    if (!filletAlgo->configure(this))
+        return;
+
     QString err;
-    if (algo->configure(this) && algo->verifyPath(model, err)) {
-        // If unsuccessful delete the cached model
-        if (!algo->processPath(model)) {
-            delete prevModel;
-            prevModel = NULL;
-        }
+    if (!filletAlgo->verifyPath(model, err)) {
+        QMessageBox::warning(this, tr("Cannot fillet path"), err);
+        return;
+    }
+
+    // If unsuccessful delete the cached model
+    if (!filletAlgo->processPath(model)) {
+        delete prevModel;
+        prevModel = NULL;
     }
 }
 
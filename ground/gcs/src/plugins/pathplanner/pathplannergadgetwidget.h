@@ -31,6 +31,7 @@
 #include <QItemSelectionModel>
 #include "flightdatamodel.h"
 #include "modeluavoproxy.h"
+#include "ipathalgorithm.h"
 
 class Ui_PathPlanner;
 
@@ -76,6 +77,9 @@ private:
 
     //! Store previous models for rolling back changes
     FlightDataModel *prevModel;
+
+    //! Kept between runs so unchanged corners need not be refilleted
+    IPathAlgorithm *filletAlgo;
     void enableButtons(bool);
 signals:
     void sendPathPlanToUAV();
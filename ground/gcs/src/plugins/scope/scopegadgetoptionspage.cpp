@@ -424,6 +424,13 @@ void ScopeGadgetOptionsPage::on_cmbUAVObjects_currentIndexChanged(QString val)
             continue;
 
         if (field->getElementNames().count() > 1) {
+            // A histogram can also take a whole array as counts already binned
+            int plotType = options_page->cmb2dPlotType
+                               ->itemData(options_page->cmb2dPlotType->currentIndex())
+                               .toInt();
+            if (plotType == Scopes2dConfig::HISTOGRAM)
+                options_page->cmbUAVField->addItem(field->getName());
+
             foreach (QString elemName, field->getElementNames()) {
                 options_page->cmbUAVField->addItem(field->getName() + "-" + elemName);
             }
@@ -675,6 +682,11 @@ void ScopeGadgetOptionsPage::on_cmb2dPlotType_currentIndexChanged(QString curren
         options_page->spnMaxNumBins->setSuffix(" bins");
         options_page->sw2dXAxis->setCurrentWidget(options_page->sw2dHistogramStack);
     }
+
+    // Which fields can be plotted depends on the plot type
+    QString field = options_page->cmbUAVField->currentText();
+    on_cmbUAVObjects_currentIndexChanged(options_page->cmbUAVObjects->currentText());
+    options_page->cmbUAVField->setCurrentIndex(options_page->cmbUAVField->findText(field));
 }
 
 /**
@@ -106,6 +106,21 @@ bool HistogramData::append(UAVObject *obj)
         if (numberOfBins > MAX_NUMBER_OF_INTERVALS)
             numberOfBins = MAX_NUMBER_OF_INTERVALS;
 
+        // A whole array field holds counts binned on board; show element i
+        // as the bin [i, i+1)
+        if (field && !haveSubField && field->getNumElements() > 1) {
+            histogramBins->clear();
+            histogramInterval->clear();
+
+            for (uint i = 0; i < field->getNumElements() && i < numberOfBins; i++) {
+                histogramInterval->append(QwtInterval(i, i + 1));
+                histogramBins->append(QwtIntervalSample(field->getDouble(i),
+                                                        histogramInterval->back()));
+            }
+
+            return true;
+        }
+
         if (field) {
             double currentValue =
                 valueAsDouble(obj, field, haveSubField, uavSubFieldName) * pow(10, scalePower);
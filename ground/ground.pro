@@ -30,11 +30,15 @@ TEMPLATE  = subdirs
 SUBDIRS = \
         sub_gcs \
         sub_uavobjects \
-        sub_uavobjgenerator
+        sub_uavobjgenerator \
+        sub_autotuneanalyzer
 
 # uavobjgenerator
 sub_uavobjgenerator.subdir = uavobjgenerator
 
+# autotuneanalyzer
+sub_autotuneanalyzer.subdir = autotuneanalyzer
+
 # uavobjects
 sub_uavobjects.subdir  = uavobjects
 sub_uavobjects.depends = sub_uavobjgenerator
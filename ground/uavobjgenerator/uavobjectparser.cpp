@@ -889,9 +889,24 @@ QString UAVObjectParser::processObjectAttributes(QDomNode& node, ObjectInfo* inf
         return QString("Object:settings attribute value is invalid");
 
 
-    // Settings objects can only have a single instance
-    if ( info->isSettings && !info->isSingleInst )
-        return QString("Object: Settings objects can not have multiple instances");
+    // Get maxinstances attribute if present; it only sizes the flight
+    // side storage, so it is deliberately left out of the object hash
+    info->maxInstances = 0;
+    attr = attributes.namedItem("maxinstances");
+    if ( !attr.isNull() )
+    {
+        bool ok;
+        info->maxInstances = attr.nodeValue().toInt(&ok);
+        if ( !ok || info->maxInstances < 1 )
+            return QString("Object:maxinstances attribute value is invalid");
+        if ( info->isSingleInst )
+            return QString("Object:maxinstances is only valid for multiple instance objects");
+    }
+
+    // Settings objects with multiple instances must say how many to expect;
+    // each instance is stored separately in flash
+    if ( info->isSettings && !info->isSingleInst && info->maxInstances == 0 )
+        return QString("Object: Settings objects with multiple instances need maxinstances");
 
     // Done
     return QString();
@@ -110,6 +110,7 @@ struct ObjectInfo_s {
     quint32 id;
     bool isSingleInst;
     bool isSettings;
+    int maxInstances; /** Expected instance count of a multi instance object, sizes its storage; 0 if unknown */
     AccessMode gcsAccess;
     AccessMode flightAccess;
     bool flightTelemetryAcked;
@@ -62,6 +62,17 @@ THUMB   = -mthumb
 
 CFLAGS += '-DDRONIN_TARGET="$(BOARD_NAME)"'
 
+# Record a timeline of task switches, queue and object events; see
+# pios_trace.h and python/dronin-trace
+ifeq ($(ENABLE_TRACE), YES)
+CFLAGS += -DPIOS_INCLUDE_TRACE
+endif
+
+# Histograms of control loop jitter, run time and latency, in LoopTiming
+ifeq ($(LOOPTIMING_DIAGNOSTICS), YES)
+CFLAGS += -DLOOPTIMING_DIAGNOSTICS
+endif
+
 # Test if quotes are needed for the echo-command
 result = ${shell echo "test"}
 ifeq (${result}, test)
@@ -0,0 +1,187 @@
+# Copyright (C) 2017 dRonin, http://dronin.org
+# Licensed under the GNU LGPL version 2.1 or any later version (see COPYING.LESSER)
+
+""" Converts the flight controller's trace recording (see pios_trace.h) to
+Chrome trace event JSON, which chrome://tracing and Perfetto display. """
+
+from __future__ import print_function
+
+import json
+
+from struct import Struct
+
+MAGIC = b'TRCE'
+
+# Must match enum pios_trace_type
+TASK_SWITCH = 1
+QUEUE_SEND = 2
+QUEUE_RECEIVE = 3
+UAVO_SET = 4
+IRQ_ENTER = 5
+IRQ_EXIT = 6
+MARK = 7
+BEGIN = 8
+END = 9
+
+# Must match enum pios_trace_marker
+MARKER_GYROS = 0
+MARKER_ACTUATOR = 3
+
+header_fmt = Struct('<4sHHIII')
+name_fmt = Struct('<IB19s')
+event_fmt = Struct('<IIB')
+
+# Fixed track ids for what isn't a thread
+PID = 1
+TID_IRQ = 1
+TID_LATENCY = 2
+TID_EVENTS = 3
+
+class TraceError(Exception):
+    pass
+
+class Trace(object):
+    def __init__(self, data):
+        if len(data) < header_fmt.size:
+            raise TraceError("Trace too short")
+
+        (magic, version, num_names, num_events, raw_span,
+                us_span) = header_fmt.unpack_from(data, 0)
+
+        if magic != MAGIC:
+            raise TraceError("Not a trace")
+
+        if version != 1:
+            raise TraceError("Unknown trace version %d" % (version))
+
+        offset = header_fmt.size
+
+        self.names = {}
+
+        for i in range(num_names):
+            arg, typ, name = name_fmt.unpack_from(data, offset)
+            offset += name_fmt.size
+
+            name = name.split(b'\0', 1)[0].decode('ascii', 'replace')
+            self.names[(typ, arg)] = name
+
+        if len(data) < offset + num_events * event_fmt.size:
+            raise TraceError("Trace truncated")
+
+        self.events = []
+
+        # Raw timestamps wrap; unwrap them by the signed distance from
+        # the previous event
+        if num_events:
+            prev = event_fmt.unpack_from(data, offset)[0]
+        ticks = 0
+
+        for i in range(num_events):
+            stamp, arg, typ = event_fmt.unpack_from(data, offset)
+            offset += event_fmt.size
+
+            delta = (stamp - prev) & 0xffffffff
+            if delta >= 0x80000000:
+                delta -= 0x100000000
+
+            ticks += delta
+            prev = stamp
+
+            self.events.append((ticks * float(us_span) / raw_span, typ, arg))
+
+    def name(self, typ, arg, default=None):
+        return self.names.get((typ, arg), default)
+
+    def to_chrome(self, uavo_defs=None):
+        """ Returns the trace as a list of Chrome trace events.
+
+        uavo_defs, a UAVOCollection, names the objects that are set. """
+
+        out = []
+
+        def meta(tid, name):
+            out.append({'ph': 'M', 'name': 'thread_name', 'pid': PID,
+                'tid': tid, 'args': {'name': name}})
+
+        meta(TID_IRQ, 'Interrupts')
+        meta(TID_LATENCY, 'Gyro to actuator')
+        meta(TID_EVENTS, 'Events')
+
+        # Threads get tids after the fixed ones
+        tids = {}
+
+        def thread_tid(thread):
+            if thread not in tids:
+                tids[thread] = 16 + len(tids)
+                meta(tids[thread], self.name(TASK_SWITCH, thread,
+                    '0x%08x' % (thread)))
+
+            return tids[thread]
+
+        def uavo_name(obj_id):
+            if uavo_defs is not None:
+                u = uavo_defs.get('{0:08x}'.format(obj_id))
+                if u is not None:
+                    return u._name[5:]
+
+            return '0x%08x' % (obj_id)
+
+        def marker_name(marker):
+            return self.name(MARK, marker, 'Marker %d' % (marker))
+
+        running = None
+        running_since = None
+        irq_stack = []
+        gyro_time = None
+        current_tid = TID_EVENTS
+
+        for ts, typ, arg in self.events:
+            if typ == TASK_SWITCH:
+                if running is not None:
+                    out.append({'ph': 'X', 'name': 'running', 'pid': PID,
+                        'tid': thread_tid(running), 'ts': running_since,
+                        'dur': ts - running_since})
+
+                running = arg
+                running_since = ts
+                current_tid = thread_tid(arg)
+            elif typ == QUEUE_SEND or typ == QUEUE_RECEIVE:
+                out.append({'ph': 'i', 's': 't',
+                    'name': 'send' if typ == QUEUE_SEND else 'receive',
+                    'pid': PID, 'tid': current_tid, 'ts': ts,
+                    'args': {'queue': '0x%08x' % (arg)}})
+            elif typ == UAVO_SET:
+                out.append({'ph': 'i', 's': 't',
+                    'name': 'set ' + uavo_name(arg),
+                    'pid': PID, 'tid': current_tid, 'ts': ts})
+            elif typ == IRQ_ENTER:
+                irq_stack.append((ts, arg))
+            elif typ == IRQ_EXIT:
+                # The start may have been overwritten
+                if irq_stack:
+                    start, irq = irq_stack.pop()
+                    out.append({'ph': 'X', 'name': 'IRQ %d' % (irq),
+                        'pid': PID, 'tid': TID_IRQ, 'ts': start,
+                        'dur': ts - start})
+            elif typ == MARK:
+                out.append({'ph': 'i', 's': 't', 'name': marker_name(arg),
+                    'pid': PID, 'tid': current_tid, 'ts': ts})
+
+                if arg == MARKER_GYROS:
+                    if gyro_time is None:
+                        gyro_time = ts
+                elif arg == MARKER_ACTUATOR and gyro_time is not None:
+                    out.append({'ph': 'X', 'name': 'latency',
+                        'pid': PID, 'tid': TID_LATENCY, 'ts': gyro_time,
+                        'dur': ts - gyro_time})
+                    gyro_time = None
+            elif typ == BEGIN or typ == END:
+                out.append({'ph': 'B' if typ == BEGIN else 'E',
+                    'name': marker_name(arg), 'pid': PID,
+                    'tid': current_tid, 'ts': ts})
+
+        return out
+
+    def to_json(self, uavo_defs=None):
+        return json.dumps({'traceEvents': self.to_chrome(uavo_defs),
+            'displayTimeUnit': 'ns'}, indent=1)